@@ -22,15 +22,38 @@ struct PassConstants
 	float4x4 projectionMatrix;
 };
 
-struct PerObjectConstants
+// NOTE: Must match Styx::PerDrawData in DrawData.h
+struct PerDrawData
 {
-	float4x4 worldMatrix;
+	uint transformIndex;
 	uint vertexOffset;
 	uint positionBufferIndex;
 	uint normalBufferIndex;
 	uint tangentBufferIndex;
 	uint uvBufferIndex;
+	uint materialIndex;
+	uint padding;
 };
 
+// Root constants: only drawId changes between draws, the buffer indices are set once per pass
+struct DrawConstants
+{
+	uint drawId;
+	uint drawDataBufferIndex;
+	uint transformBufferIndex;
+};
+
+PerDrawData LoadPerDrawData(DrawConstants drawConstants)
+{
+	StructuredBuffer<PerDrawData> drawDataBuffer = ResourceDescriptorHeap[drawConstants.drawDataBufferIndex];
+	return drawDataBuffer[drawConstants.drawId];
+}
+
+float4x4 LoadTransform(DrawConstants drawConstants, PerDrawData drawData)
+{
+	StructuredBuffer<float4x4> transformBuffer = ResourceDescriptorHeap[drawConstants.transformBufferIndex];
+	return transformBuffer[drawData.transformIndex];
+}
+
 
 #endif // __COMMON_HLSL_
\ No newline at end of file
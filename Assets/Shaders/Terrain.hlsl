@@ -0,0 +1,124 @@
+#include "Assets/Shaders/Common.hlsl"
+
+// NOTE: Must match TerrainPassConstants in TerrainRenderer.cpp
+struct TerrainPassConstants
+{
+	float4x4 viewMatrix;
+	float4x4 projectionMatrix;
+	float3 cameraPosition;
+};
+
+// NOTE: Must match TerrainObjectConstants in TerrainRenderer.cpp
+struct TerrainObjectConstants
+{
+	uint vertexOffset;
+	uint positionBufferIndex;
+	uint uvBufferIndex;
+	uint patchBufferIndex;
+	uint patchGridResolution;
+	float terrainHeight;
+	float skirtDepth;
+};
+
+// NOTE: Must match TerrainPatchInstance in TerrainRenderer.cpp
+struct TerrainPatch
+{
+	float originX;
+	float originZ;
+	float size;
+	float morphStart;
+	float morphScale;
+	float heightmapOffsetX;
+	float heightmapOffsetY;
+	float heightmapScale;
+	uint heightmapIndex;
+	uint normalMapIndex;
+	uint weightMapIndex;
+};
+
+ConstantBuffer<TerrainPassConstants> PassConstantBuffer : register(b0, perPassSpace);
+ConstantBuffer<TerrainObjectConstants> ObjectConstantBuffer : register(b0, perObjectSpace);
+
+static const float3 SUN_DIRECTION = float3(0.4, 0.8, 0.45);
+
+// Grass, rock, snow and sand, in the order of the materials TerrainRenderer::InitializeTiles describes, until they
+// have their own textures
+static const float3 MATERIAL_COLORS[4] =
+{
+	float3(0.16, 0.3, 0.08),
+	float3(0.33, 0.3, 0.27),
+	float3(0.85, 0.87, 0.9),
+	float3(0.6, 0.53, 0.36),
+};
+
+struct Interpolators
+{
+	float4 position : SV_POSITION;
+	float3 positionWS : WORLD_POSITION;
+	// Texel centres of the tile's heightmap and surface maps
+	float2 mapUV : TEXCOORD0;
+	nointerpolation uint normalMapIndex : NORMAL_MAP_INDEX;
+	nointerpolation uint weightMapIndex : WEIGHT_MAP_INDEX;
+};
+
+float SampleHeight(Texture2D<float> heightmap, SamplerState heightmapSampler, TerrainPatch patch, float2 uv)
+{
+	float2 mapUV = float2(patch.heightmapOffsetX, patch.heightmapOffsetY) + uv * patch.heightmapScale;
+	return heightmap.SampleLevel(heightmapSampler, mapUV, 0.0) * ObjectConstantBuffer.terrainHeight;
+}
+
+Interpolators VertexShader(uint vertexId : SV_VertexID, uint instanceId : SV_InstanceID)
+{
+	ByteAddressBuffer positionBuffer = ResourceDescriptorHeap[ObjectConstantBuffer.positionBufferIndex];
+	ByteAddressBuffer uvBuffer = ResourceDescriptorHeap[ObjectConstantBuffer.uvBufferIndex];
+	StructuredBuffer<TerrainPatch> patchBuffer = ResourceDescriptorHeap[ObjectConstantBuffer.patchBufferIndex];
+	SamplerState heightmapSampler = SamplerDescriptorHeap[linearClampSampler];
+
+	TerrainPatch patch = patchBuffer[instanceId];
+	Texture2D<float> heightmap = ResourceDescriptorHeap[NonUniformResourceIndex(patch.heightmapIndex)];
+
+	uint vertexIndex = vertexId + ObjectConstantBuffer.vertexOffset;
+	float3 position = positionBuffer.Load<float3>(vertexIndex * sizeof(float3));
+	float2 uv = uvBuffer.Load<float2>(vertexIndex * sizeof(float2));
+
+	// Odd vertices slide onto the next level's grid, which has every other one, as they get further from the camera.
+	// Like TerrainLodSelector::ComputeMorphFactor, the distance is taken to the unmorphed vertex.
+	float2 origin = float2(patch.originX, patch.originZ);
+	float3 unmorphed = float3(origin.x + uv.x * patch.size, SampleHeight(heightmap, heightmapSampler, patch, uv), origin.y + uv.y * patch.size);
+	float morph = saturate((distance(unmorphed, PassConstantBuffer.cameraPosition) - patch.morphStart) * patch.morphScale);
+
+	float resolution = float(ObjectConstantBuffer.patchGridResolution);
+	float2 gridPosition = round(uv * resolution);
+	uv -= frac(gridPosition * 0.5) * (2.0 / resolution) * morph;
+
+	Interpolators output;
+	output.positionWS = float3(origin.x + uv.x * patch.size, SampleHeight(heightmap, heightmapSampler, patch, uv), origin.y + uv.y * patch.size);
+	// Skirt vertices hang below the grid
+	output.positionWS.y += position.y * ObjectConstantBuffer.skirtDepth;
+	output.position = mul(PassConstantBuffer.viewMatrix, float4(output.positionWS, 1.0));
+	output.position = mul(PassConstantBuffer.projectionMatrix, output.position);
+	output.mapUV = float2(patch.heightmapOffsetX, patch.heightmapOffsetY) + uv * patch.heightmapScale;
+	output.normalMapIndex = patch.normalMapIndex;
+	output.weightMapIndex = patch.weightMapIndex;
+
+	return output;
+}
+
+float4 PixelShader(Interpolators input) : SV_TARGET
+{
+	Texture2D<float2> normalMap = ResourceDescriptorHeap[NonUniformResourceIndex(input.normalMapIndex)];
+	Texture2D<float4> weightMap = ResourceDescriptorHeap[NonUniformResourceIndex(input.weightMapIndex)];
+	SamplerState mapSampler = SamplerDescriptorHeap[linearClampSampler];
+
+	// Octahedral upper hemisphere, see TerrainSurfaceMaps::ComputeNormals
+	float2 encodedNormal = normalMap.Sample(mapSampler, input.mapUV);
+	float3 normal = normalize(float3(encodedNormal.x, 1.0 - abs(encodedNormal.x) - abs(encodedNormal.y), encodedNormal.y));
+
+	// The weights sum to one up to rounding and filtering
+	float4 weights = weightMap.Sample(mapSampler, input.mapUV);
+	float3 albedo = weights.x * MATERIAL_COLORS[0] + weights.y * MATERIAL_COLORS[1] + weights.z * MATERIAL_COLORS[2] + weights.w * MATERIAL_COLORS[3];
+	albedo /= max(dot(weights, 1.0), 1e-3);
+
+	float lighting = 0.3 + 0.7 * saturate(dot(normal, normalize(SUN_DIRECTION)));
+	return float4(albedo * lighting, 1.0);
+}
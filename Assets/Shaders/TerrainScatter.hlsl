@@ -0,0 +1,69 @@
+#include "Assets/Shaders/Common.hlsl"
+
+// NOTE: Must match TerrainPassConstants in TerrainRenderer.cpp
+struct TerrainPassConstants
+{
+	float4x4 viewMatrix;
+	float4x4 projectionMatrix;
+	float3 cameraPosition;
+};
+
+// NOTE: Must match TerrainScatterObjectConstants in TerrainRenderer.cpp
+struct TerrainScatterObjectConstants
+{
+	uint positionBufferIndex;
+	uint instanceBufferIndex;
+	uint firstInstance;
+	float boundsRadius;
+	float3 color;
+};
+
+// NOTE: Must match Styx::TerrainScatterInstance in TerrainScatter.h
+struct ScatterInstance
+{
+	float3 position;
+	float yaw;
+	float scale;
+};
+
+ConstantBuffer<TerrainPassConstants> PassConstantBuffer : register(b0, perPassSpace);
+ConstantBuffer<TerrainScatterObjectConstants> ObjectConstantBuffer : register(b0, perObjectSpace);
+
+static const float3 SUN_DIRECTION = float3(0.4, 0.8, 0.45);
+
+struct Interpolators
+{
+	float4 position : SV_POSITION;
+	float3 positionWS : WORLD_POSITION;
+};
+
+Interpolators VertexShader(uint vertexId : SV_VertexID, uint instanceId : SV_InstanceID)
+{
+	ByteAddressBuffer positionBuffer = ResourceDescriptorHeap[ObjectConstantBuffer.positionBufferIndex];
+	StructuredBuffer<ScatterInstance> instanceBuffer = ResourceDescriptorHeap[ObjectConstantBuffer.instanceBufferIndex];
+
+	ScatterInstance instance = instanceBuffer[ObjectConstantBuffer.firstInstance + instanceId];
+	float3 position = positionBuffer.Load<float3>(vertexId * sizeof(float3)) * (instance.scale * ObjectConstantBuffer.boundsRadius);
+
+	// Turned by yaw around +Y, like XMMatrixRotationY
+	float sine;
+	float cosine;
+	sincos(instance.yaw, sine, cosine);
+
+	Interpolators output;
+	output.positionWS = float3(cosine * position.x + sine * position.z, position.y, cosine * position.z - sine * position.x) + instance.position;
+	output.position = mul(PassConstantBuffer.viewMatrix, float4(output.positionWS, 1.0));
+	output.position = mul(PassConstantBuffer.projectionMatrix, output.position);
+
+	return output;
+}
+
+float4 PixelShader(Interpolators input) : SV_TARGET
+{
+	// The placeholder mesh is faceted, the face normal comes from the screen space derivatives, turned towards the camera
+	float3 normal = normalize(cross(ddx(input.positionWS), ddy(input.positionWS)));
+	normal = dot(normal, PassConstantBuffer.cameraPosition - input.positionWS) < 0.0 ? -normal : normal;
+
+	float lighting = 0.3 + 0.7 * saturate(dot(normal, normalize(SUN_DIRECTION)));
+	return float4(ObjectConstantBuffer.color * lighting, 1.0);
+}
@@ -19,8 +19,12 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <Core/FramePipeline.h>
+#include <Core/JobSystem.h>
 #include <Core/Window.h>
 #include <RHI/D3D12Lite.h>
+#include <Renderer/HeightfieldImporter.h>
+#include <Renderer/HeightmapReader.h>
 #include <Renderer/Model.h>
 #include <Renderer/TerrainRenderer.h>
 #include <imgui/imgui.h>
@@ -28,15 +32,21 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <imgui/backends/imgui_impl_dx12.h>
 
 #include <memory>
+#include <mutex>
 #include <array>
+#include <thread>
+#include <vector>
 
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 using namespace Styx;
 
 // GPU resources
 DXGI_FORMAT g_depthFormat = DXGI_FORMAT_D32_FLOAT;
-std::unique_ptr<D3D12Lite::TextureResource> g_depthBuffer;
+D3D12Lite::TextureHandle g_depthBuffer;
 
 DirectX::XMVECTOR g_worldForward = DirectX::XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
 DirectX::XMVECTOR g_worldRight = DirectX::XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
@@ -51,6 +61,70 @@ float g_inputForwardAxis = 0.0f;
 float g_inputRightAxis = 0.0f;
 float g_inputUpAxis = 0.0f;
 
+// Owned copy of a frame's ImGui draw data, since ImGui reuses its draw lists as soon as the next frame starts
+struct ImGuiDrawDataSnapshot
+{
+	ImDrawData drawData;
+	std::vector<ImDrawList*> drawLists;
+
+	void Capture(const ImDrawData* source)
+	{
+		Clear();
+
+		drawData = *source;
+		for (int i = 0; i < source->CmdListsCount; i++)
+		{
+			drawLists.push_back(source->CmdLists[i]->CloneOutput());
+		}
+
+		drawData.CmdLists = drawLists.data();
+	}
+
+	void Clear()
+	{
+		for (ImDrawList* drawList : drawLists)
+		{
+			IM_DELETE(drawList);
+		}
+
+		drawLists.clear();
+	}
+
+	~ImGuiDrawDataSnapshot() { Clear(); }
+};
+
+// Everything the render stage needs from the update stage. The renderer draws a single terrain and has no draw list
+// yet, so the camera is all it needs to know about what is visible.
+struct FramePacket
+{
+	Camera camera;
+	HeightfieldNoiseMaterialConstants terrainMaterialConstants;
+	ImGuiDrawDataSnapshot ui;
+};
+
+// Written by the render stage after each frame, shown by the UI of a later frame
+struct RenderStatistics
+{
+	D3D12Lite::DescriptorTableStats descriptorTableStats;
+	uint32_t srvHeapPeakAllocatedDescriptors = 0;
+	uint32_t srvHeapNumDescriptors = 0;
+	uint32_t numPendingReleases = 0;
+	uint64_t pendingReleaseBytes = 0;
+	uint64_t peakPendingReleaseBytes = 0;
+	uint64_t constantUploadPeakBytes = 0;
+	uint64_t constantUploadCapacity = 0;
+	uint32_t numSkippedDraws = 0;
+	TerrainTileStreamerStats terrainTileStats;
+	TerrainLodStats terrainLodStats;
+	TerrainScatterStats terrainScatterStats;
+	TerrainSurfaceMapsStats terrainSurfaceMapsStats;
+};
+
+FramePipeline<FramePacket> g_framePipeline;
+HeightfieldNoiseMaterialConstants g_terrainMaterialConstants;
+std::mutex g_renderStatisticsMutex;
+RenderStatistics g_renderStatistics;
+
 void ImGuiHierarchyForModel(Model* model, bool first)
 {
 	if (first)
@@ -72,16 +146,89 @@ void ImGuiHierarchyForModel(Model* model, bool first)
 	}
 }
 
+bool HasExtension(const char* path, const char* extension)
+{
+	const size_t pathLength = strlen(path);
+	const size_t extensionLength = strlen(extension);
+	if (pathLength < extensionLength)
+	{
+		return false;
+	}
+
+	for (size_t charIndex = 0; charIndex < extensionLength; charIndex++)
+	{
+		if (tolower(static_cast<unsigned char>(path[pathLength - extensionLength + charIndex])) != extension[charIndex])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Editor --import <heightmap.png | heightmap.raw> <output> [width height]
+// Cuts a 16 bit RAW or a grayscale PNG heightmap into a tile file the editor streams when it's passed on the command
+// line. RAW files don't store their size, it's given after the output.
+int ImportHeightmap(int argc, char** argv)
+{
+	const bool isRaw = argc == 6 && HasExtension(argv[2], ".raw");
+	const bool isPng = argc == 4 && HasExtension(argv[2], ".png");
+	if (!isRaw && !isPng)
+	{
+		printf("Usage: %s --import <heightmap.png> <output>\n", argv[0]);
+		printf("       %s --import <heightmap.raw> <output> <width> <height>\n", argv[0]);
+		return 1;
+	}
+
+	HeightmapReader reader;
+	const bool isOpen = isRaw ? reader.OpenRaw(argv[2], static_cast<uint32_t>(strtoul(argv[4], nullptr, 10)), static_cast<uint32_t>(strtoul(argv[5], nullptr, 10))) : reader.OpenPng(argv[2]);
+	if (!isOpen)
+	{
+		printf("[Import] Could not open the heightmap %s\n", argv[2]);
+		return 1;
+	}
+
+	// The main thread becomes job thread 0, so the tiles of each band are built on every core
+	JobSystem::Initialize();
+
+	HeightfieldImportStats stats;
+	const bool isImported = ImportHeightfield(reader, HeightfieldImportDesc{}, argv[3], &stats);
+
+	JobSystem::Shutdown();
+
+	if (!isImported)
+	{
+		printf("[Import] Could not import %s into %s\n", argv[2], argv[3]);
+		return 1;
+	}
+
+	printf("[Import] %s: %u x %u heights into %u x %u tiles of %u mips, %.2f MB written to %s\n", argv[2], stats.width, stats.height,
+		stats.numTilesX, stats.numTilesY, stats.numMips, stats.numBytesWritten / (1024.0 * 1024.0), argv[3]);
+	printf("[Import] %.0f ms (read %.0f ms, build %.0f ms, write %.0f ms), %.1f Msamples/s, peak memory %.2f MB\n", stats.timeInMilliseconds,
+		stats.readTimeInMilliseconds, stats.buildTimeInMilliseconds, stats.writeTimeInMilliseconds, stats.GetMegasamplesPerSecond(),
+		stats.peakMemoryInBytes / (1024.0 * 1024.0));
+	return 0;
+}
+
 // NOTE(gmodarelli): This is all temporary test code to test the current WIP implementation
 // of the RHI
-int main()
+int main(int argc, char** argv)
 {
+	if (argc > 1 && strcmp(argv[1], "--import") == 0)
+	{
+		return ImportHeightmap(argc, argv);
+	}
+
 	Window::Initialize();
+	// The main thread becomes job thread 0. The render thread and the terrain's tile generator threads register with the
+	// job system, so the loops they run, e.g. the surface map updates and the tile noise, spread over the workers.
+	JobSystemDesc jobSystemDesc;
+	jobSystemDesc.numExternalThreads = 1 + TerrainTileStreamerDesc{}.numGeneratorThreads;
+	JobSystem::Initialize(jobSystemDesc);
 
 	D3D12Lite::Uint2 screenSize(Window::GetWidth(), Window::GetHeight());
 	std::unique_ptr<D3D12Lite::Device> device = std::make_unique<D3D12Lite::Device>(Window::GetWindowHandle(), screenSize);
 	std::unique_ptr<D3D12Lite::GraphicsContext> graphicsContext = device->CreateGraphicsContext();
-	std::unique_ptr<D3D12Lite::ComputeContext> computeContext = device->CreateComputeContext();
 
 	// Create the depth buffer
 	{
@@ -97,7 +244,8 @@ int main()
 	g_freeFlyCamera.projection = DirectX::XMMatrixPerspectiveFovLH(DirectX::XMConvertToRadians(45.0f), screenSize.x / (float)screenSize.y, 0.01f, 1000.0f);
 
 	TerrainRenderer terrainRenderer(device.get());
-	terrainRenderer.Initialize();
+	// A heightfield imported with --import can be passed on the command line, noise is streamed otherwise
+	terrainRenderer.Initialize(argc > 1 ? argv[1] : nullptr);
 
 	// ImGUI
 	{
@@ -115,14 +263,84 @@ int main()
 		Window::HackHackHack();
 	}
 
+	g_terrainMaterialConstants = terrainRenderer.m_MaterialConstants;
+
+	// NOTE: Render stage. Owns the device and the contexts from here on, until the pipeline is stopped. The only
+	// exception is the swapchain resize, which the update stage does while the render stage is idle.
+	std::thread renderThread([&]()
+	{
+		const bool isJobThread = JobSystem::RegisterThread();
+
+		while (const FramePacket* packet = g_framePipeline.BeginRender())
+		{
+			device->BeginFrame();
+
+			D3D12Lite::TextureResource& backBuffer = device->GetCurrentBackBuffer();
+
+			Camera camera = packet->camera;
+			terrainRenderer.m_MaterialConstants = packet->terrainMaterialConstants;
+			terrainRenderer.Render(graphicsContext.get(), camera, &backBuffer, &device->GetTexture(g_depthBuffer));
+
+			// ImGUI
+			{
+				D3D12Lite::PipelineInfo pipeline;
+				pipeline.mPipeline = nullptr;
+				pipeline.mRenderTargets.push_back(&backBuffer);
+				graphicsContext->SetPipeline(pipeline);
+				ImGui_ImplDX12_RenderDrawData(const_cast<ImDrawData*>(&packet->ui.drawData), graphicsContext->GetCommandList());
+			}
+
+			graphicsContext->AddBarrier(backBuffer, D3D12_RESOURCE_STATE_PRESENT);
+			graphicsContext->FlushBarriers();
+
+			device->SubmitContextWork(*graphicsContext, terrainRenderer.GetGraphicsDependencies());
+
+			device->EndFrame();
+			device->Present();
+
+			// Stats of the frame just presented, before the next BeginFrame resets them
+			{
+				D3D12Lite::RenderPassDescriptorHeap& srvHeap = device->GetSRVHeap(device->GetFrameId());
+
+				std::lock_guard<std::mutex> lock(g_renderStatisticsMutex);
+				g_renderStatistics.descriptorTableStats = device->GetFrameDescriptorTableStats();
+				g_renderStatistics.srvHeapPeakAllocatedDescriptors = srvHeap.GetPeakAllocatedUserDescriptors();
+				g_renderStatistics.srvHeapNumDescriptors = srvHeap.GetNumUserDescriptors();
+				g_renderStatistics.numPendingReleases = device->GetNumPendingReleases();
+				g_renderStatistics.pendingReleaseBytes = device->GetPendingReleaseBytes();
+				g_renderStatistics.peakPendingReleaseBytes = device->GetPeakPendingReleaseBytes();
+				g_renderStatistics.constantUploadPeakBytes = device->GetConstantAllocator().GetPeakAllocatedBytes();
+				g_renderStatistics.constantUploadCapacity = device->GetConstantAllocator().GetCapacity();
+				g_renderStatistics.numSkippedDraws = device->GetFrameNumSkippedDraws();
+				g_renderStatistics.terrainTileStats = terrainRenderer.GetTileStreamerStats();
+				g_renderStatistics.terrainLodStats = terrainRenderer.GetLodStats();
+				g_renderStatistics.terrainScatterStats = terrainRenderer.GetScatterStats();
+				g_renderStatistics.terrainSurfaceMapsStats = terrainRenderer.GetSurfaceMapsStats();
+			}
+
+			g_framePipeline.EndRender();
+		}
+
+		if (isJobThread)
+		{
+			JobSystem::UnregisterThread();
+		}
+	});
+
+	// Update stage. Runs on the main thread, since that's where SDL wants its events pumped, one frame ahead of the
+	// render stage at most.
 	while (!Window::ShouldClose())
 	{
+		FramePacket& packet = g_framePipeline.BeginUpdate();
+
 		Window::Tick();
 		float deltaTime = Window::GetDeltaTime();
 
 		D3D12Lite::Uint2 swapchainSize = device->GetScreenSize();
 		if (swapchainSize.x != Window::GetWidth() || swapchainSize.y != Window::GetHeight())
 		{
+			g_framePipeline.WaitForIdle();
+
 			if (device->ResizeSwapchain(Window::GetWindowHandle(), D3D12Lite::Uint2{ Window::GetWidth(), Window::GetHeight() }))
 			{
 				printf("[Main] The SwapChain has been resized to (%d x %d)\n", Window::GetWidth(), Window::GetHeight());
@@ -200,84 +418,122 @@ int main()
 			updateFreeFlyCamera();
 		}
 
-		// Render
+		// ImGUI
 		{
-			device->BeginFrame();
+			ImGui_ImplSDL2_NewFrame();
+			ImGui_ImplDX12_NewFrame();
+			ImGui::NewFrame();
 
-			// ImGUI
+			// ImGui::Begin("Hierarchy");
+			// {
+			// 	ImGuiHierarchyForModel(scene.m_Root, true);
+			// }
+			// ImGui::End();
+
+			ImGui::Begin("Camera");
 			{
-				ImGui_ImplSDL2_NewFrame();
-				ImGui_ImplDX12_NewFrame();
-				ImGui::NewFrame();
+				// Position
+				{
+					DirectX::XMFLOAT3 p;
+					DirectX::XMStoreFloat3(&p, g_freeFlyCamera.position);
+					float position[3] = { p.x, p.y, p.z };
 
-				// ImGui::Begin("Hierarchy");
-				// {
-				// 	ImGuiHierarchyForModel(scene.m_Root, true);
-				// }
-				// ImGui::End();
+					if (ImGui::InputFloat3("Position", position))
+					{
+						g_freeFlyCamera.position = DirectX::XMVectorSet(position[0], position[1], position[2], 0.0f);
+					}
+				}
 
-				ImGui::Begin("Camera");
+				// Yaw & Pitch
 				{
-					// Position
+					float yawDeg = DirectX::XMConvertToDegrees(g_freeFlyCamera.yaw);
+					float pitchDeg = DirectX::XMConvertToDegrees(g_freeFlyCamera.pitch);
+					if (ImGui::InputFloat("Yaw", &yawDeg))
 					{
-						DirectX::XMFLOAT3 p;
-						DirectX::XMStoreFloat3(&p, g_freeFlyCamera.position);
-						float position[3] = { p.x, p.y, p.z };
-
-						if (ImGui::InputFloat3("Position", position))
-						{
-							g_freeFlyCamera.position = DirectX::XMVectorSet(position[0], position[1], position[2], 0.0f);
-						}
+						g_freeFlyCamera.yaw = DirectX::XMConvertToRadians(yawDeg);
 					}
 
-					// Yaw & Pitch
+					if (ImGui::InputFloat("Pitch", &pitchDeg))
 					{
-						float yawDeg = DirectX::XMConvertToDegrees(g_freeFlyCamera.yaw);
-						float pitchDeg = DirectX::XMConvertToDegrees(g_freeFlyCamera.pitch);
-						if (ImGui::InputFloat("Yaw", &yawDeg))
-						{
-							g_freeFlyCamera.yaw = DirectX::XMConvertToRadians(yawDeg);
-						}
-
-						if (ImGui::InputFloat("Pitch", &pitchDeg))
-						{
-							pitchDeg = pitchDeg < -80.0f ? -80.0f : pitchDeg;
-							pitchDeg = pitchDeg > 80.0f ? 80.0f : pitchDeg;
-
-							g_freeFlyCamera.pitch = DirectX::XMConvertToRadians(pitchDeg);
-						}
+						pitchDeg = pitchDeg < -80.0f ? -80.0f : pitchDeg;
+						pitchDeg = pitchDeg > 80.0f ? 80.0f : pitchDeg;
+
+						g_freeFlyCamera.pitch = DirectX::XMConvertToRadians(pitchDeg);
 					}
 				}
-				ImGui::End();
 			}
+			ImGui::End();
 
-			D3D12Lite::TextureResource& backBuffer = device->GetCurrentBackBuffer();
-
-			terrainRenderer.Render(graphicsContext.get(), computeContext.get(), g_freeFlyCamera, &backBuffer, g_depthBuffer.get());
-			terrainRenderer.RenderUI();
+			// Stats of the frame the render stage completed last
+			RenderStatistics stats;
+			{
+				std::lock_guard<std::mutex> lock(g_renderStatisticsMutex);
+				stats = g_renderStatistics;
+			}
 
-			ImGui::Render();
+			ImGui::Begin("RHI Statistics");
+			{
+				ImGui::Text("Descriptor tables copied: %u", stats.descriptorTableStats.mNumTablesCopied);
+				ImGui::Text("Descriptors copied: %u", stats.descriptorTableStats.mNumDescriptorsCopied);
+				ImGui::Text("Descriptor table cache hits: %u", stats.descriptorTableStats.mNumCacheHits);
+				ImGui::Text("SRV heap peak occupancy: %u / %u", stats.srvHeapPeakAllocatedDescriptors, stats.srvHeapNumDescriptors);
+				ImGui::Text("Pending releases: %u (%.2f MB)", stats.numPendingReleases, stats.pendingReleaseBytes / (1024.0f * 1024.0f));
+				ImGui::Text("Pending releases high-water mark: %.2f MB", stats.peakPendingReleaseBytes / (1024.0f * 1024.0f));
+				ImGui::Text("Constant upload peak: %.2f / %.2f KB", stats.constantUploadPeakBytes / 1024.0f, stats.constantUploadCapacity / 1024.0f);
+				ImGui::Text("Draws skipped without constants: %u", stats.numSkippedDraws);
+			}
+			ImGui::End();
 
-			// ImGUI
+			ImGui::Begin("Terrain Streaming");
 			{
-				D3D12Lite::PipelineInfo pipeline;
-				pipeline.mPipeline = nullptr;
-				pipeline.mRenderTargets.push_back(&backBuffer);
-				graphicsContext->SetPipeline(pipeline);
-				ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), graphicsContext->GetCommandList());
-				ImGui::EndFrame();
+				const TerrainTileStreamerStats& tileStats = stats.terrainTileStats;
+				ImGui::Text("Tiles in view: %u (%u resident)", tileStats.numVisibleTiles, tileStats.numResidentTiles);
+				ImGui::Text("Tiles pending: %u generating, %u waiting for upload", tileStats.numPendingTiles, tileStats.numReadyTiles);
+				ImGui::Text("Tiles uploaded: %u (%u requested)", tileStats.numUploads, tileStats.numTilesRequested);
+				ImGui::Text("Tiles generated: %llu", static_cast<unsigned long long>(tileStats.numTilesGenerated));
+				ImGui::Text("Cache hit rate: %.1f%% (%llu evictions)", tileStats.cacheStats.GetHitRate() * 100.0, static_cast<unsigned long long>(tileStats.cacheStats.numEvictions));
+				ImGui::Text("Generation latency: %.2f ms (max %.2f ms)", tileStats.averageGenerationLatencyInMilliseconds, tileStats.maxGenerationLatencyInMilliseconds);
+				ImGui::Text("Generation time: %.2f ms", tileStats.averageGenerationTimeInMilliseconds);
+
+				const TerrainLodStats& lodStats = stats.terrainLodStats;
+				ImGui::Text("Patches: %u (%u nodes visited, %u culled)", lodStats.numPatches, lodStats.numVisitedNodes, lodStats.numCulledNodes);
+				ImGui::Text("LOD selection: %.3f ms", lodStats.selectionTimeInMilliseconds);
+
+				const TerrainScatterStats& scatterStats = stats.terrainScatterStats;
+				ImGui::Text("Scattered instances: %u visible of %u (%u draws)", scatterStats.numVisibleInstances, scatterStats.numInstances, scatterStats.numDraws);
+				ImGui::Text("Scatter culling: %.3f ms", scatterStats.cullTimeInMilliseconds);
+
+				const TerrainSurfaceMapsStats& surfaceMapsStats = stats.terrainSurfaceMapsStats;
+				ImGui::Text("Surface maps: %u of %u tiles updated (%u texels)", surfaceMapsStats.numTilesUpdated, surfaceMapsStats.numTiles, surfaceMapsStats.numTexelsUpdated);
+				ImGui::Text("Surface map update: %.3f ms", surfaceMapsStats.updateTimeInMilliseconds);
 			}
+			ImGui::End();
 
-			graphicsContext->AddBarrier(backBuffer, D3D12_RESOURCE_STATE_PRESENT);
-			graphicsContext->FlushBarriers();
+			ImGui::Begin("Frame Pipeline");
+			{
+				const FramePipelineStats pipelineStats = g_framePipeline.GetStats();
+				ImGui::Text("Frames: %llu", static_cast<unsigned long long>(pipelineStats.numFrames));
+				ImGui::Text("Update to present latency: %.2f ms (average %.2f ms)", pipelineStats.latencyInMilliseconds, pipelineStats.averageLatencyInMilliseconds);
+				ImGui::Text("Update stage waited: %.2f ms", pipelineStats.updateWaitInMilliseconds);
+				ImGui::Text("Render stage waited: %.2f ms", pipelineStats.renderWaitInMilliseconds);
+			}
+			ImGui::End();
 
-			device->SubmitContextWork(*graphicsContext);
+			TerrainRenderer::RenderUI(g_terrainMaterialConstants);
 
-			device->EndFrame();
-			device->Present();
+			ImGui::Render();
 		}
+
+		packet.camera = g_freeFlyCamera;
+		packet.terrainMaterialConstants = g_terrainMaterialConstants;
+		packet.ui.Capture(ImGui::GetDrawData());
+
+		g_framePipeline.EndUpdate();
 	}
 
+	g_framePipeline.Stop();
+	renderThread.join();
+
 	device->WaitForIdle();
 
 	ImGui_ImplSDL2_Shutdown();
@@ -287,12 +543,12 @@ int main()
 	// scene.Shutdown();
 	terrainRenderer.Shutdown();
 
-	device->DestroyTexture(std::move(g_depthBuffer));
+	device->DestroyTexture(g_depthBuffer);
 
 	device->DestroyContext(std::move(graphicsContext));
-	device->DestroyContext(std::move(computeContext));
 	device = nullptr;
 
+	JobSystem::Shutdown();
 	Window::Shutdown();
 
 	return 0;
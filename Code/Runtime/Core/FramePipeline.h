@@ -0,0 +1,167 @@
+/*
+Copyright(c) 2023 Giuseppe Modarelli
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// NOTE: Two stage frame pipeline. The update stage fills a frame packet with everything the render stage needs and
+// publishes it. The render stage consumes it while the update stage already fills the next one. Packets are double
+// buffered: the update stage is never more than one frame ahead, and a packet is immutable from the moment it is
+// published until the render stage is done with it. The pipeline doesn't know what's in a packet or which threads run
+// the stages, so the handoff can be driven without a GPU.
+namespace Styx
+{
+	struct FramePipelineStats
+	{
+		uint64_t numFrames = 0;
+		// From the start of a frame's update (i.e. when its input was sampled) to the end of its render stage
+		double latencyInMilliseconds = 0.0;
+		double averageLatencyInMilliseconds = 0.0;
+		// Time the stages spent blocked on each other during the last frame
+		double updateWaitInMilliseconds = 0.0;
+		double renderWaitInMilliseconds = 0.0;
+	};
+
+	template<typename PacketT>
+	class FramePipeline
+	{
+	public:
+		static constexpr uint32_t NUM_PACKETS = 2;
+
+		// Update stage: waits for a free packet, which is the one the render stage finished last
+		PacketT& BeginUpdate()
+		{
+			const Clock::time_point waitStart = Clock::now();
+
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this]() { return m_NumPublished < NUM_PACKETS; });
+
+			Slot& slot = m_Slots[m_UpdateIndex % NUM_PACKETS];
+			slot.updateStart = Clock::now();
+			m_Stats.updateWaitInMilliseconds = ToMilliseconds(slot.updateStart - waitStart);
+
+			return slot.packet;
+		}
+
+		void EndUpdate()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_UpdateIndex++;
+				m_NumPublished++;
+			}
+
+			m_Condition.notify_all();
+		}
+
+		// Render stage: waits for the next published packet. Returns nullptr once the pipeline is stopped and every
+		// published packet has been rendered.
+		const PacketT* BeginRender()
+		{
+			const Clock::time_point waitStart = Clock::now();
+
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this]() { return m_NumPublished > 0 || m_IsStopped; });
+
+			m_Stats.renderWaitInMilliseconds = ToMilliseconds(Clock::now() - waitStart);
+
+			if (m_NumPublished == 0)
+			{
+				return nullptr;
+			}
+
+			return &m_Slots[m_RenderIndex % NUM_PACKETS].packet;
+		}
+
+		void EndRender()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				assert(m_NumPublished > 0);
+
+				const Slot& slot = m_Slots[m_RenderIndex % NUM_PACKETS];
+				m_Stats.latencyInMilliseconds = ToMilliseconds(Clock::now() - slot.updateStart);
+				m_Stats.numFrames++;
+
+				// Exponential moving average, roughly over the last 30 frames
+				constexpr double smoothing = 1.0 / 30.0;
+				m_Stats.averageLatencyInMilliseconds = m_Stats.numFrames == 1 ? m_Stats.latencyInMilliseconds : m_Stats.averageLatencyInMilliseconds + (m_Stats.latencyInMilliseconds - m_Stats.averageLatencyInMilliseconds) * smoothing;
+
+				m_RenderIndex++;
+				m_NumPublished--;
+			}
+
+			m_Condition.notify_all();
+		}
+
+		// Waits until the render stage has consumed every published packet, e.g. before the update stage touches
+		// something the render stage owns, like the swapchain
+		void WaitForIdle()
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this]() { return m_NumPublished == 0; });
+		}
+
+		// Called by the update stage once it won't publish anything else. The render stage drains what is left.
+		void Stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_IsStopped = true;
+			}
+
+			m_Condition.notify_all();
+		}
+
+		FramePipelineStats GetStats() const
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_Stats;
+		}
+
+	private:
+		using Clock = std::chrono::high_resolution_clock;
+
+		struct Slot
+		{
+			PacketT packet;
+			Clock::time_point updateStart;
+		};
+
+		static double ToMilliseconds(Clock::duration duration) { return std::chrono::duration<double, std::milli>(duration).count(); }
+
+		std::array<Slot, NUM_PACKETS> m_Slots;
+		uint64_t m_UpdateIndex = 0;
+		uint64_t m_RenderIndex = 0;
+		uint32_t m_NumPublished = 0;
+		bool m_IsStopped = false;
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		FramePipelineStats m_Stats;
+	};
+}
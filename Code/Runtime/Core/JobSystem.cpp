@@ -0,0 +1,465 @@
+/*
+Copyright(c) 2023 Giuseppe Modarelli
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "JobSystem.h"
+
+#include <condition_variable>
+#include <memory>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+namespace Styx
+{
+	namespace
+	{
+		// NOTE: Chase-Lev deque, with the memory orderings of "Correct and Efficient Work-Stealing for Weak Memory Models"
+		// (Le et al. 2013). Only the owner pushes and pops, at the bottom. Any thread can steal from the top. The
+		// capacity is fixed, pushing to a full deque fails.
+		class JobDeque
+		{
+		public:
+			static constexpr int64_t CAPACITY = JobSystem::MAX_JOBS_PER_THREAD;
+
+			bool TryPush(Job* job)
+			{
+				const int64_t bottom = m_Bottom.load(std::memory_order_relaxed);
+				const int64_t top = m_Top.load(std::memory_order_acquire);
+
+				// Thieves only ever move the top up, so at worst this sees a deque as full that no longer is
+				if (bottom - top >= CAPACITY)
+				{
+					return false;
+				}
+
+				m_Jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+				m_Bottom.store(bottom + 1, std::memory_order_release);
+				return true;
+			}
+
+			Job* Pop()
+			{
+				const int64_t bottom = m_Bottom.load(std::memory_order_relaxed) - 1;
+				m_Bottom.store(bottom, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				int64_t top = m_Top.load(std::memory_order_relaxed);
+
+				if (top > bottom)
+				{
+					m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+					return nullptr;
+				}
+
+				Job* job = m_Jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+				// Last job: race the thieves for it
+				if (top == bottom)
+				{
+					if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					{
+						job = nullptr;
+					}
+
+					m_Bottom.store(bottom + 1, std::memory_order_relaxed);
+				}
+
+				return job;
+			}
+
+			Job* Steal()
+			{
+				int64_t top = m_Top.load(std::memory_order_acquire);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				const int64_t bottom = m_Bottom.load(std::memory_order_acquire);
+
+				if (top >= bottom)
+				{
+					return nullptr;
+				}
+
+				Job* job = m_Jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+				if (!m_Top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				{
+					return nullptr;
+				}
+
+				return job;
+			}
+
+			bool IsEmpty() const
+			{
+				return m_Bottom.load(std::memory_order_relaxed) <= m_Top.load(std::memory_order_relaxed);
+			}
+
+		private:
+			static_assert((CAPACITY & (CAPACITY - 1)) == 0, "The deque capacity must be a power of two");
+
+			// Thieves hammer the top, the owner the bottom: keep them on separate cache lines
+			alignas(64) std::atomic<int64_t> m_Top = 0;
+			alignas(64) std::atomic<int64_t> m_Bottom = 0;
+			alignas(64) std::atomic<Job*> m_Jobs[CAPACITY] = {};
+		};
+
+		struct ThreadData
+		{
+			JobDeque deque;
+			// Blocks of MAX_JOBS_PER_THREAD jobs, only added to (and only by the owner) until shutdown, so jobs never move
+			std::vector<std::unique_ptr<Job[]>> jobBlocks;
+			uint32_t nextJob = 0;
+			uint32_t randomState = 0;
+			std::atomic<uint64_t> numJobsExecuted = 0;
+			std::atomic<uint64_t> numJobsStolen = 0;
+			// Slots of external threads only: taken by the thread registered in it
+			std::atomic<bool> isRegistered = false;
+		};
+
+		std::vector<std::unique_ptr<ThreadData>> mThreads;
+		std::vector<std::thread> mWorkers;
+		// The slots of the external threads follow the main thread's and the workers'
+		uint32_t mFirstExternalThread = 0;
+		std::atomic<bool> mIsRunning = false;
+
+		// Idle workers sleep until the epoch changes, which it does every time a job is submitted
+		std::atomic<uint64_t> mWorkEpoch = 0;
+		std::atomic<uint32_t> mNumSleepingWorkers = 0;
+		std::mutex mSleepMutex;
+		std::condition_variable mSleepCondition;
+
+		thread_local uint32_t tThreadIndex = JobSystem::INVALID_THREAD_INDEX;
+
+		void PinCurrentThread(uint32_t threadIndex)
+		{
+#if defined(_WIN32)
+			SetThreadAffinityMask(GetCurrentThread(), 1ull << (threadIndex % 64));
+#else
+			// NOTE: Only pinned on Windows for now
+			(void)threadIndex;
+#endif
+		}
+
+		Job* GetJob(ThreadData& threadData)
+		{
+			if (Job* job = threadData.deque.Pop())
+			{
+				return job;
+			}
+
+			// Start at a random victim so thieves don't all queue up on the same deque
+			const uint32_t numThreads = static_cast<uint32_t>(mThreads.size());
+			threadData.randomState ^= threadData.randomState << 13;
+			threadData.randomState ^= threadData.randomState >> 17;
+			threadData.randomState ^= threadData.randomState << 5;
+
+			for (uint32_t i = 0; i < numThreads; i++)
+			{
+				ThreadData& victim = *mThreads[(threadData.randomState + i) % numThreads];
+				if (&victim == &threadData)
+				{
+					continue;
+				}
+
+				if (Job* job = victim.deque.Steal())
+				{
+					threadData.numJobsStolen.fetch_add(1, std::memory_order_relaxed);
+					return job;
+				}
+			}
+
+			return nullptr;
+		}
+
+		void WakeWorkers(bool wakeAll)
+		{
+			mWorkEpoch.fetch_add(1, std::memory_order_seq_cst);
+
+			if (mNumSleepingWorkers.load(std::memory_order_seq_cst) > 0)
+			{
+				// Taking the lock orders the notification after a sleeper checked the epoch, so it can't be missed
+				{
+					std::lock_guard<std::mutex> lock(mSleepMutex);
+				}
+
+				if (wakeAll)
+				{
+					mSleepCondition.notify_all();
+				}
+				else
+				{
+					mSleepCondition.notify_one();
+				}
+			}
+		}
+
+	}
+
+	Job* JobSystem::AllocateJob()
+	{
+		assert(tThreadIndex != INVALID_THREAD_INDEX && "Jobs can only be spawned by the main thread, registered threads or jobs");
+
+		ThreadData& threadData = *mThreads[tThreadIndex];
+
+		// Jobs mostly complete in the order they were spawned, so the slot after the last one handed out is nearly always
+		// free. Slots still in flight, e.g. jobs parked on a dependency, are skipped rather than overwritten.
+		const uint32_t numJobs = static_cast<uint32_t>(threadData.jobBlocks.size()) * MAX_JOBS_PER_THREAD;
+		for (uint32_t i = 0; i < numJobs; i++)
+		{
+			uint32_t slot = threadData.nextJob + i;
+			slot = slot < numJobs ? slot : slot - numJobs;
+
+			Job* job = &threadData.jobBlocks[slot / MAX_JOBS_PER_THREAD][slot % MAX_JOBS_PER_THREAD];
+			if (!job->m_Function.load(std::memory_order_acquire))
+			{
+				threadData.nextJob = slot + 1;
+				return job;
+			}
+		}
+
+		// Every job is in flight
+		threadData.jobBlocks.push_back(std::make_unique<Job[]>(MAX_JOBS_PER_THREAD));
+		threadData.nextJob = numJobs + 1;
+
+		return &threadData.jobBlocks.back()[0];
+	}
+
+	void JobSystem::Submit(Job* job, JobCounter* dependency)
+	{
+		job->m_Counter->m_Value.fetch_add(1, std::memory_order_relaxed);
+
+		if (dependency)
+		{
+			// Parked on the dependency, unless it completed already. The job completing the dependency checks the list under
+			// the same lock after its decrement, so a job parked here is always picked up.
+			std::lock_guard<std::mutex> lock(dependency->m_ContinuationsMutex);
+			if (!dependency->IsDone())
+			{
+				dependency->m_Continuations.push_back(job);
+				return;
+			}
+		}
+
+		PushJob(job);
+	}
+
+	bool JobSystem::HasQueuedJobs()
+	{
+		return tThreadIndex != INVALID_THREAD_INDEX && !mThreads[tThreadIndex]->deque.IsEmpty();
+	}
+
+	void JobSystem::PushJob(Job* job)
+	{
+		if (!mThreads[tThreadIndex]->deque.TryPush(job))
+		{
+			// NOTE: Only a thread spawning thousands of jobs faster than they are taken gets here. Running the job
+			// right away is what the thread would do next anyway: pop jobs off its own deque.
+			RunJob(job);
+			return;
+		}
+
+		WakeWorkers(false);
+	}
+
+	bool JobSystem::TryRunJob()
+	{
+		Job* job = GetJob(*mThreads[tThreadIndex]);
+		if (!job)
+		{
+			return false;
+		}
+
+		RunJob(job);
+		return true;
+	}
+
+	void JobSystem::RunJob(Job* job)
+	{
+		// The job's slot can be reused as soon as it has run
+		JobCounter& counter = *job->m_Counter;
+		job->m_Function.load(std::memory_order_relaxed)(*job);
+		job->m_Function.store(nullptr, std::memory_order_release);
+		mThreads[tThreadIndex]->numJobsExecuted.fetch_add(1, std::memory_order_relaxed);
+
+		// NOTE: The decrement happens under the lock, and the counter isn't touched after the unlock. A waiter seeing the
+		// counter done goes through the same lock before it can destroy the counter (see ~JobCounter).
+		std::vector<Job*> continuations;
+		{
+			std::lock_guard<std::mutex> lock(counter.m_ContinuationsMutex);
+			if (counter.m_Value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				continuations.swap(counter.m_Continuations);
+			}
+		}
+
+		// Last job of the counter: release the jobs that depend on it
+		for (Job* continuation : continuations)
+		{
+			PushJob(continuation);
+		}
+	}
+
+	void JobSystem::Wait(JobCounter& counter)
+	{
+		assert(tThreadIndex != INVALID_THREAD_INDEX);
+
+		while (!counter.IsDone())
+		{
+			if (!TryRunJob())
+			{
+				// The remaining jobs are running on other threads
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void JobSystem::Initialize(const JobSystemDesc& desc)
+	{
+		assert(mThreads.empty());
+
+		const uint32_t numHardwareThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+		const uint32_t numWorkers = desc.numWorkers > 0 ? desc.numWorkers : numHardwareThreads - 1;
+
+		for (uint32_t threadIndex = 0; threadIndex < numWorkers + 1 + desc.numExternalThreads; threadIndex++)
+		{
+			mThreads.push_back(std::make_unique<ThreadData>());
+			mThreads.back()->randomState = 0x9E3779B9u * (threadIndex + 1);
+			mThreads.back()->jobBlocks.push_back(std::make_unique<Job[]>(MAX_JOBS_PER_THREAD));
+		}
+
+		mFirstExternalThread = numWorkers + 1;
+
+		tThreadIndex = 0;
+		if (desc.pinThreads)
+		{
+			PinCurrentThread(0);
+		}
+
+		mIsRunning.store(true);
+
+		for (uint32_t threadIndex = 1; threadIndex < numWorkers + 1; threadIndex++)
+		{
+			mWorkers.emplace_back([threadIndex, pinThreads = desc.pinThreads]()
+			{
+				tThreadIndex = threadIndex;
+				if (pinThreads)
+				{
+					PinCurrentThread(threadIndex);
+				}
+
+				while (mIsRunning.load(std::memory_order_acquire))
+				{
+					const uint64_t epoch = mWorkEpoch.load(std::memory_order_seq_cst);
+
+					// Spin a little before going to sleep, new jobs tend to come in bursts
+					constexpr uint32_t numSpins = 64;
+					bool ranJob = false;
+					for (uint32_t spin = 0; spin < numSpins && !ranJob; spin++)
+					{
+						ranJob = TryRunJob();
+					}
+
+					if (!ranJob)
+					{
+						std::unique_lock<std::mutex> lock(mSleepMutex);
+						mNumSleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+						mSleepCondition.wait(lock, [epoch]() { return mWorkEpoch.load(std::memory_order_seq_cst) != epoch || !mIsRunning.load(std::memory_order_acquire); });
+						mNumSleepingWorkers.fetch_sub(1, std::memory_order_seq_cst);
+					}
+				}
+
+				tThreadIndex = INVALID_THREAD_INDEX;
+			});
+		}
+	}
+
+	void JobSystem::Shutdown()
+	{
+		assert(tThreadIndex == 0);
+
+		for (uint32_t threadIndex = mFirstExternalThread; threadIndex < mThreads.size(); threadIndex++)
+		{
+			assert(!mThreads[threadIndex]->isRegistered.load() && "External threads must unregister before the job system shuts down");
+		}
+
+		mIsRunning.store(false, std::memory_order_release);
+		WakeWorkers(true);
+
+		for (std::thread& worker : mWorkers)
+		{
+			worker.join();
+		}
+
+		mWorkers.clear();
+		mThreads.clear();
+		mFirstExternalThread = 0;
+		tThreadIndex = INVALID_THREAD_INDEX;
+	}
+
+	bool JobSystem::RegisterThread()
+	{
+		assert(tThreadIndex == INVALID_THREAD_INDEX);
+
+		for (uint32_t threadIndex = mFirstExternalThread; threadIndex < mThreads.size(); threadIndex++)
+		{
+			// Acquires the deque and the job pool the previous thread in the slot left behind
+			bool isRegistered = false;
+			if (mThreads[threadIndex]->isRegistered.compare_exchange_strong(isRegistered, true, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				tThreadIndex = threadIndex;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void JobSystem::UnregisterThread()
+	{
+		assert(tThreadIndex != INVALID_THREAD_INDEX && tThreadIndex >= mFirstExternalThread);
+
+		mThreads[tThreadIndex]->isRegistered.store(false, std::memory_order_release);
+		tThreadIndex = INVALID_THREAD_INDEX;
+	}
+
+	uint32_t JobSystem::GetNumThreads()
+	{
+		return (std::max)(static_cast<uint32_t>(mThreads.size()), 1u);
+	}
+
+	uint32_t JobSystem::GetThreadIndex()
+	{
+		return tThreadIndex;
+	}
+
+	JobSystemStats JobSystem::GetStats()
+	{
+		JobSystemStats stats;
+		for (const std::unique_ptr<ThreadData>& threadData : mThreads)
+		{
+			stats.numJobsExecuted += threadData->numJobsExecuted.load(std::memory_order_relaxed);
+			stats.numJobsStolen += threadData->numJobsStolen.load(std::memory_order_relaxed);
+		}
+
+		return stats;
+	}
+}
@@ -0,0 +1,236 @@
+/*
+Copyright(c) 2023 Giuseppe Modarelli
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// NOTE: Work-stealing job system. Every thread taking part (the main thread, the workers and the threads registered
+// with RegisterThread) owns a Chase-Lev deque: it pushes and pops jobs at the bottom of its own deque, idle threads
+// steal from the top of the others. Completion is tracked with JobCounters, which jobs can also depend on. Waiting on
+// a counter runs jobs instead of blocking, so the main thread and jobs waiting on other jobs keep the workers fed
+// rather than stalling them.
+namespace Styx
+{
+	struct Job;
+
+	class JobCounter
+	{
+	public:
+		JobCounter() = default;
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+		~JobCounter()
+		{
+			// Waits for the job that completed the counter to let go of it
+			std::lock_guard<std::mutex> lock(m_ContinuationsMutex);
+			assert(IsDone());
+		}
+
+		bool IsDone() const { return m_Value.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<uint32_t> m_Value = 0;
+		// Jobs waiting for the counter to reach zero
+		std::mutex m_ContinuationsMutex;
+		std::vector<Job*> m_Continuations;
+	};
+
+	// Jobs are fixed size and live in per-thread pools, so spawning one doesn't allocate once a pool is warm. Callables
+	// are copied into the payload and have to be trivially copyable, e.g. lambdas capturing by reference or a few values.
+	struct alignas(64) Job
+	{
+		static constexpr uint32_t PAYLOAD_SIZE = 48;
+
+		// Null while the slot is free: set by the spawning thread, cleared by whichever thread ran the job
+		std::atomic<void (*)(Job& job)> m_Function = nullptr;
+		JobCounter* m_Counter = nullptr;
+		alignas(8) uint8_t m_Payload[PAYLOAD_SIZE];
+	};
+
+	static_assert(sizeof(Job) == 64, "Jobs should fill exactly one cache line");
+
+	struct JobSystemDesc
+	{
+		// Worker threads on top of the main thread. 0 uses one per hardware thread besides the main one.
+		uint32_t numWorkers = 0;
+		// Threads started outside the job system, e.g. the render thread, that can take part with RegisterThread
+		uint32_t numExternalThreads = 0;
+		// Pins the main thread to core 0 and each worker to the next core
+		bool pinThreads = false;
+	};
+
+	struct JobSystemStats
+	{
+		uint64_t numJobsExecuted = 0;
+		uint64_t numJobsStolen = 0;
+	};
+
+	class JobSystem
+	{
+	public:
+		// Each thread's job pool grows by this many slots whenever all of its jobs are in flight, i.e. queued, running or
+		// waiting on a dependency. A thread's deque holds at most this many queued jobs, it runs the ones it pushes past
+		// that itself, right away.
+		static constexpr uint32_t MAX_JOBS_PER_THREAD = 4096;
+		static constexpr uint32_t INVALID_THREAD_INDEX = ~0u;
+
+		// Must be called from the thread that will be thread 0. Besides the workers, only thread 0 and registered threads
+		// are allowed to spawn jobs.
+		static void Initialize(const JobSystemDesc& desc = {});
+		// Every job must have completed and every registered thread must have unregistered
+		static void Shutdown();
+
+		// Makes the calling thread, started outside the job system, take part like the main thread until it unregisters:
+		// it can spawn and wait on jobs, and its ParallelFor loops spread over the workers. Fails once the
+		// numExternalThreads slots are taken, the thread then keeps running its loops by itself.
+		static bool RegisterThread();
+		// Jobs the thread spawned don't need to have completed, the ones still queued get stolen like any other
+		static void UnregisterThread();
+
+		// Spawns function() and increments counter until it has run
+		template<typename Function>
+		static void Run(JobCounter& counter, const Function& function)
+		{
+			Submit(CreateJob(counter, function), nullptr);
+		}
+
+		// Same as Run, but the job isn't started before dependency is done
+		template<typename Function>
+		static void RunAfter(JobCounter& dependency, JobCounter& counter, const Function& function)
+		{
+			Submit(CreateJob(counter, function), &dependency);
+		}
+
+		// Runs other jobs until counter is done
+		static void Wait(JobCounter& counter);
+
+		// Calls function(begin, end) over ranges covering [0, count) and waits for all of them. Ranges are split in halves
+		// for as long as they are larger than the grain size and other threads are short of work, so big loops spread out
+		// quickly and small ones don't pay for more jobs than there are threads to run them. minGrainSize bounds the
+		// smallest range a function call gets. Threads unknown to the job system, e.g. a render thread that didn't
+		// register, run the whole loop themselves.
+		template<typename Function>
+		static void ParallelFor(uint32_t count, uint32_t minGrainSize, const Function& function);
+
+		// Thread indices are below this: the main thread, the workers and the slots of the external threads
+		static uint32_t GetNumThreads();
+		// 0 for the main thread, INVALID_THREAD_INDEX for threads unknown to the job system
+		static uint32_t GetThreadIndex();
+		static JobSystemStats GetStats();
+
+	private:
+		template<typename Function>
+		struct ParallelForRange
+		{
+			const Function* function;
+			uint32_t begin;
+			uint32_t end;
+			uint32_t grainSize;
+		};
+
+		template<typename Function>
+		static Job* CreateJob(JobCounter& counter, const Function& function)
+		{
+			static_assert(sizeof(Function) <= Job::PAYLOAD_SIZE, "Job callables must fit in the job payload, capture by reference");
+			static_assert(alignof(Function) <= 8, "Job callables can't be over-aligned");
+			static_assert(std::is_trivially_copyable_v<Function>, "Job callables must be trivially copyable");
+
+			Job* job = AllocateJob();
+			job->m_Counter = &counter;
+			new (job->m_Payload) Function(function);
+			// Published to the thread running the job by the deque push or the dependency's lock
+			job->m_Function.store([](Job& self) { (*std::launder(reinterpret_cast<Function*>(self.m_Payload)))(); }, std::memory_order_relaxed);
+
+			return job;
+		}
+
+		template<typename Function>
+		static void RunParallelForRange(JobCounter& counter, ParallelForRange<Function> range);
+
+		static Job* AllocateJob();
+		static void Submit(Job* job, JobCounter* dependency);
+		static void PushJob(Job* job);
+		static void RunJob(Job* job);
+		static bool TryRunJob();
+		static bool HasQueuedJobs();
+	};
+
+	template<typename Function>
+	void JobSystem::RunParallelForRange(JobCounter& counter, ParallelForRange<Function> range)
+	{
+		// Lazy binary splitting: the upper half of the range is handed out only while this thread's deque is empty, i.e.
+		// every half pushed so far has been stolen. While nobody is stealing, splitting further would only add overhead.
+		while (range.begin < range.end)
+		{
+			if (range.end - range.begin > range.grainSize && !HasQueuedJobs())
+			{
+				ParallelForRange<Function> upperHalf = range;
+				upperHalf.begin = range.begin + (range.end - range.begin) / 2;
+				range.end = upperHalf.begin;
+
+				Run(counter, [&counter, upperHalf]() { RunParallelForRange(counter, upperHalf); });
+				continue;
+			}
+
+			const uint32_t end = (std::min)(range.begin + range.grainSize, range.end);
+			(*range.function)(range.begin, end);
+			range.begin = end;
+		}
+	}
+
+	template<typename Function>
+	void JobSystem::ParallelFor(uint32_t count, uint32_t minGrainSize, const Function& function)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		// Aim for a few ranges per thread, so stealing can even out ranges that take longer than others
+		constexpr uint32_t rangesPerThread = 4;
+		const uint32_t grainSize = (std::max)((std::max)(minGrainSize, 1u), count / (GetNumThreads() * rangesPerThread));
+
+		if (count <= grainSize || GetNumThreads() == 1 || GetThreadIndex() == INVALID_THREAD_INDEX)
+		{
+			for (uint32_t begin = 0; begin < count; begin += grainSize)
+			{
+				function(begin, (std::min)(begin + grainSize, count));
+			}
+
+			return;
+		}
+
+		JobCounter counter;
+		const ParallelForRange<Function> range{ &function, 0, count, grainSize };
+		RunParallelForRange(counter, range);
+		Wait(counter);
+	}
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// NOTE: Intermediate command buffer. Commands are POD packets laid out back to back in one linear
+// arena, so a stream can be recorded on any thread, kept across frames and replayed in a single loop. Packets only
+// hold pointers to objects owned elsewhere, which have to outlive every replay of the stream. Anything that is only
+// valid for one frame (dynamic constants, per-frame buffers) must not go in a stream that is replayed later.
+// The format has no D3D12 dependency: replay goes through a target type, GraphicsContext or a test double.
+namespace D3D12Lite
+{
+    struct PipelineStateObject;
+    class PipelineResourceSpace;
+    struct BufferResource;
+    struct CommandSignature;
+
+    enum class StreamPacketType : uint16_t
+    {
+        setPipeline,
+        setPipelineResources,
+        setPipelineConstants,
+        setRootConstant,
+        setIndexBuffer,
+        setPrimitiveTopology,
+        drawInstanced,
+        drawIndexedInstanced,
+        executeIndirect,
+        dispatch
+    };
+
+    struct SetPipelinePacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::setPipeline;
+        PipelineStateObject* mPipeline = nullptr;
+    };
+
+    struct SetPipelineResourcesPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::setPipelineResources;
+        uint32_t mSpaceId = 0;
+        const PipelineResourceSpace* mResources = nullptr;
+    };
+
+    struct SetPipelineConstantsPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::setPipelineConstants;
+        uint32_t mSpaceId = 0;
+        // The fields of the ConstantAllocation being bound
+        uint8_t* mCPUAddress = nullptr;
+        uint64_t mGPUAddress = 0;
+        uint64_t mSize = 0;
+        const BufferResource* mBuffer = nullptr;
+        uint64_t mOffset = 0;
+    };
+
+    struct SetRootConstantPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::setRootConstant;
+        uint32_t mValue = 0;
+        uint32_t mOffset = 0;
+    };
+
+    struct SetIndexBufferPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::setIndexBuffer;
+        const BufferResource* mIndexBuffer = nullptr;
+    };
+
+    struct SetPrimitiveTopologyPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::setPrimitiveTopology;
+        uint32_t mTopology = 0;
+    };
+
+    struct DrawInstancedPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::drawInstanced;
+        uint32_t mVertexCountPerInstance = 0;
+        uint32_t mInstanceCount = 0;
+        uint32_t mStartVertexLocation = 0;
+        uint32_t mStartInstanceLocation = 0;
+    };
+
+    struct DrawIndexedInstancedPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::drawIndexedInstanced;
+        uint32_t mIndexCountPerInstance = 0;
+        uint32_t mInstanceCount = 0;
+        uint32_t mStartIndexLocation = 0;
+        uint32_t mBaseVertexLocation = 0;
+        uint32_t mStartInstanceLocation = 0;
+    };
+
+    struct ExecuteIndirectPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::executeIndirect;
+        const CommandSignature* mCommandSignature = nullptr;
+        const BufferResource* mArgumentBuffer = nullptr;
+        uint64_t mArgumentOffset = 0;
+        uint32_t mNumCommands = 0;
+    };
+
+    struct DispatchPacket
+    {
+        static constexpr StreamPacketType TYPE = StreamPacketType::dispatch;
+        uint32_t mGroupCountX = 0;
+        uint32_t mGroupCountY = 0;
+        uint32_t mGroupCountZ = 0;
+    };
+
+    class CommandStream
+    {
+    public:
+        // Packets start on 8 byte boundaries, the header takes the first 8 bytes of each one
+        static constexpr uint32_t PACKET_ALIGNMENT = 8;
+
+        template<typename Packet>
+        void Record(const Packet& packet)
+        {
+            static_assert(std::is_trivially_copyable_v<Packet>, "Stream packets must be POD");
+            static_assert(alignof(Packet) <= PACKET_ALIGNMENT, "Stream packets can't be over-aligned");
+
+            const size_t packetSize = HEADER_SIZE + AlignUp(sizeof(Packet));
+            const size_t position = mData.size();
+            mData.resize(position + packetSize);
+
+            const PacketHeader header{ Packet::TYPE, static_cast<uint16_t>(packetSize) };
+            memcpy(mData.data() + position, &header, sizeof(header));
+            memcpy(mData.data() + position + HEADER_SIZE, &packet, sizeof(Packet));
+
+            mNumPackets++;
+        }
+
+        // Appends another stream as is, e.g. to stitch cached per-object streams together
+        void Append(const CommandStream& other)
+        {
+            mData.insert(mData.end(), other.mData.begin(), other.mData.end());
+            mNumPackets += other.mNumPackets;
+        }
+
+        void Clear()
+        {
+            mData.clear();
+            mNumPackets = 0;
+        }
+
+        void Reserve(size_t sizeInBytes) { mData.reserve(sizeInBytes); }
+
+        bool IsEmpty() const { return mNumPackets == 0; }
+        uint32_t GetNumPackets() const { return mNumPackets; }
+        size_t GetSizeInBytes() const { return mData.size(); }
+
+        // Calls target.Execute(packet) for every packet, in recording order
+        template<typename Target>
+        void Replay(Target& target) const
+        {
+            const uint8_t* current = mData.data();
+            const uint8_t* end = current + mData.size();
+
+            while (current < end)
+            {
+                PacketHeader header;
+                memcpy(&header, current, sizeof(header));
+
+                const uint8_t* payload = current + HEADER_SIZE;
+
+                switch (header.mType)
+                {
+                case StreamPacketType::setPipeline: target.Execute(Read<SetPipelinePacket>(payload)); break;
+                case StreamPacketType::setPipelineResources: target.Execute(Read<SetPipelineResourcesPacket>(payload)); break;
+                case StreamPacketType::setPipelineConstants: target.Execute(Read<SetPipelineConstantsPacket>(payload)); break;
+                case StreamPacketType::setRootConstant: target.Execute(Read<SetRootConstantPacket>(payload)); break;
+                case StreamPacketType::setIndexBuffer: target.Execute(Read<SetIndexBufferPacket>(payload)); break;
+                case StreamPacketType::setPrimitiveTopology: target.Execute(Read<SetPrimitiveTopologyPacket>(payload)); break;
+                case StreamPacketType::drawInstanced: target.Execute(Read<DrawInstancedPacket>(payload)); break;
+                case StreamPacketType::drawIndexedInstanced: target.Execute(Read<DrawIndexedInstancedPacket>(payload)); break;
+                case StreamPacketType::executeIndirect: target.Execute(Read<ExecuteIndirectPacket>(payload)); break;
+                case StreamPacketType::dispatch: target.Execute(Read<DispatchPacket>(payload)); break;
+                default: assert(false); break;
+                }
+
+                current += header.mSize;
+            }
+        }
+
+    private:
+        struct PacketHeader
+        {
+            StreamPacketType mType;
+            uint16_t mSize;
+        };
+
+        static constexpr size_t HEADER_SIZE = PACKET_ALIGNMENT;
+
+        static constexpr size_t AlignUp(size_t size) { return (size + PACKET_ALIGNMENT - 1) & ~static_cast<size_t>(PACKET_ALIGNMENT - 1); }
+
+        template<typename Packet>
+        static Packet Read(const uint8_t* payload)
+        {
+            Packet packet;
+            memcpy(&packet, payload, sizeof(Packet));
+            return packet;
+        }
+
+        std::vector<uint8_t> mData;
+        uint32_t mNumPackets = 0;
+    };
+}
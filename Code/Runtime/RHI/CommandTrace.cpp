@@ -0,0 +1,100 @@
+#include "CommandTrace.h"
+
+#include <cassert>
+
+namespace D3D12Lite
+{
+    void CommandTrace::Write(TraceOpcode opcode, std::initializer_list<uint32_t> words)
+    {
+        Write(opcode, words.begin(), static_cast<uint32_t>(words.size()));
+    }
+
+    void CommandTrace::Write(TraceOpcode opcode, const uint32_t* words, uint32_t numWords)
+    {
+        assert(opcode < TraceOpcode::count);
+        assert(numWords <= UINT16_MAX);
+
+        mWords.push_back(static_cast<uint32_t>(opcode) | (numWords << 16));
+        mWords.insert(mWords.end(), words, words + numWords);
+
+        mNumPackets++;
+        mNumPacketsPerOpcode[static_cast<uint32_t>(opcode)]++;
+    }
+
+    void CommandTrace::Append(const CommandTrace& other)
+    {
+        mWords.insert(mWords.end(), other.mWords.begin(), other.mWords.end());
+        mNumPackets += other.mNumPackets;
+
+        for (uint32_t opcodeIndex = 0; opcodeIndex < static_cast<uint32_t>(TraceOpcode::count); opcodeIndex++)
+        {
+            mNumPacketsPerOpcode[opcodeIndex] += other.mNumPacketsPerOpcode[opcodeIndex];
+        }
+    }
+
+    void CommandTrace::Clear()
+    {
+        mWords.clear();
+        mNumPackets = 0;
+
+        for (uint32_t& numPackets : mNumPacketsPerOpcode)
+        {
+            numPackets = 0;
+        }
+    }
+
+    uint64_t CommandTrace::GetHash() const
+    {
+        uint64_t hash = 14695981039346656037ull;
+
+        for (uint32_t word : mWords)
+        {
+            for (uint32_t byteIndex = 0; byteIndex < 4; byteIndex++)
+            {
+                hash ^= (word >> (byteIndex * 8)) & 0xff;
+                hash *= 1099511628211ull;
+            }
+        }
+
+        return hash;
+    }
+
+    const char* CommandTrace::GetOpcodeName(TraceOpcode opcode)
+    {
+        switch (opcode)
+        {
+        case TraceOpcode::barriers: return "barriers";
+        case TraceOpcode::setDescriptorHeaps: return "setDescriptorHeaps";
+        case TraceOpcode::copyResource: return "copyResource";
+        case TraceOpcode::copyBufferRegion: return "copyBufferRegion";
+        case TraceOpcode::copyTextureRegion: return "copyTextureRegion";
+        case TraceOpcode::setViewport: return "setViewport";
+        case TraceOpcode::setScissorRect: return "setScissorRect";
+        case TraceOpcode::setStencilRef: return "setStencilRef";
+        case TraceOpcode::setBlendFactor: return "setBlendFactor";
+        case TraceOpcode::setPrimitiveTopology: return "setPrimitiveTopology";
+        case TraceOpcode::setPipeline: return "setPipeline";
+        case TraceOpcode::setRenderTargets: return "setRenderTargets";
+        case TraceOpcode::setRootConstantBufferView: return "setRootConstantBufferView";
+        case TraceOpcode::setRootDescriptorTable: return "setRootDescriptorTable";
+        case TraceOpcode::setRoot32BitConstants: return "setRoot32BitConstants";
+        case TraceOpcode::setIndexBuffer: return "setIndexBuffer";
+        case TraceOpcode::executeIndirect: return "executeIndirect";
+        case TraceOpcode::clearRenderTarget: return "clearRenderTarget";
+        case TraceOpcode::clearDepthStencil: return "clearDepthStencil";
+        case TraceOpcode::drawInstanced: return "drawInstanced";
+        case TraceOpcode::drawIndexedInstanced: return "drawIndexedInstanced";
+        case TraceOpcode::dispatch: return "dispatch";
+        default: return "unknown";
+        }
+    }
+
+    TracePacketHeader CommandTrace::ReadHeader(uint32_t word)
+    {
+        TracePacketHeader header;
+        header.mOpcode = static_cast<TraceOpcode>(word & 0xffff);
+        header.mNumWords = static_cast<uint16_t>(word >> 16);
+
+        return header;
+    }
+}
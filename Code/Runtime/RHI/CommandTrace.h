@@ -0,0 +1,93 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+// NOTE: Compact binary log of the commands a context recorded. Every packet is a 4 byte header followed
+// by its arguments as 32-bit words. Resources are written as their creation-order trace ID and never as pointers or
+// GPU addresses, so two runs recording the same frame produce the same bytes. The format has no D3D12 dependency,
+// which means traces can be decoded and compared anywhere.
+namespace D3D12Lite
+{
+    enum class TraceOpcode : uint16_t
+    {
+        barriers,
+        setDescriptorHeaps,
+        copyResource,
+        copyBufferRegion,
+        copyTextureRegion,
+        setViewport,
+        setScissorRect,
+        setStencilRef,
+        setBlendFactor,
+        setPrimitiveTopology,
+        setPipeline,
+        setRenderTargets,
+        setRootConstantBufferView,
+        setRootDescriptorTable,
+        setRoot32BitConstants,
+        setIndexBuffer,
+        executeIndirect,
+        clearRenderTarget,
+        clearDepthStencil,
+        drawInstanced,
+        drawIndexedInstanced,
+        dispatch,
+        count
+    };
+
+    struct TracePacketHeader
+    {
+        TraceOpcode mOpcode = TraceOpcode::count;
+        uint16_t mNumWords = 0;
+    };
+
+    static_assert(sizeof(TracePacketHeader) == 4, "Trace packet headers must stay 4 bytes");
+
+    class CommandTrace
+    {
+    public:
+        void Write(TraceOpcode opcode, std::initializer_list<uint32_t> words);
+        void Write(TraceOpcode opcode, const uint32_t* words, uint32_t numWords);
+        void Append(const CommandTrace& other);
+        void Clear();
+
+        // Calls function(opcode, words, numWords) for every packet, in recording order
+        template<typename Function>
+        void ForEachPacket(Function&& function) const
+        {
+            size_t position = 0;
+
+            while (position < mWords.size())
+            {
+                const TracePacketHeader header = ReadHeader(mWords[position]);
+                function(header.mOpcode, mWords.data() + position + 1, static_cast<uint32_t>(header.mNumWords));
+                position += 1 + header.mNumWords;
+            }
+        }
+
+        const uint32_t* GetData() const { return mWords.data(); }
+        size_t GetSizeInBytes() const { return mWords.size() * sizeof(uint32_t); }
+        uint32_t GetNumPackets() const { return mNumPackets; }
+        uint32_t GetNumPackets(TraceOpcode opcode) const { return mNumPacketsPerOpcode[static_cast<uint32_t>(opcode)]; }
+
+        // FNV-1a over the whole trace, for regression checks against a known frame
+        uint64_t GetHash() const;
+
+        static const char* GetOpcodeName(TraceOpcode opcode);
+
+    private:
+        static TracePacketHeader ReadHeader(uint32_t word);
+
+        std::vector<uint32_t> mWords;
+        uint32_t mNumPackets = 0;
+        uint32_t mNumPacketsPerOpcode[static_cast<uint32_t>(TraceOpcode::count)]{};
+    };
+
+    inline uint32_t TraceLow(uint64_t value) { return static_cast<uint32_t>(value); }
+    inline uint32_t TraceHigh(uint64_t value) { return static_cast<uint32_t>(value >> 32); }
+    inline uint32_t TraceFloat(float value) { return std::bit_cast<uint32_t>(value); }
+}
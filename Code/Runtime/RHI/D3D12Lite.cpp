@@ -4,6 +4,7 @@
 #include <D3D12MemAlloc.h>
 
 #include <dxcapi.h>
+#include <cstddef>
 #include <numeric>
 #include <algorithm>
 
@@ -15,6 +16,15 @@ extern "C" { __declspec(dllexport) extern const char* D3D12SDKPath = ".\\D3D12\\
 
 namespace D3D12Lite
 {
+    // Every argument of a drawIndexedWithDrawId command starts where the previous one ends
+    static_assert(offsetof(IndirectDrawIndexedCommand, mDrawId) == 0);
+    static_assert(offsetof(IndirectDrawIndexedCommand, mIndexBufferAddress) == sizeof(uint32_t));
+    static_assert(offsetof(IndirectDrawIndexedCommand, mIndexBufferAddress) + offsetof(D3D12_INDEX_BUFFER_VIEW, SizeInBytes) == offsetof(IndirectDrawIndexedCommand, mIndexBufferSize));
+    static_assert(offsetof(IndirectDrawIndexedCommand, mIndexBufferAddress) + offsetof(D3D12_INDEX_BUFFER_VIEW, Format) == offsetof(IndirectDrawIndexedCommand, mIndexBufferFormat));
+    static_assert(offsetof(IndirectDrawIndexedCommand, mIndexCountPerInstance) == sizeof(uint32_t) + sizeof(D3D12_INDEX_BUFFER_VIEW));
+    static_assert(offsetof(IndirectDrawIndexedCommand, mIndexCountPerInstance) + offsetof(D3D12_DRAW_INDEXED_ARGUMENTS, StartInstanceLocation) == offsetof(IndirectDrawIndexedCommand, mStartInstanceLocation));
+    static_assert(sizeof(IndirectDrawIndexedCommand) == sizeof(uint32_t) + sizeof(D3D12_INDEX_BUFFER_VIEW) + sizeof(D3D12_DRAW_INDEXED_ARGUMENTS));
+
     DescriptorHeap::DescriptorHeap(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE heapType, uint32_t numDescriptors, bool isShaderVisible)
         :mHeapType(heapType)
         , mMaxDescriptors(numDescriptors)
@@ -45,8 +55,9 @@ namespace D3D12Lite
 
     StagingDescriptorHeap::StagingDescriptorHeap(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE heapType, uint32_t numDescriptors)
         :DescriptorHeap(device, heapType, numDescriptors, false)
+        , mFreeDescriptors(numDescriptors)
     {
-        mFreeDescriptors.reserve(numDescriptors);
+        mUnusedDescriptors.Reset(0, numDescriptors);
     }
 
     StagingDescriptorHeap::~StagingDescriptorHeap()
@@ -59,56 +70,47 @@ namespace D3D12Lite
 
     Descriptor StagingDescriptorHeap::GetNewDescriptor()
     {
-        std::lock_guard<std::mutex> lockGuard(mUsageMutex);
-
         uint32_t newHandleID = 0;
 
-        if (mCurrentDescriptorIndex < mMaxDescriptors)
-        {
-            newHandleID = mCurrentDescriptorIndex;
-            mCurrentDescriptorIndex++;
-        }
-        else if (mFreeDescriptors.size() > 0)
-        {
-            newHandleID = mFreeDescriptors.back();
-            mFreeDescriptors.pop_back();
-        }
-        else
+        // Never used handles first, then recycled ones
+        if (!mUnusedDescriptors.Allocate(1, newHandleID) && !mFreeDescriptors.Pop(newHandleID))
         {
             AssertError("Ran out of dynamic descriptor heap handles, need to increase heap size.");
         }
 
-        Descriptor newDescriptor;
-        D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = mHeapStart.mCPUHandle;
-        cpuHandle.ptr += static_cast<uint64_t>(newHandleID) * mDescriptorSize;
-        newDescriptor.mCPUHandle = cpuHandle;
-        newDescriptor.mHeapIndex = newHandleID;
-
-        mActiveHandleCount++;
+        mActiveHandleCount.fetch_add(1, std::memory_order_relaxed);
 
-        return newDescriptor;
+        return GetDescriptor(newHandleID);
     }
 
     void StagingDescriptorHeap::FreeDescriptor(Descriptor descriptor)
     {
-        std::lock_guard<std::mutex> lockGuard(mUsageMutex);
-
-        mFreeDescriptors.push_back(descriptor.mHeapIndex);
-
-        if (mActiveHandleCount == 0)
+        if (mActiveHandleCount.fetch_sub(1, std::memory_order_relaxed) == 0)
         {
+            mActiveHandleCount.fetch_add(1, std::memory_order_relaxed);
             AssertError("Freeing heap handles when there should be none left");
             return;
         }
 
-        mActiveHandleCount--;
+        mFreeDescriptors.Push(descriptor.mHeapIndex);
+    }
+
+    Descriptor StagingDescriptorHeap::GetDescriptor(uint32_t heapIndex) const
+    {
+        Descriptor descriptor;
+        D3D12_CPU_DESCRIPTOR_HANDLE cpuHandle = mHeapStart.mCPUHandle;
+        cpuHandle.ptr += static_cast<uint64_t>(heapIndex) * mDescriptorSize;
+        descriptor.mCPUHandle = cpuHandle;
+        descriptor.mHeapIndex = heapIndex;
+
+        return descriptor;
     }
 
     RenderPassDescriptorHeap::RenderPassDescriptorHeap(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE heapType, uint32_t reservedCount, uint32_t userCount)
         :DescriptorHeap(device, heapType, reservedCount + userCount, true)
         , mReservedHandleCount(reservedCount)
-        , mCurrentDescriptorIndex(reservedCount)
     {
+        mUserDescriptors.Reset(reservedCount, reservedCount + userCount);
     }
 
     Descriptor RenderPassDescriptorHeap::GetReservedDescriptor(uint32_t index)
@@ -132,20 +134,9 @@ namespace D3D12Lite
     {
         uint32_t newHandleID = 0;
 
+        if (!mUserDescriptors.Allocate(count, newHandleID))
         {
-            std::lock_guard<std::mutex> lockGuard(mUsageMutex);
-
-            uint32_t blockEnd = mCurrentDescriptorIndex + count;
-
-            if (blockEnd <= mMaxDescriptors)
-            {
-                newHandleID = mCurrentDescriptorIndex;
-                mCurrentDescriptorIndex = blockEnd;
-            }
-            else
-            {
-                AssertError("Ran out of render pass descriptor heap handles, need to increase heap size.");
-            }
+            AssertError("Ran out of render pass descriptor heap handles, need to increase heap size.");
         }
 
         Descriptor newDescriptor;
@@ -164,7 +155,56 @@ namespace D3D12Lite
 
     void RenderPassDescriptorHeap::Reset()
     {
-        mCurrentDescriptorIndex = mReservedHandleCount;
+        mPeakAllocatedUserDescriptors = GetPeakAllocatedUserDescriptors();
+        mUserDescriptors.Reset(mReservedHandleCount, mMaxDescriptors);
+    }
+
+    bool DescriptorTableCache::Find(const D3D12_CPU_DESCRIPTOR_HANDLE* handles, uint32_t numHandles, D3D12_GPU_DESCRIPTOR_HANDLE& outTable) const
+    {
+        auto tableIt = mTables.find(HashHandles(handles, numHandles));
+        if (tableIt == mTables.end() || tableIt->second.mNumHandles != numHandles)
+        {
+            return false;
+        }
+
+        for (uint32_t handleIndex = 0; handleIndex < numHandles; handleIndex++)
+        {
+            if (tableIt->second.mHandles[handleIndex] != handles[handleIndex].ptr)
+            {
+                return false;
+            }
+        }
+
+        outTable = tableIt->second.mTable;
+        return true;
+    }
+
+    void DescriptorTableCache::Insert(const D3D12_CPU_DESCRIPTOR_HANDLE* handles, uint32_t numHandles, D3D12_GPU_DESCRIPTOR_HANDLE table)
+    {
+        assert(numHandles <= MAX_TABLE_HANDLES);
+
+        // On a hash collision the newest table wins, the other one simply gets copied again next time
+        CachedTable& cachedTable = mTables[HashHandles(handles, numHandles)];
+        cachedTable.mNumHandles = numHandles;
+        cachedTable.mTable = table;
+
+        for (uint32_t handleIndex = 0; handleIndex < numHandles; handleIndex++)
+        {
+            cachedTable.mHandles[handleIndex] = handles[handleIndex].ptr;
+        }
+    }
+
+    uint64_t DescriptorTableCache::HashHandles(const D3D12_CPU_DESCRIPTOR_HANDLE* handles, uint32_t numHandles)
+    {
+        // FNV-1a over the handle addresses
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t handleIndex = 0; handleIndex < numHandles; handleIndex++)
+        {
+            hash ^= static_cast<uint64_t>(handles[handleIndex].ptr);
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
     }
 
     bool SortPipelineBindings(PipelineResourceBinding a, PipelineResourceBinding b)
@@ -191,6 +231,17 @@ namespace D3D12Lite
         }
     }
 
+    void PipelineResourceSpace::SetDynamicCBV()
+    {
+        if (mIsLocked && !mHasDynamicCBV)
+        {
+            AssertError("Setting unused binding in a locked resource space");
+        }
+
+        assert(mCBV == nullptr);
+        mHasDynamicCBV = true;
+    }
+
     void PipelineResourceSpace::SetSRV(const PipelineResourceBinding& binding)
     {
         uint32_t currentIndex = GetIndexOfBindingIndex(mSRVs, binding.mBindingIndex);
@@ -346,8 +397,17 @@ namespace D3D12Lite
 
     uint64_t Queue::ExecuteCommandList(ID3D12CommandList* commandList)
     {
-        AssertIfFailed(static_cast<ID3D12GraphicsCommandList*>(commandList)->Close());
-        mQueue->ExecuteCommandLists(1, &commandList);
+        return ExecuteCommandLists(&commandList, 1);
+    }
+
+    uint64_t Queue::ExecuteCommandLists(ID3D12CommandList* const* commandLists, uint32_t numCommandLists)
+    {
+        for (uint32_t listIndex = 0; listIndex < numCommandLists; listIndex++)
+        {
+            AssertIfFailed(static_cast<ID3D12GraphicsCommandList*>(commandLists[listIndex])->Close());
+        }
+
+        mQueue->ExecuteCommandLists(numCommandLists, commandLists);
 
         return SignalFence();
     }
@@ -361,259 +421,377 @@ namespace D3D12Lite
         return mNextFenceValue++;
     }
 
-    Context::Context(Device& device, D3D12_COMMAND_LIST_TYPE commandType)
-        :mDevice(device)
-        , mContextType(commandType)
+    static bool IsReadOnlyResourceState(D3D12_RESOURCE_STATES state)
     {
-        for (uint32_t frameIndex = 0; frameIndex < NUM_FRAMES_IN_FLIGHT; frameIndex++)
+        constexpr D3D12_RESOURCE_STATES READ_ONLY_STATES = D3D12_RESOURCE_STATE_GENERIC_READ | D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
+
+        return state != D3D12_RESOURCE_STATE_COMMON && (state & READ_ONLY_STATES) == state;
+    }
+
+    // A read state already contains newState when it is a superset of it, in which case the
+    // transition can be dropped without losing any access the caller asked for.
+    static bool IsResourceStateCovered(D3D12_RESOURCE_STATES currentState, D3D12_RESOURCE_STATES newState)
+    {
+        if (currentState == newState)
         {
-            AssertIfFailed(mDevice.GetDevice()->CreateCommandAllocator(commandType, IID_PPV_ARGS(&mCommandAllocators[frameIndex])));
+            return true;
         }
 
-        AssertIfFailed(mDevice.GetDevice()->CreateCommandList1(0, commandType, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&mCommandList)));
+        return IsReadOnlyResourceState(currentState) && IsReadOnlyResourceState(newState) && (currentState & newState) == newState;
     }
 
-    Context::~Context()
+    ResourceBarrierBatch::ResourceBarrierBatch()
     {
-        SafeRelease(mCommandList);
+        mBarriers.reserve(NUM_RESERVED_QUEUED_BARRIERS);
+    }
 
-        for (uint32_t frameIndex = 0; frameIndex < NUM_FRAMES_IN_FLIGHT; frameIndex++)
-        {
-            SafeRelease(mCommandAllocators[frameIndex]);
-        }
+    void ResourceBarrierBatch::Transition(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource)
+    {
+        assert(!resource.mHasPendingSplitBarrier);
+
+        AddTransition(resource, newState, subresource, D3D12_RESOURCE_BARRIER_FLAG_NONE, true);
     }
 
-    void Context::Reset()
+    void ResourceBarrierBatch::BeginSplitTransition(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource)
     {
-        uint32_t frameId = mDevice.GetFrameId();
+        assert(!resource.mHasPendingSplitBarrier);
 
-        mCommandAllocators[frameId]->Reset();
-        mCommandList->Reset(mCommandAllocators[frameId], nullptr);
+        AddTransition(resource, newState, subresource, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY, false);
 
-        if (mContextType != D3D12_COMMAND_LIST_TYPE_COPY)
+        resource.mHasPendingSplitBarrier = true;
+        resource.mPendingSplitState = newState;
+        resource.mPendingSplitSubresource = subresource;
+    }
+
+    void ResourceBarrierBatch::EndSplitTransition(Resource& resource)
+    {
+        assert(resource.mHasPendingSplitBarrier);
+
+        // The tracked states have not changed since the begin half was queued, so the same
+        // set of barriers is generated again, this time closing the transition.
+        AddTransition(resource, resource.mPendingSplitState, resource.mPendingSplitSubresource, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY, true);
+
+        resource.mHasPendingSplitBarrier = false;
+        resource.mPendingSplitState = D3D12_RESOURCE_STATE_COMMON;
+        resource.mPendingSplitSubresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    }
+
+    void ResourceBarrierBatch::UAVBarrier(Resource& resource)
+    {
+        D3D12_RESOURCE_BARRIER& barrierDesc = mBarriers.emplace_back();
+        barrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+        barrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        barrierDesc.UAV.pResource = resource.mResource;
+
+        mStats.mNumUAVBarriers++;
+    }
+
+    void ResourceBarrierBatch::Clear()
+    {
+        if (!mBarriers.empty())
         {
-            BindDescriptorHeaps(mDevice.GetFrameId());
+            mStats.mNumFlushes++;
         }
+
+        mBarriers.clear();
     }
 
-    void Context::AddBarrier(Resource& resource, D3D12_RESOURCE_STATES newState)
+    void ResourceBarrierBatch::AddTransition(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource, D3D12_RESOURCE_BARRIER_FLAGS flags, bool commitState)
     {
-        if (mNumQueuedBarriers >= MAX_QUEUED_BARRIERS)
+        const uint32_t subresourceCount = resource.GetSubresourceCount();
+        const bool isSplitBarrier = flags != D3D12_RESOURCE_BARRIER_FLAG_NONE;
+
+        if (subresourceCount == 1)
         {
-            FlushBarriers();
+            subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
         }
 
-        D3D12_RESOURCE_STATES oldState = resource.mState;
+        assert(subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES || subresource < subresourceCount);
 
-        if (mContextType == D3D12_COMMAND_LIST_TYPE_COMPUTE)
+        if (subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES && resource.mSubresourceStates.empty())
         {
-            constexpr D3D12_RESOURCE_STATES VALID_COMPUTE_CONTEXT_STATES = (D3D12_RESOURCE_STATE_UNORDERED_ACCESS | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
-                                                                            D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE);
+            if (IsResourceStateCovered(resource.mState, newState))
+            {
+                if (newState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && !isSplitBarrier)
+                {
+                    UAVBarrier(resource);
+                }
+                else
+                {
+                    mStats.mNumSkippedBarriers++;
+                }
 
-            assert((oldState & VALID_COMPUTE_CONTEXT_STATES) == oldState);
-            assert((newState & VALID_COMPUTE_CONTEXT_STATES) == newState);
+                return;
+            }
+
+            PushTransition(resource.mResource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, resource.mState, newState, flags);
+
+            if (commitState)
+            {
+                resource.mState = newState;
+            }
+
+            return;
         }
 
-        if (oldState != newState)
+        if (subresource == D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
         {
-            D3D12_RESOURCE_BARRIER& barrierDesc = mResourceBarriers[mNumQueuedBarriers];
-            mNumQueuedBarriers++;
+            // Bring every subresource to the same state so tracking can collapse back to mState. Read states
+            // covering newState still need the transition here, otherwise the collapsed state would be wrong.
+            for (uint32_t subresourceIndex = 0; subresourceIndex < subresourceCount; subresourceIndex++)
+            {
+                D3D12_RESOURCE_STATES oldState = resource.mSubresourceStates[subresourceIndex];
+
+                if (oldState == newState)
+                {
+                    mStats.mNumSkippedBarriers++;
+                    continue;
+                }
 
-            barrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-            barrierDesc.Transition.pResource = resource.mResource;
-            barrierDesc.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-            barrierDesc.Transition.StateBefore = oldState;
-            barrierDesc.Transition.StateAfter = newState;
-            barrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+                PushTransition(resource.mResource, subresourceIndex, oldState, newState, flags);
+            }
 
-            resource.mState = newState;
+            if (commitState)
+            {
+                resource.mSubresourceStates.clear();
+                resource.mState = newState;
+            }
+
+            return;
         }
-        else if (newState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+
+        D3D12_RESOURCE_STATES oldState = resource.mSubresourceStates.empty() ? resource.mState : resource.mSubresourceStates[subresource];
+
+        if (IsResourceStateCovered(oldState, newState))
         {
-            D3D12_RESOURCE_BARRIER& barrierDesc = mResourceBarriers[mNumQueuedBarriers];
-            mNumQueuedBarriers++;
+            if (newState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && !isSplitBarrier)
+            {
+                UAVBarrier(resource);
+            }
+            else
+            {
+                mStats.mNumSkippedBarriers++;
+            }
 
-            barrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-            barrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-            barrierDesc.UAV.pResource = resource.mResource;
+            return;
         }
-    }
 
-    void Context::FlushBarriers()
-    {
-        if (mNumQueuedBarriers > 0)
+        PushTransition(resource.mResource, subresource, oldState, newState, flags);
+
+        if (!commitState)
         {
-            mCommandList->ResourceBarrier(mNumQueuedBarriers, mResourceBarriers.data());
-            mNumQueuedBarriers = 0;
+            return;
         }
-    }
 
-    void Context::BindDescriptorHeaps(uint32_t frameIndex)
-    {
-        mCurrentSRVHeap = &mDevice.GetSRVHeap(frameIndex);
-        mCurrentSRVHeap->Reset();
+        if (resource.mSubresourceStates.empty())
+        {
+            resource.mSubresourceStates.resize(subresourceCount, resource.mState);
+        }
 
-        ID3D12DescriptorHeap* heapsToBind[2];
-        heapsToBind[0] = mDevice.GetSRVHeap(frameIndex).GetHeap();
-        heapsToBind[1] = mDevice.GetSamplerHeap().GetHeap();
+        resource.mSubresourceStates[subresource] = newState;
 
-        mCommandList->SetDescriptorHeaps(2, heapsToBind);
-    }
+        bool allSubresourcesMatch = std::all_of(resource.mSubresourceStates.begin(), resource.mSubresourceStates.end(),
+            [newState](D3D12_RESOURCE_STATES state) { return state == newState; });
 
-    void Context::CopyResource(const Resource& destination, const Resource& source)
-    {
-        mCommandList->CopyResource(destination.mResource, source.mResource);
+        if (allSubresourcesMatch)
+        {
+            resource.mSubresourceStates.clear();
+            resource.mState = newState;
+        }
     }
 
-    void Context::CopyBufferRegion(Resource& destination, uint64_t destOffset, Resource& source, uint64_t sourceOffset, uint64_t numBytes)
+    void ResourceBarrierBatch::PushTransition(ID3D12Resource* resource, uint32_t subresource, D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState, D3D12_RESOURCE_BARRIER_FLAGS flags)
     {
-        mCommandList->CopyBufferRegion(destination.mResource, destOffset, source.mResource, sourceOffset, numBytes);
+        D3D12_RESOURCE_BARRIER& barrierDesc = mBarriers.emplace_back();
+        barrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+        barrierDesc.Transition.pResource = resource;
+        barrierDesc.Transition.Subresource = subresource;
+        barrierDesc.Transition.StateBefore = oldState;
+        barrierDesc.Transition.StateAfter = newState;
+        barrierDesc.Flags = flags;
+
+        if (flags == D3D12_RESOURCE_BARRIER_FLAG_NONE)
+        {
+            mStats.mNumTransitionBarriers++;
+        }
+        else
+        {
+            mStats.mNumSplitBarriers++;
+        }
     }
 
-    void Context::CopyTextureRegion(Resource& destination, Resource& source, size_t sourceOffset, SubResourceLayouts& subResourceLayouts, uint32_t numSubResources)
+    Context::Context(Device& device, D3D12_COMMAND_LIST_TYPE commandType)
+        :mDevice(device)
+        , mContextType(commandType)
+        , mQueueMask(GetQueueMask(Device::GetQueueType(commandType)))
+        , mIsTracing(device.GetCommandBackend() != CommandBackend::d3d12)
     {
-        for (uint32_t subResourceIndex = 0; subResourceIndex < numSubResources; subResourceIndex++)
+        // NOTE: The null backend keeps every bit of context bookkeeping but never talks to a command list
+        if (device.GetCommandBackend() == CommandBackend::null)
         {
-            D3D12_TEXTURE_COPY_LOCATION destinationLocation = {};
-            destinationLocation.pResource = destination.mResource;
-            destinationLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-            destinationLocation.SubresourceIndex = subResourceIndex;
-
-            D3D12_TEXTURE_COPY_LOCATION sourceLocation = {};
-            sourceLocation.pResource = source.mResource;
-            sourceLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-            sourceLocation.PlacedFootprint = subResourceLayouts[subResourceIndex];
-            sourceLocation.PlacedFootprint.Offset += sourceOffset;
+            return;
+        }
 
-            mCommandList->CopyTextureRegion(&destinationLocation, 0, 0, 0, &sourceLocation, nullptr);
+        for (uint32_t frameIndex = 0; frameIndex < NUM_FRAMES_IN_FLIGHT; frameIndex++)
+        {
+            AssertIfFailed(mDevice.GetDevice()->CreateCommandAllocator(commandType, IID_PPV_ARGS(&mCommandAllocators[frameIndex])));
         }
+
+        AssertIfFailed(mDevice.GetDevice()->CreateCommandList1(0, commandType, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&mCommandList)));
     }
 
-    GraphicsContext::GraphicsContext(Device& device)
-        :Context(device, D3D12_COMMAND_LIST_TYPE_DIRECT)
+    Context::~Context()
     {
+        SafeRelease(mCommandList);
+
+        for (uint32_t frameIndex = 0; frameIndex < NUM_FRAMES_IN_FLIGHT; frameIndex++)
+        {
+            SafeRelease(mCommandAllocators[frameIndex]);
+        }
     }
 
-    void GraphicsContext::SetDefaultViewPortAndScissor(Uint2 screenSize)
+    void Context::Reset()
     {
-        D3D12_VIEWPORT viewPort;
-        viewPort.Width = static_cast<float>(screenSize.x);
-        viewPort.Height = static_cast<float>(screenSize.y);
-        viewPort.MinDepth = 0.0f;
-        viewPort.MaxDepth = 1.0f;
-        viewPort.TopLeftX = 0;
-        viewPort.TopLeftY = 0;
+        uint32_t frameId = mDevice.GetFrameId();
 
-        D3D12_RECT scissor;
-        scissor.top = 0;
-        scissor.left = 0;
-        scissor.bottom = screenSize.y;
-        scissor.right = screenSize.x;
+        if (mCommandList)
+        {
+            mCommandAllocators[frameId]->Reset();
+            mCommandList->Reset(mCommandAllocators[frameId], nullptr);
+        }
 
-        SetViewport(viewPort);
-        SetScissorRect(scissor);
-    }
+        mTrace.Clear();
 
-    void GraphicsContext::SetViewport(const D3D12_VIEWPORT& viewPort)
-    {
-        mCommandList->RSSetViewports(1, &viewPort);
-    }
+        // Barriers queued but never flushed belong to the previous recording
+        assert(mBarrierBatch.GetNumBarriers() == 0);
+        mBarrierBatch.ResetStats();
 
-    void GraphicsContext::SetScissorRect(const D3D12_RECT& rect)
-    {
-        mCommandList->RSSetScissorRects(1, &rect);
+        // Tables cached during a previous frame live in another frame's heap
+        mDescriptorTableCache.Clear();
+        mDescriptorTableStats = DescriptorTableStats{};
+        mNumSkippedDraws = 0;
+
+        if (mContextType != D3D12_COMMAND_LIST_TYPE_COPY)
+        {
+            BindDescriptorHeaps(mDevice.GetFrameId());
+        }
+
+        ResetBindings();
     }
 
-    void GraphicsContext::SetStencilRef(uint32_t stencilRef)
+    void Context::AddBarrier(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource)
     {
-        mCommandList->OMSetStencilRef(stencilRef);
+        ValidateBarrierStates(resource, newState);
+        TrackQueueUsage(resource);
+        mBarrierBatch.Transition(resource, newState, subresource);
     }
 
-    void GraphicsContext::SetBlendFactor(float* blendFactor)
+    void Context::BeginSplitBarrier(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource)
     {
-        mCommandList->OMSetBlendFactor(blendFactor);
+        ValidateBarrierStates(resource, newState);
+        TrackQueueUsage(resource);
+        mBarrierBatch.BeginSplitTransition(resource, newState, subresource);
     }
 
-    void GraphicsContext::SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+    void Context::EndSplitBarrier(Resource& resource)
     {
-        mCommandList->IASetPrimitiveTopology(topology);
+        mBarrierBatch.EndSplitTransition(resource);
     }
 
-    void GraphicsContext::SetPipeline(const PipelineInfo& pipelineBinding)
+    void Context::ValidateBarrierStates(const Resource& resource, D3D12_RESOURCE_STATES newState)
     {
-        //The checks for a pipeline here are basically just a workaround for the imgui default backend
-
-        if (pipelineBinding.mPipeline)
+        if (mContextType == D3D12_COMMAND_LIST_TYPE_COMPUTE)
         {
-            mCommandList->SetPipelineState(pipelineBinding.mPipeline->mPipeline);
-            mCommandList->SetGraphicsRootSignature(pipelineBinding.mPipeline->mRootSignature);
+            constexpr D3D12_RESOURCE_STATES VALID_COMPUTE_CONTEXT_STATES = (D3D12_RESOURCE_STATE_UNORDERED_ACCESS | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+                                                                            D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE);
 
-            mCurrentPipeline = pipelineBinding.mPipeline;
+            assert((resource.mState & VALID_COMPUTE_CONTEXT_STATES) == resource.mState);
+            assert((newState & VALID_COMPUTE_CONTEXT_STATES) == newState);
+
+            for (D3D12_RESOURCE_STATES subresourceState : resource.mSubresourceStates)
+            {
+                assert((subresourceState & VALID_COMPUTE_CONTEXT_STATES) == subresourceState);
+            }
         }
+    }
 
-        if (!pipelineBinding.mPipeline || mCurrentPipeline->mPipelineType == PipelineType::graphics)
+    void Context::FlushBarriers()
+    {
+        if (mBarrierBatch.GetNumBarriers() > 0)
         {
-            D3D12_CPU_DESCRIPTOR_HANDLE renderTargetHandles[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
-            D3D12_CPU_DESCRIPTOR_HANDLE depthStencilHandle{ 0 };
-
-            size_t renderTargetCount = pipelineBinding.mRenderTargets.size();
-
-            for (size_t targetIndex = 0; targetIndex < renderTargetCount; targetIndex++)
+            if (mIsTracing)
             {
-                renderTargetHandles[targetIndex] = pipelineBinding.mRenderTargets[targetIndex]->mRTVDescriptor.mCPUHandle;
+                TraceBarriers();
             }
 
-            if (pipelineBinding.mDepthStencilTarget)
+            if (mCommandList)
             {
-                depthStencilHandle = pipelineBinding.mDepthStencilTarget->mDSVDescriptor.mCPUHandle;
+                mCommandList->ResourceBarrier(mBarrierBatch.GetNumBarriers(), mBarrierBatch.GetBarriers());
             }
 
-            SetTargets(static_cast<uint32_t>(renderTargetCount), renderTargetHandles, depthStencilHandle);
+            mBarrierBatch.Clear();
         }
     }
 
-    void GraphicsContext::SetPipelineResources(uint32_t spaceId, const PipelineResourceSpace& resources)
+    void Context::TraceBarriers()
     {
-        assert(mCurrentPipeline);
-        assert(resources.IsLocked());
+        std::vector<uint32_t>& words = mTraceScratch;
+        words.clear();
+
+        for (uint32_t barrierIndex = 0; barrierIndex < mBarrierBatch.GetNumBarriers(); barrierIndex++)
+        {
+            const D3D12_RESOURCE_BARRIER& barrier = mBarrierBatch.GetBarriers()[barrierIndex];
+            words.push_back(static_cast<uint32_t>(barrier.Type) | (static_cast<uint32_t>(barrier.Flags) << 16));
+
+            if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)
+            {
+                words.push_back(barrier.Transition.Subresource);
+                words.push_back(static_cast<uint32_t>(barrier.Transition.StateBefore));
+                words.push_back(static_cast<uint32_t>(barrier.Transition.StateAfter));
+            }
+        }
+
+        mTrace.Write(TraceOpcode::barriers, words.data(), static_cast<uint32_t>(words.size()));
+    }
+
+    void Context::BindDescriptorHeaps(uint32_t frameIndex)
+    {
+        mCurrentSRVHeap = &mDevice.GetSRVHeap(frameIndex);
+
+        ID3D12DescriptorHeap* heapsToBind[2];
+        heapsToBind[0] = mDevice.GetSRVHeap(frameIndex).GetHeap();
+        heapsToBind[1] = mDevice.GetSamplerHeap().GetHeap();
 
-        static const uint32_t maxNumHandlesPerBinding = 16;
+        Trace(TraceOpcode::setDescriptorHeaps, { frameIndex });
+
+        if (mCommandList)
+        {
+            mCommandList->SetDescriptorHeaps(2, heapsToBind);
+        }
+    }
+
+    bool Context::GetDescriptorTable(const PipelineResourceSpace& resources, D3D12_GPU_DESCRIPTOR_HANDLE& outTable)
+    {
+        static const uint32_t maxNumHandlesPerBinding = DescriptorTableCache::MAX_TABLE_HANDLES;
         static const uint32_t singleDescriptorRangeCopyArray[maxNumHandlesPerBinding]{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 ,1 };
-        
-        const BufferResource* cbv = resources.GetCBV();
+
         const auto& uavs = resources.GetUAVs();
         const auto& srvs = resources.GetSRVs();
         const uint32_t numTableHandles = static_cast<uint32_t>(uavs.size() + srvs.size());
         D3D12_CPU_DESCRIPTOR_HANDLE handles[maxNumHandlesPerBinding]{};
         uint32_t currentHandleIndex = 0;
-        assert(numTableHandles <= maxNumHandlesPerBinding);
-
-        if(cbv)
-        {
-            auto& cbvMapping = mCurrentPipeline->mPipelineResourceMapping.mCbvMapping[spaceId];
-            assert(cbvMapping.has_value());
 
-            switch (mCurrentPipeline->mPipelineType)
-            {
-            case PipelineType::graphics:
-                mCommandList->SetGraphicsRootConstantBufferView(cbvMapping.value(), cbv->mVirtualAddress);
-                break;
-            case PipelineType::compute:
-                mCommandList->SetComputeRootConstantBufferView(cbvMapping.value(), cbv->mVirtualAddress);
-                break;
-            default:
-                assert(false);
-                break;
-            }
-        }
+        assert(numTableHandles <= maxNumHandlesPerBinding);
 
         if (numTableHandles == 0)
         {
-            return;
+            return false;
         }
 
         for (auto& uav : uavs)
         {
+            TrackQueueUsage(*uav.mResource);
+
             if (uav.mResource->mType == GPUResourceType::buffer)
             {
                 handles[currentHandleIndex++] = static_cast<BufferResource*>(uav.mResource)->mUAVDescriptor.mCPUHandle;
@@ -626,6 +804,8 @@ namespace D3D12Lite
 
         for (auto& srv : srvs)
         {
+            TrackQueueUsage(*srv.mResource);
+
             if (srv.mResource->mType == GPUResourceType::buffer)
             {
                 handles[currentHandleIndex++] = static_cast<BufferResource*>(srv.mResource)->mSRVDescriptor.mCPUHandle;
@@ -636,39 +816,423 @@ namespace D3D12Lite
             }
         }
 
+        if (mDescriptorTableCache.Find(handles, numTableHandles, outTable))
+        {
+            mDescriptorTableStats.mNumCacheHits++;
+            return true;
+        }
+
         Descriptor blockStart = mCurrentSRVHeap->AllocateUserDescriptorBlock(numTableHandles);
         mDevice.CopyDescriptors(1, &blockStart.mCPUHandle, &numTableHandles, numTableHandles, handles, singleDescriptorRangeCopyArray, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
+        mDescriptorTableCache.Insert(handles, numTableHandles, blockStart.mGPUHandle);
+        mDescriptorTableStats.mNumTablesCopied++;
+        mDescriptorTableStats.mNumDescriptorsCopied += numTableHandles;
+
+        outTable = blockStart.mGPUHandle;
+        return true;
+    }
+
+    void Context::TraceDescriptorTable(uint32_t rootParameterIndex, const PipelineResourceSpace& resources)
+    {
+        if (!mIsTracing)
+        {
+            return;
+        }
+
+        std::vector<uint32_t>& words = mTraceScratch;
+        words.clear();
+        words.push_back(rootParameterIndex);
+
+        for (const PipelineResourceBinding& uav : resources.GetUAVs())
+        {
+            words.push_back(uav.mResource->mTraceId);
+        }
+
+        for (const PipelineResourceBinding& srv : resources.GetSRVs())
+        {
+            words.push_back(srv.mResource->mTraceId);
+        }
+
+        mTrace.Write(TraceOpcode::setRootDescriptorTable, words.data(), static_cast<uint32_t>(words.size()));
+    }
+
+    void Context::CopyResource(const Resource& destination, const Resource& source)
+    {
+        TrackQueueUsage(destination);
+        TrackQueueUsage(source);
+        Trace(TraceOpcode::copyResource, { destination.mTraceId, source.mTraceId });
+
+        if (mCommandList)
+        {
+            mCommandList->CopyResource(destination.mResource, source.mResource);
+        }
+    }
+
+    void Context::CopyBufferRegion(Resource& destination, uint64_t destOffset, Resource& source, uint64_t sourceOffset, uint64_t numBytes)
+    {
+        TrackQueueUsage(destination);
+        TrackQueueUsage(source);
+        Trace(TraceOpcode::copyBufferRegion, { destination.mTraceId, TraceLow(destOffset), TraceHigh(destOffset), source.mTraceId, TraceLow(sourceOffset), TraceHigh(sourceOffset), TraceLow(numBytes), TraceHigh(numBytes) });
+
+        if (mCommandList)
+        {
+            mCommandList->CopyBufferRegion(destination.mResource, destOffset, source.mResource, sourceOffset, numBytes);
+        }
+    }
+
+    void Context::CopyTextureRegion(Resource& destination, Resource& source, size_t sourceOffset, SubResourceLayouts& subResourceLayouts, uint32_t numSubResources)
+    {
+        TrackQueueUsage(destination);
+        TrackQueueUsage(source);
+        Trace(TraceOpcode::copyTextureRegion, { destination.mTraceId, source.mTraceId, TraceLow(sourceOffset), TraceHigh(sourceOffset), numSubResources });
+
+        for (uint32_t subResourceIndex = 0; mCommandList && subResourceIndex < numSubResources; subResourceIndex++)
+        {
+            D3D12_TEXTURE_COPY_LOCATION destinationLocation = {};
+            destinationLocation.pResource = destination.mResource;
+            destinationLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+            destinationLocation.SubresourceIndex = subResourceIndex;
+
+            D3D12_TEXTURE_COPY_LOCATION sourceLocation = {};
+            sourceLocation.pResource = source.mResource;
+            sourceLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+            sourceLocation.PlacedFootprint = subResourceLayouts[subResourceIndex];
+            sourceLocation.PlacedFootprint.Offset += sourceOffset;
+
+            mCommandList->CopyTextureRegion(&destinationLocation, 0, 0, 0, &sourceLocation, nullptr);
+        }
+    }
+
+    GraphicsContext::GraphicsContext(Device& device)
+        :Context(device, D3D12_COMMAND_LIST_TYPE_DIRECT)
+    {
+    }
+
+    void GraphicsContext::SetDefaultViewPortAndScissor(Uint2 screenSize)
+    {
+        D3D12_VIEWPORT viewPort;
+        viewPort.Width = static_cast<float>(screenSize.x);
+        viewPort.Height = static_cast<float>(screenSize.y);
+        viewPort.MinDepth = 0.0f;
+        viewPort.MaxDepth = 1.0f;
+        viewPort.TopLeftX = 0;
+        viewPort.TopLeftY = 0;
+
+        D3D12_RECT scissor;
+        scissor.top = 0;
+        scissor.left = 0;
+        scissor.bottom = screenSize.y;
+        scissor.right = screenSize.x;
+
+        SetViewport(viewPort);
+        SetScissorRect(scissor);
+    }
+
+    void GraphicsContext::SetViewport(const D3D12_VIEWPORT& viewPort)
+    {
+        Trace(TraceOpcode::setViewport, { TraceFloat(viewPort.TopLeftX), TraceFloat(viewPort.TopLeftY), TraceFloat(viewPort.Width), TraceFloat(viewPort.Height), TraceFloat(viewPort.MinDepth), TraceFloat(viewPort.MaxDepth) });
+
+        if (mCommandList)
+        {
+            mCommandList->RSSetViewports(1, &viewPort);
+        }
+
+        mState.mViewport = viewPort;
+    }
+
+    void GraphicsContext::SetScissorRect(const D3D12_RECT& rect)
+    {
+        Trace(TraceOpcode::setScissorRect, { static_cast<uint32_t>(rect.left), static_cast<uint32_t>(rect.top), static_cast<uint32_t>(rect.right), static_cast<uint32_t>(rect.bottom) });
+
+        if (mCommandList)
+        {
+            mCommandList->RSSetScissorRects(1, &rect);
+        }
+
+        mState.mScissorRect = rect;
+    }
+
+    void GraphicsContext::SetStencilRef(uint32_t stencilRef)
+    {
+        Trace(TraceOpcode::setStencilRef, { stencilRef });
+
+        if (mCommandList)
+        {
+            mCommandList->OMSetStencilRef(stencilRef);
+        }
+
+        mState.mStencilRef = stencilRef;
+    }
+
+    void GraphicsContext::SetBlendFactor(float* blendFactor)
+    {
+        if (mCommandList)
+        {
+            mCommandList->OMSetBlendFactor(blendFactor);
+        }
+
+        if (blendFactor)
+        {
+            Trace(TraceOpcode::setBlendFactor, { TraceFloat(blendFactor[0]), TraceFloat(blendFactor[1]), TraceFloat(blendFactor[2]), TraceFloat(blendFactor[3]) });
+            mState.mBlendFactor = std::array<float, 4>{ blendFactor[0], blendFactor[1], blendFactor[2], blendFactor[3] };
+        }
+        else
+        {
+            Trace(TraceOpcode::setBlendFactor, {});
+            mState.mBlendFactor.reset();
+        }
+    }
+
+    void GraphicsContext::SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+    {
+        Trace(TraceOpcode::setPrimitiveTopology, { static_cast<uint32_t>(topology) });
+
+        if (mCommandList)
+        {
+            mCommandList->IASetPrimitiveTopology(topology);
+        }
+
+        mState.mPrimitiveTopology = topology;
+    }
+
+    void GraphicsContext::SetPipeline(const PipelineInfo& pipelineBinding)
+    {
+        //The checks for a pipeline here are basically just a workaround for the imgui default backend
+
+        if (pipelineBinding.mPipeline)
+        {
+            SetPipelineState(pipelineBinding.mPipeline);
+        }
+
+        mState.mPipeline = pipelineBinding;
+
+        if (!pipelineBinding.mPipeline || mCurrentPipeline->mPipelineType == PipelineType::graphics)
+        {
+            D3D12_CPU_DESCRIPTOR_HANDLE renderTargetHandles[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT]{};
+            D3D12_CPU_DESCRIPTOR_HANDLE depthStencilHandle{ 0 };
+
+            size_t renderTargetCount = pipelineBinding.mRenderTargets.size();
+
+            for (size_t targetIndex = 0; targetIndex < renderTargetCount; targetIndex++)
+            {
+                renderTargetHandles[targetIndex] = pipelineBinding.mRenderTargets[targetIndex]->mRTVDescriptor.mCPUHandle;
+            }
+
+            if (pipelineBinding.mDepthStencilTarget)
+            {
+                depthStencilHandle = pipelineBinding.mDepthStencilTarget->mDSVDescriptor.mCPUHandle;
+            }
+
+            if (mIsTracing)
+            {
+                uint32_t targetTraceIds[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT + 1]{};
+                targetTraceIds[0] = pipelineBinding.mDepthStencilTarget ? pipelineBinding.mDepthStencilTarget->mTraceId : 0;
+
+                for (size_t targetIndex = 0; targetIndex < renderTargetCount; targetIndex++)
+                {
+                    targetTraceIds[targetIndex + 1] = pipelineBinding.mRenderTargets[targetIndex]->mTraceId;
+                }
+
+                mTrace.Write(TraceOpcode::setRenderTargets, targetTraceIds, static_cast<uint32_t>(renderTargetCount + 1));
+            }
+
+            SetTargets(static_cast<uint32_t>(renderTargetCount), renderTargetHandles, depthStencilHandle);
+        }
+    }
+
+    void GraphicsContext::SetPipelineState(PipelineStateObject* pipeline)
+    {
+        assert(pipeline);
+
+        Trace(TraceOpcode::setPipeline, { pipeline->mTraceId });
+
+        if (mCommandList)
+        {
+            mCommandList->SetPipelineState(pipeline->mPipeline);
+            mCommandList->SetGraphicsRootSignature(pipeline->mRootSignature);
+        }
+
+        // Setting a root signature invalidates every root argument bound so far
+        if (pipeline != mCurrentPipeline)
+        {
+            mState.mResourceSpaces.fill(nullptr);
+            mState.mConstants.fill(ConstantAllocation{});
+            mState.mRootConstantsMask = 0;
+        }
+
+        if (mState.mPipeline.has_value())
+        {
+            mState.mPipeline->mPipeline = pipeline;
+        }
+
+        mCurrentPipeline = pipeline;
+    }
+
+    void GraphicsContext::SetPipelineResources(uint32_t spaceId, const PipelineResourceSpace& resources)
+    {
+        assert(mCurrentPipeline);
+        assert(resources.IsLocked());
+
+        mState.mResourceSpaces[spaceId] = &resources;
+
+        const BufferResource* cbv = resources.GetCBV();
+
+        if(cbv)
+        {
+            auto& cbvMapping = mCurrentPipeline->mPipelineResourceMapping.mCbvMapping[spaceId];
+            assert(cbvMapping.has_value());
+
+            TrackQueueUsage(*cbv);
+            Trace(TraceOpcode::setRootConstantBufferView, { cbvMapping.value(), cbv->mTraceId, 0, 0 });
+
+            if (mCommandList)
+            {
+                switch (mCurrentPipeline->mPipelineType)
+                {
+                case PipelineType::graphics:
+                    mCommandList->SetGraphicsRootConstantBufferView(cbvMapping.value(), cbv->mVirtualAddress);
+                    break;
+                case PipelineType::compute:
+                    mCommandList->SetComputeRootConstantBufferView(cbvMapping.value(), cbv->mVirtualAddress);
+                    break;
+                default:
+                    assert(false);
+                    break;
+                }
+            }
+        }
+
+        D3D12_GPU_DESCRIPTOR_HANDLE table{ 0 };
+        if (!GetDescriptorTable(resources, table))
+        {
+            return;
+        }
+
         auto& tableMapping = mCurrentPipeline->mPipelineResourceMapping.mTableMapping[spaceId];
         assert(tableMapping.has_value());
 
-        switch (mCurrentPipeline->mPipelineType)
+        TraceDescriptorTable(tableMapping.value(), resources);
+
+        if (mCommandList)
         {
-        case PipelineType::graphics:
-            mCommandList->SetGraphicsRootDescriptorTable(tableMapping.value(), blockStart.mGPUHandle);
-            break;
-        case PipelineType::compute:
-            mCommandList->SetComputeRootDescriptorTable(tableMapping.value(), blockStart.mGPUHandle);
-            break;
-        default:
-            assert(false);
-            break;
+            switch (mCurrentPipeline->mPipelineType)
+            {
+            case PipelineType::graphics:
+                mCommandList->SetGraphicsRootDescriptorTable(tableMapping.value(), table);
+                break;
+            case PipelineType::compute:
+                mCommandList->SetComputeRootDescriptorTable(tableMapping.value(), table);
+                break;
+            default:
+                assert(false);
+                break;
+            }
+        }
+    }
+
+    void GraphicsContext::SetPipelineConstants(uint32_t spaceId, const ConstantAllocation& constants)
+    {
+        assert(mCurrentPipeline);
+
+        // The previous constants stay bound, the draws are skipped instead of reading them
+        if (!constants.IsValid())
+        {
+            AssertError("Binding constants that couldn't be allocated, the draws using them are skipped");
+            mState.mConstants[spaceId] = ConstantAllocation{};
+            mState.mMissingConstantsMask |= 1u << spaceId;
+            return;
+        }
+
+        mState.mConstants[spaceId] = constants;
+        mState.mMissingConstantsMask &= ~(1u << spaceId);
+
+        auto& cbvMapping = mCurrentPipeline->mPipelineResourceMapping.mCbvMapping[spaceId];
+        assert(cbvMapping.has_value());
+
+        Trace(TraceOpcode::setRootConstantBufferView, { cbvMapping.value(), constants.mBuffer->mTraceId, TraceLow(constants.mOffset), TraceHigh(constants.mOffset) });
+
+        if (mCommandList)
+        {
+            switch (mCurrentPipeline->mPipelineType)
+            {
+            case PipelineType::graphics:
+                mCommandList->SetGraphicsRootConstantBufferView(cbvMapping.value(), constants.mGPUAddress);
+                break;
+            case PipelineType::compute:
+                mCommandList->SetComputeRootConstantBufferView(cbvMapping.value(), constants.mGPUAddress);
+                break;
+            default:
+                assert(false);
+                break;
+            }
         }
     }
 
     void GraphicsContext::SetPipeline32BitConstant(uint32_t rootParameterIndex, uint32_t value, uint32_t offset)
     {
-        mCommandList->SetGraphicsRoot32BitConstant(rootParameterIndex, value, offset);
+        Trace(TraceOpcode::setRoot32BitConstants, { rootParameterIndex, offset, value });
+
+        if (mCommandList)
+        {
+            mCommandList->SetGraphicsRoot32BitConstant(rootParameterIndex, value, offset);
+        }
     }
 
     void GraphicsContext::SetPipeline32BitConstants(uint32_t rootParameterIndex, uint32_t numValues, const void* data, uint32_t offset)
     {
-        mCommandList->SetGraphicsRoot32BitConstants(rootParameterIndex, numValues, data, offset);
+        if (mIsTracing)
+        {
+            std::vector<uint32_t>& words = mTraceScratch;
+            words.assign({ rootParameterIndex, offset });
+            words.insert(words.end(), static_cast<const uint32_t*>(data), static_cast<const uint32_t*>(data) + numValues);
+            mTrace.Write(TraceOpcode::setRoot32BitConstants, words.data(), static_cast<uint32_t>(words.size()));
+        }
+
+        if (mCommandList)
+        {
+            mCommandList->SetGraphicsRoot32BitConstants(rootParameterIndex, numValues, data, offset);
+        }
+    }
+
+    void GraphicsContext::SetRootConstant(uint32_t value, uint32_t offset)
+    {
+        assert(mCurrentPipeline);
+
+        auto& constantsMapping = mCurrentPipeline->mPipelineResourceMapping.mConstantsMapping;
+        assert(constantsMapping.has_value());
+
+        if (offset < MAX_INHERITED_ROOT_CONSTANTS)
+        {
+            mState.mRootConstants[offset] = value;
+            mState.mRootConstantsMask |= 1u << offset;
+        }
+
+        Trace(TraceOpcode::setRoot32BitConstants, { constantsMapping.value(), offset, value });
+
+        if (mCommandList)
+        {
+            switch (mCurrentPipeline->mPipelineType)
+            {
+            case PipelineType::graphics:
+                mCommandList->SetGraphicsRoot32BitConstant(constantsMapping.value(), value, offset);
+                break;
+            case PipelineType::compute:
+                mCommandList->SetComputeRoot32BitConstant(constantsMapping.value(), value, offset);
+                break;
+            default:
+                assert(false);
+                break;
+            }
+        }
     }
 
     void GraphicsContext::SetTargets(uint32_t numRenderTargets, const D3D12_CPU_DESCRIPTOR_HANDLE renderTargets[], D3D12_CPU_DESCRIPTOR_HANDLE depthStencil)
     {
-        mCommandList->OMSetRenderTargets(numRenderTargets, renderTargets, false, depthStencil.ptr != 0 ? &depthStencil : nullptr);
+        if (mCommandList)
+        {
+            mCommandList->OMSetRenderTargets(numRenderTargets, renderTargets, false, depthStencil.ptr != 0 ? &depthStencil : nullptr);
+        }
     }
 
     void GraphicsContext::SetIndexBuffer(const BufferResource& indexBuffer)
@@ -682,23 +1246,170 @@ namespace D3D12Lite
         indexBufferView.SizeInBytes = static_cast<uint32_t>(indexBuffer.mDesc.Width);
         indexBufferView.BufferLocation = indexBuffer.mResource->GetGPUVirtualAddress();
 
-        mCommandList->IASetIndexBuffer(&indexBufferView);
+        TrackQueueUsage(indexBuffer);
+        Trace(TraceOpcode::setIndexBuffer, { indexBuffer.mTraceId, indexBufferView.SizeInBytes, static_cast<uint32_t>(indexBufferView.Format) });
+
+        if (mCommandList)
+        {
+            mCommandList->IASetIndexBuffer(&indexBufferView);
+        }
+
+        mState.mIndexBuffer = &indexBuffer;
+    }
+
+    void GraphicsContext::ExecuteIndirect(const CommandSignature& commandSignature, const BufferResource& argumentBuffer, uint64_t argumentOffset, uint32_t numCommands)
+    {
+        assert(mCurrentPipeline);
+        assert(commandSignature.mType == CommandSignatureType::drawIndexedWithDrawId);
+
+        if (SkipWithoutConstants(mState.mMissingConstantsMask))
+        {
+            return;
+        }
+
+        TrackQueueUsage(argumentBuffer);
+        Trace(TraceOpcode::executeIndirect, { static_cast<uint32_t>(commandSignature.mType), commandSignature.mByteStride, argumentBuffer.mTraceId, TraceLow(argumentOffset), TraceHigh(argumentOffset), numCommands });
+
+        if (mCommandList)
+        {
+            mCommandList->ExecuteIndirect(commandSignature.mCommandSignature, numCommands, argumentBuffer.mResource, argumentOffset, nullptr, 0);
+        }
+    }
+
+    void GraphicsContext::InheritState(const GraphicsContextState& state)
+    {
+        if (state.mPipeline.has_value())
+        {
+            SetPipeline(state.mPipeline.value());
+        }
+
+        for (uint32_t spaceId = 0; spaceId < NUM_RESOURCE_SPACES; spaceId++)
+        {
+            if (state.mResourceSpaces[spaceId])
+            {
+                SetPipelineResources(spaceId, *state.mResourceSpaces[spaceId]);
+            }
+
+            if (state.mConstants[spaceId].IsValid())
+            {
+                SetPipelineConstants(spaceId, state.mConstants[spaceId]);
+            }
+        }
+
+        // The parent asserted already, its chunks skip the same draws
+        mState.mMissingConstantsMask = state.mMissingConstantsMask;
+
+        for (uint32_t offset = 0; offset < MAX_INHERITED_ROOT_CONSTANTS; offset++)
+        {
+            if (state.mRootConstantsMask & (1u << offset))
+            {
+                SetRootConstant(state.mRootConstants[offset], offset);
+            }
+        }
+
+        if (state.mViewport.has_value())
+        {
+            SetViewport(state.mViewport.value());
+        }
+
+        if (state.mScissorRect.has_value())
+        {
+            SetScissorRect(state.mScissorRect.value());
+        }
+
+        if (state.mStencilRef.has_value())
+        {
+            SetStencilRef(state.mStencilRef.value());
+        }
+
+        if (state.mBlendFactor.has_value())
+        {
+            std::array<float, 4> blendFactor = state.mBlendFactor.value();
+            SetBlendFactor(blendFactor.data());
+        }
+
+        if (state.mPrimitiveTopology != D3D_PRIMITIVE_TOPOLOGY_UNDEFINED)
+        {
+            SetPrimitiveTopology(state.mPrimitiveTopology);
+        }
+
+        if (state.mIndexBuffer)
+        {
+            SetIndexBuffer(*state.mIndexBuffer);
+        }
+    }
+
+    // Turns stream packets back into GraphicsContext calls, so replayed commands go through the same bookkeeping
+    // (state tracking, queue usage, descriptor tables, traces) as commands recorded directly
+    struct GraphicsContextStreamTarget
+    {
+        GraphicsContext& mContext;
+
+        void Execute(const SetPipelinePacket& packet) { mContext.SetPipelineState(packet.mPipeline); }
+        void Execute(const SetPipelineResourcesPacket& packet) { mContext.SetPipelineResources(packet.mSpaceId, *packet.mResources); }
+        void Execute(const SetRootConstantPacket& packet) { mContext.SetRootConstant(packet.mValue, packet.mOffset); }
+        void Execute(const SetIndexBufferPacket& packet) { mContext.SetIndexBuffer(*packet.mIndexBuffer); }
+        void Execute(const SetPrimitiveTopologyPacket& packet) { mContext.SetPrimitiveTopology(static_cast<D3D12_PRIMITIVE_TOPOLOGY>(packet.mTopology)); }
+        void Execute(const DrawInstancedPacket& packet) { mContext.DrawInstanced(packet.mVertexCountPerInstance, packet.mInstanceCount, packet.mStartVertexLocation, packet.mStartInstanceLocation); }
+        void Execute(const DrawIndexedInstancedPacket& packet) { mContext.DrawIndexedInstanced(packet.mIndexCountPerInstance, packet.mInstanceCount, packet.mStartIndexLocation, packet.mBaseVertexLocation, packet.mStartInstanceLocation); }
+        void Execute(const ExecuteIndirectPacket& packet) { mContext.ExecuteIndirect(*packet.mCommandSignature, *packet.mArgumentBuffer, packet.mArgumentOffset, packet.mNumCommands); }
+        void Execute(const DispatchPacket& packet) { mContext.Dispatch(packet.mGroupCountX, packet.mGroupCountY, packet.mGroupCountZ); }
+
+        void Execute(const SetPipelineConstantsPacket& packet)
+        {
+            ConstantAllocation constants;
+            constants.mCPUAddress = packet.mCPUAddress;
+            constants.mGPUAddress = packet.mGPUAddress;
+            constants.mSize = packet.mSize;
+            constants.mBuffer = packet.mBuffer;
+            constants.mOffset = packet.mOffset;
+
+            mContext.SetPipelineConstants(packet.mSpaceId, constants);
+        }
+    };
+
+    void GraphicsContext::Replay(const CommandStream& stream)
+    {
+        GraphicsContextStreamTarget target{ *this };
+        stream.Replay(target);
+    }
+
+    void GraphicsContext::ResetBindings()
+    {
+        mCurrentPipeline = nullptr;
+        mState = GraphicsContextState{};
     }
 
     void GraphicsContext::ClearRenderTarget(const TextureResource& target, float* color)
     {
-        mCommandList->ClearRenderTargetView(target.mRTVDescriptor.mCPUHandle, color, 0, nullptr);
+        Trace(TraceOpcode::clearRenderTarget, { target.mTraceId, TraceFloat(color[0]), TraceFloat(color[1]), TraceFloat(color[2]), TraceFloat(color[3]) });
+
+        if (mCommandList)
+        {
+            mCommandList->ClearRenderTargetView(target.mRTVDescriptor.mCPUHandle, color, 0, nullptr);
+        }
     }
 
     void GraphicsContext::ClearDepthStencilTarget(const TextureResource& target, float depth, uint8_t stencil)
     {
-        mCommandList->ClearDepthStencilView(target.mDSVDescriptor.mCPUHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, depth, stencil, 0, nullptr);
+        Trace(TraceOpcode::clearDepthStencil, { target.mTraceId, TraceFloat(depth), stencil });
+
+        if (mCommandList)
+        {
+            mCommandList->ClearDepthStencilView(target.mDSVDescriptor.mCPUHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, depth, stencil, 0, nullptr);
+        }
     }
 
     void GraphicsContext::DrawFullScreenTriangle()
     {
         SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-        mCommandList->IASetIndexBuffer(nullptr);
+        Trace(TraceOpcode::setIndexBuffer, { 0, 0, 0 });
+
+        if (mCommandList)
+        {
+            mCommandList->IASetIndexBuffer(nullptr);
+        }
+
         Draw(3);
     }
 
@@ -714,17 +1425,47 @@ namespace D3D12Lite
 
     void GraphicsContext::DrawInstanced(uint32_t vertexCountPerInstance, uint32_t instanceCount, uint32_t startVertexLocation, uint32_t startInstanceLocation)
     {
-        mCommandList->DrawInstanced(vertexCountPerInstance, instanceCount, startVertexLocation, startInstanceLocation);
+        if (SkipWithoutConstants(mState.mMissingConstantsMask))
+        {
+            return;
+        }
+
+        Trace(TraceOpcode::drawInstanced, { vertexCountPerInstance, instanceCount, startVertexLocation, startInstanceLocation });
+
+        if (mCommandList)
+        {
+            mCommandList->DrawInstanced(vertexCountPerInstance, instanceCount, startVertexLocation, startInstanceLocation);
+        }
     }
 
     void GraphicsContext::DrawIndexedInstanced(uint32_t indexCountPerInstance, uint32_t instanceCount, uint32_t startIndexLocation, uint32_t baseVertexLocation, uint32_t startInstanceLocation)
     {
-        mCommandList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+        if (SkipWithoutConstants(mState.mMissingConstantsMask))
+        {
+            return;
+        }
+
+        Trace(TraceOpcode::drawIndexedInstanced, { indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation });
+
+        if (mCommandList)
+        {
+            mCommandList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+        }
     }
 
     void GraphicsContext::Dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
     {
-        mCommandList->Dispatch(groupCountX, groupCountY, groupCountZ);
+        if (SkipWithoutConstants(mState.mMissingConstantsMask))
+        {
+            return;
+        }
+
+        Trace(TraceOpcode::dispatch, { groupCountX, groupCountY, groupCountZ });
+
+        if (mCommandList)
+        {
+            mCommandList->Dispatch(groupCountX, groupCountY, groupCountZ);
+        }
     }
 
     void GraphicsContext::Dispatch1D(uint32_t threadCountX, uint32_t groupSizeX)
@@ -752,8 +1493,13 @@ namespace D3D12Lite
     {
         assert(pipelineBinding.mPipeline && pipelineBinding.mPipeline->mPipelineType == PipelineType::compute);
 
-        mCommandList->SetPipelineState(pipelineBinding.mPipeline->mPipeline);
-        mCommandList->SetComputeRootSignature(pipelineBinding.mPipeline->mRootSignature);
+        Trace(TraceOpcode::setPipeline, { pipelineBinding.mPipeline->mTraceId });
+
+        if (mCommandList)
+        {
+            mCommandList->SetPipelineState(pipelineBinding.mPipeline->mPipeline);
+            mCommandList->SetComputeRootSignature(pipelineBinding.mPipeline->mRootSignature);
+        }
 
         mCurrentPipeline = pipelineBinding.mPipeline;
     }
@@ -763,67 +1509,77 @@ namespace D3D12Lite
         assert(mCurrentPipeline);
         assert(resources.IsLocked());
 
-        static const uint32_t maxNumHandlesPerBinding = 16;
-        static const uint32_t singleDescriptorRangeCopyArray[maxNumHandlesPerBinding]{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 ,1 };
-
         const BufferResource* cbv = resources.GetCBV();
-        const auto& uavs = resources.GetUAVs();
-        const auto& srvs = resources.GetSRVs();
-        const uint32_t numTableHandles = static_cast<uint32_t>(uavs.size() + srvs.size());
-        D3D12_CPU_DESCRIPTOR_HANDLE handles[maxNumHandlesPerBinding]{};
-        uint32_t currentHandleIndex = 0;
-
-        assert(numTableHandles <= maxNumHandlesPerBinding);
 
         if(cbv)
         {
             auto& cbvMapping = mCurrentPipeline->mPipelineResourceMapping.mCbvMapping[spaceId];
             assert(cbvMapping.has_value());
 
-            mCommandList->SetComputeRootConstantBufferView(cbvMapping.value(), cbv->mVirtualAddress);
+            TrackQueueUsage(*cbv);
+            Trace(TraceOpcode::setRootConstantBufferView, { cbvMapping.value(), cbv->mTraceId, 0, 0 });
+
+            if (mCommandList)
+            {
+                mCommandList->SetComputeRootConstantBufferView(cbvMapping.value(), cbv->mVirtualAddress);
+            }
         }
 
-        if (numTableHandles == 0)
+        D3D12_GPU_DESCRIPTOR_HANDLE table{ 0 };
+        if (!GetDescriptorTable(resources, table))
         {
             return;
         }
 
-        for (auto& uav : uavs)
+        auto& tableMapping = mCurrentPipeline->mPipelineResourceMapping.mTableMapping[spaceId];
+        assert(tableMapping.has_value());
+
+        TraceDescriptorTable(tableMapping.value(), resources);
+
+        if (mCommandList)
         {
-            if (uav.mResource->mType == GPUResourceType::buffer)
-            {
-                handles[currentHandleIndex++] = static_cast<BufferResource*>(uav.mResource)->mUAVDescriptor.mCPUHandle;
-            }
-            else
-            {
-                handles[currentHandleIndex++] = static_cast<TextureResource*>(uav.mResource)->mUAVDescriptor.mCPUHandle;
-            }
+            mCommandList->SetComputeRootDescriptorTable(tableMapping.value(), table);
         }
+    }
 
-        for (auto& srv : srvs)
+    void ComputeContext::SetPipelineConstants(uint32_t spaceId, const ConstantAllocation& constants)
+    {
+        assert(mCurrentPipeline);
+
+        // The previous constants stay bound, the dispatches are skipped instead of reading them
+        if (!constants.IsValid())
         {
-            if (srv.mResource->mType == GPUResourceType::buffer)
-            {
-                handles[currentHandleIndex++] = static_cast<BufferResource*>(srv.mResource)->mSRVDescriptor.mCPUHandle;
-            }
-            else
-            {
-                handles[currentHandleIndex++] = static_cast<TextureResource*>(srv.mResource)->mSRVDescriptor.mCPUHandle;
-            }
+            AssertError("Binding constants that couldn't be allocated, the dispatches using them are skipped");
+            mMissingConstantsMask |= 1u << spaceId;
+            return;
         }
 
-        Descriptor blockStart = mCurrentSRVHeap->AllocateUserDescriptorBlock(numTableHandles);
-        mDevice.CopyDescriptors(1, &blockStart.mCPUHandle, &numTableHandles, numTableHandles, handles, singleDescriptorRangeCopyArray, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+        mMissingConstantsMask &= ~(1u << spaceId);
 
-        auto& tableMapping = mCurrentPipeline->mPipelineResourceMapping.mTableMapping[spaceId];
-        assert(tableMapping.has_value());
+        auto& cbvMapping = mCurrentPipeline->mPipelineResourceMapping.mCbvMapping[spaceId];
+        assert(cbvMapping.has_value());
+
+        Trace(TraceOpcode::setRootConstantBufferView, { cbvMapping.value(), constants.mBuffer->mTraceId, TraceLow(constants.mOffset), TraceHigh(constants.mOffset) });
+
+        if (mCommandList)
+        {
+            mCommandList->SetComputeRootConstantBufferView(cbvMapping.value(), constants.mGPUAddress);
+        }
+    }
+
+    void ComputeContext::Dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+    {
+        if (SkipWithoutConstants(mMissingConstantsMask))
+        {
+            return;
+        }
 
-        mCommandList->SetComputeRootDescriptorTable(tableMapping.value(), blockStart.mGPUHandle);
-    }
+        Trace(TraceOpcode::dispatch, { groupCountX, groupCountY, groupCountZ });
 
-    void ComputeContext::Dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
-    {
-        mCommandList->Dispatch(groupCountX, groupCountY, groupCountZ);
+        if (mCommandList)
+        {
+            mCommandList->Dispatch(groupCountX, groupCountY, groupCountZ);
+        }
     }
 
     void ComputeContext::Dispatch1D(uint32_t threadCountX, uint32_t groupSizeX)
@@ -841,10 +1597,10 @@ namespace D3D12Lite
         Dispatch(GetGroupCount(threadCountX, groupSizeX), GetGroupCount(threadCountY, groupSizeY), GetGroupCount(threadCountZ, groupSizeZ));
     }
 
-    UploadContext::UploadContext(Device& device, std::unique_ptr<BufferResource> bufferUploadHeap, std::unique_ptr<BufferResource> textureUploadHeap)
+    UploadContext::UploadContext(Device& device, BufferHandle bufferUploadHeap, BufferHandle textureUploadHeap)
         :Context(device, D3D12_COMMAND_LIST_TYPE_COPY)
-        , mBufferUploadHeap(std::move(bufferUploadHeap))
-        , mTextureUploadHeap(std::move(textureUploadHeap))
+        , mBufferUploadHeap(bufferUploadHeap)
+        , mTextureUploadHeap(textureUploadHeap)
     {
 
     }
@@ -852,30 +1608,34 @@ namespace D3D12Lite
     UploadContext::~UploadContext()
     {
         //Upload context heaps weren't returned for some reason
-        assert(mBufferUploadHeap == nullptr);
-        assert(mTextureUploadHeap == nullptr);
+        assert(!mBufferUploadHeap.IsValid());
+        assert(!mTextureUploadHeap.IsValid());
     }
 
-    std::unique_ptr<BufferResource> UploadContext::ReturnBufferHeap()
+    BufferHandle UploadContext::ReturnBufferHeap()
     {
-        return std::move(mBufferUploadHeap);
+        BufferHandle bufferUploadHeap = mBufferUploadHeap;
+        mBufferUploadHeap = BufferHandle();
+        return bufferUploadHeap;
     }
 
-    std::unique_ptr<BufferResource> UploadContext::ReturnTextureHeap()
+    BufferHandle UploadContext::ReturnTextureHeap()
     {
-        return std::move(mTextureUploadHeap);
+        BufferHandle textureUploadHeap = mTextureUploadHeap;
+        mTextureUploadHeap = BufferHandle();
+        return textureUploadHeap;
     }
 
     void UploadContext::AddBufferUpload(std::unique_ptr<BufferUpload> bufferUpload)
     {
-        assert(bufferUpload->mBufferDataSize <= mBufferUploadHeap->mDesc.Width);
+        assert(bufferUpload->mBufferDataSize <= mDevice.GetBuffer(mBufferUploadHeap).mDesc.Width);
 
         mBufferUploads.push_back(std::move(bufferUpload));
     }
 
     void UploadContext::AddTextureUpload(std::unique_ptr<TextureUpload> textureUpload)
     {
-        assert(textureUpload->mTextureDataSize <= mTextureUploadHeap->mDesc.Width);
+        assert(textureUpload->mTextureDataSize <= mDevice.GetBuffer(mTextureUploadHeap).mDesc.Width);
 
         mTextureUploads.push_back(std::move(textureUpload));
     }
@@ -888,18 +1648,20 @@ namespace D3D12Lite
         uint32_t numTexturesProcessed = 0;
         size_t bufferUploadHeapOffset = 0;
         size_t textureUploadHeapOffset = 0;
+        BufferResource& bufferUploadHeap = mDevice.GetBuffer(mBufferUploadHeap);
+        BufferResource& textureUploadHeap = mDevice.GetBuffer(mTextureUploadHeap);
 
         for (numBuffersProcessed; numBuffersProcessed < numBufferUploads; numBuffersProcessed++)
         {
             BufferUpload& currentUpload = *mBufferUploads[numBuffersProcessed];
 
-            if ((bufferUploadHeapOffset + currentUpload.mBufferDataSize) > mBufferUploadHeap->mDesc.Width)
+            if ((bufferUploadHeapOffset + currentUpload.mBufferDataSize) > bufferUploadHeap.mDesc.Width)
             {
                 break;
             }
 
-            memcpy(mBufferUploadHeap->mMappedResource + bufferUploadHeapOffset, currentUpload.mBufferData.get(), currentUpload.mBufferDataSize);
-            CopyBufferRegion(*currentUpload.mBuffer, 0, *mBufferUploadHeap, bufferUploadHeapOffset, currentUpload.mBufferDataSize);
+            memcpy(bufferUploadHeap.mMappedResource + bufferUploadHeapOffset, currentUpload.mBufferData.get(), currentUpload.mBufferDataSize);
+            CopyBufferRegion(*currentUpload.mBuffer, 0, bufferUploadHeap, bufferUploadHeapOffset, currentUpload.mBufferDataSize);
 
             bufferUploadHeapOffset += currentUpload.mBufferDataSize;
             mBufferUploadsInProgress.push_back(currentUpload.mBuffer);
@@ -909,13 +1671,13 @@ namespace D3D12Lite
         {
             TextureUpload& currentUpload = *mTextureUploads[numTexturesProcessed];
 
-            if ((textureUploadHeapOffset + currentUpload.mTextureDataSize) > mTextureUploadHeap->mDesc.Width)
+            if ((textureUploadHeapOffset + currentUpload.mTextureDataSize) > textureUploadHeap.mDesc.Width)
             {
                 break;
             }
 
-            memcpy(mTextureUploadHeap->mMappedResource + textureUploadHeapOffset, currentUpload.mTextureData.get(), currentUpload.mTextureDataSize);
-            CopyTextureRegion(*currentUpload.mTexture, *mTextureUploadHeap, textureUploadHeapOffset, currentUpload.mSubResourceLayouts, currentUpload.mNumSubResources);
+            memcpy(textureUploadHeap.mMappedResource + textureUploadHeapOffset, currentUpload.mTextureData.get(), currentUpload.mTextureDataSize);
+            CopyTextureRegion(*currentUpload.mTexture, textureUploadHeap, textureUploadHeapOffset, currentUpload.mSubResourceLayouts, currentUpload.mNumSubResources);
 
             textureUploadHeapOffset += currentUpload.mTextureDataSize;
             textureUploadHeapOffset = AlignU64(textureUploadHeapOffset, 512);
@@ -950,7 +1712,8 @@ namespace D3D12Lite
         mTextureUploadsInProgress.clear();
     }
 
-    Device::Device(void* windowHandle, Uint2 screenSize)
+    Device::Device(void* windowHandle, Uint2 screenSize, CommandBackend commandBackend)
+        : mCommandBackend(commandBackend)
     {
         InitializeDeviceResources();
         
@@ -970,10 +1733,11 @@ namespace D3D12Lite
             DestroyBuffer(mUploadContexts[frameIndex]->ReturnTextureHeap());
         }
 
-        for (uint32_t frameIndex = 0; frameIndex < NUM_FRAMES_IN_FLIGHT; frameIndex++)
-        {
-            ProcessDestructions(frameIndex);
-        }
+        DestroyBuffer(mConstantUploadBuffer);
+
+        FlushReleases();
+
+        mGraphicsContextPool = nullptr;
 
         mCopyQueue = nullptr;
         mComputeQueue = nullptr;
@@ -1018,41 +1782,53 @@ namespace D3D12Lite
         AssertIfFailed(CreateDXGIFactory1(IID_PPV_ARGS(&mDXGIFactory)));
 
         IDXGIAdapter1* adapter = nullptr;
-        uint32_t bestAdapterIndex = 0;
-        size_t bestAdapterMemory = 0;
+        D3D_FEATURE_LEVEL minimumFeatureLevel = D3D_FEATURE_LEVEL_12_2;
 
-        for (uint32_t adapterIndex = 0; mDXGIFactory->EnumAdapters1(adapterIndex, &adapter) != DXGI_ERROR_NOT_FOUND; adapterIndex++)
+        if (mCommandBackend == CommandBackend::null)
+        {
+            // NOTE: Resources, descriptors and fences stay real with the null backend, the software adapter
+            // is enough for them and is available on machines without a GPU
+            AssertIfFailed(mDXGIFactory->EnumWarpAdapter(IID_PPV_ARGS(&adapter)));
+            minimumFeatureLevel = D3D_FEATURE_LEVEL_12_0;
+        }
+        else
         {
-            DXGI_ADAPTER_DESC1 adapterDesc;
-            AssertIfFailed(adapter->GetDesc1(&adapterDesc));
+            uint32_t bestAdapterIndex = 0;
+            size_t bestAdapterMemory = 0;
 
-            if (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)
+            for (uint32_t adapterIndex = 0; mDXGIFactory->EnumAdapters1(adapterIndex, &adapter) != DXGI_ERROR_NOT_FOUND; adapterIndex++)
             {
-                continue;
-            }
+                DXGI_ADAPTER_DESC1 adapterDesc;
+                AssertIfFailed(adapter->GetDesc1(&adapterDesc));
 
-            if (FAILED(D3D12CreateDevice(adapter, D3D_FEATURE_LEVEL_12_2, _uuidof(ID3D12Device), nullptr)))
-            {
-                continue;
+                if (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE)
+                {
+                    continue;
+                }
+
+                if (FAILED(D3D12CreateDevice(adapter, D3D_FEATURE_LEVEL_12_2, _uuidof(ID3D12Device), nullptr)))
+                {
+                    continue;
+                }
+
+                if (adapterDesc.DedicatedVideoMemory > bestAdapterMemory)
+                {
+                    bestAdapterIndex = adapterIndex;
+                    bestAdapterMemory = adapterDesc.DedicatedVideoMemory;
+                }
+
+                SafeRelease(adapter);
             }
 
-            if (adapterDesc.DedicatedVideoMemory > bestAdapterMemory)
+            if (bestAdapterMemory == 0)
             {
-                bestAdapterIndex = adapterIndex;
-                bestAdapterMemory = adapterDesc.DedicatedVideoMemory;
+                AssertError("Failed to find an adapter.");
             }
 
-            SafeRelease(adapter);
-        }
-
-        if (bestAdapterMemory == 0)
-        {
-            AssertError("Failed to find an adapter.");
+            mDXGIFactory->EnumAdapters1(bestAdapterIndex, &adapter);
         }
 
-        mDXGIFactory->EnumAdapters1(bestAdapterIndex, &adapter);
-
-        AssertIfFailed(D3D12CreateDevice(adapter, D3D_FEATURE_LEVEL_12_2, IID_PPV_ARGS(&mDevice)));
+        AssertIfFailed(D3D12CreateDevice(adapter, minimumFeatureLevel, IID_PPV_ARGS(&mDevice)));
 
         D3D12MA::ALLOCATOR_DESC desc = {};
         desc.Flags = D3D12MA::ALLOCATOR_FLAG_NONE;
@@ -1095,6 +1871,17 @@ namespace D3D12Lite
             mUploadContexts[frameIndex] = std::make_unique<UploadContext>(*this, CreateBuffer(uploadBufferDesc), CreateBuffer(uploadTextureDesc));
         }
 
+        mGraphicsContextPool = std::make_unique<ContextPool<GraphicsContext>>([this]() { return CreateGraphicsContext(); });
+
+        // NOTE: One persistently mapped buffer split in a region per frame in flight. Each frame's region
+        // is handed out linearly by mConstantAllocator and recycled in BeginFrame once the frame's fences are reached.
+        BufferCreationDesc constantUploadBufferDesc;
+        constantUploadBufferDesc.mSize = CONSTANT_UPLOAD_BUFFER_SIZE_PER_FRAME * NUM_FRAMES_IN_FLIGHT;
+        constantUploadBufferDesc.mAccessFlags = BufferAccessFlags::hostWritable;
+        constantUploadBufferDesc.mDebugName = L"Device::ConstantUploadBuffer";
+        mConstantUploadBuffer = CreateBuffer(constantUploadBufferDesc);
+        mConstantAllocator.Reset(mFrameId * CONSTANT_UPLOAD_BUFFER_SIZE_PER_FRAME, (mFrameId + 1) * CONSTANT_UPLOAD_BUFFER_SIZE_PER_FRAME);
+
         //The -1 and starting at index 1 accounts for the imgui descriptor.
         mFreeReservedDescriptorIndices.resize(NUM_RESERVED_SRV_DESCRIPTORS - 1);
         std::iota(mFreeReservedDescriptorIndices.begin(), mFreeReservedDescriptorIndices.end(), 1);
@@ -1195,6 +1982,13 @@ namespace D3D12Lite
     {
 		DestroyWindowDependentResources();
 
+        if (!windowHandle)
+        {
+            CreateHeadlessBackBuffers(screenSize);
+            mFrameId = 0;
+            return;
+        }
+
         DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
         ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
         swapChainDesc.Width = lround(screenSize.x);
@@ -1234,11 +2028,51 @@ namespace D3D12Lite
             mBackBuffers[bufferIndex]->mResource = backBufferResource;
             mBackBuffers[bufferIndex]->mState = D3D12_RESOURCE_STATE_PRESENT;
             mBackBuffers[bufferIndex]->mRTVDescriptor = backBufferRTVHandle;
+            mBackBuffers[bufferIndex]->mTraceId = mNextTraceId.fetch_add(1, std::memory_order_relaxed);
         }
 
         mFrameId = 0;
     }
 
+    void Device::CreateHeadlessBackBuffers(Uint2 screenSize)
+    {
+        D3D12_RESOURCE_DESC backBufferDesc{};
+        backBufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+        backBufferDesc.Width = screenSize.x;
+        backBufferDesc.Height = screenSize.y;
+        backBufferDesc.DepthOrArraySize = 1;
+        backBufferDesc.MipLevels = 1;
+        backBufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        backBufferDesc.SampleDesc.Count = 1;
+        backBufferDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+        backBufferDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+
+        D3D12_HEAP_PROPERTIES heapProperties{};
+        heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+
+        for (uint32_t bufferIndex = 0; bufferIndex < NUM_BACK_BUFFERS; bufferIndex++)
+        {
+            ID3D12Resource* backBufferResource = nullptr;
+            Descriptor backBufferRTVHandle = mRTVStagingDescriptorHeap->GetNewDescriptor();
+
+            D3D12_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+            rtvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+            rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+
+            AssertIfFailed(mDevice->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &backBufferDesc, D3D12_RESOURCE_STATE_PRESENT, nullptr, IID_PPV_ARGS(&backBufferResource)));
+            mDevice->CreateRenderTargetView(backBufferResource, &rtvDesc, backBufferRTVHandle.mCPUHandle);
+
+            mBackBuffers[bufferIndex] = std::make_unique<TextureResource>();
+            mBackBuffers[bufferIndex]->mDesc = backBufferResource->GetDesc();
+            mBackBuffers[bufferIndex]->mResource = backBufferResource;
+            mBackBuffers[bufferIndex]->mState = D3D12_RESOURCE_STATE_PRESENT;
+            mBackBuffers[bufferIndex]->mRTVDescriptor = backBufferRTVHandle;
+            mBackBuffers[bufferIndex]->mTraceId = mNextTraceId.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        mHeadlessBackBufferIndex = 0;
+    }
+
     void Device::DestroyWindowDependentResources()
     {
         for (uint32_t bufferIndex = 0; bufferIndex < NUM_BACK_BUFFERS; bufferIndex++)
@@ -1254,74 +2088,171 @@ namespace D3D12Lite
         SafeRelease(mSwapChain);
     }
 
-    void Device::ProcessDestructions(uint32_t frameIndex)
+    QueueFenceClock Device::GetReleaseFences(uint8_t queueMask) const
     {
-        auto& destructionQueueForFrame = mDestructionQueues[frameIndex];
+        const EndOfFrameFences& frameFences = mEndOfFrameFences[mFrameId];
 
-        for(auto& bufferToDestroy : destructionQueueForFrame.mBuffersToDestroy)
-        {
-            if (bufferToDestroy->mCBVDescriptor.IsValid())
-            {
-                mSRVStagingDescriptorHeap->FreeDescriptor(bufferToDestroy->mCBVDescriptor);
-            }
+        QueueFenceClock releaseFences{};
+        releaseFences[static_cast<uint32_t>(QueueType::graphics)] = (queueMask & GetQueueMask(QueueType::graphics)) ? frameFences.mGraphicsQueueFence : 0;
+        releaseFences[static_cast<uint32_t>(QueueType::compute)] = (queueMask & GetQueueMask(QueueType::compute)) ? frameFences.mComputeQueueFence : 0;
+        releaseFences[static_cast<uint32_t>(QueueType::copy)] = (queueMask & GetQueueMask(QueueType::copy)) ? frameFences.mCopyQueueFence : 0;
 
-            if (bufferToDestroy->mSRVDescriptor.IsValid())
-            {
-                mSRVStagingDescriptorHeap->FreeDescriptor(bufferToDestroy->mSRVDescriptor);
-                mFreeReservedDescriptorIndices.push_back(bufferToDestroy->mDescriptorHeapIndex);
-            }
+        return releaseFences;
+    }
 
-            if (bufferToDestroy->mUAVDescriptor.IsValid())
-            {
-                mSRVStagingDescriptorHeap->FreeDescriptor(bufferToDestroy->mUAVDescriptor);
-            }
+    QueueFenceClock Device::PollCompletedFences()
+    {
+        QueueFenceClock completedFences{};
+        completedFences[static_cast<uint32_t>(QueueType::graphics)] = mGraphicsQueue->PollCurrentFenceValue();
+        completedFences[static_cast<uint32_t>(QueueType::compute)] = mComputeQueue->PollCurrentFenceValue();
+        completedFences[static_cast<uint32_t>(QueueType::copy)] = mCopyQueue->PollCurrentFenceValue();
 
-            if (bufferToDestroy->mMappedResource != nullptr)
-            {
-                bufferToDestroy->mResource->Unmap(0, nullptr);
-            }
+        return completedFences;
+    }
+
+    // NOTE: Called once the end of frame fences are signaled. A release only waits on the queues that
+    // may have referenced the resource during the frame it was destroyed in, so a texture only ever sampled on the
+    // graphics queue doesn't have to outlive a long running async compute frame.
+    void Device::ScheduleReleases()
+    {
+        const QueueFenceClock allQueueFences = GetReleaseFences(UINT8_MAX);
+
+        for (BufferHandle bufferHandle : mDestructionQueue.mBuffersToDestroy)
+        {
+            const BufferResource& buffer = mBufferPool.Get(bufferHandle);
+            const uint64_t sizeInBytes = buffer.mAllocation != nullptr ? buffer.mAllocation->GetSize() : 0;
 
-            SafeRelease(bufferToDestroy->mResource);
-            SafeRelease(bufferToDestroy->mAllocation);
+            mBufferReleases.Push(std::move(bufferHandle), GetReleaseFences(buffer.mQueueUsageMask.load(std::memory_order_relaxed)), sizeInBytes);
         }
 
-        for (auto& textureToDestroy : destructionQueueForFrame.mTexturesToDestroy)
+        for (TextureHandle textureHandle : mDestructionQueue.mTexturesToDestroy)
         {
-            if (textureToDestroy->mRTVDescriptor.IsValid())
-            {
-                mRTVStagingDescriptorHeap->FreeDescriptor(textureToDestroy->mRTVDescriptor);
-            }
+            const TextureResource& texture = mTexturePool.Get(textureHandle);
+            const uint64_t sizeInBytes = texture.mAllocation != nullptr ? texture.mAllocation->GetSize() : 0;
 
-            if (textureToDestroy->mDSVDescriptor.IsValid())
-            {
-                mDSVStagingDescriptorHeap->FreeDescriptor(textureToDestroy->mDSVDescriptor);
-            }
+            mTextureReleases.Push(std::move(textureHandle), GetReleaseFences(texture.mQueueUsageMask.load(std::memory_order_relaxed)), sizeInBytes);
+        }
 
-            if (textureToDestroy->mSRVDescriptor.IsValid())
-            {
-                mSRVStagingDescriptorHeap->FreeDescriptor(textureToDestroy->mSRVDescriptor);
-                mFreeReservedDescriptorIndices.push_back(textureToDestroy->mDescriptorHeapIndex);
-            }
+        for (auto& pipelineToDestroy : mDestructionQueue.mPipelinesToDestroy)
+        {
+            mPipelineReleases.Push(std::move(pipelineToDestroy), allQueueFences, 0);
+        }
 
-            if (textureToDestroy->mUAVDescriptor.IsValid())
-            {
-                mSRVStagingDescriptorHeap->FreeDescriptor(textureToDestroy->mUAVDescriptor);
-            }
+        for (auto& commandSignatureToDestroy : mDestructionQueue.mCommandSignaturesToDestroy)
+        {
+            mCommandSignatureReleases.Push(std::move(commandSignatureToDestroy), allQueueFences, 0);
+        }
 
-            SafeRelease(textureToDestroy->mResource);
-            SafeRelease(textureToDestroy->mAllocation);
+        for (auto& contextToDestroy : mDestructionQueue.mContextsToDestroy)
+        {
+            mContextReleases.Push(std::move(contextToDestroy), allQueueFences, 0);
         }
 
-        for (auto& pipelineToDestroy : destructionQueueForFrame.mPipelinesToDestroy)
+        mDestructionQueue.mBuffersToDestroy.clear();
+        mDestructionQueue.mTexturesToDestroy.clear();
+        mDestructionQueue.mPipelinesToDestroy.clear();
+        mDestructionQueue.mCommandSignaturesToDestroy.clear();
+        mDestructionQueue.mContextsToDestroy.clear();
+
+        mPeakPendingReleaseBytes = (std::max)(mPeakPendingReleaseBytes, GetPendingReleaseBytes());
+    }
+
+    void Device::ProcessReleases(const QueueFenceClock& completedFences)
+    {
+        mBufferReleases.Sweep(completedFences, [this](BufferHandle bufferHandle) { ReleaseBuffer(bufferHandle); });
+        mTextureReleases.Sweep(completedFences, [this](TextureHandle textureHandle) { ReleaseTexture(textureHandle); });
+        mPipelineReleases.Sweep(completedFences, [](std::unique_ptr<PipelineStateObject>& pipelineToDestroy)
         {
             SafeRelease(pipelineToDestroy->mRootSignature);
             SafeRelease(pipelineToDestroy->mPipeline);
+            pipelineToDestroy = nullptr;
+        });
+        mCommandSignatureReleases.Sweep(completedFences, [](std::unique_ptr<CommandSignature>& commandSignatureToDestroy)
+        {
+            SafeRelease(commandSignatureToDestroy->mCommandSignature);
+            commandSignatureToDestroy = nullptr;
+        });
+        mContextReleases.Sweep(completedFences, [](std::unique_ptr<Context>& contextToDestroy) { contextToDestroy = nullptr; });
+    }
+
+    void Device::FlushReleases()
+    {
+        // Whatever was destroyed after the last Present never got tagged, the caller guarantees the GPU is idle
+        ScheduleReleases();
+
+        QueueFenceClock allFences;
+        allFences.fill(UINT64_MAX);
+        ProcessReleases(allFences);
+    }
+
+    uint32_t Device::GetNumPendingReleases() const
+    {
+        return mBufferReleases.GetNumPending() + mTextureReleases.GetNumPending() + mPipelineReleases.GetNumPending() +
+            mCommandSignatureReleases.GetNumPending() + mContextReleases.GetNumPending();
+    }
+
+    void Device::ReleaseBuffer(BufferHandle bufferHandle)
+    {
+        BufferResource* bufferToDestroy = &mBufferPool.Get(bufferHandle);
+
+        if (bufferToDestroy->mCBVDescriptor.IsValid())
+        {
+            mSRVStagingDescriptorHeap->FreeDescriptor(bufferToDestroy->mCBVDescriptor);
+        }
+
+        if (bufferToDestroy->mSRVDescriptor.IsValid())
+        {
+            mSRVStagingDescriptorHeap->FreeDescriptor(bufferToDestroy->mSRVDescriptor);
+            mFreeReservedDescriptorIndices.push_back(bufferToDestroy->mDescriptorHeapIndex);
+        }
+
+        if (bufferToDestroy->mUAVDescriptor.IsValid())
+        {
+            mSRVStagingDescriptorHeap->FreeDescriptor(bufferToDestroy->mUAVDescriptor);
+        }
+
+        if (bufferToDestroy->mMappedResource != nullptr)
+        {
+            bufferToDestroy->mResource->Unmap(0, nullptr);
+        }
+
+        SafeRelease(bufferToDestroy->mResource);
+        SafeRelease(bufferToDestroy->mAllocation);
+
+        mQueueScheduler.ForgetResource(bufferToDestroy);
+        mBufferPool.Free(bufferHandle);
+    }
+
+    void Device::ReleaseTexture(TextureHandle textureHandle)
+    {
+        TextureResource* textureToDestroy = &mTexturePool.Get(textureHandle);
+
+        if (textureToDestroy->mRTVDescriptor.IsValid())
+        {
+            mRTVStagingDescriptorHeap->FreeDescriptor(textureToDestroy->mRTVDescriptor);
+        }
+
+        if (textureToDestroy->mDSVDescriptor.IsValid())
+        {
+            mDSVStagingDescriptorHeap->FreeDescriptor(textureToDestroy->mDSVDescriptor);
+        }
+
+        if (textureToDestroy->mSRVDescriptor.IsValid())
+        {
+            mSRVStagingDescriptorHeap->FreeDescriptor(textureToDestroy->mSRVDescriptor);
+            mFreeReservedDescriptorIndices.push_back(textureToDestroy->mDescriptorHeapIndex);
+        }
+
+        if (textureToDestroy->mUAVDescriptor.IsValid())
+        {
+            mSRVStagingDescriptorHeap->FreeDescriptor(textureToDestroy->mUAVDescriptor);
         }
 
-        destructionQueueForFrame.mBuffersToDestroy.clear();
-        destructionQueueForFrame.mTexturesToDestroy.clear();
-        destructionQueueForFrame.mPipelinesToDestroy.clear();
-        destructionQueueForFrame.mContextsToDestroy.clear();
+        SafeRelease(textureToDestroy->mResource);
+        SafeRelease(textureToDestroy->mAllocation);
+
+        mQueueScheduler.ForgetResource(textureToDestroy);
+        mTexturePool.Free(textureHandle);
     }
 
     void Device::CopySRVHandleToReservedTable(Descriptor srvHandle, uint32_t index)
@@ -1343,12 +2274,29 @@ namespace D3D12Lite
         mComputeQueue->WaitForFenceCPUBlocking(mEndOfFrameFences[mFrameId].mComputeQueueFence);
         mCopyQueue->WaitForFenceCPUBlocking(mEndOfFrameFences[mFrameId].mCopyQueueFence);
 
-        ProcessDestructions(mFrameId);
+        // The CPU waits above are still needed to recycle this frame's command allocators, but releases are no
+        // longer tied to them: anything whose fences have completed is reclaimed, whatever frame it came from.
+        const QueueFenceClock completedFences = PollCompletedFences();
+        mQueueScheduler.RetireCompletedFences(completedFences);
+
+        ProcessReleases(completedFences);
+
+        // The render pass heap is shared by every context recording this frame, so it is recycled once per frame here
+        // rather than by each Context::Reset, which would overwrite tables another context already used.
+        mSRVRenderPassDescriptorHeaps[mFrameId]->Reset();
 
         mUploadContexts[mFrameId]->ResolveProcessedUploads();
         mUploadContexts[mFrameId]->Reset();
 
+        mConstantAllocator.Reset(mFrameId * CONSTANT_UPLOAD_BUFFER_SIZE_PER_FRAME, (mFrameId + 1) * CONSTANT_UPLOAD_BUFFER_SIZE_PER_FRAME);
+
         mContextSubmissions[mFrameId].clear();
+        mFrameTrace.Clear();
+        mFrameDescriptorTableStats = DescriptorTableStats{};
+        mFrameNumSkippedDraws = 0;
+
+        // The CPU waits above guarantee no pooled context is still executing with this frame's allocators
+        mGraphicsContextPool->Rewind();
     }
 
     void Device::EndFrame()
@@ -1362,8 +2310,18 @@ namespace D3D12Lite
 
     void Device::Present()
     {
-        mSwapChain->Present(0, 0);
+        if (mSwapChain)
+        {
+            mSwapChain->Present(0, 0);
+        }
+        else
+        {
+            mHeadlessBackBufferIndex = (mHeadlessBackBufferIndex + 1) % NUM_BACK_BUFFERS;
+        }
+
         mEndOfFrameFences[mFrameId].mGraphicsQueueFence = mGraphicsQueue->SignalFence();
+
+        ScheduleReleases();
     }
 
     void Device::CopyDescriptorsSimple(uint32_t numDescriptors, D3D12_CPU_DESCRIPTOR_HANDLE destDescriptorRangeStart, D3D12_CPU_DESCRIPTOR_HANDLE srcDescriptorRangeStart, D3D12_DESCRIPTOR_HEAP_TYPE descriptorType)
@@ -1379,12 +2337,13 @@ namespace D3D12Lite
 
     TextureResource& Device::GetCurrentBackBuffer()
     {
-        return *mBackBuffers[mSwapChain->GetCurrentBackBufferIndex()];
+        return *mBackBuffers[mSwapChain ? mSwapChain->GetCurrentBackBufferIndex() : mHeadlessBackBufferIndex];
     }
 
-    std::unique_ptr<BufferResource> Device::CreateBuffer(const BufferCreationDesc& desc)
+    BufferHandle Device::CreateBuffer(const BufferCreationDesc& desc)
     {
-        std::unique_ptr<BufferResource> newBuffer = std::make_unique<BufferResource>();
+        BufferHandle newBufferHandle = mBufferPool.Allocate();
+        BufferResource* newBuffer = &mBufferPool.Get(newBufferHandle);
         newBuffer->mDesc.Width = AlignU32(static_cast<uint32_t>(desc.mSize), 256);
         newBuffer->mDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
         newBuffer->mDesc.Alignment = 0;
@@ -1480,10 +2439,23 @@ namespace D3D12Lite
         }
 #endif
 
-        return newBuffer;
+        // NOTE: Bindless resources can be reached by any shader without a context ever seeing them, and
+        // index buffers can be bound from ExecuteIndirect arguments
+        uint8_t queueUsageMask = 0;
+        queueUsageMask |= hasSRV ? BINDLESS_QUEUE_MASK : 0;
+        queueUsageMask |= desc.mFormat != DXGI_FORMAT_UNKNOWN ? GetQueueMask(QueueType::graphics) : 0;
+        newBuffer->mQueueUsageMask.store(queueUsageMask, std::memory_order_relaxed);
+
+        ResourceHotData& hotData = mBufferPool.GetHotData(newBufferHandle);
+        hotData.mVirtualAddress = newBuffer->mVirtualAddress;
+        hotData.mDescriptorHeapIndex = newBuffer->mDescriptorHeapIndex;
+
+        newBuffer->mTraceId = mNextTraceId.fetch_add(1, std::memory_order_relaxed);
+
+        return newBufferHandle;
     }
 
-    std::unique_ptr<TextureResource> Device::CreateTexture(const TextureCreationDesc& desc)
+    TextureHandle Device::CreateTexture(const TextureCreationDesc& desc)
     {
         D3D12_RESOURCE_DESC textureDesc = desc.mResourceDesc;
         textureDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
@@ -1540,7 +2512,8 @@ namespace D3D12Lite
 
         textureDesc.Format = resourceFormat;
 
-        std::unique_ptr<TextureResource> newTexture = std::make_unique<TextureResource>();
+        TextureHandle newTextureHandle = mTexturePool.Allocate();
+        TextureResource* newTexture = &mTexturePool.Get(newTextureHandle);
         newTexture->mDesc = textureDesc;
         newTexture->mState = resourceState;
 
@@ -1625,7 +2598,18 @@ namespace D3D12Lite
 
         newTexture->mIsReady = (hasRTV || hasDSV);
 
-        return newTexture;
+        // NOTE: Render targets are bound through descriptor handles and bindless textures through the
+        // reserved table, neither goes through a call that tracks queue usage
+        uint8_t queueUsageMask = 0;
+        queueUsageMask |= (hasRTV || hasDSV) ? GetQueueMask(QueueType::graphics) : 0;
+        queueUsageMask |= hasSRV ? BINDLESS_QUEUE_MASK : 0;
+        newTexture->mQueueUsageMask.store(queueUsageMask, std::memory_order_relaxed);
+
+        mTexturePool.GetHotData(newTextureHandle).mDescriptorHeapIndex = newTexture->mDescriptorHeapIndex;
+
+        newTexture->mTraceId = mNextTraceId.fetch_add(1, std::memory_order_relaxed);
+
+        return newTextureHandle;
     }
 
     // TODO(gmodarelli): Add support for creating textures
@@ -1854,11 +2838,10 @@ namespace D3D12Lite
 
             if (currentSpace)
             {
-                const BufferResource* cbv = currentSpace->GetCBV();
                 auto& uavs = currentSpace->GetUAVs();
                 auto& srvs = currentSpace->GetSRVs();
 
-                if (cbv)
+                if (currentSpace->HasCBV())
                 {
                     D3D12_ROOT_PARAMETER1 rootParameter{};
                     rootParameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
@@ -1920,6 +2903,8 @@ namespace D3D12Lite
             rootParameter.Constants.Num32BitValues = layout.mNum32BitConstants;
             rootParameter.Constants.ShaderRegister = 1;
             rootParameter.Constants.RegisterSpace = 0;
+
+            resourceMapping.mConstantsMapping = static_cast<uint32_t>(rootParameters.size());
             rootParameters.push_back(rootParameter);
         }
 
@@ -1983,6 +2968,7 @@ namespace D3D12Lite
 
         newPipeline->mPipeline = graphicsPipeline;
         newPipeline->mRootSignature = pipelineDesc.pRootSignature;
+        newPipeline->mTraceId = mNextTraceId.fetch_add(1, std::memory_order_relaxed);
 
         return newPipeline;
     }
@@ -2003,10 +2989,64 @@ namespace D3D12Lite
 
         newPipeline->mPipeline = computePipeline;
         newPipeline->mRootSignature = pipelineDesc.pRootSignature;
+        newPipeline->mTraceId = mNextTraceId.fetch_add(1, std::memory_order_relaxed);
 
         return newPipeline;
     }
 
+    std::unique_ptr<CommandSignature> Device::CreateCommandSignature(CommandSignatureType type, const PipelineStateObject* pipeline)
+    {
+        std::unique_ptr<CommandSignature> commandSignature = std::make_unique<CommandSignature>();
+        commandSignature->mType = type;
+
+        std::array<D3D12_INDIRECT_ARGUMENT_DESC, 3> arguments{};
+        uint32_t numArguments = 0;
+        ID3D12RootSignature* rootSignature = nullptr;
+
+        switch (type)
+        {
+        case CommandSignatureType::drawIndexedWithDrawId:
+        {
+            assert(pipeline && pipeline->mPipelineResourceMapping.mConstantsMapping.has_value());
+            rootSignature = pipeline->mRootSignature;
+
+            arguments[numArguments].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+            arguments[numArguments].Constant.RootParameterIndex = pipeline->mPipelineResourceMapping.mConstantsMapping.value();
+            arguments[numArguments].Constant.DestOffsetIn32BitValues = 0;
+            arguments[numArguments].Constant.Num32BitValuesToSet = 1;
+            numArguments++;
+
+            arguments[numArguments].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+            numArguments++;
+
+            arguments[numArguments].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+            numArguments++;
+
+            commandSignature->mByteStride = sizeof(IndirectDrawIndexedCommand);
+            break;
+        }
+        case CommandSignatureType::dispatch:
+            arguments[numArguments].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+            numArguments++;
+
+            commandSignature->mByteStride = sizeof(D3D12_DISPATCH_ARGUMENTS);
+            break;
+        default:
+            AssertError("Unknown command signature type.");
+            break;
+        }
+
+        D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc{};
+        commandSignatureDesc.ByteStride = commandSignature->mByteStride;
+        commandSignatureDesc.NumArgumentDescs = numArguments;
+        commandSignatureDesc.pArgumentDescs = arguments.data();
+        commandSignatureDesc.NodeMask = 0;
+
+        AssertIfFailed(mDevice->CreateCommandSignature(&commandSignatureDesc, rootSignature, IID_PPV_ARGS(&commandSignature->mCommandSignature)));
+
+        return commandSignature;
+    }
+
     std::unique_ptr<GraphicsContext> Device::CreateGraphicsContext()
     {
         std::unique_ptr<GraphicsContext> newGraphicsContext = std::make_unique<GraphicsContext>(*this);
@@ -2021,14 +3061,50 @@ namespace D3D12Lite
         return newComputeContext;
     }
 
-    void Device::DestroyBuffer(std::unique_ptr<BufferResource> buffer)
+    ConstantAllocation Device::AllocateConstants(uint64_t size, uint64_t alignment)
+    {
+        assert(size > 0);
+
+        const uint64_t offset = mConstantAllocator.Allocate(size, alignment);
+        if (offset == LinearAllocator::INVALID_OFFSET)
+        {
+            AssertError("Constant upload buffer exhausted, increase CONSTANT_UPLOAD_BUFFER_SIZE_PER_FRAME");
+            return ConstantAllocation{};
+        }
+
+        BufferResource& constantUploadBuffer = mBufferPool.Get(mConstantUploadBuffer);
+
+        ConstantAllocation constants;
+        constants.mCPUAddress = constantUploadBuffer.mMappedResource + offset;
+        constants.mGPUAddress = constantUploadBuffer.mVirtualAddress + offset;
+        constants.mSize = LinearAllocator::AlignUp(size, alignment);
+        constants.mBuffer = &constantUploadBuffer;
+        constants.mOffset = offset;
+
+        return constants;
+    }
+
+    void Device::DestroyBuffer(BufferHandle buffer)
     {
-        mDestructionQueues[mFrameId].mBuffersToDestroy.push_back(std::move(buffer));
+        // Optional mesh streams are destroyed unconditionally, so an empty handle is not an error
+        if (!buffer.IsValid())
+        {
+            return;
+        }
+
+        assert(mBufferPool.IsValid(buffer));
+        mDestructionQueue.mBuffersToDestroy.push_back(buffer);
     }
 
-    void Device::DestroyTexture(std::unique_ptr<TextureResource> texture)
+    void Device::DestroyTexture(TextureHandle texture)
     {
-        mDestructionQueues[mFrameId].mTexturesToDestroy.push_back(std::move(texture));
+        if (!texture.IsValid())
+        {
+            return;
+        }
+
+        assert(mTexturePool.IsValid(texture));
+        mDestructionQueue.mTexturesToDestroy.push_back(texture);
     }
 
     void Device::DestroyShader(std::unique_ptr<Shader> shader)
@@ -2038,77 +3114,100 @@ namespace D3D12Lite
 
     void Device::DestroyPipelineStateObject(std::unique_ptr<PipelineStateObject> pso)
     {
-        mDestructionQueues[mFrameId].mPipelinesToDestroy.push_back(std::move(pso));
+        mDestructionQueue.mPipelinesToDestroy.push_back(std::move(pso));
+    }
+
+    void Device::DestroyCommandSignature(std::unique_ptr<CommandSignature> commandSignature)
+    {
+        mDestructionQueue.mCommandSignaturesToDestroy.push_back(std::move(commandSignature));
     }
 
     void Device::DestroyContext(std::unique_ptr<Context> context)
     {
-        mDestructionQueues[mFrameId].mContextsToDestroy.push_back(std::move(context));
+        mDestructionQueue.mContextsToDestroy.push_back(std::move(context));
     }
 
     ContextSubmissionResult Device::SubmitContextWork(Context& context)
     {
-        uint64_t fenceResult = 0;
+        return SubmitContextWork(context, QueueDependencies{});
+    }
+
+    ContextSubmissionResult Device::SubmitContextWork(Context& context, const QueueDependencies& dependencies)
+    {
+        Context* contexts[] = { &context };
+        return SubmitContextWork(contexts, 1, dependencies);
+    }
+
+    ContextSubmissionResult Device::SubmitContextWork(Context* const* contexts, uint32_t numContexts, const QueueDependencies& dependencies)
+    {
+        assert(numContexts > 0 && numContexts <= MAX_BATCHED_COMMAND_LISTS);
 
-        switch (context.GetCommandType())
+        const D3D12_COMMAND_LIST_TYPE commandType = contexts[0]->GetCommandType();
+        QueueType queueType = GetQueueType(commandType);
+        Queue& queue = GetQueue(queueType);
+
+        std::array<ID3D12CommandList*, MAX_BATCHED_COMMAND_LISTS> commandLists{ nullptr };
+        for (uint32_t contextIndex = 0; contextIndex < numContexts; contextIndex++)
         {
-        case D3D12_COMMAND_LIST_TYPE_DIRECT:
-            fenceResult = mGraphicsQueue->ExecuteCommandList(context.GetCommandList());
-            break;
-        case D3D12_COMMAND_LIST_TYPE_COMPUTE:
-            fenceResult = mComputeQueue->ExecuteCommandList(context.GetCommandList());
-            break;
-        case D3D12_COMMAND_LIST_TYPE_COPY:
-            fenceResult = mCopyQueue->ExecuteCommandList(context.GetCommandList());
-            break;
-        default:
-            AssertError("Unsupported submission type.");
-            break;
+            assert(contexts[contextIndex]->GetCommandType() == commandType);
+            commandLists[contextIndex] = contexts[contextIndex]->GetCommandList();
+
+            const DescriptorTableStats& tableStats = contexts[contextIndex]->GetDescriptorTableStats();
+            mFrameDescriptorTableStats.mNumTablesCopied += tableStats.mNumTablesCopied;
+            mFrameDescriptorTableStats.mNumDescriptorsCopied += tableStats.mNumDescriptorsCopied;
+            mFrameDescriptorTableStats.mNumCacheHits += tableStats.mNumCacheHits;
+            mFrameNumSkippedDraws += contexts[contextIndex]->GetNumSkippedDraws();
+        }
+
+        mScheduledWaits.clear();
+        mQueueScheduler.ScheduleSubmission(queueType, queue.GetNextFenceValue(), dependencies, mScheduledWaits);
+
+        for (const QueueWait& wait : mScheduledWaits)
+        {
+            queue.InsertWaitForQueueFence(&GetQueue(wait.mSignalingQueue), wait.mFenceValue);
+        }
+
+        if (mCommandBackend != CommandBackend::d3d12)
+        {
+            for (uint32_t contextIndex = 0; contextIndex < numContexts; contextIndex++)
+            {
+                mFrameTrace.Append(contexts[contextIndex]->GetTrace());
+            }
         }
 
+        // The null backend has nothing to execute, but still signals so fence driven bookkeeping keeps moving
+        uint64_t fenceResult = mCommandBackend == CommandBackend::null ? queue.SignalFence() : queue.ExecuteCommandLists(commandLists.data(), numContexts);
+
         ContextSubmissionResult submissionResult;
         submissionResult.mFrameId = mFrameId;
         submissionResult.mSubmissionIndex = static_cast<uint32_t>(mContextSubmissions[mFrameId].size());
 
-        mContextSubmissions[mFrameId].push_back(std::make_pair(fenceResult, context.GetCommandType()));
+        mContextSubmissions[mFrameId].push_back(std::make_pair(fenceResult, commandType));
 
         return submissionResult;
     }
 
     void Device::WaitOnContextWork(ContextSubmissionResult submission, ContextWaitType waitType)
     {
-        std::pair<uint64_t, D3D12_COMMAND_LIST_TYPE> contextSubmission = mContextSubmissions[submission.mFrameId][submission.mSubmissionIndex];
-        Queue* workSourceQueue = nullptr;
-
-        switch (contextSubmission.second)
-        {
-        case D3D12_COMMAND_LIST_TYPE_DIRECT:
-            workSourceQueue = mGraphicsQueue.get();
-            break;
-        case D3D12_COMMAND_LIST_TYPE_COMPUTE:
-            workSourceQueue = mComputeQueue.get();
-            break;
-        case D3D12_COMMAND_LIST_TYPE_COPY:
-            workSourceQueue = mCopyQueue.get();
-            break;
-        default:
-            AssertError("Unsupported submission type.");
-            break;
-        }
+        QueueFence workFence = GetContextWorkFence(submission);
+        Queue& workSourceQueue = GetQueue(workFence.mQueue);
 
         switch (waitType)
         {
         case ContextWaitType::graphics:
-            mGraphicsQueue->InsertWaitForQueueFence(workSourceQueue, contextSubmission.second);
+            mGraphicsQueue->InsertWaitForQueueFence(&workSourceQueue, workFence.mFenceValue);
+            mQueueScheduler.NotifyWait(QueueType::graphics, workFence);
             break;
         case ContextWaitType::compute:
-            mComputeQueue->InsertWaitForQueueFence(workSourceQueue, contextSubmission.second);
+            mComputeQueue->InsertWaitForQueueFence(&workSourceQueue, workFence.mFenceValue);
+            mQueueScheduler.NotifyWait(QueueType::compute, workFence);
             break;
         case ContextWaitType::copy:
-            mCopyQueue->InsertWaitForQueueFence(workSourceQueue, contextSubmission.second);
+            mCopyQueue->InsertWaitForQueueFence(&workSourceQueue, workFence.mFenceValue);
+            mQueueScheduler.NotifyWait(QueueType::copy, workFence);
             break;
         case ContextWaitType::host:
-            workSourceQueue->WaitForFenceCPUBlocking(contextSubmission.second);
+            workSourceQueue.WaitForFenceCPUBlocking(workFence.mFenceValue);
             break;
         default:
             AssertError("Unsupported wait type.");
@@ -2116,6 +3215,49 @@ namespace D3D12Lite
         }
     }
 
+    QueueFence Device::GetContextWorkFence(ContextSubmissionResult submission)
+    {
+        std::pair<uint64_t, D3D12_COMMAND_LIST_TYPE> contextSubmission = mContextSubmissions[submission.mFrameId][submission.mSubmissionIndex];
+
+        QueueFence workFence;
+        workFence.mQueue = GetQueueType(contextSubmission.second);
+        workFence.mFenceValue = contextSubmission.first;
+
+        return workFence;
+    }
+
+    Queue& Device::GetQueue(QueueType queueType)
+    {
+        switch (queueType)
+        {
+        case QueueType::graphics:
+            return *mGraphicsQueue;
+        case QueueType::compute:
+            return *mComputeQueue;
+        case QueueType::copy:
+            return *mCopyQueue;
+        default:
+            AssertError("Unsupported queue type.");
+            return *mGraphicsQueue;
+        }
+    }
+
+    QueueType Device::GetQueueType(D3D12_COMMAND_LIST_TYPE commandType)
+    {
+        switch (commandType)
+        {
+        case D3D12_COMMAND_LIST_TYPE_DIRECT:
+            return QueueType::graphics;
+        case D3D12_COMMAND_LIST_TYPE_COMPUTE:
+            return QueueType::compute;
+        case D3D12_COMMAND_LIST_TYPE_COPY:
+            return QueueType::copy;
+        default:
+            AssertError("Unsupported submission type.");
+            return QueueType::graphics;
+        }
+    }
+
     void Device::WaitForIdle()
     {
         mGraphicsQueue->WaitForIdle();
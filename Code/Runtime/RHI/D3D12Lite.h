@@ -23,6 +23,19 @@
 #include <array>
 #include <optional>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+
+#include "CommandStream.h"
+#include "CommandTrace.h"
+#include "IndexAllocators.h"
+#include "IndirectDrawBuilder.h"
+#include "LinearAllocator.h"
+#include "ParallelRecording.h"
+#include "DeferredReleaseQueue.h"
+#include "QueueScheduler.h"
+#include "ResourcePool.h"
 
 struct IDxcBlob;
 
@@ -40,7 +53,7 @@ namespace D3D12Lite
     constexpr uint32_t NUM_DSV_STAGING_DESCRIPTORS = 32;
     constexpr uint32_t NUM_SRV_STAGING_DESCRIPTORS = 4096;
     constexpr uint32_t NUM_SAMPLER_DESCRIPTORS = 6;
-    constexpr uint32_t MAX_QUEUED_BARRIERS = 16;
+    constexpr uint32_t NUM_RESERVED_QUEUED_BARRIERS = 64;
     constexpr uint8_t PER_OBJECT_SPACE = 0;
     constexpr uint8_t PER_MATERIAL_SPACE = 1;
     constexpr uint8_t PER_PASS_SPACE = 2;
@@ -51,6 +64,9 @@ namespace D3D12Lite
     constexpr uint32_t NUM_SRV_RENDER_PASS_USER_DESCRIPTORS = 65536;
     constexpr uint32_t INVALID_RESOURCE_TABLE_INDEX = UINT_MAX;
     constexpr uint32_t MAX_TEXTURE_SUBRESOURCE_COUNT = 32;
+    constexpr uint64_t CONSTANT_UPLOAD_BUFFER_SIZE_PER_FRAME = 4 * 1024 * 1024;
+    constexpr uint32_t MAX_INHERITED_ROOT_CONSTANTS = 8;
+    constexpr uint32_t MAX_BATCHED_COMMAND_LISTS = 64;
     static const wchar_t* SHADER_SOURCE_PATH = L"Assets/Shaders/";
     static const wchar_t* SHADER_OUTPUT_PATH = L"Assets/Shaders/Compiled/";
     static const char* RESOURCE_PATH = "Resources/";
@@ -94,6 +110,17 @@ namespace D3D12Lite
         copy
     };
 
+    // NOTE: What contexts record into. recording and null also write every command to a CommandTrace, and
+    // null skips command lists altogether: all the CPU bookkeeping (barrier batching, descriptor tables, uploads,
+    // deferred releases) still runs, but nothing reaches the GPU. Pair it with a null window handle and the device runs
+    // headless on the WARP adapter, so renderer CPU cost can be measured on machines without a GPU.
+    enum class CommandBackend : uint8_t
+    {
+        d3d12 = 0,
+        recording,
+        null
+    };
+
     enum class PipelineType : uint8_t
     {
         graphics = 0,
@@ -238,6 +265,31 @@ namespace D3D12Lite
         D3D12_RESOURCE_STATES mState = D3D12_RESOURCE_STATE_COMMON;
         bool mIsReady = false;
         uint32_t mDescriptorHeapIndex = INVALID_RESOURCE_TABLE_INDEX;
+        // Creation order, written to command traces in place of pointers or GPU addresses
+        uint32_t mTraceId = 0;
+
+        // NOTE: Per-subresource states are only tracked once a single mip or slice has been
+        // transitioned on its own. While the vector is empty every subresource is in mState.
+        std::vector<D3D12_RESOURCE_STATES> mSubresourceStates;
+        bool mHasPendingSplitBarrier = false;
+        D3D12_RESOURCE_STATES mPendingSplitState = D3D12_RESOURCE_STATE_COMMON;
+        uint32_t mPendingSplitSubresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+
+        // NOTE: Queues that may reference the resource (see GetQueueMask), so its release only waits
+        // on those. Set by contexts while recording, which can happen on several threads at once.
+        mutable std::atomic<uint8_t> mQueueUsageMask{ 0 };
+
+        // NOTE: Planes of depth-stencil formats are not tracked separately
+        uint32_t GetSubresourceCount() const
+        {
+            if (mType == GPUResourceType::buffer)
+            {
+                return 1;
+            }
+
+            uint32_t arraySize = mDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : mDesc.DepthOrArraySize;
+            return (std::max)(1u, static_cast<uint32_t>(mDesc.MipLevels)) * (std::max)(1u, arraySize);
+        }
     };
 
     struct BufferResource : public Resource
@@ -273,6 +325,40 @@ namespace D3D12Lite
         Descriptor mUAVDescriptor{};
     };
 
+    // NOTE: Immutable per-resource data read when building draws, kept next to the pool slots
+    // rather than inside the resource objects so iterating it doesn't drag the rest of the resource into cache.
+    struct ResourceHotData
+    {
+        D3D12_GPU_VIRTUAL_ADDRESS mVirtualAddress = 0;
+        uint32_t mDescriptorHeapIndex = INVALID_RESOURCE_TABLE_INDEX;
+    };
+
+    // NOTE: A slice of the per-frame constant upload buffer. Only valid for the frame it was allocated in.
+    struct ConstantAllocation
+    {
+        uint8_t* mCPUAddress = nullptr;
+        D3D12_GPU_VIRTUAL_ADDRESS mGPUAddress = 0;
+        uint64_t mSize = 0;
+        // Where the slice lives, for APIs that take a resource and an offset rather than an address (e.g. ExecuteIndirect)
+        const BufferResource* mBuffer = nullptr;
+        uint64_t mOffset = 0;
+
+        bool IsValid() const { return mCPUAddress != nullptr; }
+    };
+
+    inline SetPipelineConstantsPacket MakeSetPipelineConstantsPacket(uint32_t spaceId, const ConstantAllocation& constants)
+    {
+        SetPipelineConstantsPacket packet;
+        packet.mSpaceId = spaceId;
+        packet.mCPUAddress = constants.mCPUAddress;
+        packet.mGPUAddress = constants.mGPUAddress;
+        packet.mSize = constants.mSize;
+        packet.mBuffer = constants.mBuffer;
+        packet.mOffset = constants.mOffset;
+
+        return packet;
+    }
+
     struct PipelineResourceBinding
     {
         uint32_t mBindingIndex = 0;
@@ -283,11 +369,14 @@ namespace D3D12Lite
     {
     public:
         void SetCBV(BufferResource* resource);
+        // Declares a CBV whose data is allocated per frame and bound with SetPipelineConstants
+        void SetDynamicCBV();
         void SetSRV(const PipelineResourceBinding& binding);
         void SetUAV(const PipelineResourceBinding& binding);
         void Lock();
 
         const BufferResource* GetCBV() const { return mCBV; }
+        bool HasCBV() const { return mCBV != nullptr || mHasDynamicCBV; }
         const std::vector<PipelineResourceBinding>& GetUAVs() const { return mUAVs; }
         const std::vector<PipelineResourceBinding>& GetSRVs() const { return mSRVs; }
 
@@ -300,6 +389,7 @@ namespace D3D12Lite
         //as possible if they have the same update frequency (which is contained by a PipelineResourceSpace). Of course,
         //you can freely change this to a vector like the others if you want.
         BufferResource* mCBV = nullptr;
+        bool mHasDynamicCBV = false;
         std::vector<PipelineResourceBinding> mUAVs;
         std::vector<PipelineResourceBinding> mSRVs;
         bool mIsLocked = false;
@@ -402,6 +492,7 @@ namespace D3D12Lite
     {
         std::array<std::optional<uint32_t>, NUM_RESOURCE_SPACES> mCbvMapping{};
         std::array<std::optional<uint32_t>, NUM_RESOURCE_SPACES> mTableMapping{};
+        std::optional<uint32_t> mConstantsMapping;
     };
 
     struct PipelineStateObject
@@ -410,6 +501,21 @@ namespace D3D12Lite
         ID3D12RootSignature* mRootSignature = nullptr;
         PipelineType mPipelineType = PipelineType::graphics;
         PipelineResourceMapping mPipelineResourceMapping;
+        uint32_t mTraceId = 0;
+    };
+
+    enum class CommandSignatureType : uint8_t
+    {
+        // IndirectDrawIndexedCommand: a root constant (the draw ID), an index buffer view and indexed draw arguments
+        drawIndexedWithDrawId,
+        dispatch
+    };
+
+    struct CommandSignature
+    {
+        ID3D12CommandSignature* mCommandSignature = nullptr;
+        CommandSignatureType mType = CommandSignatureType::drawIndexedWithDrawId;
+        uint32_t mByteStride = 0;
     };
 
     struct PipelineInfo
@@ -419,6 +525,26 @@ namespace D3D12Lite
         TextureResource* mDepthStencilTarget = nullptr;
     };
 
+    // NOTE: Bindings set on a GraphicsContext since its last Reset. Command lists don't inherit anything
+    // from each other, so contexts recording chunks of a pass replay their parent's state before drawing. Resource
+    // spaces are referenced, not copied: they have to outlive the chunk recordings.
+    struct GraphicsContextState
+    {
+        std::optional<PipelineInfo> mPipeline;
+        std::array<const PipelineResourceSpace*, NUM_RESOURCE_SPACES> mResourceSpaces{ nullptr };
+        std::array<ConstantAllocation, NUM_RESOURCE_SPACES> mConstants{};
+        std::array<uint32_t, MAX_INHERITED_ROOT_CONSTANTS> mRootConstants{ 0 };
+        uint32_t mRootConstantsMask = 0;
+        // Spaces whose last constants couldn't be allocated, draws are skipped until new ones are set
+        uint32_t mMissingConstantsMask = 0;
+        std::optional<D3D12_VIEWPORT> mViewport;
+        std::optional<D3D12_RECT> mScissorRect;
+        std::optional<uint32_t> mStencilRef;
+        std::optional<std::array<float, 4>> mBlendFactor;
+        D3D12_PRIMITIVE_TOPOLOGY mPrimitiveTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+        const BufferResource* mIndexBuffer = nullptr;
+    };
+
     struct BufferUpload
     {
         BufferResource* mBuffer = nullptr;
@@ -435,6 +561,74 @@ namespace D3D12Lite
         SubResourceLayouts mSubResourceLayouts{ 0 };
     };
 
+    struct ResourceBarrierStats
+    {
+        uint32_t mNumTransitionBarriers = 0;
+        uint32_t mNumSplitBarriers = 0;
+        uint32_t mNumUAVBarriers = 0;
+        uint32_t mNumSkippedBarriers = 0;
+        uint32_t mNumFlushes = 0;
+    };
+
+    // Batches the barriers of a pass, tracking resource states per subresource. Transitions that would not
+    // change the state of a subresource (or that target a read state already covered by the current one) are
+    // dropped, so callers can declare the state they need without checking what the resource is in.
+    class ResourceBarrierBatch
+    {
+    public:
+        ResourceBarrierBatch();
+
+        void Transition(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+        void BeginSplitTransition(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+        void EndSplitTransition(Resource& resource);
+        void UAVBarrier(Resource& resource);
+        void Clear();
+        void ResetStats() { mStats = ResourceBarrierStats{}; }
+
+        const D3D12_RESOURCE_BARRIER* GetBarriers() const { return mBarriers.data(); }
+        uint32_t GetNumBarriers() const { return static_cast<uint32_t>(mBarriers.size()); }
+        const ResourceBarrierStats& GetStats() const { return mStats; }
+
+    private:
+        void AddTransition(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource, D3D12_RESOURCE_BARRIER_FLAGS flags, bool commitState);
+        void PushTransition(ID3D12Resource* resource, uint32_t subresource, D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState, D3D12_RESOURCE_BARRIER_FLAGS flags);
+
+        std::vector<D3D12_RESOURCE_BARRIER> mBarriers;
+        ResourceBarrierStats mStats;
+    };
+
+    struct DescriptorTableStats
+    {
+        uint32_t mNumTablesCopied = 0;
+        uint32_t mNumDescriptorsCopied = 0;
+        uint32_t mNumCacheHits = 0;
+    };
+
+    // Per-frame map from the set of staging CPU handles of a locked PipelineResourceSpace to the GPU handle of the
+    // shader visible table they were already copied to, so binding the same space again is just a root argument change.
+    class DescriptorTableCache
+    {
+    public:
+        static constexpr uint32_t MAX_TABLE_HANDLES = 16;
+
+        bool Find(const D3D12_CPU_DESCRIPTOR_HANDLE* handles, uint32_t numHandles, D3D12_GPU_DESCRIPTOR_HANDLE& outTable) const;
+        void Insert(const D3D12_CPU_DESCRIPTOR_HANDLE* handles, uint32_t numHandles, D3D12_GPU_DESCRIPTOR_HANDLE table);
+        void Clear() { mTables.clear(); }
+
+        // Tables are stored by this hash, one per hash
+        static uint64_t HashHandles(const D3D12_CPU_DESCRIPTOR_HANDLE* handles, uint32_t numHandles);
+
+    private:
+        struct CachedTable
+        {
+            std::array<SIZE_T, MAX_TABLE_HANDLES> mHandles{};
+            uint32_t mNumHandles = 0;
+            D3D12_GPU_DESCRIPTOR_HANDLE mTable{ 0 };
+        };
+
+        std::unordered_map<uint64_t, CachedTable> mTables;
+    };
+
     class DescriptorHeap
     {
     public:
@@ -466,11 +660,14 @@ namespace D3D12Lite
         Descriptor GetNewDescriptor();
         void FreeDescriptor(Descriptor descriptor);
 
+        uint32_t GetActiveHandleCount() const { return mActiveHandleCount.load(std::memory_order_relaxed); }
+
     private:
-        std::vector<uint32_t> mFreeDescriptors;
-        uint32_t mCurrentDescriptorIndex = 0;
-        uint32_t mActiveHandleCount = 0;
-        std::mutex mUsageMutex;
+        Descriptor GetDescriptor(uint32_t heapIndex) const;
+
+        AtomicLinearIndexAllocator mUnusedDescriptors;
+        AtomicFreeIndexList mFreeDescriptors;
+        std::atomic<uint32_t> mActiveHandleCount{ 0 };
     };
 
     class RenderPassDescriptorHeap final : public DescriptorHeap
@@ -482,10 +679,14 @@ namespace D3D12Lite
         Descriptor AllocateUserDescriptorBlock(uint32_t count);
         Descriptor GetReservedDescriptor(uint32_t index);
 
+        uint32_t GetNumAllocatedUserDescriptors() const { return mUserDescriptors.GetNumAllocated(); }
+        uint32_t GetPeakAllocatedUserDescriptors() const { return (std::max)(mPeakAllocatedUserDescriptors, GetNumAllocatedUserDescriptors()); }
+        uint32_t GetNumUserDescriptors() const { return mUserDescriptors.GetCapacity(); }
+
     private:
         uint32_t mReservedHandleCount = 0;
-        uint32_t mCurrentDescriptorIndex = 0;
-        std::mutex mUsageMutex;
+        uint32_t mPeakAllocatedUserDescriptors = 0;
+        AtomicLinearIndexAllocator mUserDescriptors;
     };
 
     class Queue
@@ -505,6 +706,8 @@ namespace D3D12Lite
         uint64_t GetLastCompletedFence() { return mLastCompletedFenceValue; }
         uint64_t GetNextFenceValue() { return mNextFenceValue; }
         uint64_t ExecuteCommandList(ID3D12CommandList* commandList);
+        // Closes and submits the lists as a single batch, executed in order, behind a single fence
+        uint64_t ExecuteCommandLists(ID3D12CommandList* const* commandLists, uint32_t numCommandLists);
         uint64_t SignalFence();
 
         ID3D12CommandQueue* GetDeviceQueue() { return mQueue; }
@@ -528,27 +731,56 @@ namespace D3D12Lite
         virtual ~Context();
 
         D3D12_COMMAND_LIST_TYPE GetCommandType() { return mContextType; }
+        // Null with CommandBackend::null
         ID3D12GraphicsCommandList* GetCommandList() { return mCommandList; }
+        // Commands recorded since the last Reset, empty with CommandBackend::d3d12
+        const CommandTrace& GetTrace() const { return mTrace; }
 
         void Reset();
-        void AddBarrier(Resource& resource, D3D12_RESOURCE_STATES newState);
+        void AddBarrier(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+        void BeginSplitBarrier(Resource& resource, D3D12_RESOURCE_STATES newState, uint32_t subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+        void EndSplitBarrier(Resource& resource);
         void FlushBarriers();
+        const ResourceBarrierStats& GetBarrierStats() const { return mBarrierBatch.GetStats(); }
+        // Tables of this context's recording since its last Reset, see Device::GetFrameDescriptorTableStats for the frame
+        const DescriptorTableStats& GetDescriptorTableStats() const { return mDescriptorTableStats; }
+        // Draws and dispatches dropped since the last Reset because constants they needed couldn't be allocated
+        uint32_t GetNumSkippedDraws() const { return mNumSkippedDraws; }
         void CopyResource(const Resource& destination, const Resource& source);
         void CopyBufferRegion(Resource& destination, uint64_t destOffset, Resource& source, uint64_t sourceOffset, uint64_t numBytes);
         void CopyTextureRegion(Resource& destination, Resource& source, size_t sourceOffset, SubResourceLayouts& subResourceLayouts, uint32_t numSubResources);
 
     protected:
+        virtual void ResetBindings() {}
         void BindDescriptorHeaps(uint32_t frameIndex);
+        void Trace(TraceOpcode opcode, std::initializer_list<uint32_t> words) { if (mIsTracing) { mTrace.Write(opcode, words); } }
+        void TraceBarriers();
+        void TraceDescriptorTable(uint32_t rootParameterIndex, const PipelineResourceSpace& resources);
+        void ValidateBarrierStates(const Resource& resource, D3D12_RESOURCE_STATES newState);
+        void TrackQueueUsage(const Resource& resource) { resource.mQueueUsageMask.fetch_or(mQueueMask, std::memory_order_relaxed); }
+        bool GetDescriptorTable(const PipelineResourceSpace& resources, D3D12_GPU_DESCRIPTOR_HANDLE& outTable);
+        // Rather than have the draw read whatever constants another draw left bound
+        bool SkipWithoutConstants(uint32_t missingConstantsMask)
+        {
+            mNumSkippedDraws += missingConstantsMask != 0 ? 1 : 0;
+            return missingConstantsMask != 0;
+        }
 
         class Device& mDevice;
         D3D12_COMMAND_LIST_TYPE mContextType = D3D12_COMMAND_LIST_TYPE_DIRECT;
+        uint8_t mQueueMask = 0;
         ID3D12GraphicsCommandList4* mCommandList = nullptr;
         std::array<ID3D12DescriptorHeap*, D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES> mCurrentDescriptorHeaps{ nullptr };
         std::array<ID3D12CommandAllocator*, NUM_FRAMES_IN_FLIGHT> mCommandAllocators{ nullptr };
-        std::array<D3D12_RESOURCE_BARRIER, MAX_QUEUED_BARRIERS> mResourceBarriers{};
-        uint32_t mNumQueuedBarriers = 0;
+        ResourceBarrierBatch mBarrierBatch;
         RenderPassDescriptorHeap* mCurrentSRVHeap = nullptr;
         D3D12_CPU_DESCRIPTOR_HANDLE mCurrentSRVHeapHandle{ 0 };
+        DescriptorTableCache mDescriptorTableCache;
+        DescriptorTableStats mDescriptorTableStats;
+        uint32_t mNumSkippedDraws = 0;
+        bool mIsTracing = false;
+        CommandTrace mTrace;
+        std::vector<uint32_t> mTraceScratch;
     };
 
     class GraphicsContext final : public Context
@@ -563,10 +795,16 @@ namespace D3D12Lite
         void SetBlendFactor(float* blendFactor);
         void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology);
         void SetPipeline(const PipelineInfo& pipelineBinding);
+        // Binds the pipeline and its root signature but leaves the render targets as they are
+        void SetPipelineState(PipelineStateObject* pipeline);
         void SetPipelineResources(uint32_t spaceId, const PipelineResourceSpace& resources);
+        void SetPipelineConstants(uint32_t spaceId, const ConstantAllocation& constants);
         void SetPipeline32BitConstant(uint32_t rootParameterIndex, uint32_t value, uint32_t offset);
         void SetPipeline32BitConstants(uint32_t rootParameterIndex, uint32_t numValues, const void* data, uint32_t offset);
+        // Sets one of the PipelineResourceLayout::mNum32BitConstants root constants (register b1, space0) of the current pipeline
+        void SetRootConstant(uint32_t value, uint32_t offset = 0);
         void SetIndexBuffer(const BufferResource& indexBuffer);
+        void ExecuteIndirect(const CommandSignature& commandSignature, const BufferResource& argumentBuffer, uint64_t argumentOffset, uint32_t numCommands);
         void ClearRenderTarget(const TextureResource& target, float* color);
         void ClearDepthStencilTarget(const TextureResource& target, float depth, uint8_t stencil);
         void DrawFullScreenTriangle();
@@ -579,10 +817,19 @@ namespace D3D12Lite
         void Dispatch2D(uint32_t threadCountX, uint32_t threadCountY, uint32_t groupSizeX, uint32_t groupSizeY);
         void Dispatch3D(uint32_t threadCountX, uint32_t threadCountY, uint32_t threadCountZ, uint32_t groupSizeX, uint32_t groupSizeY, uint32_t groupSizeZ);
 
+        const GraphicsContextState& GetState() const { return mState; }
+        // Replays the bindings of another context right after Reset. Barriers and clears are not part of the state:
+        // they stay on the parent, which has to be submitted before the contexts inheriting from it.
+        void InheritState(const GraphicsContextState& state);
+        // Executes a recorded CommandStream packet by packet, as if its commands had been called on this context
+        void Replay(const CommandStream& stream);
+
     private:
+        void ResetBindings() override;
         void SetTargets(uint32_t numRenderTargets, const D3D12_CPU_DESCRIPTOR_HANDLE renderTargets[], D3D12_CPU_DESCRIPTOR_HANDLE depthStencil);
 
         PipelineStateObject* mCurrentPipeline = nullptr;
+        GraphicsContextState mState;
     };
 
     class ComputeContext final : public Context
@@ -592,23 +839,27 @@ namespace D3D12Lite
 
         void SetPipeline(const PipelineInfo& pipelineBinding);
         void SetPipelineResources(uint32_t spaceId, const PipelineResourceSpace& resources);
+        void SetPipelineConstants(uint32_t spaceId, const ConstantAllocation& constants);
         void Dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
         void Dispatch1D(uint32_t threadCountX, uint32_t groupSizeX);
         void Dispatch2D(uint32_t threadCountX, uint32_t threadCountY, uint32_t groupSizeX, uint32_t groupSizeY);
         void Dispatch3D(uint32_t threadCountX, uint32_t threadCountY, uint32_t threadCountZ, uint32_t groupSizeX, uint32_t groupSizeY, uint32_t groupSizeZ);
 
     private:
+        void ResetBindings() override { mMissingConstantsMask = 0; }
+
         PipelineStateObject* mCurrentPipeline = nullptr;
+        uint32_t mMissingConstantsMask = 0;
     };
 
     class UploadContext final : public Context
     {
     public:
-        UploadContext(class Device& device, std::unique_ptr<BufferResource> bufferUploadHeap, std::unique_ptr<BufferResource> textureUploadHeap);
+        UploadContext(class Device& device, BufferHandle bufferUploadHeap, BufferHandle textureUploadHeap);
         ~UploadContext();
 
-        std::unique_ptr<BufferResource> ReturnBufferHeap();
-        std::unique_ptr<BufferResource> ReturnTextureHeap();
+        BufferHandle ReturnBufferHeap();
+        BufferHandle ReturnTextureHeap();
 
         void AddBufferUpload(std::unique_ptr<BufferUpload> bufferUpload);
         void AddTextureUpload(std::unique_ptr<TextureUpload> textureUpload);
@@ -620,14 +871,15 @@ namespace D3D12Lite
         std::vector<std::unique_ptr<TextureUpload>> mTextureUploads;
         std::vector<BufferResource*> mBufferUploadsInProgress;
         std::vector<TextureResource*> mTextureUploadsInProgress;
-        std::unique_ptr<BufferResource> mBufferUploadHeap;
-        std::unique_ptr<BufferResource> mTextureUploadHeap;
+        BufferHandle mBufferUploadHeap;
+        BufferHandle mTextureUploadHeap;
     };
 
     class Device
     {
     public:
-        Device(void* windowHandle, Uint2 screenSize);
+        // A null windowHandle renders to offscreen back buffers instead of a swap chain
+        Device(void* windowHandle, Uint2 screenSize, CommandBackend commandBackend = CommandBackend::d3d12);
         ~Device();
 
         void BeginFrame();
@@ -641,28 +893,77 @@ namespace D3D12Lite
         TextureResource& GetCurrentBackBuffer();
         Descriptor& GetImguiDescriptor(uint32_t index) { return mImguiDescriptors[index]; }
         uint32_t GetFrameId() { return mFrameId; }
+        CommandBackend GetCommandBackend() const { return mCommandBackend; }
+        // Traces of every context submitted since BeginFrame, in submission order
+        const CommandTrace& GetFrameTrace() const { return mFrameTrace; }
         Uint2 GetScreenSize() { return mScreenSize; }
         UploadContext& GetUploadContextForCurrentFrame() { return *mUploadContexts[mFrameId]; }
 
-        std::unique_ptr<BufferResource> CreateBuffer(const BufferCreationDesc& desc);
-        std::unique_ptr<TextureResource> CreateTexture(const TextureCreationDesc& desc);
+        bool IsValid(BufferHandle buffer) const { return mBufferPool.IsValid(buffer); }
+        bool IsValid(TextureHandle texture) const { return mTexturePool.IsValid(texture); }
+        BufferResource& GetBuffer(BufferHandle buffer) { return mBufferPool.Get(buffer); }
+        TextureResource& GetTexture(TextureHandle texture) { return mTexturePool.Get(texture); }
+        D3D12_GPU_VIRTUAL_ADDRESS GetVirtualAddress(BufferHandle buffer) const { return mBufferPool.GetHotData(buffer).mVirtualAddress; }
+        uint32_t GetDescriptorHeapIndex(BufferHandle buffer) const { return mBufferPool.GetHotData(buffer).mDescriptorHeapIndex; }
+        uint32_t GetDescriptorHeapIndex(TextureHandle texture) const { return mTexturePool.GetHotData(texture).mDescriptorHeapIndex; }
+        uint32_t GetNumBuffers() const { return mBufferPool.GetNumAlive(); }
+        uint32_t GetNumTextures() const { return mTexturePool.GetNumAlive(); }
+
+        BufferHandle CreateBuffer(const BufferCreationDesc& desc);
+        TextureHandle CreateTexture(const TextureCreationDesc& desc);
         // std::unique_ptr<TextureResource> CreateTextureFromFile(const std::string& texturePath);
         std::unique_ptr<Shader> CreateShader(const ShaderCreationDesc& desc);
         std::unique_ptr<PipelineStateObject> CreateGraphicsPipeline(const GraphicsPipelineDesc& desc, const PipelineResourceLayout& layout);
         std::unique_ptr<PipelineStateObject> CreateComputePipeline(const ComputePipelineDesc& desc, const PipelineResourceLayout& layout);
+        // Signatures with root constants are bound to the root signature of pipeline, it must outlive the signature
+        std::unique_ptr<CommandSignature> CreateCommandSignature(CommandSignatureType type, const PipelineStateObject* pipeline);
         std::unique_ptr<GraphicsContext> CreateGraphicsContext();
         std::unique_ptr<ComputeContext> CreateComputeContext();
+        // Graphics contexts for recording passes in parallel, each one can be acquired once per frame
+        ContextPool<GraphicsContext>& GetGraphicsContextPool() { return *mGraphicsContextPool; }
+
+        // Constant data for the current frame, recycled once the frame's fences have completed. Thread safe.
+        ConstantAllocation AllocateConstants(uint64_t size, uint64_t alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+        template<typename T>
+        ConstantAllocation AllocateConstants(const T& data)
+        {
+            // An exhausted upload buffer already asserted, the invalid allocation is returned as is and binding it is skipped
+            ConstantAllocation constants = AllocateConstants(sizeof(T));
+            if (constants.IsValid())
+            {
+                memcpy(constants.mCPUAddress, &data, sizeof(T));
+            }
+
+            return constants;
+        }
+        const LinearAllocator& GetConstantAllocator() const { return mConstantAllocator; }
 
-        void DestroyBuffer(std::unique_ptr<BufferResource> buffer);
-        void DestroyTexture(std::unique_ptr<TextureResource> texture);
+        void DestroyBuffer(BufferHandle buffer);
+        void DestroyTexture(TextureHandle texture);
         void DestroyShader(std::unique_ptr<Shader> shader);
         void DestroyPipelineStateObject(std::unique_ptr<PipelineStateObject> pso);
+        void DestroyCommandSignature(std::unique_ptr<CommandSignature> commandSignature);
         void DestroyContext(std::unique_ptr<Context> context);
 
         ContextSubmissionResult SubmitContextWork(Context& context);
+        ContextSubmissionResult SubmitContextWork(Context& context, const QueueDependencies& dependencies);
+        // Submits contexts of the same type as one batch, in order, e.g. a parent context followed by its parallel recordings
+        ContextSubmissionResult SubmitContextWork(Context* const* contexts, uint32_t numContexts, const QueueDependencies& dependencies);
         void WaitOnContextWork(ContextSubmissionResult submission, ContextWaitType waitType);
+        QueueFence GetContextWorkFence(ContextSubmissionResult submission);
         void WaitForIdle();
 
+        const QueueSchedulerStats& GetQueueSchedulerStats() { return mQueueScheduler.GetStats(); }
+        // Summed over every context submitted since BeginFrame, each one counted with the recording it was submitted with
+        const DescriptorTableStats& GetFrameDescriptorTableStats() const { return mFrameDescriptorTableStats; }
+        // Same for Context::GetNumSkippedDraws, non-zero once the constant upload buffer ran out
+        uint32_t GetFrameNumSkippedDraws() const { return mFrameNumSkippedDraws; }
+        uint32_t GetNumPendingReleases() const;
+        uint64_t GetPendingReleaseBytes() const { return mBufferReleases.GetPendingBytes() + mTextureReleases.GetPendingBytes(); }
+        uint64_t GetPeakPendingReleaseBytes() const { return mPeakPendingReleaseBytes; }
+
+        static QueueType GetQueueType(D3D12_COMMAND_LIST_TYPE commandType);
+
         void CopyDescriptorsSimple(uint32_t numDescriptors, D3D12_CPU_DESCRIPTOR_HANDLE destDescriptorRangeStart, D3D12_CPU_DESCRIPTOR_HANDLE srcDescriptorRangeStart, D3D12_DESCRIPTOR_HEAP_TYPE descriptorType);
         void CopyDescriptors(uint32_t numDestDescriptorRanges, const D3D12_CPU_DESCRIPTOR_HANDLE* destDescriptorRangeStarts, const uint32_t* destDescriptorRangeSizes,
                              uint32_t numSrcDescriptorRanges, const D3D12_CPU_DESCRIPTOR_HANDLE* srcDescriptorRangeStarts, const uint32_t* srcDescriptorRangeSizes, D3D12_DESCRIPTOR_HEAP_TYPE descriptorType);
@@ -671,12 +972,21 @@ namespace D3D12Lite
         void InitializeDeviceResources();
         void CreateSamplers();
         void CreateWindowDependentResources(void* windowHandle, Uint2 screenSize);
+        void CreateHeadlessBackBuffers(Uint2 screenSize);
         void DestroyWindowDependentResources();
-        void ProcessDestructions(uint32_t frameIndex);
+        void ScheduleReleases();
+        void ProcessReleases(const QueueFenceClock& completedFences);
+        void FlushReleases();
+        void ReleaseBuffer(BufferHandle bufferHandle);
+        void ReleaseTexture(TextureHandle textureHandle);
+        QueueFenceClock GetReleaseFences(uint8_t queueMask) const;
+        QueueFenceClock PollCompletedFences();
         void CopySRVHandleToReservedTable(Descriptor srvHandle, uint32_t index);
 
         ID3D12RootSignature* CreateRootSignature(const PipelineResourceLayout& layout, PipelineResourceMapping& resourceMapping);
 
+        Queue& GetQueue(QueueType queueType);
+
         struct EndOfFrameFences
         {
             uint64_t mGraphicsQueueFence = 0;
@@ -684,16 +994,24 @@ namespace D3D12Lite
             uint64_t mCopyQueueFence = 0;
         };
 
+        // Destroyed this frame, waiting for the end of frame fences to be tagged with
         struct DestructionQueue
         {
-            std::vector<std::unique_ptr<BufferResource>> mBuffersToDestroy;
-            std::vector<std::unique_ptr<TextureResource>> mTexturesToDestroy;
+            std::vector<BufferHandle> mBuffersToDestroy;
+            std::vector<TextureHandle> mTexturesToDestroy;
             std::vector<std::unique_ptr<PipelineStateObject>> mPipelinesToDestroy;
+            std::vector<std::unique_ptr<CommandSignature>> mCommandSignaturesToDestroy;
             std::vector<std::unique_ptr<Context>> mContextsToDestroy;
         };
 
         uint32_t mFrameId = 0;
         Uint2 mScreenSize{ 0, 0 };
+        CommandBackend mCommandBackend = CommandBackend::d3d12;
+        CommandTrace mFrameTrace;
+        DescriptorTableStats mFrameDescriptorTableStats;
+        uint32_t mFrameNumSkippedDraws = 0;
+        std::atomic<uint32_t> mNextTraceId{ 1 };
+        uint32_t mHeadlessBackBufferIndex = 0;
         ID3D12Device9* mDevice = nullptr;
         IDXGIFactory7* mDXGIFactory = nullptr;
         IDXGISwapChain4* mSwapChain = nullptr;
@@ -708,11 +1026,27 @@ namespace D3D12Lite
         std::vector<uint32_t> mFreeReservedDescriptorIndices;
         std::unique_ptr<RenderPassDescriptorHeap> mSamplerRenderPassDescriptorHeap;
         std::array<std::unique_ptr<RenderPassDescriptorHeap>, NUM_FRAMES_IN_FLIGHT> mSRVRenderPassDescriptorHeaps;
+        // NOTE: Back buffers are owned by the swap chain, so they stay out of the texture pool
         std::array<std::unique_ptr<TextureResource>, NUM_BACK_BUFFERS> mBackBuffers;
+        ResourcePool<BufferResource, ResourceHotData> mBufferPool;
+        ResourcePool<TextureResource, ResourceHotData> mTexturePool;
         std::array<EndOfFrameFences, NUM_FRAMES_IN_FLIGHT> mEndOfFrameFences;
         std::array<std::unique_ptr<UploadContext>, NUM_FRAMES_IN_FLIGHT> mUploadContexts;
+        std::unique_ptr<ContextPool<GraphicsContext>> mGraphicsContextPool;
+        BufferHandle mConstantUploadBuffer;
+        LinearAllocator mConstantAllocator;
         std::array<std::vector<std::pair<uint64_t, D3D12_COMMAND_LIST_TYPE>>, NUM_FRAMES_IN_FLIGHT> mContextSubmissions;
-        std::array<DestructionQueue, NUM_FRAMES_IN_FLIGHT> mDestructionQueues;
+        QueueScheduler mQueueScheduler;
+        std::vector<QueueWait> mScheduledWaits;
+        static constexpr uint8_t BINDLESS_QUEUE_MASK = GetQueueMask(QueueType::graphics) | GetQueueMask(QueueType::compute);
+
+        DestructionQueue mDestructionQueue;
+        DeferredReleaseQueue<BufferHandle> mBufferReleases;
+        DeferredReleaseQueue<TextureHandle> mTextureReleases;
+        DeferredReleaseQueue<std::unique_ptr<PipelineStateObject>> mPipelineReleases;
+        DeferredReleaseQueue<std::unique_ptr<CommandSignature>> mCommandSignatureReleases;
+        DeferredReleaseQueue<std::unique_ptr<Context>> mContextReleases;
+        uint64_t mPeakPendingReleaseBytes = 0;
     };
 }
 
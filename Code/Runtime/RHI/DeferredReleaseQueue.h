@@ -0,0 +1,146 @@
+#pragma once
+
+#include "QueueScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// NOTE: Releases waiting on the GPU. Each entry carries the fence value it needs from every queue that
+// may still reference it (0 for queues that never touched it), and is reclaimed by the first sweep that observes
+// all of those fences as completed. Entries live in a ring that only grows, so steady state streaming doesn't allocate,
+// and a sweep where the oldest entries completed first only moves the head. Only plain fence values are involved, so
+// it can be driven with simulated fences.
+namespace D3D12Lite
+{
+    template<typename T>
+    class DeferredReleaseQueue
+    {
+    public:
+        void Push(T&& item, const QueueFenceClock& fences, uint64_t sizeInBytes)
+        {
+            if (mNumEntries == mRing.size())
+            {
+                Grow();
+            }
+
+            Entry& entry = At(mNumEntries++);
+            entry.mItem = std::move(item);
+            entry.mFences = fences;
+            entry.mSizeInBytes = sizeInBytes;
+
+            mPendingBytes += sizeInBytes;
+            mPeakPendingBytes = (std::max)(mPeakPendingBytes, mPendingBytes);
+        }
+
+        // Walks the ring once from its oldest entry and hands every entry whose fences are all complete to release.
+        // Reclaimed entries in front of the first survivor just move the head, later survivors are compacted behind it,
+        // keeping them in release order. Returns the number of reclaimed entries.
+        template<typename ReleaseFunction>
+        uint32_t Sweep(const QueueFenceClock& completedFences, ReleaseFunction&& release)
+        {
+            const uint32_t numEntries = mNumEntries;
+            uint32_t firstKept = 0;
+            uint32_t numKept = 0;
+
+            for (uint32_t entryIndex = 0; entryIndex < numEntries; entryIndex++)
+            {
+                Entry& entry = At(entryIndex);
+
+                if (IsComplete(entry.mFences, completedFences))
+                {
+                    mPendingBytes -= entry.mSizeInBytes;
+                    release(entry.mItem);
+                    continue;
+                }
+
+                if (numKept == 0)
+                {
+                    firstKept = entryIndex;
+                }
+                else if (firstKept + numKept != entryIndex)
+                {
+                    At(firstKept + numKept) = std::move(entry);
+                }
+
+                numKept++;
+            }
+
+            // Freed slots keep no items alive until the ring wraps around to them
+            for (uint32_t entryIndex = 0; entryIndex < firstKept; entryIndex++)
+            {
+                At(entryIndex).mItem = T{};
+            }
+
+            for (uint32_t entryIndex = firstKept + numKept; entryIndex < numEntries; entryIndex++)
+            {
+                At(entryIndex).mItem = T{};
+            }
+
+            mHead = (mHead + firstKept) & GetRingMask();
+            mNumEntries = numKept;
+            return numEntries - numKept;
+        }
+
+        // Releases everything regardless of fences, for when the caller knows the GPU is idle
+        template<typename ReleaseFunction>
+        void Flush(ReleaseFunction&& release)
+        {
+            QueueFenceClock allFences;
+            allFences.fill(UINT64_MAX);
+            Sweep(allFences, release);
+        }
+
+        uint32_t GetNumPending() const { return mNumEntries; }
+        uint64_t GetPendingBytes() const { return mPendingBytes; }
+        uint64_t GetPeakPendingBytes() const { return mPeakPendingBytes; }
+
+    private:
+        struct Entry
+        {
+            T mItem{};
+            QueueFenceClock mFences{};
+            uint64_t mSizeInBytes = 0;
+        };
+
+        static bool IsComplete(const QueueFenceClock& fences, const QueueFenceClock& completedFences)
+        {
+            for (uint32_t queueIndex = 0; queueIndex < NUM_QUEUE_TYPES; queueIndex++)
+            {
+                if (fences[queueIndex] > completedFences[queueIndex])
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        uint32_t GetRingMask() const { return static_cast<uint32_t>(mRing.size()) - 1; }
+        Entry& At(uint32_t entryIndex) { return mRing[(mHead + entryIndex) & GetRingMask()]; }
+
+        // Unwraps the pending entries into a ring twice as large, only while the pending set is still growing
+        void Grow()
+        {
+            std::vector<Entry> ring((std::max)(MIN_RING_SIZE, static_cast<uint32_t>(mRing.size()) * 2));
+            for (uint32_t entryIndex = 0; entryIndex < mNumEntries; entryIndex++)
+            {
+                ring[entryIndex] = std::move(At(entryIndex));
+            }
+
+            mRing = std::move(ring);
+            mHead = 0;
+        }
+
+        static constexpr uint32_t MIN_RING_SIZE = 64;
+
+        // Power of two sized, pending entries are the mNumEntries ones starting at mHead
+        std::vector<Entry> mRing;
+        uint32_t mHead = 0;
+        uint32_t mNumEntries = 0;
+        uint64_t mPendingBytes = 0;
+        uint64_t mPeakPendingBytes = 0;
+    };
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+
+// NOTE: Lock-free index allocators backing the descriptor heaps. They only hand out integers, so they have
+// no D3D12 dependency and can be stress tested on their own.
+namespace D3D12Lite
+{
+    // Bump allocator over [begin, end). Allocation is a compare-exchange loop, so any number of threads recording
+    // command lists can grab descriptor blocks without serializing on a lock.
+    class AtomicLinearIndexAllocator
+    {
+    public:
+        void Reset(uint32_t begin, uint32_t end)
+        {
+            assert(begin <= end);
+
+            mBegin = begin;
+            mEnd = end;
+            mCurrent.store(begin, std::memory_order_relaxed);
+        }
+
+        bool Allocate(uint32_t count, uint32_t& outIndex)
+        {
+            // Not a fetch_add: a failed allocation has to leave the counter as it was, so it never moves past mEnd
+            // and smaller blocks still fit in what is left
+            uint32_t index = mCurrent.load(std::memory_order_relaxed);
+
+            do
+            {
+                if (count > mEnd - index)
+                {
+                    return false;
+                }
+            } while (!mCurrent.compare_exchange_weak(index, index + count, std::memory_order_relaxed));
+
+            outIndex = index;
+            return true;
+        }
+
+        uint32_t GetNumAllocated() const { return mCurrent.load(std::memory_order_relaxed) - mBegin; }
+        uint32_t GetCapacity() const { return mEnd - mBegin; }
+
+    private:
+        uint32_t mBegin = 0;
+        uint32_t mEnd = 0;
+        std::atomic<uint32_t> mCurrent{ 0 };
+    };
+
+    // Treiber stack of free indices. The head packs a 32 bit tag next to the top index; the tag changes on every
+    // successful exchange, which rules out ABA when an index is popped and pushed back while another thread is
+    // still looking at it. Links live in a preallocated array, so nothing is ever freed while being read.
+    class AtomicFreeIndexList
+    {
+    public:
+        explicit AtomicFreeIndexList(uint32_t capacity)
+            : mCapacity(capacity)
+            , mNextIndices(std::make_unique<std::atomic<uint32_t>[]>(capacity))
+        {
+        }
+
+        void Push(uint32_t index)
+        {
+            assert(index < mCapacity);
+
+            uint64_t head = mHead.load(std::memory_order_relaxed);
+            uint64_t newHead = 0;
+
+            do
+            {
+                mNextIndices[index].store(GetIndex(head), std::memory_order_relaxed);
+                newHead = MakeHead(GetTag(head) + 1, index);
+            } while (!mHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        bool Pop(uint32_t& outIndex)
+        {
+            uint64_t head = mHead.load(std::memory_order_acquire);
+            uint64_t newHead = 0;
+
+            do
+            {
+                if (GetIndex(head) == INVALID_INDEX)
+                {
+                    return false;
+                }
+
+                newHead = MakeHead(GetTag(head) + 1, mNextIndices[GetIndex(head)].load(std::memory_order_relaxed));
+            } while (!mHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire));
+
+            outIndex = GetIndex(head);
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+        static uint64_t MakeHead(uint32_t tag, uint32_t index) { return (static_cast<uint64_t>(tag) << 32) | index; }
+        static uint32_t GetTag(uint64_t head) { return static_cast<uint32_t>(head >> 32); }
+        static uint32_t GetIndex(uint64_t head) { return static_cast<uint32_t>(head); }
+
+        uint32_t mCapacity = 0;
+        std::unique_ptr<std::atomic<uint32_t>[]> mNextIndices;
+        std::atomic<uint64_t> mHead{ MakeHead(0, INVALID_INDEX) };
+    };
+}
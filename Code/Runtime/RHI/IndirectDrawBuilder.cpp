@@ -0,0 +1,51 @@
+#include "IndirectDrawBuilder.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace D3D12Lite
+{
+    void IndirectDrawBuilder::SortByBucket(const IndirectDrawSource& source, std::vector<uint32_t>& drawIds)
+    {
+        std::stable_sort(drawIds.begin(), drawIds.end(), [&source](uint32_t a, uint32_t b)
+        {
+            return source.mBucketKeys[a] < source.mBucketKeys[b];
+        });
+    }
+
+    void IndirectDrawBuilder::Build(const IndirectDrawSource& source, const uint32_t* visibleDrawIds, uint32_t numVisibleDraws, IndirectDrawIndexedCommand* outCommands)
+    {
+        mBuckets.clear();
+
+        for (uint32_t commandIndex = 0; commandIndex < numVisibleDraws; commandIndex++)
+        {
+            const uint32_t drawId = visibleDrawIds[commandIndex];
+            const uint32_t bucketKey = source.mBucketKeys[drawId];
+
+            if (mBuckets.empty() || mBuckets.back().mBucketKey != bucketKey)
+            {
+                assert(mBuckets.empty() || mBuckets.back().mBucketKey < bucketKey);
+
+                IndirectDrawBucket& bucket = mBuckets.emplace_back();
+                bucket.mBucketKey = bucketKey;
+                bucket.mFirstCommand = commandIndex;
+            }
+
+            mBuckets.back().mNumCommands++;
+
+            // Built on the stack and copied out whole, so the destination sees full sequential writes
+            IndirectDrawIndexedCommand command;
+            command.mDrawId = drawId;
+            command.mIndexBufferAddress = source.mIndexBufferAddresses[drawId];
+            command.mIndexBufferSize = source.mIndexBufferSizes[drawId];
+            command.mIndexBufferFormat = source.mIndexBufferFormat;
+            command.mIndexCountPerInstance = source.mIndexCounts[drawId];
+            command.mInstanceCount = 1;
+            command.mStartIndexLocation = source.mStartIndices[drawId];
+            command.mBaseVertexLocation = 0;
+            command.mStartInstanceLocation = 0;
+
+            outCommands[commandIndex] = command;
+        }
+    }
+}
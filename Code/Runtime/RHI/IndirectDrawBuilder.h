@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// NOTE: CPU side generation of ExecuteIndirect arguments. The command layout mirrors the
+// D3D12 argument structures (checked with static_asserts in D3D12Lite.cpp) but the builder itself has no D3D12
+// dependency, so it can be tested and benchmarked headless.
+namespace D3D12Lite
+{
+    // One command of a CommandSignatureType::drawIndexedWithDrawId signature: the draw ID root constant,
+    // the index buffer view and the D3D12_DRAW_INDEXED_ARGUMENTS. D3D12 packs the arguments back to back with no
+    // alignment, so the index buffer view starts at offset 4 and the struct is packed to 4 bytes to match.
+#pragma pack(push, 4)
+    struct IndirectDrawIndexedCommand
+    {
+        uint32_t mDrawId = 0;
+        uint64_t mIndexBufferAddress = 0;
+        uint32_t mIndexBufferSize = 0;
+        uint32_t mIndexBufferFormat = 0;
+        uint32_t mIndexCountPerInstance = 0;
+        uint32_t mInstanceCount = 0;
+        uint32_t mStartIndexLocation = 0;
+        int32_t mBaseVertexLocation = 0;
+        uint32_t mStartInstanceLocation = 0;
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(IndirectDrawIndexedCommand) == 40, "Indirect commands must stay tightly packed");
+
+    // Read only view over per-draw streams, indexed by draw ID
+    struct IndirectDrawSource
+    {
+        const uint32_t* mBucketKeys = nullptr;
+        const uint32_t* mIndexCounts = nullptr;
+        const uint32_t* mStartIndices = nullptr;
+        const uint64_t* mIndexBufferAddresses = nullptr;
+        const uint32_t* mIndexBufferSizes = nullptr;
+        uint32_t mIndexBufferFormat = 0;
+    };
+
+    // A run of commands sharing a bucket key (e.g. a pipeline), submitted with a single ExecuteIndirect
+    struct IndirectDrawBucket
+    {
+        uint32_t mBucketKey = 0;
+        uint32_t mFirstCommand = 0;
+        uint32_t mNumCommands = 0;
+    };
+
+    class IndirectDrawBuilder
+    {
+    public:
+        // Stable sort of drawIds by bucket key, so draws keep their submission order inside a bucket
+        static void SortByBucket(const IndirectDrawSource& source, std::vector<uint32_t>& drawIds);
+
+        // Writes one command per visible draw to outCommands and splits them into buckets. visibleDrawIds must be sorted
+        // by bucket key. outCommands is only written, in order, so it can point to write-combined upload memory.
+        void Build(const IndirectDrawSource& source, const uint32_t* visibleDrawIds, uint32_t numVisibleDraws, IndirectDrawIndexedCommand* outCommands);
+
+        const std::vector<IndirectDrawBucket>& GetBuckets() const { return mBuckets; }
+
+    private:
+        std::vector<IndirectDrawBucket> mBuckets;
+    };
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+// NOTE: Bump allocator over a byte range, used to sub-allocate the per-frame constant upload buffer. It
+// only hands out offsets, so it has no D3D12 dependency and can be tested on its own. Allocations are lock-free so
+// contexts recording on different threads can share it.
+namespace D3D12Lite
+{
+    class LinearAllocator
+    {
+    public:
+        static constexpr uint64_t INVALID_OFFSET = UINT64_MAX;
+
+        void Reset(uint64_t begin, uint64_t end)
+        {
+            assert(begin <= end);
+
+            mBegin = begin;
+            mEnd = end;
+            mCurrent.store(begin, std::memory_order_relaxed);
+        }
+
+        // Returns the offset of size bytes aligned to alignment (a power of two), or INVALID_OFFSET once the range is exhausted
+        uint64_t Allocate(uint64_t size, uint64_t alignment)
+        {
+            assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+            uint64_t current = mCurrent.load(std::memory_order_relaxed);
+            uint64_t offset = 0;
+
+            do
+            {
+                offset = AlignUp(current, alignment);
+
+                if (offset + size > mEnd)
+                {
+                    return INVALID_OFFSET;
+                }
+            } while (!mCurrent.compare_exchange_weak(current, offset + size, std::memory_order_relaxed));
+
+            UpdatePeak(offset + size - mBegin);
+            return offset;
+        }
+
+        uint64_t GetNumAllocatedBytes() const { return (std::min)(mCurrent.load(std::memory_order_relaxed), mEnd) - mBegin; }
+        uint64_t GetCapacity() const { return mEnd - mBegin; }
+        uint64_t GetPeakAllocatedBytes() const { return mPeakAllocatedBytes.load(std::memory_order_relaxed); }
+
+        static uint64_t AlignUp(uint64_t value, uint64_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+
+    private:
+        void UpdatePeak(uint64_t allocatedBytes)
+        {
+            uint64_t peak = mPeakAllocatedBytes.load(std::memory_order_relaxed);
+            while (allocatedBytes > peak && !mPeakAllocatedBytes.compare_exchange_weak(peak, allocatedBytes, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        uint64_t mBegin = 0;
+        uint64_t mEnd = 0;
+        std::atomic<uint64_t> mCurrent{ 0 };
+        std::atomic<uint64_t> mPeakAllocatedBytes{ 0 };
+    };
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// NOTE: Splitting a pass over several command lists. Everything here is templated on the context type,
+// so the chunking, ordering and pooling can be driven by a mock context that just records the calls it receives.
+// A context type has to provide Reset(), and InheritState(const StateT&) to replay the parent's bindings.
+namespace D3D12Lite
+{
+    struct RecordChunk
+    {
+        uint32_t mFirstItem = 0;
+        uint32_t mNumItems = 0;
+    };
+
+    // Contiguous, in order ranges covering [0, numItems). At most maxChunks of them, none smaller than minItemsPerChunk
+    // unless there are fewer items than that in total, with sizes differing by at most one.
+    inline void SplitIntoChunks(uint32_t numItems, uint32_t maxChunks, uint32_t minItemsPerChunk, std::vector<RecordChunk>& outChunks)
+    {
+        outChunks.clear();
+
+        if (numItems == 0)
+        {
+            return;
+        }
+
+        const uint32_t numChunks = std::clamp(numItems / (std::max)(minItemsPerChunk, 1u), 1u, (std::max)(maxChunks, 1u));
+        const uint32_t baseChunkSize = numItems / numChunks;
+        const uint32_t numLargerChunks = numItems % numChunks;
+
+        uint32_t firstItem = 0;
+        for (uint32_t chunkIndex = 0; chunkIndex < numChunks; chunkIndex++)
+        {
+            RecordChunk& chunk = outChunks.emplace_back();
+            chunk.mFirstItem = firstItem;
+            chunk.mNumItems = baseChunkSize + (chunkIndex < numLargerChunks ? 1 : 0);
+            firstItem += chunk.mNumItems;
+        }
+
+        assert(firstItem == numItems);
+    }
+
+    // Contexts handed out for one frame's worth of recordings. Once a frame's fences have completed its contexts can
+    // be recorded again, so the pool simply rewinds at the beginning of the frame. Not thread safe: contexts are
+    // acquired on the submitting thread before recording fans out.
+    template<typename ContextT>
+    class ContextPool
+    {
+    public:
+        using Factory = std::function<std::unique_ptr<ContextT>()>;
+
+        explicit ContextPool(Factory factory)
+            : mFactory(std::move(factory))
+        {
+        }
+
+        ContextT& Acquire()
+        {
+            if (mNumAcquired == mContexts.size())
+            {
+                mContexts.push_back(mFactory());
+            }
+
+            return *mContexts[mNumAcquired++];
+        }
+
+        void Rewind() { mNumAcquired = 0; }
+
+        uint32_t GetNumAcquired() const { return mNumAcquired; }
+        uint32_t GetNumContexts() const { return static_cast<uint32_t>(mContexts.size()); }
+
+    private:
+        Factory mFactory;
+        std::vector<std::unique_ptr<ContextT>> mContexts;
+        uint32_t mNumAcquired = 0;
+    };
+
+    struct ParallelRecordingStats
+    {
+        uint32_t mNumChunks = 0;
+        uint32_t mNumThreads = 0;
+        double mRecordTimeInMilliseconds = 0.0;
+    };
+
+    template<typename ContextT, typename StateT>
+    class ParallelRecorder
+    {
+    public:
+        ParallelRecorder(ContextPool<ContextT>& contextPool, uint32_t maxThreads, uint32_t minItemsPerChunk)
+            : mContextPool(contextPool)
+            , mMaxThreads((std::max)(maxThreads, 1u))
+            , mMinItemsPerChunk(minItemsPerChunk)
+        {
+        }
+
+        void SetMaxThreads(uint32_t maxThreads) { mMaxThreads = (std::max)(maxThreads, 1u); }
+
+        // Records [0, numItems) as recordChunk(context, firstItem, numItems) calls, one pooled context per chunk. Every
+        // context is reset and inherits state before its chunk is recorded. The first chunk is recorded on the calling
+        // thread. Recording must not touch shared resource states: barriers belong to the parent context.
+        template<typename RecordFunction>
+        void Record(const StateT& state, uint32_t numItems, RecordFunction&& recordChunk)
+        {
+            std::chrono::high_resolution_clock::time_point recordStart = std::chrono::high_resolution_clock::now();
+
+            SplitIntoChunks(numItems, mMaxThreads, mMinItemsPerChunk, mChunks);
+
+            mRecordedContexts.clear();
+            for (size_t chunkIndex = 0; chunkIndex < mChunks.size(); chunkIndex++)
+            {
+                mRecordedContexts.push_back(&mContextPool.Acquire());
+            }
+
+            auto recordChunkInContext = [&](uint32_t chunkIndex)
+            {
+                ContextT& context = *mRecordedContexts[chunkIndex];
+                context.Reset();
+                context.InheritState(state);
+                recordChunk(context, mChunks[chunkIndex].mFirstItem, mChunks[chunkIndex].mNumItems);
+            };
+
+            mWorkers.clear();
+            for (uint32_t chunkIndex = 1; chunkIndex < mChunks.size(); chunkIndex++)
+            {
+                mWorkers.emplace_back(recordChunkInContext, chunkIndex);
+            }
+
+            if (!mChunks.empty())
+            {
+                recordChunkInContext(0);
+            }
+
+            for (std::thread& worker : mWorkers)
+            {
+                worker.join();
+            }
+
+            mStats.mNumChunks = static_cast<uint32_t>(mChunks.size());
+            mStats.mNumThreads = static_cast<uint32_t>(mWorkers.size() + (mChunks.empty() ? 0 : 1));
+            mStats.mRecordTimeInMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
+        }
+
+        // Contexts of the last Record call, in item order. They have to be submitted in this order.
+        const std::vector<ContextT*>& GetRecordedContexts() const { return mRecordedContexts; }
+        const std::vector<RecordChunk>& GetChunks() const { return mChunks; }
+        const ParallelRecordingStats& GetStats() const { return mStats; }
+
+    private:
+        ContextPool<ContextT>& mContextPool;
+        uint32_t mMaxThreads = 1;
+        uint32_t mMinItemsPerChunk = 0;
+        std::vector<RecordChunk> mChunks;
+        std::vector<ContextT*> mRecordedContexts;
+        std::vector<std::thread> mWorkers;
+        ParallelRecordingStats mStats;
+    };
+}
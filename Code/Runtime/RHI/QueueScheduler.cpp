@@ -0,0 +1,236 @@
+#include "QueueScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace D3D12Lite
+{
+    void QueueScheduler::ScheduleSubmission(QueueType queue, uint64_t fenceValue, const QueueDependencies& dependencies, std::vector<QueueWait>& outWaits)
+    {
+        const uint32_t queueIndex = static_cast<uint32_t>(queue);
+        QueueFenceClock& knownFences = mKnownFences[queueIndex];
+
+        assert(queue != QueueType::count);
+        assert(fenceValue > knownFences[queueIndex]);
+
+        QueueFenceClock requiredFences{};
+
+        for (const QueueFence& submission : dependencies.mSubmissions)
+        {
+            RequireFence(requiredFences, submission);
+        }
+
+        for (const QueueResourceAccess& access : dependencies.mAccesses)
+        {
+            auto usageIt = mResourceUsages.find(access.mResource);
+            if (usageIt == mResourceUsages.end())
+            {
+                continue;
+            }
+
+            const ResourceUsage& usage = usageIt->second;
+            RequireFence(requiredFences, usage.mLastWrite);
+
+            if (access.mIsWrite)
+            {
+                for (uint32_t readQueueIndex = 0; readQueueIndex < NUM_QUEUE_TYPES; readQueueIndex++)
+                {
+                    RequireFence(requiredFences, { static_cast<QueueType>(readQueueIndex), usage.mLastReads[readQueueIndex] });
+                }
+            }
+        }
+
+        // Work on the same queue executes in submission order, so only other queues can introduce waits
+        requiredFences[queueIndex] = 0;
+
+        std::array<QueueFenceClock, NUM_QUEUE_TYPES> candidateClocks{};
+        std::array<bool, NUM_QUEUE_TYPES> isCandidate{};
+
+        for (uint32_t otherQueueIndex = 0; otherQueueIndex < NUM_QUEUE_TYPES; otherQueueIndex++)
+        {
+            if (requiredFences[otherQueueIndex] == 0)
+            {
+                continue;
+            }
+
+            mStats.mNumRequiredDependencies++;
+
+            if (requiredFences[otherQueueIndex] <= knownFences[otherQueueIndex])
+            {
+                mStats.mNumElidedWaits++;
+                continue;
+            }
+
+            isCandidate[otherQueueIndex] = true;
+            candidateClocks[otherQueueIndex] = GetClockAtFence({ static_cast<QueueType>(otherQueueIndex), requiredFences[otherQueueIndex] });
+        }
+
+        // A wait is redundant when another wait we are about to insert already implies it transitively
+        // (e.g. compute waited on copy, and graphics now waits on that compute submission).
+        for (uint32_t otherQueueIndex = 0; otherQueueIndex < NUM_QUEUE_TYPES; otherQueueIndex++)
+        {
+            if (!isCandidate[otherQueueIndex])
+            {
+                continue;
+            }
+
+            bool isImplied = false;
+            for (uint32_t coveringQueueIndex = 0; coveringQueueIndex < NUM_QUEUE_TYPES; coveringQueueIndex++)
+            {
+                if (coveringQueueIndex != otherQueueIndex && isCandidate[coveringQueueIndex] &&
+                    candidateClocks[coveringQueueIndex][otherQueueIndex] >= requiredFences[otherQueueIndex])
+                {
+                    isImplied = true;
+                    break;
+                }
+            }
+
+            if (isImplied)
+            {
+                mStats.mNumElidedWaits++;
+                continue;
+            }
+
+            QueueWait& wait = outWaits.emplace_back();
+            wait.mWaitingQueue = queue;
+            wait.mSignalingQueue = static_cast<QueueType>(otherQueueIndex);
+            wait.mFenceValue = requiredFences[otherQueueIndex];
+
+            mStats.mNumEmittedWaits++;
+        }
+
+        for (uint32_t otherQueueIndex = 0; otherQueueIndex < NUM_QUEUE_TYPES; otherQueueIndex++)
+        {
+            if (isCandidate[otherQueueIndex])
+            {
+                MergeClock(knownFences, candidateClocks[otherQueueIndex]);
+            }
+        }
+
+        knownFences[queueIndex] = fenceValue;
+
+        std::deque<SubmissionRecord>& history = mSubmissionHistory[queueIndex];
+        history.push_back({ fenceValue, knownFences });
+        if (history.size() > MAX_SUBMISSION_HISTORY)
+        {
+            history.pop_front();
+        }
+
+        // Reads first, so a resource both read and written by the submission ends up tracked as written
+        for (const QueueResourceAccess& access : dependencies.mAccesses)
+        {
+            if (!access.mIsWrite)
+            {
+                ResourceUsage& usage = mResourceUsages[access.mResource];
+                usage.mLastReads[queueIndex] = fenceValue;
+            }
+        }
+
+        for (const QueueResourceAccess& access : dependencies.mAccesses)
+        {
+            if (access.mIsWrite)
+            {
+                ResourceUsage& usage = mResourceUsages[access.mResource];
+                usage.mLastWrite = { queue, fenceValue };
+                usage.mLastReads.fill(0);
+            }
+        }
+
+        mStats.mNumSubmissions++;
+    }
+
+    void QueueScheduler::NotifyWait(QueueType waitingQueue, QueueFence signal)
+    {
+        if (waitingQueue == signal.mQueue)
+        {
+            return;
+        }
+
+        MergeClock(mKnownFences[static_cast<uint32_t>(waitingQueue)], GetClockAtFence(signal));
+    }
+
+    void QueueScheduler::RetireCompletedFences(const QueueFenceClock& completedFences)
+    {
+        for (QueueFenceClock& knownFences : mKnownFences)
+        {
+            MergeClock(knownFences, completedFences);
+        }
+
+        for (uint32_t queueIndex = 0; queueIndex < NUM_QUEUE_TYPES; queueIndex++)
+        {
+            std::deque<SubmissionRecord>& history = mSubmissionHistory[queueIndex];
+            while (!history.empty() && history.front().mFenceValue <= completedFences[queueIndex])
+            {
+                history.pop_front();
+            }
+        }
+
+        for (auto usageIt = mResourceUsages.begin(); usageIt != mResourceUsages.end();)
+        {
+            ResourceUsage& usage = usageIt->second;
+            bool isPending = false;
+
+            if (usage.mLastWrite.mFenceValue <= completedFences[static_cast<uint32_t>(usage.mLastWrite.mQueue)])
+            {
+                usage.mLastWrite.mFenceValue = 0;
+            }
+
+            isPending |= usage.mLastWrite.mFenceValue != 0;
+
+            for (uint32_t queueIndex = 0; queueIndex < NUM_QUEUE_TYPES; queueIndex++)
+            {
+                if (usage.mLastReads[queueIndex] <= completedFences[queueIndex])
+                {
+                    usage.mLastReads[queueIndex] = 0;
+                }
+
+                isPending |= usage.mLastReads[queueIndex] != 0;
+            }
+
+            usageIt = isPending ? std::next(usageIt) : mResourceUsages.erase(usageIt);
+        }
+    }
+
+    void QueueScheduler::ForgetResource(const void* resource)
+    {
+        mResourceUsages.erase(resource);
+    }
+
+    void QueueScheduler::RequireFence(QueueFenceClock& requiredFences, QueueFence fence) const
+    {
+        if (fence.mFenceValue == 0)
+        {
+            return;
+        }
+
+        uint64_t& requiredFence = requiredFences[static_cast<uint32_t>(fence.mQueue)];
+        requiredFence = (std::max)(requiredFence, fence.mFenceValue);
+    }
+
+    QueueFenceClock QueueScheduler::GetClockAtFence(QueueFence fence) const
+    {
+        const std::deque<SubmissionRecord>& history = mSubmissionHistory[static_cast<uint32_t>(fence.mQueue)];
+
+        // Waiting on a fence only guarantees what was known by the last submission at or before it
+        auto recordIt = std::upper_bound(history.begin(), history.end(), fence.mFenceValue,
+            [](uint64_t fenceValue, const SubmissionRecord& record) { return fenceValue < record.mFenceValue; });
+
+        QueueFenceClock clock{};
+        if (recordIt != history.begin())
+        {
+            clock = std::prev(recordIt)->mKnownFences;
+        }
+
+        // Records that fell out of the history only lose the transitive part, which is conservative
+        clock[static_cast<uint32_t>(fence.mQueue)] = fence.mFenceValue;
+        return clock;
+    }
+
+    void QueueScheduler::MergeClock(QueueFenceClock& clock, const QueueFenceClock& otherClock) const
+    {
+        for (uint32_t queueIndex = 0; queueIndex < NUM_QUEUE_TYPES; queueIndex++)
+        {
+            clock[queueIndex] = (std::max)(clock[queueIndex], otherClock[queueIndex]);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+// NOTE: Cross-queue dependency planning. This file deliberately has no D3D12 dependency: the scheduler only
+// reasons about queues and monotonically increasing fence values, so it can be driven by the Device with real fences or
+// by a test harness with simulated ones.
+namespace D3D12Lite
+{
+    enum class QueueType : uint8_t
+    {
+        graphics = 0,
+        compute,
+        copy,
+        count
+    };
+
+    constexpr uint32_t NUM_QUEUE_TYPES = static_cast<uint32_t>(QueueType::count);
+
+    using QueueFenceClock = std::array<uint64_t, NUM_QUEUE_TYPES>;
+
+    constexpr uint8_t GetQueueMask(QueueType queue) { return static_cast<uint8_t>(1u << static_cast<uint32_t>(queue)); }
+
+    struct QueueFence
+    {
+        QueueType mQueue = QueueType::graphics;
+        uint64_t mFenceValue = 0;
+    };
+
+    struct QueueWait
+    {
+        QueueType mWaitingQueue = QueueType::graphics;
+        QueueType mSignalingQueue = QueueType::graphics;
+        uint64_t mFenceValue = 0;
+    };
+
+    struct QueueResourceAccess
+    {
+        const void* mResource = nullptr;
+        bool mIsWrite = false;
+    };
+
+    // A node of the submission DAG. Edges are either implied by resource accesses (read after write, write after read/write)
+    // or given explicitly as fences of earlier submissions.
+    struct QueueDependencies
+    {
+        std::vector<QueueResourceAccess> mAccesses;
+        std::vector<QueueFence> mSubmissions;
+
+        void Read(const void* resource) { mAccesses.push_back({ resource, false }); }
+        void Write(const void* resource) { mAccesses.push_back({ resource, true }); }
+        void Clear() { mAccesses.clear(); mSubmissions.clear(); }
+    };
+
+    struct QueueSchedulerStats
+    {
+        uint32_t mNumSubmissions = 0;
+        uint32_t mNumRequiredDependencies = 0;
+        uint32_t mNumEmittedWaits = 0;
+        uint32_t mNumElidedWaits = 0;
+    };
+
+    class QueueScheduler
+    {
+    public:
+        // Plans the waits that queue has to insert before executing the submission that will signal fenceValue.
+        // Only waits that are not already implied by what the queue has previously waited on are emitted.
+        void ScheduleSubmission(QueueType queue, uint64_t fenceValue, const QueueDependencies& dependencies, std::vector<QueueWait>& outWaits);
+
+        // Records a wait inserted outside the scheduler, so later submissions can take it into account.
+        void NotifyWait(QueueType waitingQueue, QueueFence signal);
+
+        // Drops the tracking of work the GPU has completed; a wait on a reached fence is a no-op, so forgetting it is safe.
+        void RetireCompletedFences(const QueueFenceClock& completedFences);
+        void ForgetResource(const void* resource);
+
+        const QueueFenceClock& GetKnownFences(QueueType queue) const { return mKnownFences[static_cast<uint32_t>(queue)]; }
+        const QueueSchedulerStats& GetStats() const { return mStats; }
+        void ResetStats() { mStats = QueueSchedulerStats{}; }
+
+    private:
+        struct ResourceUsage
+        {
+            QueueFence mLastWrite;
+            QueueFenceClock mLastReads{};
+        };
+
+        struct SubmissionRecord
+        {
+            uint64_t mFenceValue = 0;
+            QueueFenceClock mKnownFences{};
+        };
+
+        static constexpr uint32_t MAX_SUBMISSION_HISTORY = 64;
+
+        void RequireFence(QueueFenceClock& requiredFences, QueueFence fence) const;
+        QueueFenceClock GetClockAtFence(QueueFence fence) const;
+        void MergeClock(QueueFenceClock& clock, const QueueFenceClock& otherClock) const;
+
+        std::array<QueueFenceClock, NUM_QUEUE_TYPES> mKnownFences{};
+        std::array<std::deque<SubmissionRecord>, NUM_QUEUE_TYPES> mSubmissionHistory;
+        std::unordered_map<const void*, ResourceUsage> mResourceUsages;
+        QueueSchedulerStats mStats;
+    };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+// NOTE: 32 bit handles into the Device resource pools. The low bits address a slot, the high bits
+// hold the generation the slot had when the handle was created, so a handle outliving its resource is detected
+// instead of silently aliasing whatever got allocated in the same slot afterwards.
+namespace D3D12Lite
+{
+    template<typename T>
+    class ResourceHandle
+    {
+    public:
+        static constexpr uint32_t INDEX_BITS = 20;
+        static constexpr uint32_t GENERATION_BITS = 32 - INDEX_BITS;
+        static constexpr uint32_t MAX_INDEX = (1u << INDEX_BITS) - 1;
+        static constexpr uint32_t MAX_GENERATION = (1u << GENERATION_BITS) - 1;
+
+        ResourceHandle() = default;
+
+        ResourceHandle(uint32_t index, uint32_t generation)
+            : mValue((generation << INDEX_BITS) | index)
+        {
+            // Generation 0 is never handed out, which keeps the all zero handle invalid
+            assert(index <= MAX_INDEX);
+            assert(generation > 0 && generation <= MAX_GENERATION);
+        }
+
+        bool IsValid() const { return mValue != 0; }
+        uint32_t GetIndex() const { return mValue & MAX_INDEX; }
+        uint32_t GetGeneration() const { return mValue >> INDEX_BITS; }
+        uint32_t GetValue() const { return mValue; }
+
+        bool operator==(const ResourceHandle& other) const { return mValue == other.mValue; }
+        bool operator!=(const ResourceHandle& other) const { return mValue != other.mValue; }
+
+    private:
+        uint32_t mValue = 0;
+    };
+
+    struct BufferResource;
+    struct TextureResource;
+
+    using BufferHandle = ResourceHandle<BufferResource>;
+    using TextureHandle = ResourceHandle<TextureResource>;
+}
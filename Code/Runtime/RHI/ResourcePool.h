@@ -0,0 +1,147 @@
+#pragma once
+
+#include "ResourceHandle.h"
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// NOTE: Generational slot pool. Slot metadata and the hot per-resource data the renderer reads every draw
+// (HotT) are kept in flat arrays indexed by slot, while the full resource objects (T) live in fixed size chunks so the
+// references handed out to contexts stay valid while the pool grows. Freed slots are recycled through a free list, so
+// after warm-up creating a resource doesn't allocate.
+namespace D3D12Lite
+{
+    template<typename T, typename HotT>
+    class ResourcePool
+    {
+    public:
+        using Handle = ResourceHandle<T>;
+
+        static constexpr uint32_t CHUNK_SIZE = 256;
+
+        Handle Allocate()
+        {
+            uint32_t index = 0;
+
+            if (!mFreeSlots.empty())
+            {
+                index = mFreeSlots.back();
+                mFreeSlots.pop_back();
+            }
+            else
+            {
+                index = static_cast<uint32_t>(mGenerations.size());
+                assert(index <= Handle::MAX_INDEX);
+
+                if (index % CHUNK_SIZE == 0)
+                {
+                    mChunks.push_back(std::make_unique<T[]>(CHUNK_SIZE));
+                }
+
+                mGenerations.push_back(1);
+                mIsAlive.push_back(false);
+                mHotData.emplace_back();
+            }
+
+            assert(!mIsAlive[index]);
+
+            ResetSlot(index);
+            mHotData[index] = HotT{};
+            mIsAlive[index] = true;
+            mNumAlive++;
+
+            return Handle(index, mGenerations[index]);
+        }
+
+        void Free(Handle handle)
+        {
+            assert(IsValid(handle));
+
+            const uint32_t index = handle.GetIndex();
+
+            // Skip generation 0 on wrap-around, it would make the next handle for this slot look invalid
+            uint32_t& generation = mGenerations[index];
+            generation = generation == Handle::MAX_GENERATION ? 1 : generation + 1;
+
+            ResetSlot(index);
+            mIsAlive[index] = false;
+            mNumAlive--;
+
+            mFreeSlots.push_back(index);
+        }
+
+        bool IsValid(Handle handle) const
+        {
+            const uint32_t index = handle.GetIndex();
+
+            return handle.IsValid() && index < mGenerations.size() && mIsAlive[index] && mGenerations[index] == handle.GetGeneration();
+        }
+
+        T& Get(Handle handle)
+        {
+            assert(IsValid(handle));
+            return GetSlot(handle.GetIndex());
+        }
+
+        const T& Get(Handle handle) const
+        {
+            assert(IsValid(handle));
+            return mChunks[handle.GetIndex() / CHUNK_SIZE][handle.GetIndex() % CHUNK_SIZE];
+        }
+
+        T* TryGet(Handle handle)
+        {
+            return IsValid(handle) ? &GetSlot(handle.GetIndex()) : nullptr;
+        }
+
+        HotT& GetHotData(Handle handle)
+        {
+            assert(IsValid(handle));
+            return mHotData[handle.GetIndex()];
+        }
+
+        const HotT& GetHotData(Handle handle) const
+        {
+            assert(IsValid(handle));
+            return mHotData[handle.GetIndex()];
+        }
+
+        // Visits every live resource in slot order
+        template<typename Function>
+        void ForEach(Function&& function)
+        {
+            const uint32_t numSlots = static_cast<uint32_t>(mGenerations.size());
+            for (uint32_t index = 0; index < numSlots; index++)
+            {
+                if (mIsAlive[index])
+                {
+                    function(Handle(index, mGenerations[index]), GetSlot(index), mHotData[index]);
+                }
+            }
+        }
+
+        uint32_t GetNumAlive() const { return mNumAlive; }
+        uint32_t GetNumSlots() const { return static_cast<uint32_t>(mGenerations.size()); }
+
+    private:
+        T& GetSlot(uint32_t index) { return mChunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+
+        // Rebuilt in place rather than assigned, so T may hold members that can't be copied or moved (e.g. atomics)
+        void ResetSlot(uint32_t index)
+        {
+            T* slot = &GetSlot(index);
+            slot->~T();
+            new (slot) T();
+        }
+
+        std::vector<std::unique_ptr<T[]>> mChunks;
+        std::vector<uint32_t> mGenerations;
+        std::vector<bool> mIsAlive;
+        std::vector<HotT> mHotData;
+        std::vector<uint32_t> mFreeSlots;
+        uint32_t mNumAlive = 0;
+    };
+}
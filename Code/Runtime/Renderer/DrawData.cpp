@@ -0,0 +1,231 @@
+#include "DrawData.h"
+#include "RHI/D3D12Lite.h"
+
+#include <cassert>
+#include <cmath>
+#include <emmintrin.h>
+#include <xmmintrin.h>
+
+namespace Styx
+{
+	uint32_t DrawList::AddTransform(const Transform& transform)
+	{
+		transforms.push_back(transform.worldMatrix);
+		return GetNumTransforms() - 1;
+	}
+
+	uint32_t DrawList::AddDraw(D3D12Lite::Device* device, const Mesh& mesh, uint32_t transformIndex, uint32_t materialIndex)
+	{
+		assert(transformIndex < GetNumTransforms());
+
+		transformIndices.push_back(transformIndex);
+		materialIndices.push_back(materialIndex);
+
+		// NOTE: Draws are bucketed by material until materials map to their own pipelines
+		bucketKeys.push_back(materialIndex);
+
+		const uint32_t drawIndex = GetNumDraws() - 1;
+		vertexOffsets.resize(drawIndex + 1);
+		positionBufferIndices.resize(drawIndex + 1);
+		normalBufferIndices.resize(drawIndex + 1);
+		tangentBufferIndices.resize(drawIndex + 1);
+		uvBufferIndices.resize(drawIndex + 1);
+		indexCounts.resize(drawIndex + 1);
+		indexOffsets.resize(drawIndex + 1);
+		indexBuffers.resize(drawIndex + 1);
+		indexBufferAddresses.resize(drawIndex + 1);
+		indexBufferSizes.resize(drawIndex + 1);
+		localBoundsCenters.resize(drawIndex + 1);
+		localBoundsExtents.resize(drawIndex + 1);
+		worldBoundsCenters.resize(drawIndex + 1);
+		worldBoundsExtents.resize(drawIndex + 1);
+
+		SetDrawMesh(device, drawIndex, mesh);
+
+		return drawIndex;
+	}
+
+	void DrawList::SetDrawMesh(D3D12Lite::Device* device, uint32_t drawIndex, const Mesh& mesh)
+	{
+		assert(drawIndex < GetNumDraws());
+
+		// Descriptor indices don't change while the mesh is alive, so they are resolved once here rather than per frame
+		auto getDescriptorHeapIndex = [device](D3D12Lite::BufferHandle buffer)
+		{
+			return device->IsValid(buffer) ? device->GetDescriptorHeapIndex(buffer) : D3D12Lite::INVALID_RESOURCE_TABLE_INDEX;
+		};
+
+		vertexOffsets[drawIndex] = mesh.vertexOffset;
+		positionBufferIndices[drawIndex] = getDescriptorHeapIndex(mesh.positionBuffer);
+		normalBufferIndices[drawIndex] = getDescriptorHeapIndex(mesh.normalBuffer);
+		tangentBufferIndices[drawIndex] = getDescriptorHeapIndex(mesh.tangentBuffer);
+		uvBufferIndices[drawIndex] = getDescriptorHeapIndex(mesh.uvBuffer);
+
+		indexCounts[drawIndex] = mesh.indexCount;
+		indexOffsets[drawIndex] = mesh.indexOffset;
+		indexBuffers[drawIndex] = mesh.indexBuffer;
+		indexBufferAddresses[drawIndex] = device->GetVirtualAddress(mesh.indexBuffer);
+		indexBufferSizes[drawIndex] = static_cast<uint32_t>(device->GetBuffer(mesh.indexBuffer).mDesc.Width);
+
+		localBoundsCenters[drawIndex] = mesh.boundsCenter;
+		localBoundsExtents[drawIndex] = mesh.boundsExtents;
+		UpdateWorldBounds(drawIndex, 1);
+	}
+
+	void DrawList::UpdateWorldBounds(uint32_t firstDraw, uint32_t numDraws)
+	{
+		assert(firstDraw + numDraws <= GetNumDraws());
+
+		for (uint32_t drawIndex = firstDraw; drawIndex < firstDraw + numDraws; drawIndex++)
+		{
+			const DirectX::XMFLOAT4X4& m = transforms[transformIndices[drawIndex]];
+			const DirectX::XMFLOAT3& c = localBoundsCenters[drawIndex];
+			const DirectX::XMFLOAT3& e = localBoundsExtents[drawIndex];
+
+			// Row vectors: the center goes through the full transform, the extents through the absolute rotation/scale
+			worldBoundsCenters[drawIndex] = DirectX::XMFLOAT3(
+				c.x * m.m[0][0] + c.y * m.m[1][0] + c.z * m.m[2][0] + m.m[3][0],
+				c.x * m.m[0][1] + c.y * m.m[1][1] + c.z * m.m[2][1] + m.m[3][1],
+				c.x * m.m[0][2] + c.y * m.m[1][2] + c.z * m.m[2][2] + m.m[3][2]);
+			worldBoundsExtents[drawIndex] = DirectX::XMFLOAT3(
+				e.x * fabsf(m.m[0][0]) + e.y * fabsf(m.m[1][0]) + e.z * fabsf(m.m[2][0]),
+				e.x * fabsf(m.m[0][1]) + e.y * fabsf(m.m[1][1]) + e.z * fabsf(m.m[2][1]),
+				e.x * fabsf(m.m[0][2]) + e.y * fabsf(m.m[1][2]) + e.z * fabsf(m.m[2][2]));
+		}
+	}
+
+	void DrawList::Clear()
+	{
+		transformIndices.clear();
+		vertexOffsets.clear();
+		positionBufferIndices.clear();
+		normalBufferIndices.clear();
+		tangentBufferIndices.clear();
+		uvBufferIndices.clear();
+		materialIndices.clear();
+		bucketKeys.clear();
+		indexCounts.clear();
+		indexOffsets.clear();
+		indexBuffers.clear();
+		indexBufferAddresses.clear();
+		indexBufferSizes.clear();
+		localBoundsCenters.clear();
+		localBoundsExtents.clear();
+		worldBoundsCenters.clear();
+		worldBoundsExtents.clear();
+		transforms.clear();
+	}
+
+	D3D12Lite::IndirectDrawSource DrawList::GetIndirectDrawSource() const
+	{
+		D3D12Lite::IndirectDrawSource source;
+		source.mBucketKeys = bucketKeys.data();
+		source.mIndexCounts = indexCounts.data();
+		source.mStartIndices = indexOffsets.data();
+		source.mIndexBufferAddresses = indexBufferAddresses.data();
+		source.mIndexBufferSizes = indexBufferSizes.data();
+		source.mIndexBufferFormat = DXGI_FORMAT_R32_UINT;
+
+		return source;
+	}
+
+	void PackDrawData(const DrawList& drawList, uint32_t firstDraw, uint32_t numDraws, PerDrawData* outDrawData)
+	{
+		assert(firstDraw + numDraws <= drawList.GetNumDraws());
+		assert((reinterpret_cast<uintptr_t>(outDrawData) & 15) == 0);
+
+		const uint32_t* transformIndices = drawList.transformIndices.data();
+		const uint32_t* vertexOffsets = drawList.vertexOffsets.data();
+		const uint32_t* positionBufferIndices = drawList.positionBufferIndices.data();
+		const uint32_t* normalBufferIndices = drawList.normalBufferIndices.data();
+		const uint32_t* tangentBufferIndices = drawList.tangentBufferIndices.data();
+		const uint32_t* uvBufferIndices = drawList.uvBufferIndices.data();
+		const uint32_t* materialIndices = drawList.materialIndices.data();
+
+		const uint32_t endDraw = firstDraw + numDraws;
+		uint32_t drawIndex = firstDraw;
+
+		// Four draws at a time: load 4 values of 8 fields, transpose the two 4x4 blocks and store each draw as two
+		// 16 byte halves. Every load and store is a full vector, and the destination is written strictly in order.
+		for (; drawIndex + 4 <= endDraw; drawIndex += 4)
+		{
+			__m128 lowHalf0 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(transformIndices + drawIndex)));
+			__m128 lowHalf1 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(vertexOffsets + drawIndex)));
+			__m128 lowHalf2 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(positionBufferIndices + drawIndex)));
+			__m128 lowHalf3 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(normalBufferIndices + drawIndex)));
+			_MM_TRANSPOSE4_PS(lowHalf0, lowHalf1, lowHalf2, lowHalf3);
+
+			__m128 highHalf0 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tangentBufferIndices + drawIndex)));
+			__m128 highHalf1 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uvBufferIndices + drawIndex)));
+			__m128 highHalf2 = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(materialIndices + drawIndex)));
+			__m128 highHalf3 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(highHalf0, highHalf1, highHalf2, highHalf3);
+
+			float* destination = reinterpret_cast<float*>(outDrawData + drawIndex);
+			_mm_store_ps(destination + 0, lowHalf0);
+			_mm_store_ps(destination + 4, highHalf0);
+			_mm_store_ps(destination + 8, lowHalf1);
+			_mm_store_ps(destination + 12, highHalf1);
+			_mm_store_ps(destination + 16, lowHalf2);
+			_mm_store_ps(destination + 20, highHalf2);
+			_mm_store_ps(destination + 24, lowHalf3);
+			_mm_store_ps(destination + 28, highHalf3);
+		}
+
+		for (; drawIndex < endDraw; drawIndex++)
+		{
+			PerDrawData drawData;
+			drawData.transformIndex = transformIndices[drawIndex];
+			drawData.vertexOffset = vertexOffsets[drawIndex];
+			drawData.positionBufferIndex = positionBufferIndices[drawIndex];
+			drawData.normalBufferIndex = normalBufferIndices[drawIndex];
+			drawData.tangentBufferIndex = tangentBufferIndices[drawIndex];
+			drawData.uvBufferIndex = uvBufferIndices[drawIndex];
+			drawData.materialIndex = materialIndices[drawIndex];
+			drawData.padding = 0;
+
+			outDrawData[drawIndex] = drawData;
+		}
+	}
+
+	void CullDraws(const DrawList& drawList, const DirectX::XMFLOAT4X4& viewProjection, std::vector<uint32_t>& outVisibleDrawIds)
+	{
+		outVisibleDrawIds.clear();
+
+		// Frustum planes from the columns of the view projection matrix, pointing inwards: left, right, bottom, top, near, far
+		const DirectX::XMFLOAT4X4& m = viewProjection;
+		const float planes[6][4] =
+		{
+			{ m.m[0][3] + m.m[0][0], m.m[1][3] + m.m[1][0], m.m[2][3] + m.m[2][0], m.m[3][3] + m.m[3][0] },
+			{ m.m[0][3] - m.m[0][0], m.m[1][3] - m.m[1][0], m.m[2][3] - m.m[2][0], m.m[3][3] - m.m[3][0] },
+			{ m.m[0][3] + m.m[0][1], m.m[1][3] + m.m[1][1], m.m[2][3] + m.m[2][1], m.m[3][3] + m.m[3][1] },
+			{ m.m[0][3] - m.m[0][1], m.m[1][3] - m.m[1][1], m.m[2][3] - m.m[2][1], m.m[3][3] - m.m[3][1] },
+			{ m.m[0][2], m.m[1][2], m.m[2][2], m.m[3][2] },
+			{ m.m[0][3] - m.m[0][2], m.m[1][3] - m.m[1][2], m.m[2][3] - m.m[2][2], m.m[3][3] - m.m[3][2] },
+		};
+
+		const uint32_t numDraws = drawList.GetNumDraws();
+		const DirectX::XMFLOAT3* centers = drawList.worldBoundsCenters.data();
+		const DirectX::XMFLOAT3* extents = drawList.worldBoundsExtents.data();
+
+		for (uint32_t drawIndex = 0; drawIndex < numDraws; drawIndex++)
+		{
+			const DirectX::XMFLOAT3& c = centers[drawIndex];
+			const DirectX::XMFLOAT3& e = extents[drawIndex];
+
+			bool isVisible = true;
+			for (uint32_t planeIndex = 0; planeIndex < 6 && isVisible; planeIndex++)
+			{
+				const float* plane = planes[planeIndex];
+				const float distance = plane[0] * c.x + plane[1] * c.y + plane[2] * c.z + plane[3];
+				const float radius = fabsf(plane[0]) * e.x + fabsf(plane[1]) * e.y + fabsf(plane[2]) * e.z;
+				isVisible = distance + radius >= 0.0f;
+			}
+
+			if (isVisible)
+			{
+				outVisibleDrawIds.push_back(drawIndex);
+			}
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "RendererTypes.h"
+#include "RHI/IndirectDrawBuilder.h"
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+namespace D3D12Lite
+{
+	class Device;
+}
+
+namespace Styx
+{
+	// NOTE: Must match PerDrawData in Common.hlsl. Two 16 byte halves, so it can be written with aligned SIMD stores.
+	struct alignas(16) PerDrawData
+	{
+		uint32_t transformIndex;
+		uint32_t vertexOffset;
+		uint32_t positionBufferIndex;
+		uint32_t normalBufferIndex;
+		uint32_t tangentBufferIndex;
+		uint32_t uvBufferIndex;
+		uint32_t materialIndex;
+		uint32_t padding;
+	};
+
+	static_assert(sizeof(PerDrawData) == 32, "PerDrawData layout must match Common.hlsl");
+
+	// NOTE: Draws are stored one array per field, so packing them into PerDrawData is a straight interleave
+	// of contiguous streams that never touches the Mesh objects or the resource pools.
+	struct DrawList
+	{
+		std::vector<uint32_t> transformIndices;
+		std::vector<uint32_t> vertexOffsets;
+		std::vector<uint32_t> positionBufferIndices;
+		std::vector<uint32_t> normalBufferIndices;
+		std::vector<uint32_t> tangentBufferIndices;
+		std::vector<uint32_t> uvBufferIndices;
+		std::vector<uint32_t> materialIndices;
+
+		// Only needed to issue the draws
+		std::vector<uint32_t> bucketKeys;
+		std::vector<uint32_t> indexCounts;
+		std::vector<uint32_t> indexOffsets;
+		std::vector<D3D12Lite::BufferHandle> indexBuffers;
+		std::vector<uint64_t> indexBufferAddresses;
+		std::vector<uint32_t> indexBufferSizes;
+
+		// Only needed to cull the draws. World bounds follow the transforms, see UpdateWorldBounds.
+		std::vector<DirectX::XMFLOAT3> localBoundsCenters;
+		std::vector<DirectX::XMFLOAT3> localBoundsExtents;
+		std::vector<DirectX::XMFLOAT3> worldBoundsCenters;
+		std::vector<DirectX::XMFLOAT3> worldBoundsExtents;
+
+		std::vector<DirectX::XMFLOAT4X4> transforms;
+
+		uint32_t AddTransform(const Transform& transform);
+		uint32_t AddDraw(D3D12Lite::Device* device, const Mesh& mesh, uint32_t transformIndex, uint32_t materialIndex);
+		// Points an existing draw to another mesh, or to the same mesh after its buffers were recreated
+		void SetDrawMesh(D3D12Lite::Device* device, uint32_t drawIndex, const Mesh& mesh);
+		// Recomputes the world bounds of draws [firstDraw, firstDraw + numDraws) from their transforms
+		void UpdateWorldBounds(uint32_t firstDraw, uint32_t numDraws);
+		void Clear();
+
+		D3D12Lite::IndirectDrawSource GetIndirectDrawSource() const;
+
+		uint32_t GetNumDraws() const { return static_cast<uint32_t>(transformIndices.size()); }
+		uint32_t GetNumTransforms() const { return static_cast<uint32_t>(transforms.size()); }
+	};
+
+	// Packs draws [firstDraw, firstDraw + numDraws) into outDrawData[firstDraw...]. Ranges don't overlap, so the list
+	// can be split across threads. outDrawData may point to write-combined upload memory: it is only ever written.
+	void PackDrawData(const DrawList& drawList, uint32_t firstDraw, uint32_t numDraws, PerDrawData* outDrawData);
+
+	// Writes the IDs of the draws whose world bounds intersect the view frustum to outVisibleDrawIds, in draw order.
+	// viewProjection follows the DirectXMath row vector convention with a [0, 1] depth range.
+	void CullDraws(const DrawList& drawList, const DirectX::XMFLOAT4X4& viewProjection, std::vector<uint32_t>& outVisibleDrawIds);
+}
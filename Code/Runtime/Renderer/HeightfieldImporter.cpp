@@ -0,0 +1,353 @@
+#include "HeightfieldImporter.h"
+#include "HeightmapReader.h"
+#include "TerrainSurfaceMaps.h"
+#include "TerrainTileFile.h"
+#include "Core/JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STYX_HEIGHTFIELD_IMPORT_SSE2 1
+#endif
+
+namespace Styx
+{
+	namespace
+	{
+		FILE* OpenFile(const char* path, const char* mode)
+		{
+			FILE* file = nullptr;
+#if defined(_WIN32)
+			fopen_s(&file, path, mode);
+#else
+			file = fopen(path, mode);
+#endif
+			return file;
+		}
+
+		// What the jobs building the tiles of a band share
+		struct BandContext
+		{
+			// The last numRingRows rows read, row y at (y % numRingRows) * width
+			const uint16_t* rows = nullptr;
+			uint32_t numRingRows = 0;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t tileSize = 0;
+			uint32_t numMips = 0;
+			uint32_t tileStride = 0;
+			uint32_t tileY = 0;
+			// Turns a difference of heights two texels apart into a slope
+			float normalScale = 0.0f;
+			uint8_t* tiles = nullptr;
+			// scratchSize floats per thread
+			float* scratch = nullptr;
+			size_t scratchSize = 0;
+		};
+
+		// The tile's mip 0 heights with a one texel border, as floats, then two mips and a row to filter them with
+		size_t GetScratchSize(uint32_t tileSize)
+		{
+			const size_t gatherSize = tileSize + 3;
+			const size_t mipSize = tileSize / 2 + 1;
+			return gatherSize * gatherSize + 2 * mipSize * mipSize + tileSize + 1;
+		}
+
+		// Copies a size x size block of heights with its top left corner at x, y. Heights outside the heightmap repeat
+		// its edges.
+		void GatherHeights(const BandContext& context, int32_t x, int32_t y, uint32_t size, float* outHeights)
+		{
+			const int32_t maxX = static_cast<int32_t>(context.width) - 1;
+			const int32_t maxY = static_cast<int32_t>(context.height) - 1;
+			for (uint32_t row = 0; row < size; row++)
+			{
+				const uint32_t rowY = static_cast<uint32_t>((std::min)((std::max)(y + static_cast<int32_t>(row), 0), maxY));
+				const uint16_t* heights = context.rows + static_cast<size_t>(rowY % context.numRingRows) * context.width;
+				float* out = outHeights + static_cast<size_t>(row) * size;
+
+				uint32_t column = 0;
+				for (; column < size && x + static_cast<int32_t>(column) < 0; column++)
+				{
+					out[column] = heights[0];
+				}
+
+				const uint32_t end = static_cast<uint32_t>((std::max)((std::min)(maxX + 1 - x, static_cast<int32_t>(size)), static_cast<int32_t>(column)));
+#if STYX_HEIGHTFIELD_IMPORT_SSE2
+				const __m128i zero = _mm_setzero_si128();
+				for (; column + 8 <= end; column += 8)
+				{
+					const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(heights + x + column));
+					_mm_storeu_ps(out + column, _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, zero)));
+					_mm_storeu_ps(out + column + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(packed, zero)));
+				}
+#endif
+				for (; column < end; column++)
+				{
+					out[column] = heights[x + static_cast<int32_t>(column)];
+				}
+
+				for (; column < size; column++)
+				{
+					out[column] = heights[maxX];
+				}
+			}
+		}
+
+		// out[x] = (a[x] + 2 b[x] + c[x]) / 4
+		void FilterVertically(const float* a, const float* b, const float* c, uint32_t size, float* out)
+		{
+			uint32_t x = 0;
+#if STYX_HEIGHTFIELD_IMPORT_SSE2
+			const __m128 quarter = _mm_set1_ps(0.25f);
+			for (; x + 4 <= size; x += 4)
+			{
+				const __m128 center = _mm_loadu_ps(b + x);
+				const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a + x), _mm_loadu_ps(c + x)), _mm_add_ps(center, center));
+				_mm_storeu_ps(out + x, _mm_mul_ps(sum, quarter));
+			}
+#endif
+			for (; x < size; x++)
+			{
+				out[x] = ((a[x] + c[x]) + (b[x] + b[x])) * 0.25f;
+			}
+		}
+
+		// out[i] = (row[2i - 1] + 2 row[2i] + row[2i + 1]) / 4 for i in [1, outSize - 1), the end texels are copied
+		void FilterHorizontally(const float* row, uint32_t outSize, float* out)
+		{
+			const uint32_t last = outSize - 1;
+			out[0] = row[0];
+			out[last] = row[2 * last];
+
+			uint32_t i = 1;
+#if STYX_HEIGHTFIELD_IMPORT_SSE2
+			const __m128 quarter = _mm_set1_ps(0.25f);
+			for (; i + 4 <= last; i += 4)
+			{
+				// Even texels 2i.. and the odd texels on either side of them
+				const __m128 low = _mm_loadu_ps(row + 2 * i);
+				const __m128 high = _mm_loadu_ps(row + 2 * i + 4);
+				const __m128 center = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+				const __m128 right = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+				const __m128 left = _mm_shuffle_ps(_mm_loadu_ps(row + 2 * i - 2), _mm_loadu_ps(row + 2 * i + 2), _MM_SHUFFLE(3, 1, 3, 1));
+				const __m128 sum = _mm_add_ps(_mm_add_ps(left, right), _mm_add_ps(center, center));
+				_mm_storeu_ps(out + i, _mm_mul_ps(sum, quarter));
+			}
+#endif
+			for (; i < last; i++)
+			{
+				const float center = row[2 * i];
+				out[i] = ((row[2 * i - 1] + row[2 * i + 1]) + (center + center)) * 0.25f;
+			}
+		}
+
+		// Halves a (2 k + 1)^2 mip into a (k + 1)^2 one. Interior texels get the 3x3 tent, edge texels the tent along
+		// their edge only and corners are kept, so what lands on a tile's edge only depends on the edge.
+		void DownsampleMip(const float* mip, uint32_t stride, uint32_t size, float* row, float* outMip)
+		{
+			const uint32_t outSize = size / 2 + 1;
+			for (uint32_t y = 0; y < outSize; y++)
+			{
+				const float* center = mip + static_cast<size_t>(2 * y) * stride;
+				const float* filtered = center;
+				if (y > 0 && y < outSize - 1)
+				{
+					FilterVertically(center - stride, center, center + stride, size, row);
+					filtered = row;
+				}
+
+				FilterHorizontally(filtered, outSize, outMip + static_cast<size_t>(y) * outSize);
+			}
+		}
+
+		void StoreHeights(const float* heights, uint32_t stride, uint32_t size, uint16_t* outHeights)
+		{
+			for (uint32_t y = 0; y < size; y++)
+			{
+				const float* in = heights + static_cast<size_t>(y) * stride;
+				uint16_t* out = outHeights + static_cast<size_t>(y) * size;
+
+				uint32_t x = 0;
+#if STYX_HEIGHTFIELD_IMPORT_SSE2
+				// SSE2 only packs to signed 16 bit integers, so the heights are moved down into their range and back
+				const __m128 half = _mm_set1_ps(0.5f);
+				const __m128i bias = _mm_set1_epi32(32768);
+				const __m128i signBit = _mm_set1_epi16(static_cast<short>(0x8000));
+				for (; x + 8 <= size; x += 8)
+				{
+					const __m128i low = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(in + x), half)), bias);
+					const __m128i high = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(in + x + 4), half)), bias);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_xor_si128(_mm_packs_epi32(low, high), signBit));
+				}
+#endif
+				for (; x < size; x++)
+				{
+					out[x] = static_cast<uint16_t>(static_cast<int32_t>(in[x] + 0.5f));
+				}
+			}
+		}
+
+		void BuildTile(const BandContext& context, uint32_t tileX, float* scratch)
+		{
+			const uint32_t tileSize = context.tileSize;
+			const uint32_t gatherSize = tileSize + 3;
+			const uint32_t mipSize = tileSize / 2 + 1;
+			float* gathered = scratch;
+			float* mips[2] = { gathered + gatherSize * gatherSize, gathered + gatherSize * gatherSize + mipSize * mipSize };
+			float* row = mips[1] + mipSize * mipSize;
+
+			GatherHeights(context, static_cast<int32_t>(tileX * tileSize) - 1, static_cast<int32_t>(context.tileY * tileSize) - 1, gatherSize, gathered);
+
+			uint8_t* tile = context.tiles + static_cast<size_t>(tileX) * context.tileStride;
+			const float* mip = gathered + gatherSize + 1;
+			uint32_t stride = gatherSize;
+			for (uint32_t level = 0; level < context.numMips; level++)
+			{
+				const uint32_t size = TerrainTileFile::GetMipSize(tileSize, level);
+				if (level > 0)
+				{
+					float* outMip = mips[level & 1];
+					DownsampleMip(mip, stride, TerrainTileFile::GetMipSize(tileSize, level - 1), row, outMip);
+					mip = outMip;
+					stride = size;
+				}
+
+				StoreHeights(mip, stride, size, reinterpret_cast<uint16_t*>(tile + TerrainTileFile::GetMipOffset(tileSize, level)));
+			}
+
+			int8_t* normals = reinterpret_cast<int8_t*>(tile + TerrainTileFile::GetNormalsOffset(tileSize, context.numMips));
+			TerrainSurfaceMaps::ComputeNormals(gathered, gatherSize, tileSize + 1, tileSize + 1, context.normalScale, normals, tileSize + 1);
+		}
+	}
+
+	bool ImportHeightfield(HeightmapReader& reader, const HeightfieldImportDesc& desc, const char* outputPath, HeightfieldImportStats* outStats)
+	{
+		using Clock = std::chrono::high_resolution_clock;
+		const Clock::time_point importStart = Clock::now();
+
+		const uint32_t width = reader.GetWidth();
+		const uint32_t height = reader.GetHeight();
+		const uint32_t tileSize = desc.tileSize;
+		if (width < 2 || height < 2 || reader.GetNextRow() != 0 || tileSize < 2 || (tileSize & (tileSize - 1)) != 0)
+		{
+			printf("[HeightfieldImporter] Needs a heightmap of at least 2x2 heights opened for reading and a power of two tile size\n");
+			return false;
+		}
+
+		const uint32_t maxNumMips = TerrainTileFile::GetMaxNumMips(tileSize);
+		TerrainTileFileHeader header;
+		header.magic = TerrainTileFile::MAGIC;
+		header.version = TerrainTileFile::VERSION;
+		header.width = width;
+		header.height = height;
+		header.tileSize = tileSize;
+		header.numTilesX = (width - 2) / tileSize + 1;
+		header.numTilesY = (height - 2) / tileSize + 1;
+		header.numMips = desc.numMips == 0 ? maxNumMips : (std::min)(desc.numMips, maxNumMips);
+		header.tileStride = TerrainTileFile::GetTileStride(tileSize, header.numMips);
+		header.dataOffset = TerrainTileFile::ALIGNMENT;
+		header.sampleSpacing = desc.sampleSpacing;
+		header.heightScale = desc.heightScale;
+
+		FILE* file = OpenFile(outputPath, "wb");
+		if (file == nullptr)
+		{
+			printf("[HeightfieldImporter] Failed to create '%s'\n", outputPath);
+			return false;
+		}
+
+		std::vector<uint8_t> headerPage(header.dataOffset, 0);
+		memcpy(headerPage.data(), &header, sizeof(header));
+		bool isWritten = fwrite(headerPage.data(), 1, headerPage.size(), file) == headerPage.size();
+
+		const uint32_t numScratches = JobSystem::GetNumThreads();
+
+		// A band of tiles needs its tileSize + 1 rows and one more on each side for the normals
+		BandContext context;
+		context.numRingRows = tileSize + 3;
+		context.width = width;
+		context.height = height;
+		context.tileSize = tileSize;
+		context.numMips = header.numMips;
+		context.tileStride = header.tileStride;
+		context.normalScale = desc.heightScale / (65535.0f * 2.0f * desc.sampleSpacing);
+		context.scratchSize = GetScratchSize(tileSize);
+
+		std::vector<uint16_t> rows(static_cast<size_t>(context.numRingRows) * width);
+		std::vector<uint8_t> tiles(static_cast<size_t>(header.numTilesX) * header.tileStride, 0);
+		std::vector<float> scratch(context.scratchSize * numScratches);
+		context.rows = rows.data();
+		context.tiles = tiles.data();
+		context.scratch = scratch.data();
+
+		const BandContext* bandContext = &context;
+		const auto buildTiles = [bandContext](uint32_t beginTile, uint32_t endTile)
+		{
+			const uint32_t threadIndex = JobSystem::GetThreadIndex();
+			float* threadScratch = bandContext->scratch + (threadIndex == JobSystem::INVALID_THREAD_INDEX ? 0 : threadIndex) * bandContext->scratchSize;
+			for (uint32_t tileX = beginTile; tileX < endTile; tileX++)
+			{
+				BuildTile(*bandContext, tileX, threadScratch);
+			}
+		};
+
+		HeightfieldImportStats stats;
+		stats.width = width;
+		stats.height = height;
+		stats.numTilesX = header.numTilesX;
+		stats.numTilesY = header.numTilesY;
+		stats.numMips = header.numMips;
+		stats.numBytesWritten = headerPage.size();
+		stats.peakMemoryInBytes = reader.GetMemoryUsage() + rows.capacity() * sizeof(uint16_t) + tiles.capacity() + scratch.capacity() * sizeof(float) + headerPage.capacity();
+
+		bool isRead = true;
+		uint32_t numRowsRead = 0;
+		for (uint32_t tileY = 0; tileY < header.numTilesY && isRead && isWritten; tileY++)
+		{
+			const Clock::time_point readStart = Clock::now();
+			const uint32_t lastRow = (std::min)((tileY + 1) * tileSize + 1, height - 1);
+			for (; numRowsRead <= lastRow && isRead; numRowsRead++)
+			{
+				isRead = reader.ReadRows(1, rows.data() + static_cast<size_t>(numRowsRead % context.numRingRows) * width);
+			}
+
+			const Clock::time_point buildStart = Clock::now();
+			context.tileY = tileY;
+			JobSystem::ParallelFor(header.numTilesX, 1, buildTiles);
+
+			const Clock::time_point writeStart = Clock::now();
+			isWritten = fwrite(tiles.data(), 1, tiles.size(), file) == tiles.size();
+			stats.numBytesWritten += tiles.size();
+			const Clock::time_point writeEnd = Clock::now();
+
+			stats.readTimeInMilliseconds += std::chrono::duration<double, std::milli>(buildStart - readStart).count();
+			stats.buildTimeInMilliseconds += std::chrono::duration<double, std::milli>(writeStart - buildStart).count();
+			stats.writeTimeInMilliseconds += std::chrono::duration<double, std::milli>(writeEnd - writeStart).count();
+		}
+
+		isWritten = fclose(file) == 0 && isWritten;
+		if (!isRead || !isWritten)
+		{
+			if (!isWritten)
+			{
+				printf("[HeightfieldImporter] Failed to write '%s'\n", outputPath);
+			}
+
+			remove(outputPath);
+			return false;
+		}
+
+		stats.timeInMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - importStart).count();
+		if (outStats != nullptr)
+		{
+			*outStats = stats;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Styx
+{
+	class HeightmapReader;
+
+	struct HeightfieldImportDesc
+	{
+		// Quads along a tile side, a power of two. Must match TerrainTileStreamerDesc::tileSize to stream the tiles.
+		uint32_t tileSize = 64;
+		// 0 for the whole chain, down to a single quad per tile
+		uint32_t numMips = 0;
+		// World distance between two heights and world height of a height of 65535, the normals are made with these
+		float sampleSpacing = 100.0f / 64.0f;
+		float heightScale = 1.0f;
+	};
+
+	struct HeightfieldImportStats
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t numTilesX = 0;
+		uint32_t numTilesY = 0;
+		uint32_t numMips = 0;
+		uint64_t numBytesWritten = 0;
+		// Bytes the import held at once: the reader, the rows of a band of tiles, the band's tiles and the scratch of
+		// every thread. It doesn't grow with the heightmap's height.
+		size_t peakMemoryInBytes = 0;
+		// Reading and decoding the heightmap, building the tiles and writing them out
+		double readTimeInMilliseconds = 0.0;
+		double buildTimeInMilliseconds = 0.0;
+		double writeTimeInMilliseconds = 0.0;
+		double timeInMilliseconds = 0.0;
+
+		double GetMegasamplesPerSecond() const { return timeInMilliseconds > 0.0 ? static_cast<double>(width) * height / (timeInMilliseconds * 1000.0) : 0.0; }
+	};
+
+	// NOTE: Cuts the heightmap the reader has open into the tiles of a TerrainTileFile at outputPath. The heightmap is
+	// read a band of tiles at a time, tileSize + 3 rows kept, so 16k x 16k maps import in a few megabytes. The tiles of
+	// a band get their mips and normals in parallel when the job system is initialized and this runs on one of its
+	// threads, then the band is written out. Mips are a [1 2 1] tent filter of the mip above, filtered only along the
+	// edge on the edge texels and kept as is on the corners, so neighbouring tiles agree on every mip of the edges they
+	// share. Normals are central differences of the mip 0 heights, across tile borders too. Returns false, and
+	// removes the output, when reading or writing fails.
+	bool ImportHeightfield(HeightmapReader& reader, const HeightfieldImportDesc& desc, const char* outputPath, HeightfieldImportStats* outStats = nullptr);
+}
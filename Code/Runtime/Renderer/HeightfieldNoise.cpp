@@ -0,0 +1,194 @@
+#include "HeightfieldNoise.h"
+#include "HeightfieldNoiseKernels.h"
+#include "Core/JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STYX_NOISE_SSE2 1
+#endif
+
+// The AVX2 kernel is built on every x64 target and only picked when the CPU has AVX2
+#if defined(_M_X64) || defined(__x86_64__)
+#define STYX_NOISE_AVX2 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace
+{
+	using namespace Styx;
+
+	// Rows are handed out to jobs in batches of at least this many texels
+	constexpr uint32_t MIN_TEXELS_PER_JOB = 2048;
+
+	HeightfieldNoiseParameters GetHeightfieldNoiseParameters(const HeightfieldNoiseMaterialConstants& constants)
+	{
+		HeightfieldNoiseParameters parameters;
+		parameters.seed = static_cast<uint32_t>(constants.seed);
+		parameters.octaves = constants.octaves;
+		parameters.frequency = constants.frequency;
+		parameters.lacunarity = constants.lacunarity;
+		parameters.gain = constants.gain;
+
+		float amplitudeSum = 0.0f;
+		float amplitude = 1.0f;
+		for (int32_t octave = 0; octave < constants.octaves; octave++)
+		{
+			amplitudeSum += std::fabs(amplitude);
+			amplitude *= constants.gain;
+		}
+
+		parameters.scale = amplitudeSum > 0.0f ? 0.5f / amplitudeSum : 0.0f;
+		return parameters;
+	}
+
+#if STYX_NOISE_SSE2
+	struct Sse2
+	{
+		static constexpr uint32_t WIDTH = 4;
+		using Float = __m128;
+		using Int = __m128i;
+
+		static Float SetFloat(float value) { return _mm_set1_ps(value); }
+		static Int SetInt(uint32_t value) { return _mm_set1_epi32(static_cast<int32_t>(value)); }
+		static Int LaneIndices() { return _mm_setr_epi32(0, 1, 2, 3); }
+
+		static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+		static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+		static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+		static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+		static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+		static Float FlipSign(Float value, Int signMask) { return _mm_xor_ps(value, _mm_castsi128_ps(signMask)); }
+
+		// No SSE4.1 round instruction: truncate, then step down where truncation rounded up (negative values)
+		static Float Floor(Float value)
+		{
+			const Float truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+			return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), _mm_set1_ps(1.0f)));
+		}
+
+		static Int ToInt(Float value) { return _mm_cvttps_epi32(value); }
+		static Float ToFloat(Int value) { return _mm_cvtepi32_ps(value); }
+
+		static Int Add(Int a, Int b) { return _mm_add_epi32(a, b); }
+		static Int Xor(Int a, Int b) { return _mm_xor_si128(a, b); }
+		static Int And(Int a, Int b) { return _mm_and_si128(a, b); }
+		static Int ShiftLeftOne(Int value) { return _mm_slli_epi32(value, 1); }
+
+		// No 32-bit multiply low before SSE4.1: multiply the even and odd lanes to 64-bit and keep the low halves
+		static Int MulLo(Int a, Int b)
+		{
+			const Int even = _mm_mul_epu32(a, b);
+			const Int odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+			return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+		}
+
+		static void Store(float* destination, Float value) { _mm_storeu_ps(destination, value); }
+	};
+#endif
+
+#if STYX_NOISE_AVX2
+	bool IsAvx2Supported()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		// The OS has to save the YMM registers on context switches, on top of the CPU supporting AVX and AVX2
+		__cpuid(info, 1);
+		const bool hasAvx = (info[2] & (1 << 28)) != 0;
+		const bool hasOsxsave = (info[2] & (1 << 27)) != 0;
+
+		__cpuidex(info, 7, 0);
+		const bool hasAvx2 = (info[1] & (1 << 5)) != 0;
+
+		return hasAvx && hasOsxsave && hasAvx2 && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+}
+
+float Styx::SampleHeightfieldNoise(const HeightfieldNoiseMaterialConstants& constants, float x, float y)
+{
+	return FractalNoise(GetHeightfieldNoiseParameters(constants), x, y);
+}
+
+void Styx::GenerateHeightfieldNoise(const HeightfieldNoiseMaterialConstants& constants, int32_t originX, int32_t originY, uint32_t width, uint32_t height, float* output, uint32_t rowPitch)
+{
+	GenerateHeightfieldNoise(constants, originX, originY, width, height, output, rowPitch, GetNoiseInstructionSet());
+}
+
+void Styx::GenerateHeightfieldNoise(const HeightfieldNoiseMaterialConstants& constants, int32_t originX, int32_t originY, uint32_t width, uint32_t height, float* output, uint32_t rowPitch, NoiseInstructionSet instructionSet)
+{
+	if (width == 0 || height == 0)
+	{
+		return;
+	}
+
+	if (static_cast<uint32_t>(instructionSet) > static_cast<uint32_t>(GetNoiseInstructionSet()))
+	{
+		instructionSet = GetNoiseInstructionSet();
+	}
+
+	void (*generateRow)(const HeightfieldNoiseParameters&, int32_t, int32_t, uint32_t, float*) = GenerateRowScalar;
+#if STYX_NOISE_SSE2
+	if (instructionSet == NoiseInstructionSet::sse2)
+	{
+		generateRow = GenerateRowSimd<Sse2>;
+	}
+#endif
+#if STYX_NOISE_AVX2
+	if (instructionSet == NoiseInstructionSet::avx2)
+	{
+		generateRow = GenerateHeightfieldNoiseRowAvx2;
+	}
+#endif
+
+	const HeightfieldNoiseParameters parameters = GetHeightfieldNoiseParameters(constants);
+	const auto generateRows = [&](uint32_t beginRow, uint32_t endRow)
+	{
+		for (uint32_t row = beginRow; row < endRow; row++)
+		{
+			generateRow(parameters, originX, originY + static_cast<int32_t>(row), width, output + static_cast<size_t>(row) * rowPitch);
+		}
+	};
+
+	JobSystem::ParallelFor(height, (std::max)(MIN_TEXELS_PER_JOB / width, 1u), generateRows);
+}
+
+Styx::NoiseInstructionSet Styx::GetNoiseInstructionSet()
+{
+#if STYX_NOISE_AVX2
+	static const bool isAvx2Supported = IsAvx2Supported();
+	if (isAvx2Supported)
+	{
+		return NoiseInstructionSet::avx2;
+	}
+#endif
+#if STYX_NOISE_SSE2
+	return NoiseInstructionSet::sse2;
+#else
+	return NoiseInstructionSet::scalar;
+#endif
+}
+
+const char* Styx::GetNoiseInstructionSetName(NoiseInstructionSet instructionSet)
+{
+	switch (instructionSet)
+	{
+	case NoiseInstructionSet::scalar: return "Scalar";
+	case NoiseInstructionSet::sse2: return "SSE2";
+	case NoiseInstructionSet::avx2: return "AVX2";
+	default: return "Unknown";
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace Styx
+{
+	// NOTE: Must match the material constants of HeightfieldNoise.hlsl
+	struct HeightfieldNoiseMaterialConstants
+	{
+		int32_t seed = 42;
+		float frequency = 0.01f;
+		int32_t octaves = 3;
+		float lacunarity = 2.0f;
+		float gain = 0.5f;
+	};
+
+	enum class NoiseInstructionSet : uint8_t
+	{
+		scalar,
+		sse2,
+		avx2
+	};
+
+	// NOTE: CPU version of the heightfield noise, so terrain height can be queried without a GPU. It's fractal gradient
+	// noise: every octave is 2D Perlin noise with diagonal gradients picked by an integer hash of the lattice point and the
+	// octave's seed (seed + octave index), summed with decreasing amplitudes and remapped to [0, 1]. Coordinates are in
+	// heightfield texels, scaled by frequency. The vectorised paths do the same float operations in the same order as
+	// the scalar one, so every instruction set produces bit-identical heights.
+
+	// Height in [0, 1] at texel coordinates (x, y). This is the reference implementation.
+	float SampleHeightfieldNoise(const HeightfieldNoiseMaterialConstants& constants, float x, float y);
+
+	// Writes the heights of the texels [originX, originX + width) x [originY, originY + height) to output, one row every
+	// rowPitch floats. Rows are spread over the job system when it's initialized and this runs on one of its threads.
+	void GenerateHeightfieldNoise(const HeightfieldNoiseMaterialConstants& constants, int32_t originX, int32_t originY, uint32_t width, uint32_t height, float* output, uint32_t rowPitch);
+	// Same as above, forcing an instruction set. Anything wider than GetNoiseInstructionSet() falls back to it.
+	void GenerateHeightfieldNoise(const HeightfieldNoiseMaterialConstants& constants, int32_t originX, int32_t originY, uint32_t width, uint32_t height, float* output, uint32_t rowPitch, NoiseInstructionSet instructionSet);
+
+	// The widest instruction set the CPU supports, detected once at runtime
+	NoiseInstructionSet GetNoiseInstructionSet();
+	const char* GetNoiseInstructionSetName(NoiseInstructionSet instructionSet);
+}
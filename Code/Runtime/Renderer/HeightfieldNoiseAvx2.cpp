@@ -0,0 +1,53 @@
+// NOTE: The only file built for AVX2 (/arch:AVX2 in Runtime.vcxproj), and only called when the CPU supports it. Builds
+// without the flag get the instruction set from the pragma, which has to come before the kernels are included.
+#if defined(_M_X64) || defined(__x86_64__)
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2")
+#endif
+
+#include "HeightfieldNoiseKernels.h"
+
+#include <immintrin.h>
+
+namespace
+{
+	using namespace Styx;
+
+	struct Avx2
+	{
+		static constexpr uint32_t WIDTH = 8;
+		using Float = __m256;
+		using Int = __m256i;
+
+		static Float SetFloat(float value) { return _mm256_set1_ps(value); }
+		static Int SetInt(uint32_t value) { return _mm256_set1_epi32(static_cast<int32_t>(value)); }
+		static Int LaneIndices() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+
+		static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+		static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+		static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+		static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+		static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+		static Float FlipSign(Float value, Int signMask) { return _mm256_xor_ps(value, _mm256_castsi256_ps(signMask)); }
+		static Float Floor(Float value) { return _mm256_floor_ps(value); }
+
+		static Int ToInt(Float value) { return _mm256_cvttps_epi32(value); }
+		static Float ToFloat(Int value) { return _mm256_cvtepi32_ps(value); }
+
+		static Int Add(Int a, Int b) { return _mm256_add_epi32(a, b); }
+		static Int Xor(Int a, Int b) { return _mm256_xor_si256(a, b); }
+		static Int And(Int a, Int b) { return _mm256_and_si256(a, b); }
+		static Int ShiftLeftOne(Int value) { return _mm256_slli_epi32(value, 1); }
+		static Int MulLo(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+
+		static void Store(float* destination, Float value) { _mm256_storeu_ps(destination, value); }
+	};
+}
+
+void Styx::GenerateHeightfieldNoiseRowAvx2(const HeightfieldNoiseParameters& parameters, int32_t x, int32_t y, uint32_t width, float* output)
+{
+	GenerateRowSimd<Avx2>(parameters, x, y, width, output);
+}
+
+#endif
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "HeightfieldNoise.h"
+
+#include <math.h>
+
+// NOTE: The noise kernels, shared by HeightfieldNoise.cpp and HeightfieldNoiseAvx2.cpp. The latter is the only file
+// compiled for AVX2, so everything in here but the parameters has internal linkage: each file gets its own copy built
+// for its own instruction set, and the linker can't pick an AVX2 copy for callers running on older CPUs. For the same
+// reason the kernels don't call inline functions of other headers, like std::min, only C library functions.
+namespace Styx
+{
+	struct HeightfieldNoiseParameters
+	{
+		uint32_t seed;
+		int32_t octaves;
+		float frequency;
+		float lacunarity;
+		float gain;
+		// Maps the sum of the octaves from [-amplitudeSum, amplitudeSum] to [-0.5, 0.5]
+		float scale;
+	};
+
+	// Defined in HeightfieldNoiseAvx2.cpp. Only call it after checking the CPU supports AVX2.
+	void GenerateHeightfieldNoiseRowAvx2(const HeightfieldNoiseParameters& parameters, int32_t x, int32_t y, uint32_t width, float* output);
+
+	namespace
+	{
+		// Lattice coordinates are multiplied by these primes before being hashed together with the seed
+		constexpr uint32_t PRIME_X = 501125321u;
+		constexpr uint32_t PRIME_Y = 1136930381u;
+		constexpr uint32_t HASH_MULTIPLIER = 0x27d4eb2du;
+		constexpr uint32_t SIGN_BIT = 0x80000000u;
+
+		// Scalar reference
+
+		float Fade(float t)
+		{
+			return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+		}
+
+		float Lerp(float a, float b, float t)
+		{
+			return a + t * (b - a);
+		}
+
+		// Same as (std::min)((std::max)(value, 0.0f), 1.0f)
+		float Saturate(float value)
+		{
+			const float lowerClamped = value < 0.0f ? 0.0f : value;
+			return 1.0f < lowerClamped ? 1.0f : lowerClamped;
+		}
+
+		// The two top bits of the hash pick one of the four diagonal gradients, which only flips the sign of each offset
+		float Gradient(uint32_t seed, uint32_t xPrimed, uint32_t yPrimed, float x, float y)
+		{
+			const uint32_t hash = (seed ^ xPrimed ^ yPrimed) * HASH_MULTIPLIER;
+			return ((hash & SIGN_BIT) ? -x : x) + (((hash << 1) & SIGN_BIT) ? -y : y);
+		}
+
+		float GradientNoise(uint32_t seed, float x, float y)
+		{
+			const float x0 = floorf(x);
+			const float y0 = floorf(y);
+
+			const float fx0 = x - x0;
+			const float fy0 = y - y0;
+			const float fx1 = fx0 - 1.0f;
+			const float fy1 = fy0 - 1.0f;
+
+			const uint32_t xPrimed0 = static_cast<uint32_t>(static_cast<int32_t>(x0)) * PRIME_X;
+			const uint32_t yPrimed0 = static_cast<uint32_t>(static_cast<int32_t>(y0)) * PRIME_Y;
+			const uint32_t xPrimed1 = xPrimed0 + PRIME_X;
+			const uint32_t yPrimed1 = yPrimed0 + PRIME_Y;
+
+			const float u = Fade(fx0);
+			const float v = Fade(fy0);
+
+			const float n00 = Gradient(seed, xPrimed0, yPrimed0, fx0, fy0);
+			const float n10 = Gradient(seed, xPrimed1, yPrimed0, fx1, fy0);
+			const float n01 = Gradient(seed, xPrimed0, yPrimed1, fx0, fy1);
+			const float n11 = Gradient(seed, xPrimed1, yPrimed1, fx1, fy1);
+
+			return Lerp(Lerp(n00, n10, u), Lerp(n01, n11, u), v);
+		}
+
+		float FractalNoise(const HeightfieldNoiseParameters& parameters, float x, float y)
+		{
+			float sum = 0.0f;
+			float amplitude = 1.0f;
+			float frequency = parameters.frequency;
+
+			for (int32_t octave = 0; octave < parameters.octaves; octave++)
+			{
+				sum += amplitude * GradientNoise(parameters.seed + static_cast<uint32_t>(octave), x * frequency, y * frequency);
+				amplitude *= parameters.gain;
+				frequency *= parameters.lacunarity;
+			}
+
+			return Saturate(sum * parameters.scale + 0.5f);
+		}
+
+		void GenerateRowScalar(const HeightfieldNoiseParameters& parameters, int32_t x, int32_t y, uint32_t width, float* output)
+		{
+			const float sampleY = static_cast<float>(y);
+			for (uint32_t i = 0; i < width; i++)
+			{
+				output[i] = FractalNoise(parameters, static_cast<float>(x + static_cast<int32_t>(i)), sampleY);
+			}
+		}
+
+		// Vectorised paths. Each instruction set wraps the handful of operations the noise needs (Sse2 in
+		// HeightfieldNoise.cpp, Avx2 in HeightfieldNoiseAvx2.cpp), the noise itself is written once on top of them and
+		// mirrors the scalar reference operation by operation.
+
+		template<typename Simd>
+		typename Simd::Float FadeSimd(typename Simd::Float t)
+		{
+			const typename Simd::Float inner = Simd::Add(Simd::Mul(t, Simd::Sub(Simd::Mul(t, Simd::SetFloat(6.0f)), Simd::SetFloat(15.0f))), Simd::SetFloat(10.0f));
+			return Simd::Mul(Simd::Mul(Simd::Mul(t, t), t), inner);
+		}
+
+		template<typename Simd>
+		typename Simd::Float LerpSimd(typename Simd::Float a, typename Simd::Float b, typename Simd::Float t)
+		{
+			return Simd::Add(a, Simd::Mul(t, Simd::Sub(b, a)));
+		}
+
+		template<typename Simd>
+		typename Simd::Float GradientSimd(typename Simd::Int seed, typename Simd::Int xPrimed, typename Simd::Int yPrimed, typename Simd::Float x, typename Simd::Float y)
+		{
+			const typename Simd::Int signBit = Simd::SetInt(SIGN_BIT);
+			const typename Simd::Int hash = Simd::MulLo(Simd::Xor(Simd::Xor(seed, xPrimed), yPrimed), Simd::SetInt(HASH_MULTIPLIER));
+			const typename Simd::Float gradientX = Simd::FlipSign(x, Simd::And(hash, signBit));
+			const typename Simd::Float gradientY = Simd::FlipSign(y, Simd::And(Simd::ShiftLeftOne(hash), signBit));
+			return Simd::Add(gradientX, gradientY);
+		}
+
+		template<typename Simd>
+		typename Simd::Float GradientNoiseSimd(typename Simd::Int seed, typename Simd::Float x, typename Simd::Float y)
+		{
+			using Float = typename Simd::Float;
+			using Int = typename Simd::Int;
+
+			const Float x0 = Simd::Floor(x);
+			const Float y0 = Simd::Floor(y);
+
+			const Float one = Simd::SetFloat(1.0f);
+			const Float fx0 = Simd::Sub(x, x0);
+			const Float fy0 = Simd::Sub(y, y0);
+			const Float fx1 = Simd::Sub(fx0, one);
+			const Float fy1 = Simd::Sub(fy0, one);
+
+			const Int primeX = Simd::SetInt(PRIME_X);
+			const Int primeY = Simd::SetInt(PRIME_Y);
+			const Int xPrimed0 = Simd::MulLo(Simd::ToInt(x0), primeX);
+			const Int yPrimed0 = Simd::MulLo(Simd::ToInt(y0), primeY);
+			const Int xPrimed1 = Simd::Add(xPrimed0, primeX);
+			const Int yPrimed1 = Simd::Add(yPrimed0, primeY);
+
+			const Float u = FadeSimd<Simd>(fx0);
+			const Float v = FadeSimd<Simd>(fy0);
+
+			const Float n00 = GradientSimd<Simd>(seed, xPrimed0, yPrimed0, fx0, fy0);
+			const Float n10 = GradientSimd<Simd>(seed, xPrimed1, yPrimed0, fx1, fy0);
+			const Float n01 = GradientSimd<Simd>(seed, xPrimed0, yPrimed1, fx0, fy1);
+			const Float n11 = GradientSimd<Simd>(seed, xPrimed1, yPrimed1, fx1, fy1);
+
+			return LerpSimd<Simd>(LerpSimd<Simd>(n00, n10, u), LerpSimd<Simd>(n01, n11, u), v);
+		}
+
+		template<typename Simd>
+		void GenerateRowSimd(const HeightfieldNoiseParameters& parameters, int32_t x, int32_t y, uint32_t width, float* output)
+		{
+			using Float = typename Simd::Float;
+
+			const Float sampleY = Simd::SetFloat(static_cast<float>(y));
+
+			uint32_t i = 0;
+			for (; i + Simd::WIDTH <= width; i += Simd::WIDTH)
+			{
+				const Float sampleX = Simd::ToFloat(Simd::Add(Simd::SetInt(static_cast<uint32_t>(x) + i), Simd::LaneIndices()));
+
+				Float sum = Simd::SetFloat(0.0f);
+				float amplitude = 1.0f;
+				float frequency = parameters.frequency;
+
+				for (int32_t octave = 0; octave < parameters.octaves; octave++)
+				{
+					const Float octaveFrequency = Simd::SetFloat(frequency);
+					const Float noise = GradientNoiseSimd<Simd>(Simd::SetInt(parameters.seed + static_cast<uint32_t>(octave)), Simd::Mul(sampleX, octaveFrequency), Simd::Mul(sampleY, octaveFrequency));
+					sum = Simd::Add(sum, Simd::Mul(Simd::SetFloat(amplitude), noise));
+					amplitude *= parameters.gain;
+					frequency *= parameters.lacunarity;
+				}
+
+				const Float height = Simd::Add(Simd::Mul(sum, Simd::SetFloat(parameters.scale)), Simd::SetFloat(0.5f));
+				Simd::Store(output + i, Simd::Min(Simd::Max(height, Simd::SetFloat(0.0f)), Simd::SetFloat(1.0f)));
+			}
+
+			GenerateRowScalar(parameters, x + static_cast<int32_t>(i), y, width - i, output + i);
+		}
+	}
+}
@@ -0,0 +1,832 @@
+#include "HeightmapReader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string.h>
+#include <vector>
+
+namespace Styx
+{
+	namespace
+	{
+		constexpr uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		constexpr uint32_t PNG_GRAY = 0;
+		constexpr uint32_t PNG_GRAY_ALPHA = 4;
+
+		constexpr uint32_t WINDOW_SIZE = 1 << 15;
+		constexpr uint32_t MAX_CODE_LENGTH = 15;
+		// Codes up to this long are decoded with a single table lookup, longer ones a bit at a time
+		constexpr uint32_t FAST_BITS = 10;
+		constexpr uint32_t NUM_LITERAL_CODES = 288;
+		constexpr uint32_t NUM_DISTANCE_CODES = 30;
+		constexpr uint32_t END_OF_BLOCK = 256;
+		constexpr uint32_t INPUT_BUFFER_SIZE = 1 << 16;
+
+		constexpr uint16_t LENGTH_BASES[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		constexpr uint8_t LENGTH_EXTRA_BITS[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		constexpr uint16_t DISTANCE_BASES[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		constexpr uint8_t DISTANCE_EXTRA_BITS[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		// Order the code length code lengths of a dynamic block come in
+		constexpr uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		uint32_t ReadBigEndian32(const uint8_t* bytes)
+		{
+			return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+		}
+
+		FILE* OpenFile(const char* path, const char* mode)
+		{
+			FILE* file = nullptr;
+#if defined(_WIN32)
+			fopen_s(&file, path, mode);
+#else
+			file = fopen(path, mode);
+#endif
+			return file;
+		}
+
+		bool GetFileSize(FILE* file, uint64_t& outSize)
+		{
+#if defined(_WIN32)
+			if (_fseeki64(file, 0, SEEK_END) != 0)
+			{
+				return false;
+			}
+			const int64_t size = _ftelli64(file);
+			if (size < 0 || _fseeki64(file, 0, SEEK_SET) != 0)
+			{
+				return false;
+			}
+#else
+			if (fseeko(file, 0, SEEK_END) != 0)
+			{
+				return false;
+			}
+			const off_t size = ftello(file);
+			if (size < 0 || fseeko(file, 0, SEEK_SET) != 0)
+			{
+				return false;
+			}
+#endif
+			outSize = static_cast<uint64_t>(size);
+			return true;
+		}
+
+		// Canonical Huffman code, as deflate defines it
+		struct HuffmanTable
+		{
+			// (symbol << 4) | code length, indexed by the next FAST_BITS bits of the stream. 0 where the code is longer.
+			uint16_t fast[1 << FAST_BITS];
+			uint16_t counts[MAX_CODE_LENGTH + 1];
+			// Sorted by code
+			uint16_t symbols[NUM_LITERAL_CODES];
+
+			// Incomplete codes are allowed, e.g. a single distance code
+			bool Build(const uint8_t* lengths, uint32_t numSymbols)
+			{
+				memset(fast, 0, sizeof(fast));
+				memset(counts, 0, sizeof(counts));
+				for (uint32_t symbol = 0; symbol < numSymbols; symbol++)
+				{
+					++counts[lengths[symbol]];
+				}
+				counts[0] = 0;
+
+				int32_t left = 1;
+				for (uint32_t length = 1; length <= MAX_CODE_LENGTH; length++)
+				{
+					left = (left << 1) - counts[length];
+					if (left < 0)
+					{
+						return false;
+					}
+				}
+
+				uint16_t offsets[MAX_CODE_LENGTH + 2] = {};
+				uint32_t nextCodes[MAX_CODE_LENGTH + 1] = {};
+				uint32_t code = 0;
+				for (uint32_t length = 1; length <= MAX_CODE_LENGTH; length++)
+				{
+					offsets[length + 1] = offsets[length] + counts[length];
+					code = (code + counts[length - 1]) << 1;
+					nextCodes[length] = code;
+				}
+
+				for (uint32_t symbol = 0; symbol < numSymbols; symbol++)
+				{
+					const uint32_t length = lengths[symbol];
+					if (length == 0)
+					{
+						continue;
+					}
+
+					symbols[offsets[length]++] = static_cast<uint16_t>(symbol);
+					const uint32_t symbolCode = nextCodes[length]++;
+					if (length > FAST_BITS)
+					{
+						continue;
+					}
+
+					// Codes are packed from their most significant bit, the stream is read from the least significant one
+					uint32_t reversed = 0;
+					for (uint32_t bit = 0; bit < length; bit++)
+					{
+						reversed |= ((symbolCode >> bit) & 1) << (length - 1 - bit);
+					}
+
+					for (uint32_t index = reversed; index < (1u << FAST_BITS); index += 1u << length)
+					{
+						fast[index] = static_cast<uint16_t>((symbol << 4) | length);
+					}
+				}
+
+				return true;
+			}
+		};
+	}
+
+	// NOTE: Walks the IDAT chunks of a PNG as one zlib stream and inflates it a row at a time. The CRCs and the Adler-32
+	// checksum aren't checked, a corrupt file fails on an invalid deflate stream or a missing row instead.
+	class HeightmapReader::PngDecoder
+	{
+	public:
+		bool Open(FILE* file, const char* path, uint32_t& outWidth, uint32_t& outHeight);
+		bool ReadRow(uint16_t* outHeights);
+
+		size_t GetMemoryUsage() const
+		{
+			return sizeof(PngDecoder) + m_Input.capacity() + m_Row.capacity() + m_PreviousRow.capacity();
+		}
+
+	private:
+		enum class BlockType
+		{
+			none,
+			stored,
+			huffman
+		};
+
+		bool ReadChunkHeader(uint32_t& outLength, uint8_t* outType);
+		bool NextIdatByte(uint8_t& outByte);
+		bool NeedBits(uint32_t numBits);
+		uint32_t GetBits(uint32_t numBits);
+		bool DecodeSymbol(const HuffmanTable& table, uint32_t& outSymbol);
+		bool ReadBlockHeader();
+		bool ReadDynamicTables();
+		bool Inflate(uint8_t* out, size_t size);
+
+		FILE* m_File = nullptr;
+		uint32_t m_Width = 0;
+		uint32_t m_BytesPerPixel = 0;
+		uint32_t m_BytesPerSample = 0;
+
+		// Bytes of the current IDAT chunk not read from the file yet
+		uint32_t m_ChunkRemaining = 0;
+		std::vector<uint8_t> m_Input;
+		size_t m_InputPosition = 0;
+		size_t m_InputSize = 0;
+
+		uint64_t m_BitBuffer = 0;
+		uint32_t m_NumBits = 0;
+		BlockType m_BlockType = BlockType::none;
+		bool m_IsFinalBlock = false;
+		uint32_t m_StoredRemaining = 0;
+		uint32_t m_MatchLength = 0;
+		uint32_t m_MatchDistance = 0;
+		uint64_t m_NumBytesInflated = 0;
+		HuffmanTable m_LiteralTable;
+		HuffmanTable m_DistanceTable;
+		uint8_t m_Window[WINDOW_SIZE];
+
+		// Filter byte first, as in the stream
+		std::vector<uint8_t> m_Row;
+		std::vector<uint8_t> m_PreviousRow;
+	};
+
+	bool HeightmapReader::PngDecoder::ReadChunkHeader(uint32_t& outLength, uint8_t* outType)
+	{
+		uint8_t header[8];
+		if (fread(header, 1, sizeof(header), m_File) != sizeof(header))
+		{
+			return false;
+		}
+
+		outLength = ReadBigEndian32(header);
+		memcpy(outType, header + 4, 4);
+		return true;
+	}
+
+	bool HeightmapReader::PngDecoder::Open(FILE* file, const char* path, uint32_t& outWidth, uint32_t& outHeight)
+	{
+		m_File = file;
+
+		uint8_t signature[sizeof(PNG_SIGNATURE)];
+		if (fread(signature, 1, sizeof(signature), m_File) != sizeof(signature) || memcmp(signature, PNG_SIGNATURE, sizeof(signature)) != 0)
+		{
+			printf("[HeightmapReader] '%s' is not a PNG\n", path);
+			return false;
+		}
+
+		uint32_t length = 0;
+		uint8_t type[4];
+		uint8_t ihdr[13];
+		if (!ReadChunkHeader(length, type) || memcmp(type, "IHDR", 4) != 0 || length != sizeof(ihdr) || fread(ihdr, 1, sizeof(ihdr), m_File) != sizeof(ihdr))
+		{
+			printf("[HeightmapReader] '%s' has no valid IHDR chunk\n", path);
+			return false;
+		}
+
+		const uint32_t width = ReadBigEndian32(ihdr);
+		const uint32_t height = ReadBigEndian32(ihdr + 4);
+		const uint32_t bitDepth = ihdr[8];
+		const uint32_t colorType = ihdr[9];
+		const uint32_t interlaceMethod = ihdr[12];
+		if (width == 0 || height == 0 || (bitDepth != 8 && bitDepth != 16) || (colorType != PNG_GRAY && colorType != PNG_GRAY_ALPHA) || ihdr[10] != 0 || ihdr[11] != 0 || interlaceMethod != 0)
+		{
+			printf("[HeightmapReader] '%s' must be a non-interlaced 8 or 16 bit grayscale PNG\n", path);
+			return false;
+		}
+
+		m_Width = width;
+		m_BytesPerSample = bitDepth / 8;
+		m_BytesPerPixel = m_BytesPerSample * (colorType == PNG_GRAY_ALPHA ? 2 : 1);
+
+		// Skip the IHDR CRC and every chunk up to the first IDAT
+		if (fseek(m_File, 4, SEEK_CUR) != 0)
+		{
+			return false;
+		}
+		for (;;)
+		{
+			if (!ReadChunkHeader(length, type))
+			{
+				printf("[HeightmapReader] '%s' has no IDAT chunk\n", path);
+				return false;
+			}
+
+			if (memcmp(type, "IDAT", 4) == 0)
+			{
+				break;
+			}
+
+			if (fseek(m_File, static_cast<long>(length) + 4, SEEK_CUR) != 0)
+			{
+				return false;
+			}
+		}
+
+		m_ChunkRemaining = length;
+		m_Input.resize(INPUT_BUFFER_SIZE);
+		m_Row.assign(static_cast<size_t>(m_Width) * m_BytesPerPixel + 1, 0);
+		m_PreviousRow.assign(m_Row.size(), 0);
+
+		const uint32_t compressionMethod = NeedBits(16) ? GetBits(8) : 0;
+		const uint32_t flags = GetBits(8);
+		if ((compressionMethod & 0x0F) != 8 || (compressionMethod >> 4) > 7 || ((compressionMethod << 8) | flags) % 31 != 0 || (flags & 0x20) != 0)
+		{
+			printf("[HeightmapReader] '%s' has an invalid zlib stream\n", path);
+			return false;
+		}
+
+		outWidth = width;
+		outHeight = height;
+		return true;
+	}
+
+	bool HeightmapReader::PngDecoder::NextIdatByte(uint8_t& outByte)
+	{
+		while (m_InputPosition == m_InputSize)
+		{
+			if (m_ChunkRemaining == 0)
+			{
+				// The image data may be split over consecutive IDAT chunks. Skip the CRC of the current one.
+				uint32_t length = 0;
+				uint8_t type[4];
+				if (fseek(m_File, 4, SEEK_CUR) != 0 || !ReadChunkHeader(length, type) || memcmp(type, "IDAT", 4) != 0)
+				{
+					return false;
+				}
+
+				m_ChunkRemaining = length;
+				continue;
+			}
+
+			const size_t size = (std::min)(static_cast<size_t>(m_ChunkRemaining), m_Input.size());
+			if (fread(m_Input.data(), 1, size, m_File) != size)
+			{
+				return false;
+			}
+
+			m_ChunkRemaining -= static_cast<uint32_t>(size);
+			m_InputPosition = 0;
+			m_InputSize = size;
+		}
+
+		outByte = m_Input[m_InputPosition++];
+		return true;
+	}
+
+	bool HeightmapReader::PngDecoder::NeedBits(uint32_t numBits)
+	{
+		while (m_NumBits < numBits)
+		{
+			uint8_t byte = 0;
+			if (!NextIdatByte(byte))
+			{
+				return false;
+			}
+
+			m_BitBuffer |= static_cast<uint64_t>(byte) << m_NumBits;
+			m_NumBits += 8;
+		}
+
+		return true;
+	}
+
+	uint32_t HeightmapReader::PngDecoder::GetBits(uint32_t numBits)
+	{
+		const uint32_t bits = static_cast<uint32_t>(m_BitBuffer & ((1ull << numBits) - 1));
+		m_BitBuffer >>= numBits;
+		m_NumBits -= numBits;
+		return bits;
+	}
+
+	bool HeightmapReader::PngDecoder::DecodeSymbol(const HuffmanTable& table, uint32_t& outSymbol)
+	{
+		// The stream may end on a short code, so the lookup only needs as many bits as are left
+		NeedBits(FAST_BITS);
+		const uint32_t entry = table.fast[m_BitBuffer & ((1u << FAST_BITS) - 1)];
+		const uint32_t length = entry & 0xF;
+		if (entry != 0 && length <= m_NumBits)
+		{
+			GetBits(length);
+			outSymbol = entry >> 4;
+			return true;
+		}
+
+		// A bit at a time, after puff
+		int32_t code = 0;
+		int32_t first = 0;
+		int32_t index = 0;
+		for (uint32_t codeLength = 1; codeLength <= MAX_CODE_LENGTH; codeLength++)
+		{
+			if (!NeedBits(1))
+			{
+				return false;
+			}
+
+			code |= static_cast<int32_t>(GetBits(1));
+			const int32_t count = table.counts[codeLength];
+			if (code - first < count)
+			{
+				outSymbol = table.symbols[index + code - first];
+				return true;
+			}
+
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+
+		return false;
+	}
+
+	bool HeightmapReader::PngDecoder::ReadDynamicTables()
+	{
+		if (!NeedBits(14))
+		{
+			return false;
+		}
+
+		const uint32_t numLiteralCodes = GetBits(5) + 257;
+		const uint32_t numDistanceCodes = GetBits(5) + 1;
+		const uint32_t numCodeLengthCodes = GetBits(4) + 4;
+		if (numLiteralCodes > 286 || numDistanceCodes > NUM_DISTANCE_CODES)
+		{
+			return false;
+		}
+
+		uint8_t codeLengthLengths[19] = {};
+		for (uint32_t i = 0; i < numCodeLengthCodes; i++)
+		{
+			if (!NeedBits(3))
+			{
+				return false;
+			}
+			codeLengthLengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(GetBits(3));
+		}
+
+		HuffmanTable codeLengthTable;
+		if (!codeLengthTable.Build(codeLengthLengths, 19))
+		{
+			return false;
+		}
+
+		// Literal and distance code lengths are one sequence, repeats may cross from one to the other
+		uint8_t lengths[286 + NUM_DISTANCE_CODES] = {};
+		const uint32_t numLengths = numLiteralCodes + numDistanceCodes;
+		for (uint32_t i = 0; i < numLengths;)
+		{
+			uint32_t symbol = 0;
+			if (!DecodeSymbol(codeLengthTable, symbol))
+			{
+				return false;
+			}
+
+			if (symbol < 16)
+			{
+				lengths[i++] = static_cast<uint8_t>(symbol);
+				continue;
+			}
+
+			uint8_t length = 0;
+			uint32_t repeat = 0;
+			if (symbol == 16)
+			{
+				if (i == 0 || !NeedBits(2))
+				{
+					return false;
+				}
+				length = lengths[i - 1];
+				repeat = 3 + GetBits(2);
+			}
+			else if (symbol == 17)
+			{
+				if (!NeedBits(3))
+				{
+					return false;
+				}
+				repeat = 3 + GetBits(3);
+			}
+			else
+			{
+				if (!NeedBits(7))
+				{
+					return false;
+				}
+				repeat = 11 + GetBits(7);
+			}
+
+			if (i + repeat > numLengths)
+			{
+				return false;
+			}
+			memset(lengths + i, length, repeat);
+			i += repeat;
+		}
+
+		if (lengths[END_OF_BLOCK] == 0)
+		{
+			return false;
+		}
+
+		return m_LiteralTable.Build(lengths, numLiteralCodes) && m_DistanceTable.Build(lengths + numLiteralCodes, numDistanceCodes);
+	}
+
+	bool HeightmapReader::PngDecoder::ReadBlockHeader()
+	{
+		if (!NeedBits(3))
+		{
+			return false;
+		}
+
+		m_IsFinalBlock = GetBits(1) != 0;
+		const uint32_t type = GetBits(2);
+		if (type == 0)
+		{
+			// Stored blocks start on a byte boundary
+			GetBits(m_NumBits & 7);
+			if (!NeedBits(32))
+			{
+				return false;
+			}
+
+			const uint32_t length = GetBits(16);
+			const uint32_t lengthComplement = GetBits(16);
+			if ((length ^ 0xFFFF) != lengthComplement)
+			{
+				return false;
+			}
+
+			m_StoredRemaining = length;
+			m_BlockType = BlockType::stored;
+			return true;
+		}
+
+		if (type == 1)
+		{
+			uint8_t lengths[NUM_LITERAL_CODES + NUM_DISTANCE_CODES];
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			memset(lengths + NUM_LITERAL_CODES, 5, NUM_DISTANCE_CODES);
+			m_LiteralTable.Build(lengths, NUM_LITERAL_CODES);
+			m_DistanceTable.Build(lengths + NUM_LITERAL_CODES, NUM_DISTANCE_CODES);
+		}
+		else if (type != 2 || !ReadDynamicTables())
+		{
+			return false;
+		}
+
+		m_BlockType = BlockType::huffman;
+		return true;
+	}
+
+	bool HeightmapReader::PngDecoder::Inflate(uint8_t* out, size_t size)
+	{
+		size_t numWritten = 0;
+		while (numWritten < size)
+		{
+			if (m_MatchLength > 0)
+			{
+				const uint32_t numBytes = static_cast<uint32_t>((std::min)(static_cast<size_t>(m_MatchLength), size - numWritten));
+				uint32_t position = static_cast<uint32_t>(m_NumBytesInflated);
+				for (uint32_t i = 0; i < numBytes; ++i, position++)
+				{
+					const uint8_t byte = m_Window[(position - m_MatchDistance) & (WINDOW_SIZE - 1)];
+					m_Window[position & (WINDOW_SIZE - 1)] = byte;
+					out[numWritten++] = byte;
+				}
+
+				m_MatchLength -= numBytes;
+				m_NumBytesInflated += numBytes;
+				continue;
+			}
+
+			if (m_BlockType == BlockType::none)
+			{
+				if (m_IsFinalBlock || !ReadBlockHeader())
+				{
+					return false;
+				}
+				continue;
+			}
+
+			if (m_BlockType == BlockType::stored)
+			{
+				const uint32_t numBytes = static_cast<uint32_t>((std::min)(static_cast<size_t>(m_StoredRemaining), size - numWritten));
+				for (uint32_t i = 0; i < numBytes; i++)
+				{
+					if (!NeedBits(8))
+					{
+						return false;
+					}
+
+					const uint8_t byte = static_cast<uint8_t>(GetBits(8));
+					m_Window[m_NumBytesInflated++ & (WINDOW_SIZE - 1)] = byte;
+					out[numWritten++] = byte;
+				}
+
+				m_StoredRemaining -= numBytes;
+				if (m_StoredRemaining == 0)
+				{
+					m_BlockType = BlockType::none;
+				}
+				continue;
+			}
+
+			uint32_t symbol = 0;
+			if (!DecodeSymbol(m_LiteralTable, symbol))
+			{
+				return false;
+			}
+
+			if (symbol < END_OF_BLOCK)
+			{
+				m_Window[m_NumBytesInflated++ & (WINDOW_SIZE - 1)] = static_cast<uint8_t>(symbol);
+				out[numWritten++] = static_cast<uint8_t>(symbol);
+				continue;
+			}
+
+			if (symbol == END_OF_BLOCK)
+			{
+				m_BlockType = BlockType::none;
+				continue;
+			}
+
+			symbol -= END_OF_BLOCK + 1;
+			if (symbol >= 29 || !NeedBits(LENGTH_EXTRA_BITS[symbol]))
+			{
+				return false;
+			}
+			const uint32_t length = LENGTH_BASES[symbol] + GetBits(LENGTH_EXTRA_BITS[symbol]);
+
+			uint32_t distanceSymbol = 0;
+			if (!DecodeSymbol(m_DistanceTable, distanceSymbol) || distanceSymbol >= NUM_DISTANCE_CODES || !NeedBits(DISTANCE_EXTRA_BITS[distanceSymbol]))
+			{
+				return false;
+			}
+			const uint32_t distance = DISTANCE_BASES[distanceSymbol] + GetBits(DISTANCE_EXTRA_BITS[distanceSymbol]);
+			if (distance > m_NumBytesInflated)
+			{
+				return false;
+			}
+
+			m_MatchLength = length;
+			m_MatchDistance = distance;
+		}
+
+		return true;
+	}
+
+	bool HeightmapReader::PngDecoder::ReadRow(uint16_t* outHeights)
+	{
+		std::swap(m_Row, m_PreviousRow);
+		if (!Inflate(m_Row.data(), m_Row.size()))
+		{
+			return false;
+		}
+
+		// Undo the row filter, the previous row is all zeros before the first one
+		const uint32_t filter = m_Row[0];
+		uint8_t* row = m_Row.data() + 1;
+		const uint8_t* previous = m_PreviousRow.data() + 1;
+		const size_t rowSize = m_Row.size() - 1;
+		const size_t bpp = m_BytesPerPixel;
+		switch (filter)
+		{
+		case 0:
+			break;
+		case 1:
+			for (size_t i = bpp; i < rowSize; i++)
+			{
+				row[i] = static_cast<uint8_t>(row[i] + row[i - bpp]);
+			}
+			break;
+		case 2:
+			for (size_t i = 0; i < rowSize; i++)
+			{
+				row[i] = static_cast<uint8_t>(row[i] + previous[i]);
+			}
+			break;
+		case 3:
+			for (size_t i = 0; i < rowSize; i++)
+			{
+				const uint32_t left = i >= bpp ? row[i - bpp] : 0;
+				row[i] = static_cast<uint8_t>(row[i] + ((left + previous[i]) >> 1));
+			}
+			break;
+		case 4:
+			for (size_t i = 0; i < rowSize; i++)
+			{
+				const int32_t left = i >= bpp ? row[i - bpp] : 0;
+				const int32_t up = previous[i];
+				const int32_t upLeft = i >= bpp ? previous[i - bpp] : 0;
+				const int32_t estimate = left + up - upLeft;
+				const int32_t leftDistance = std::abs(estimate - left);
+				const int32_t upDistance = std::abs(estimate - up);
+				const int32_t upLeftDistance = std::abs(estimate - upLeft);
+				int32_t predictor = upLeft;
+				if (leftDistance <= upDistance && leftDistance <= upLeftDistance)
+				{
+					predictor = left;
+				}
+				else if (upDistance <= upLeftDistance)
+				{
+					predictor = up;
+				}
+				row[i] = static_cast<uint8_t>(row[i] + predictor);
+			}
+			break;
+		default:
+			return false;
+		}
+
+		// Samples are big endian, the gray channel comes first
+		if (m_BytesPerSample == 2)
+		{
+			for (uint32_t x = 0; x < m_Width; x++)
+			{
+				outHeights[x] = static_cast<uint16_t>((row[x * bpp] << 8) | row[x * bpp + 1]);
+			}
+		}
+		else
+		{
+			for (uint32_t x = 0; x < m_Width; x++)
+			{
+				outHeights[x] = static_cast<uint16_t>(row[x * bpp] * 257);
+			}
+		}
+
+		return true;
+	}
+
+	HeightmapReader::HeightmapReader() = default;
+
+	HeightmapReader::~HeightmapReader()
+	{
+		Close();
+	}
+
+	bool HeightmapReader::OpenRaw(const char* path, uint32_t width, uint32_t height, bool isBigEndian)
+	{
+		Close();
+
+		m_File = OpenFile(path, "rb");
+		if (m_File == nullptr)
+		{
+			printf("[HeightmapReader] Failed to open '%s'\n", path);
+			return false;
+		}
+
+		uint64_t fileSize = 0;
+		if (width == 0 || height == 0 || !GetFileSize(m_File, fileSize) || fileSize != static_cast<uint64_t>(width) * height * sizeof(uint16_t))
+		{
+			printf("[HeightmapReader] '%s' is not a %ux%u 16 bit RAW heightmap\n", path, width, height);
+			Close();
+			return false;
+		}
+
+		m_Width = width;
+		m_Height = height;
+		m_IsBigEndian = isBigEndian;
+		return true;
+	}
+
+	bool HeightmapReader::OpenPng(const char* path)
+	{
+		Close();
+
+		m_File = OpenFile(path, "rb");
+		if (m_File == nullptr)
+		{
+			printf("[HeightmapReader] Failed to open '%s'\n", path);
+			return false;
+		}
+
+		m_PngDecoder = std::make_unique<PngDecoder>();
+		if (!m_PngDecoder->Open(m_File, path, m_Width, m_Height))
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void HeightmapReader::Close()
+	{
+		if (m_File != nullptr)
+		{
+			fclose(m_File);
+		}
+
+		m_File = nullptr;
+		m_Width = 0;
+		m_Height = 0;
+		m_NextRow = 0;
+		m_IsBigEndian = false;
+		m_PngDecoder.reset();
+	}
+
+	bool HeightmapReader::ReadRawRow(uint16_t* outHeights)
+	{
+		if (fread(outHeights, sizeof(uint16_t), m_Width, m_File) != m_Width)
+		{
+			return false;
+		}
+
+		// Heights are read as they are stored, swap them when the file and the machine disagree
+		const uint16_t one = 1;
+		uint8_t isLittleEndianMachine = 0;
+		memcpy(&isLittleEndianMachine, &one, 1);
+		if ((isLittleEndianMachine != 0) == m_IsBigEndian)
+		{
+			for (uint32_t x = 0; x < m_Width; x++)
+			{
+				outHeights[x] = static_cast<uint16_t>((outHeights[x] >> 8) | (outHeights[x] << 8));
+			}
+		}
+
+		return true;
+	}
+
+	bool HeightmapReader::ReadRows(uint32_t numRows, uint16_t* outHeights)
+	{
+		if (m_File == nullptr || numRows > m_Height - m_NextRow)
+		{
+			return false;
+		}
+
+		for (uint32_t row = 0; row < numRows; row++)
+		{
+			uint16_t* rowHeights = outHeights + static_cast<size_t>(row) * m_Width;
+			const bool isRead = m_PngDecoder ? m_PngDecoder->ReadRow(rowHeights) : ReadRawRow(rowHeights);
+			if (!isRead)
+			{
+				printf("[HeightmapReader] Failed to read row %u, the file is truncated or corrupt\n", m_NextRow);
+				return false;
+			}
+
+			++m_NextRow;
+		}
+
+		return true;
+	}
+
+	size_t HeightmapReader::GetMemoryUsage() const
+	{
+		return sizeof(HeightmapReader) + (m_PngDecoder ? m_PngDecoder->GetMemoryUsage() : 0);
+	}
+}
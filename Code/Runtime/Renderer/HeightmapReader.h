@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace Styx
+{
+	// NOTE: Reads a heightmap file top to bottom, a few rows at a time, so maps far larger than memory can be imported.
+	// Supports headerless 16 bit RAW files and non-interlaced grayscale PNGs of 8 or 16 bits, with or without alpha.
+	// PNGs are inflated as their rows are read, only the previous row and the 32 KB deflate window are kept.
+	// Heights come out as 16 bit values, 8 bit maps are scaled to the full range.
+	class HeightmapReader
+	{
+	public:
+		HeightmapReader();
+		~HeightmapReader();
+
+		HeightmapReader(const HeightmapReader&) = delete;
+		HeightmapReader& operator=(const HeightmapReader&) = delete;
+
+		// RAW files don't store their size. Rows are width little endian heights, unless isBigEndian.
+		bool OpenRaw(const char* path, uint32_t width, uint32_t height, bool isBigEndian = false);
+		bool OpenPng(const char* path);
+		void Close();
+
+		// Reads the next numRows rows into outHeights, width heights per row. Fails past the last row or on a corrupt file.
+		bool ReadRows(uint32_t numRows, uint16_t* outHeights);
+
+		uint32_t GetWidth() const { return m_Width; }
+		uint32_t GetHeight() const { return m_Height; }
+		// Index of the next row ReadRows returns
+		uint32_t GetNextRow() const { return m_NextRow; }
+		// Bytes held while reading, the PNG decoder state included
+		size_t GetMemoryUsage() const;
+
+	private:
+		class PngDecoder;
+
+		bool ReadRawRow(uint16_t* outHeights);
+
+		FILE* m_File = nullptr;
+		uint32_t m_Width = 0;
+		uint32_t m_Height = 0;
+		uint32_t m_NextRow = 0;
+		bool m_IsBigEndian = false;
+		std::unique_ptr<PngDecoder> m_PngDecoder;
+	};
+}
@@ -4,7 +4,12 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <algorithm>
 #include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <numeric>
 
 namespace Styx
 {
@@ -19,38 +24,339 @@ namespace Styx
 		}
 
 		ProcessNode(scene->mRootNode, scene, nullptr);
+
+		m_DrawList.Clear();
+		m_ModelDraws.clear();
+		BuildDrawList(m_Root);
+
+		m_FrameDrawData.resize(D3D12Lite::NUM_FRAMES_IN_FLIGHT);
 	}
 
 	void Scene::Shutdown()
 	{
 		m_Root->Destroy(m_Device);
+
+		for (FrameDrawData& frameDrawData : m_FrameDrawData)
+		{
+			m_Device->DestroyBuffer(frameDrawData.drawDataBuffer);
+			m_Device->DestroyBuffer(frameDrawData.transformBuffer);
+			m_Device->DestroyBuffer(frameDrawData.argumentBuffer);
+		}
+
+		if (m_DrawCommandSignature)
+		{
+			m_Device->DestroyCommandSignature(std::move(m_DrawCommandSignature));
+		}
+	}
+
+	void Scene::SetViewProjection(const DirectX::XMMATRIX& viewProjection)
+	{
+		DirectX::XMFLOAT4X4 newViewProjection;
+		DirectX::XMStoreFloat4x4(&newViewProjection, viewProjection);
+
+		// Only an actual change of view can change what is visible
+		if (!m_HasViewProjection || memcmp(&newViewProjection, &m_ViewProjection, sizeof(newViewProjection)) != 0)
+		{
+			m_ViewProjection = newViewProjection;
+			m_HasViewProjection = true;
+			m_IsVisibilityDirty = true;
+		}
 	}
 
-	void Scene::Render(D3D12Lite::GraphicsContext* gfx)
+	void Scene::Render(D3D12Lite::GraphicsContext* gfx, const D3D12Lite::PipelineStateObject* pipeline)
 	{
-		DrawModel(gfx, m_Root);
+		PrepareDraws(gfx, pipeline);
+		gfx->Replay(m_FrameDrawData[m_Device->GetFrameId()].commands);
+
+		m_DrawDataStats.numRecordingThreads = 1;
 	}
 
-	void Scene::DrawModel(D3D12Lite::GraphicsContext* gfx, Model* model)
+	const std::vector<D3D12Lite::GraphicsContext*>& Scene::RenderParallel(D3D12Lite::GraphicsContext* gfx, const D3D12Lite::PipelineStateObject* pipeline, uint32_t maxThreads)
 	{
-		for (uint32_t i = 0; i < model->meshes.size(); i++)
+		if (!m_ParallelRecorder)
 		{
-			gfx->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-			gfx->SetIndexBuffer(*model->meshes[i].indexBuffer);
+			// NOTE: Below a few hundred draws a chunk costs more to set up than it saves
+			constexpr uint32_t minDrawsPerChunk = 256;
+			m_ParallelRecorder = std::make_unique<D3D12Lite::ParallelRecorder<D3D12Lite::GraphicsContext, D3D12Lite::GraphicsContextState>>(m_Device->GetGraphicsContextPool(), maxThreads, minDrawsPerChunk);
+		}
 
-			gfx->SetPipeline32BitConstants(1, 16, model->transforms[i].worldMatrix.m, 0);
-			gfx->SetPipeline32BitConstant(1, model->meshes[i].vertexOffset, 16);
-			gfx->SetPipeline32BitConstant(1, model->meshes[i].positionBuffer->mDescriptorHeapIndex, 17);
-			gfx->SetPipeline32BitConstant(1, model->meshes[i].normalBuffer->mDescriptorHeapIndex, 18);
-			gfx->SetPipeline32BitConstant(1, model->meshes[i].tangentBuffer->mDescriptorHeapIndex, 19);
-			gfx->SetPipeline32BitConstant(1, model->meshes[i].uvBuffer->mDescriptorHeapIndex, 20);
+		m_ParallelRecorder->SetMaxThreads(maxThreads);
 
-			gfx->DrawIndexed(model->meshes[i].indexCount, model->meshes[i].indexOffset, 0);
+		// Recording only reads the draw list, the argument buffer and the bindings captured here, so chunks don't share
+		// any mutable state. Everything that writes (draw data upload, argument build) happens in PrepareDraws.
+		const uint32_t numCommands = PrepareDraws(gfx, pipeline);
+		m_ParallelRecorder->Record(gfx->GetState(), numCommands, [this](D3D12Lite::GraphicsContext& chunkContext, uint32_t firstCommand, uint32_t numChunkCommands)
+		{
+			RecordDraws(&chunkContext, firstCommand, numChunkCommands);
+		});
+
+		const D3D12Lite::ParallelRecordingStats& recordingStats = m_ParallelRecorder->GetStats();
+		m_DrawDataStats.numRecordingThreads = recordingStats.mNumThreads;
+		m_DrawDataStats.recordTimeInMilliseconds = recordingStats.mRecordTimeInMilliseconds;
+
+		return m_ParallelRecorder->GetRecordedContexts();
+	}
+
+	uint32_t Scene::PrepareDraws(D3D12Lite::GraphicsContext* gfx, const D3D12Lite::PipelineStateObject* pipeline)
+	{
+		if (m_DrawList.GetNumDraws() == 0)
+		{
+			return 0;
+		}
+
+		std::chrono::high_resolution_clock::time_point prepareStart = std::chrono::high_resolution_clock::now();
+
+		// The signature's draw ID argument is tied to the pipeline's root signature
+		if (m_DrawCommandSignaturePipeline != pipeline)
+		{
+			if (m_DrawCommandSignature)
+			{
+				m_Device->DestroyCommandSignature(std::move(m_DrawCommandSignature));
+			}
+
+			m_DrawCommandSignature = m_Device->CreateCommandSignature(D3D12Lite::CommandSignatureType::drawIndexedWithDrawId, pipeline);
+			m_DrawCommandSignaturePipeline = pipeline;
+			m_CommandsVersion++;
+		}
+
+		SyncModels();
+		UpdateVisibleDraws();
+		UpdateDrawData();
+
+		FrameDrawData& frameDrawData = m_FrameDrawData[m_Device->GetFrameId()];
+		gfx->SetRootConstant(m_Device->GetDescriptorHeapIndex(frameDrawData.drawDataBuffer), 1);
+		gfx->SetRootConstant(m_Device->GetDescriptorHeapIndex(frameDrawData.transformBuffer), 2);
+		gfx->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+		const uint32_t numVisibleDraws = static_cast<uint32_t>(m_VisibleDrawIds.size());
+		m_DrawDataStats.numVisibleDraws = numVisibleDraws;
+		m_DrawDataStats.reusedCommands = frameDrawData.commandsVersion == m_CommandsVersion;
+		m_DrawDataStats.argumentBuildTimeInMilliseconds = 0.0;
+
+		if (!m_DrawDataStats.reusedCommands)
+		{
+			const uint32_t commandStride = m_DrawCommandSignature->mByteStride;
+
+			if (frameDrawData.argumentCapacity < numVisibleDraws)
+			{
+				m_Device->DestroyBuffer(frameDrawData.argumentBuffer);
+
+				D3D12Lite::BufferCreationDesc desc{};
+				desc.mSize = numVisibleDraws * commandStride;
+				desc.mStride = commandStride;
+				desc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
+				desc.mViewFlags = D3D12Lite::BufferViewFlags::none;
+				desc.mDebugName = L"Scene::DrawArgumentBuffer";
+
+				frameDrawData.argumentBuffer = m_Device->CreateBuffer(desc);
+				frameDrawData.argumentCapacity = numVisibleDraws;
+			}
+
+			std::chrono::high_resolution_clock::time_point buildStart = std::chrono::high_resolution_clock::now();
+			const D3D12Lite::IndirectDrawSource drawSource = m_DrawList.GetIndirectDrawSource();
+			D3D12Lite::IndirectDrawIndexedCommand* arguments = numVisibleDraws > 0 ? reinterpret_cast<D3D12Lite::IndirectDrawIndexedCommand*>(m_Device->GetBuffer(frameDrawData.argumentBuffer).mMappedResource) : nullptr;
+			m_IndirectDrawBuilder.Build(drawSource, m_VisibleDrawIds.data(), numVisibleDraws, arguments);
+			std::chrono::high_resolution_clock::time_point buildEnd = std::chrono::high_resolution_clock::now();
+
+			m_DrawDataStats.argumentBuildTimeInMilliseconds = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+			// NOTE: The argument buffer and the signature outlive the stream: both are only replaced by bumping m_CommandsVersion
+			frameDrawData.commands.Clear();
+			for (const D3D12Lite::IndirectDrawBucket& bucket : m_IndirectDrawBuilder.GetBuckets())
+			{
+				D3D12Lite::ExecuteIndirectPacket packet;
+				packet.mCommandSignature = m_DrawCommandSignature.get();
+				packet.mArgumentBuffer = &m_Device->GetBuffer(frameDrawData.argumentBuffer);
+				packet.mArgumentOffset = static_cast<uint64_t>(bucket.mFirstCommand) * commandStride;
+				packet.mNumCommands = bucket.mNumCommands;
+				frameDrawData.commands.Record(packet);
+			}
+
+			frameDrawData.commandsVersion = m_CommandsVersion;
+		}
+
+		m_DrawArgumentBuffer = numVisibleDraws > 0 ? &m_Device->GetBuffer(frameDrawData.argumentBuffer) : nullptr;
+		m_DrawArgumentOffset = 0;
+
+		m_DrawDataStats.numIndirectBuckets = static_cast<uint32_t>(m_IndirectDrawBuilder.GetBuckets().size());
+		m_DrawDataStats.prepareTimeInMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - prepareStart).count();
+
+		return numVisibleDraws;
+	}
+
+	void Scene::RecordDraws(D3D12Lite::GraphicsContext* gfx, uint32_t firstCommand, uint32_t numCommands) const
+	{
+		const uint32_t endCommand = firstCommand + numCommands;
+		const uint32_t commandStride = m_DrawCommandSignature ? m_DrawCommandSignature->mByteStride : 0;
+
+		// One ExecuteIndirect per bucket overlapping [firstCommand, endCommand). Buckets will switch pipelines once
+		// materials have their own, for now they all use the pipeline bound by the caller.
+		for (const D3D12Lite::IndirectDrawBucket& bucket : m_IndirectDrawBuilder.GetBuckets())
+		{
+			const uint32_t bucketFirstCommand = (std::max)(bucket.mFirstCommand, firstCommand);
+			const uint32_t bucketEndCommand = (std::min)(bucket.mFirstCommand + bucket.mNumCommands, endCommand);
+
+			if (bucketFirstCommand < bucketEndCommand)
+			{
+				gfx->ExecuteIndirect(*m_DrawCommandSignature, *m_DrawArgumentBuffer, m_DrawArgumentOffset + bucketFirstCommand * commandStride, bucketEndCommand - bucketFirstCommand);
+			}
+		}
+	}
+
+	void Scene::BuildDrawList(Model* model)
+	{
+		ModelDraws& modelDraws = m_ModelDraws.emplace_back();
+		modelDraws.model = model;
+		modelDraws.firstDraw = m_DrawList.GetNumDraws();
+		modelDraws.numDraws = static_cast<uint32_t>(model->meshes.size());
+		modelDraws.transformVersion = model->m_TransformVersion;
+		modelDraws.meshVersion = model->m_MeshVersion;
+
+		for (uint32_t i = 0; i < model->meshes.size(); i++)
+		{
+			uint32_t transformIndex = m_DrawList.AddTransform(model->transforms[i]);
+			m_DrawList.AddDraw(m_Device, model->meshes[i], transformIndex, 0);
 		}
 
 		for (uint32_t i = 0; i < model->m_Children.size(); i++)
 		{
-			DrawModel(gfx, model->m_Children[i]);
+			BuildDrawList(model->m_Children[i]);
+		}
+	}
+
+	void Scene::SyncModels()
+	{
+		// A model's draws are contiguous and each has its own transform, so changes are copied over range by range
+		for (ModelDraws& modelDraws : m_ModelDraws)
+		{
+			const Model* model = modelDraws.model;
+			assert(model->meshes.size() == modelDraws.numDraws);
+
+			if (modelDraws.meshVersion != model->m_MeshVersion)
+			{
+				for (uint32_t i = 0; i < modelDraws.numDraws; i++)
+				{
+					m_DrawList.SetDrawMesh(m_Device, modelDraws.firstDraw + i, model->meshes[i]);
+				}
+
+				modelDraws.meshVersion = model->m_MeshVersion;
+				m_DrawDataVersion++;
+				m_CommandsVersion++;
+				m_IsVisibilityDirty = true;
+			}
+
+			if (modelDraws.transformVersion != model->m_TransformVersion)
+			{
+				for (uint32_t i = 0; i < modelDraws.numDraws; i++)
+				{
+					m_DrawList.transforms[m_DrawList.transformIndices[modelDraws.firstDraw + i]] = model->transforms[i].worldMatrix;
+				}
+
+				m_DrawList.UpdateWorldBounds(modelDraws.firstDraw, modelDraws.numDraws);
+
+				modelDraws.transformVersion = model->m_TransformVersion;
+				m_TransformVersion++;
+				m_IsVisibilityDirty = true;
+			}
+		}
+	}
+
+	void Scene::UpdateVisibleDraws()
+	{
+		m_DrawDataStats.cullTimeInMilliseconds = 0.0;
+
+		if (!m_IsVisibilityDirty)
+		{
+			return;
+		}
+
+		std::chrono::high_resolution_clock::time_point cullStart = std::chrono::high_resolution_clock::now();
+
+		if (m_HasViewProjection)
+		{
+			CullDraws(m_DrawList, m_ViewProjection, m_CulledDrawIdsScratch);
+		}
+		else
+		{
+			m_CulledDrawIdsScratch.resize(m_DrawList.GetNumDraws());
+			std::iota(m_CulledDrawIdsScratch.begin(), m_CulledDrawIdsScratch.end(), 0);
+		}
+
+		// A moving view often keeps the same draws in sight, in which case the recorded commands are still valid
+		if (m_CulledDrawIdsScratch != m_CulledDrawIds)
+		{
+			std::swap(m_CulledDrawIds, m_CulledDrawIdsScratch);
+
+			m_VisibleDrawIds = m_CulledDrawIds;
+			D3D12Lite::IndirectDrawBuilder::SortByBucket(m_DrawList.GetIndirectDrawSource(), m_VisibleDrawIds);
+
+			m_CommandsVersion++;
+		}
+
+		m_IsVisibilityDirty = false;
+		m_DrawDataStats.cullTimeInMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cullStart).count();
+	}
+
+	void Scene::UpdateDrawData()
+	{
+		FrameDrawData& frameDrawData = m_FrameDrawData[m_Device->GetFrameId()];
+		const uint32_t numDraws = m_DrawList.GetNumDraws();
+		const uint32_t numTransforms = m_DrawList.GetNumTransforms();
+
+		// The buffers of this frame are no longer read by the GPU, so they can be rewritten in place. They only grow.
+		if (frameDrawData.drawCapacity < numDraws)
+		{
+			m_Device->DestroyBuffer(frameDrawData.drawDataBuffer);
+
+			D3D12Lite::BufferCreationDesc desc{};
+			desc.mSize = numDraws * sizeof(PerDrawData);
+			desc.mStride = sizeof(PerDrawData);
+			desc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
+			desc.mViewFlags = D3D12Lite::BufferViewFlags::srv;
+			desc.mDebugName = L"Scene::DrawDataBuffer";
+
+			frameDrawData.drawDataBuffer = m_Device->CreateBuffer(desc);
+			frameDrawData.drawCapacity = numDraws;
+			frameDrawData.drawDataVersion = 0;
+		}
+
+		if (frameDrawData.transformCapacity < numTransforms)
+		{
+			m_Device->DestroyBuffer(frameDrawData.transformBuffer);
+
+			D3D12Lite::BufferCreationDesc desc{};
+			desc.mSize = numTransforms * sizeof(DirectX::XMFLOAT4X4);
+			desc.mStride = sizeof(DirectX::XMFLOAT4X4);
+			desc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
+			desc.mViewFlags = D3D12Lite::BufferViewFlags::srv;
+			desc.mDebugName = L"Scene::TransformBuffer";
+
+			frameDrawData.transformBuffer = m_Device->CreateBuffer(desc);
+			frameDrawData.transformCapacity = numTransforms;
+			frameDrawData.transformVersion = 0;
+		}
+
+		m_DrawDataStats.numDraws = numDraws;
+		m_DrawDataStats.packTimeInMilliseconds = 0.0;
+
+		// Buffers that are up to date with the scene are left alone, a static scene only uploads in its first frames
+		if (frameDrawData.drawDataVersion != m_DrawDataVersion)
+		{
+			std::chrono::high_resolution_clock::time_point packStart = std::chrono::high_resolution_clock::now();
+
+			PerDrawData* drawData = reinterpret_cast<PerDrawData*>(m_Device->GetBuffer(frameDrawData.drawDataBuffer).mMappedResource);
+			PackDrawData(m_DrawList, 0, numDraws, drawData);
+			frameDrawData.drawDataVersion = m_DrawDataVersion;
+
+			std::chrono::high_resolution_clock::time_point packEnd = std::chrono::high_resolution_clock::now();
+			m_DrawDataStats.packTimeInMilliseconds = std::chrono::duration<double, std::milli>(packEnd - packStart).count();
+		}
+
+		if (frameDrawData.transformVersion != m_TransformVersion)
+		{
+			uint8_t* transforms = m_Device->GetBuffer(frameDrawData.transformBuffer).mMappedResource;
+			memcpy(transforms, m_DrawList.transforms.data(), numTransforms * sizeof(DirectX::XMFLOAT4X4));
+			frameDrawData.transformVersion = m_TransformVersion;
 		}
 	}
 
@@ -133,6 +439,17 @@ namespace Styx
 			uvs.push_back(mesh->mTextureCoords[0][i].y);
 		}
 
+		DirectX::XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		DirectX::XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint32_t i = 0; i < mesh->mNumVertices; i++)
+		{
+			boundsMin = DirectX::XMFLOAT3((std::min)(boundsMin.x, mesh->mVertices[i].x), (std::min)(boundsMin.y, mesh->mVertices[i].y), (std::min)(boundsMin.z, mesh->mVertices[i].z));
+			boundsMax = DirectX::XMFLOAT3((std::max)(boundsMax.x, mesh->mVertices[i].x), (std::max)(boundsMax.y, mesh->mVertices[i].y), (std::max)(boundsMax.z, mesh->mVertices[i].z));
+		}
+
+		outMesh.boundsCenter = DirectX::XMFLOAT3((boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f);
+		outMesh.boundsExtents = DirectX::XMFLOAT3((boundsMax.x - boundsMin.x) * 0.5f, (boundsMax.y - boundsMin.y) * 0.5f, (boundsMax.z - boundsMin.z) * 0.5f);
+
 		for (uint32_t i = 0; i < mesh->mNumFaces; i++)
 		{
 			aiFace face = mesh->mFaces[i];
@@ -173,7 +490,7 @@ namespace Styx
 			outMesh.positionBuffer = device->CreateBuffer(desc);
 
 			std::unique_ptr<D3D12Lite::BufferUpload> uploadBuffer = std::make_unique<D3D12Lite::BufferUpload>();
-			uploadBuffer->mBuffer = outMesh.positionBuffer.get();
+			uploadBuffer->mBuffer = &device->GetBuffer(outMesh.positionBuffer);
 			uploadBuffer->mBufferData = std::make_unique<uint8_t[]>(sizeInBytes);
 			uploadBuffer->mBufferDataSize = sizeInBytes;
 
@@ -195,7 +512,7 @@ namespace Styx
 			outMesh.normalBuffer = device->CreateBuffer(desc);
 
 			std::unique_ptr<D3D12Lite::BufferUpload> uploadBuffer = std::make_unique<D3D12Lite::BufferUpload>();
-			uploadBuffer->mBuffer = outMesh.normalBuffer.get();
+			uploadBuffer->mBuffer = &device->GetBuffer(outMesh.normalBuffer);
 			uploadBuffer->mBufferData = std::make_unique<uint8_t[]>(sizeInBytes);
 			uploadBuffer->mBufferDataSize = sizeInBytes;
 
@@ -217,7 +534,7 @@ namespace Styx
 			outMesh.tangentBuffer = device->CreateBuffer(desc);
 
 			std::unique_ptr<D3D12Lite::BufferUpload> uploadBuffer = std::make_unique<D3D12Lite::BufferUpload>();
-			uploadBuffer->mBuffer = outMesh.tangentBuffer.get();
+			uploadBuffer->mBuffer = &device->GetBuffer(outMesh.tangentBuffer);
 			uploadBuffer->mBufferData = std::make_unique<uint8_t[]>(sizeInBytes);
 			uploadBuffer->mBufferDataSize = sizeInBytes;
 
@@ -238,7 +555,7 @@ namespace Styx
 			outMesh.uvBuffer = device->CreateBuffer(desc);
 
 			std::unique_ptr<D3D12Lite::BufferUpload> uploadBuffer = std::make_unique<D3D12Lite::BufferUpload>();
-			uploadBuffer->mBuffer = outMesh.uvBuffer.get();
+			uploadBuffer->mBuffer = &device->GetBuffer(outMesh.uvBuffer);
 			uploadBuffer->mBufferData = std::make_unique<uint8_t[]>(sizeInBytes);
 			uploadBuffer->mBufferDataSize = sizeInBytes;
 
@@ -260,7 +577,7 @@ namespace Styx
 			outMesh.indexBuffer = device->CreateBuffer(desc);
 
 			std::unique_ptr<D3D12Lite::BufferUpload> uploadBuffer = std::make_unique<D3D12Lite::BufferUpload>();
-			uploadBuffer->mBuffer = outMesh.indexBuffer.get();
+			uploadBuffer->mBuffer = &device->GetBuffer(outMesh.indexBuffer);
 			uploadBuffer->mBufferData = std::make_unique<uint8_t[]>(sizeInBytes);
 			uploadBuffer->mBufferDataSize = sizeInBytes;
 
@@ -271,15 +588,29 @@ namespace Styx
 		return outMesh;
 	}
 
+	void Model::SetTransform(uint32_t index, const Transform& transform)
+	{
+		assert(index < transforms.size());
+		transforms[index] = transform;
+		m_TransformVersion++;
+	}
+
+	void Model::SetMesh(uint32_t index, const Mesh& mesh)
+	{
+		assert(index < meshes.size());
+		meshes[index] = mesh;
+		m_MeshVersion++;
+	}
+
 	void Model::Destroy(D3D12Lite::Device* device)
 	{
 		for (uint32_t i = 0; i < meshes.size(); i++)
 		{
-			device->DestroyBuffer(std::move(meshes[i].positionBuffer));
-			device->DestroyBuffer(std::move(meshes[i].normalBuffer));
-			device->DestroyBuffer(std::move(meshes[i].tangentBuffer));
-			device->DestroyBuffer(std::move(meshes[i].uvBuffer));
-			device->DestroyBuffer(std::move(meshes[i].indexBuffer));
+			device->DestroyBuffer(meshes[i].positionBuffer);
+			device->DestroyBuffer(meshes[i].normalBuffer);
+			device->DestroyBuffer(meshes[i].tangentBuffer);
+			device->DestroyBuffer(meshes[i].uvBuffer);
+			device->DestroyBuffer(meshes[i].indexBuffer);
 		}
 
 		for (uint32_t i = 0; i < m_Children.size(); i++)
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "DrawData.h"
 #include "RendererTypes.h"
+#include "RHI/CommandStream.h"
+#include "RHI/ParallelRecording.h"
 
 #include <stdint.h>
 #include <memory>
@@ -12,7 +15,10 @@ namespace D3D12Lite
 {
 	class Device;
 	struct BufferResource;
+	struct CommandSignature;
+	struct PipelineStateObject;
 	class GraphicsContext;
+	struct GraphicsContextState;
 }
 
 struct aiMesh;
@@ -27,9 +33,33 @@ namespace Styx
 		std::vector<Mesh> meshes;
 		std::vector<Transform> transforms;
 
+		// NOTE: Transforms and meshes of a loaded model have to be changed through these, so the scene can tell which of
+		// its cached draws are stale. SetMesh doesn't destroy the buffers of the mesh it replaces.
+		void SetTransform(uint32_t index, const Transform& transform);
+		void SetMesh(uint32_t index, const Mesh& mesh);
+
 		void Destroy(D3D12Lite::Device* device);
 
 		std::vector<Model*> m_Children;
+		uint32_t m_TransformVersion = 0;
+		uint32_t m_MeshVersion = 0;
+	};
+
+	struct DrawDataStats
+	{
+		uint32_t numDraws = 0;
+		uint32_t numIndirectBuckets = 0;
+		double packTimeInMilliseconds = 0.0;
+		double argumentBuildTimeInMilliseconds = 0.0;
+		uint32_t numRecordingThreads = 0;
+		double recordTimeInMilliseconds = 0.0;
+		uint32_t numVisibleDraws = 0;
+		double cullTimeInMilliseconds = 0.0;
+		// Whether the frame replayed the draw commands recorded in an earlier frame, and what preparing them cost overall
+		bool reusedCommands = false;
+		double prepareTimeInMilliseconds = 0.0;
+
+		double GetDrawsPackedPerMillisecond() const { return packTimeInMilliseconds > 0.0 ? numDraws / packTimeInMilliseconds : 0.0; }
 	};
 
 	class Scene
@@ -41,19 +71,84 @@ namespace Styx
 		void Initialize(const char* path);
 		void Shutdown();
 
-		void Render(D3D12Lite::GraphicsContext* gfx);
+		// Draws outside the view frustum are culled. Until a view is set every draw is visible.
+		void SetViewProjection(const DirectX::XMMATRIX& viewProjection);
+
+		// Expects pipeline to be bound, with 3 root constants: draw ID, draw data buffer index and transform buffer index (see Common.hlsl)
+		void Render(D3D12Lite::GraphicsContext* gfx, const D3D12Lite::PipelineStateObject* pipeline);
+		// Same as Render, but the draws are recorded into pooled contexts on up to maxThreads threads, inheriting gfx's bindings.
+		// The returned contexts must be submitted in order right after gfx, in the same batch. gfx records no draws, so
+		// anything meant to run after them has to go to another context.
+		const std::vector<D3D12Lite::GraphicsContext*>& RenderParallel(D3D12Lite::GraphicsContext* gfx, const D3D12Lite::PipelineStateObject* pipeline, uint32_t maxThreads);
+
+		const DrawDataStats& GetDrawDataStats() const { return m_DrawDataStats; }
 
 	public:
 		static Mesh ProcessMesh(D3D12Lite::Device* device, aiMesh* mesh, const aiScene* scene);
 
 	private:
-		void DrawModel(D3D12Lite::GraphicsContext* gfx, Model* model);
+		void BuildDrawList(Model* model);
+		void SyncModels();
+		void UpdateVisibleDraws();
+		void UpdateDrawData();
+		uint32_t PrepareDraws(D3D12Lite::GraphicsContext* gfx, const D3D12Lite::PipelineStateObject* pipeline);
+		void RecordDraws(D3D12Lite::GraphicsContext* gfx, uint32_t firstCommand, uint32_t numCommands) const;
 		void ProcessNode(aiNode* node, const aiScene* scene, Model* parent);
 
 	public:
 		Model* m_Root;
 
 	private:
+		// NOTE: Everything the GPU reads is kept per frame in flight and stamped with the scene version it was written
+		// from. A static scene with a static view rewrites nothing and replays the commands recorded for its frame slot.
+		struct FrameDrawData
+		{
+			D3D12Lite::BufferHandle drawDataBuffer;
+			D3D12Lite::BufferHandle transformBuffer;
+			D3D12Lite::BufferHandle argumentBuffer;
+			uint32_t drawCapacity = 0;
+			uint32_t transformCapacity = 0;
+			uint32_t argumentCapacity = 0;
+			uint32_t drawDataVersion = 0;
+			uint32_t transformVersion = 0;
+			uint32_t commandsVersion = 0;
+			D3D12Lite::CommandStream commands;
+		};
+
+		struct ModelDraws
+		{
+			Model* model = nullptr;
+			uint32_t firstDraw = 0;
+			uint32_t numDraws = 0;
+			uint32_t transformVersion = 0;
+			uint32_t meshVersion = 0;
+		};
+
 		D3D12Lite::Device* m_Device;
+
+		DrawList m_DrawList;
+		std::vector<ModelDraws> m_ModelDraws;
+		std::vector<FrameDrawData> m_FrameDrawData;
+		DrawDataStats m_DrawDataStats;
+
+		// Bumped whenever the per-draw data, the transforms or the recorded commands (visible set, arguments) go stale.
+		// They start at 1 so that freshly created frame data is stale.
+		uint32_t m_DrawDataVersion = 1;
+		uint32_t m_TransformVersion = 1;
+		uint32_t m_CommandsVersion = 1;
+
+		DirectX::XMFLOAT4X4 m_ViewProjection;
+		bool m_HasViewProjection = false;
+		bool m_IsVisibilityDirty = true;
+		std::vector<uint32_t> m_CulledDrawIds;
+		std::vector<uint32_t> m_CulledDrawIdsScratch;
+		// m_CulledDrawIds sorted by bucket
+		std::vector<uint32_t> m_VisibleDrawIds;
+		D3D12Lite::IndirectDrawBuilder m_IndirectDrawBuilder;
+		const D3D12Lite::BufferResource* m_DrawArgumentBuffer = nullptr;
+		uint64_t m_DrawArgumentOffset = 0;
+		std::unique_ptr<D3D12Lite::ParallelRecorder<D3D12Lite::GraphicsContext, D3D12Lite::GraphicsContextState>> m_ParallelRecorder;
+		std::unique_ptr<D3D12Lite::CommandSignature> m_DrawCommandSignature;
+		const D3D12Lite::PipelineStateObject* m_DrawCommandSignaturePipeline = nullptr;
 	};
 }
@@ -1,13 +1,10 @@
 #pragma once
 
+#include "RHI/ResourceHandle.h"
+
 #include <DirectXMath.h>
 #include <memory>
 
-namespace D3D12Lite
-{
-	struct BufferResource;
-}
-
 namespace Styx
 {
 	struct Camera
@@ -39,10 +36,14 @@ namespace Styx
 		uint32_t indexCount;
 		uint32_t indexOffset;
 
-		std::unique_ptr<D3D12Lite::BufferResource> positionBuffer;
-		std::unique_ptr<D3D12Lite::BufferResource> normalBuffer;
-		std::unique_ptr<D3D12Lite::BufferResource> tangentBuffer;
-		std::unique_ptr<D3D12Lite::BufferResource> uvBuffer;
-		std::unique_ptr<D3D12Lite::BufferResource> indexBuffer;
+		// Object space axis aligned bounds
+		DirectX::XMFLOAT3 boundsCenter;
+		DirectX::XMFLOAT3 boundsExtents;
+
+		D3D12Lite::BufferHandle positionBuffer;
+		D3D12Lite::BufferHandle normalBuffer;
+		D3D12Lite::BufferHandle tangentBuffer;
+		D3D12Lite::BufferHandle uvBuffer;
+		D3D12Lite::BufferHandle indexBuffer;
 	};
 }
@@ -0,0 +1,504 @@
+#include "TerrainErosion.h"
+#include "Core/JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	// Rain is hashed from these, like the lattice points of the heightfield noise
+	constexpr uint32_t PRIME_X = 501125321u;
+	constexpr uint32_t PRIME_Y = 1136930381u;
+	constexpr uint32_t PRIME_ITERATION = 2654435761u;
+
+	// Water shallower than this doesn't move fast enough to carry anything
+	constexpr float MIN_WATER_DEPTH = 1e-4f;
+
+	float HashToUnitFloat(uint32_t seed, uint32_t x, uint32_t y, uint32_t iteration)
+	{
+		uint32_t hash = seed ^ (x * PRIME_X) ^ (y * PRIME_Y) ^ (iteration * PRIME_ITERATION);
+		hash ^= hash >> 16;
+		hash *= 0x7feb352du;
+		hash ^= hash >> 15;
+		hash *= 0x846ca68bu;
+		hash ^= hash >> 16;
+
+		return static_cast<float>(hash >> 8) * (1.0f / 16777216.0f);
+	}
+}
+
+Styx::TerrainErosion::TerrainErosion(const TerrainErosionDesc& desc)
+	: m_Desc(desc)
+{
+	assert(desc.blockSize > 0);
+	assert(desc.cellSize > 0.0f && desc.timeStep > 0.0f && desc.erosionDepth > 0.0f);
+}
+
+void Styx::TerrainErosion::Reset(const float* heights, uint32_t width, uint32_t height, uint32_t rowPitch, int32_t originX, int32_t originY)
+{
+	assert(width > 0 && height > 0);
+
+	m_Width = width;
+	m_Height = height;
+	m_OriginX = originX;
+	m_OriginY = originY;
+	m_NumBlocksX = (width + m_Desc.blockSize - 1) / m_Desc.blockSize;
+	m_NumBlocksY = (height + m_Desc.blockSize - 1) / m_Desc.blockSize;
+	m_NumIterations = 0;
+
+	m_Blocks.clear();
+	m_Blocks.resize(static_cast<size_t>(m_NumBlocksX) * m_NumBlocksY);
+
+	for (uint32_t blockY = 0; blockY < m_NumBlocksY; blockY++)
+	{
+		for (uint32_t blockX = 0; blockX < m_NumBlocksX; blockX++)
+		{
+			Block& block = m_Blocks[static_cast<size_t>(blockY) * m_NumBlocksX + blockX];
+			block.x = blockX * m_Desc.blockSize;
+			block.y = blockY * m_Desc.blockSize;
+			block.width = (std::min)(m_Desc.blockSize, width - block.x);
+			block.height = (std::min)(m_Desc.blockSize, height - block.y);
+
+			const size_t numValues = static_cast<size_t>(block.width + 2) * (block.height + 2);
+			block.terrain.assign(numValues, 0.0f);
+			block.water.assign(numValues, 0.0f);
+			block.sediment.assign(numValues, 0.0f);
+			block.scratch.assign(numValues, 0.0f);
+
+			for (std::vector<float>& flux : block.flux)
+			{
+				flux.assign(numValues, 0.0f);
+			}
+
+			for (uint32_t cellY = 0; cellY < block.height; cellY++)
+			{
+				const float* row = heights + static_cast<size_t>(block.y + cellY) * rowPitch + block.x;
+				std::copy(row, row + block.width, block.terrain.begin() + block.GetIndex(0, cellY));
+			}
+		}
+	}
+}
+
+uint32_t Styx::TerrainErosion::Run(uint32_t numIterations, double timeBudgetInMilliseconds)
+{
+	if (m_Blocks.empty())
+	{
+		return 0;
+	}
+
+	std::chrono::high_resolution_clock::time_point runStart = std::chrono::high_resolution_clock::now();
+
+	uint32_t numIterationsRun = 0;
+	double elapsedInMilliseconds = 0.0;
+
+	// Iterations are never cut short, only the number of them depends on the budget
+	while (numIterationsRun < numIterations && (numIterationsRun == 0 || elapsedInMilliseconds < timeBudgetInMilliseconds))
+	{
+		RunIteration();
+		numIterationsRun++;
+
+		elapsedInMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - runStart).count();
+	}
+
+	m_Stats.numIterations += numIterationsRun;
+	m_Stats.numCellUpdates += static_cast<uint64_t>(numIterationsRun) * m_Width * m_Height;
+	m_Stats.timeInMilliseconds += elapsedInMilliseconds;
+
+	return numIterationsRun;
+}
+
+void Styx::TerrainErosion::ReadHeights(float* outHeights, uint32_t rowPitch) const
+{
+	for (const Block& block : m_Blocks)
+	{
+		for (uint32_t cellY = 0; cellY < block.height; cellY++)
+		{
+			const float* row = block.terrain.data() + block.GetIndex(0, cellY);
+			std::copy(row, row + block.width, outHeights + static_cast<size_t>(block.y + cellY) * rowPitch + block.x);
+		}
+	}
+}
+
+void Styx::TerrainErosion::ReadWaterHeights(float* outWaterHeights, uint32_t rowPitch) const
+{
+	for (const Block& block : m_Blocks)
+	{
+		for (uint32_t cellY = 0; cellY < block.height; cellY++)
+		{
+			const float* row = block.water.data() + block.GetIndex(0, cellY);
+			std::copy(row, row + block.width, outWaterHeights + static_cast<size_t>(block.y + cellY) * rowPitch + block.x);
+		}
+	}
+}
+
+uint32_t Styx::TerrainErosion::GetReach(const TerrainErosionDesc& desc, uint32_t numIterations)
+{
+	const uint32_t reachPerIteration = (desc.hasHydraulicErosion ? 2 : 0) + (desc.hasThermalErosion ? 1 : 0);
+	return reachPerIteration * numIterations;
+}
+
+void Styx::TerrainErosion::RunIteration()
+{
+	if (m_Desc.hasHydraulicErosion)
+	{
+		ForEachBlock(&TerrainErosion::AddRain);
+		ExchangeHalos(terrainHalo | waterHalo | sedimentHalo);
+		ForEachBlock(&TerrainErosion::UpdateFlux);
+		ExchangeHalos(fluxHalo);
+		ForEachBlock(&TerrainErosion::TransportSediment);
+		ForEachBlock(&TerrainErosion::UpdateWaterAndErode);
+	}
+
+	if (m_Desc.hasThermalErosion)
+	{
+		ExchangeHalos(terrainHalo);
+		ForEachBlock(&TerrainErosion::SlideMaterial);
+	}
+
+	m_NumIterations++;
+}
+
+void Styx::TerrainErosion::ForEachBlock(BlockPass pass)
+{
+	const auto runBlocks = [this, pass](uint32_t beginBlock, uint32_t endBlock)
+	{
+		for (uint32_t blockIndex = beginBlock; blockIndex < endBlock; blockIndex++)
+		{
+			(this->*pass)(m_Blocks[blockIndex]);
+		}
+	};
+
+	JobSystem::ParallelFor(static_cast<uint32_t>(m_Blocks.size()), 1, runBlocks);
+}
+
+void Styx::TerrainErosion::ExchangeHalos(uint32_t fields)
+{
+	// Halos are written from the neighbours' cells, never from their halos, so blocks can be refreshed in any order
+	const auto exchangeBlocks = [this, fields](uint32_t beginBlock, uint32_t endBlock)
+	{
+		for (uint32_t blockIndex = beginBlock; blockIndex < endBlock; blockIndex++)
+		{
+			ExchangeHalo(m_Blocks[blockIndex], fields);
+		}
+	};
+
+	JobSystem::ParallelFor(static_cast<uint32_t>(m_Blocks.size()), 4, exchangeBlocks);
+}
+
+void Styx::TerrainErosion::ExchangeHalo(Block& block, uint32_t fields) const
+{
+	const uint32_t stride = block.GetStride();
+
+	for (uint32_t haloY = 0; haloY < block.height + 2; haloY++)
+	{
+		// Only the first and last rows are entirely halo, the others only have their first and last cells in it
+		const uint32_t haloStep = haloY == 0 || haloY == block.height + 1 ? 1 : block.width + 1;
+
+		for (uint32_t haloX = 0; haloX < block.width + 2; haloX += haloStep)
+		{
+			const int32_t cellX = static_cast<int32_t>(block.x + haloX) - 1;
+			const int32_t cellY = static_cast<int32_t>(block.y + haloY) - 1;
+			const bool isOutside = cellX < 0 || cellY < 0 || cellX >= static_cast<int32_t>(m_Width) || cellY >= static_cast<int32_t>(m_Height);
+
+			const uint32_t clampedX = static_cast<uint32_t>(std::clamp(cellX, 0, static_cast<int32_t>(m_Width) - 1));
+			const uint32_t clampedY = static_cast<uint32_t>(std::clamp(cellY, 0, static_cast<int32_t>(m_Height) - 1));
+			const Block& source = FindBlock(clampedX, clampedY);
+			const uint32_t sourceIndex = source.GetIndex(clampedX - source.x, clampedY - source.y);
+			const uint32_t haloIndex = haloY * stride + haloX;
+
+			if (fields & terrainHalo)
+			{
+				block.terrain[haloIndex] = source.terrain[sourceIndex];
+			}
+
+			if (fields & waterHalo)
+			{
+				block.water[haloIndex] = source.water[sourceIndex];
+			}
+
+			if (fields & sedimentHalo)
+			{
+				block.sediment[haloIndex] = source.sediment[sourceIndex];
+			}
+
+			if (fields & fluxHalo)
+			{
+				for (uint32_t direction = 0; direction < numDirections; direction++)
+				{
+					block.flux[direction][haloIndex] = isOutside ? 0.0f : source.flux[direction][sourceIndex];
+				}
+			}
+		}
+	}
+}
+
+const Styx::TerrainErosion::Block& Styx::TerrainErosion::FindBlock(uint32_t cellX, uint32_t cellY) const
+{
+	return m_Blocks[static_cast<size_t>(cellY / m_Desc.blockSize) * m_NumBlocksX + cellX / m_Desc.blockSize];
+}
+
+void Styx::TerrainErosion::AddRain(Block& block) const
+{
+	const float rainPerIteration = 2.0f * m_Desc.rainRate * m_Desc.timeStep;
+	// Rain is hashed from the cell of the terrain, wherever the heightfield starts in it
+	const uint32_t originX = static_cast<uint32_t>(m_OriginX) + block.x;
+	const uint32_t originY = static_cast<uint32_t>(m_OriginY) + block.y;
+
+	for (uint32_t cellY = 0; cellY < block.height; cellY++)
+	{
+		for (uint32_t cellX = 0; cellX < block.width; cellX++)
+		{
+			block.water[block.GetIndex(cellX, cellY)] += rainPerIteration * HashToUnitFloat(m_Desc.seed, originX + cellX, originY + cellY, m_NumIterations);
+		}
+	}
+}
+
+void Styx::TerrainErosion::UpdateFlux(Block& block) const
+{
+	const int32_t stride = static_cast<int32_t>(block.GetStride());
+	const int32_t offsets[numDirections] = { -1, 1, -stride, stride };
+	const float flowScale = m_Desc.timeStep * m_Desc.pipeFlowRate / m_Desc.cellSize;
+	const float cellArea = m_Desc.cellSize * m_Desc.cellSize;
+
+	for (uint32_t cellY = 0; cellY < block.height; cellY++)
+	{
+		for (uint32_t cellX = 0; cellX < block.width; cellX++)
+		{
+			const uint32_t index = block.GetIndex(cellX, cellY);
+			const float surface = block.terrain[index] + block.water[index];
+
+			// The edges of the heightfield are walls
+			const bool isOpen[numDirections] =
+			{
+				block.x + cellX > 0,
+				block.x + cellX + 1 < m_Width,
+				block.y + cellY > 0,
+				block.y + cellY + 1 < m_Height,
+			};
+
+			float outflows[numDirections];
+			float totalOutflow = 0.0f;
+
+			for (uint32_t direction = 0; direction < numDirections; direction++)
+			{
+				const uint32_t neighbour = static_cast<uint32_t>(static_cast<int32_t>(index) + offsets[direction]);
+				const float surfaceDifference = surface - block.terrain[neighbour] - block.water[neighbour];
+
+				outflows[direction] = isOpen[direction] ? (std::max)(0.0f, block.flux[direction][index] + flowScale * surfaceDifference) : 0.0f;
+				totalOutflow += outflows[direction];
+			}
+
+			// A cell can't lose more water than it holds
+			const float scale = totalOutflow > 0.0f ? (std::min)(1.0f, block.water[index] * cellArea / (totalOutflow * m_Desc.timeStep)) : 0.0f;
+
+			for (uint32_t direction = 0; direction < numDirections; direction++)
+			{
+				block.flux[direction][index] = outflows[direction] * scale;
+			}
+		}
+	}
+}
+
+void Styx::TerrainErosion::UpdateWaterAndErode(Block& block) const
+{
+	const int32_t stride = static_cast<int32_t>(block.GetStride());
+	const float cellArea = m_Desc.cellSize * m_Desc.cellSize;
+	const float inverseTwoCellSize = 0.5f / m_Desc.cellSize;
+	const float evaporation = (std::max)(0.0f, 1.0f - m_Desc.evaporationRate * m_Desc.timeStep);
+
+	for (uint32_t cellY = 0; cellY < block.height; cellY++)
+	{
+		for (uint32_t cellX = 0; cellX < block.width; cellX++)
+		{
+			const uint32_t index = block.GetIndex(cellX, cellY);
+			const uint32_t leftIndex = index - 1;
+			const uint32_t rightIndex = index + 1;
+			const uint32_t downIndex = static_cast<uint32_t>(static_cast<int32_t>(index) - stride);
+			const uint32_t upIndex = static_cast<uint32_t>(static_cast<int32_t>(index) + stride);
+
+			const float inflow = block.flux[right][leftIndex] + block.flux[left][rightIndex] + block.flux[up][downIndex] + block.flux[down][upIndex];
+			const float outflow = block.flux[left][index] + block.flux[right][index] + block.flux[down][index] + block.flux[up][index];
+
+			const float previousWater = block.water[index];
+			const float water = (std::max)(0.0f, previousWater + m_Desc.timeStep * (inflow - outflow) / cellArea);
+			block.water[index] = water;
+
+			// Water crossing the cell on each axis, averaged over both of its sides
+			const float throughflowX = 0.5f * (block.flux[right][leftIndex] - block.flux[left][index] + block.flux[right][index] - block.flux[left][rightIndex]);
+			const float throughflowY = 0.5f * (block.flux[up][downIndex] - block.flux[down][index] + block.flux[up][index] - block.flux[down][upIndex]);
+			const float averageWater = 0.5f * (previousWater + water);
+
+			const float velocityX = averageWater > MIN_WATER_DEPTH ? throughflowX / (m_Desc.cellSize * averageWater) : 0.0f;
+			const float velocityY = averageWater > MIN_WATER_DEPTH ? throughflowY / (m_Desc.cellSize * averageWater) : 0.0f;
+
+			// Faster water on steeper ground carries more sediment. Whatever it can't carry is deposited, and it picks
+			// up ground while it could carry more.
+			const float slopeX = (block.terrain[rightIndex] - block.terrain[leftIndex]) * inverseTwoCellSize;
+			const float slopeY = (block.terrain[upIndex] - block.terrain[downIndex]) * inverseTwoCellSize;
+			const float slopeSquared = slopeX * slopeX + slopeY * slopeY;
+			const float sine = (std::max)(sqrtf(slopeSquared / (1.0f + slopeSquared)), m_Desc.minimumSlope);
+			const float depthFactor = (std::min)(water / m_Desc.erosionDepth, 1.0f);
+			const float capacity = m_Desc.sedimentCapacity * sine * depthFactor * sqrtf(velocityX * velocityX + velocityY * velocityY);
+
+			const float sediment = block.sediment[index];
+			const float exchange = sediment < capacity ? m_Desc.dissolvingRate * (capacity - sediment) : -m_Desc.depositionRate * (sediment - capacity);
+
+			block.scratch[index] = block.terrain[index] - exchange;
+			block.sediment[index] = sediment + exchange;
+			block.water[index] = water * evaporation;
+		}
+	}
+
+	// The neighbours' terrain was read for the slopes, so it's only replaced once every cell is done
+	block.terrain.swap(block.scratch);
+}
+
+void Styx::TerrainErosion::TransportSediment(Block& block) const
+{
+	const int32_t stride = static_cast<int32_t>(block.GetStride());
+	const int32_t offsets[numDirections] = { -1, 1, -stride, stride };
+	const Direction opposites[numDirections] = { right, left, up, down };
+	const float timeStepPerCellArea = m_Desc.timeStep / (m_Desc.cellSize * m_Desc.cellSize);
+
+	// Share of the sediment of a cell that leaves it towards a direction, the same as the share of its water
+	const auto outflowShare = [&block, timeStepPerCellArea](uint32_t index, uint32_t direction)
+	{
+		const float water = block.water[index];
+		return water > 0.0f ? block.flux[direction][index] * timeStepPerCellArea / water : 0.0f;
+	};
+
+	for (uint32_t cellY = 0; cellY < block.height; cellY++)
+	{
+		for (uint32_t cellX = 0; cellX < block.width; cellX++)
+		{
+			const uint32_t index = block.GetIndex(cellX, cellY);
+
+			// Sediment moves with the water. A neighbour computes what it receives from this cell with the same values
+			// and operations, so sediment is neither lost nor created on the way.
+			float totalOutflowShare = 0.0f;
+			float inflow = 0.0f;
+
+			for (uint32_t direction = 0; direction < numDirections; direction++)
+			{
+				const uint32_t neighbour = static_cast<uint32_t>(static_cast<int32_t>(index) + offsets[direction]);
+
+				totalOutflowShare += outflowShare(index, direction);
+				inflow += block.sediment[neighbour] * outflowShare(neighbour, opposites[direction]);
+			}
+
+			// Outflows are scaled so a cell never loses more water than it holds
+			block.scratch[index] = block.sediment[index] * (std::max)(0.0f, 1.0f - totalOutflowShare) + inflow;
+		}
+	}
+
+	block.sediment.swap(block.scratch);
+}
+
+void Styx::TerrainErosion::SlideMaterial(Block& block) const
+{
+	const int32_t stride = static_cast<int32_t>(block.GetStride());
+
+	struct Neighbour
+	{
+		int32_t x;
+		int32_t y;
+		float distance;
+	};
+
+	const float diagonal = 1.41421356f;
+	const Neighbour neighbours[8] =
+	{
+		{ -1, -1, diagonal }, { 0, -1, 1.0f }, { 1, -1, diagonal },
+		{ -1, 0, 1.0f }, { 1, 0, 1.0f },
+		{ -1, 1, diagonal }, { 0, 1, 1.0f }, { 1, 1, diagonal },
+	};
+
+	// Every pair of cells moves the same amount from the higher to the lower one whichever side computes it, so
+	// material is conserved
+	const float transferRate = 0.5f * m_Desc.thermalRate * m_Desc.timeStep;
+
+	int32_t neighbourOffsets[8];
+	float talusHeights[8];
+	for (uint32_t neighbourIndex = 0; neighbourIndex < 8; neighbourIndex++)
+	{
+		neighbourOffsets[neighbourIndex] = neighbours[neighbourIndex].y * stride + neighbours[neighbourIndex].x;
+		talusHeights[neighbourIndex] = m_Desc.talusSlope * neighbours[neighbourIndex].distance * m_Desc.cellSize;
+	}
+
+	for (uint32_t cellY = 0; cellY < block.height; cellY++)
+	{
+		for (uint32_t cellX = 0; cellX < block.width; cellX++)
+		{
+			const uint32_t index = block.GetIndex(cellX, cellY);
+			const float height = block.terrain[index];
+			float change = 0.0f;
+
+			const int32_t globalX = static_cast<int32_t>(block.x + cellX);
+			const int32_t globalY = static_cast<int32_t>(block.y + cellY);
+			const bool isOnEdge = globalX == 0 || globalY == 0 || globalX + 1 == static_cast<int32_t>(m_Width) || globalY + 1 == static_cast<int32_t>(m_Height);
+
+			for (uint32_t neighbourIndex = 0; neighbourIndex < 8; neighbourIndex++)
+			{
+				const Neighbour& neighbour = neighbours[neighbourIndex];
+				if (isOnEdge)
+				{
+					const int32_t neighbourX = globalX + neighbour.x;
+					const int32_t neighbourY = globalY + neighbour.y;
+					if (neighbourX < 0 || neighbourY < 0 || neighbourX >= static_cast<int32_t>(m_Width) || neighbourY >= static_cast<int32_t>(m_Height))
+					{
+						continue;
+					}
+				}
+
+				const float difference = height - block.terrain[static_cast<uint32_t>(static_cast<int32_t>(index) + neighbourOffsets[neighbourIndex])];
+				const float excess = (std::max)(fabsf(difference) - talusHeights[neighbourIndex], 0.0f);
+
+				change -= copysignf(transferRate * excess, difference);
+			}
+
+			block.scratch[index] = height + change;
+		}
+	}
+
+	block.terrain.swap(block.scratch);
+}
+
+void Styx::GenerateErodedTerrainTileHeights(const TerrainTileErosionDesc& desc, const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights)
+{
+	assert(desc.heightScale > 0.0f);
+
+	const uint32_t numSamples = tileSize + 1;
+	const uint32_t halo = TerrainErosion::GetReach(desc.erosion, desc.numIterations);
+	const uint32_t numWindowSamples = numSamples + 2 * halo;
+	const int32_t originX = coord.x * static_cast<int32_t>(tileSize) - static_cast<int32_t>(halo);
+	const int32_t originY = coord.y * static_cast<int32_t>(tileSize) - static_cast<int32_t>(halo);
+
+	thread_local std::vector<float> samples;
+	samples.resize(static_cast<size_t>(numWindowSamples) * numWindowSamples);
+
+	GenerateHeightfieldNoise(constants, originX, originY, numWindowSamples, numWindowSamples, samples.data(), numWindowSamples);
+
+	for (float& sample : samples)
+	{
+		sample *= desc.heightScale;
+	}
+
+	// Generator threads aren't job system threads, every tile is eroded on its own thread
+	TerrainErosion erosion(desc.erosion);
+	erosion.Reset(samples.data(), numWindowSamples, numWindowSamples, numWindowSamples, originX, originY);
+	erosion.Run(desc.numIterations);
+	erosion.ReadHeights(samples.data(), numWindowSamples);
+
+	const float inverseHeightScale = 1.0f / desc.heightScale;
+	for (uint32_t sampleY = 0; sampleY < numSamples; sampleY++)
+	{
+		const float* row = samples.data() + static_cast<size_t>(sampleY + halo) * numWindowSamples + halo;
+		for (uint32_t sampleX = 0; sampleX < numSamples; sampleX++)
+		{
+			const float height = std::clamp(row[sampleX] * inverseHeightScale, 0.0f, 1.0f);
+			heights[sampleY * numSamples + sampleX] = static_cast<uint16_t>(height * 65535.0f + 0.5f);
+		}
+	}
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "HeightfieldNoise.h"
+#include "TerrainTileCache.h"
+
+#include <cfloat>
+#include <stdint.h>
+#include <vector>
+
+namespace Styx
+{
+	struct TerrainErosionDesc
+	{
+		// Cells per side of the blocks the heightfield is split into, each block is updated by one job at a time
+		uint32_t blockSize = 64;
+		// Drives where the rain falls
+		uint32_t seed = 1;
+		// World distance between two heights
+		float cellSize = 1.0f;
+		float timeStep = 0.05f;
+
+		// Hydraulic erosion, water flows to the neighbours through virtual pipes and carries sediment along
+		bool hasHydraulicErosion = true;
+		// Average water added per cell and unit of time, each cell gets between none and twice as much every iteration
+		float rainRate = 0.02f;
+		float evaporationRate = 0.02f;
+		// Pipe cross section times gravity
+		float pipeFlowRate = 10.0f;
+		// Sediment a unit of water moving at unit speed down a vertical slope can carry
+		float sedimentCapacity = 0.1f;
+		float dissolvingRate = 0.3f;
+		float depositionRate = 0.3f;
+		// Flat ground still carries a little sediment, otherwise it would all drop the moment water reaches a plain
+		float minimumSlope = 0.05f;
+		// Water shallower than this carries proportionally less, so a film of fresh rain doesn't scour the whole terrain
+		float erosionDepth = 0.1f;
+
+		// Thermal erosion, material slides down slopes steeper than the talus slope
+		bool hasThermalErosion = true;
+		float talusSlope = 0.8f;
+		// Fraction of the excess height moved per unit of time
+		float thermalRate = 0.5f;
+	};
+
+	struct TerrainErosionStats
+	{
+		uint64_t numIterations = 0;
+		uint64_t numCellUpdates = 0;
+		double timeInMilliseconds = 0.0;
+
+		double GetCellsPerSecond() const { return timeInMilliseconds > 0.0 ? static_cast<double>(numCellUpdates) / (timeInMilliseconds * 0.001) : 0.0; }
+	};
+
+	struct TerrainTileErosionDesc
+	{
+		TerrainErosionDesc erosion;
+		uint32_t numIterations = 16;
+		// World height of a unit of noise, the erosion rates are in world units
+		float heightScale = 1.0f;
+	};
+
+	// NOTE: Grid based hydraulic erosion (virtual pipes, after Mei et al.) and thermal erosion over a CPU heightfield.
+	// The heightfield is cut into blocks with a one cell halo. Every pass of an iteration updates the blocks in parallel
+	// from their own cells and their halo only, then the halos are refreshed from the neighbouring blocks, so a cell's
+	// next state only depends on the previous state of its neighbours. Results are the same whatever the number of
+	// threads and however the iterations are spread over calls to Run. Rain comes from a hash of the seed, the cell and
+	// the iteration. The edges of the heightfield are walls: water doesn't leave and material doesn't slide off.
+	// A window of a larger terrain, reset with its origin in it, gets the same rain as the same cells of the whole
+	// terrain, so cells far enough from the walls (GetReach) erode exactly as they would in one piece.
+	class TerrainErosion
+	{
+	public:
+		explicit TerrainErosion(const TerrainErosionDesc& desc);
+
+		// Starts over from width x height heights, one row every rowPitch floats, with no water or sediment. The first
+		// height is the cell (originX, originY) of the terrain.
+		void Reset(const float* heights, uint32_t width, uint32_t height, uint32_t rowPitch, int32_t originX = 0, int32_t originY = 0);
+
+		// Runs iterations until numIterations ran or timeBudgetInMilliseconds is spent, so erosion can be spread over
+		// frames. At least one iteration runs. Blocks are spread over the job system when it's initialized and this runs
+		// on one of its threads. Returns the number of iterations run.
+		uint32_t Run(uint32_t numIterations, double timeBudgetInMilliseconds = DBL_MAX);
+
+		// Terrain heights, without the water on top of them
+		void ReadHeights(float* outHeights, uint32_t rowPitch) const;
+		void ReadWaterHeights(float* outWaterHeights, uint32_t rowPitch) const;
+
+		uint32_t GetWidth() const { return m_Width; }
+		uint32_t GetHeight() const { return m_Height; }
+		uint32_t GetNumIterations() const { return m_NumIterations; }
+		const TerrainErosionDesc& GetDesc() const { return m_Desc; }
+		const TerrainErosionStats& GetStats() const { return m_Stats; }
+		void ResetStats() { m_Stats = {}; }
+
+		// How many cells away something can change a cell's height within numIterations: an iteration reads the
+		// neighbours once for the flux, once more for the sediment and once more to slide material
+		static uint32_t GetReach(const TerrainErosionDesc& desc, uint32_t numIterations);
+
+	private:
+		enum Direction : uint32_t
+		{
+			left,
+			right,
+			down,
+			up,
+			numDirections
+		};
+
+		// Every field has a one cell halo around the block's cells, rows are width + 2 floats apart
+		struct Block
+		{
+			uint32_t x = 0;
+			uint32_t y = 0;
+			uint32_t width = 0;
+			uint32_t height = 0;
+
+			std::vector<float> terrain;
+			std::vector<float> water;
+			std::vector<float> sediment;
+			// Water flowing out of each cell towards each of its four neighbours
+			std::vector<float> flux[numDirections];
+			// The new terrain or sediment of passes that read their neighbours' current values
+			std::vector<float> scratch;
+
+			uint32_t GetStride() const { return width + 2; }
+			uint32_t GetIndex(uint32_t cellX, uint32_t cellY) const { return (cellY + 1) * GetStride() + cellX + 1; }
+		};
+
+		// Fields whose halos an exchange refreshes
+		enum HaloField : uint32_t
+		{
+			terrainHalo = 1 << 0,
+			waterHalo = 1 << 1,
+			sedimentHalo = 1 << 2,
+			fluxHalo = 1 << 3
+		};
+
+		using BlockPass = void (TerrainErosion::*)(Block& block) const;
+
+		void RunIteration();
+		void ForEachBlock(BlockPass pass);
+		// Refreshes the halo of every block from its neighbours. Outside the heightfield heights repeat the edge and
+		// nothing flows.
+		void ExchangeHalos(uint32_t fields);
+		void ExchangeHalo(Block& block, uint32_t fields) const;
+
+		void AddRain(Block& block) const;
+		void UpdateFlux(Block& block) const;
+		void UpdateWaterAndErode(Block& block) const;
+		void TransportSediment(Block& block) const;
+		void SlideMaterial(Block& block) const;
+
+		const Block& FindBlock(uint32_t cellX, uint32_t cellY) const;
+
+		TerrainErosionDesc m_Desc;
+		uint32_t m_Width = 0;
+		uint32_t m_Height = 0;
+		int32_t m_OriginX = 0;
+		int32_t m_OriginY = 0;
+		uint32_t m_NumBlocksX = 0;
+		uint32_t m_NumBlocksY = 0;
+		std::vector<Block> m_Blocks;
+		uint32_t m_NumIterations = 0;
+		TerrainErosionStats m_Stats;
+	};
+
+	// A TerrainTileGenerator eroding the heightfield noise of every tile on the generator thread. Each tile is eroded
+	// with GetReach cells of noise around it, so it comes out the same as the same cells of the terrain eroded in one
+	// piece and neighbouring tiles agree on their shared edges.
+	void GenerateErodedTerrainTileHeights(const TerrainTileErosionDesc& desc, const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights);
+}
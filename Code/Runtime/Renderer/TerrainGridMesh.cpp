@@ -0,0 +1,170 @@
+#include "TerrainGridMesh.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Styx
+{
+	namespace
+	{
+		constexpr uint32_t UNUSED_VERTEX = ~0u;
+	}
+
+	void GenerateTerrainGridMesh(const TerrainGridMeshDesc& desc, TerrainGridMeshData& outData)
+	{
+		const uint32_t resolution = desc.resolution;
+		const uint32_t numGridVertices = (resolution + 1) * (resolution + 1);
+		const uint32_t numSkirtVertices = desc.hasSkirts ? 4 * resolution : 0;
+		const uint32_t numVertices = numGridVertices + numSkirtVertices;
+
+		assert(resolution > 0);
+		assert(numVertices <= 0x10000 && "The grid is too large for 16 bit indices");
+		assert(desc.vertexCacheSize >= 4);
+
+		// Vertices are first numbered row by row, grid then skirts, and renumbered once the triangle order is known
+		std::vector<uint32_t> indices;
+		indices.reserve(6 * resolution * resolution + (desc.hasSkirts ? 24 * resolution : 0));
+
+		auto gridVertex = [resolution](uint32_t x, uint32_t z) { return z * (resolution + 1) + x; };
+
+		// Two rows of a band have to fit in the cache, the band then walks down one row at a time and only transforms
+		// the vertices of the new row
+		const uint32_t bandWidth = (std::max)(desc.vertexCacheSize / 2 - 1, 1u);
+
+		for (uint32_t bandStart = 0; bandStart < resolution; bandStart += bandWidth)
+		{
+			const uint32_t bandEnd = (std::min)(bandStart + bandWidth, resolution);
+
+			for (uint32_t z = 0; z < resolution; z++)
+			{
+				for (uint32_t x = bandStart; x < bandEnd; x++)
+				{
+					const uint32_t v00 = gridVertex(x, z);
+					const uint32_t v10 = gridVertex(x + 1, z);
+					const uint32_t v01 = gridVertex(x, z + 1);
+					const uint32_t v11 = gridVertex(x + 1, z + 1);
+
+					indices.push_back(v00);
+					indices.push_back(v01);
+					indices.push_back(v10);
+
+					indices.push_back(v10);
+					indices.push_back(v01);
+					indices.push_back(v11);
+				}
+			}
+		}
+
+		const uint32_t numGridIndices = static_cast<uint32_t>(indices.size());
+
+		// The border loop, counterclockwise seen from +Y so the inside of the grid is on its left
+		std::vector<uint32_t> border;
+		border.reserve(numSkirtVertices);
+
+		if (desc.hasSkirts)
+		{
+			for (uint32_t x = 0; x < resolution; x++)
+			{
+				border.push_back(gridVertex(x, 0));
+			}
+
+			for (uint32_t z = 0; z < resolution; z++)
+			{
+				border.push_back(gridVertex(resolution, z));
+			}
+
+			for (uint32_t x = resolution; x > 0; x--)
+			{
+				border.push_back(gridVertex(x, resolution));
+			}
+
+			for (uint32_t z = resolution; z > 0; z--)
+			{
+				border.push_back(gridVertex(0, z));
+			}
+
+			for (uint32_t borderIndex = 0; borderIndex < numSkirtVertices; borderIndex++)
+			{
+				const uint32_t nextBorderIndex = (borderIndex + 1) % numSkirtVertices;
+				const uint32_t top0 = border[borderIndex];
+				const uint32_t top1 = border[nextBorderIndex];
+				const uint32_t bottom0 = numGridVertices + borderIndex;
+				const uint32_t bottom1 = numGridVertices + nextBorderIndex;
+
+				indices.push_back(top0);
+				indices.push_back(top1);
+				indices.push_back(bottom0);
+
+				indices.push_back(top1);
+				indices.push_back(bottom1);
+				indices.push_back(bottom0);
+			}
+		}
+
+		// Number the vertices in the order they are first used, so they are fetched mostly sequentially
+		std::vector<uint32_t> remap(numVertices, UNUSED_VERTEX);
+		std::vector<uint32_t> sourceVertices;
+		sourceVertices.reserve(numVertices);
+
+		outData.indices.resize(indices.size());
+		for (size_t index = 0; index < indices.size(); index++)
+		{
+			uint32_t& newVertex = remap[indices[index]];
+			if (newVertex == UNUSED_VERTEX)
+			{
+				newVertex = static_cast<uint32_t>(sourceVertices.size());
+				sourceVertices.push_back(indices[index]);
+			}
+
+			outData.indices[index] = static_cast<uint16_t>(newVertex);
+		}
+
+		assert(sourceVertices.size() == numVertices);
+
+		outData.positions.resize(3 * numVertices);
+		outData.uvs.resize(2 * numVertices);
+		outData.numGridIndices = numGridIndices;
+
+		const float scale = 1.0f / static_cast<float>(resolution);
+
+		for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+		{
+			const uint32_t sourceVertex = sourceVertices[vertex];
+			const bool isSkirt = sourceVertex >= numGridVertices;
+			const uint32_t gridSourceVertex = isSkirt ? border[sourceVertex - numGridVertices] : sourceVertex;
+
+			const float u = static_cast<float>(gridSourceVertex % (resolution + 1)) * scale;
+			const float v = static_cast<float>(gridSourceVertex / (resolution + 1)) * scale;
+
+			outData.positions[3 * vertex + 0] = u;
+			outData.positions[3 * vertex + 1] = isSkirt ? -1.0f : 0.0f;
+			outData.positions[3 * vertex + 2] = v;
+			outData.uvs[2 * vertex + 0] = u;
+			outData.uvs[2 * vertex + 1] = v;
+		}
+	}
+
+	float ComputeAverageCacheMissRatio(const uint16_t* indices, uint32_t numIndices, uint32_t cacheSize)
+	{
+		if (numIndices < 3)
+		{
+			return 0.0f;
+		}
+
+		// A vertex enters the cache when it's transformed and leaves it cacheSize transforms later
+		std::vector<uint64_t> transformedAt(0x10000, 0);
+		uint64_t numTransforms = 0;
+
+		for (uint32_t index = 0; index < numIndices; index++)
+		{
+			uint64_t& vertexTransformedAt = transformedAt[indices[index]];
+			if (vertexTransformedAt == 0 || numTransforms - vertexTransformedAt >= cacheSize)
+			{
+				numTransforms++;
+				vertexTransformedAt = numTransforms;
+			}
+		}
+
+		return static_cast<float>(numTransforms) / static_cast<float>(numIndices / 3);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace Styx
+{
+	struct TerrainGridMeshDesc
+	{
+		// Quads along a side of the grid
+		uint32_t resolution = 16;
+		// A strip hanging down from the border of the grid, hides the gaps between patches whose edges don't match
+		bool hasSkirts = true;
+		// Entries of the post-transform vertex cache to order the triangles for, assumed FIFO
+		uint32_t vertexCacheSize = 32;
+	};
+
+	// NOTE: The grid spans [0, 1] on XZ, its uvs are its XZ coordinates. Grid vertices have y = 0 and skirt vertices
+	// y = -1, the vertex shader scales them by the skirt depth. Skirts are drawn after the grid, the grid alone is the
+	// first numGridIndices indices. Front faces are clockwise seen from +Y, the skirts face outwards.
+	struct TerrainGridMeshData
+	{
+		std::vector<float> positions;
+		std::vector<float> uvs;
+		std::vector<uint16_t> indices;
+		uint32_t numGridIndices = 0;
+
+		uint32_t GetNumVertices() const { return static_cast<uint32_t>(positions.size() / 3); }
+		uint32_t GetNumIndices() const { return static_cast<uint32_t>(indices.size()); }
+	};
+
+	// Builds the grid without any file I/O. The triangles are walked in bands narrow enough for two rows of vertices to
+	// stay in the vertex cache, and the vertices are numbered in the order the triangles first use them.
+	void GenerateTerrainGridMesh(const TerrainGridMeshDesc& desc, TerrainGridMeshData& outData);
+
+	// Average number of vertices transformed per triangle with a FIFO vertex cache of cacheSize entries, 0.5 at best for
+	// a grid and 3 at worst
+	float ComputeAverageCacheMissRatio(const uint16_t* indices, uint32_t numIndices, uint32_t cacheSize);
+}
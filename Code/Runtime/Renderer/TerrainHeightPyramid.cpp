@@ -0,0 +1,540 @@
+#include "TerrainHeightPyramid.h"
+#include "Core/JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STYX_TERRAIN_RAY_SSE2 1
+#endif
+
+namespace
+{
+	// Rays are handed out to jobs in batches of at least this many
+	constexpr uint32_t MIN_RAYS_PER_JOB = 64;
+	constexpr uint32_t RAYS_PER_PACKET = 4;
+	// Depth first traversal pushes at most three siblings per level on top of the node being visited
+	constexpr uint32_t MAX_STACK_SIZE = 3 * 32 + 1;
+
+	// Large instead of infinite, so an axis the ray doesn't move along never turns a slab test into 0 * inf
+	constexpr float HUGE_INVERSE = 1e30f;
+
+	// Roots this close outside of a cell still count, so rays crossing exactly between two cells can't slip through
+	constexpr float ROOT_TOLERANCE = 1e-5f;
+
+	float SafeInverse(float value)
+	{
+		return value != 0.0f ? 1.0f / value : HUGE_INVERSE;
+	}
+
+	struct NodeRef
+	{
+		uint32_t level;
+		uint32_t x;
+		uint32_t z;
+	};
+
+	// Children of a node ordered along the ray's direction on XZ, the nearest first. A ray crosses at most three of
+	// them and the two in the middle can't both be on its way, so this is front to back for any ray going that way.
+	void GetChildOrder(float directionX, float directionZ, uint32_t outChildren[4][2])
+	{
+		const uint32_t nearX = directionX >= 0.0f ? 0 : 1;
+		const uint32_t nearZ = directionZ >= 0.0f ? 0 : 1;
+
+		outChildren[0][0] = nearX;
+		outChildren[0][1] = nearZ;
+		outChildren[1][0] = 1 - nearX;
+		outChildren[1][1] = nearZ;
+		outChildren[2][0] = nearX;
+		outChildren[2][1] = 1 - nearZ;
+		outChildren[3][0] = 1 - nearX;
+		outChildren[3][1] = 1 - nearZ;
+	}
+}
+
+void Styx::TerrainHeightPyramid::Build(const float* heights, uint32_t width, uint32_t height, uint32_t rowPitch, float originX, float originZ, float sampleSpacing)
+{
+	assert(width >= 2 && height >= 2);
+	assert(sampleSpacing > 0.0f);
+
+	m_Width = width;
+	m_Height = height;
+	m_OriginX = originX;
+	m_OriginZ = originZ;
+	m_SampleSpacing = sampleSpacing;
+
+	m_Heights.resize(static_cast<size_t>(width) * height);
+	for (uint32_t row = 0; row < height; row++)
+	{
+		std::copy(heights + static_cast<size_t>(row) * rowPitch, heights + static_cast<size_t>(row) * rowPitch + width, m_Heights.begin() + static_cast<size_t>(row) * width);
+	}
+
+	BuildPyramid();
+}
+
+void Styx::TerrainHeightPyramid::Build(const uint16_t* heights, uint32_t width, uint32_t height, uint32_t rowPitch, float originX, float originZ, float sampleSpacing, float heightScale)
+{
+	std::vector<float> worldHeights(static_cast<size_t>(width) * height);
+	const float scale = heightScale / 65535.0f;
+
+	for (uint32_t row = 0; row < height; row++)
+	{
+		for (uint32_t column = 0; column < width; column++)
+		{
+			worldHeights[static_cast<size_t>(row) * width + column] = static_cast<float>(heights[static_cast<size_t>(row) * rowPitch + column]) * scale;
+		}
+	}
+
+	Build(worldHeights.data(), width, height, width, originX, originZ, sampleSpacing);
+}
+
+void Styx::TerrainHeightPyramid::BuildPyramid()
+{
+	m_Levels.clear();
+	m_MinHeights.clear();
+	m_MaxHeights.clear();
+
+	// A bilinear patch never leaves the range of its four corners
+	Level cells;
+	cells.width = m_Width - 1;
+	cells.height = m_Height - 1;
+	cells.offset = 0;
+	m_Levels.push_back(cells);
+
+	m_MinHeights.resize(static_cast<size_t>(cells.width) * cells.height);
+	m_MaxHeights.resize(static_cast<size_t>(cells.width) * cells.height);
+
+	for (uint32_t z = 0; z < cells.height; z++)
+	{
+		for (uint32_t x = 0; x < cells.width; x++)
+		{
+			const float* row0 = m_Heights.data() + static_cast<size_t>(z) * m_Width + x;
+			const float* row1 = row0 + m_Width;
+
+			m_MinHeights[static_cast<size_t>(z) * cells.width + x] = (std::min)((std::min)(row0[0], row0[1]), (std::min)(row1[0], row1[1]));
+			m_MaxHeights[static_cast<size_t>(z) * cells.width + x] = (std::max)((std::max)(row0[0], row0[1]), (std::max)(row1[0], row1[1]));
+		}
+	}
+
+	while (m_Levels.back().width > 1 || m_Levels.back().height > 1)
+	{
+		const Level previous = m_Levels.back();
+
+		Level level;
+		level.width = (previous.width + 1) / 2;
+		level.height = (previous.height + 1) / 2;
+		level.offset = static_cast<uint32_t>(m_MinHeights.size());
+		m_Levels.push_back(level);
+
+		m_MinHeights.resize(m_MinHeights.size() + static_cast<size_t>(level.width) * level.height);
+		m_MaxHeights.resize(m_MaxHeights.size() + static_cast<size_t>(level.width) * level.height);
+
+		for (uint32_t z = 0; z < level.height; z++)
+		{
+			for (uint32_t x = 0; x < level.width; x++)
+			{
+				float minHeight = FLT_MAX;
+				float maxHeight = -FLT_MAX;
+
+				// Nodes on the last row or column of an odd level have fewer children
+				for (uint32_t childZ = 2 * z; childZ < (std::min)(2 * z + 2, previous.height); childZ++)
+				{
+					for (uint32_t childX = 2 * x; childX < (std::min)(2 * x + 2, previous.width); childX++)
+					{
+						const size_t child = previous.offset + static_cast<size_t>(childZ) * previous.width + childX;
+						minHeight = (std::min)(minHeight, m_MinHeights[child]);
+						maxHeight = (std::max)(maxHeight, m_MaxHeights[child]);
+					}
+				}
+
+				m_MinHeights[level.offset + static_cast<size_t>(z) * level.width + x] = minHeight;
+				m_MaxHeights[level.offset + static_cast<size_t>(z) * level.width + x] = maxHeight;
+			}
+		}
+	}
+}
+
+void Styx::TerrainHeightPyramid::FindCell(float x, float z, uint32_t& cellX, uint32_t& cellZ, float& u, float& v) const
+{
+	const float sampleX = std::clamp((x - m_OriginX) / m_SampleSpacing, 0.0f, static_cast<float>(m_Width - 1));
+	const float sampleZ = std::clamp((z - m_OriginZ) / m_SampleSpacing, 0.0f, static_cast<float>(m_Height - 1));
+
+	cellX = (std::min)(static_cast<uint32_t>(sampleX), m_Width - 2);
+	cellZ = (std::min)(static_cast<uint32_t>(sampleZ), m_Height - 2);
+	u = sampleX - static_cast<float>(cellX);
+	v = sampleZ - static_cast<float>(cellZ);
+}
+
+float Styx::TerrainHeightPyramid::SampleHeight(float x, float z) const
+{
+	assert(!m_Levels.empty());
+
+	uint32_t cellX, cellZ;
+	float u, v;
+	FindCell(x, z, cellX, cellZ, u, v);
+
+	const float* row0 = m_Heights.data() + static_cast<size_t>(cellZ) * m_Width + cellX;
+	const float* row1 = row0 + m_Width;
+
+	const float height0 = row0[0] + (row0[1] - row0[0]) * u;
+	const float height1 = row1[0] + (row1[1] - row1[0]) * u;
+	return height0 + (height1 - height0) * v;
+}
+
+Styx::TerrainHeightSample Styx::TerrainHeightPyramid::Sample(float x, float z) const
+{
+	assert(!m_Levels.empty());
+
+	uint32_t cellX, cellZ;
+	float u, v;
+	FindCell(x, z, cellX, cellZ, u, v);
+
+	const float* row0 = m_Heights.data() + static_cast<size_t>(cellZ) * m_Width + cellX;
+	const float* row1 = row0 + m_Width;
+
+	TerrainHeightSample sample;
+	const float height0 = row0[0] + (row0[1] - row0[0]) * u;
+	const float height1 = row1[0] + (row1[1] - row1[0]) * u;
+	sample.height = height0 + (height1 - height0) * v;
+
+	// The normal is (-dh/dx, 1, -dh/dz) normalized, from the derivatives of the bilinear patch
+	const float slopeX = ((row0[1] - row0[0]) + ((row1[1] - row1[0]) - (row0[1] - row0[0])) * v) / m_SampleSpacing;
+	const float slopeZ = (height1 - height0) / m_SampleSpacing;
+	const float inverseLength = 1.0f / sqrtf(slopeX * slopeX + 1.0f + slopeZ * slopeZ);
+
+	sample.normalX = -slopeX * inverseLength;
+	sample.normalY = inverseLength;
+	sample.normalZ = -slopeZ * inverseLength;
+	return sample;
+}
+
+bool Styx::TerrainHeightPyramid::IntersectCell(const TerrainRay& ray, uint32_t cellX, uint32_t cellZ, float tEnter, float tExit, float& outDistance) const
+{
+	const float* row0 = m_Heights.data() + static_cast<size_t>(cellZ) * m_Width + cellX;
+	const float* row1 = row0 + m_Width;
+
+	// h(u, v) = a + b * u + c * v + d * u * v over the cell
+	const float a = row0[0];
+	const float b = row0[1] - row0[0];
+	const float c = row1[0] - row0[0];
+	const float d = row0[0] - row0[1] - row1[0] + row1[1];
+
+	// Along the ray from tEnter on, u and v move linearly with t, so the height of the ray above the patch is a
+	// quadratic in t. Starting at tEnter keeps the coefficients small wherever the ray comes from.
+	const float inverseSpacing = 1.0f / m_SampleSpacing;
+	const float u0 = (ray.originX + ray.directionX * tEnter - m_OriginX) * inverseSpacing - static_cast<float>(cellX);
+	const float v0 = (ray.originZ + ray.directionZ * tEnter - m_OriginZ) * inverseSpacing - static_cast<float>(cellZ);
+	const float du = ray.directionX * inverseSpacing;
+	const float dv = ray.directionZ * inverseSpacing;
+
+	const float quadratic = -d * du * dv;
+	const float linear = ray.directionY - (b * du + c * dv + d * (u0 * dv + v0 * du));
+	const float constant = ray.originY + ray.directionY * tEnter - (a + b * u0 + c * v0 + d * u0 * v0);
+
+	const float length = tExit - tEnter;
+	const float tolerance = ROOT_TOLERANCE * (1.0f + length);
+	float closest = FLT_MAX;
+
+	auto acceptRoot = [&](float root)
+	{
+		if (root >= -tolerance && root <= length + tolerance)
+		{
+			closest = (std::min)(closest, std::clamp(root, 0.0f, length));
+		}
+	};
+
+	if (constant == 0.0f)
+	{
+		outDistance = tEnter;
+		return true;
+	}
+
+	if (fabsf(quadratic) <= 1e-12f * (fabsf(linear) + fabsf(constant)))
+	{
+		if (linear != 0.0f)
+		{
+			acceptRoot(-constant / linear);
+		}
+	}
+	else
+	{
+		const float discriminant = linear * linear - 4.0f * quadratic * constant;
+		if (discriminant < 0.0f)
+		{
+			return false;
+		}
+
+		// Numerically stable form of both roots
+		const float q = -0.5f * (linear + copysignf(sqrtf(discriminant), linear));
+		acceptRoot(q / quadratic);
+
+		if (q != 0.0f)
+		{
+			acceptRoot(constant / q);
+		}
+	}
+
+	if (closest == FLT_MAX)
+	{
+		return false;
+	}
+
+	outDistance = tEnter + closest;
+	return true;
+}
+
+void Styx::TerrainHeightPyramid::FillHit(const TerrainRay& ray, float distance, TerrainRayHit& outHit) const
+{
+	outHit.hasHit = true;
+	outHit.distance = distance;
+	outHit.positionX = ray.originX + ray.directionX * distance;
+	outHit.positionY = ray.originY + ray.directionY * distance;
+	outHit.positionZ = ray.originZ + ray.directionZ * distance;
+}
+
+bool Styx::TerrainHeightPyramid::RayCast(const TerrainRay& ray, TerrainRayHit& outHit) const
+{
+	outHit = {};
+
+	if (m_Levels.empty() || ray.maxDistance < 0.0f)
+	{
+		return false;
+	}
+
+	const float inverseX = SafeInverse(ray.directionX);
+	const float inverseY = SafeInverse(ray.directionY);
+	const float inverseZ = SafeInverse(ray.directionZ);
+
+	uint32_t childOrder[4][2];
+	GetChildOrder(ray.directionX, ray.directionZ, childOrder);
+
+	NodeRef stack[MAX_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { GetNumLevels() - 1, 0, 0 };
+
+	const uint32_t numCellsX = m_Levels[0].width;
+	const uint32_t numCellsZ = m_Levels[0].height;
+	float closest = ray.maxDistance;
+	bool hasHit = false;
+
+	while (stackSize > 0)
+	{
+		const NodeRef node = stack[--stackSize];
+		const Level& level = m_Levels[node.level];
+
+		const uint32_t firstCellX = node.x << node.level;
+		const uint32_t firstCellZ = node.z << node.level;
+		const uint32_t endCellX = (std::min)((node.x + 1) << node.level, numCellsX);
+		const uint32_t endCellZ = (std::min)((node.z + 1) << node.level, numCellsZ);
+
+		const size_t nodeIndex = level.offset + static_cast<size_t>(node.z) * level.width + node.x;
+		const float minX = m_OriginX + static_cast<float>(firstCellX) * m_SampleSpacing;
+		const float maxX = m_OriginX + static_cast<float>(endCellX) * m_SampleSpacing;
+		const float minZ = m_OriginZ + static_cast<float>(firstCellZ) * m_SampleSpacing;
+		const float maxZ = m_OriginZ + static_cast<float>(endCellZ) * m_SampleSpacing;
+
+		const float tX0 = (minX - ray.originX) * inverseX;
+		const float tX1 = (maxX - ray.originX) * inverseX;
+		const float tZ0 = (minZ - ray.originZ) * inverseZ;
+		const float tZ1 = (maxZ - ray.originZ) * inverseZ;
+		const float tY0 = (m_MinHeights[nodeIndex] - ray.originY) * inverseY;
+		const float tY1 = (m_MaxHeights[nodeIndex] - ray.originY) * inverseY;
+
+		const float tEnterXZ = (std::max)((std::max)((std::min)(tX0, tX1), (std::min)(tZ0, tZ1)), 0.0f);
+		const float tExitXZ = (std::min)((std::min)((std::max)(tX0, tX1), (std::max)(tZ0, tZ1)), closest);
+		const float tEnter = (std::max)(tEnterXZ, (std::min)(tY0, tY1));
+		const float tExit = (std::min)(tExitXZ, (std::max)(tY0, tY1));
+
+		if (tEnter > tExit)
+		{
+			continue;
+		}
+
+		if (node.level == 0)
+		{
+			float distance;
+			if (IntersectCell(ray, node.x, node.z, tEnterXZ, tExitXZ, distance) && distance <= closest)
+			{
+				closest = distance;
+				hasHit = true;
+			}
+
+			continue;
+		}
+
+		// Pushed far to near, so the nearest child is visited first
+		const Level& childLevel = m_Levels[node.level - 1];
+		for (int32_t childIndex = 3; childIndex >= 0; childIndex--)
+		{
+			const uint32_t childX = 2 * node.x + childOrder[childIndex][0];
+			const uint32_t childZ = 2 * node.z + childOrder[childIndex][1];
+
+			if (childX < childLevel.width && childZ < childLevel.height)
+			{
+				stack[stackSize++] = { node.level - 1, childX, childZ };
+			}
+		}
+	}
+
+	if (hasHit)
+	{
+		FillHit(ray, closest, outHit);
+	}
+
+	return hasHit;
+}
+
+void Styx::TerrainHeightPyramid::RayCast(const TerrainRay* rays, uint32_t numRays, TerrainRayHit* outHits) const
+{
+	const uint32_t numPackets = (numRays + RAYS_PER_PACKET - 1) / RAYS_PER_PACKET;
+
+	const auto castPackets = [&](uint32_t beginPacket, uint32_t endPacket)
+	{
+		for (uint32_t packet = beginPacket; packet < endPacket; packet++)
+		{
+			const uint32_t firstRay = packet * RAYS_PER_PACKET;
+			RayCastPacket(rays + firstRay, (std::min)(RAYS_PER_PACKET, numRays - firstRay), outHits + firstRay);
+		}
+	};
+
+	JobSystem::ParallelFor(numPackets, MIN_RAYS_PER_JOB / RAYS_PER_PACKET, castPackets);
+}
+
+#if STYX_TERRAIN_RAY_SSE2
+void Styx::TerrainHeightPyramid::RayCastPacket(const TerrainRay* rays, uint32_t numRays, TerrainRayHit* outHits) const
+{
+	// Missing rays of the last packet are copies of the first one whose results are dropped
+	alignas(16) float originX[RAYS_PER_PACKET], originY[RAYS_PER_PACKET], originZ[RAYS_PER_PACKET];
+	alignas(16) float inverseX[RAYS_PER_PACKET], inverseY[RAYS_PER_PACKET], inverseZ[RAYS_PER_PACKET];
+	alignas(16) float closest[RAYS_PER_PACKET];
+	bool hasHit[RAYS_PER_PACKET] = {};
+
+	for (uint32_t lane = 0; lane < RAYS_PER_PACKET; lane++)
+	{
+		const TerrainRay& ray = rays[lane < numRays ? lane : 0];
+		originX[lane] = ray.originX;
+		originY[lane] = ray.originY;
+		originZ[lane] = ray.originZ;
+		inverseX[lane] = SafeInverse(ray.directionX);
+		inverseY[lane] = SafeInverse(ray.directionY);
+		inverseZ[lane] = SafeInverse(ray.directionZ);
+		// A negative distance leaves nothing to hit
+		closest[lane] = ray.maxDistance;
+	}
+
+	for (uint32_t lane = 0; lane < numRays; lane++)
+	{
+		outHits[lane] = {};
+	}
+
+	if (m_Levels.empty())
+	{
+		return;
+	}
+
+	const __m128 rayOriginX = _mm_load_ps(originX);
+	const __m128 rayOriginY = _mm_load_ps(originY);
+	const __m128 rayOriginZ = _mm_load_ps(originZ);
+	const __m128 rayInverseX = _mm_load_ps(inverseX);
+	const __m128 rayInverseY = _mm_load_ps(inverseY);
+	const __m128 rayInverseZ = _mm_load_ps(inverseZ);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 rayClosest = _mm_load_ps(closest);
+
+	// The first ray picks the order, the others still see every node they cross, only maybe not nearest first
+	uint32_t childOrder[4][2];
+	GetChildOrder(rays[0].directionX, rays[0].directionZ, childOrder);
+
+	NodeRef stack[MAX_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { GetNumLevels() - 1, 0, 0 };
+
+	const uint32_t numCellsX = m_Levels[0].width;
+	const uint32_t numCellsZ = m_Levels[0].height;
+
+	while (stackSize > 0)
+	{
+		const NodeRef node = stack[--stackSize];
+		const Level& level = m_Levels[node.level];
+
+		const uint32_t firstCellX = node.x << node.level;
+		const uint32_t firstCellZ = node.z << node.level;
+		const uint32_t endCellX = (std::min)((node.x + 1) << node.level, numCellsX);
+		const uint32_t endCellZ = (std::min)((node.z + 1) << node.level, numCellsZ);
+
+		const size_t nodeIndex = level.offset + static_cast<size_t>(node.z) * level.width + node.x;
+
+		const __m128 tX0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(m_OriginX + static_cast<float>(firstCellX) * m_SampleSpacing), rayOriginX), rayInverseX);
+		const __m128 tX1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(m_OriginX + static_cast<float>(endCellX) * m_SampleSpacing), rayOriginX), rayInverseX);
+		const __m128 tZ0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(m_OriginZ + static_cast<float>(firstCellZ) * m_SampleSpacing), rayOriginZ), rayInverseZ);
+		const __m128 tZ1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(m_OriginZ + static_cast<float>(endCellZ) * m_SampleSpacing), rayOriginZ), rayInverseZ);
+		const __m128 tY0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(m_MinHeights[nodeIndex]), rayOriginY), rayInverseY);
+		const __m128 tY1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(m_MaxHeights[nodeIndex]), rayOriginY), rayInverseY);
+
+		const __m128 tEnterXZ = _mm_max_ps(_mm_max_ps(_mm_min_ps(tX0, tX1), _mm_min_ps(tZ0, tZ1)), zero);
+		const __m128 tExitXZ = _mm_min_ps(_mm_min_ps(_mm_max_ps(tX0, tX1), _mm_max_ps(tZ0, tZ1)), rayClosest);
+		const __m128 tEnter = _mm_max_ps(tEnterXZ, _mm_min_ps(tY0, tY1));
+		const __m128 tExit = _mm_min_ps(tExitXZ, _mm_max_ps(tY0, tY1));
+
+		const int crossingLanes = _mm_movemask_ps(_mm_cmple_ps(tEnter, tExit));
+		if (crossingLanes == 0)
+		{
+			continue;
+		}
+
+		if (node.level == 0)
+		{
+			alignas(16) float enterXZ[RAYS_PER_PACKET];
+			alignas(16) float exitXZ[RAYS_PER_PACKET];
+			_mm_store_ps(enterXZ, tEnterXZ);
+			_mm_store_ps(exitXZ, tExitXZ);
+
+			for (uint32_t lane = 0; lane < numRays; lane++)
+			{
+				if (crossingLanes & (1 << lane))
+				{
+					float distance;
+					if (IntersectCell(rays[lane], node.x, node.z, enterXZ[lane], exitXZ[lane], distance) && distance <= closest[lane])
+					{
+						closest[lane] = distance;
+						hasHit[lane] = true;
+					}
+				}
+			}
+
+			rayClosest = _mm_load_ps(closest);
+			continue;
+		}
+
+		const Level& childLevel = m_Levels[node.level - 1];
+		for (int32_t childIndex = 3; childIndex >= 0; childIndex--)
+		{
+			const uint32_t childX = 2 * node.x + childOrder[childIndex][0];
+			const uint32_t childZ = 2 * node.z + childOrder[childIndex][1];
+
+			if (childX < childLevel.width && childZ < childLevel.height)
+			{
+				stack[stackSize++] = { node.level - 1, childX, childZ };
+			}
+		}
+	}
+
+	for (uint32_t lane = 0; lane < numRays; lane++)
+	{
+		if (hasHit[lane])
+		{
+			FillHit(rays[lane], closest[lane], outHits[lane]);
+		}
+	}
+}
+#else
+void Styx::TerrainHeightPyramid::RayCastPacket(const TerrainRay* rays, uint32_t numRays, TerrainRayHit* outHits) const
+{
+	for (uint32_t rayIndex = 0; rayIndex < numRays; rayIndex++)
+	{
+		RayCast(rays[rayIndex], outHits[rayIndex]);
+	}
+}
+#endif
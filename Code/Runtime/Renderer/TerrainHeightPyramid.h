@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cfloat>
+#include <stdint.h>
+#include <vector>
+
+namespace Styx
+{
+	// direction doesn't have to be normalized, distances are in units of its length
+	struct TerrainRay
+	{
+		float originX = 0.0f;
+		float originY = 0.0f;
+		float originZ = 0.0f;
+		float directionX = 0.0f;
+		float directionY = -1.0f;
+		float directionZ = 0.0f;
+		float maxDistance = FLT_MAX;
+	};
+
+	struct TerrainRayHit
+	{
+		bool hasHit = false;
+		float distance = FLT_MAX;
+		float positionX = 0.0f;
+		float positionY = 0.0f;
+		float positionZ = 0.0f;
+	};
+
+	struct TerrainHeightSample
+	{
+		float height = 0.0f;
+		float normalX = 0.0f;
+		float normalY = 1.0f;
+		float normalZ = 0.0f;
+	};
+
+	// NOTE: CPU copy of a heightfield for ray casts and height queries, e.g. camera collision, picking and placement.
+	// Sample (i, j) is at (originX + i * sampleSpacing, originZ + j * sampleSpacing) and the surface between four
+	// samples is their bilinear interpolation, so the ray casts hit exactly what SampleHeight returns. On top of the
+	// samples sits a pyramid of the min and max height of every cell, then of every 2x2 cells and so on up to a single
+	// node, and rays only descend into the nodes whose bounds they cross.
+	class TerrainHeightPyramid
+	{
+	public:
+		// heights is width x height world space heights, one row every rowPitch floats. Both sides need two samples at least.
+		void Build(const float* heights, uint32_t width, uint32_t height, uint32_t rowPitch, float originX, float originZ, float sampleSpacing);
+		// Same as above from R16_UNORM heights, e.g. a streamed tile, scaled by heightScale
+		void Build(const uint16_t* heights, uint32_t width, uint32_t height, uint32_t rowPitch, float originX, float originZ, float sampleSpacing, float heightScale);
+
+		// Bilinear height and the normal of the surface at world (x, z), clamped to the edges of the heightfield
+		float SampleHeight(float x, float z) const;
+		TerrainHeightSample Sample(float x, float z) const;
+
+		// The closest intersection with the surface up to ray.maxDistance. Rays starting below the surface hit it on their
+		// way out.
+		bool RayCast(const TerrainRay& ray, TerrainRayHit& outHit) const;
+		// Answers numRays rays, four at a time with SSE2 where available. Rays are spread over the job system when it's
+		// initialized and this runs on one of its threads. Packets of rays going the same way traverse the pyramid best.
+		void RayCast(const TerrainRay* rays, uint32_t numRays, TerrainRayHit* outHits) const;
+
+		uint32_t GetWidth() const { return m_Width; }
+		uint32_t GetHeight() const { return m_Height; }
+		uint32_t GetNumLevels() const { return static_cast<uint32_t>(m_Levels.size()); }
+		float GetMinHeight() const { return m_Levels.empty() ? 0.0f : m_MinHeights[m_Levels.back().offset]; }
+		float GetMaxHeight() const { return m_Levels.empty() ? 0.0f : m_MaxHeights[m_Levels.back().offset]; }
+
+	private:
+		struct Level
+		{
+			uint32_t width = 0;
+			uint32_t height = 0;
+			// Of the level's first node in m_MinHeights and m_MaxHeights
+			uint32_t offset = 0;
+		};
+
+		void BuildPyramid();
+		// Clamps to the heightfield and returns the cell (x, z) is in, with the position inside it in [0, 1]
+		void FindCell(float x, float z, uint32_t& cellX, uint32_t& cellZ, float& u, float& v) const;
+		// Closest intersection of the ray with the bilinear patch of a cell within [tEnter, tExit]
+		bool IntersectCell(const TerrainRay& ray, uint32_t cellX, uint32_t cellZ, float tEnter, float tExit, float& outDistance) const;
+		void RayCastPacket(const TerrainRay* rays, uint32_t numRays, TerrainRayHit* outHits) const;
+		void FillHit(const TerrainRay& ray, float distance, TerrainRayHit& outHit) const;
+
+		std::vector<float> m_Heights;
+		uint32_t m_Width = 0;
+		uint32_t m_Height = 0;
+		float m_OriginX = 0.0f;
+		float m_OriginZ = 0.0f;
+		float m_SampleSpacing = 1.0f;
+
+		// Level 0 has a node per cell, i.e. (width - 1) x (height - 1)
+		std::vector<Level> m_Levels;
+		std::vector<float> m_MinHeights;
+		std::vector<float> m_MaxHeights;
+	};
+}
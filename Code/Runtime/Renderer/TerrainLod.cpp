@@ -0,0 +1,176 @@
+#include "TerrainLod.h"
+
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+namespace Styx
+{
+	TerrainLodSelector::TerrainLodSelector(const TerrainLodDesc& desc)
+		: m_Desc(desc)
+	{
+		assert(desc.numLevels > 0 && desc.numLevels <= 16);
+		assert(desc.leafNodeSize > 0.0f && desc.leafRangeInNodes > 0.0f);
+		assert(desc.morphStartRatio >= 0.0f && desc.morphStartRatio < 1.0f);
+
+		m_Ranges.resize(desc.numLevels);
+		m_MorphStarts.resize(desc.numLevels);
+
+		float innerRange = 0.0f;
+		for (uint32_t level = 0; level < desc.numLevels; level++)
+		{
+			// Nothing is coarser than the roots, they are drawn at any distance and never morph
+			if (level == desc.numLevels - 1)
+			{
+				m_Ranges[level] = FLT_MAX;
+				m_MorphStarts[level] = FLT_MAX;
+				break;
+			}
+
+			m_Ranges[level] = desc.leafNodeSize * desc.leafRangeInNodes * static_cast<float>(1u << level);
+			m_MorphStarts[level] = innerRange + (m_Ranges[level] - innerRange) * desc.morphStartRatio;
+			innerRange = m_Ranges[level];
+		}
+	}
+
+	void TerrainLodSelector::Select(const TerrainLodView& view, float rootX, float rootZ, float minHeight, float maxHeight, std::vector<TerrainPatch>& outPatches)
+	{
+		std::chrono::high_resolution_clock::time_point selectionStart = std::chrono::high_resolution_clock::now();
+
+		m_ViewPosition[0] = view.positionX;
+		m_ViewPosition[1] = view.positionY;
+		m_ViewPosition[2] = view.positionZ;
+		m_MinHeight = minHeight;
+		m_MaxHeight = maxHeight;
+		m_HasFrustum = view.viewProjection != nullptr;
+
+		if (m_HasFrustum)
+		{
+			// Frustum planes from the columns of the view projection matrix, pointing inwards: left, right, bottom, top, near, far
+			const DirectX::XMFLOAT4X4& m = *view.viewProjection;
+			const float planes[6][4] =
+			{
+				{ m.m[0][3] + m.m[0][0], m.m[1][3] + m.m[1][0], m.m[2][3] + m.m[2][0], m.m[3][3] + m.m[3][0] },
+				{ m.m[0][3] - m.m[0][0], m.m[1][3] - m.m[1][0], m.m[2][3] - m.m[2][0], m.m[3][3] - m.m[3][0] },
+				{ m.m[0][3] + m.m[0][1], m.m[1][3] + m.m[1][1], m.m[2][3] + m.m[2][1], m.m[3][3] + m.m[3][1] },
+				{ m.m[0][3] - m.m[0][1], m.m[1][3] - m.m[1][1], m.m[2][3] - m.m[2][1], m.m[3][3] - m.m[3][1] },
+				{ m.m[0][2], m.m[1][2], m.m[2][2], m.m[3][2] },
+				{ m.m[0][3] - m.m[0][2], m.m[1][3] - m.m[1][2], m.m[2][3] - m.m[2][2], m.m[3][3] - m.m[3][2] },
+			};
+
+			for (uint32_t planeIndex = 0; planeIndex < 6; planeIndex++)
+			{
+				for (uint32_t component = 0; component < 4; component++)
+				{
+					m_Frustum.planes[planeIndex][component] = planes[planeIndex][component];
+				}
+			}
+		}
+
+		const uint32_t firstPatch = static_cast<uint32_t>(outPatches.size());
+		SelectNode(rootX, rootZ, m_Desc.numLevels - 1, outPatches);
+		m_Stats.numPatches += static_cast<uint32_t>(outPatches.size()) - firstPatch;
+
+		std::chrono::high_resolution_clock::time_point selectionEnd = std::chrono::high_resolution_clock::now();
+		m_Stats.selectionTimeInMilliseconds += std::chrono::duration<double, std::milli>(selectionEnd - selectionStart).count();
+	}
+
+	bool TerrainLodSelector::IsCrackFree(float heightRange) const
+	{
+		// A patch of level l is drawn because its parent is within range l, so the points of the parent are at most
+		// range l plus the parent's diagonal away. A neighbour of the patch outside the parent is no further than that,
+		// and has to be neither two levels coarser nor morphing into the level above. Morphing starts before the range
+		// ends, so the second condition covers the first.
+		for (uint32_t level = 0; level + 2 < m_Desc.numLevels; level++)
+		{
+			const float parentSize = GetNodeSize(level + 1);
+			const float parentDiagonal = sqrtf(2.0f * parentSize * parentSize + heightRange * heightRange);
+
+			if (m_Ranges[level] + parentDiagonal > m_MorphStarts[level + 1])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	float TerrainLodSelector::ComputeMorphFactor(float distance, float morphStart, float morphEnd)
+	{
+		if (distance <= morphStart)
+		{
+			return 0.0f;
+		}
+
+		if (distance >= morphEnd)
+		{
+			return 1.0f;
+		}
+
+		return (distance - morphStart) / (morphEnd - morphStart);
+	}
+
+	void TerrainLodSelector::SelectNode(float x, float z, uint32_t level, std::vector<TerrainPatch>& outPatches)
+	{
+		m_Stats.numVisitedNodes++;
+
+		const float size = GetNodeSize(level);
+
+		if (m_HasFrustum && IsOutsideFrustum(x, z, size))
+		{
+			m_Stats.numCulledNodes++;
+			return;
+		}
+
+		// The whole node is drawn at this level unless part of it needs the finer one
+		if (level == 0 || !IsWithinRange(x, z, size, m_Ranges[level - 1]))
+		{
+			TerrainPatch patch;
+			patch.x = x;
+			patch.z = z;
+			patch.size = size;
+			patch.level = level;
+			outPatches.push_back(patch);
+			return;
+		}
+
+		const float childSize = size * 0.5f;
+		SelectNode(x, z, level - 1, outPatches);
+		SelectNode(x + childSize, z, level - 1, outPatches);
+		SelectNode(x, z + childSize, level - 1, outPatches);
+		SelectNode(x + childSize, z + childSize, level - 1, outPatches);
+	}
+
+	bool TerrainLodSelector::IsWithinRange(float x, float z, float size, float range) const
+	{
+		// Distance from the camera to the closest point of the node's bounds
+		const float dx = fmaxf(fmaxf(x - m_ViewPosition[0], m_ViewPosition[0] - (x + size)), 0.0f);
+		const float dy = fmaxf(fmaxf(m_MinHeight - m_ViewPosition[1], m_ViewPosition[1] - m_MaxHeight), 0.0f);
+		const float dz = fmaxf(fmaxf(z - m_ViewPosition[2], m_ViewPosition[2] - (z + size)), 0.0f);
+
+		return dx * dx + dy * dy + dz * dz <= range * range;
+	}
+
+	bool TerrainLodSelector::IsOutsideFrustum(float x, float z, float size) const
+	{
+		const float halfSize = size * 0.5f;
+		const float halfHeight = (m_MaxHeight - m_MinHeight) * 0.5f;
+		const float c[3] = { x + halfSize, m_MinHeight + halfHeight, z + halfSize };
+		const float e[3] = { halfSize, halfHeight, halfSize };
+
+		for (uint32_t planeIndex = 0; planeIndex < 6; planeIndex++)
+		{
+			const float* plane = m_Frustum.planes[planeIndex];
+			const float distance = plane[0] * c[0] + plane[1] * c[1] + plane[2] * c[2] + plane[3];
+			const float radius = fabsf(plane[0]) * e[0] + fabsf(plane[1]) * e[1] + fabsf(plane[2]) * e[2];
+
+			if (distance + radius < 0.0f)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
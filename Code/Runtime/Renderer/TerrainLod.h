@@ -0,0 +1,103 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Styx
+{
+	struct TerrainLodDesc
+	{
+		// Level 0 is the finest. A node of level l is leafNodeSize * 2^l wide, the roots are at numLevels - 1.
+		uint32_t numLevels = 4;
+		float leafNodeSize = 12.5f;
+		// How far from the camera level 0 is drawn, in leaf nodes. Each level reaches twice as far as the previous one,
+		// the coarsest level is drawn at any distance.
+		float leafRangeInNodes = 5.0f;
+		// Fraction of the way from a level's inner range to its outer range where its patches start morphing into the
+		// next level
+		float morphStartRatio = 0.7f;
+	};
+
+	// Where the camera is, and optionally its view projection to cull nodes against. viewProjection follows the
+	// DirectXMath row vector convention with a [0, 1] depth range.
+	struct TerrainLodView
+	{
+		float positionX = 0.0f;
+		float positionY = 0.0f;
+		float positionZ = 0.0f;
+		const DirectX::XMFLOAT4X4* viewProjection = nullptr;
+	};
+
+	// A selected node, drawn with the patch grid scaled to size. (x, z) is its min corner.
+	struct TerrainPatch
+	{
+		float x = 0.0f;
+		float z = 0.0f;
+		float size = 0.0f;
+		uint32_t level = 0;
+	};
+
+	struct TerrainLodStats
+	{
+		uint32_t numPatches = 0;
+		uint32_t numVisitedNodes = 0;
+		uint32_t numCulledNodes = 0;
+		double selectionTimeInMilliseconds = 0.0;
+	};
+
+	// NOTE: Continuous distance based LOD over a quadtree per root node, after CDLOD. A node is split while any part
+	// of its bounds is within the range of the level below, so the level of a patch only depends on its distance to the
+	// camera. The vertices of a patch morph into the grid of the next level as they get closer to the end of their
+	// level's range, and they are fully morphed by the time they reach a coarser patch. With ranges at least
+	// 2 * sqrt(2) / morphStartRatio leaf nodes apart neighbours never differ by more than one level and their shared
+	// edges line up, see IsCrackFree.
+	class TerrainLodSelector
+	{
+	public:
+		explicit TerrainLodSelector(const TerrainLodDesc& desc);
+
+		// Appends the patches covering the root node whose min corner is (rootX, rootZ) and whose heights are within
+		// [minHeight, maxHeight]. Nodes outside the view frustum are skipped.
+		void Select(const TerrainLodView& view, float rootX, float rootZ, float minHeight, float maxHeight, std::vector<TerrainPatch>& outPatches);
+
+		// A level's patches are drawn up to GetRange(level) from the camera, morphing from GetMorphStart(level) on
+		float GetRange(uint32_t level) const { return m_Ranges[level]; }
+		float GetMorphStart(uint32_t level) const { return m_MorphStarts[level]; }
+		float GetMorphEnd(uint32_t level) const { return m_Ranges[level]; }
+		float GetNodeSize(uint32_t level) const { return m_Desc.leafNodeSize * static_cast<float>(1u << level); }
+		float GetRootNodeSize() const { return GetNodeSize(m_Desc.numLevels - 1); }
+		// Whether the ranges keep neighbours within one level of each other and their edges fully morphed, for terrains
+		// heightRange high
+		bool IsCrackFree(float heightRange) const;
+
+		const TerrainLodDesc& GetDesc() const { return m_Desc; }
+		const TerrainLodStats& GetStats() const { return m_Stats; }
+		void ResetStats() { m_Stats = {}; }
+
+		// How far a vertex at distance from the camera is morphed into the next level, what the vertex shader computes
+		static float ComputeMorphFactor(float distance, float morphStart, float morphEnd);
+
+	private:
+		struct Frustum
+		{
+			float planes[6][4];
+		};
+
+		void SelectNode(float x, float z, uint32_t level, std::vector<TerrainPatch>& outPatches);
+		bool IsWithinRange(float x, float z, float size, float range) const;
+		bool IsOutsideFrustum(float x, float z, float size) const;
+
+		TerrainLodDesc m_Desc;
+		std::vector<float> m_Ranges;
+		std::vector<float> m_MorphStarts;
+		TerrainLodStats m_Stats;
+
+		// Set for the duration of Select
+		float m_ViewPosition[3] = {};
+		float m_MinHeight = 0.0f;
+		float m_MaxHeight = 0.0f;
+		bool m_HasFrustum = false;
+		Frustum m_Frustum = {};
+	};
+}
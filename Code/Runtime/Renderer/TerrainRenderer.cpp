@@ -1,49 +1,159 @@
 #include "TerrainRenderer.h"
 #include "RHI/D3D12Lite.h"
-#include "Model.h"
+#include "TerrainErosion.h"
+#include "TerrainGridMesh.h"
 
 #include <DirectXMath.h>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <imgui/imgui.h>
+#include <iterator>
 
 namespace
 {
+	// Heights are stored as R16_UNORM, this is their world scale when they are generated. Imported heightfields have
+	// their own.
+	constexpr float TERRAIN_HEIGHT = 5.0f;
+	// Deep enough to cover the gaps left by the few texels of height error between two LOD levels
+	constexpr float TERRAIN_SKIRT_DEPTH = 0.5f;
+	// Erodes every tile on the generator threads. Off by default: the halo grows with the iterations, at the default 16
+	// a tile takes tens of milliseconds against a fraction of one for its noise.
+	constexpr bool TERRAIN_TILE_EROSION = false;
+
 	struct TerrainPassConstants
 	{
 		DirectX::XMFLOAT4X4 viewMatrix;
 		DirectX::XMFLOAT4X4 projectionMatrix;
+		DirectX::XMFLOAT3 cameraPosition;
 	};
 
 	struct TerrainObjectConstants
 	{
-		float worldMatrix[4][4];
 		uint32_t vertexOffset;
 		uint32_t positionBufferIndex;
 		uint32_t uvBufferIndex;
+		uint32_t patchBufferIndex;
+		uint32_t patchGridResolution;
+		float terrainHeight;
+		float skirtDepth;
 	};
 
-	struct TerrainMaterialConstants
+	// NOTE: Must match TerrainPatch in Terrain.hlsl. The vertex shader places the grid vertex at uv in
+	// [origin, origin + size] on XZ, snaps it towards the next level's grid by
+	// saturate((distance to camera - morphStart) * morphScale) and samples the height at heightmapOffset + uv * heightmapScale.
+	// Skirt vertices then move down by their y times skirtDepth. The pixel shader samples the tile's normal and material
+	// weight maps at the same coordinates.
+	struct TerrainPatchInstance
 	{
+		float originX;
+		float originZ;
+		float size;
+		float morphStart;
+		float morphScale;
+		float heightmapOffsetX;
+		float heightmapOffsetY;
+		float heightmapScale;
 		uint32_t heightmapIndex;
-		float terrainTileSize;
-		float terrainHeight;
+		uint32_t normalMapIndex;
+		uint32_t weightMapIndex;
+	};
+
+	static_assert(sizeof(TerrainPatchInstance) == 44, "TerrainPatchInstance layout must match Terrain.hlsl");
+
+	// NOTE: Must match TerrainScatterObjectConstants in TerrainScatter.hlsl. SV_InstanceID doesn't include the start
+	// instance of a draw, so the shader reads the instances from firstInstance itself.
+	struct TerrainScatterObjectConstants
+	{
+		uint32_t positionBufferIndex;
+		uint32_t instanceBufferIndex;
+		uint32_t firstInstance;
+		float boundsRadius;
+		DirectX::XMFLOAT3 color;
+	};
+
+	// The placeholder every layer is drawn with: a square pyramid standing on the instance position, inside a sphere of
+	// radius 1 around it. Front faces are clockwise seen from outside.
+	constexpr float SCATTER_MESH_POSITIONS[] =
+	{
+		-0.5f, 0.0f, -0.5f,
+		0.5f, 0.0f, -0.5f,
+		0.5f, 0.0f, 0.5f,
+		-0.5f, 0.0f, 0.5f,
+		0.0f, 1.0f, 0.0f,
 	};
 
-	struct HeightfieldNoiseObjectConstants
+	constexpr uint16_t SCATTER_MESH_INDICES[] =
 	{
-		uint32_t heightfieldNoiseTextureWidth;
-		uint32_t heightfieldNoiseTextureHeight;
-		uint32_t heightfieldNoiseTextureIndex;
+		0, 4, 1,
+		1, 4, 2,
+		2, 4, 3,
+		3, 4, 0,
+		0, 1, 2,
+		0, 2, 3,
 	};
+
+	// Layers are told apart by colour until they have their own meshes, in the order InitializeTiles adds them
+	constexpr DirectX::XMFLOAT3 SCATTER_LAYER_COLORS[] =
+	{
+		{ 0.1f, 0.3f, 0.08f },
+		{ 0.35f, 0.33f, 0.3f },
+	};
+
+	// Index buffers are drawn from, everything else is read by the shaders as raw buffers
+	D3D12Lite::BufferHandle CreateMeshBuffer(D3D12Lite::Device* device, const void* data, uint32_t sizeInBytes, uint32_t stride, DXGI_FORMAT format, const wchar_t* debugName)
+	{
+		const bool isIndexBuffer = format != DXGI_FORMAT_UNKNOWN;
+
+		D3D12Lite::BufferCreationDesc desc{};
+		desc.mSize = sizeInBytes;
+		desc.mAccessFlags = D3D12Lite::BufferAccessFlags::gpuOnly;
+		desc.mViewFlags = isIndexBuffer ? D3D12Lite::BufferViewFlags::none : D3D12Lite::BufferViewFlags::srv;
+		desc.mStride = stride;
+		desc.mIsRawAccess = !isIndexBuffer;
+		desc.mFormat = format;
+		desc.mDebugName = debugName;
+
+		D3D12Lite::BufferHandle buffer = device->CreateBuffer(desc);
+
+		std::unique_ptr<D3D12Lite::BufferUpload> uploadBuffer = std::make_unique<D3D12Lite::BufferUpload>();
+		uploadBuffer->mBuffer = &device->GetBuffer(buffer);
+		uploadBuffer->mBufferData = std::make_unique<uint8_t[]>(sizeInBytes);
+		uploadBuffer->mBufferDataSize = sizeInBytes;
+
+		memcpy_s(uploadBuffer->mBufferData.get(), sizeInBytes, data, sizeInBytes);
+		device->GetUploadContextForCurrentFrame().AddBufferUpload(std::move(uploadBuffer));
+
+		return buffer;
+	}
+
+	// Copies numRows rows of rowSizeInBytes bytes from data into an upload of a tile texture with the given footprint
+	std::unique_ptr<D3D12Lite::TextureUpload> CreateTileUpload(D3D12Lite::TextureResource& texture, const D3D12Lite::SubResourceLayouts& layouts, uint64_t uploadSize, const void* data, uint32_t rowSizeInBytes, uint32_t numRows)
+	{
+		std::unique_ptr<D3D12Lite::TextureUpload> textureUpload = std::make_unique<D3D12Lite::TextureUpload>();
+		textureUpload->mTexture = &texture;
+		textureUpload->mNumSubResources = 1;
+		textureUpload->mSubResourceLayouts = layouts;
+		textureUpload->mTextureDataSize = uploadSize;
+		textureUpload->mTextureData = std::make_unique<uint8_t[]>(uploadSize);
+
+		const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = layouts[0];
+		for (uint32_t row = 0; row < numRows; row++)
+		{
+			memcpy(textureUpload->mTextureData.get() + layout.Offset + row * layout.Footprint.RowPitch, static_cast<const uint8_t*>(data) + static_cast<size_t>(row) * rowSizeInBytes, rowSizeInBytes);
+		}
+
+		return textureUpload;
+	}
 }
 
-void Styx::TerrainRenderer::Initialize()
+void Styx::TerrainRenderer::Initialize(const char* tileFilePath)
 {
-	LoadResources();
 	InitializePSOs();
+	InitializeTiles(tileFilePath);
+	InitializePatchMesh();
+	InitializeScatterMesh();
 }
 
 void Styx::TerrainRenderer::Shutdown()
@@ -51,56 +161,65 @@ void Styx::TerrainRenderer::Shutdown()
 	m_Device->DestroyPipelineStateObject(std::move(m_TerrainPSO));
 	m_Device->DestroyShader(std::move(m_VertexShader));
 	m_Device->DestroyShader(std::move(m_PixelShader));
-
-	for (uint32_t i = 0; i < D3D12Lite::NUM_FRAMES_IN_FLIGHT; i++)
+	m_Device->DestroyPipelineStateObject(std::move(m_ScatterPSO));
+	m_Device->DestroyShader(std::move(m_ScatterVertexShader));
+	m_Device->DestroyShader(std::move(m_ScatterPixelShader));
+
+	m_Device->DestroyBuffer(m_Mesh.positionBuffer);
+	m_Device->DestroyBuffer(m_Mesh.uvBuffer);
+	m_Device->DestroyBuffer(m_Mesh.indexBuffer);
+	m_Device->DestroyBuffer(m_ScatterMesh.positionBuffer);
+	m_Device->DestroyBuffer(m_ScatterMesh.indexBuffer);
+
+	// Joins the generator threads before the textures and the scatter go away
+	m_TileStreamer.reset();
+	m_TileFile.Close();
+	m_Scatter.reset();
+	m_ScatterTiles.clear();
+	m_SurfaceMaps.reset();
+
+	for (D3D12Lite::TextureHandle tileTexture : m_TileTextures)
 	{
-		m_Device->DestroyBuffer(std::move(m_PassConstantBuffers[i]));
-		m_Device->DestroyBuffer(std::move(m_ObjectConstantBuffers[i]));
-		m_Device->DestroyBuffer(std::move(m_MaterialConstantBuffers[i]));
-		m_Device->DestroyBuffer(std::move(m_HeightfieldNoiseObjectConstantBuffers[i]));
-		m_Device->DestroyBuffer(std::move(m_HeightfieldNoiseMaterialConstantBuffers[i]));
+		m_Device->DestroyTexture(tileTexture);
 	}
 
-	m_Device->DestroyBuffer(std::move(m_Mesh.positionBuffer));
-	m_Device->DestroyBuffer(std::move(m_Mesh.uvBuffer));
-	m_Device->DestroyBuffer(std::move(m_Mesh.indexBuffer));
+	m_TileTextures.clear();
 
-	m_Device->DestroyPipelineStateObject(std::move(m_HeightfieldNoisePSO));
-	m_Device->DestroyShader(std::move(m_HeightfieldNoiseShader));
-	m_Device->DestroyTexture(std::move(m_HeightfieldTexture));
-}
-
-void Styx::TerrainRenderer::Render(D3D12Lite::GraphicsContext* gfx, D3D12Lite::ComputeContext* compute, Camera& camera, D3D12Lite::TextureResource* rt0, D3D12Lite::TextureResource* depthBuffer)
-{
-	// Render the heightfield noise
+	for (SurfaceMapSlot& surfaceMapSlot : m_SurfaceMapSlots)
 	{
-		D3D12Lite::PipelineInfo pso;
-		pso.mPipeline = m_HeightfieldNoisePSO.get();
+		for (SurfaceMapCopy& copy : surfaceMapSlot.copies)
+		{
+			m_Device->DestroyTexture(copy.normals);
+			m_Device->DestroyTexture(copy.weights);
+		}
+	}
 
-		HeightfieldNoiseObjectConstants objectConstants;
-		objectConstants.heightfieldNoiseTextureIndex = m_HeightfieldTexture->mDescriptorHeapIndex;
-		objectConstants.heightfieldNoiseTextureWidth = 513;
-		objectConstants.heightfieldNoiseTextureHeight = 513;
-		m_HeightfieldNoiseObjectConstantBuffers[m_Device->GetFrameId()]->SetMappedData(&objectConstants, sizeof(HeightfieldNoiseObjectConstants));
+	m_SurfaceMapSlots.clear();
+	m_DirtySurfaceMapSlots.clear();
 
-		m_HeightfieldNoiseMaterialConstantBuffers[m_Device->GetFrameId()]->SetMappedData(&m_MaterialConstants, sizeof(HeightfieldNoiseMaterialConstants));
+	for (D3D12Lite::BufferHandle patchBuffer : m_PatchBuffers)
+	{
+		m_Device->DestroyBuffer(patchBuffer);
+	}
 
-		compute->Reset();
-		compute->AddBarrier(*m_HeightfieldTexture.get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		compute->FlushBarriers();
+	m_PatchBufferCapacities = {};
+	m_LodSelector.reset();
 
-		compute->SetPipeline(pso);
-		compute->SetPipelineResources(D3D12Lite::PER_OBJECT_SPACE, m_HeightfieldNoisePerObjectResourceSpace);
-		compute->SetPipelineResources(D3D12Lite::PER_MATERIAL_SPACE, m_HeightfieldNoisePerMaterialResourceSpace);
-		compute->Dispatch((513 / 8) + 1, (513 / 8) + 1, 1);
+	for (D3D12Lite::BufferHandle scatterBuffer : m_ScatterBuffers)
+	{
+		m_Device->DestroyBuffer(scatterBuffer);
+	}
 
-		compute->AddBarrier(*m_HeightfieldTexture.get(), D3D12_RESOURCE_STATE_COMMON);
-		compute->FlushBarriers();
+	m_ScatterBufferCapacities = {};
+}
 
-		m_Device->SubmitContextWork(*compute);
-	}
+void Styx::TerrainRenderer::Render(D3D12Lite::GraphicsContext* gfx, Camera& camera, D3D12Lite::TextureResource* rt0, D3D12Lite::TextureResource* depthBuffer)
+{
+	StreamTiles(camera);
+	const uint32_t numPatches = SelectPatches(camera);
+	CullScatter(camera);
 
-	// Render the terrain
+	// Render the terrain, every patch of every tile in one instanced draw
 	{
 		D3D12Lite::PipelineInfo pso;
 		pso.mPipeline = m_TerrainPSO.get();
@@ -110,24 +229,33 @@ void Styx::TerrainRenderer::Render(D3D12Lite::GraphicsContext* gfx, D3D12Lite::C
 		TerrainPassConstants passConstants;
 		DirectX::XMStoreFloat4x4(&passConstants.viewMatrix, camera.view);
 		DirectX::XMStoreFloat4x4(&passConstants.projectionMatrix, camera.projection);
-		m_PassConstantBuffers[m_Device->GetFrameId()]->SetMappedData(&passConstants, sizeof(TerrainPassConstants));
+		DirectX::XMStoreFloat3(&passConstants.cameraPosition, camera.position);
+		D3D12Lite::ConstantAllocation passConstantsAllocation = m_Device->AllocateConstants(passConstants);
 
-		TerrainObjectConstants objectConstants;
-		memcpy_s(&objectConstants.worldMatrix, sizeof(float[4][4]), m_Transform.worldMatrix.m, sizeof(float[4][4]));
-		objectConstants.vertexOffset = m_Mesh.vertexOffset;
-		objectConstants.positionBufferIndex = m_Mesh.positionBuffer->mDescriptorHeapIndex;
-		objectConstants.uvBufferIndex = m_Mesh.uvBuffer->mDescriptorHeapIndex;
-		m_ObjectConstantBuffers[m_Device->GetFrameId()]->SetMappedData(&objectConstants, sizeof(TerrainObjectConstants));
+		gfx->Reset();
 
-		TerrainMaterialConstants materialConstants;
-		materialConstants.heightmapIndex = m_HeightfieldTexture->mDescriptorHeapIndex;
-		materialConstants.terrainTileSize = 100.0f;
-		materialConstants.terrainHeight = 5.0f;
-		m_MaterialConstantBuffers[m_Device->GetFrameId()]->SetMappedData(&materialConstants, sizeof(TerrainMaterialConstants));
+		m_GraphicsDependencies.Clear();
 
-		gfx->Reset();
+		for (const TerrainTileDraw& tile : m_TileStreamer->GetVisibleTiles())
+		{
+			D3D12Lite::TextureResource& tileTexture = m_Device->GetTexture(m_TileTextures[tile.slot]);
+			m_GraphicsDependencies.Read(&tileTexture);
+			gfx->AddBarrier(tileTexture, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+
+			// The maps of the tiles SelectPatches drew, which no upload goes to while the frames in flight read them
+			if (IsTileReady(tile.slot))
+			{
+				const SurfaceMapSlot& surfaceMapSlot = m_SurfaceMapSlots[tile.slot];
+				const SurfaceMapCopy& copy = surfaceMapSlot.copies[surfaceMapSlot.drawnCopy];
+				for (D3D12Lite::TextureHandle map : { copy.normals, copy.weights })
+				{
+					D3D12Lite::TextureResource& mapTexture = m_Device->GetTexture(map);
+					m_GraphicsDependencies.Read(&mapTexture);
+					gfx->AddBarrier(mapTexture, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+				}
+			}
+		}
 
-		gfx->AddBarrier(*m_HeightfieldTexture.get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
 		gfx->AddBarrier(*rt0, D3D12_RESOURCE_STATE_RENDER_TARGET);
 		gfx->AddBarrier(*depthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
 		gfx->FlushBarriers();
@@ -136,97 +264,448 @@ void Styx::TerrainRenderer::Render(D3D12Lite::GraphicsContext* gfx, D3D12Lite::C
 		gfx->ClearRenderTarget(*rt0, color);
 		gfx->ClearDepthStencilTarget(*depthBuffer, 1.0f, 0);
 
-		gfx->SetPipeline(pso);
-		gfx->SetPipelineResources(D3D12Lite::PER_PASS_SPACE, m_PerPassResourceSpace);
-		gfx->SetPipelineResources(D3D12Lite::PER_OBJECT_SPACE, m_PerObjectResourceSpace);
-		gfx->SetPipelineResources(D3D12Lite::PER_MATERIAL_SPACE, m_PerMaterialResourceSpace);
-		gfx->SetDefaultViewPortAndScissor(m_Device->GetScreenSize());
-		gfx->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		gfx->SetIndexBuffer(*m_Mesh.indexBuffer);
+		if (numPatches > 0)
+		{
+			TerrainObjectConstants objectConstants;
+			objectConstants.vertexOffset = m_Mesh.vertexOffset;
+			objectConstants.positionBufferIndex = m_Device->GetDescriptorHeapIndex(m_Mesh.positionBuffer);
+			objectConstants.uvBufferIndex = m_Device->GetDescriptorHeapIndex(m_Mesh.uvBuffer);
+			objectConstants.patchBufferIndex = m_Device->GetDescriptorHeapIndex(m_PatchBuffers[m_Device->GetFrameId()]);
+			objectConstants.patchGridResolution = m_PatchGridResolution;
+			objectConstants.terrainHeight = m_TerrainHeight;
+			objectConstants.skirtDepth = TERRAIN_SKIRT_DEPTH;
+
+			gfx->SetPipeline(pso);
+			gfx->SetPipelineConstants(D3D12Lite::PER_PASS_SPACE, passConstantsAllocation);
+			gfx->SetPipelineConstants(D3D12Lite::PER_OBJECT_SPACE, m_Device->AllocateConstants(objectConstants));
+			gfx->SetDefaultViewPortAndScissor(m_Device->GetScreenSize());
+			gfx->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			gfx->SetIndexBuffer(m_Device->GetBuffer(m_Mesh.indexBuffer));
+			gfx->DrawIndexedInstanced(m_Mesh.indexCount, numPatches, m_Mesh.indexOffset, 0, 0);
+		}
+
+		// Then every scattered layer in one instanced draw each, on top of the terrain
+		if (!m_ScatterDraws.empty())
+		{
+			D3D12Lite::PipelineInfo scatterPso = pso;
+			scatterPso.mPipeline = m_ScatterPSO.get();
+
+			gfx->SetPipeline(scatterPso);
+			gfx->SetPipelineConstants(D3D12Lite::PER_PASS_SPACE, passConstantsAllocation);
+			gfx->SetDefaultViewPortAndScissor(m_Device->GetScreenSize());
+			gfx->SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			gfx->SetIndexBuffer(m_Device->GetBuffer(m_ScatterMesh.indexBuffer));
+
+			const uint32_t positionBufferIndex = m_Device->GetDescriptorHeapIndex(m_ScatterMesh.positionBuffer);
+			const uint32_t instanceBufferIndex = m_Device->GetDescriptorHeapIndex(m_ScatterBuffers[m_Device->GetFrameId()]);
+			constexpr uint32_t numLayerColors = static_cast<uint32_t>(std::size(SCATTER_LAYER_COLORS));
+
+			for (const ScatterDraw& draw : m_ScatterDraws)
+			{
+				TerrainScatterObjectConstants objectConstants;
+				objectConstants.positionBufferIndex = positionBufferIndex;
+				objectConstants.instanceBufferIndex = instanceBufferIndex;
+				objectConstants.firstInstance = draw.firstInstance;
+				objectConstants.boundsRadius = m_Scatter->GetDesc().layers[draw.layer].boundsRadius;
+				objectConstants.color = SCATTER_LAYER_COLORS[draw.layer % numLayerColors];
+
+				gfx->SetPipelineConstants(D3D12Lite::PER_OBJECT_SPACE, m_Device->AllocateConstants(objectConstants));
+				gfx->DrawIndexedInstanced(m_ScatterMesh.indexCount, draw.numInstances, m_ScatterMesh.indexOffset, 0, 0);
+			}
+		}
 
-		gfx->DrawIndexed(m_Mesh.indexCount, m_Mesh.indexOffset, 0);
+		// Back to common, so the copy queue can upload into the tiles again
+		for (const TerrainTileDraw& tile : m_TileStreamer->GetVisibleTiles())
+		{
+			gfx->AddBarrier(m_Device->GetTexture(m_TileTextures[tile.slot]), D3D12_RESOURCE_STATE_COMMON);
+
+			if (IsTileReady(tile.slot))
+			{
+				const SurfaceMapSlot& surfaceMapSlot = m_SurfaceMapSlots[tile.slot];
+				const SurfaceMapCopy& copy = surfaceMapSlot.copies[surfaceMapSlot.drawnCopy];
+				gfx->AddBarrier(m_Device->GetTexture(copy.normals), D3D12_RESOURCE_STATE_COMMON);
+				gfx->AddBarrier(m_Device->GetTexture(copy.weights), D3D12_RESOURCE_STATE_COMMON);
+			}
+		}
 
-		gfx->AddBarrier(*m_HeightfieldTexture.get(), D3D12_RESOURCE_STATE_COMMON);
 		gfx->FlushBarriers();
 	}
+
+	m_FrameIndex++;
 }
 
-void Styx::TerrainRenderer::RenderUI()
+uint32_t Styx::TerrainRenderer::SelectPatches(const Camera& camera)
 {
-	ImGui::Begin("Heightfield Noise");
+	DirectX::XMFLOAT3 position;
+	DirectX::XMStoreFloat3(&position, camera.position);
+
+	DirectX::XMFLOAT4X4 viewProjection;
+	DirectX::XMStoreFloat4x4(&viewProjection, DirectX::XMMatrixMultiply(camera.view, camera.projection));
+
+	TerrainLodView view;
+	view.positionX = position.x;
+	view.positionY = position.y;
+	view.positionZ = position.z;
+	view.viewProjection = &viewProjection;
+
+	const float tileWorldSize = m_TileStreamer->GetDesc().tileWorldSize;
+	const uint32_t tileSize = m_TileStreamer->GetDesc().tileSize;
+	// Tiles hold (tileSize + 1)^2 texels, sampling at texel centres keeps the edges of neighbouring tiles identical
+	const float texelScale = static_cast<float>(tileSize) / static_cast<float>(tileSize + 1);
+	const float texelOffset = 0.5f / static_cast<float>(tileSize + 1);
+
+	m_LodSelector->ResetStats();
+	m_Patches.clear();
+
+	// Gathered first, the buffer is sized to fit every instance before it's written
+	struct TilePatches
 	{
+		const TerrainTileDraw* tile;
+		uint32_t firstPatch;
+		uint32_t numPatches;
+	};
+
+	std::vector<TilePatches> tilePatches;
+	tilePatches.reserve(m_TileStreamer->GetVisibleTiles().size());
+
+	for (const TerrainTileDraw& tile : m_TileStreamer->GetVisibleTiles())
+	{
+		// The streamer waits for the frames in flight before drawing an upload, but the upload context can
+		// postpone copies when its heap is full
+		if (!IsTileReady(tile.slot))
 		{
-			ImGui::InputInt("Seed", &m_MaterialConstants.seed);
-			ImGui::InputFloat("Frequency", &m_MaterialConstants.frequency);
-			ImGui::InputInt("Octaves", &m_MaterialConstants.octaves);
-			ImGui::InputFloat("Lacunarity", &m_MaterialConstants.lacunarity);
-			ImGui::InputFloat("Gain", &m_MaterialConstants.gain);
+			continue;
 		}
+
+		SurfaceMapSlot& surfaceMapSlot = m_SurfaceMapSlots[tile.slot];
+		surfaceMapSlot.copies[surfaceMapSlot.drawnCopy].reusableFrame = m_FrameIndex + D3D12Lite::NUM_FRAMES_IN_FLIGHT;
+
+		const uint32_t firstPatch = static_cast<uint32_t>(m_Patches.size());
+		m_LodSelector->Select(view, static_cast<float>(tile.coord.x) * tileWorldSize, static_cast<float>(tile.coord.y) * tileWorldSize, 0.0f, m_TerrainHeight, m_Patches);
+		tilePatches.push_back({ &tile, firstPatch, static_cast<uint32_t>(m_Patches.size()) - firstPatch });
 	}
-	ImGui::End();
+
+	const uint32_t numPatches = static_cast<uint32_t>(m_Patches.size());
+	if (numPatches == 0)
+	{
+		return 0;
+	}
+
+	// This frame's buffer is no longer read by the GPU, so it can be rewritten in place. It only grows.
+	const uint32_t frameId = m_Device->GetFrameId();
+	if (m_PatchBufferCapacities[frameId] < numPatches)
+	{
+		m_Device->DestroyBuffer(m_PatchBuffers[frameId]);
+
+		D3D12Lite::BufferCreationDesc desc{};
+		desc.mSize = numPatches * sizeof(TerrainPatchInstance);
+		desc.mStride = sizeof(TerrainPatchInstance);
+		desc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
+		desc.mViewFlags = D3D12Lite::BufferViewFlags::srv;
+		desc.mDebugName = L"TerrainRenderer::PatchBuffer";
+
+		m_PatchBuffers[frameId] = m_Device->CreateBuffer(desc);
+		m_PatchBufferCapacities[frameId] = numPatches;
+	}
+
+	TerrainPatchInstance* instances = reinterpret_cast<TerrainPatchInstance*>(m_Device->GetBuffer(m_PatchBuffers[frameId]).mMappedResource);
+
+	for (const TilePatches& patches : tilePatches)
+	{
+		const float tileX = static_cast<float>(patches.tile->coord.x) * tileWorldSize;
+		const float tileZ = static_cast<float>(patches.tile->coord.y) * tileWorldSize;
+		const uint32_t heightmapIndex = m_Device->GetDescriptorHeapIndex(m_TileTextures[patches.tile->slot]);
+		const SurfaceMapSlot& surfaceMapSlot = m_SurfaceMapSlots[patches.tile->slot];
+		const SurfaceMapCopy& surfaceMaps = surfaceMapSlot.copies[surfaceMapSlot.drawnCopy];
+		const uint32_t normalMapIndex = m_Device->GetDescriptorHeapIndex(surfaceMaps.normals);
+		const uint32_t weightMapIndex = m_Device->GetDescriptorHeapIndex(surfaceMaps.weights);
+
+		for (uint32_t patchIndex = patches.firstPatch; patchIndex < patches.firstPatch + patches.numPatches; patchIndex++)
+		{
+			const TerrainPatch& patch = m_Patches[patchIndex];
+			const float morphStart = m_LodSelector->GetMorphStart(patch.level);
+			const float morphEnd = m_LodSelector->GetMorphEnd(patch.level);
+
+			// Written whole, the buffer is write-combined memory
+			TerrainPatchInstance instance;
+			instance.originX = patch.x;
+			instance.originZ = patch.z;
+			instance.size = patch.size;
+			instance.morphStart = morphStart;
+			// The roots never morph
+			instance.morphScale = morphEnd > morphStart ? 1.0f / (morphEnd - morphStart) : 0.0f;
+			instance.heightmapOffsetX = (patch.x - tileX) / tileWorldSize * texelScale + texelOffset;
+			instance.heightmapOffsetY = (patch.z - tileZ) / tileWorldSize * texelScale + texelOffset;
+			instance.heightmapScale = patch.size / tileWorldSize * texelScale;
+			instance.heightmapIndex = heightmapIndex;
+			instance.normalMapIndex = normalMapIndex;
+			instance.weightMapIndex = weightMapIndex;
+
+			instances[patchIndex] = instance;
+		}
+	}
+
+	return numPatches;
 }
 
-void Styx::TerrainRenderer::LoadResources()
+void Styx::TerrainRenderer::CullScatter(const Camera& camera)
 {
-	Assimp::Importer importer;
-	const char* terrainPlanePath = "Assets/Models/TerrainPlane.gltf";
-	const aiScene* scene = importer.ReadFile(terrainPlanePath, aiProcess_Triangulate | aiProcess_CalcTangentSpace);
-	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+	std::chrono::high_resolution_clock::time_point cullStart = std::chrono::high_resolution_clock::now();
+
+	m_ScatterDraws.clear();
+	m_ScatterStats = {};
+
+	// The tiles drawn this frame, see SelectPatches
+	uint32_t numInstances = 0;
+	for (const TerrainTileDraw& tile : m_TileStreamer->GetVisibleTiles())
+	{
+		if (IsTileReady(tile.slot))
+		{
+			m_ScatterStats.numTiles++;
+			numInstances += static_cast<uint32_t>(m_ScatterTiles[tile.slot].instances.size());
+		}
+	}
+
+	m_ScatterStats.numInstances = numInstances;
+	if (numInstances == 0)
 	{
-		printf("[TerrainRenderer::LoadResources] Failed to load model at '%s'. Error: %s\n", terrainPlanePath, importer.GetErrorString());
 		return;
 	}
 
-	aiNode* node = scene->mRootNode;
-	assert(node->mNumMeshes == 1);
-	DirectX::XMMATRIX m = DirectX::XMMatrixSet(
-		node->mTransformation.a1, node->mTransformation.b1, node->mTransformation.c1, node->mTransformation.d1,
-		node->mTransformation.a2, node->mTransformation.b2, node->mTransformation.c2, node->mTransformation.d2,
-		node->mTransformation.a3, node->mTransformation.b3, node->mTransformation.c3, node->mTransformation.d3,
-		node->mTransformation.a4, node->mTransformation.b4, node->mTransformation.c4, node->mTransformation.d4);
+	// Sized for every instance of the tiles in view, so culling writes straight into it. It only grows.
+	const uint32_t frameId = m_Device->GetFrameId();
+	if (m_ScatterBufferCapacities[frameId] < numInstances)
+	{
+		m_Device->DestroyBuffer(m_ScatterBuffers[frameId]);
 
-	DirectX::XMStoreFloat4x4(&m_Transform.worldMatrix, m);
+		D3D12Lite::BufferCreationDesc desc{};
+		desc.mSize = numInstances * sizeof(TerrainScatterInstance);
+		desc.mStride = sizeof(TerrainScatterInstance);
+		desc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
+		desc.mViewFlags = D3D12Lite::BufferViewFlags::srv;
+		desc.mDebugName = L"TerrainRenderer::ScatterBuffer";
 
-	aiMesh* mesh = scene->mMeshes[node->mMeshes[0]];
-	m_Mesh = Scene::ProcessMesh(m_Device, mesh, scene);
+		m_ScatterBuffers[frameId] = m_Device->CreateBuffer(desc);
+		m_ScatterBufferCapacities[frameId] = numInstances;
+	}
 
+	DirectX::XMFLOAT3 position;
+	DirectX::XMStoreFloat3(&position, camera.position);
+
+	DirectX::XMFLOAT4X4 viewProjection;
+	DirectX::XMStoreFloat4x4(&viewProjection, DirectX::XMMatrixMultiply(camera.view, camera.projection));
+
+	TerrainScatterView view;
+	view.positionX = position.x;
+	view.positionY = position.y;
+	view.positionZ = position.z;
+	view.viewProjection = &viewProjection;
+
+	TerrainScatterInstance* instances = reinterpret_cast<TerrainScatterInstance*>(m_Device->GetBuffer(m_ScatterBuffers[frameId]).mMappedResource);
+	uint32_t numVisibleInstances = 0;
+
+	// Layer by layer, the visible instances of a layer end up next to each other whichever tiles they come from
+	for (uint32_t layer = 0; layer < m_Scatter->GetNumLayers(); layer++)
+	{
+		const uint32_t firstInstance = numVisibleInstances;
+
+		for (const TerrainTileDraw& tile : m_TileStreamer->GetVisibleTiles())
+		{
+			const TerrainScatterTile& scatterTile = m_ScatterTiles[tile.slot];
+			if (!IsTileReady(tile.slot) || scatterTile.instances.empty())
+			{
+				continue;
+			}
+
+			numVisibleInstances += m_Scatter->CullInstances(view, scatterTile, layer, instances + numVisibleInstances);
+		}
+
+		if (numVisibleInstances > firstInstance)
+		{
+			m_ScatterDraws.push_back({ layer, firstInstance, numVisibleInstances - firstInstance });
+		}
+	}
+
+	m_ScatterStats.numVisibleInstances = numVisibleInstances;
+	m_ScatterStats.numDraws = static_cast<uint32_t>(m_ScatterDraws.size());
+
+	std::chrono::high_resolution_clock::time_point cullEnd = std::chrono::high_resolution_clock::now();
+	m_ScatterStats.cullTimeInMilliseconds = std::chrono::duration<double, std::milli>(cullEnd - cullStart).count();
 }
 
-void Styx::TerrainRenderer::InitializePSOs()
+void Styx::TerrainRenderer::StreamTiles(const Camera& camera)
 {
-	D3D12Lite::BufferCreationDesc passConstantBufferDesc{};
-	passConstantBufferDesc.mSize = sizeof(TerrainPassConstants);
-	passConstantBufferDesc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
-	passConstantBufferDesc.mViewFlags = D3D12Lite::BufferViewFlags::cbv;
-	passConstantBufferDesc.mDebugName = L"TerrainRenderer::PassConstantBuffer";
+	m_TileStreamer->SetNoiseConstants(m_MaterialConstants);
+
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT3 forward;
+	DirectX::XMStoreFloat3(&position, camera.position);
+	DirectX::XMStoreFloat3(&forward, camera.forward);
+
+	TerrainTileView view;
+	view.positionX = position.x;
+	view.positionZ = position.z;
+	view.forwardX = forward.x;
+	view.forwardZ = forward.z;
+	m_TileStreamer->Update(view, m_FrameIndex);
+
+	const uint32_t numSamples = m_TileStreamer->GetDesc().tileSize + 1;
+
+	for (const TerrainTileUpload& upload : m_TileStreamer->GetUploads())
+	{
+		D3D12Lite::TextureResource& tileTexture = m_Device->GetTexture(m_TileTextures[upload.slot]);
+		tileTexture.mIsReady = false;
+
+		if (upload.scatter)
+		{
+			m_ScatterTiles[upload.slot] = *upload.scatter;
+		}
+
+		m_Device->GetUploadContextForCurrentFrame().AddTextureUpload(CreateTileUpload(tileTexture, m_TileUploadLayouts, m_TileUploadSize, upload.heights, numSamples * sizeof(uint16_t), numSamples));
+
+		// The maps of the slot's previous tile are never drawn again
+		SurfaceMapSlot& surfaceMapSlot = m_SurfaceMapSlots[upload.slot];
+		surfaceMapSlot.tileVersion++;
+		surfaceMapSlot.drawnCopy = INVALID_SURFACE_MAP_COPY;
 
-	for (uint32_t i = 0; i < D3D12Lite::NUM_FRAMES_IN_FLIGHT; i++)
+		m_SurfaceMaps->SetTile(upload.slot, upload.coord, upload.heights);
+	}
+
+	// Maps that landed are drawn from now on
+	for (SurfaceMapSlot& surfaceMapSlot : m_SurfaceMapSlots)
 	{
-		m_PassConstantBuffers[i] = m_Device->CreateBuffer(passConstantBufferDesc);
+		if (surfaceMapSlot.pendingCopy == INVALID_SURFACE_MAP_COPY)
+		{
+			continue;
+		}
+
+		const SurfaceMapCopy& copy = surfaceMapSlot.copies[surfaceMapSlot.pendingCopy];
+		if (m_Device->GetTexture(copy.normals).mIsReady && m_Device->GetTexture(copy.weights).mIsReady)
+		{
+			surfaceMapSlot.drawnCopy = copy.tileVersion == surfaceMapSlot.tileVersion ? surfaceMapSlot.pendingCopy : surfaceMapSlot.drawnCopy;
+			surfaceMapSlot.pendingCopy = INVALID_SURFACE_MAP_COPY;
+		}
 	}
 
-	D3D12Lite::BufferCreationDesc objectConstantBufferDesc{};
-	objectConstantBufferDesc.mSize = sizeof(TerrainObjectConstants);
-	objectConstantBufferDesc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
-	objectConstantBufferDesc.mViewFlags = D3D12Lite::BufferViewFlags::cbv;
-	objectConstantBufferDesc.mDebugName = L"TerrainRenderer::ObjectConstantBuffer";
+	// New tiles and the edges of their resident neighbours. Slots that can't be uploaded to yet stay dirty, their latest
+	// maps go up once they can.
+	for (uint32_t slot : m_SurfaceMaps->Update())
+	{
+		if (!m_SurfaceMapSlots[slot].isDirty)
+		{
+			m_SurfaceMapSlots[slot].isDirty = true;
+			m_DirtySurfaceMapSlots.push_back(slot);
+		}
+	}
+
+	const auto isUploaded = [this](uint32_t slot) { return UploadSurfaceMaps(slot); };
+	m_DirtySurfaceMapSlots.erase(std::remove_if(m_DirtySurfaceMapSlots.begin(), m_DirtySurfaceMapSlots.end(), isUploaded), m_DirtySurfaceMapSlots.end());
+}
 
-	for (uint32_t i = 0; i < D3D12Lite::NUM_FRAMES_IN_FLIGHT; i++)
+bool Styx::TerrainRenderer::UploadSurfaceMaps(uint32_t slot)
+{
+	SurfaceMapSlot& surfaceMapSlot = m_SurfaceMapSlots[slot];
+	const int8_t* normals = m_SurfaceMaps->GetNormals(slot);
+	const uint8_t* weights = m_SurfaceMaps->GetMaterialWeights(slot);
+	if (normals == nullptr || weights == nullptr)
 	{
-		m_ObjectConstantBuffers[i] = m_Device->CreateBuffer(objectConstantBufferDesc);
+		surfaceMapSlot.isDirty = false;
+		return true;
 	}
 
-	D3D12Lite::BufferCreationDesc materialConstantBufferDesc{};
-	materialConstantBufferDesc.mSize = sizeof(TerrainMaterialConstants);
-	materialConstantBufferDesc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
-	materialConstantBufferDesc.mViewFlags = D3D12Lite::BufferViewFlags::cbv;
-	materialConstantBufferDesc.mDebugName = L"TerrainRenderer::MaterialConstantBuffer";
+	// A copy is only uploaded to again once its last upload landed, the upload context flags a texture ready by the
+	// frame it was first uploaded in
+	if (surfaceMapSlot.pendingCopy != INVALID_SURFACE_MAP_COPY)
+	{
+		return false;
+	}
 
-	for (uint32_t i = 0; i < D3D12Lite::NUM_FRAMES_IN_FLIGHT; i++)
+	uint32_t target = INVALID_SURFACE_MAP_COPY;
+	for (uint32_t copyIndex = 0; copyIndex < static_cast<uint32_t>(surfaceMapSlot.copies.size()); copyIndex++)
 	{
-		m_MaterialConstantBuffers[i] = m_Device->CreateBuffer(materialConstantBufferDesc);
+		if (copyIndex != surfaceMapSlot.drawnCopy && surfaceMapSlot.copies[copyIndex].reusableFrame <= m_FrameIndex)
+		{
+			target = copyIndex;
+			break;
+		}
 	}
 
+	if (target == INVALID_SURFACE_MAP_COPY)
+	{
+		return false;
+	}
+
+	// Whole maps, a few tens of kilobytes each, rather than the dirty edges on their own
+	const uint32_t numSamples = m_SurfaceMaps->GetDesc().tileSize + 1;
+	SurfaceMapCopy& copy = surfaceMapSlot.copies[target];
+	D3D12Lite::TextureResource& normalTexture = m_Device->GetTexture(copy.normals);
+	D3D12Lite::TextureResource& weightTexture = m_Device->GetTexture(copy.weights);
+	normalTexture.mIsReady = false;
+	weightTexture.mIsReady = false;
+
+	D3D12Lite::UploadContext& uploadContext = m_Device->GetUploadContextForCurrentFrame();
+	uploadContext.AddTextureUpload(CreateTileUpload(normalTexture, m_NormalMapUploadLayouts, m_NormalMapUploadSize, normals, numSamples * 2, numSamples));
+	uploadContext.AddTextureUpload(CreateTileUpload(weightTexture, m_WeightMapUploadLayouts, m_WeightMapUploadSize, weights, numSamples * 4, numSamples));
+
+	copy.tileVersion = surfaceMapSlot.tileVersion;
+	surfaceMapSlot.pendingCopy = target;
+	surfaceMapSlot.isDirty = false;
+	return true;
+}
+
+bool Styx::TerrainRenderer::IsTileReady(uint32_t slot) const
+{
+	return m_Device->GetTexture(m_TileTextures[slot]).mIsReady && m_SurfaceMapSlots[slot].drawnCopy != INVALID_SURFACE_MAP_COPY;
+}
+
+void Styx::TerrainRenderer::RenderUI(HeightfieldNoiseMaterialConstants& materialConstants)
+{
+	ImGui::Begin("Heightfield Noise");
+	{
+		{
+			ImGui::InputInt("Seed", &materialConstants.seed);
+			ImGui::InputFloat("Frequency", &materialConstants.frequency);
+			ImGui::InputInt("Octaves", &materialConstants.octaves);
+			ImGui::InputFloat("Lacunarity", &materialConstants.lacunarity);
+			ImGui::InputFloat("Gain", &materialConstants.gain);
+		}
+	}
+	ImGui::End();
+}
+
+void Styx::TerrainRenderer::InitializePatchMesh()
+{
+	// A leaf patch is as dense as the heightfield
+	TerrainGridMeshDesc gridDesc{};
+	gridDesc.resolution = m_TileStreamer->GetDesc().tileSize >> (m_LodSelector->GetDesc().numLevels - 1);
+	gridDesc.hasSkirts = true;
+
+	TerrainGridMeshData grid;
+	GenerateTerrainGridMesh(gridDesc, grid);
+
+	m_PatchGridResolution = gridDesc.resolution;
+
+	m_Mesh.vertexCount = grid.GetNumVertices();
+	m_Mesh.vertexOffset = 0;
+	m_Mesh.indexCount = grid.GetNumIndices();
+	m_Mesh.indexOffset = 0;
+	m_Mesh.positionBuffer = CreateMeshBuffer(m_Device, grid.positions.data(), static_cast<uint32_t>(grid.positions.size() * sizeof(float)), sizeof(float) * 3, DXGI_FORMAT_UNKNOWN, L"TerrainRenderer::PatchPositionBuffer");
+	m_Mesh.uvBuffer = CreateMeshBuffer(m_Device, grid.uvs.data(), static_cast<uint32_t>(grid.uvs.size() * sizeof(float)), sizeof(float) * 2, DXGI_FORMAT_UNKNOWN, L"TerrainRenderer::PatchUVBuffer");
+	m_Mesh.indexBuffer = CreateMeshBuffer(m_Device, grid.indices.data(), static_cast<uint32_t>(grid.indices.size() * sizeof(uint16_t)), sizeof(uint16_t), DXGI_FORMAT_R16_UINT, L"TerrainRenderer::PatchIndexBuffer");
+}
+
+void Styx::TerrainRenderer::InitializeScatterMesh()
+{
+	m_ScatterMesh.vertexCount = static_cast<uint32_t>(std::size(SCATTER_MESH_POSITIONS) / 3);
+	m_ScatterMesh.vertexOffset = 0;
+	m_ScatterMesh.indexCount = static_cast<uint32_t>(std::size(SCATTER_MESH_INDICES));
+	m_ScatterMesh.indexOffset = 0;
+	m_ScatterMesh.positionBuffer = CreateMeshBuffer(m_Device, SCATTER_MESH_POSITIONS, sizeof(SCATTER_MESH_POSITIONS), sizeof(float) * 3, DXGI_FORMAT_UNKNOWN, L"TerrainRenderer::ScatterPositionBuffer");
+	m_ScatterMesh.indexBuffer = CreateMeshBuffer(m_Device, SCATTER_MESH_INDICES, sizeof(SCATTER_MESH_INDICES), sizeof(uint16_t), DXGI_FORMAT_R16_UINT, L"TerrainRenderer::ScatterIndexBuffer");
+}
+
+void Styx::TerrainRenderer::InitializePSOs()
+{
 	D3D12Lite::ShaderCreationDesc vsDesc{};
 	vsDesc.mShaderName = L"Terrain.hlsl";
 	vsDesc.mEntryPoint = L"VertexShader";
@@ -249,70 +728,165 @@ void Styx::TerrainRenderer::InitializePSOs()
 	psoDesc.mRenderTargetDesc.mDepthStencilFormat = DXGI_FORMAT_D32_FLOAT;
 	psoDesc.mDepthStencilDesc.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
 
-	m_PerPassResourceSpace.SetCBV(m_PassConstantBuffers[0].get());
+	m_PerPassResourceSpace.SetDynamicCBV();
 	m_PerPassResourceSpace.Lock();
 
-	m_PerObjectResourceSpace.SetCBV(m_ObjectConstantBuffers[0].get());
+	m_PerObjectResourceSpace.SetDynamicCBV();
 	m_PerObjectResourceSpace.Lock();
 
-	m_PerMaterialResourceSpace.SetCBV(m_MaterialConstantBuffers[0].get());
-	m_PerMaterialResourceSpace.Lock();
-
 	D3D12Lite::PipelineResourceLayout resourceLayout;
 	resourceLayout.mSpaces[D3D12Lite::PER_PASS_SPACE] = &m_PerPassResourceSpace;
 	resourceLayout.mSpaces[D3D12Lite::PER_OBJECT_SPACE] = &m_PerObjectResourceSpace;
-	resourceLayout.mSpaces[D3D12Lite::PER_MATERIAL_SPACE] = &m_PerMaterialResourceSpace;
 
 	m_TerrainPSO = m_Device->CreateGraphicsPipeline(psoDesc, resourceLayout);
 
-	D3D12Lite::TextureCreationDesc heightfieldCreationDesc{};
-	heightfieldCreationDesc.mResourceDesc.Format = DXGI_FORMAT_R16_UNORM;
-	heightfieldCreationDesc.mResourceDesc.Width = 513;
-	heightfieldCreationDesc.mResourceDesc.Height = 513;
-	heightfieldCreationDesc.mResourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-	heightfieldCreationDesc.mViewFlags = D3D12Lite::TextureViewFlags::uav | D3D12Lite::TextureViewFlags::srv;
-	m_HeightfieldTexture = m_Device->CreateTexture(heightfieldCreationDesc);
+	// The scatter layers share the terrain's resource spaces and render targets
+	vsDesc.mShaderName = L"TerrainScatter.hlsl";
+	psDesc.mShaderName = L"TerrainScatter.hlsl";
+
+	m_ScatterVertexShader = m_Device->CreateShader(vsDesc);
+	m_ScatterPixelShader = m_Device->CreateShader(psDesc);
+
+	psoDesc.mVertexShader = m_ScatterVertexShader.get();
+	psoDesc.mPixelShader = m_ScatterPixelShader.get();
 
-	D3D12Lite::ShaderCreationDesc csDesc{};
-	csDesc.mShaderName = L"HeightfieldNoise.hlsl";
-	csDesc.mEntryPoint = L"HeightfieldNoise";
-	csDesc.mType = D3D12Lite::ShaderType::compute;
+	m_ScatterPSO = m_Device->CreateGraphicsPipeline(psoDesc, resourceLayout);
+}
 
-	m_HeightfieldNoiseShader = m_Device->CreateShader(csDesc);
+void Styx::TerrainRenderer::InitializeTiles(const char* tileFilePath)
+{
+	TerrainTileStreamerDesc desc{};
+	m_TerrainHeight = TERRAIN_HEIGHT;
 
-	D3D12Lite::BufferCreationDesc heightfieldNoiseObjectConstantBufferDesc{};
-	heightfieldNoiseObjectConstantBufferDesc.mSize = sizeof(HeightfieldNoiseObjectConstants);
-	heightfieldNoiseObjectConstantBufferDesc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
-	heightfieldNoiseObjectConstantBufferDesc.mViewFlags = D3D12Lite::BufferViewFlags::cbv;
-	heightfieldNoiseObjectConstantBufferDesc.mDebugName = L"TerrainRenderer::HeightfieldNoiseObjectConstantBuffer";
+	// Every tile is a root node, four levels deep, so a leaf patch needs at least one quad
+	TerrainLodDesc lodDesc{};
+	lodDesc.numLevels = 4;
 
-	for (uint32_t i = 0; i < D3D12Lite::NUM_FRAMES_IN_FLIGHT; i++)
+	// An imported heightfield brings its own tile size, spacing and height, tiles outside it are flat
+	const bool hasTileFile = tileFilePath != nullptr && m_TileFile.Open(tileFilePath);
+	if (hasTileFile && m_TileFile.GetHeader().tileSize >= (1u << (lodDesc.numLevels - 1)))
+	{
+		const TerrainTileFileHeader& header = m_TileFile.GetHeader();
+		desc.tileSize = header.tileSize;
+		desc.tileWorldSize = header.sampleSpacing * static_cast<float>(header.tileSize);
+		m_TerrainHeight = header.heightScale;
+	}
+	else if (hasTileFile)
+	{
+		printf("[TerrainRenderer] '%s' has %u quads per tile, %u levels need at least %u, streaming noise instead\n", tileFilePath, m_TileFile.GetHeader().tileSize, lodDesc.numLevels, 1u << (lodDesc.numLevels - 1));
+		m_TileFile.Close();
+	}
+
+	// Trees on the lower, gentler ground and rocks anywhere, scattered by the generator threads with the heights
+	TerrainScatterLayerDesc treeLayer{};
+	treeLayer.minSpacing = 6.0f;
+	treeLayer.seed = 1;
+	treeLayer.maxHeight = 0.6f * m_TerrainHeight;
+	treeLayer.heightFade = 0.1f * m_TerrainHeight;
+	treeLayer.maxSlope = 0.15f;
+	treeLayer.slopeFade = 0.05f;
+	treeLayer.boundsRadius = 4.0f;
+	treeLayer.drawDistance = 400.0f;
+
+	TerrainScatterLayerDesc rockLayer{};
+	rockLayer.minSpacing = 3.0f;
+	rockLayer.seed = 2;
+	rockLayer.density = 0.3f;
+	rockLayer.minScale = 0.5f;
+	rockLayer.maxScale = 1.5f;
+	rockLayer.boundsRadius = 0.5f;
+	rockLayer.drawDistance = 150.0f;
+
+	TerrainScatterDesc scatterDesc{};
+	scatterDesc.tileSize = desc.tileSize;
+	scatterDesc.tileWorldSize = desc.tileWorldSize;
+	scatterDesc.heightScale = m_TerrainHeight;
+	scatterDesc.layers = { treeLayer, rockLayer };
+
+	m_Scatter = std::make_unique<TerrainScatter>(scatterDesc);
+	m_ScatterTiles.resize(desc.cacheCapacity);
+
+	// Grass on the gentler ground, rock on the steep slopes, snow on the peaks and sand along the lowest ground
+	TerrainSurfaceMapsDesc surfaceMapsDesc{};
+	surfaceMapsDesc.tileSize = desc.tileSize;
+	surfaceMapsDesc.tileWorldSize = desc.tileWorldSize;
+	surfaceMapsDesc.heightScale = m_TerrainHeight;
+	surfaceMapsDesc.materials[0].maxSlope = 0.6f;
+	surfaceMapsDesc.materials[1].minSlope = 0.5f;
+	surfaceMapsDesc.materials[2].minHeight = 0.75f * m_TerrainHeight;
+	surfaceMapsDesc.materials[2].heightFade = 0.05f * m_TerrainHeight;
+	surfaceMapsDesc.materials[2].maxSlope = 0.8f;
+	surfaceMapsDesc.materials[3].maxHeight = 0.1f * m_TerrainHeight;
+	surfaceMapsDesc.materials[3].heightFade = 0.05f * m_TerrainHeight;
+	surfaceMapsDesc.materials[3].maxSlope = 0.3f;
+
+	m_SurfaceMaps = std::make_unique<TerrainSurfaceMaps>(surfaceMapsDesc, desc.cacheCapacity);
+
+	TerrainTileGenerator generator = GenerateTerrainTileHeights;
+	if (m_TileFile.IsOpen())
+	{
+		// The file is mapped read only and outlives the streamer, its tiles are copied on the generator threads
+		generator = [this](const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants&, uint32_t, uint16_t* heights)
+		{
+			m_TileFile.CopyTileHeights(coord, heights);
+		};
+	}
+	else if constexpr (TERRAIN_TILE_EROSION)
 	{
-		m_HeightfieldNoiseObjectConstantBuffers[i] = m_Device->CreateBuffer(heightfieldNoiseObjectConstantBufferDesc);
+		TerrainTileErosionDesc erosionDesc{};
+		erosionDesc.erosion.cellSize = desc.tileWorldSize / static_cast<float>(desc.tileSize);
+		erosionDesc.heightScale = m_TerrainHeight;
+
+		generator = [erosionDesc](const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights)
+		{
+			GenerateErodedTerrainTileHeights(erosionDesc, coord, constants, tileSize, heights);
+		};
 	}
 
-	D3D12Lite::BufferCreationDesc heightfieldNoiseMaterialConstantBufferDesc{};
-	heightfieldNoiseMaterialConstantBufferDesc.mSize = sizeof(HeightfieldNoiseMaterialConstants);
-	heightfieldNoiseMaterialConstantBufferDesc.mAccessFlags = D3D12Lite::BufferAccessFlags::hostWritable;
-	heightfieldNoiseMaterialConstantBufferDesc.mViewFlags = D3D12Lite::BufferViewFlags::cbv;
-	heightfieldNoiseMaterialConstantBufferDesc.mDebugName = L"TerrainRenderer::HeightfieldNoiseMaterialConstantBuffer";
+	m_TileStreamer = std::make_unique<TerrainTileStreamer>(desc, std::move(generator), m_Scatter.get());
 
-	for (uint32_t i = 0; i < D3D12Lite::NUM_FRAMES_IN_FLIGHT; i++)
+	// Taller terrains need the finer levels to reach further before their neighbours can be two levels coarser
+	lodDesc.leafNodeSize = desc.tileWorldSize / static_cast<float>(1u << (lodDesc.numLevels - 1));
+	m_LodSelector = std::make_unique<TerrainLodSelector>(lodDesc);
+	while (!m_LodSelector->IsCrackFree(m_TerrainHeight))
 	{
-		m_HeightfieldNoiseMaterialConstantBuffers[i] = m_Device->CreateBuffer(heightfieldNoiseMaterialConstantBufferDesc);
+		lodDesc.leafRangeInNodes *= 1.25f;
+		m_LodSelector = std::make_unique<TerrainLodSelector>(lodDesc);
 	}
 
-	D3D12Lite::ComputePipelineDesc cPsoDesc = { m_HeightfieldNoiseShader.get()};
+	D3D12Lite::TextureCreationDesc tileCreationDesc{};
+	tileCreationDesc.mResourceDesc.Format = DXGI_FORMAT_R16_UNORM;
+	tileCreationDesc.mResourceDesc.Width = desc.tileSize + 1;
+	tileCreationDesc.mResourceDesc.Height = desc.tileSize + 1;
+	tileCreationDesc.mViewFlags = D3D12Lite::TextureViewFlags::srv;
 
-	D3D12Lite::PipelineResourceLayout computeResourceLayout;
-	computeResourceLayout.mSpaces[D3D12Lite::PER_OBJECT_SPACE] = &m_HeightfieldNoisePerObjectResourceSpace;
-	computeResourceLayout.mSpaces[D3D12Lite::PER_MATERIAL_SPACE] = &m_HeightfieldNoisePerMaterialResourceSpace;
+	m_TileTextures.resize(desc.cacheCapacity);
+	for (D3D12Lite::TextureHandle& tileTexture : m_TileTextures)
+	{
+		tileTexture = m_Device->CreateTexture(tileCreationDesc);
+	}
 
-	m_HeightfieldNoisePerObjectResourceSpace.SetCBV(m_HeightfieldNoiseObjectConstantBuffers[0].get());
-	m_HeightfieldNoisePerObjectResourceSpace.Lock();
+	// Every tile has the same layout, the upload footprint is computed once
+	uint32_t numRows = 0;
+	uint64_t rowSizeInBytes = 0;
+	m_Device->GetDevice()->GetCopyableFootprints(&tileCreationDesc.mResourceDesc, 0, 1, 0, m_TileUploadLayouts.data(), &numRows, &rowSizeInBytes, &m_TileUploadSize);
 
-	m_HeightfieldNoisePerMaterialResourceSpace.SetCBV(m_HeightfieldNoiseMaterialConstantBuffers[0].get());
-	m_HeightfieldNoisePerMaterialResourceSpace.Lock();
+	// Two copies of the surface maps per slot, see SurfaceMapSlot
+	D3D12Lite::TextureCreationDesc normalMapCreationDesc = tileCreationDesc;
+	normalMapCreationDesc.mResourceDesc.Format = DXGI_FORMAT_R8G8_SNORM;
+	D3D12Lite::TextureCreationDesc weightMapCreationDesc = tileCreationDesc;
+	weightMapCreationDesc.mResourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+	m_SurfaceMapSlots.resize(desc.cacheCapacity);
+	for (SurfaceMapSlot& surfaceMapSlot : m_SurfaceMapSlots)
+	{
+		for (SurfaceMapCopy& copy : surfaceMapSlot.copies)
+		{
+			copy.normals = m_Device->CreateTexture(normalMapCreationDesc);
+			copy.weights = m_Device->CreateTexture(weightMapCreationDesc);
+		}
+	}
 
-	m_HeightfieldNoisePSO = m_Device->CreateComputePipeline(cPsoDesc, computeResourceLayout);
+	m_Device->GetDevice()->GetCopyableFootprints(&normalMapCreationDesc.mResourceDesc, 0, 1, 0, m_NormalMapUploadLayouts.data(), &numRows, &rowSizeInBytes, &m_NormalMapUploadSize);
+	m_Device->GetDevice()->GetCopyableFootprints(&weightMapCreationDesc.mResourceDesc, 0, 1, 0, m_WeightMapUploadLayouts.data(), &numRows, &rowSizeInBytes, &m_WeightMapUploadSize);
 }
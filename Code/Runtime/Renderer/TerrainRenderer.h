@@ -1,22 +1,20 @@
 #pragma once
 
+#include "HeightfieldNoise.h"
 #include "RendererTypes.h"
+#include "TerrainLod.h"
+#include "TerrainScatter.h"
+#include "TerrainSurfaceMaps.h"
+#include "TerrainTileFile.h"
+#include "TerrainTileStreamer.h"
 #include "RHI/D3D12Lite.h"
 
 #include <array>
 #include <memory>
+#include <vector>
 
 namespace Styx
 {
-	struct HeightfieldNoiseMaterialConstants
-	{
-		int32_t seed = 42;
-		float frequency = 0.01f;
-		int32_t octaves = 3;
-		float lacunarity = 2.0f;
-		float gain = 0.5f;
-	};
-
 	// NOTE: This should be a pass
 	class TerrainRenderer
 	{
@@ -24,15 +22,41 @@ namespace Styx
 		TerrainRenderer(D3D12Lite::Device* device) : m_Device(device) {}
 		~TerrainRenderer() = default;
 
-		void Initialize();
+		// Streams the tiles of the heightfield at tileFilePath, imported with ImportHeightfield, when it opens and heightfield
+		// noise otherwise
+		void Initialize(const char* tileFilePath = nullptr);
 		void Shutdown();
 
-		void Render(D3D12Lite::GraphicsContext* gfx, D3D12Lite::ComputeContext* compute, Camera& camera, D3D12Lite::TextureResource* rt0, D3D12Lite::TextureResource* depthBuffer);
-		void RenderUI();
+		void Render(D3D12Lite::GraphicsContext* gfx, Camera& camera, D3D12Lite::TextureResource* rt0, D3D12Lite::TextureResource* depthBuffer);
+		// Edits the given constants rather than m_MaterialConstants, so the UI can run on another thread than Render
+		static void RenderUI(HeightfieldNoiseMaterialConstants& materialConstants);
+
+		// Dependencies the graphics submission containing this renderer's work has to declare
+		const D3D12Lite::QueueDependencies& GetGraphicsDependencies() const { return m_GraphicsDependencies; }
+
+		// Tiles are only regenerated when they are dirty. Changing m_MaterialConstants dirties all of them.
+		void MarkHeightfieldDirty(int32_t x, int32_t y, uint32_t width, uint32_t height) { m_TileStreamer->MarkDirty(x, y, width, height); }
+		const TerrainTileStreamerStats& GetTileStreamerStats() const { return m_TileStreamer->GetStats(); }
+		const TerrainLodStats& GetLodStats() const { return m_LodSelector->GetStats(); }
+		const TerrainScatterStats& GetScatterStats() const { return m_ScatterStats; }
+		const TerrainSurfaceMapsStats& GetSurfaceMapsStats() const { return m_SurfaceMaps->GetStats(); }
 
 	private:
-		void LoadResources();
 		void InitializePSOs();
+		void InitializeTiles(const char* tileFilePath);
+		// The grid every patch is drawn with, generated to match the LOD levels
+		void InitializePatchMesh();
+		void StreamTiles(const Camera& camera);
+		// Selects the patches of every tile in view whose heights and surface maps are on the GPU and writes them to this frame's patch buffer
+		uint32_t SelectPatches(const Camera& camera);
+		// Culls the scattered instances of the same tiles into this frame's scatter buffer, one range per layer
+		void CullScatter(const Camera& camera);
+		// A stand-in for the layers' meshes until they get their own, drawn at the bounds radius of each layer
+		void InitializeScatterMesh();
+		// Uploads the maps of a dirty slot to its copy the GPU isn't reading, returns false when they have to wait
+		bool UploadSurfaceMaps(uint32_t slot);
+		// Whether the heights and the surface maps of the tile in slot are on the GPU
+		bool IsTileReady(uint32_t slot) const;
 
 	public:
 		HeightfieldNoiseMaterialConstants m_MaterialConstants;
@@ -41,24 +65,86 @@ namespace Styx
 		D3D12Lite::Device* m_Device;
 
 		Mesh m_Mesh;
-		Transform m_Transform;
 
-		std::array<std::unique_ptr<D3D12Lite::BufferResource>, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_PassConstantBuffers;
-		std::array<std::unique_ptr<D3D12Lite::BufferResource>, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_ObjectConstantBuffers;
-		std::array<std::unique_ptr<D3D12Lite::BufferResource>, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_MaterialConstantBuffers;
 		D3D12Lite::PipelineResourceSpace m_PerPassResourceSpace;
 		D3D12Lite::PipelineResourceSpace m_PerObjectResourceSpace;
-		D3D12Lite::PipelineResourceSpace m_PerMaterialResourceSpace;
 		std::unique_ptr<D3D12Lite::Shader> m_VertexShader;
 		std::unique_ptr<D3D12Lite::Shader> m_PixelShader;
 		std::unique_ptr<D3D12Lite::PipelineStateObject> m_TerrainPSO;
 
-		std::unique_ptr<D3D12Lite::Shader> m_HeightfieldNoiseShader;
-		std::unique_ptr<D3D12Lite::PipelineStateObject> m_HeightfieldNoisePSO;
-		std::array<std::unique_ptr<D3D12Lite::BufferResource>, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_HeightfieldNoiseObjectConstantBuffers;
-		std::array<std::unique_ptr<D3D12Lite::BufferResource>, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_HeightfieldNoiseMaterialConstantBuffers;
-		D3D12Lite::PipelineResourceSpace m_HeightfieldNoisePerObjectResourceSpace;
-		D3D12Lite::PipelineResourceSpace m_HeightfieldNoisePerMaterialResourceSpace;
-		std::unique_ptr<D3D12Lite::TextureResource> m_HeightfieldTexture;
+		// One heightfield texture per slot of the tile cache. Tiles are read from m_TileFile when it is open.
+		std::unique_ptr<TerrainTileStreamer> m_TileStreamer;
+		TerrainTileFile m_TileFile;
+		// World height of a height of 65535
+		float m_TerrainHeight = 0.0f;
+		std::vector<D3D12Lite::TextureHandle> m_TileTextures;
+		D3D12Lite::SubResourceLayouts m_TileUploadLayouts{};
+		uint64_t m_TileUploadSize = 0;
+		uint64_t m_FrameIndex = 0;
+
+		// Every tile is the root of a quadtree, the selected nodes are drawn as instances of m_Mesh
+		std::unique_ptr<TerrainLodSelector> m_LodSelector;
+		std::vector<TerrainPatch> m_Patches;
+		std::array<D3D12Lite::BufferHandle, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_PatchBuffers;
+		std::array<uint32_t, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_PatchBufferCapacities{};
+		// Quads along a side of m_Mesh
+		uint32_t m_PatchGridResolution = 0;
+
+		// A layer with visible instances, drawn with numInstances instances starting at firstInstance in the scatter buffer
+		struct ScatterDraw
+		{
+			uint32_t layer;
+			uint32_t firstInstance;
+			uint32_t numInstances;
+		};
+
+		// Instances are generated with the tiles, and live in the slot of the tile like its heights
+		std::unique_ptr<TerrainScatter> m_Scatter;
+		std::vector<TerrainScatterTile> m_ScatterTiles;
+		std::array<D3D12Lite::BufferHandle, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_ScatterBuffers;
+		std::array<uint32_t, D3D12Lite::NUM_FRAMES_IN_FLIGHT> m_ScatterBufferCapacities{};
+		std::vector<ScatterDraw> m_ScatterDraws;
+		TerrainScatterStats m_ScatterStats;
+		Mesh m_ScatterMesh;
+		std::unique_ptr<D3D12Lite::Shader> m_ScatterVertexShader;
+		std::unique_ptr<D3D12Lite::Shader> m_ScatterPixelShader;
+		std::unique_ptr<D3D12Lite::PipelineStateObject> m_ScatterPSO;
+
+		// The normal and material weight textures of a cache slot. A tile's edges change while it's drawn, as its
+		// neighbours stream in, so every slot has two copies: new maps are uploaded to the one the GPU isn't reading and
+		// drawn once they landed.
+		static constexpr uint32_t INVALID_SURFACE_MAP_COPY = ~0u;
+
+		struct SurfaceMapCopy
+		{
+			D3D12Lite::TextureHandle normals;
+			D3D12Lite::TextureHandle weights;
+			// Bumped with every tile moving into the slot, a copy uploaded for an older one is never drawn
+			uint32_t tileVersion = 0;
+			// First frame the copy can be uploaded to again, once the frames that drew it are done with it
+			uint64_t reusableFrame = 0;
+		};
+
+		struct SurfaceMapSlot
+		{
+			std::array<SurfaceMapCopy, 2> copies;
+			uint32_t tileVersion = 0;
+			// The copy the shaders sample and the one uploaded but not landed yet, INVALID_SURFACE_MAP_COPY if none
+			uint32_t drawnCopy = INVALID_SURFACE_MAP_COPY;
+			uint32_t pendingCopy = INVALID_SURFACE_MAP_COPY;
+			// Changed since they were last uploaded, in m_DirtySurfaceMapSlots
+			bool isDirty = false;
+		};
+
+		// Normal and material weight maps of the tiles, by cache slot like their heights
+		std::unique_ptr<TerrainSurfaceMaps> m_SurfaceMaps;
+		std::vector<SurfaceMapSlot> m_SurfaceMapSlots;
+		std::vector<uint32_t> m_DirtySurfaceMapSlots;
+		D3D12Lite::SubResourceLayouts m_NormalMapUploadLayouts{};
+		D3D12Lite::SubResourceLayouts m_WeightMapUploadLayouts{};
+		uint64_t m_NormalMapUploadSize = 0;
+		uint64_t m_WeightMapUploadSize = 0;
+
+		D3D12Lite::QueueDependencies m_GraphicsDependencies;
 	};
 }
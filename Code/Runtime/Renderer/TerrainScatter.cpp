@@ -0,0 +1,430 @@
+#include "TerrainScatter.h"
+#include "Core/JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace Styx
+{
+	namespace
+	{
+		constexpr uint32_t EMPTY_CELL = ~0u;
+		// Candidates tried around a point before it's considered surrounded
+		constexpr uint32_t MAX_ATTEMPTS = 30;
+		constexpr float TWO_PI = 6.28318531f;
+
+		// What each hash of a point drives, so they are independent of each other
+		enum PointHash : uint32_t
+		{
+			keepHash,
+			yawHash,
+			scaleHash
+		};
+
+		// Xorshift with a splitmix seed, the same sequence on every platform
+		struct Random
+		{
+			uint64_t state;
+
+			explicit Random(uint32_t seed)
+			{
+				uint64_t z = static_cast<uint64_t>(seed) + 0x9E3779B97F4A7C15ull;
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				state = (z ^ (z >> 31)) | 1;
+			}
+
+			// In [0, 1)
+			float NextFloat()
+			{
+				state ^= state << 13;
+				state ^= state >> 7;
+				state ^= state << 17;
+				return static_cast<float>(state >> 40) * (1.0f / 16777216.0f);
+			}
+
+			uint32_t NextIndex(uint32_t count)
+			{
+				return (std::min)(static_cast<uint32_t>(NextFloat() * static_cast<float>(count)), count - 1);
+			}
+		};
+
+		// In [0, 1)
+		float HashPoint(uint32_t seed, const TerrainTileCoord& coord, uint32_t pointIndex, PointHash hashType)
+		{
+			uint32_t hash = seed * 0x9E3779B1u;
+			hash ^= static_cast<uint32_t>(coord.x) * 501125321u;
+			hash ^= static_cast<uint32_t>(coord.y) * 1136930381u;
+			hash ^= pointIndex * 2654435761u;
+			hash ^= static_cast<uint32_t>(hashType) * 0x85EBCA77u;
+			hash ^= hash >> 16;
+			hash *= 0x7feb352du;
+			hash ^= hash >> 15;
+			hash *= 0x846ca68bu;
+			hash ^= hash >> 16;
+
+			return static_cast<float>(hash >> 8) * (1.0f / 16777216.0f);
+		}
+
+		// 1 at fade or more past the limit, 0 at or before it
+		float Fade(float distancePastLimit, float fade)
+		{
+			if (fade <= 0.0f)
+			{
+				return distancePastLimit >= 0.0f ? 1.0f : 0.0f;
+			}
+
+			return std::clamp(distancePastLimit / fade, 0.0f, 1.0f);
+		}
+
+		float WrapToUnit(float value)
+		{
+			const float wrapped = value - floorf(value);
+			// Tiny negative values round up to 1
+			return wrapped < 1.0f ? wrapped : 0.0f;
+		}
+
+		float WrappedDistanceSquared(float x0, float y0, float x1, float y1)
+		{
+			float dx = fabsf(x0 - x1);
+			float dy = fabsf(y0 - y1);
+			dx = (std::min)(dx, 1.0f - dx);
+			dy = (std::min)(dy, 1.0f - dy);
+			return dx * dx + dy * dy;
+		}
+	}
+
+	TerrainScatter::TerrainScatter(const TerrainScatterDesc& desc)
+		: m_Desc(desc)
+	{
+		assert(desc.tileSize > 0 && desc.tileWorldSize > 0.0f);
+
+		m_Patterns.resize(desc.layers.size());
+		for (size_t layer = 0; layer < desc.layers.size(); layer++)
+		{
+			const TerrainScatterLayerDesc& layerDesc = desc.layers[layer];
+			assert(layerDesc.minSpacing > 0.0f && layerDesc.minSpacing < 0.5f * desc.tileWorldSize);
+			assert(layerDesc.minScale > 0.0f && layerDesc.minScale <= layerDesc.maxScale);
+
+			GeneratePoissonDiskPattern(layerDesc.minSpacing / desc.tileWorldSize, layerDesc.seed, m_Patterns[layer]);
+		}
+	}
+
+	void TerrainScatter::GenerateTile(const TerrainTileCoord& coord, const uint16_t* heights, TerrainScatterTile& outTile) const
+	{
+		const uint32_t tileSize = m_Desc.tileSize;
+		const uint32_t numSamples = tileSize + 1;
+		const float sampleSpacing = m_Desc.tileWorldSize / static_cast<float>(tileSize);
+		const float heightScale = m_Desc.heightScale / 65535.0f;
+		const float originX = static_cast<float>(coord.x) * m_Desc.tileWorldSize;
+		const float originZ = static_cast<float>(coord.y) * m_Desc.tileWorldSize;
+
+		outTile.instances.clear();
+		outTile.layerOffsets.assign(1, 0);
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			outTile.boundsMin[axis] = FLT_MAX;
+			outTile.boundsMax[axis] = -FLT_MAX;
+		}
+
+		for (uint32_t layer = 0; layer < GetNumLayers(); layer++)
+		{
+			const TerrainScatterLayerDesc& layerDesc = m_Desc.layers[layer];
+			const std::vector<float>& pattern = m_Patterns[layer];
+			const uint32_t numPoints = static_cast<uint32_t>(pattern.size() / 2);
+
+			for (uint32_t pointIndex = 0; pointIndex < numPoints; pointIndex++)
+			{
+				// The bilinear surface the terrain is drawn with, and its slope
+				const float sampleX = pattern[2 * pointIndex + 0] * static_cast<float>(tileSize);
+				const float sampleZ = pattern[2 * pointIndex + 1] * static_cast<float>(tileSize);
+				const uint32_t cellX = (std::min)(static_cast<uint32_t>(sampleX), tileSize - 1);
+				const uint32_t cellZ = (std::min)(static_cast<uint32_t>(sampleZ), tileSize - 1);
+				const float u = sampleX - static_cast<float>(cellX);
+				const float v = sampleZ - static_cast<float>(cellZ);
+
+				const uint16_t* row0 = heights + cellZ * numSamples + cellX;
+				const uint16_t* row1 = row0 + numSamples;
+				const float h00 = static_cast<float>(row0[0]) * heightScale;
+				const float h10 = static_cast<float>(row0[1]) * heightScale;
+				const float h01 = static_cast<float>(row1[0]) * heightScale;
+				const float h11 = static_cast<float>(row1[1]) * heightScale;
+
+				const float height0 = h00 + (h10 - h00) * u;
+				const float height1 = h01 + (h11 - h01) * u;
+				const float height = height0 + (height1 - height0) * v;
+				const float slopeX = ((h10 - h00) * (1.0f - v) + (h11 - h01) * v) / sampleSpacing;
+				const float slopeZ = (height1 - height0) / sampleSpacing;
+				const float slope = sqrtf(slopeX * slopeX + slopeZ * slopeZ);
+
+				const float heightMask = Fade(height - layerDesc.minHeight, layerDesc.heightFade) * Fade(layerDesc.maxHeight - height, layerDesc.heightFade);
+				const float slopeMask = Fade(layerDesc.maxSlope - slope, layerDesc.slopeFade);
+
+				if (HashPoint(layerDesc.seed, coord, pointIndex, keepHash) >= layerDesc.density * heightMask * slopeMask)
+				{
+					continue;
+				}
+
+				TerrainScatterInstance instance;
+				instance.positionX = originX + pattern[2 * pointIndex + 0] * m_Desc.tileWorldSize;
+				instance.positionY = height;
+				instance.positionZ = originZ + pattern[2 * pointIndex + 1] * m_Desc.tileWorldSize;
+				instance.yaw = HashPoint(layerDesc.seed, coord, pointIndex, yawHash) * TWO_PI;
+				instance.scale = layerDesc.minScale + (layerDesc.maxScale - layerDesc.minScale) * HashPoint(layerDesc.seed, coord, pointIndex, scaleHash);
+				outTile.instances.push_back(instance);
+
+				const float position[3] = { instance.positionX, instance.positionY, instance.positionZ };
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					outTile.boundsMin[axis] = (std::min)(outTile.boundsMin[axis], position[axis]);
+					outTile.boundsMax[axis] = (std::max)(outTile.boundsMax[axis], position[axis]);
+				}
+			}
+
+			outTile.layerOffsets.push_back(static_cast<uint32_t>(outTile.instances.size()));
+		}
+
+		if (outTile.instances.empty())
+		{
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				outTile.boundsMin[axis] = 0.0f;
+				outTile.boundsMax[axis] = 0.0f;
+			}
+		}
+	}
+
+	void TerrainScatter::GenerateTiles(const TerrainTileCoord* coords, const uint16_t* const* heights, uint32_t numTiles, TerrainScatterTile* outTiles) const
+	{
+		const auto generateTiles = [this, coords, heights, outTiles](uint32_t beginTile, uint32_t endTile)
+		{
+			for (uint32_t tileIndex = beginTile; tileIndex < endTile; tileIndex++)
+			{
+				GenerateTile(coords[tileIndex], heights[tileIndex], outTiles[tileIndex]);
+			}
+		};
+
+		JobSystem::ParallelFor(numTiles, 1, generateTiles);
+	}
+
+	uint32_t TerrainScatter::CullInstances(const TerrainScatterView& view, const TerrainScatterTile& tile, uint32_t layer, TerrainScatterInstance* outInstances) const
+	{
+		const uint32_t numInstances = tile.GetNumInstances(layer);
+		if (numInstances == 0)
+		{
+			return 0;
+		}
+
+		const TerrainScatterLayerDesc& layerDesc = m_Desc.layers[layer];
+		const TerrainScatterInstance* instances = tile.GetInstances(layer);
+
+		// Frustum planes from the columns of the view projection matrix, pointing inwards: left, right, bottom, top,
+		// near, far. Normalized, so the instance spheres can be tested against them.
+		float planes[6][4] = {};
+		uint32_t numPlanes = 0;
+
+		if (view.viewProjection)
+		{
+			const DirectX::XMFLOAT4X4& m = *view.viewProjection;
+			const float columnPlanes[6][4] =
+			{
+				{ m.m[0][3] + m.m[0][0], m.m[1][3] + m.m[1][0], m.m[2][3] + m.m[2][0], m.m[3][3] + m.m[3][0] },
+				{ m.m[0][3] - m.m[0][0], m.m[1][3] - m.m[1][0], m.m[2][3] - m.m[2][0], m.m[3][3] - m.m[3][0] },
+				{ m.m[0][3] + m.m[0][1], m.m[1][3] + m.m[1][1], m.m[2][3] + m.m[2][1], m.m[3][3] + m.m[3][1] },
+				{ m.m[0][3] - m.m[0][1], m.m[1][3] - m.m[1][1], m.m[2][3] - m.m[2][1], m.m[3][3] - m.m[3][1] },
+				{ m.m[0][2], m.m[1][2], m.m[2][2], m.m[3][2] },
+				{ m.m[0][3] - m.m[0][2], m.m[1][3] - m.m[1][2], m.m[2][3] - m.m[2][2], m.m[3][3] - m.m[3][2] },
+			};
+
+			for (uint32_t planeIndex = 0; planeIndex < 6; planeIndex++)
+			{
+				const float* plane = columnPlanes[planeIndex];
+				const float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+				const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+
+				for (uint32_t component = 0; component < 4; component++)
+				{
+					planes[planeIndex][component] = plane[component] * scale;
+				}
+			}
+
+			numPlanes = 6;
+		}
+
+		// The whole layer of the tile first, with the largest instance: most tiles are either entirely in view or out
+		// of it, only the ones on the edges need every instance tested
+		const float maxRadius = layerDesc.boundsRadius * layerDesc.maxScale;
+		float center[3];
+		float extents[3];
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			center[axis] = 0.5f * (tile.boundsMin[axis] + tile.boundsMax[axis]);
+			extents[axis] = 0.5f * (tile.boundsMax[axis] - tile.boundsMin[axis]) + maxRadius;
+		}
+
+		bool isFullyInside = true;
+		for (uint32_t planeIndex = 0; planeIndex < numPlanes; planeIndex++)
+		{
+			const float* plane = planes[planeIndex];
+			const float distance = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+			const float radius = fabsf(plane[0]) * extents[0] + fabsf(plane[1]) * extents[1] + fabsf(plane[2]) * extents[2];
+
+			if (distance < -radius)
+			{
+				return 0;
+			}
+
+			isFullyInside &= distance >= radius;
+		}
+
+		const bool hasDrawDistance = layerDesc.drawDistance < FLT_MAX;
+		const float drawDistanceSquared = layerDesc.drawDistance * layerDesc.drawDistance;
+
+		if (hasDrawDistance)
+		{
+			// Closest and furthest point of the bounds from the camera
+			const float viewPosition[3] = { view.positionX, view.positionY, view.positionZ };
+			float closestSquared = 0.0f;
+			float furthestSquared = 0.0f;
+
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				const float offset = fabsf(viewPosition[axis] - center[axis]);
+				const float outside = (std::max)(offset - extents[axis], 0.0f);
+				closestSquared += outside * outside;
+				furthestSquared += (offset + extents[axis]) * (offset + extents[axis]);
+			}
+
+			if (closestSquared > drawDistanceSquared)
+			{
+				return 0;
+			}
+
+			isFullyInside &= furthestSquared <= drawDistanceSquared;
+		}
+
+		if (isFullyInside)
+		{
+			for (uint32_t instanceIndex = 0; instanceIndex < numInstances; instanceIndex++)
+			{
+				outInstances[instanceIndex] = instances[instanceIndex];
+			}
+
+			return numInstances;
+		}
+
+		uint32_t numVisible = 0;
+
+		for (uint32_t instanceIndex = 0; instanceIndex < numInstances; instanceIndex++)
+		{
+			const TerrainScatterInstance& instance = instances[instanceIndex];
+			const float radius = layerDesc.boundsRadius * instance.scale;
+
+			bool isVisible = true;
+			for (uint32_t planeIndex = 0; planeIndex < numPlanes; planeIndex++)
+			{
+				const float* plane = planes[planeIndex];
+				isVisible &= plane[0] * instance.positionX + plane[1] * instance.positionY + plane[2] * instance.positionZ + plane[3] >= -radius;
+			}
+
+			if (hasDrawDistance)
+			{
+				const float toInstanceX = instance.positionX - view.positionX;
+				const float toInstanceY = instance.positionY - view.positionY;
+				const float toInstanceZ = instance.positionZ - view.positionZ;
+				isVisible &= toInstanceX * toInstanceX + toInstanceY * toInstanceY + toInstanceZ * toInstanceZ <= drawDistanceSquared;
+			}
+
+			if (isVisible)
+			{
+				outInstances[numVisible++] = instance;
+			}
+		}
+
+		return numVisible;
+	}
+
+	void TerrainScatter::GeneratePoissonDiskPattern(float minDistance, uint32_t seed, std::vector<float>& outPoints)
+	{
+		assert(minDistance > 0.0f && minDistance < 0.5f);
+
+		outPoints.clear();
+
+		// Cells small enough to hold a single point, the points closer than minDistance are then at most two cells away
+		const uint32_t gridSize = static_cast<uint32_t>(ceilf(1.41421356f / minDistance));
+		const float minDistanceSquared = minDistance * minDistance;
+
+		std::vector<uint32_t> grid(gridSize * gridSize, EMPTY_CELL);
+		std::vector<uint32_t> activePoints;
+		Random random(seed);
+
+		auto findCell = [gridSize](float coordinate) { return (std::min)(static_cast<uint32_t>(coordinate * static_cast<float>(gridSize)), gridSize - 1); };
+
+		auto addPoint = [&](float x, float y)
+		{
+			const uint32_t pointIndex = static_cast<uint32_t>(outPoints.size() / 2);
+			outPoints.push_back(x);
+			outPoints.push_back(y);
+			grid[findCell(y) * gridSize + findCell(x)] = pointIndex;
+			activePoints.push_back(pointIndex);
+		};
+
+		auto isFarEnough = [&](float x, float y)
+		{
+			const int32_t cellX = static_cast<int32_t>(findCell(x));
+			const int32_t cellY = static_cast<int32_t>(findCell(y));
+			const int32_t size = static_cast<int32_t>(gridSize);
+
+			for (int32_t offsetY = -2; offsetY <= 2; offsetY++)
+			{
+				for (int32_t offsetX = -2; offsetX <= 2; offsetX++)
+				{
+					const int32_t neighbourX = ((cellX + offsetX) % size + size) % size;
+					const int32_t neighbourY = ((cellY + offsetY) % size + size) % size;
+					const uint32_t neighbour = grid[neighbourY * size + neighbourX];
+
+					if (neighbour != EMPTY_CELL && WrappedDistanceSquared(x, y, outPoints[2 * neighbour], outPoints[2 * neighbour + 1]) < minDistanceSquared)
+					{
+						return false;
+					}
+				}
+			}
+
+			return true;
+		};
+
+		addPoint(random.NextFloat(), random.NextFloat());
+
+		while (!activePoints.empty())
+		{
+			const uint32_t activeIndex = random.NextIndex(static_cast<uint32_t>(activePoints.size()));
+			const uint32_t pointIndex = activePoints[activeIndex];
+			const float pointX = outPoints[2 * pointIndex];
+			const float pointY = outPoints[2 * pointIndex + 1];
+
+			bool hasAddedPoint = false;
+			for (uint32_t attempt = 0; attempt < MAX_ATTEMPTS; attempt++)
+			{
+				// Uniform over the annulus between minDistance and twice that
+				const float angle = random.NextFloat() * TWO_PI;
+				const float distance = minDistance * sqrtf(1.0f + 3.0f * random.NextFloat());
+				const float candidateX = WrapToUnit(pointX + cosf(angle) * distance);
+				const float candidateY = WrapToUnit(pointY + sinf(angle) * distance);
+
+				if (isFarEnough(candidateX, candidateY))
+				{
+					addPoint(candidateX, candidateY);
+					hasAddedPoint = true;
+					break;
+				}
+			}
+
+			if (!hasAddedPoint)
+			{
+				activePoints[activeIndex] = activePoints.back();
+				activePoints.pop_back();
+			}
+		}
+	}
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "TerrainTileCache.h"
+
+#include <DirectXMath.h>
+#include <cfloat>
+#include <stdint.h>
+#include <vector>
+
+namespace Styx
+{
+	// One kind of instance scattered over the terrain, e.g. a tree or a rock
+	struct TerrainScatterLayerDesc
+	{
+		// World distance two instances of the layer are always at least apart, tile borders included
+		float minSpacing = 4.0f;
+		uint32_t seed = 1;
+		// Fraction of the candidate points kept where the masks below are fully on
+		float density = 1.0f;
+		// World heights the layer grows between, it thins out over heightFade on both ends
+		float minHeight = -FLT_MAX;
+		float maxHeight = FLT_MAX;
+		float heightFade = 0.5f;
+		// Steepest ground the layer grows on as rise over run, it thins out over slopeFade below that
+		float maxSlope = 1.0f;
+		float slopeFade = 0.2f;
+		float minScale = 0.8f;
+		float maxScale = 1.2f;
+		// Radius of a sphere around the instance position bounding its mesh at scale 1, what it's culled with
+		float boundsRadius = 1.0f;
+		// Instances further away from the camera aren't drawn
+		float drawDistance = FLT_MAX;
+	};
+
+	struct TerrainScatterDesc
+	{
+		// Must match the tiles the heights come from, see TerrainTileStreamerDesc
+		uint32_t tileSize = 64;
+		float tileWorldSize = 100.0f;
+		// World height of a height of 65535
+		float heightScale = 1.0f;
+		std::vector<TerrainScatterLayerDesc> layers;
+	};
+
+	// NOTE: Must match ScatterInstance in the shaders drawing the layers. The vertex shader turns the mesh by yaw
+	// around +Y, scales it by scale and moves it to position.
+	struct TerrainScatterInstance
+	{
+		float positionX;
+		float positionY;
+		float positionZ;
+		float yaw;
+		float scale;
+	};
+
+	static_assert(sizeof(TerrainScatterInstance) == 20, "TerrainScatterInstance layout must match the shaders");
+
+	// The instances of a tile, layer by layer: those of layer l are [layerOffsets[l], layerOffsets[l + 1])
+	struct TerrainScatterTile
+	{
+		std::vector<TerrainScatterInstance> instances;
+		std::vector<uint32_t> layerOffsets;
+		// Of the instance positions of every layer
+		float boundsMin[3] = {};
+		float boundsMax[3] = {};
+
+		uint32_t GetNumInstances(uint32_t layer) const { return layerOffsets[layer + 1] - layerOffsets[layer]; }
+		const TerrainScatterInstance* GetInstances(uint32_t layer) const { return instances.data() + layerOffsets[layer]; }
+	};
+
+	// Where the camera is and what it sees. viewProjection follows the DirectXMath row vector convention with a [0, 1]
+	// depth range.
+	struct TerrainScatterView
+	{
+		float positionX = 0.0f;
+		float positionY = 0.0f;
+		float positionZ = 0.0f;
+		const DirectX::XMFLOAT4X4* viewProjection = nullptr;
+	};
+
+	struct TerrainScatterStats
+	{
+		uint32_t numTiles = 0;
+		uint32_t numInstances = 0;
+		uint32_t numVisibleInstances = 0;
+		// Layers with visible instances, each one instanced draw
+		uint32_t numDraws = 0;
+		double cullTimeInMilliseconds = 0.0;
+	};
+
+	// NOTE: Scatters instances over the heightfield tiles. Each layer has a Poisson disk pattern over a torus the size
+	// of a tile, so repeating it on every tile keeps instances minSpacing apart across tile borders too. The points of
+	// a tile are then kept or dropped by a hash of the tile and the point, against density masks derived from the
+	// height and the slope under them, so a tile always gets the same instances whichever thread generates it and
+	// whenever it's streamed in. Per-instance culling compacts the visible instances of a tile and layer into one
+	// contiguous range, so culling every tile of a layer one after the other draws the layer with a single
+	// DrawIndexedInstanced.
+	class TerrainScatter
+	{
+	public:
+		explicit TerrainScatter(const TerrainScatterDesc& desc);
+
+		// heights are the (tileSize + 1)^2 R16_UNORM heights of the tile at coord. Can be called from any thread.
+		void GenerateTile(const TerrainTileCoord& coord, const uint16_t* heights, TerrainScatterTile& outTile) const;
+		// Same as above for numTiles tiles, spread over the job system when it's initialized and this runs on one of
+		// its threads
+		void GenerateTiles(const TerrainTileCoord* coords, const uint16_t* const* heights, uint32_t numTiles, TerrainScatterTile* outTiles) const;
+
+		// Writes the instances of a layer of the tile that are within its draw distance and intersect the view frustum
+		// to outInstances, which needs room for all of them, in order. outInstances may point to write-combined upload
+		// memory: it is only ever written. Returns the number of instances written.
+		uint32_t CullInstances(const TerrainScatterView& view, const TerrainScatterTile& tile, uint32_t layer, TerrainScatterInstance* outInstances) const;
+
+		// The pattern of a layer, as x, y pairs in [0, 1)
+		const std::vector<float>& GetPattern(uint32_t layer) const { return m_Patterns[layer]; }
+		uint32_t GetNumLayers() const { return static_cast<uint32_t>(m_Desc.layers.size()); }
+		const TerrainScatterDesc& GetDesc() const { return m_Desc; }
+
+		// Bridson's algorithm over the unit square wrapped into a torus: every two points are at least minDistance
+		// apart, also across the edges, and few gaps are left. minDistance must be below 0.5.
+		static void GeneratePoissonDiskPattern(float minDistance, uint32_t seed, std::vector<float>& outPoints);
+
+	private:
+		TerrainScatterDesc m_Desc;
+		std::vector<std::vector<float>> m_Patterns;
+	};
+}
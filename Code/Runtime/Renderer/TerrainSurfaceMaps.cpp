@@ -0,0 +1,425 @@
+#include "TerrainSurfaceMaps.h"
+#include "Core/JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STYX_SURFACE_MAPS_SSE2 1
+#endif
+
+namespace Styx
+{
+	namespace
+	{
+		constexpr uint32_t NUM_MATERIALS = 4;
+
+		float Saturate(float value)
+		{
+			return (std::min)((std::max)(value, 0.0f), 1.0f);
+		}
+
+		// 1 / fade, a fade of 0 turns the mask into a step
+		float GetFadeScale(float fade)
+		{
+			return fade > 0.0f ? 1.0f / fade : FLT_MAX;
+		}
+
+		void ConvertHeights(const uint16_t* heights, uint32_t count, float* outHeights)
+		{
+			uint32_t i = 0;
+#if STYX_SURFACE_MAPS_SSE2
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 8 <= count; i += 8)
+			{
+				const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(heights + i));
+				_mm_storeu_ps(outHeights + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, zero)));
+				_mm_storeu_ps(outHeights + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(packed, zero)));
+			}
+#endif
+			for (; i < count; i++)
+			{
+				outHeights[i] = heights[i];
+			}
+		}
+
+#if STYX_SURFACE_MAPS_SSE2
+		__m128 SaturateSimd(__m128 value)
+		{
+			return _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		}
+#endif
+	}
+
+	TerrainSurfaceMaps::TerrainSurfaceMaps(const TerrainSurfaceMapsDesc& desc, uint32_t numSlots)
+		: m_Desc(desc)
+	{
+		assert(desc.tileSize >= 2);
+
+		// Heights stay in texel units, 65535 at heightScale
+		const float heightToTexel = 65535.0f / desc.heightScale;
+		const float sampleSpacing = desc.tileWorldSize / static_cast<float>(desc.tileSize);
+		m_NormalScale = desc.heightScale / (65535.0f * 2.0f * sampleSpacing);
+
+		for (uint32_t material = 0; material < NUM_MATERIALS; material++)
+		{
+			const TerrainMaterialDesc& materialDesc = desc.materials[material];
+			MaterialLimits& limits = m_MaterialLimits[material];
+			limits.minHeight = materialDesc.minHeight <= -FLT_MAX ? -FLT_MAX : materialDesc.minHeight * heightToTexel;
+			limits.maxHeight = materialDesc.maxHeight >= FLT_MAX ? FLT_MAX : materialDesc.maxHeight * heightToTexel;
+			limits.heightFadeScale = GetFadeScale(materialDesc.heightFade * heightToTexel);
+			limits.minSlope = materialDesc.minSlope;
+			limits.maxSlope = materialDesc.maxSlope;
+			limits.slopeFadeScale = GetFadeScale(materialDesc.slopeFade);
+		}
+
+		const uint32_t numTexels = (desc.tileSize + 1) * (desc.tileSize + 1);
+		m_Tiles.resize(numSlots);
+		for (Tile& tile : m_Tiles)
+		{
+			tile.heights.resize(numTexels);
+			tile.normals.resize(numTexels * 2);
+			tile.weights.resize(numTexels * 4);
+		}
+
+		m_SlotByCoord.reserve(numSlots);
+	}
+
+	void TerrainSurfaceMaps::SetTile(uint32_t slot, const TerrainTileCoord& coord, const uint16_t* heights)
+	{
+		ClearSlot(slot);
+
+		Tile& tile = m_Tiles[slot];
+		tile.coord = coord;
+		tile.isOccupied = true;
+		std::copy(heights, heights + tile.heights.size(), tile.heights.begin());
+
+		const uint32_t tileSize = m_Desc.tileSize;
+		MarkDirty(tile, 0, 0, tileSize, tileSize);
+		m_SlotByCoord[coord] = slot;
+
+		// A neighbour's edge texels are the only ones whose central differences reach into this tile
+		for (int32_t offsetY = -1; offsetY <= 1; offsetY++)
+		{
+			for (int32_t offsetX = -1; offsetX <= 1; offsetX++)
+			{
+				auto it = m_SlotByCoord.find(TerrainTileCoord{ coord.x + offsetX, coord.y + offsetY });
+				if ((offsetX == 0 && offsetY == 0) || it == m_SlotByCoord.end())
+				{
+					continue;
+				}
+
+				const uint32_t minX = offsetX < 0 ? tileSize : 0;
+				const uint32_t maxX = offsetX > 0 ? 0 : tileSize;
+				const uint32_t minY = offsetY < 0 ? tileSize : 0;
+				const uint32_t maxY = offsetY > 0 ? 0 : tileSize;
+				MarkDirty(m_Tiles[it->second], minX, minY, maxX, maxY);
+			}
+		}
+	}
+
+	void TerrainSurfaceMaps::ClearSlot(uint32_t slot)
+	{
+		Tile& tile = m_Tiles[slot];
+		if (!tile.isOccupied)
+		{
+			return;
+		}
+
+		// The tile may already have moved to a newer slot
+		auto it = m_SlotByCoord.find(tile.coord);
+		if (it != m_SlotByCoord.end() && it->second == slot)
+		{
+			m_SlotByCoord.erase(it);
+		}
+
+		tile.isOccupied = false;
+		tile.dirtyMinX = 1;
+		tile.dirtyMaxX = 0;
+	}
+
+	void TerrainSurfaceMaps::MarkDirty(Tile& tile, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY)
+	{
+		if (!tile.isQueued)
+		{
+			m_DirtySlots.push_back(static_cast<uint32_t>(&tile - m_Tiles.data()));
+			tile.isQueued = true;
+		}
+
+		if (tile.dirtyMinX > tile.dirtyMaxX)
+		{
+			tile.dirtyMinX = minX;
+			tile.dirtyMinY = minY;
+			tile.dirtyMaxX = maxX;
+			tile.dirtyMaxY = maxY;
+			return;
+		}
+
+		tile.dirtyMinX = (std::min)(tile.dirtyMinX, minX);
+		tile.dirtyMinY = (std::min)(tile.dirtyMinY, minY);
+		tile.dirtyMaxX = (std::max)(tile.dirtyMaxX, maxX);
+		tile.dirtyMaxY = (std::max)(tile.dirtyMaxY, maxY);
+	}
+
+	const std::vector<uint32_t>& TerrainSurfaceMaps::Update()
+	{
+		std::chrono::high_resolution_clock::time_point updateStart = std::chrono::high_resolution_clock::now();
+
+		// Slots cleared or moved to another tile after being dirtied are skipped
+		m_UpdatedSlots.clear();
+		uint32_t numTexelsUpdated = 0;
+		for (uint32_t slot : m_DirtySlots)
+		{
+			Tile& tile = m_Tiles[slot];
+			tile.isQueued = false;
+			if (tile.isOccupied && tile.dirtyMinX <= tile.dirtyMaxX)
+			{
+				m_UpdatedSlots.push_back(slot);
+				numTexelsUpdated += (tile.dirtyMaxX - tile.dirtyMinX + 1) * (tile.dirtyMaxY - tile.dirtyMinY + 1);
+			}
+		}
+
+		m_DirtySlots.clear();
+
+		const size_t scratchSize = static_cast<size_t>(m_Desc.tileSize + 3) * (m_Desc.tileSize + 3);
+		const uint32_t numScratches = JobSystem::GetNumThreads();
+		m_Scratch.resize(scratchSize * numScratches);
+
+		const auto updateTiles = [this, scratchSize](uint32_t beginTile, uint32_t endTile)
+		{
+			const uint32_t threadIndex = JobSystem::GetThreadIndex();
+			float* scratch = m_Scratch.data() + (threadIndex == JobSystem::INVALID_THREAD_INDEX ? 0 : threadIndex) * scratchSize;
+			for (uint32_t tileIndex = beginTile; tileIndex < endTile; tileIndex++)
+			{
+				UpdateTile(m_Tiles[m_UpdatedSlots[tileIndex]], scratch);
+			}
+		};
+
+		const uint32_t numTilesUpdated = static_cast<uint32_t>(m_UpdatedSlots.size());
+		JobSystem::ParallelFor(numTilesUpdated, 1, updateTiles);
+
+		for (uint32_t slot : m_UpdatedSlots)
+		{
+			Tile& tile = m_Tiles[slot];
+			tile.dirtyMinX = 1;
+			tile.dirtyMaxX = 0;
+		}
+
+		std::chrono::high_resolution_clock::time_point updateEnd = std::chrono::high_resolution_clock::now();
+		m_Stats.numTiles = static_cast<uint32_t>(m_SlotByCoord.size());
+		m_Stats.numTilesUpdated = numTilesUpdated;
+		m_Stats.numTexelsUpdated = numTexelsUpdated;
+		m_Stats.updateTimeInMilliseconds = std::chrono::duration<double, std::milli>(updateEnd - updateStart).count();
+
+		return m_UpdatedSlots;
+	}
+
+	const int8_t* TerrainSurfaceMaps::GetNormals(uint32_t slot) const
+	{
+		return m_Tiles[slot].isOccupied ? m_Tiles[slot].normals.data() : nullptr;
+	}
+
+	const uint8_t* TerrainSurfaceMaps::GetMaterialWeights(uint32_t slot) const
+	{
+		return m_Tiles[slot].isOccupied ? m_Tiles[slot].weights.data() : nullptr;
+	}
+
+	float TerrainSurfaceMaps::GetHeight(const Tile& tile, int32_t x, int32_t y) const
+	{
+		const int32_t tileSize = static_cast<int32_t>(m_Desc.tileSize);
+		const int32_t offsetX = x < 0 ? -1 : (x > tileSize ? 1 : 0);
+		const int32_t offsetY = y < 0 ? -1 : (y > tileSize ? 1 : 0);
+		const Tile* source = &tile;
+		if (offsetX != 0 || offsetY != 0)
+		{
+			auto it = m_SlotByCoord.find(TerrainTileCoord{ tile.coord.x + offsetX, tile.coord.y + offsetY });
+			if (it != m_SlotByCoord.end())
+			{
+				// Neighbours share their edge texels, so the texel past the edge is one in from the neighbour's edge
+				source = &m_Tiles[it->second];
+				x -= offsetX * tileSize;
+				y -= offsetY * tileSize;
+			}
+			else
+			{
+				x = (std::min)((std::max)(x, 0), tileSize);
+				y = (std::min)((std::max)(y, 0), tileSize);
+			}
+		}
+
+		return source->heights[static_cast<size_t>(y) * (tileSize + 1) + x];
+	}
+
+	void TerrainSurfaceMaps::UpdateTile(Tile& tile, float* scratch) const
+	{
+		const uint32_t tileSize = m_Desc.tileSize;
+		const uint32_t width = tile.dirtyMaxX - tile.dirtyMinX + 1;
+		const uint32_t height = tile.dirtyMaxY - tile.dirtyMinY + 1;
+		const uint32_t stride = width + 2;
+		const int32_t firstX = static_cast<int32_t>(tile.dirtyMinX) - 1;
+		const int32_t firstY = static_cast<int32_t>(tile.dirtyMinY) - 1;
+
+		// The dirty texels and a one texel border, only the border can come from the neighbours
+		for (uint32_t row = 0; row < height + 2; row++)
+		{
+			const int32_t y = firstY + static_cast<int32_t>(row);
+			float* out = scratch + static_cast<size_t>(row) * stride;
+			if (y < 0 || y > static_cast<int32_t>(tileSize))
+			{
+				for (uint32_t column = 0; column < stride; column++)
+				{
+					out[column] = GetHeight(tile, firstX + static_cast<int32_t>(column), y);
+				}
+
+				continue;
+			}
+
+			// Columns inside the tile
+			const uint32_t beginColumn = firstX < 0 ? 1 : 0;
+			const uint32_t endColumn = (std::min)(stride, static_cast<uint32_t>(static_cast<int32_t>(tileSize) + 1 - firstX));
+			ConvertHeights(tile.heights.data() + static_cast<size_t>(y) * (tileSize + 1) + (firstX + static_cast<int32_t>(beginColumn)), endColumn - beginColumn, out + beginColumn);
+			if (beginColumn > 0)
+			{
+				out[0] = GetHeight(tile, firstX, y);
+			}
+
+			for (uint32_t column = endColumn; column < stride; column++)
+			{
+				out[column] = GetHeight(tile, firstX + static_cast<int32_t>(column), y);
+			}
+		}
+
+		const size_t firstTexel = static_cast<size_t>(tile.dirtyMinY) * (tileSize + 1) + tile.dirtyMinX;
+		ComputeNormals(scratch, stride, width, height, m_NormalScale, tile.normals.data() + firstTexel * 2, tileSize + 1);
+		ComputeMaterialWeights(scratch, stride, width, height, tile.weights.data() + firstTexel * 4, tileSize + 1);
+	}
+
+	void TerrainSurfaceMaps::ComputeNormals(const float* heights, uint32_t heightStride, uint32_t width, uint32_t height, float normalScale, int8_t* outNormals, uint32_t normalStride)
+	{
+		// NOTE: Heightfield normals always point up, so the octahedral encoding never has to fold the lower hemisphere
+		// and (x, z) / (|x| + y + |z|) only needs the unnormalized normal (-dh/dx, 1, -dh/dz)
+		for (uint32_t y = 0; y < height; y++)
+		{
+			const float* up = heights + static_cast<size_t>(y) * heightStride + 1;
+			const float* center = heights + static_cast<size_t>(y + 1) * heightStride;
+			const float* down = heights + static_cast<size_t>(y + 2) * heightStride + 1;
+			int8_t* out = outNormals + static_cast<size_t>(y) * normalStride * 2;
+
+			uint32_t x = 0;
+#if STYX_SURFACE_MAPS_SSE2
+			const __m128 scale = _mm_set1_ps(-normalScale);
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 maxSnorm = _mm_set1_ps(127.0f);
+			const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+			for (; x + 4 <= width; x += 4)
+			{
+				const __m128 normalX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(center + x + 2), _mm_loadu_ps(center + x)), scale);
+				const __m128 normalZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(down + x), _mm_loadu_ps(up + x)), scale);
+				const __m128 norm = _mm_add_ps(_mm_add_ps(_mm_and_ps(normalX, absMask), _mm_and_ps(normalZ, absMask)), one);
+				const __m128 inverseNorm = _mm_div_ps(one, norm);
+				const __m128i x32 = _mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(normalX, inverseNorm), maxSnorm));
+				const __m128i z32 = _mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(normalZ, inverseNorm), maxSnorm));
+				const __m128i xz16 = _mm_unpacklo_epi16(_mm_packs_epi32(x32, x32), _mm_packs_epi32(z32, z32));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(out + 2 * x), _mm_packs_epi16(xz16, xz16));
+			}
+#endif
+			for (; x < width; x++)
+			{
+				const float normalX = (center[x + 2] - center[x]) * -normalScale;
+				const float normalZ = (down[x] - up[x]) * -normalScale;
+				const float inverseNorm = 1.0f / ((std::fabs(normalX) + std::fabs(normalZ)) + 1.0f);
+				out[2 * x] = static_cast<int8_t>(std::lrint((normalX * inverseNorm) * 127.0f));
+				out[2 * x + 1] = static_cast<int8_t>(std::lrint((normalZ * inverseNorm) * 127.0f));
+			}
+		}
+	}
+
+	void TerrainSurfaceMaps::ComputeMaterialWeights(const float* heights, uint32_t heightStride, uint32_t width, uint32_t height, uint8_t* outWeights, uint32_t weightStride) const
+	{
+		// Slopes from the same central differences as the normals
+		const float slopeScale = m_NormalScale;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			const float* up = heights + static_cast<size_t>(y) * heightStride + 1;
+			const float* center = heights + static_cast<size_t>(y + 1) * heightStride;
+			const float* down = heights + static_cast<size_t>(y + 2) * heightStride + 1;
+			uint8_t* out = outWeights + static_cast<size_t>(y) * weightStride * 4;
+
+			uint32_t x = 0;
+#if STYX_SURFACE_MAPS_SSE2
+			const __m128 scale = _mm_set1_ps(slopeScale);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 maxUnorm = _mm_set1_ps(255.0f);
+			for (; x + 4 <= width; x += 4)
+			{
+				const __m128 texelHeight = _mm_loadu_ps(center + x + 1);
+				const __m128 slopeX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(center + x + 2), _mm_loadu_ps(center + x)), scale);
+				const __m128 slopeZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(down + x), _mm_loadu_ps(up + x)), scale);
+				const __m128 slope = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeZ, slopeZ)));
+
+				__m128 weights[NUM_MATERIALS];
+				for (uint32_t material = 0; material < NUM_MATERIALS; material++)
+				{
+					const MaterialLimits& limits = m_MaterialLimits[material];
+					const __m128 heightFadeScale = _mm_set1_ps(limits.heightFadeScale);
+					const __m128 slopeFadeScale = _mm_set1_ps(limits.slopeFadeScale);
+					const __m128 aboveMin = SaturateSimd(_mm_mul_ps(_mm_sub_ps(texelHeight, _mm_set1_ps(limits.minHeight)), heightFadeScale));
+					const __m128 belowMax = SaturateSimd(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(limits.maxHeight), texelHeight), heightFadeScale));
+					const __m128 steeperThanMin = SaturateSimd(_mm_mul_ps(_mm_sub_ps(slope, _mm_set1_ps(limits.minSlope)), slopeFadeScale));
+					const __m128 gentlerThanMax = SaturateSimd(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(limits.maxSlope), slope), slopeFadeScale));
+					weights[material] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(aboveMin, belowMax), steeperThanMin), gentlerThanMax);
+				}
+
+				// Normalized to 255, the first material where none covers the terrain
+				const __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(weights[0], weights[1]), weights[2]), weights[3]);
+				const __m128 isCovered = _mm_cmpgt_ps(sum, zero);
+				const __m128 weightScale = _mm_and_ps(_mm_div_ps(maxUnorm, _mm_max_ps(sum, _mm_set1_ps(FLT_MIN))), isCovered);
+				for (uint32_t material = 0; material < NUM_MATERIALS; material++)
+				{
+					weights[material] = _mm_mul_ps(weights[material], weightScale);
+				}
+				weights[0] = _mm_or_ps(weights[0], _mm_andnot_ps(isCovered, maxUnorm));
+
+				// From a material per register to a texel per register
+				_MM_TRANSPOSE4_PS(weights[0], weights[1], weights[2], weights[3]);
+				const __m128i texels01 = _mm_packs_epi32(_mm_cvtps_epi32(weights[0]), _mm_cvtps_epi32(weights[1]));
+				const __m128i texels23 = _mm_packs_epi32(_mm_cvtps_epi32(weights[2]), _mm_cvtps_epi32(weights[3]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * x), _mm_packus_epi16(texels01, texels23));
+			}
+#endif
+			for (; x < width; x++)
+			{
+				const float texelHeight = center[x + 1];
+				const float slopeX = (center[x + 2] - center[x]) * slopeScale;
+				const float slopeZ = (down[x] - up[x]) * slopeScale;
+				const float slope = std::sqrt(slopeX * slopeX + slopeZ * slopeZ);
+
+				float weights[NUM_MATERIALS];
+				for (uint32_t material = 0; material < NUM_MATERIALS; material++)
+				{
+					const MaterialLimits& limits = m_MaterialLimits[material];
+					const float aboveMin = Saturate((texelHeight - limits.minHeight) * limits.heightFadeScale);
+					const float belowMax = Saturate((limits.maxHeight - texelHeight) * limits.heightFadeScale);
+					const float steeperThanMin = Saturate((slope - limits.minSlope) * limits.slopeFadeScale);
+					const float gentlerThanMax = Saturate((limits.maxSlope - slope) * limits.slopeFadeScale);
+					weights[material] = ((aboveMin * belowMax) * steeperThanMin) * gentlerThanMax;
+				}
+
+				const float sum = ((weights[0] + weights[1]) + weights[2]) + weights[3];
+				const float weightScale = sum > 0.0f ? 255.0f / (std::max)(sum, FLT_MIN) : 0.0f;
+				for (uint32_t material = 0; material < NUM_MATERIALS; material++)
+				{
+					out[4 * x + material] = static_cast<uint8_t>(std::lrint(weights[material] * weightScale));
+				}
+
+				if (sum <= 0.0f)
+				{
+					out[4 * x] = 255;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "TerrainTileCache.h"
+
+#include <array>
+#include <cfloat>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Styx
+{
+	// Where a material covers the terrain. Its weight is 1 inside the height and slope ranges and fades out over
+	// heightFade and slopeFade inside their limits, a fade of 0 gives a hard edge.
+	struct TerrainMaterialDesc
+	{
+		// World heights
+		float minHeight = -FLT_MAX;
+		float maxHeight = FLT_MAX;
+		float heightFade = 0.5f;
+		// Rise over run
+		float minSlope = -FLT_MAX;
+		float maxSlope = FLT_MAX;
+		float slopeFade = 0.2f;
+	};
+
+	struct TerrainSurfaceMapsDesc
+	{
+		// Must match the tiles the heights come from, see TerrainTileStreamerDesc
+		uint32_t tileSize = 64;
+		float tileWorldSize = 100.0f;
+		// World height of a height of 65535
+		float heightScale = 1.0f;
+		// One per channel of the weight maps. Where none of them covers the terrain the first one takes over.
+		std::array<TerrainMaterialDesc, 4> materials;
+	};
+
+	struct TerrainSurfaceMapsStats
+	{
+		uint32_t numTiles = 0;
+		// By the last Update, tiles whose neighbours changed only get their edges updated
+		uint32_t numTilesUpdated = 0;
+		uint32_t numTexelsUpdated = 0;
+		double updateTimeInMilliseconds = 0.0;
+
+		double GetMegapixelsPerSecond() const { return updateTimeInMilliseconds > 0.0 ? static_cast<double>(numTexelsUpdated) / (updateTimeInMilliseconds * 1000.0) : 0.0; }
+	};
+
+	// NOTE: Derives per-texel normal and material weight maps from the heightfield tiles, so the terrain shaders can
+	// sample them instead of working them out from the heights every pixel. Tiles live in the slots of the tile cache
+	// and keep a copy of their heights. Normals are central differences, taken across tile borders from the neighbouring
+	// tiles when they are resident and by repeating the edge otherwise. A new tile only dirties its own texels and the
+	// edge texels its neighbours share with it, so Update only redoes what changed and the seams close up as tiles
+	// stream in. Normals are stored octahedral as RG8_SNORM, weights as RGBA8_UNORM summing to 255 up to rounding.
+	class TerrainSurfaceMaps
+	{
+	public:
+		TerrainSurfaceMaps(const TerrainSurfaceMapsDesc& desc, uint32_t numSlots);
+
+		// The tile at coord now lives in slot with these (tileSize + 1)^2 heights, whatever the slot held before. Its
+		// maps and the edges of its resident neighbours are regenerated by the next Update.
+		void SetTile(uint32_t slot, const TerrainTileCoord& coord, const uint16_t* heights);
+		void ClearSlot(uint32_t slot);
+
+		// Regenerates what changed since the last Update, tiles spread over the job system when it's initialized and this
+		// runs on one of its threads. Returns the slots whose maps changed, to upload again.
+		const std::vector<uint32_t>& Update();
+
+		// (tileSize + 1)^2 texels each, null for an empty slot
+		const int8_t* GetNormals(uint32_t slot) const;
+		const uint8_t* GetMaterialWeights(uint32_t slot) const;
+		const TerrainSurfaceMapsStats& GetStats() const { return m_Stats; }
+		const TerrainSurfaceMapsDesc& GetDesc() const { return m_Desc; }
+
+		// Octahedral normals of the width x height texels inside heights, which has a one texel border and rows
+		// heightStride floats apart. normalScale turns the difference of two heights two texels apart into a slope.
+		static void ComputeNormals(const float* heights, uint32_t heightStride, uint32_t width, uint32_t height, float normalScale, int8_t* outNormals, uint32_t normalStride);
+		// Same as above for the material weights
+		void ComputeMaterialWeights(const float* heights, uint32_t heightStride, uint32_t width, uint32_t height, uint8_t* outWeights, uint32_t weightStride) const;
+
+	private:
+		struct Tile
+		{
+			TerrainTileCoord coord;
+			bool isOccupied = false;
+			// In m_DirtySlots
+			bool isQueued = false;
+			std::vector<uint16_t> heights;
+			std::vector<int8_t> normals;
+			std::vector<uint8_t> weights;
+			// Inclusive texel rectangle to regenerate, empty when dirtyMinX > dirtyMaxX
+			uint32_t dirtyMinX = 1;
+			uint32_t dirtyMinY = 1;
+			uint32_t dirtyMaxX = 0;
+			uint32_t dirtyMaxY = 0;
+		};
+
+		// Per material limits in height units and slopes, fades as reciprocals
+		struct MaterialLimits
+		{
+			float minHeight;
+			float maxHeight;
+			float heightFadeScale;
+			float minSlope;
+			float maxSlope;
+			float slopeFadeScale;
+		};
+
+		void MarkDirty(Tile& tile, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY);
+		void UpdateTile(Tile& tile, float* scratch) const;
+		// Height at x, y in the texels of tile, which may be up to one texel outside of it
+		float GetHeight(const Tile& tile, int32_t x, int32_t y) const;
+
+		TerrainSurfaceMapsDesc m_Desc;
+		std::array<MaterialLimits, 4> m_MaterialLimits;
+		float m_NormalScale = 0.0f;
+		std::vector<Tile> m_Tiles;
+		std::unordered_map<TerrainTileCoord, uint32_t, TerrainTileCoordHash> m_SlotByCoord;
+		std::vector<uint32_t> m_DirtySlots;
+		std::vector<uint32_t> m_UpdatedSlots;
+		std::vector<float> m_Scratch;
+		TerrainSurfaceMapsStats m_Stats;
+	};
+}
@@ -0,0 +1,174 @@
+#include "TerrainTileCache.h"
+
+#include <cassert>
+
+namespace Styx
+{
+	TerrainTileCache::TerrainTileCache(uint32_t capacity, uint32_t minFramesBeforeReuse)
+		: m_MinFramesBeforeReuse(minFramesBeforeReuse)
+	{
+		assert(capacity > 0);
+
+		m_Slots.resize(capacity);
+		m_SlotByCoord.reserve(capacity);
+
+		// Every slot is in the LRU list from the start, unused ones at the back
+		for (uint32_t slotIndex = 0; slotIndex < capacity; slotIndex++)
+		{
+			PushFront(slotIndex);
+		}
+	}
+
+	uint32_t TerrainTileCache::Lookup(const TerrainTileCoord& coord, uint64_t frameIndex)
+	{
+		auto it = m_SlotByCoord.find(coord);
+		if (it == m_SlotByCoord.end())
+		{
+			m_Stats.numMisses++;
+			return INVALID_SLOT;
+		}
+
+		m_Stats.numHits++;
+		Touch(it->second, frameIndex);
+		return it->second;
+	}
+
+	uint32_t TerrainTileCache::Find(const TerrainTileCoord& coord) const
+	{
+		auto it = m_SlotByCoord.find(coord);
+		return it != m_SlotByCoord.end() ? it->second : INVALID_SLOT;
+	}
+
+	uint32_t TerrainTileCache::Insert(const TerrainTileCoord& coord, uint64_t frameIndex)
+	{
+		// The list is ordered by last use, so the slots old enough to be reused are all at the back. Prefer one that
+		// doesn't hold a tile anymore, otherwise evict the least recently used tile.
+		uint32_t slotIndex = INVALID_SLOT;
+		for (uint32_t candidate = m_LeastRecent; candidate != INVALID_SLOT && IsReusable(m_Slots[candidate], frameIndex); candidate = m_Slots[candidate].previous)
+		{
+			if (slotIndex == INVALID_SLOT)
+			{
+				slotIndex = candidate;
+			}
+
+			if (!m_Slots[candidate].isOccupied)
+			{
+				slotIndex = candidate;
+				break;
+			}
+		}
+
+		if (slotIndex == INVALID_SLOT)
+		{
+			m_Stats.numRejectedInserts++;
+			return INVALID_SLOT;
+		}
+
+		Slot& slot = m_Slots[slotIndex];
+
+		if (slot.isOccupied)
+		{
+			m_SlotByCoord.erase(slot.coord);
+			m_Stats.numEvictions += slot.coord != coord ? 1 : 0;
+		}
+
+		// A new version of a cached tile: the previous slot keeps its contents until it's old enough to be reused
+		auto it = m_SlotByCoord.find(coord);
+		if (it != m_SlotByCoord.end())
+		{
+			m_Slots[it->second].isOccupied = false;
+			it->second = slotIndex;
+		}
+		else
+		{
+			m_SlotByCoord.emplace(coord, slotIndex);
+		}
+
+		slot.coord = coord;
+		slot.isOccupied = true;
+		Touch(slotIndex, frameIndex);
+
+		return slotIndex;
+	}
+
+	void TerrainTileCache::Remove(const TerrainTileCoord& coord)
+	{
+		auto it = m_SlotByCoord.find(coord);
+		if (it == m_SlotByCoord.end())
+		{
+			return;
+		}
+
+		m_Slots[it->second].isOccupied = false;
+		m_SlotByCoord.erase(it);
+	}
+
+	void TerrainTileCache::Clear()
+	{
+		for (Slot& slot : m_Slots)
+		{
+			slot.isOccupied = false;
+		}
+
+		m_SlotByCoord.clear();
+	}
+
+	void TerrainTileCache::Unlink(uint32_t slotIndex)
+	{
+		Slot& slot = m_Slots[slotIndex];
+
+		if (slot.previous != INVALID_SLOT)
+		{
+			m_Slots[slot.previous].next = slot.next;
+		}
+		else
+		{
+			m_MostRecent = slot.next;
+		}
+
+		if (slot.next != INVALID_SLOT)
+		{
+			m_Slots[slot.next].previous = slot.previous;
+		}
+		else
+		{
+			m_LeastRecent = slot.previous;
+		}
+
+		slot.previous = INVALID_SLOT;
+		slot.next = INVALID_SLOT;
+	}
+
+	void TerrainTileCache::PushFront(uint32_t slotIndex)
+	{
+		Slot& slot = m_Slots[slotIndex];
+		slot.previous = INVALID_SLOT;
+		slot.next = m_MostRecent;
+
+		if (m_MostRecent != INVALID_SLOT)
+		{
+			m_Slots[m_MostRecent].previous = slotIndex;
+		}
+		else
+		{
+			m_LeastRecent = slotIndex;
+		}
+
+		m_MostRecent = slotIndex;
+	}
+
+	void TerrainTileCache::Touch(uint32_t slotIndex, uint64_t frameIndex)
+	{
+		Slot& slot = m_Slots[slotIndex];
+		assert(!slot.hasBeenUsed || frameIndex >= slot.lastUsedFrame);
+
+		slot.hasBeenUsed = true;
+		slot.lastUsedFrame = frameIndex;
+
+		if (m_MostRecent != slotIndex)
+		{
+			Unlink(slotIndex);
+			PushFront(slotIndex);
+		}
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Styx
+{
+	// Tile (x, y) covers the terrain texels [x * tileSize, (x + 1) * tileSize] on both axes
+	struct TerrainTileCoord
+	{
+		int32_t x = 0;
+		int32_t y = 0;
+
+		bool operator==(const TerrainTileCoord& other) const { return x == other.x && y == other.y; }
+		bool operator!=(const TerrainTileCoord& other) const { return !(*this == other); }
+	};
+
+	struct TerrainTileCoordHash
+	{
+		size_t operator()(const TerrainTileCoord& coord) const
+		{
+			const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(coord.x)) << 32) | static_cast<uint32_t>(coord.y);
+			return std::hash<uint64_t>()(key);
+		}
+	};
+
+	struct TerrainTileCacheStats
+	{
+		uint64_t numHits = 0;
+		uint64_t numMisses = 0;
+		uint64_t numEvictions = 0;
+		// Inserts refused because every slot was used too recently to be overwritten
+		uint64_t numRejectedInserts = 0;
+
+		double GetHitRate() const { return numHits + numMisses > 0 ? static_cast<double>(numHits) / static_cast<double>(numHits + numMisses) : 0.0; }
+	};
+
+	// NOTE: Bounded LRU cache mapping terrain tiles to a fixed number of slots, e.g. the GPU textures holding their
+	// heights. A slot used in frame N can still be read by the GPU until frame N + minFramesBeforeReuse, so it isn't
+	// handed out again before then, whether its tile was evicted or invalidated. The cache only does the bookkeeping,
+	// what lives in a slot is up to the caller.
+	class TerrainTileCache
+	{
+	public:
+		static constexpr uint32_t INVALID_SLOT = ~0u;
+
+		TerrainTileCache(uint32_t capacity, uint32_t minFramesBeforeReuse);
+
+		// Returns the slot holding coord and marks it used in frameIndex, or INVALID_SLOT. Counts as a hit or a miss.
+		uint32_t Lookup(const TerrainTileCoord& coord, uint64_t frameIndex);
+		// Same as Lookup, without touching the tile or the stats
+		uint32_t Find(const TerrainTileCoord& coord) const;
+
+		// Assigns a slot to coord and marks it used in frameIndex. Takes a free slot or evicts the least recently used
+		// tile. If coord is already cached it moves to a new slot, so the old contents can be read until they are
+		// replaced. Returns INVALID_SLOT when no slot can be reused yet.
+		uint32_t Insert(const TerrainTileCoord& coord, uint64_t frameIndex);
+		// Marks a slot used in frameIndex without going through its tile, e.g. for a slot still being read after its tile
+		// moved to another one
+		void MarkUsed(uint32_t slot, uint64_t frameIndex) { Touch(slot, frameIndex); }
+		// Drops coord from the cache, its slot is reused once it's old enough
+		void Remove(const TerrainTileCoord& coord);
+		void Clear();
+
+		uint32_t GetCapacity() const { return static_cast<uint32_t>(m_Slots.size()); }
+		uint32_t GetNumTiles() const { return static_cast<uint32_t>(m_SlotByCoord.size()); }
+		const TerrainTileCacheStats& GetStats() const { return m_Stats; }
+		void ResetStats() { m_Stats = {}; }
+
+	private:
+		struct Slot
+		{
+			TerrainTileCoord coord;
+			bool isOccupied = false;
+			bool hasBeenUsed = false;
+			uint64_t lastUsedFrame = 0;
+			// Intrusive LRU list, m_MostRecent is the head
+			uint32_t previous = INVALID_SLOT;
+			uint32_t next = INVALID_SLOT;
+		};
+
+		bool IsReusable(const Slot& slot, uint64_t frameIndex) const { return !slot.hasBeenUsed || slot.lastUsedFrame + m_MinFramesBeforeReuse <= frameIndex; }
+		void Unlink(uint32_t slotIndex);
+		void PushFront(uint32_t slotIndex);
+		void Touch(uint32_t slotIndex, uint64_t frameIndex);
+
+		uint32_t m_MinFramesBeforeReuse = 0;
+		std::vector<Slot> m_Slots;
+		std::unordered_map<TerrainTileCoord, uint32_t, TerrainTileCoordHash> m_SlotByCoord;
+		uint32_t m_MostRecent = INVALID_SLOT;
+		uint32_t m_LeastRecent = INVALID_SLOT;
+		TerrainTileCacheStats m_Stats;
+	};
+}
@@ -0,0 +1,167 @@
+#include "TerrainTileFile.h"
+
+#include <cassert>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Styx
+{
+	TerrainTileFile::~TerrainTileFile()
+	{
+		Close();
+	}
+
+	bool TerrainTileFile::Open(const char* path)
+	{
+		Close();
+
+		// NOTE: The mapping keeps the file open, so the handles can go as soon as the view exists
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			printf("[TerrainTileFile] Failed to open '%s'\n", path);
+			return false;
+		}
+
+		LARGE_INTEGER fileSize = {};
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= static_cast<LONGLONG>(sizeof(TerrainTileFileHeader)))
+		{
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		}
+		CloseHandle(file);
+
+		if (mapping != nullptr)
+		{
+			m_Data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+		m_Size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+		const int file = open(path, O_RDONLY);
+		if (file < 0)
+		{
+			printf("[TerrainTileFile] Failed to open '%s'\n", path);
+			return false;
+		}
+
+		struct stat fileStatus = {};
+		if (fstat(file, &fileStatus) == 0 && fileStatus.st_size >= static_cast<off_t>(sizeof(TerrainTileFileHeader)))
+		{
+			void* data = mmap(nullptr, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_SHARED, file, 0);
+			m_Data = data != MAP_FAILED ? static_cast<const uint8_t*>(data) : nullptr;
+		}
+		close(file);
+		m_Size = static_cast<uint64_t>(fileStatus.st_size);
+#endif
+
+		if (m_Data == nullptr)
+		{
+			printf("[TerrainTileFile] Failed to map '%s'\n", path);
+			Close();
+			return false;
+		}
+
+		memcpy(&m_Header, m_Data, sizeof(m_Header));
+		const TerrainTileFileHeader& header = m_Header;
+		const bool isValid = header.magic == MAGIC && header.version == VERSION && header.tileSize >= 2 && (header.tileSize & (header.tileSize - 1)) == 0 &&
+			header.numMips >= 1 && header.numMips <= GetMaxNumMips(header.tileSize) && header.tileStride == GetTileStride(header.tileSize, header.numMips) &&
+			header.dataOffset >= sizeof(TerrainTileFileHeader) && m_Size >= header.dataOffset + static_cast<uint64_t>(header.numTilesX) * header.numTilesY * header.tileStride;
+		if (!isValid)
+		{
+			printf("[TerrainTileFile] '%s' is not a valid terrain tile file\n", path);
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void TerrainTileFile::Close()
+	{
+		if (m_Data != nullptr)
+		{
+#if defined(_WIN32)
+			UnmapViewOfFile(m_Data);
+#else
+			munmap(const_cast<uint8_t*>(m_Data), static_cast<size_t>(m_Size));
+#endif
+		}
+
+		m_Header = {};
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+
+	const uint8_t* TerrainTileFile::GetTile(uint32_t tileX, uint32_t tileY) const
+	{
+		assert(tileX < m_Header.numTilesX && tileY < m_Header.numTilesY);
+		const uint64_t tileIndex = static_cast<uint64_t>(tileY) * m_Header.numTilesX + tileX;
+		return m_Data + m_Header.dataOffset + tileIndex * m_Header.tileStride;
+	}
+
+	const uint16_t* TerrainTileFile::GetHeights(uint32_t tileX, uint32_t tileY, uint32_t mip) const
+	{
+		assert(mip < m_Header.numMips);
+		return reinterpret_cast<const uint16_t*>(GetTile(tileX, tileY) + GetMipOffset(m_Header.tileSize, mip));
+	}
+
+	const int8_t* TerrainTileFile::GetNormals(uint32_t tileX, uint32_t tileY) const
+	{
+		return reinterpret_cast<const int8_t*>(GetTile(tileX, tileY) + GetNormalsOffset(m_Header.tileSize, m_Header.numMips));
+	}
+
+	void TerrainTileFile::CopyTileHeights(const TerrainTileCoord& coord, uint16_t* heights) const
+	{
+		const size_t numHeights = static_cast<size_t>(m_Header.tileSize + 1) * (m_Header.tileSize + 1);
+		if (coord.x < 0 || coord.y < 0 || static_cast<uint32_t>(coord.x) >= m_Header.numTilesX || static_cast<uint32_t>(coord.y) >= m_Header.numTilesY)
+		{
+			memset(heights, 0, numHeights * sizeof(uint16_t));
+			return;
+		}
+
+		memcpy(heights, GetHeights(static_cast<uint32_t>(coord.x), static_cast<uint32_t>(coord.y), 0), numHeights * sizeof(uint16_t));
+	}
+
+	uint32_t TerrainTileFile::GetMaxNumMips(uint32_t tileSize)
+	{
+		uint32_t numMips = 1;
+		while ((tileSize >> numMips) != 0)
+		{
+			numMips++;
+		}
+
+		return numMips;
+	}
+
+	uint32_t TerrainTileFile::GetMipOffset(uint32_t tileSize, uint32_t mip)
+	{
+		uint32_t offset = 0;
+		for (uint32_t level = 0; level < mip; level++)
+		{
+			const uint32_t mipSize = GetMipSize(tileSize, level);
+			// Keep every mip 4 byte aligned
+			offset += (mipSize * mipSize * static_cast<uint32_t>(sizeof(uint16_t)) + 3) & ~3u;
+		}
+
+		return offset;
+	}
+
+	uint32_t TerrainTileFile::GetTileStride(uint32_t tileSize, uint32_t numMips)
+	{
+		const uint32_t numNormalBytes = (tileSize + 1) * (tileSize + 1) * 2;
+		return (GetNormalsOffset(tileSize, numMips) + numNormalBytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+}
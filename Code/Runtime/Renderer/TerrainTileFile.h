@@ -0,0 +1,76 @@
+#pragma once
+
+#include "TerrainTileCache.h"
+
+#include <stdint.h>
+
+namespace Styx
+{
+	// NOTE: Layout of an imported heightfield, see ImportHeightfield. The header is followed by padding up to
+	// dataOffset, then by the tiles row by row, each tileStride bytes long so a tile can be found, mapped or read on its
+	// own. A tile holds its heights mip after mip, mip m being ((tileSize >> m) + 1)^2 R16_UNORM texels, then the
+	// (tileSize + 1)^2 octahedral RG8_SNORM normals of mip 0, see TerrainSurfaceMaps. Neighbouring tiles share their
+	// edge texels.
+	struct TerrainTileFileHeader
+	{
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		// Heights of the source heightmap, tiles past its right and bottom edges repeat the edge heights
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t tileSize = 0;
+		uint32_t numTilesX = 0;
+		uint32_t numTilesY = 0;
+		uint32_t numMips = 0;
+		uint32_t tileStride = 0;
+		uint32_t dataOffset = 0;
+		// World distance between two heights and world height of a height of 65535, what the normals were made with
+		float sampleSpacing = 0.0f;
+		float heightScale = 0.0f;
+	};
+
+	// NOTE: Maps an imported heightfield into memory. Only the pages of the tiles that are read are loaded, so the
+	// streamer can pull tiles out of a heightfield far larger than memory.
+	class TerrainTileFile
+	{
+	public:
+		static constexpr uint32_t MAGIC = 0x46545453; // "STTF"
+		static constexpr uint32_t VERSION = 2;
+		// Tiles start on a page boundary
+		static constexpr uint32_t ALIGNMENT = 4096;
+
+		TerrainTileFile() = default;
+		~TerrainTileFile();
+
+		TerrainTileFile(const TerrainTileFile&) = delete;
+		TerrainTileFile& operator=(const TerrainTileFile&) = delete;
+
+		bool Open(const char* path);
+		void Close();
+
+		bool IsOpen() const { return m_Data != nullptr; }
+		const TerrainTileFileHeader& GetHeader() const { return m_Header; }
+
+		// tileX and tileY must be below numTilesX and numTilesY
+		const uint16_t* GetHeights(uint32_t tileX, uint32_t tileY, uint32_t mip) const;
+		const int8_t* GetNormals(uint32_t tileX, uint32_t tileY) const;
+
+		// Writes the (tileSize + 1)^2 mip 0 heights of the tile at coord, flat zero heights outside the heightfield. Can
+		// be called from any thread, e.g. by a TerrainTileGenerator.
+		void CopyTileHeights(const TerrainTileCoord& coord, uint16_t* heights) const;
+
+		// Mip chain down to a single quad
+		static uint32_t GetMaxNumMips(uint32_t tileSize);
+		static uint32_t GetMipSize(uint32_t tileSize, uint32_t mip) { return (tileSize >> mip) + 1; }
+		static uint32_t GetMipOffset(uint32_t tileSize, uint32_t mip);
+		static uint32_t GetNormalsOffset(uint32_t tileSize, uint32_t numMips) { return GetMipOffset(tileSize, numMips); }
+		static uint32_t GetTileStride(uint32_t tileSize, uint32_t numMips);
+
+	private:
+		const uint8_t* GetTile(uint32_t tileX, uint32_t tileY) const;
+
+		TerrainTileFileHeader m_Header;
+		const uint8_t* m_Data = nullptr;
+		uint64_t m_Size = 0;
+	};
+}
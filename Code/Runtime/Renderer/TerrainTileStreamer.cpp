@@ -0,0 +1,386 @@
+#include "TerrainTileStreamer.h"
+#include "Core/JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	double ToMilliseconds(std::chrono::high_resolution_clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+}
+
+void Styx::GenerateTerrainTileHeights(const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights)
+{
+	const uint32_t numSamples = tileSize + 1;
+
+	thread_local std::vector<float> samples;
+	samples.resize(numSamples * numSamples);
+
+	GenerateHeightfieldNoise(constants, coord.x * static_cast<int32_t>(tileSize), coord.y * static_cast<int32_t>(tileSize), numSamples, numSamples, samples.data(), numSamples);
+
+	for (uint32_t sampleIndex = 0; sampleIndex < numSamples * numSamples; sampleIndex++)
+	{
+		heights[sampleIndex] = static_cast<uint16_t>(samples[sampleIndex] * 65535.0f + 0.5f);
+	}
+}
+
+Styx::TerrainTileStreamer::TerrainTileStreamer(const TerrainTileStreamerDesc& desc, TerrainTileGenerator generator, const TerrainScatter* scatter)
+	: m_Desc(desc)
+	, m_Generator(std::move(generator))
+	, m_Scatter(scatter)
+	, m_Cache(desc.cacheCapacity, desc.minFramesBeforeReuse)
+	, m_TileVersions(desc.tileSize)
+{
+	// A slot drawn this frame must never be handed out again in the same frame
+	assert(desc.minFramesBeforeReuse > 0);
+	assert(desc.numGeneratorThreads > 0);
+	assert(desc.tileSize > 0 && desc.tileWorldSize > 0.0f);
+	assert(!scatter || (scatter->GetDesc().tileSize == desc.tileSize && scatter->GetDesc().tileWorldSize == desc.tileWorldSize));
+
+	m_SlotVersions.resize(desc.cacheCapacity, 0);
+	// Uploads point into the uploaded tiles, which must not move while they are pushed
+	m_UploadedTiles.reserve(desc.maxUploadsPerFrame);
+
+	for (uint32_t threadIndex = 0; threadIndex < desc.numGeneratorThreads; threadIndex++)
+	{
+		m_GeneratorThreads.emplace_back([this]() { GeneratorThread(); });
+	}
+}
+
+Styx::TerrainTileStreamer::~TerrainTileStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsStopping = true;
+	}
+
+	m_WorkAvailable.notify_all();
+
+	for (std::thread& generatorThread : m_GeneratorThreads)
+	{
+		generatorThread.join();
+	}
+}
+
+void Styx::TerrainTileStreamer::SetNoiseConstants(const HeightfieldNoiseMaterialConstants& constants)
+{
+	if (memcmp(&constants, &m_NoiseConstants, sizeof(HeightfieldNoiseMaterialConstants)) == 0)
+	{
+		return;
+	}
+
+	m_NoiseConstants = constants;
+	m_TileVersions.MarkAllDirty();
+}
+
+void Styx::TerrainTileStreamer::MarkDirty(int32_t x, int32_t y, uint32_t width, uint32_t height)
+{
+	m_TileVersions.MarkDirty(x, y, width, height);
+}
+
+void Styx::TerrainTileStreamer::Update(const TerrainTileView& view, uint64_t frameIndex)
+{
+	m_Uploads.clear();
+	m_UploadedTiles.clear();
+	m_VisibleTiles.clear();
+	m_NewRequests.clear();
+
+	// Requests nobody picked up yet are taken back and queued again below if they are still needed, with their new
+	// priority. The ones being generated stay pending.
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_RequeueCandidates.swap(m_Queue);
+		m_CompletedTiles.swap(m_Generated);
+	}
+
+	CollectGeneratedTiles();
+
+	for (auto it = m_UploadsInFlight.begin(); it != m_UploadsInFlight.end();)
+	{
+		it = it->second.readyFrame <= frameIndex ? m_UploadsInFlight.erase(it) : std::next(it);
+	}
+
+	// Tiles in view, most urgent first
+	const int32_t centreTileX = static_cast<int32_t>(std::floor(view.positionX / m_Desc.tileWorldSize));
+	const int32_t centreTileY = static_cast<int32_t>(std::floor(view.positionZ / m_Desc.tileWorldSize));
+	const int32_t viewRadius = static_cast<int32_t>(m_Desc.viewRadius);
+
+	m_DesiredTiles.clear();
+	for (int32_t tileY = centreTileY - viewRadius; tileY <= centreTileY + viewRadius; tileY++)
+	{
+		for (int32_t tileX = centreTileX - viewRadius; tileX <= centreTileX + viewRadius; tileX++)
+		{
+			const TerrainTileCoord coord{ tileX, tileY };
+			m_DesiredTiles.push_back({ coord, ComputeTilePriority(coord, view, m_Desc.tileWorldSize) });
+		}
+	}
+
+	std::sort(m_DesiredTiles.begin(), m_DesiredTiles.end(), [](const DesiredTile& a, const DesiredTile& b) { return a.priority < b.priority; });
+
+	m_RequeueCandidateIndices.clear();
+	for (uint32_t candidateIndex = 0; candidateIndex < m_RequeueCandidates.size(); candidateIndex++)
+	{
+		m_RequeueCandidateIndices[m_RequeueCandidates[candidateIndex].coord] = candidateIndex;
+	}
+
+	const Clock::time_point now = Clock::now();
+	uint32_t numTilesRequested = 0;
+
+	for (const DesiredTile& desiredTile : m_DesiredTiles)
+	{
+		const TerrainTileCoord& coord = desiredTile.coord;
+		const uint32_t requiredVersion = m_TileVersions.GetRequiredVersion(coord);
+
+		const uint32_t slot = m_Cache.Lookup(coord, frameIndex);
+		if (slot != TerrainTileCache::INVALID_SLOT)
+		{
+			AddVisibleTile(coord, slot, frameIndex);
+
+			if (m_SlotVersions[slot] >= requiredVersion)
+			{
+				continue;
+			}
+		}
+
+		// Generated already, waiting for an upload and a slot
+		auto readyTile = m_ReadyTiles.find(coord);
+		if (readyTile != m_ReadyTiles.end() && readyTile->second.version < requiredVersion)
+		{
+			m_ReadyTiles.erase(readyTile);
+			readyTile = m_ReadyTiles.end();
+		}
+
+		if (readyTile != m_ReadyTiles.end())
+		{
+			if (m_Uploads.size() >= m_Desc.maxUploadsPerFrame)
+			{
+				continue;
+			}
+
+			const uint32_t newSlot = m_Cache.Insert(coord, frameIndex);
+			if (newSlot == TerrainTileCache::INVALID_SLOT)
+			{
+				continue;
+			}
+
+			m_SlotVersions[newSlot] = readyTile->second.version;
+			m_UploadsInFlight[coord] = UploadInFlight{ slot, frameIndex + m_Desc.minFramesBeforeReuse };
+
+			m_UploadedTiles.push_back(std::move(readyTile->second));
+			m_ReadyTiles.erase(readyTile);
+			const GeneratedTile& uploadedTile = m_UploadedTiles.back();
+			m_Uploads.push_back({ coord, newSlot, uploadedTile.heights.data(), m_Scatter ? &uploadedTile.scatter : nullptr });
+			continue;
+		}
+
+		// Already requested: either still queued, then it's queued again, or being generated
+		auto pendingVersion = m_PendingVersions.find(coord);
+		if (pendingVersion != m_PendingVersions.end() && pendingVersion->second >= requiredVersion)
+		{
+			auto candidate = m_RequeueCandidateIndices.find(coord);
+			if (candidate != m_RequeueCandidateIndices.end())
+			{
+				m_NewRequests.push_back(m_RequeueCandidates[candidate->second]);
+				m_RequeueCandidateIndices.erase(candidate);
+			}
+
+			continue;
+		}
+
+		numTilesRequested++;
+
+		Request request;
+		request.coord = coord;
+		request.version = m_TileVersions.GetVersion();
+		request.constants = m_NoiseConstants;
+		request.requestTime = now;
+		m_NewRequests.push_back(request);
+	}
+
+	// Queued requests for tiles out of view are dropped
+	for (const auto& [coord, candidateIndex] : m_RequeueCandidateIndices)
+	{
+		auto pendingVersion = m_PendingVersions.find(coord);
+		if (pendingVersion != m_PendingVersions.end() && pendingVersion->second == m_RequeueCandidates[candidateIndex].version)
+		{
+			m_PendingVersions.erase(pendingVersion);
+		}
+	}
+
+	m_RequeueCandidates.clear();
+
+	// Generated tiles out of view aren't worth keeping around, they are generated again if they come back in view
+	for (auto it = m_ReadyTiles.begin(); it != m_ReadyTiles.end();)
+	{
+		const bool isInView = std::abs(it->first.x - centreTileX) <= viewRadius && std::abs(it->first.y - centreTileY) <= viewRadius;
+		it = isInView ? std::next(it) : m_ReadyTiles.erase(it);
+	}
+
+	for (const Request& request : m_NewRequests)
+	{
+		m_PendingVersions[request.coord] = request.version;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Queue.assign(m_NewRequests.rbegin(), m_NewRequests.rend());
+	}
+
+	if (!m_NewRequests.empty())
+	{
+		m_WorkAvailable.notify_all();
+	}
+
+	m_Stats.numVisibleTiles = static_cast<uint32_t>(m_VisibleTiles.size());
+	m_Stats.numResidentTiles = m_Cache.GetNumTiles();
+	m_Stats.numPendingTiles = static_cast<uint32_t>(m_PendingVersions.size());
+	m_Stats.numReadyTiles = static_cast<uint32_t>(m_ReadyTiles.size());
+	m_Stats.numUploads = static_cast<uint32_t>(m_Uploads.size());
+	m_Stats.numTilesRequested = numTilesRequested;
+	m_Stats.cacheStats = m_Cache.GetStats();
+}
+
+void Styx::TerrainTileStreamer::WaitForIdle()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_WorkDone.wait(lock, [this]() { return m_Queue.empty() && m_NumGenerating == 0; });
+}
+
+float Styx::TerrainTileStreamer::ComputeTilePriority(const TerrainTileCoord& coord, const TerrainTileView& view, float tileWorldSize)
+{
+	const float toTileX = (static_cast<float>(coord.x) + 0.5f) - view.positionX / tileWorldSize;
+	const float toTileZ = (static_cast<float>(coord.y) + 0.5f) - view.positionZ / tileWorldSize;
+	const float distance = std::sqrt(toTileX * toTileX + toTileZ * toTileZ);
+
+	const float forwardLength = std::sqrt(view.forwardX * view.forwardX + view.forwardZ * view.forwardZ);
+	if (distance < 1e-4f || forwardLength < 1e-4f)
+	{
+		return distance;
+	}
+
+	// 1 straight ahead, 2 straight behind
+	const float facing = (toTileX * view.forwardX + toTileZ * view.forwardZ) / (distance * forwardLength);
+	return distance * (1.5f - 0.5f * facing);
+}
+
+void Styx::TerrainTileStreamer::GeneratorThread()
+{
+	const uint32_t numSamples = m_Desc.tileSize + 1;
+
+	// The noise, the erosion and the scatter spread their loops over the workers from a registered thread only
+	const bool isJobThread = JobSystem::RegisterThread();
+
+	while (true)
+	{
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_WorkAvailable.wait(lock, [this]() { return m_IsStopping || !m_Queue.empty(); });
+
+			if (m_IsStopping)
+			{
+				break;
+			}
+
+			request = m_Queue.back();
+			m_Queue.pop_back();
+			m_NumGenerating++;
+		}
+
+		GeneratedTile tile;
+		tile.coord = request.coord;
+		tile.version = request.version;
+		tile.heights.resize(numSamples * numSamples);
+
+		const Clock::time_point generationStart = Clock::now();
+		m_Generator(request.coord, request.constants, m_Desc.tileSize, tile.heights.data());
+
+		if (m_Scatter)
+		{
+			m_Scatter->GenerateTile(request.coord, tile.heights.data(), tile.scatter);
+		}
+
+		const Clock::time_point generationEnd = Clock::now();
+
+		tile.generationTimeInMilliseconds = ToMilliseconds(generationEnd - generationStart);
+		tile.latencyInMilliseconds = ToMilliseconds(generationEnd - request.requestTime);
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Generated.push_back(std::move(tile));
+			m_NumGenerating--;
+		}
+
+		m_WorkDone.notify_all();
+	}
+
+	if (isJobThread)
+	{
+		JobSystem::UnregisterThread();
+	}
+}
+
+void Styx::TerrainTileStreamer::CollectGeneratedTiles()
+{
+	for (GeneratedTile& tile : m_CompletedTiles)
+	{
+		auto pendingVersion = m_PendingVersions.find(tile.coord);
+		if (pendingVersion != m_PendingVersions.end() && pendingVersion->second == tile.version)
+		{
+			m_PendingVersions.erase(pendingVersion);
+		}
+
+		m_Stats.numTilesGenerated++;
+		m_TotalGenerationLatencyInMilliseconds += tile.latencyInMilliseconds;
+		m_TotalGenerationTimeInMilliseconds += tile.generationTimeInMilliseconds;
+		m_Stats.maxGenerationLatencyInMilliseconds = (std::max)(m_Stats.maxGenerationLatencyInMilliseconds, tile.latencyInMilliseconds);
+
+		// Outdated while it was being generated
+		if (m_TileVersions.IsOutdated(tile.coord, tile.version))
+		{
+			continue;
+		}
+
+		auto readyTile = m_ReadyTiles.find(tile.coord);
+		if (readyTile == m_ReadyTiles.end())
+		{
+			m_ReadyTiles.emplace(tile.coord, std::move(tile));
+		}
+		else if (readyTile->second.version < tile.version)
+		{
+			readyTile->second = std::move(tile);
+		}
+	}
+
+	if (m_Stats.numTilesGenerated > 0)
+	{
+		m_Stats.averageGenerationLatencyInMilliseconds = m_TotalGenerationLatencyInMilliseconds / static_cast<double>(m_Stats.numTilesGenerated);
+		m_Stats.averageGenerationTimeInMilliseconds = m_TotalGenerationTimeInMilliseconds / static_cast<double>(m_Stats.numTilesGenerated);
+	}
+
+	m_CompletedTiles.clear();
+}
+
+void Styx::TerrainTileStreamer::AddVisibleTile(const TerrainTileCoord& coord, uint32_t slot, uint64_t frameIndex)
+{
+	// A new version whose upload hasn't landed yet: keep drawing the previous one, if there is one
+	auto uploadInFlight = m_UploadsInFlight.find(coord);
+	if (uploadInFlight != m_UploadsInFlight.end())
+	{
+		const uint32_t previousSlot = uploadInFlight->second.previousSlot;
+		if (previousSlot != TerrainTileCache::INVALID_SLOT)
+		{
+			m_Cache.MarkUsed(previousSlot, frameIndex);
+			m_VisibleTiles.push_back({ coord, previousSlot });
+		}
+
+		return;
+	}
+
+	m_VisibleTiles.push_back({ coord, slot });
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "HeightfieldNoise.h"
+#include "TerrainScatter.h"
+#include "TerrainTileCache.h"
+#include "TerrainTileVersions.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Styx
+{
+	struct TerrainTileStreamerDesc
+	{
+		// Quads along a tile side. Tiles hold (tileSize + 1)^2 heights, so neighbours share their edge texels.
+		uint32_t tileSize = 64;
+		float tileWorldSize = 100.0f;
+		// Tiles up to this many tiles away from the camera's tile, on either axis, are streamed in
+		uint32_t viewRadius = 3;
+		// Room for every tile in view plus a new version of each, so regenerating the terrain never starves the view
+		uint32_t cacheCapacity = 128;
+		// Frames the GPU can still read a tile's texture after the CPU last used it, i.e. the frames in flight
+		uint32_t minFramesBeforeReuse = 2;
+		uint32_t maxUploadsPerFrame = 4;
+		uint32_t numGeneratorThreads = 2;
+	};
+
+	// Where the camera is on the terrain plane (world XZ) and where it looks
+	struct TerrainTileView
+	{
+		float positionX = 0.0f;
+		float positionZ = 0.0f;
+		float forwardX = 0.0f;
+		float forwardZ = 1.0f;
+	};
+
+	// Writes the (tileSize + 1)^2 heights of a tile as R16_UNORM texels. Called on the generator threads.
+	using TerrainTileGenerator = std::function<void(const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights)>;
+
+	// Generates a tile with the heightfield noise
+	void GenerateTerrainTileHeights(const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights);
+
+	// A generated tile to copy into the texture of its slot. heights and scatter stay valid until the next Update,
+	// scatter is null without a TerrainScatter.
+	struct TerrainTileUpload
+	{
+		TerrainTileCoord coord;
+		uint32_t slot = TerrainTileCache::INVALID_SLOT;
+		const uint16_t* heights = nullptr;
+		const TerrainScatterTile* scatter = nullptr;
+	};
+
+	struct TerrainTileDraw
+	{
+		TerrainTileCoord coord;
+		uint32_t slot = TerrainTileCache::INVALID_SLOT;
+	};
+
+	struct TerrainTileStreamerStats
+	{
+		uint32_t numVisibleTiles = 0;
+		uint32_t numResidentTiles = 0;
+		// Requested but not generated yet, generated but not uploaded yet
+		uint32_t numPendingTiles = 0;
+		uint32_t numReadyTiles = 0;
+		uint32_t numUploads = 0;
+		// Tiles requested this frame because they were missing, outdated by new constants or marked dirty
+		uint32_t numTilesRequested = 0;
+		uint64_t numTilesGenerated = 0;
+		TerrainTileCacheStats cacheStats;
+		// From the frame a tile was requested to the end of its generation, and the generation alone
+		double averageGenerationLatencyInMilliseconds = 0.0;
+		double maxGenerationLatencyInMilliseconds = 0.0;
+		double averageGenerationTimeInMilliseconds = 0.0;
+	};
+
+	// NOTE: Streams the heightfield tiles around the camera. Every Update works out the tiles in view, requests the
+	// missing or outdated ones from background generator threads, most urgent first, and hands out at most
+	// maxUploadsPerFrame generated tiles to upload, each with a slot in the tile cache. A new version of a tile gets a
+	// new slot: the old one keeps being drawn until the upload had time to land, minFramesBeforeReuse frames later.
+	// Nothing here touches the GPU, the caller owns a texture per slot. With a TerrainScatter the generator threads also
+	// scatter instances over each tile once its heights are done, and they are handed out with its upload.
+	// The generator threads register with the job system when it has an external thread slot left for each of them, so
+	// the loops they run spread over the workers. The streamer must then be destroyed before the job system shuts down.
+	// Changes are tracked by TerrainTileVersions: new constants outdate every tile, MarkDirty only the tiles it overlaps,
+	// and a frame without changes requests nothing.
+	class TerrainTileStreamer
+	{
+	public:
+		// scatter must outlive the streamer
+		explicit TerrainTileStreamer(const TerrainTileStreamerDesc& desc, TerrainTileGenerator generator = GenerateTerrainTileHeights, const TerrainScatter* scatter = nullptr);
+		~TerrainTileStreamer();
+
+		TerrainTileStreamer(const TerrainTileStreamer&) = delete;
+		TerrainTileStreamer& operator=(const TerrainTileStreamer&) = delete;
+
+		// Regenerates every tile when the constants changed
+		void SetNoiseConstants(const HeightfieldNoiseMaterialConstants& constants);
+		// Regenerates the tiles overlapping the texels [x, x + width) x [y, y + height)
+		void MarkDirty(int32_t x, int32_t y, uint32_t width, uint32_t height);
+
+		// frameIndex must not decrease between calls
+		void Update(const TerrainTileView& view, uint64_t frameIndex);
+
+		// Results of the last Update
+		const std::vector<TerrainTileUpload>& GetUploads() const { return m_Uploads; }
+		const std::vector<TerrainTileDraw>& GetVisibleTiles() const { return m_VisibleTiles; }
+		const TerrainTileStreamerStats& GetStats() const { return m_Stats; }
+		const TerrainTileStreamerDesc& GetDesc() const { return m_Desc; }
+
+		// Blocks until the generator threads went through every request, for tools and tests
+		void WaitForIdle();
+
+		// Lower is more urgent: the distance from the camera to the tile centre in tiles, up to twice as far behind the
+		// camera than in front of it
+		static float ComputeTilePriority(const TerrainTileCoord& coord, const TerrainTileView& view, float tileWorldSize);
+
+	private:
+		using Clock = std::chrono::high_resolution_clock;
+
+		struct Request
+		{
+			TerrainTileCoord coord;
+			uint32_t version = 0;
+			HeightfieldNoiseMaterialConstants constants;
+			Clock::time_point requestTime;
+		};
+
+		struct GeneratedTile
+		{
+			TerrainTileCoord coord;
+			uint32_t version = 0;
+			std::vector<uint16_t> heights;
+			TerrainScatterTile scatter;
+			double latencyInMilliseconds = 0.0;
+			double generationTimeInMilliseconds = 0.0;
+		};
+
+		// A tile whose new version was uploaded this frame, drawn from its previous slot until readyFrame
+		struct UploadInFlight
+		{
+			uint32_t previousSlot = TerrainTileCache::INVALID_SLOT;
+			uint64_t readyFrame = 0;
+		};
+
+		struct DesiredTile
+		{
+			TerrainTileCoord coord;
+			float priority = 0.0f;
+		};
+
+		void GeneratorThread();
+		void CollectGeneratedTiles();
+		void AddVisibleTile(const TerrainTileCoord& coord, uint32_t slot, uint64_t frameIndex);
+
+		TerrainTileStreamerDesc m_Desc;
+		TerrainTileGenerator m_Generator;
+		const TerrainScatter* m_Scatter = nullptr;
+		TerrainTileCache m_Cache;
+		TerrainTileVersions m_TileVersions;
+
+		// Owned by the thread calling Update
+		HeightfieldNoiseMaterialConstants m_NoiseConstants;
+		// Version the tile in each slot was generated with
+		std::vector<uint32_t> m_SlotVersions;
+		// Version of the latest request of each tile that is queued or being generated
+		std::unordered_map<TerrainTileCoord, uint32_t, TerrainTileCoordHash> m_PendingVersions;
+		std::unordered_map<TerrainTileCoord, GeneratedTile, TerrainTileCoordHash> m_ReadyTiles;
+		std::unordered_map<TerrainTileCoord, UploadInFlight, TerrainTileCoordHash> m_UploadsInFlight;
+		std::vector<DesiredTile> m_DesiredTiles;
+		std::vector<Request> m_NewRequests;
+		std::vector<Request> m_RequeueCandidates;
+		std::unordered_map<TerrainTileCoord, uint32_t, TerrainTileCoordHash> m_RequeueCandidateIndices;
+		std::vector<GeneratedTile> m_CompletedTiles;
+		std::vector<GeneratedTile> m_UploadedTiles;
+		std::vector<TerrainTileUpload> m_Uploads;
+		std::vector<TerrainTileDraw> m_VisibleTiles;
+		TerrainTileStreamerStats m_Stats;
+		double m_TotalGenerationLatencyInMilliseconds = 0.0;
+		double m_TotalGenerationTimeInMilliseconds = 0.0;
+
+		// Shared with the generator threads
+		std::mutex m_Mutex;
+		std::condition_variable m_WorkAvailable;
+		std::condition_variable m_WorkDone;
+		// Sorted by priority, the most urgent request is at the back
+		std::vector<Request> m_Queue;
+		std::vector<GeneratedTile> m_Generated;
+		uint32_t m_NumGenerating = 0;
+		bool m_IsStopping = false;
+		std::vector<std::thread> m_GeneratorThreads;
+	};
+}
@@ -0,0 +1,62 @@
+#include "TerrainTileVersions.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	int32_t FloorDivide(int32_t value, int32_t divisor)
+	{
+		const int32_t quotient = value / divisor;
+		return (value % divisor != 0 && value < 0) ? quotient - 1 : quotient;
+	}
+}
+
+namespace Styx
+{
+	TerrainTileVersions::TerrainTileVersions(uint32_t tileSize)
+		: m_TileSize(tileSize)
+	{
+		assert(tileSize > 0);
+	}
+
+	void TerrainTileVersions::MarkAllDirty()
+	{
+		m_Version++;
+		m_RequiredVersion = m_Version;
+		m_DirtyTileVersions.clear();
+	}
+
+	uint32_t TerrainTileVersions::MarkDirty(int32_t x, int32_t y, uint32_t width, uint32_t height)
+	{
+		if (width == 0 || height == 0)
+		{
+			return 0;
+		}
+
+		// Tiles share their edge texels, a texel on an edge belongs to the tiles on both sides
+		const int32_t tileSize = static_cast<int32_t>(m_TileSize);
+		const int32_t firstTileX = FloorDivide(x - 1, tileSize);
+		const int32_t firstTileY = FloorDivide(y - 1, tileSize);
+		const int32_t lastTileX = FloorDivide(x + static_cast<int32_t>(width) - 1, tileSize);
+		const int32_t lastTileY = FloorDivide(y + static_cast<int32_t>(height) - 1, tileSize);
+
+		m_Version++;
+
+		for (int32_t tileY = firstTileY; tileY <= lastTileY; tileY++)
+		{
+			for (int32_t tileX = firstTileX; tileX <= lastTileX; tileX++)
+			{
+				m_DirtyTileVersions[TerrainTileCoord{ tileX, tileY }] = m_Version;
+			}
+		}
+
+		return static_cast<uint32_t>((lastTileX - firstTileX + 1) * (lastTileY - firstTileY + 1));
+	}
+
+	uint32_t TerrainTileVersions::GetRequiredVersion(const TerrainTileCoord& coord) const
+	{
+		auto dirtyVersion = m_DirtyTileVersions.find(coord);
+		return dirtyVersion != m_DirtyTileVersions.end() ? (std::max)(dirtyVersion->second, m_RequiredVersion) : m_RequiredVersion;
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "TerrainTileCache.h"
+
+#include <stdint.h>
+#include <unordered_map>
+
+namespace Styx
+{
+	// NOTE: Change tracking of the procedural terrain, at tile granularity. Every change bumps a version: a change
+	// of the whole terrain, e.g. new noise constants, makes every tile generated before it outdated, a dirty region only
+	// the tiles it overlaps. A tile is then regenerated when the version it was generated with is older than its
+	// required version, and a frame without changes has nothing to regenerate. Only versions are compared, so tiles that
+	// are generated, queued or in flight can all be checked against the latest changes.
+	class TerrainTileVersions
+	{
+	public:
+		// Tile (x, y) covers the texels [x * tileSize, (x + 1) * tileSize] on both axes
+		explicit TerrainTileVersions(uint32_t tileSize);
+
+		// Outdates every tile
+		void MarkAllDirty();
+		// Outdates the tiles overlapping the texels [x, x + width) x [y, y + height). Returns the number of tiles.
+		uint32_t MarkDirty(int32_t x, int32_t y, uint32_t width, uint32_t height);
+
+		// Version to generate tiles with, up to date with every change so far
+		uint32_t GetVersion() const { return m_Version; }
+		uint32_t GetRequiredVersion(const TerrainTileCoord& coord) const;
+		bool IsOutdated(const TerrainTileCoord& coord, uint32_t version) const { return version < GetRequiredVersion(coord); }
+
+		// Tiles marked dirty since the last change of the whole terrain
+		uint32_t GetNumDirtyTiles() const { return static_cast<uint32_t>(m_DirtyTileVersions.size()); }
+
+	private:
+		uint32_t m_TileSize = 0;
+		uint32_t m_Version = 1;
+		// Tiles older than this are outdated, on top of the tiles marked dirty after it
+		uint32_t m_RequiredVersion = 1;
+		std::unordered_map<TerrainTileCoord, uint32_t, TerrainTileCoordHash> m_DirtyTileVersions;
+	};
+}
@@ -0,0 +1,194 @@
+#include "TestFramework.h"
+
+#include <Core/FramePipeline.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	struct TestPacket
+	{
+		uint64_t frame = 0;
+		uint64_t checksum = 0;
+		std::vector<uint32_t> payload;
+	};
+
+	uint64_t GetChecksum(const std::vector<uint32_t>& payload)
+	{
+		uint64_t checksum = 0;
+		for (uint32_t value : payload)
+		{
+			checksum = checksum * 31 + value;
+		}
+
+		return checksum;
+	}
+}
+
+// Every packet is rendered once, in order, and isn't touched by the update stage while the render stage reads it
+STYX_TEST(FramePipeline_PacketsAreHandedOffInOrder)
+{
+	constexpr uint64_t NUM_FRAMES = 2000;
+
+	FramePipeline<TestPacket> pipeline;
+	std::atomic<uint64_t> numRendered = 0;
+	std::atomic<uint32_t> numWrongPackets = 0;
+	std::atomic<uint32_t> numTooFarAhead = 0;
+
+	std::thread renderThread([&]()
+	{
+		uint64_t expectedFrame = 0;
+		while (const TestPacket* packet = pipeline.BeginRender())
+		{
+			const uint64_t checksum = packet->checksum;
+			if (packet->frame != expectedFrame || GetChecksum(packet->payload) != checksum)
+			{
+				numWrongPackets++;
+			}
+
+			// Give the update stage time to scribble over the packet, if it were going to
+			std::this_thread::yield();
+			if (packet->frame != expectedFrame || GetChecksum(packet->payload) != checksum)
+			{
+				numWrongPackets++;
+			}
+
+			expectedFrame++;
+			numRendered.store(expectedFrame, std::memory_order_release);
+			pipeline.EndRender();
+		}
+	});
+
+	for (uint64_t frame = 0; frame < NUM_FRAMES; frame++)
+	{
+		TestPacket& packet = pipeline.BeginUpdate();
+
+		// The update stage is at most one frame ahead: the packets before the previous one have all been rendered
+		if (frame >= FramePipeline<TestPacket>::NUM_PACKETS && numRendered.load(std::memory_order_acquire) < frame - 1)
+		{
+			numTooFarAhead++;
+		}
+
+		packet.frame = frame;
+		packet.payload.assign(64 + frame % 64, static_cast<uint32_t>(frame));
+		packet.checksum = GetChecksum(packet.payload);
+		pipeline.EndUpdate();
+	}
+
+	pipeline.Stop();
+	renderThread.join();
+
+	STYX_CHECK(numWrongPackets == 0);
+	STYX_CHECK(numTooFarAhead == 0);
+	STYX_CHECK(numRendered == NUM_FRAMES);
+	STYX_CHECK(pipeline.GetStats().numFrames == NUM_FRAMES);
+}
+
+STYX_TEST(FramePipeline_StopDrainsThePublishedPackets)
+{
+	FramePipeline<TestPacket> pipeline;
+
+	// Both packets published before the render stage even started
+	for (uint64_t frame = 0; frame < FramePipeline<TestPacket>::NUM_PACKETS; frame++)
+	{
+		pipeline.BeginUpdate().frame = frame;
+		pipeline.EndUpdate();
+	}
+
+	pipeline.Stop();
+
+	uint64_t expectedFrame = 0;
+	while (const TestPacket* packet = pipeline.BeginRender())
+	{
+		STYX_CHECK(packet->frame == expectedFrame);
+		expectedFrame++;
+		pipeline.EndRender();
+	}
+
+	STYX_CHECK(expectedFrame == FramePipeline<TestPacket>::NUM_PACKETS);
+
+	// Stopped and drained, the render stage doesn't block anymore
+	STYX_CHECK(pipeline.BeginRender() == nullptr);
+}
+
+STYX_TEST(FramePipeline_WaitForIdleWaitsForTheRenderStage)
+{
+	FramePipeline<TestPacket> pipeline;
+	std::atomic<bool> isRenderDone = false;
+
+	pipeline.BeginUpdate().frame = 7;
+	pipeline.EndUpdate();
+
+	std::thread renderThread([&]()
+	{
+		const TestPacket* packet = pipeline.BeginRender();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		isRenderDone = packet && packet->frame == 7;
+		pipeline.EndRender();
+	});
+
+	// e.g. the swapchain resize: nothing may be in flight on the render stage
+	pipeline.WaitForIdle();
+	STYX_CHECK(isRenderDone);
+
+	pipeline.Stop();
+	renderThread.join();
+}
+
+// Update and render stages that each take about the same time: pipelined, a frame costs one stage instead of both
+STYX_BENCHMARK(FramePipeline_Throughput)
+{
+	constexpr uint32_t NUM_FRAMES = 200;
+
+	const auto burn = [](std::chrono::microseconds duration)
+	{
+		const auto end = std::chrono::high_resolution_clock::now() + duration;
+		while (std::chrono::high_resolution_clock::now() < end)
+		{
+		}
+	};
+
+	for (uint32_t stageMicroseconds : { 0u, 500u, 2000u })
+	{
+		const std::chrono::microseconds stageTime(stageMicroseconds);
+
+		const double serialTime = MeasureMilliseconds([&]()
+		{
+			for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+			{
+				burn(stageTime);
+				burn(stageTime);
+			}
+		});
+
+		FramePipeline<TestPacket> pipeline;
+		const double pipelinedTime = MeasureMilliseconds([&]()
+		{
+			std::thread renderThread([&]()
+			{
+				while (pipeline.BeginRender())
+				{
+					burn(stageTime);
+					pipeline.EndRender();
+				}
+			});
+
+			for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+			{
+				pipeline.BeginUpdate().frame = frame;
+				burn(stageTime);
+				pipeline.EndUpdate();
+			}
+
+			pipeline.Stop();
+			renderThread.join();
+		});
+
+		printf("    %4u us per stage: serial %.3f ms per frame, pipelined %.3f ms per frame, %.3f ms average latency\n", stageMicroseconds,
+			serialTime / NUM_FRAMES, pipelinedTime / NUM_FRAMES, pipeline.GetStats().averageLatencyInMilliseconds);
+	}
+}
@@ -0,0 +1,365 @@
+#include "TestFramework.h"
+
+#include <Core/JobSystem.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	// Shuts the job system down however the test returns
+	struct ScopedJobSystem
+	{
+		ScopedJobSystem(uint32_t numWorkers, uint32_t numExternalThreads = 0)
+		{
+			JobSystemDesc desc;
+			desc.numWorkers = numWorkers;
+			desc.numExternalThreads = numExternalThreads;
+			JobSystem::Initialize(desc);
+		}
+
+		~ScopedJobSystem() { JobSystem::Shutdown(); }
+	};
+}
+
+// More jobs parked on a dependency than a thread has job slots: none of them may be overwritten before it ran
+STYX_TEST(JobSystem_ParkedJobsPastThePoolSize)
+{
+	ScopedJobSystem jobSystem(3);
+
+	constexpr uint32_t NUM_JOBS = JobSystem::MAX_JOBS_PER_THREAD + 904;
+
+	std::atomic<bool> isGateOpen = false;
+	JobCounter gate;
+	JobSystem::Run(gate, [&isGateOpen]()
+	{
+		while (!isGateOpen.load(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+	});
+
+	std::vector<std::atomic<uint32_t>> numRuns(NUM_JOBS);
+	JobCounter counter;
+	for (uint32_t jobIndex = 0; jobIndex < NUM_JOBS; jobIndex++)
+	{
+		std::atomic<uint32_t>* jobRuns = &numRuns[jobIndex];
+		JobSystem::RunAfter(gate, counter, [jobRuns]() { jobRuns->fetch_add(1, std::memory_order_relaxed); });
+	}
+
+	STYX_CHECK(!counter.IsDone());
+
+	isGateOpen.store(true, std::memory_order_release);
+	JobSystem::Wait(counter);
+
+	// Released all at once, the continuations overflow the deque of the thread completing the gate as well
+	uint32_t numWrongRuns = 0;
+	for (const std::atomic<uint32_t>& jobRuns : numRuns)
+	{
+		numWrongRuns += jobRuns.load() != 1 ? 1 : 0;
+	}
+
+	STYX_CHECK(numWrongRuns == 0);
+	STYX_CHECK(gate.IsDone());
+}
+
+STYX_TEST(JobSystem_SpawnBurstsPastTheDequeCapacity)
+{
+	ScopedJobSystem jobSystem(2);
+
+	for (uint32_t round = 0; round < 4; round++)
+	{
+		constexpr uint32_t NUM_JOBS = 3 * JobSystem::MAX_JOBS_PER_THREAD;
+		std::atomic<uint32_t> numRuns = 0;
+		std::atomic<uint32_t> numNestedRuns = 0;
+
+		JobCounter counter;
+		for (uint32_t jobIndex = 0; jobIndex < NUM_JOBS; jobIndex++)
+		{
+			JobSystem::Run(counter, [&numRuns, &numNestedRuns, &counter, jobIndex]()
+			{
+				numRuns.fetch_add(1, std::memory_order_relaxed);
+
+				// Jobs spawning jobs on the same counter
+				if (jobIndex % 16 == 0)
+				{
+					JobSystem::Run(counter, [&numNestedRuns]() { numNestedRuns.fetch_add(1, std::memory_order_relaxed); });
+				}
+			});
+		}
+
+		JobSystem::Wait(counter);
+		STYX_CHECK(numRuns == NUM_JOBS);
+		STYX_CHECK(numNestedRuns == NUM_JOBS / 16);
+	}
+}
+
+// Random chains of dependencies: every job runs exactly once, and only after the job it depends on
+STYX_TEST(JobSystem_DependencyChainsRunInOrder)
+{
+	ScopedJobSystem jobSystem(3);
+
+	constexpr uint32_t NUM_CHAINS = 64;
+	constexpr uint32_t CHAIN_LENGTH = 100;
+
+	std::mt19937 random(39);
+	for (uint32_t round = 0; round < 5; round++)
+	{
+		std::vector<std::unique_ptr<JobCounter>> counters(NUM_CHAINS * CHAIN_LENGTH);
+		std::vector<std::atomic<uint32_t>> steps(NUM_CHAINS);
+		std::atomic<uint32_t> numOutOfOrder = 0;
+
+		for (std::unique_ptr<JobCounter>& counter : counters)
+		{
+			counter = std::make_unique<JobCounter>();
+		}
+
+		// Chains are built in a shuffled order, so some links are spawned after the link they depend on has run
+		std::vector<uint32_t> order;
+		for (uint32_t step = 0; step < CHAIN_LENGTH; step++)
+		{
+			for (uint32_t chain = 0; chain < NUM_CHAINS; chain++)
+			{
+				order.push_back(step * NUM_CHAINS + chain);
+			}
+
+			std::shuffle(order.end() - NUM_CHAINS, order.end(), random);
+		}
+
+		for (uint32_t link : order)
+		{
+			const uint32_t chain = link % NUM_CHAINS;
+			const uint32_t step = link / NUM_CHAINS;
+			std::atomic<uint32_t>* chainStep = &steps[chain];
+			std::atomic<uint32_t>* outOfOrder = &numOutOfOrder;
+
+			const auto runStep = [chainStep, outOfOrder, step]()
+			{
+				if (chainStep->fetch_add(1, std::memory_order_relaxed) != step)
+				{
+					outOfOrder->fetch_add(1, std::memory_order_relaxed);
+				}
+			};
+
+			if (step == 0)
+			{
+				JobSystem::Run(*counters[link], runStep);
+			}
+			else
+			{
+				JobSystem::RunAfter(*counters[link - NUM_CHAINS], *counters[link], runStep);
+			}
+		}
+
+		for (std::unique_ptr<JobCounter>& counter : counters)
+		{
+			JobSystem::Wait(*counter);
+		}
+
+		STYX_CHECK(numOutOfOrder == 0);
+		for (const std::atomic<uint32_t>& chainStep : steps)
+		{
+			STYX_CHECK(chainStep.load() == CHAIN_LENGTH);
+		}
+	}
+}
+
+STYX_TEST(JobSystem_ParallelForCoversEveryIndexOnce)
+{
+	ScopedJobSystem jobSystem(3);
+
+	for (uint32_t count : { 0u, 1u, 7u, 1000u, 100003u })
+	{
+		for (uint32_t minGrainSize : { 0u, 1u, 64u, 5000u })
+		{
+			std::vector<std::atomic<uint8_t>> numVisits(count);
+			JobSystem::ParallelFor(count, minGrainSize, [&numVisits](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t index = begin; index < end; index++)
+				{
+					numVisits[index].fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+
+			uint32_t numWrongVisits = 0;
+			for (const std::atomic<uint8_t>& visits : numVisits)
+			{
+				numWrongVisits += visits.load() != 1 ? 1 : 0;
+			}
+
+			STYX_CHECK(numWrongVisits == 0);
+		}
+	}
+}
+
+// A thread the job system doesn't know about, e.g. the render thread, runs the loop itself
+STYX_TEST(JobSystem_ParallelForOffJobThreadsRunsSerially)
+{
+	ScopedJobSystem jobSystem(3);
+
+	std::vector<uint32_t> values(50000, 0);
+	bool stayedOnThread = true;
+
+	std::thread renderThread([&values, &stayedOnThread]()
+	{
+		const std::thread::id threadId = std::this_thread::get_id();
+		JobSystem::ParallelFor(static_cast<uint32_t>(values.size()), 1, [&](uint32_t begin, uint32_t end)
+		{
+			stayedOnThread = stayedOnThread && std::this_thread::get_id() == threadId;
+			for (uint32_t index = begin; index < end; index++)
+			{
+				values[index] = index;
+			}
+		});
+	});
+
+	renderThread.join();
+
+	STYX_CHECK(stayedOnThread);
+	for (uint32_t index = 0; index < values.size(); index += 997)
+	{
+		STYX_CHECK(values[index] == index);
+	}
+}
+
+// Once registered, the same thread hands ranges out to the workers
+STYX_TEST(JobSystem_RegisteredThreadsSpreadParallelFor)
+{
+	ScopedJobSystem jobSystem(3, 1);
+
+	std::atomic<bool> ranElsewhere = false;
+	bool isRegistered = false;
+	bool waitedTooLong = false;
+
+	std::thread renderThread([&]()
+	{
+		isRegistered = JobSystem::RegisterThread();
+		if (!isRegistered)
+		{
+			return;
+		}
+
+		const std::thread::id threadId = std::this_thread::get_id();
+		JobSystem::ParallelFor(64, 1, [&](uint32_t, uint32_t)
+		{
+			if (std::this_thread::get_id() != threadId)
+			{
+				ranElsewhere.store(true, std::memory_order_release);
+				return;
+			}
+
+			// The ranges this thread pushed are only run elsewhere if a worker steals them
+			const auto start = std::chrono::steady_clock::now();
+			while (!ranElsewhere.load(std::memory_order_acquire) && !waitedTooLong)
+			{
+				waitedTooLong = std::chrono::steady_clock::now() - start > std::chrono::seconds(10);
+				std::this_thread::yield();
+			}
+		});
+
+		JobSystem::UnregisterThread();
+	});
+
+	renderThread.join();
+
+	STYX_CHECK(isRegistered);
+	STYX_CHECK(ranElsewhere.load());
+	STYX_CHECK(!waitedTooLong);
+}
+
+STYX_TEST(JobSystem_RegisterFailsOnceTheSlotsAreTaken)
+{
+	ScopedJobSystem jobSystem(1, 1);
+
+	bool isFirstRegistered = false;
+	bool isSecondRegistered = true;
+	uint32_t secondThreadIndex = 0;
+	bool isThirdRegistered = false;
+
+	std::thread firstThread([&]()
+	{
+		isFirstRegistered = JobSystem::RegisterThread();
+
+		std::thread secondThread([&]()
+		{
+			isSecondRegistered = JobSystem::RegisterThread();
+			secondThreadIndex = JobSystem::GetThreadIndex();
+		});
+
+		secondThread.join();
+
+		if (isFirstRegistered)
+		{
+			JobSystem::UnregisterThread();
+		}
+	});
+
+	firstThread.join();
+
+	// The slot is free again
+	std::thread thirdThread([&]()
+	{
+		isThirdRegistered = JobSystem::RegisterThread();
+		if (isThirdRegistered)
+		{
+			JobSystem::UnregisterThread();
+		}
+	});
+
+	thirdThread.join();
+
+	STYX_CHECK(isFirstRegistered);
+	STYX_CHECK(!isSecondRegistered);
+	STYX_CHECK(secondThreadIndex == JobSystem::INVALID_THREAD_INDEX);
+	STYX_CHECK(isThirdRegistered);
+}
+
+STYX_BENCHMARK(JobSystem_SpawnAndParallelForOverhead)
+{
+	constexpr uint32_t NUM_JOBS = 200000;
+	constexpr uint32_t NUM_ITEMS = 1 << 22;
+
+	std::vector<float> items(NUM_ITEMS, 1.0f);
+
+	for (uint32_t numWorkers : { 1u, 3u, 7u })
+	{
+		ScopedJobSystem jobSystem(numWorkers);
+
+		// Empty jobs, so this is all scheduling: allocation, push, steal and completion
+		std::atomic<uint32_t> numRuns = 0;
+		const double spawnTime = MeasureMilliseconds([&]()
+		{
+			JobCounter counter;
+			for (uint32_t jobIndex = 0; jobIndex < NUM_JOBS; jobIndex++)
+			{
+				JobSystem::Run(counter, [&numRuns]() { numRuns.fetch_add(1, std::memory_order_relaxed); });
+			}
+
+			JobSystem::Wait(counter);
+		});
+
+		double bestLoopTime = 1e9;
+		for (uint32_t iteration = 0; iteration < 5; iteration++)
+		{
+			bestLoopTime = (std::min)(bestLoopTime, MeasureMilliseconds([&]()
+			{
+				JobSystem::ParallelFor(NUM_ITEMS, 1024, [&items](uint32_t begin, uint32_t end)
+				{
+					for (uint32_t index = begin; index < end; index++)
+					{
+						items[index] = items[index] * 0.999f + 0.001f;
+					}
+				});
+			}));
+		}
+
+		const JobSystemStats stats = JobSystem::GetStats();
+		printf("    %u threads: %.0f jobs/ms, ParallelFor over %u items in %.2f ms, %.1f%% of jobs stolen\n", JobSystem::GetNumThreads(),
+			NUM_JOBS / spawnTime, NUM_ITEMS, bestLoopTime, 100.0 * stats.numJobsStolen / (std::max)(stats.numJobsExecuted, uint64_t(1)));
+	}
+}
@@ -0,0 +1,133 @@
+#include "TestFramework.h"
+
+#include <RHI/CommandStream.h>
+
+#include <algorithm>
+#include <string>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	// Stands in for GraphicsContext: logs every packet it is asked to execute
+	struct MockStreamTarget
+	{
+		void Execute(const SetPipelinePacket& packet) { Log("setPipeline " + std::to_string(reinterpret_cast<uintptr_t>(packet.mPipeline))); }
+		void Execute(const SetPipelineResourcesPacket& packet) { Log("setPipelineResources " + std::to_string(packet.mSpaceId)); }
+		void Execute(const SetPipelineConstantsPacket& packet) { Log("setPipelineConstants " + std::to_string(packet.mGPUAddress)); }
+		void Execute(const SetRootConstantPacket& packet) { Log("setRootConstant " + std::to_string(packet.mValue) + "@" + std::to_string(packet.mOffset)); }
+		void Execute(const SetIndexBufferPacket&) { Log("setIndexBuffer"); }
+		void Execute(const SetPrimitiveTopologyPacket& packet) { Log("setPrimitiveTopology " + std::to_string(packet.mTopology)); }
+		void Execute(const DrawInstancedPacket& packet) { Log("drawInstanced " + std::to_string(packet.mVertexCountPerInstance)); }
+		void Execute(const DrawIndexedInstancedPacket& packet) { Log("drawIndexedInstanced " + std::to_string(packet.mIndexCountPerInstance) + "," + std::to_string(packet.mStartInstanceLocation)); }
+		void Execute(const ExecuteIndirectPacket& packet) { Log("executeIndirect " + std::to_string(packet.mArgumentOffset) + "x" + std::to_string(packet.mNumCommands)); }
+		void Execute(const DispatchPacket& packet) { Log("dispatch " + std::to_string(packet.mGroupCountX) + "," + std::to_string(packet.mGroupCountY) + "," + std::to_string(packet.mGroupCountZ)); }
+
+		void Log(std::string&& entry) { log.push_back(std::move(entry)); }
+
+		std::vector<std::string> log;
+	};
+
+	// Does as little as possible per packet, so the benchmark measures the stream itself
+	struct ChecksumStreamTarget
+	{
+		template<typename Packet>
+		void Execute(const Packet&) { numPackets++; }
+		void Execute(const SetRootConstantPacket& packet) { checksum += packet.mValue; numPackets++; }
+		void Execute(const DrawIndexedInstancedPacket& packet) { checksum += packet.mStartIndexLocation; numPackets++; }
+
+		uint64_t checksum = 0;
+		uint32_t numPackets = 0;
+	};
+
+	void RecordEveryPacketType(CommandStream& stream)
+	{
+		stream.Record(SetPipelinePacket{ reinterpret_cast<PipelineStateObject*>(0x40) });
+		stream.Record(SetPipelineResourcesPacket{ 2, nullptr });
+
+		SetPipelineConstantsPacket constants;
+		constants.mGPUAddress = 0x123456789ull;
+		stream.Record(constants);
+
+		stream.Record(SetRootConstantPacket{ 7, 1 });
+		stream.Record(SetPrimitiveTopologyPacket{ 4 });
+		stream.Record(SetIndexBufferPacket{});
+		stream.Record(DrawIndexedInstancedPacket{ 36, 1, 0, 0, 9 });
+		stream.Record(DrawInstancedPacket{ 3, 1, 0, 0 });
+		stream.Record(ExecuteIndirectPacket{ nullptr, nullptr, 4096, 12 });
+		stream.Record(DispatchPacket{ 1, 2, 3 });
+	}
+}
+
+STYX_TEST(CommandStream_ReplaysEveryPacketInOrder)
+{
+	CommandStream stream;
+	RecordEveryPacketType(stream);
+	STYX_CHECK(stream.GetNumPackets() == 10);
+	STYX_CHECK(stream.GetSizeInBytes() % CommandStream::PACKET_ALIGNMENT == 0);
+
+	const std::vector<std::string> expected =
+	{
+		"setPipeline 64", "setPipelineResources 2", "setPipelineConstants 4886718345", "setRootConstant 7@1", "setPrimitiveTopology 4",
+		"setIndexBuffer", "drawIndexedInstanced 36,9", "drawInstanced 3", "executeIndirect 4096x12", "dispatch 1,2,3"
+	};
+
+	// A cached stream replays the same way every time
+	for (uint32_t replay = 0; replay < 2; replay++)
+	{
+		MockStreamTarget target;
+		stream.Replay(target);
+		STYX_CHECK(target.log == expected);
+	}
+}
+
+STYX_TEST(CommandStream_AppendStitchesStreams)
+{
+	CommandStream object;
+	RecordEveryPacketType(object);
+
+	CommandStream frame;
+	frame.Append(object);
+	frame.Append(object);
+	STYX_CHECK(frame.GetNumPackets() == 20);
+	STYX_CHECK(frame.GetSizeInBytes() == 2 * object.GetSizeInBytes());
+
+	MockStreamTarget target;
+	frame.Replay(target);
+	STYX_REQUIRE(target.log.size() == 20);
+	STYX_CHECK(target.log[0] == target.log[10] && target.log[9] == target.log[19]);
+
+	frame.Clear();
+	STYX_CHECK(frame.IsEmpty() && frame.GetSizeInBytes() == 0);
+
+	MockStreamTarget emptyTarget;
+	frame.Replay(emptyTarget);
+	STYX_CHECK(emptyTarget.log.empty());
+}
+
+STYX_BENCHMARK(CommandStream_RecordAndReplay)
+{
+	constexpr uint32_t NUM_DRAWS = 500000;
+
+	CommandStream stream;
+	const double recordTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t draw = 0; draw < NUM_DRAWS; draw++)
+		{
+			stream.Record(SetRootConstantPacket{ draw, 0 });
+			stream.Record(DrawIndexedInstancedPacket{ 36, 1, draw, 0, 0 });
+		}
+	});
+
+	ChecksumStreamTarget target;
+	double bestReplayTime = 1e9;
+	for (uint32_t iteration = 0; iteration < 10; iteration++)
+	{
+		bestReplayTime = (std::min)(bestReplayTime, MeasureMilliseconds([&]() { stream.Replay(target); }));
+	}
+
+	const double numPackets = 2.0 * NUM_DRAWS;
+	printf("    record %.1f M packets/s, replay %.1f M packets/s, %.1f bytes per packet (checksum %llu)\n", numPackets / recordTime / 1000.0,
+		numPackets / bestReplayTime / 1000.0, stream.GetSizeInBytes() / numPackets, static_cast<unsigned long long>(target.checksum));
+}
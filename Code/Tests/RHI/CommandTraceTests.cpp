@@ -0,0 +1,100 @@
+#include "TestFramework.h"
+
+#include <RHI/CommandTrace.h>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+STYX_TEST(CommandTrace_PacketsDecodeInRecordingOrder)
+{
+	CommandTrace first;
+	first.Write(TraceOpcode::setPipeline, { 7 });
+	first.Write(TraceOpcode::drawIndexedInstanced, { 36, 1, 0, 0, 0 });
+	first.Write(TraceOpcode::setBlendFactor, {});
+	STYX_CHECK(first.GetNumPackets() == 3);
+	STYX_CHECK(first.GetSizeInBytes() == sizeof(uint32_t) * (2 + 6 + 1));
+
+	CommandTrace second;
+	const uint32_t barrierWords[] = { 1, 2, 3 };
+	second.Write(TraceOpcode::barriers, barrierWords, 3);
+	second.Write(TraceOpcode::setViewport, { TraceFloat(1.0f), TraceLow(0x100000002ull), TraceHigh(0x100000002ull) });
+
+	// Parallel contexts are merged in submission order
+	CommandTrace frame;
+	frame.Append(first);
+	frame.Append(second);
+	STYX_CHECK(frame.GetNumPackets() == 5);
+	STYX_CHECK(frame.GetNumPackets(TraceOpcode::barriers) == 1 && frame.GetNumPackets(TraceOpcode::setPipeline) == 1);
+
+	const TraceOpcode expectedOpcodes[] = { TraceOpcode::setPipeline, TraceOpcode::drawIndexedInstanced, TraceOpcode::setBlendFactor, TraceOpcode::barriers, TraceOpcode::setViewport };
+	const uint32_t expectedNumWords[] = { 1, 5, 0, 3, 3 };
+	uint32_t packetIndex = 0;
+
+	frame.ForEachPacket([&](TraceOpcode opcode, const uint32_t* words, uint32_t numWords)
+	{
+		STYX_REQUIRE(packetIndex < 5);
+		STYX_CHECK(opcode == expectedOpcodes[packetIndex] && numWords == expectedNumWords[packetIndex]);
+
+		if (opcode == TraceOpcode::setViewport)
+		{
+			STYX_CHECK(words[0] == 0x3f800000 && words[1] == 2 && words[2] == 1);
+		}
+
+		packetIndex++;
+	});
+
+	STYX_CHECK(packetIndex == 5);
+}
+
+STYX_TEST(CommandTrace_HashIdentifiesTheFrame)
+{
+	CommandTrace a;
+	CommandTrace b;
+	for (CommandTrace* trace : { &a, &b })
+	{
+		trace->Write(TraceOpcode::setPipeline, { 3 });
+		trace->Write(TraceOpcode::dispatch, { 8, 8, 1 });
+	}
+
+	STYX_CHECK(a.GetHash() == b.GetHash());
+
+	// Same packets with swapped arguments must not collide
+	CommandTrace swapped;
+	swapped.Write(TraceOpcode::setPipeline, { 3 });
+	swapped.Write(TraceOpcode::dispatch, { 8, 1, 8 });
+	STYX_CHECK(swapped.GetHash() != a.GetHash());
+
+	b.Write(TraceOpcode::dispatch, { 1, 1, 1 });
+	STYX_CHECK(a.GetHash() != b.GetHash());
+
+	b.Clear();
+	STYX_CHECK(b.GetNumPackets() == 0 && b.GetSizeInBytes() == 0 && b.GetNumPackets(TraceOpcode::dispatch) == 0);
+	STYX_CHECK(b.GetHash() == CommandTrace().GetHash());
+}
+
+STYX_BENCHMARK(CommandTrace_RecordingOverhead)
+{
+	constexpr uint32_t NUM_FRAMES = 20;
+	constexpr uint32_t NUM_DRAWS = 100000;
+
+	CommandTrace trace;
+	const double recordTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+		{
+			trace.Clear();
+			for (uint32_t draw = 0; draw < NUM_DRAWS; draw++)
+			{
+				trace.Write(TraceOpcode::setRoot32BitConstants, { 2, 0, draw });
+				trace.Write(TraceOpcode::drawIndexedInstanced, { 36, 1, draw, 0, 0 });
+			}
+		}
+	});
+
+	uint64_t hash = 0;
+	const double hashTime = MeasureMilliseconds([&]() { hash = trace.GetHash(); });
+
+	const double numPackets = 2.0 * NUM_DRAWS * NUM_FRAMES;
+	printf("    %.1f M packets/s, %.1f MB per frame of %u draws, hashed in %.2f ms (%016llx)\n", numPackets / recordTime / 1000.0,
+		trace.GetSizeInBytes() / (1024.0 * 1024.0), NUM_DRAWS, hashTime, static_cast<unsigned long long>(hash));
+}
@@ -0,0 +1,257 @@
+#include "TestFramework.h"
+
+#include <RHI/DeferredReleaseQueue.h>
+
+#include <memory>
+#include <random>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	struct TestRelease
+	{
+		uint32_t id = 0;
+	};
+
+	QueueFenceClock MakeFences(uint64_t graphics, uint64_t compute, uint64_t copy)
+	{
+		QueueFenceClock fences{};
+		fences[static_cast<uint32_t>(QueueType::graphics)] = graphics;
+		fences[static_cast<uint32_t>(QueueType::compute)] = compute;
+		fences[static_cast<uint32_t>(QueueType::copy)] = copy;
+		return fences;
+	}
+}
+
+STYX_TEST(DeferredReleaseQueue_CopyOnlyReleasesDontWaitOnGraphics)
+{
+	DeferredReleaseQueue<TestRelease> queue;
+	std::vector<uint32_t> released;
+	auto release = [&](TestRelease& item) { released.push_back(item.id); };
+
+	// A staging buffer only the copy queue touched, and a texture the graphics queue sampled
+	queue.Push({ 1 }, MakeFences(0, 0, 5), 64);
+	queue.Push({ 2 }, MakeFences(10, 0, 5), 128);
+	STYX_CHECK(queue.GetPendingBytes() == 192);
+
+	STYX_CHECK(queue.Sweep(MakeFences(3, 0, 5), release) == 1);
+	STYX_REQUIRE(released.size() == 1);
+	STYX_CHECK(released[0] == 1);
+	STYX_CHECK(queue.GetPendingBytes() == 128);
+
+	STYX_CHECK(queue.Sweep(MakeFences(9, 0, 100), release) == 0);
+	STYX_CHECK(queue.Sweep(MakeFences(10, 0, 100), release) == 1);
+	STYX_CHECK(queue.GetNumPending() == 0 && queue.GetPendingBytes() == 0);
+	STYX_CHECK(queue.GetPeakPendingBytes() == 192);
+}
+
+STYX_TEST(DeferredReleaseQueue_SurvivorsKeepReleaseOrder)
+{
+	DeferredReleaseQueue<TestRelease> queue;
+	for (uint32_t id = 0; id < 8; id++)
+	{
+		queue.Push({ id }, MakeFences(id % 2 == 0 ? 1 : 2, 0, 0), 1);
+	}
+
+	std::vector<uint32_t> released;
+	auto release = [&](TestRelease& item) { released.push_back(item.id); };
+
+	queue.Sweep(MakeFences(1, 0, 0), release);
+	STYX_CHECK((released == std::vector<uint32_t>{ 0, 2, 4, 6 }));
+
+	released.clear();
+	queue.Flush(release);
+	STYX_CHECK((released == std::vector<uint32_t>{ 1, 3, 5, 7 }));
+}
+
+// FIFO completion only moves the head around the ring, a blocked entry makes it grow with the pending set in order,
+// and reclaimed slots don't keep their items alive until they get reused.
+STYX_TEST(DeferredReleaseQueue_RingWrapsAndGrowsInReleaseOrder)
+{
+	DeferredReleaseQueue<std::shared_ptr<uint32_t>> queue;
+	std::vector<std::weak_ptr<uint32_t>> items;
+	std::vector<uint32_t> released;
+	auto release = [&](std::shared_ptr<uint32_t>& item) { released.push_back(*item); };
+
+	auto push = [&](uint64_t graphicsFence)
+	{
+		std::shared_ptr<uint32_t> item = std::make_shared<uint32_t>(static_cast<uint32_t>(items.size()));
+		items.push_back(item);
+		queue.Push(std::move(item), MakeFences(graphicsFence, 0, 0), 1);
+	};
+
+	// Several laps of a small pending set, reclaimed oldest first
+	for (uint64_t frame = 1; frame <= 1000; frame++)
+	{
+		push(frame);
+		queue.Sweep(MakeFences(frame > 3 ? frame - 3 : 0, 0, 0), release);
+		STYX_CHECK(queue.GetNumPending() == (std::min)(frame, uint64_t(3)));
+	}
+
+	STYX_REQUIRE(released.size() == 997);
+	for (uint32_t id = 0; id < released.size(); id++)
+	{
+		STYX_CHECK(released[id] == id);
+	}
+
+	// Nothing released is kept alive by the ring
+	for (uint32_t id = 0; id < released.size(); id++)
+	{
+		STYX_CHECK(items[id].expired());
+	}
+
+	// One entry waits on a late fence while hundreds of others pile up and complete around it
+	released.clear();
+	queue.Flush(release);
+	push(5000);
+	for (uint64_t id = 0; id < 500; id++)
+	{
+		push(id % 2 == 0 ? 2000 : 3000);
+	}
+
+	queue.Sweep(MakeFences(2000, 0, 0), release);
+	STYX_CHECK(queue.GetNumPending() == 251);
+
+	released.clear();
+	queue.Flush(release);
+	STYX_REQUIRE(released.size() == 251);
+	STYX_CHECK(released[0] == 1000);
+	for (uint32_t index = 1; index < released.size(); index++)
+	{
+		STYX_CHECK(released[index] == 1000 + 2 * index);
+	}
+
+	for (const std::weak_ptr<uint32_t>& item : items)
+	{
+		STYX_CHECK(item.expired());
+	}
+}
+
+STYX_TEST(DeferredReleaseQueue_RandomFencesReleaseExactlyOnceAndNeverEarly)
+{
+	std::mt19937 random(31);
+	DeferredReleaseQueue<TestRelease> queue;
+
+	QueueFenceClock submittedFences{};
+	QueueFenceClock completedFences{};
+	std::vector<QueueFenceClock> releaseFences;
+	std::vector<uint8_t> isReleased;
+	uint32_t numEarly = 0;
+	uint32_t numTwice = 0;
+
+	auto release = [&](TestRelease& item)
+	{
+		for (uint32_t queueIndex = 0; queueIndex < NUM_QUEUE_TYPES; queueIndex++)
+		{
+			numEarly += releaseFences[item.id][queueIndex] > completedFences[queueIndex] ? 1 : 0;
+		}
+
+		numTwice += isReleased[item.id] != 0 ? 1 : 0;
+		isReleased[item.id] = 1;
+	};
+
+	for (uint32_t step = 0; step < 20000; step++)
+	{
+		// Every queue advances on its own, with the GPU a random distance behind
+		const uint32_t queueIndex = random() % NUM_QUEUE_TYPES;
+		submittedFences[queueIndex]++;
+		completedFences[queueIndex] = (std::min)(submittedFences[queueIndex], completedFences[queueIndex] + random() % 4);
+
+		// Releases depend on a random subset of the queues
+		QueueFenceClock fences{};
+		for (uint32_t otherQueueIndex = 0; otherQueueIndex < NUM_QUEUE_TYPES; otherQueueIndex++)
+		{
+			fences[otherQueueIndex] = random() % 2 == 0 ? submittedFences[otherQueueIndex] : 0;
+		}
+
+		const uint32_t id = static_cast<uint32_t>(releaseFences.size());
+		releaseFences.push_back(fences);
+		isReleased.push_back(0);
+		queue.Push({ id }, fences, 1);
+
+		queue.Sweep(completedFences, release);
+	}
+
+	STYX_CHECK(numEarly == 0 && numTwice == 0);
+
+	// Whatever is still pending is pending for a reason
+	for (uint32_t id = 0; id < releaseFences.size(); id++)
+	{
+		if (isReleased[id] == 0)
+		{
+			bool isBlocked = false;
+			for (uint32_t queueIndex = 0; queueIndex < NUM_QUEUE_TYPES; queueIndex++)
+			{
+				isBlocked = isBlocked || releaseFences[id][queueIndex] > completedFences[queueIndex];
+			}
+
+			STYX_CHECK(isBlocked);
+		}
+	}
+
+	queue.Flush(release);
+	for (uint8_t released : isReleased)
+	{
+		STYX_CHECK(released == 1);
+	}
+
+	STYX_CHECK(numTwice == 0);
+}
+
+// Simulates heavy tile streaming: every frame the copy queue replaces a few staging buffers and textures while the
+// graphics queue lags a couple of frames behind, and reports how much memory waits for the GPU compared to the old
+// per-frame-slot scheme that only reclaimed after all queues finished the frame.
+STYX_BENCHMARK(DeferredReleaseQueue_StreamingHighWaterMark)
+{
+	constexpr uint32_t NUM_FRAMES = 100000;
+	constexpr uint32_t NUM_FRAMES_IN_FLIGHT = 3;
+	constexpr uint64_t STAGING_SIZE = 512 * 1024;
+	constexpr uint64_t TEXTURE_SIZE = 2 * 1024 * 1024;
+
+	std::mt19937 random(31);
+	DeferredReleaseQueue<TestRelease> queue;
+	uint64_t frameSlotPendingBytes[NUM_FRAMES_IN_FLIGHT] = {};
+	uint64_t frameSlotPeakBytes = 0;
+	uint32_t numReleased = 0;
+
+	const double timeInMilliseconds = MeasureMilliseconds([&]()
+	{
+		for (uint64_t frame = 1; frame <= NUM_FRAMES; frame++)
+		{
+			const uint32_t frameSlot = frame % NUM_FRAMES_IN_FLIGHT;
+			frameSlotPendingBytes[frameSlot] = 0;
+
+			// The copy queue finishes within the frame, graphics completes NUM_FRAMES_IN_FLIGHT - 1 frames later
+			const QueueFenceClock completedFences = MakeFences(frame > NUM_FRAMES_IN_FLIGHT - 1 ? frame - (NUM_FRAMES_IN_FLIGHT - 1) : 0, 0, frame - 1);
+			numReleased += queue.Sweep(completedFences, [](TestRelease&) {});
+
+			const uint32_t numStaging = random() % 8;
+			for (uint32_t staging = 0; staging < numStaging; staging++)
+			{
+				queue.Push({}, MakeFences(0, 0, frame), STAGING_SIZE);
+				frameSlotPendingBytes[frameSlot] += STAGING_SIZE;
+			}
+
+			const uint32_t numTextures = random() % 3;
+			for (uint32_t texture = 0; texture < numTextures; texture++)
+			{
+				queue.Push({}, MakeFences(frame, 0, frame), TEXTURE_SIZE);
+				frameSlotPendingBytes[frameSlot] += TEXTURE_SIZE;
+			}
+
+			uint64_t frameSlotBytes = 0;
+			for (uint64_t bytes : frameSlotPendingBytes)
+			{
+				frameSlotBytes += bytes;
+			}
+
+			frameSlotPeakBytes = (std::max)(frameSlotPeakBytes, frameSlotBytes);
+		}
+	});
+
+	printf("    %u frames, %u releases in %.2f ms (%.0f ns per release)\n", NUM_FRAMES, numReleased, timeInMilliseconds, timeInMilliseconds * 1e6 / numReleased);
+	printf("    high-water mark: %.1f MB per-queue fences, %.1f MB per-frame slots\n",
+		queue.GetPeakPendingBytes() / (1024.0 * 1024.0), frameSlotPeakBytes / (1024.0 * 1024.0));
+}
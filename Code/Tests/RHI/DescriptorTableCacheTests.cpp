@@ -0,0 +1,176 @@
+#include "TestFramework.h"
+
+#include <RHI/D3D12Lite.h>
+
+#include <random>
+#include <vector>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	// Staging handles are only compared and hashed here, never dereferenced
+	D3D12_CPU_DESCRIPTOR_HANDLE MakeHandle(SIZE_T id)
+	{
+		return D3D12_CPU_DESCRIPTOR_HANDLE{ id * 32 };
+	}
+
+	D3D12_GPU_DESCRIPTOR_HANDLE MakeTable(UINT64 id)
+	{
+		return D3D12_GPU_DESCRIPTOR_HANDLE{ 0x100000000ull + id * 32 };
+	}
+
+	bool Find(const DescriptorTableCache& cache, const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& handles, D3D12_GPU_DESCRIPTOR_HANDLE& outTable)
+	{
+		return cache.Find(handles.data(), static_cast<uint32_t>(handles.size()), outTable);
+	}
+
+	void Insert(DescriptorTableCache& cache, const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& handles, D3D12_GPU_DESCRIPTOR_HANDLE table)
+	{
+		cache.Insert(handles.data(), static_cast<uint32_t>(handles.size()), table);
+	}
+
+	uint64_t Hash(const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& handles)
+	{
+		return DescriptorTableCache::HashHandles(handles.data(), static_cast<uint32_t>(handles.size()));
+	}
+
+	// Solves for the last handle of a two handle set hashing to the same value as target. The hash is FNV-1a over the
+	// handle addresses: once the first handle is mixed in, xoring the second one in is the only step left before the
+	// final (invertible) multiply, so it can be picked to land on the state target has at the same point.
+	D3D12_CPU_DESCRIPTOR_HANDLE MakeCollidingHandle(const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& target, D3D12_CPU_DESCRIPTOR_HANDLE firstHandle)
+	{
+		constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+		// The inverse of the prime modulo 2^64, by Newton iterations
+		uint64_t inversePrime = FNV_PRIME;
+		for (uint32_t iteration = 0; iteration < 6; iteration++)
+		{
+			inversePrime *= 2 - FNV_PRIME * inversePrime;
+		}
+
+		const uint64_t targetState = Hash(target) * inversePrime;
+		const uint64_t firstState = Hash({ firstHandle });
+		return D3D12_CPU_DESCRIPTOR_HANDLE{ static_cast<SIZE_T>(targetState ^ firstState) };
+	}
+}
+
+STYX_TEST(DescriptorTableCache_HitsOnlyTheSameHandles)
+{
+	DescriptorTableCache cache;
+	const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> handles = { MakeHandle(1), MakeHandle(2), MakeHandle(3) };
+
+	D3D12_GPU_DESCRIPTOR_HANDLE table{ 0 };
+	STYX_CHECK(!Find(cache, handles, table));
+
+	Insert(cache, handles, MakeTable(7));
+	STYX_CHECK(Find(cache, handles, table) && table.ptr == MakeTable(7).ptr);
+
+	// A prefix, a longer set, another order and another handle are all different tables
+	STYX_CHECK(!Find(cache, { MakeHandle(1), MakeHandle(2) }, table));
+	STYX_CHECK(!Find(cache, { MakeHandle(1), MakeHandle(2), MakeHandle(3), MakeHandle(4) }, table));
+	STYX_CHECK(!Find(cache, { MakeHandle(3), MakeHandle(2), MakeHandle(1) }, table));
+	STYX_CHECK(!Find(cache, { MakeHandle(1), MakeHandle(2), MakeHandle(5) }, table));
+
+	// Tables of the previous frame live in its heap
+	cache.Clear();
+	STYX_CHECK(!Find(cache, handles, table));
+}
+
+STYX_TEST(DescriptorTableCache_EveryHandleCountGetsItsOwnTable)
+{
+	DescriptorTableCache cache;
+
+	std::vector<std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>> tables;
+	for (uint32_t numHandles = 1; numHandles <= DescriptorTableCache::MAX_TABLE_HANDLES; numHandles++)
+	{
+		std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> handles;
+		for (uint32_t handleIndex = 0; handleIndex < numHandles; handleIndex++)
+		{
+			handles.push_back(MakeHandle(handleIndex + 1));
+		}
+
+		Insert(cache, handles, MakeTable(numHandles));
+		tables.push_back(handles);
+	}
+
+	for (const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& handles : tables)
+	{
+		D3D12_GPU_DESCRIPTOR_HANDLE table{ 0 };
+		STYX_CHECK(Find(cache, handles, table) && table.ptr == MakeTable(handles.size()).ptr);
+	}
+}
+
+// Only one table is kept per hash, the newest one. The other one misses and gets copied again.
+STYX_TEST(DescriptorTableCache_CollisionsOverwriteTheOlderTable)
+{
+	DescriptorTableCache cache;
+	D3D12_GPU_DESCRIPTOR_HANDLE table{ 0 };
+
+	const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> first = { MakeHandle(10), MakeHandle(11) };
+	const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> second = { MakeHandle(20), MakeCollidingHandle(first, MakeHandle(20)) };
+	STYX_REQUIRE(Hash(first) == Hash(second));
+
+	Insert(cache, first, MakeTable(1));
+	STYX_CHECK(!Find(cache, second, table));
+
+	Insert(cache, second, MakeTable(2));
+	STYX_CHECK(Find(cache, second, table) && table.ptr == MakeTable(2).ptr);
+	STYX_CHECK(!Find(cache, first, table));
+
+	Insert(cache, first, MakeTable(3));
+	STYX_CHECK(Find(cache, first, table) && table.ptr == MakeTable(3).ptr);
+	STYX_CHECK(!Find(cache, second, table));
+
+	// Colliding sets of different sizes are told apart by their handle count
+	const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> single = { MakeHandle(30) };
+	const std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> pair = { MakeHandle(40), MakeCollidingHandle(single, MakeHandle(40)) };
+	STYX_REQUIRE(Hash(single) == Hash(pair));
+
+	Insert(cache, pair, MakeTable(4));
+	STYX_CHECK(!Find(cache, single, table));
+
+	Insert(cache, single, MakeTable(5));
+	STYX_CHECK(Find(cache, single, table) && table.ptr == MakeTable(5).ptr);
+	STYX_CHECK(!Find(cache, pair, table));
+}
+
+STYX_BENCHMARK(DescriptorTableCache_Lookups)
+{
+	constexpr uint32_t NUM_TABLES = 512;
+	constexpr uint32_t NUM_LOOKUPS = 1000000;
+
+	// Material-like spaces of 2 to 8 textures out of a few hundred, bound over and over during a frame
+	std::mt19937 random(5);
+	std::vector<std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>> tables(NUM_TABLES);
+	for (std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>& handles : tables)
+	{
+		handles.resize(2 + random() % 7);
+		for (D3D12_CPU_DESCRIPTOR_HANDLE& handle : handles)
+		{
+			handle = MakeHandle(random() % 400);
+		}
+	}
+
+	DescriptorTableCache cache;
+	const double insertTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t tableIndex = 0; tableIndex < NUM_TABLES; tableIndex++)
+		{
+			Insert(cache, tables[tableIndex], MakeTable(tableIndex));
+		}
+	});
+
+	uint32_t numHits = 0;
+	const double lookupTime = MeasureMilliseconds([&]()
+	{
+		D3D12_GPU_DESCRIPTOR_HANDLE table{ 0 };
+		for (uint32_t lookup = 0; lookup < NUM_LOOKUPS; lookup++)
+		{
+			numHits += Find(cache, tables[lookup % NUM_TABLES], table) ? 1 : 0;
+		}
+	});
+
+	printf("    %u tables: %.1f ns per insert, %.1f ns per lookup, %u of %u hits\n", NUM_TABLES, insertTime * 1e6 / NUM_TABLES, lookupTime * 1e6 / NUM_LOOKUPS, numHits, NUM_LOOKUPS);
+}
@@ -0,0 +1,275 @@
+#include "TestFramework.h"
+
+#include <RHI/IndexAllocators.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	struct Block
+	{
+		uint32_t index;
+		uint32_t count;
+	};
+
+	template<typename F>
+	void RunOnThreads(uint32_t numThreads, F&& function)
+	{
+		std::vector<std::thread> threads;
+		for (uint32_t threadIndex = 0; threadIndex < numThreads; threadIndex++)
+		{
+			threads.emplace_back(function, threadIndex);
+		}
+
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	// What the staging heaps did before: a mutex around a vector free list
+	class LockedFreeIndexList
+	{
+	public:
+		void Push(uint32_t index)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_FreeIndices.push_back(index);
+		}
+
+		bool Pop(uint32_t& outIndex)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (m_FreeIndices.empty())
+			{
+				return false;
+			}
+
+			outIndex = m_FreeIndices.back();
+			m_FreeIndices.pop_back();
+			return true;
+		}
+
+	private:
+		std::mutex m_Mutex;
+		std::vector<uint32_t> m_FreeIndices;
+	};
+}
+
+STYX_TEST(AtomicLinearIndexAllocator_FailedAllocationsLeaveTheCounterAlone)
+{
+	AtomicLinearIndexAllocator allocator;
+	allocator.Reset(100, 110);
+
+	uint32_t index = 0;
+	STYX_CHECK(allocator.Allocate(6, index) && index == 100);
+	STYX_CHECK(!allocator.Allocate(6, index));
+	STYX_CHECK(allocator.GetNumAllocated() == 6);
+
+	// What is left still fits a smaller block
+	STYX_CHECK(allocator.Allocate(4, index) && index == 106);
+	STYX_CHECK(allocator.GetNumAllocated() == allocator.GetCapacity());
+
+	for (uint32_t attempt = 0; attempt < 1000; attempt++)
+	{
+		STYX_CHECK(!allocator.Allocate(1, index));
+	}
+
+	STYX_CHECK(allocator.GetNumAllocated() == 10);
+
+	allocator.Reset(100, 110);
+	STYX_CHECK(allocator.GetNumAllocated() == 0);
+	STYX_CHECK(allocator.Allocate(10, index) && index == 100);
+}
+
+STYX_TEST(AtomicLinearIndexAllocator_ConcurrentBlocksAreDisjoint)
+{
+	constexpr uint32_t CAPACITY = 65536;
+
+	for (uint32_t numThreads : { 2u, 8u, 32u })
+	{
+		AtomicLinearIndexAllocator allocator;
+		allocator.Reset(0, CAPACITY);
+
+		std::vector<std::vector<Block>> threadBlocks(numThreads);
+		RunOnThreads(numThreads, [&](uint32_t threadIndex)
+		{
+			uint32_t seed = threadIndex * 2654435761u + 1;
+			uint32_t index = 0;
+
+			// Keeps going well past exhaustion, failed attempts must not disturb the others
+			for (uint32_t attempt = 0; attempt < 4096; attempt++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const uint32_t count = 1 + (seed >> 24) % 16;
+				if (allocator.Allocate(count, index))
+				{
+					threadBlocks[threadIndex].push_back({ index, count });
+				}
+			}
+		});
+
+		std::vector<Block> blocks;
+		for (const std::vector<Block>& threadBlock : threadBlocks)
+		{
+			blocks.insert(blocks.end(), threadBlock.begin(), threadBlock.end());
+		}
+
+		std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) { return a.index < b.index; });
+
+		uint32_t numAllocated = 0;
+		uint32_t end = 0;
+		for (const Block& block : blocks)
+		{
+			STYX_CHECK(block.index >= end);
+			STYX_CHECK(block.index + block.count <= CAPACITY);
+			end = block.index + block.count;
+			numAllocated += block.count;
+		}
+
+		// Blocks are handed out back to back, so they tile the range without gaps
+		STYX_CHECK(numAllocated == end);
+		STYX_CHECK(allocator.GetNumAllocated() == numAllocated);
+		STYX_CHECK(CAPACITY - numAllocated < 16);
+	}
+}
+
+STYX_TEST(AtomicFreeIndexList_ConcurrentChurnLosesNothing)
+{
+	constexpr uint32_t CAPACITY = 4096;
+	constexpr uint32_t NUM_THREADS = 16;
+
+	AtomicFreeIndexList freeList(CAPACITY);
+	for (uint32_t index = 0; index < CAPACITY; index++)
+	{
+		freeList.Push(index);
+	}
+
+	// Every thread holds a handful of indices at a time, any index owned twice is caught by the flags
+	std::vector<std::atomic<uint8_t>> isOwned(CAPACITY);
+	std::atomic<uint32_t> numDoubleOwned = 0;
+
+	RunOnThreads(NUM_THREADS, [&](uint32_t threadIndex)
+	{
+		std::vector<uint32_t> held;
+		uint32_t seed = threadIndex + 1;
+
+		for (uint32_t iteration = 0; iteration < 20000; iteration++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			uint32_t index = 0;
+
+			if ((seed >> 28) < 9 && held.size() < 32 && freeList.Pop(index))
+			{
+				if (isOwned[index].exchange(1) != 0)
+				{
+					numDoubleOwned++;
+				}
+
+				held.push_back(index);
+			}
+			else if (!held.empty())
+			{
+				index = held.back();
+				held.pop_back();
+				isOwned[index].store(0);
+				freeList.Push(index);
+			}
+		}
+
+		for (uint32_t index : held)
+		{
+			isOwned[index].store(0);
+			freeList.Push(index);
+		}
+	});
+
+	STYX_CHECK(numDoubleOwned == 0);
+
+	// Every index made it back
+	std::vector<uint8_t> isFree(CAPACITY, 0);
+	uint32_t index = 0;
+	uint32_t numFree = 0;
+	while (freeList.Pop(index))
+	{
+		STYX_CHECK(index < CAPACITY && isFree[index] == 0);
+		isFree[index] = 1;
+		numFree++;
+	}
+
+	STYX_CHECK(numFree == CAPACITY);
+}
+
+STYX_BENCHMARK(DescriptorAllocators_Contention)
+{
+	constexpr uint32_t NUM_OPERATIONS_PER_THREAD = 200000;
+
+	printf("    threads | linear block ns/op | lock-free pop+push ns/op | locked pop+push ns/op\n");
+
+	for (uint32_t numThreads : { 1u, 2u, 4u, 8u, 16u, 32u })
+	{
+		// Render-pass heap: every SetPipelineResources grabs a block, the heap is reset per frame
+		AtomicLinearIndexAllocator linearAllocator;
+		linearAllocator.Reset(0, UINT32_MAX);
+		const double linearTime = MeasureMilliseconds([&]()
+		{
+			RunOnThreads(numThreads, [&](uint32_t)
+			{
+				uint32_t index = 0;
+				for (uint32_t operation = 0; operation < NUM_OPERATIONS_PER_THREAD; operation++)
+				{
+					linearAllocator.Allocate(8, index);
+				}
+			});
+		});
+
+		// Staging heap: descriptors created and destroyed while streaming
+		AtomicFreeIndexList freeList(numThreads * 64);
+		LockedFreeIndexList lockedFreeList;
+		for (uint32_t index = 0; index < numThreads * 64; index++)
+		{
+			freeList.Push(index);
+			lockedFreeList.Push(index);
+		}
+
+		const double freeListTime = MeasureMilliseconds([&]()
+		{
+			RunOnThreads(numThreads, [&](uint32_t)
+			{
+				uint32_t index = 0;
+				for (uint32_t operation = 0; operation < NUM_OPERATIONS_PER_THREAD; operation++)
+				{
+					if (freeList.Pop(index))
+					{
+						freeList.Push(index);
+					}
+				}
+			});
+		});
+
+		const double lockedTime = MeasureMilliseconds([&]()
+		{
+			RunOnThreads(numThreads, [&](uint32_t)
+			{
+				uint32_t index = 0;
+				for (uint32_t operation = 0; operation < NUM_OPERATIONS_PER_THREAD; operation++)
+				{
+					if (lockedFreeList.Pop(index))
+					{
+						lockedFreeList.Push(index);
+					}
+				}
+			});
+		});
+
+		const double numOperations = static_cast<double>(numThreads) * NUM_OPERATIONS_PER_THREAD;
+		printf("    %7u | %18.1f | %24.1f | %21.1f\n", numThreads, linearTime * 1e6 / numOperations, freeListTime * 1e6 / numOperations, lockedTime * 1e6 / numOperations);
+	}
+}
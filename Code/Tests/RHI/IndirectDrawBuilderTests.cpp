@@ -0,0 +1,175 @@
+#include "TestFramework.h"
+
+#include <RHI/IndirectDrawBuilder.h>
+
+#include <cstddef>
+#include <cstring>
+#include <random>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	// Headless copy of the draw streams a DrawList hands to the builder
+	struct TestDraws
+	{
+		std::vector<uint32_t> bucketKeys;
+		std::vector<uint32_t> indexCounts;
+		std::vector<uint32_t> startIndices;
+		std::vector<uint64_t> indexBufferAddresses;
+		std::vector<uint32_t> indexBufferSizes;
+
+		TestDraws(uint32_t numDraws, uint32_t numBuckets, uint32_t seed)
+		{
+			std::mt19937 random(seed);
+			for (uint32_t draw = 0; draw < numDraws; draw++)
+			{
+				bucketKeys.push_back(random() % numBuckets);
+				indexCounts.push_back(3 * (1 + random() % 1000));
+				startIndices.push_back(random() % 100000);
+				indexBufferAddresses.push_back(0x100000000ull + 0x10000ull * (random() % 64));
+				indexBufferSizes.push_back(4 * (random() % 65536));
+			}
+		}
+
+		IndirectDrawSource GetSource() const
+		{
+			IndirectDrawSource source;
+			source.mBucketKeys = bucketKeys.data();
+			source.mIndexCounts = indexCounts.data();
+			source.mStartIndices = startIndices.data();
+			source.mIndexBufferAddresses = indexBufferAddresses.data();
+			source.mIndexBufferSizes = indexBufferSizes.data();
+			source.mIndexBufferFormat = 42;
+			return source;
+		}
+	};
+}
+
+// What the GPU reads: the root constant, D3D12_INDEX_BUFFER_VIEW and D3D12_DRAW_INDEXED_ARGUMENTS back to back
+STYX_TEST(IndirectDrawBuilder_CommandLayoutMatchesTheArgumentStream)
+{
+	constexpr size_t ROOT_CONSTANT_SIZE = 4;
+	constexpr size_t INDEX_BUFFER_VIEW_SIZE = 16;
+	constexpr size_t DRAW_INDEXED_ARGUMENTS_SIZE = 20;
+
+	STYX_CHECK(offsetof(IndirectDrawIndexedCommand, mIndexBufferAddress) == ROOT_CONSTANT_SIZE);
+	STYX_CHECK(offsetof(IndirectDrawIndexedCommand, mIndexCountPerInstance) == ROOT_CONSTANT_SIZE + INDEX_BUFFER_VIEW_SIZE);
+	STYX_CHECK(sizeof(IndirectDrawIndexedCommand) == ROOT_CONSTANT_SIZE + INDEX_BUFFER_VIEW_SIZE + DRAW_INDEXED_ARGUMENTS_SIZE);
+
+	TestDraws draws(1, 1, 34);
+	IndirectDrawBuilder builder;
+	const uint32_t drawIds[] = { 0 };
+	alignas(8) uint8_t commandBytes[2 * sizeof(IndirectDrawIndexedCommand)];
+	memset(commandBytes, 0xcd, sizeof(commandBytes));
+	builder.Build(draws.GetSource(), drawIds, 1, reinterpret_cast<IndirectDrawIndexedCommand*>(commandBytes));
+
+	// Read back the way the command processor does, as a stream of dwords
+	uint32_t dwords[10];
+	memcpy(dwords, commandBytes, sizeof(dwords));
+	STYX_CHECK(dwords[0] == 0);
+	STYX_CHECK(dwords[1] == static_cast<uint32_t>(draws.indexBufferAddresses[0]));
+	STYX_CHECK(dwords[2] == static_cast<uint32_t>(draws.indexBufferAddresses[0] >> 32));
+	STYX_CHECK(dwords[3] == draws.indexBufferSizes[0]);
+	STYX_CHECK(dwords[4] == 42);
+	STYX_CHECK(dwords[5] == draws.indexCounts[0]);
+	STYX_CHECK(dwords[6] == 1);
+	STYX_CHECK(dwords[7] == draws.startIndices[0]);
+	STYX_CHECK(dwords[8] == 0 && dwords[9] == 0);
+
+	// Only the first command was written
+	for (size_t byte = sizeof(IndirectDrawIndexedCommand); byte < sizeof(commandBytes); byte++)
+	{
+		STYX_CHECK(commandBytes[byte] == 0xcd);
+	}
+}
+
+STYX_TEST(IndirectDrawBuilder_BucketsFollowSortedKeys)
+{
+	TestDraws draws(5000, 17, 34);
+	const IndirectDrawSource source = draws.GetSource();
+
+	// Every other draw is visible
+	std::vector<uint32_t> drawIds;
+	for (uint32_t drawId = 0; drawId < draws.bucketKeys.size(); drawId += 2)
+	{
+		drawIds.push_back(drawId);
+	}
+
+	IndirectDrawBuilder::SortByBucket(source, drawIds);
+
+	std::vector<IndirectDrawIndexedCommand> commands(drawIds.size());
+	IndirectDrawBuilder builder;
+	builder.Build(source, drawIds.data(), static_cast<uint32_t>(drawIds.size()), commands.data());
+
+	uint32_t nextCommand = 0;
+	for (const IndirectDrawBucket& bucket : builder.GetBuckets())
+	{
+		STYX_CHECK(bucket.mFirstCommand == nextCommand);
+		STYX_CHECK(bucket.mNumCommands > 0);
+
+		for (uint32_t commandIndex = bucket.mFirstCommand; commandIndex < bucket.mFirstCommand + bucket.mNumCommands; commandIndex++)
+		{
+			const IndirectDrawIndexedCommand& command = commands[commandIndex];
+			const uint32_t drawId = command.mDrawId;
+
+			STYX_CHECK(drawId == drawIds[commandIndex]);
+			STYX_CHECK(draws.bucketKeys[drawId] == bucket.mBucketKey);
+			STYX_CHECK(command.mIndexBufferAddress == draws.indexBufferAddresses[drawId]);
+			STYX_CHECK(command.mIndexBufferSize == draws.indexBufferSizes[drawId]);
+			STYX_CHECK(command.mIndexCountPerInstance == draws.indexCounts[drawId]);
+			STYX_CHECK(command.mStartIndexLocation == draws.startIndices[drawId]);
+
+			// The sort is stable, draws keep their submission order inside a bucket
+			if (commandIndex > bucket.mFirstCommand)
+			{
+				STYX_CHECK(commands[commandIndex - 1].mDrawId < drawId);
+			}
+		}
+
+		nextCommand += bucket.mNumCommands;
+	}
+
+	STYX_CHECK(nextCommand == drawIds.size());
+	STYX_CHECK(builder.GetBuckets().size() == 17);
+}
+
+STYX_BENCHMARK(IndirectDrawBuilder_BuildCommands)
+{
+	constexpr uint32_t NUM_DRAWS = 100000;
+	constexpr uint32_t NUM_REPEATS = 100;
+
+	TestDraws draws(NUM_DRAWS, 32, 34);
+	const IndirectDrawSource source = draws.GetSource();
+
+	std::vector<uint32_t> drawIds(NUM_DRAWS);
+	for (uint32_t drawId = 0; drawId < NUM_DRAWS; drawId++)
+	{
+		drawIds[drawId] = drawId;
+	}
+
+	std::vector<uint32_t> sortedDrawIds;
+	const double sortTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t repeat = 0; repeat < NUM_REPEATS; repeat++)
+		{
+			sortedDrawIds = drawIds;
+			IndirectDrawBuilder::SortByBucket(source, sortedDrawIds);
+		}
+	});
+
+	std::vector<IndirectDrawIndexedCommand> commands(NUM_DRAWS);
+	IndirectDrawBuilder builder;
+	const double buildTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t repeat = 0; repeat < NUM_REPEATS; repeat++)
+		{
+			builder.Build(source, sortedDrawIds.data(), NUM_DRAWS, commands.data());
+		}
+	});
+
+	const double numCommands = static_cast<double>(NUM_DRAWS) * NUM_REPEATS;
+	printf("    sort %.0f draws/ms, build %.0f commands/ms, %u buckets, %.1f MB of arguments per frame\n", numCommands / sortTime, numCommands / buildTime,
+		static_cast<uint32_t>(builder.GetBuckets().size()), NUM_DRAWS * sizeof(IndirectDrawIndexedCommand) / (1024.0 * 1024.0));
+}
@@ -0,0 +1,125 @@
+#include "TestFramework.h"
+
+#include <RHI/LinearAllocator.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	constexpr uint64_t CONSTANT_ALIGNMENT = 256;
+
+	struct Slice
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+}
+
+STYX_TEST(LinearAllocator_AlignsAndExhausts)
+{
+	LinearAllocator allocator;
+	allocator.Reset(1024, 2048);
+
+	STYX_CHECK(allocator.Allocate(4, CONSTANT_ALIGNMENT) == 1024);
+	STYX_CHECK(allocator.Allocate(200, CONSTANT_ALIGNMENT) == 1280);
+	STYX_CHECK(allocator.Allocate(256, CONSTANT_ALIGNMENT) == 1536);
+	STYX_CHECK(allocator.GetNumAllocatedBytes() == 768);
+
+	// Doesn't fit, and must not move the allocator, so a smaller slice still does
+	STYX_CHECK(allocator.Allocate(512, CONSTANT_ALIGNMENT) == LinearAllocator::INVALID_OFFSET);
+	STYX_CHECK(allocator.GetNumAllocatedBytes() == 768);
+	STYX_CHECK(allocator.Allocate(256, CONSTANT_ALIGNMENT) == 1792);
+	STYX_CHECK(allocator.Allocate(1, CONSTANT_ALIGNMENT) == LinearAllocator::INVALID_OFFSET);
+	STYX_CHECK(allocator.GetNumAllocatedBytes() == allocator.GetCapacity());
+
+	// Frame retired, the range is reused and the peak is kept
+	allocator.Reset(1024, 2048);
+	STYX_CHECK(allocator.GetNumAllocatedBytes() == 0);
+	STYX_CHECK(allocator.GetPeakAllocatedBytes() == 1024);
+	STYX_CHECK(allocator.Allocate(64, CONSTANT_ALIGNMENT) == 1024);
+}
+
+STYX_TEST(LinearAllocator_ConcurrentSlicesAreDisjointAndAligned)
+{
+	constexpr uint32_t NUM_THREADS = 8;
+	constexpr uint64_t CAPACITY = 4 * 1024 * 1024;
+
+	LinearAllocator allocator;
+	allocator.Reset(0, CAPACITY);
+
+	std::vector<std::vector<Slice>> threadSlices(NUM_THREADS);
+	std::vector<std::thread> threads;
+	for (uint32_t threadIndex = 0; threadIndex < NUM_THREADS; threadIndex++)
+	{
+		threads.emplace_back([&, threadIndex]()
+		{
+			uint32_t seed = threadIndex + 1;
+
+			// Runs well past exhaustion
+			for (uint32_t allocation = 0; allocation < 4096; allocation++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const uint64_t size = 16 + (seed >> 20) % 1024;
+				const uint64_t offset = allocator.Allocate(size, CONSTANT_ALIGNMENT);
+				if (offset != LinearAllocator::INVALID_OFFSET)
+				{
+					threadSlices[threadIndex].push_back({ offset, size });
+				}
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<Slice> slices;
+	for (const std::vector<Slice>& threadSlice : threadSlices)
+	{
+		slices.insert(slices.end(), threadSlice.begin(), threadSlice.end());
+	}
+
+	std::sort(slices.begin(), slices.end(), [](const Slice& a, const Slice& b) { return a.offset < b.offset; });
+
+	uint64_t end = 0;
+	for (const Slice& slice : slices)
+	{
+		STYX_CHECK(slice.offset % CONSTANT_ALIGNMENT == 0);
+		STYX_CHECK(slice.offset >= end);
+		STYX_CHECK(slice.offset + slice.size <= CAPACITY);
+		end = slice.offset + slice.size;
+	}
+
+	STYX_CHECK(allocator.GetNumAllocatedBytes() <= CAPACITY);
+	STYX_CHECK(allocator.GetPeakAllocatedBytes() == allocator.GetNumAllocatedBytes());
+}
+
+STYX_BENCHMARK(LinearAllocator_PerDrawConstants)
+{
+	constexpr uint32_t NUM_FRAMES = 1000;
+	constexpr uint32_t NUM_DRAWS = 10000;
+
+	LinearAllocator allocator;
+	uint64_t checksum = 0;
+
+	const double timeInMilliseconds = MeasureMilliseconds([&]()
+	{
+		for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+		{
+			allocator.Reset(0, NUM_DRAWS * CONSTANT_ALIGNMENT);
+			for (uint32_t draw = 0; draw < NUM_DRAWS; draw++)
+			{
+				checksum += allocator.Allocate(112, CONSTANT_ALIGNMENT);
+			}
+		}
+	});
+
+	printf("    %u frames of %u draws, %.2f ns per allocation (checksum %llu)\n", NUM_FRAMES, NUM_DRAWS,
+		timeInMilliseconds * 1e6 / (static_cast<double>(NUM_FRAMES) * NUM_DRAWS), static_cast<unsigned long long>(checksum));
+}
@@ -0,0 +1,199 @@
+#include "TestFramework.h"
+
+#include <RHI/ParallelRecording.h>
+
+#include <atomic>
+#include <cmath>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	struct MockState
+	{
+		uint32_t pipeline = 0;
+		uint32_t rootConstant = 0;
+	};
+
+	// Records the calls it receives instead of filling a command list
+	class MockContext
+	{
+	public:
+		enum class Call
+		{
+			reset,
+			inheritState,
+			draw
+		};
+
+		void Reset()
+		{
+			m_Calls.clear();
+			m_Calls.push_back({ Call::reset, 0 });
+			m_State = MockState{};
+		}
+
+		void InheritState(const MockState& state)
+		{
+			m_State = state;
+			m_Calls.push_back({ Call::inheritState, state.pipeline });
+		}
+
+		void Draw(uint32_t drawIndex)
+		{
+			m_Calls.push_back({ Call::draw, drawIndex });
+		}
+
+		const MockState& GetState() const { return m_State; }
+		const std::vector<std::pair<Call, uint32_t>>& GetCalls() const { return m_Calls; }
+
+	private:
+		MockState m_State;
+		std::vector<std::pair<Call, uint32_t>> m_Calls;
+	};
+
+	ContextPool<MockContext>::Factory GetMockFactory(uint32_t* numCreated)
+	{
+		return [numCreated]()
+		{
+			(*numCreated)++;
+			return std::make_unique<MockContext>();
+		};
+	}
+}
+
+STYX_TEST(ParallelRecording_ChunksCoverTheItemsInOrder)
+{
+	std::vector<RecordChunk> chunks;
+
+	for (uint32_t numItems : { 0u, 1u, 5u, 255u, 256u, 1000u, 4099u })
+	{
+		for (uint32_t maxChunks : { 1u, 2u, 3u, 8u })
+		{
+			SplitIntoChunks(numItems, maxChunks, 256, chunks);
+			STYX_CHECK(chunks.size() <= maxChunks);
+			STYX_CHECK(numItems > 0 || chunks.empty());
+
+			uint32_t nextItem = 0;
+			for (const RecordChunk& chunk : chunks)
+			{
+				STYX_CHECK(chunk.mFirstItem == nextItem && chunk.mNumItems > 0);
+				STYX_CHECK(numItems < 256 || chunk.mNumItems >= 256);
+				STYX_CHECK(chunk.mNumItems + 1 >= chunks[0].mNumItems && chunk.mNumItems <= chunks[0].mNumItems);
+				nextItem += chunk.mNumItems;
+			}
+
+			STYX_CHECK(nextItem == numItems);
+		}
+	}
+}
+
+STYX_TEST(ParallelRecording_ContextsInheritStateAndKeepDrawOrder)
+{
+	uint32_t numCreated = 0;
+	ContextPool<MockContext> contextPool(GetMockFactory(&numCreated));
+	ParallelRecorder<MockContext, MockState> recorder(contextPool, 4, 16);
+	const MockState state{ 7, 42 };
+
+	for (uint32_t frame = 0; frame < 3; frame++)
+	{
+		contextPool.Rewind();
+
+		std::atomic<uint32_t> numWrongStates = 0;
+		recorder.Record(state, 1000, [&](MockContext& context, uint32_t firstItem, uint32_t numItems)
+		{
+			if (context.GetState().pipeline != 7 || context.GetState().rootConstant != 42)
+			{
+				numWrongStates++;
+			}
+
+			for (uint32_t item = firstItem; item < firstItem + numItems; item++)
+			{
+				context.Draw(item);
+			}
+		});
+
+		STYX_CHECK(numWrongStates == 0);
+
+		// Submitting the contexts in the order they are returned replays the draws in item order
+		uint32_t expectedItem = 0;
+		for (MockContext* context : recorder.GetRecordedContexts())
+		{
+			const auto& calls = context->GetCalls();
+			STYX_REQUIRE(calls.size() >= 2);
+			STYX_CHECK(calls[0].first == MockContext::Call::reset);
+			STYX_CHECK(calls[1].first == MockContext::Call::inheritState);
+
+			for (size_t callIndex = 2; callIndex < calls.size(); callIndex++)
+			{
+				STYX_CHECK(calls[callIndex].first == MockContext::Call::draw && calls[callIndex].second == expectedItem);
+				expectedItem++;
+			}
+		}
+
+		STYX_CHECK(expectedItem == 1000);
+		STYX_CHECK(recorder.GetStats().mNumChunks == 4 && recorder.GetStats().mNumThreads == 4);
+	}
+
+	// Contexts are reused across frames once the pool is rewound
+	STYX_CHECK(numCreated == 4);
+	STYX_CHECK(contextPool.GetNumContexts() == 4);
+}
+
+STYX_TEST(ParallelRecording_SmallPassesStayOnTheCallingThread)
+{
+	uint32_t numCreated = 0;
+	ContextPool<MockContext> contextPool(GetMockFactory(&numCreated));
+	ParallelRecorder<MockContext, MockState> recorder(contextPool, 8, 256);
+
+	const std::thread::id callingThread = std::this_thread::get_id();
+	bool isOnCallingThread = false;
+	recorder.Record(MockState{}, 100, [&](MockContext&, uint32_t, uint32_t)
+	{
+		isOnCallingThread = std::this_thread::get_id() == callingThread;
+	});
+
+	STYX_CHECK(isOnCallingThread);
+	STYX_CHECK(recorder.GetStats().mNumThreads == 1);
+
+	recorder.Record(MockState{}, 0, [&](MockContext&, uint32_t, uint32_t) { STYX_CHECK(false); });
+	STYX_CHECK(recorder.GetRecordedContexts().empty() && recorder.GetStats().mNumThreads == 0);
+}
+
+// Each draw burns a fixed amount of CPU, standing in for validation and command list writes
+STYX_BENCHMARK(ParallelRecording_RecordScaling)
+{
+	constexpr uint32_t NUM_DRAWS = 200000;
+	const MockState state{ 1, 0 };
+
+	for (uint32_t maxThreads : { 1u, 2u, 4u, 8u })
+	{
+		uint32_t numCreated = 0;
+		ContextPool<MockContext> contextPool(GetMockFactory(&numCreated));
+		ParallelRecorder<MockContext, MockState> recorder(contextPool, maxThreads, 256);
+
+		double bestTime = 1e9;
+		for (uint32_t iteration = 0; iteration < 5; iteration++)
+		{
+			contextPool.Rewind();
+			recorder.Record(state, NUM_DRAWS, [](MockContext& context, uint32_t firstItem, uint32_t numItems)
+			{
+				for (uint32_t item = firstItem; item < firstItem + numItems; item++)
+				{
+					volatile float work = 0.0f;
+					for (uint32_t step = 0; step < 50; step++)
+					{
+						work = work + std::sqrt(static_cast<float>(item + step));
+					}
+
+					context.Draw(item);
+				}
+			});
+
+			bestTime = (std::min)(bestTime, recorder.GetStats().mRecordTimeInMilliseconds);
+		}
+
+		printf("    %u threads: %.2f ms, %.0f draws/ms\n", recorder.GetStats().mNumThreads, bestTime, NUM_DRAWS / bestTime);
+	}
+}
@@ -0,0 +1,281 @@
+#include "TestFramework.h"
+
+#include <RHI/QueueScheduler.h>
+
+#include <random>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	// Hands out fence values per queue like the device does and keeps the happens-before clock of every submission,
+	// built only from the waits the scheduler emitted
+	struct SimulatedQueues
+	{
+		uint64_t Submit(QueueScheduler& scheduler, QueueType queue, const QueueDependencies& dependencies, std::vector<QueueWait>& outWaits)
+		{
+			const uint32_t queueIndex = static_cast<uint32_t>(queue);
+			const uint64_t fenceValue = ++nextFenceValues[queueIndex];
+
+			outWaits.clear();
+			scheduler.ScheduleSubmission(queue, fenceValue, dependencies, outWaits);
+
+			QueueFenceClock clock = lastClocks[queueIndex];
+			for (const QueueWait& wait : outWaits)
+			{
+				const QueueFenceClock& signalClock = clocks[static_cast<uint32_t>(wait.mSignalingQueue)][wait.mFenceValue];
+				for (uint32_t otherQueueIndex = 0; otherQueueIndex < NUM_QUEUE_TYPES; otherQueueIndex++)
+				{
+					clock[otherQueueIndex] = (std::max)(clock[otherQueueIndex], signalClock[otherQueueIndex]);
+				}
+			}
+
+			clock[queueIndex] = fenceValue;
+			clocks[queueIndex][fenceValue] = clock;
+			lastClocks[queueIndex] = clock;
+			return fenceValue;
+		}
+
+		// Whether the GPU can only start the later submission once the earlier one is done
+		bool HappensBefore(QueueFence earlier, QueueFence later) const
+		{
+			return clocks[static_cast<uint32_t>(later.mQueue)].at(later.mFenceValue)[static_cast<uint32_t>(earlier.mQueue)] >= earlier.mFenceValue;
+		}
+
+		QueueFenceClock nextFenceValues{};
+		std::array<QueueFenceClock, NUM_QUEUE_TYPES> lastClocks{};
+		std::array<std::unordered_map<uint64_t, QueueFenceClock>, NUM_QUEUE_TYPES> clocks;
+	};
+}
+
+STYX_TEST(QueueScheduler_WaitsOnceForAsyncComputeResults)
+{
+	QueueScheduler scheduler;
+	SimulatedQueues queues;
+	std::vector<QueueWait> waits;
+	int heightfield = 0;
+
+	// The noise dispatch writes the heightfield on the compute queue, the terrain pass samples it
+	QueueDependencies compute;
+	compute.Write(&heightfield);
+	const uint64_t computeFence = queues.Submit(scheduler, QueueType::compute, compute, waits);
+	STYX_CHECK(waits.empty());
+
+	QueueDependencies graphics;
+	graphics.Read(&heightfield);
+	queues.Submit(scheduler, QueueType::graphics, graphics, waits);
+	STYX_REQUIRE(waits.size() == 1);
+	STYX_CHECK(waits[0].mWaitingQueue == QueueType::graphics);
+	STYX_CHECK(waits[0].mSignalingQueue == QueueType::compute);
+	STYX_CHECK(waits[0].mFenceValue == computeFence);
+
+	// Nothing new was written, the next frame doesn't wait again
+	queues.Submit(scheduler, QueueType::graphics, graphics, waits);
+	STYX_CHECK(waits.empty());
+	STYX_CHECK(scheduler.GetStats().mNumElidedWaits == 1);
+}
+
+STYX_TEST(QueueScheduler_IndependentWorkOverlaps)
+{
+	QueueScheduler scheduler;
+	SimulatedQueues queues;
+	std::vector<QueueWait> waits;
+	int computeBuffer = 0;
+	int graphicsBuffer = 0;
+
+	QueueDependencies compute;
+	compute.Write(&computeBuffer);
+	queues.Submit(scheduler, QueueType::compute, compute, waits);
+
+	QueueDependencies graphics;
+	graphics.Write(&graphicsBuffer);
+	queues.Submit(scheduler, QueueType::graphics, graphics, waits);
+	STYX_CHECK(waits.empty());
+}
+
+STYX_TEST(QueueScheduler_ElidesTransitiveWaits)
+{
+	QueueScheduler scheduler;
+	SimulatedQueues queues;
+	std::vector<QueueWait> waits;
+	int uploaded = 0;
+	int generated = 0;
+
+	// copy -> compute -> graphics: graphics reading both only has to wait on compute
+	QueueDependencies copy;
+	copy.Write(&uploaded);
+	queues.Submit(scheduler, QueueType::copy, copy, waits);
+
+	QueueDependencies compute;
+	compute.Read(&uploaded);
+	compute.Write(&generated);
+	queues.Submit(scheduler, QueueType::compute, compute, waits);
+	STYX_REQUIRE(waits.size() == 1);
+	STYX_CHECK(waits[0].mSignalingQueue == QueueType::copy);
+
+	QueueDependencies graphics;
+	graphics.Read(&uploaded);
+	graphics.Read(&generated);
+	queues.Submit(scheduler, QueueType::graphics, graphics, waits);
+	STYX_REQUIRE(waits.size() == 1);
+	STYX_CHECK(waits[0].mSignalingQueue == QueueType::compute);
+}
+
+STYX_TEST(QueueScheduler_WriteAfterReadWaitsForTheReaders)
+{
+	QueueScheduler scheduler;
+	SimulatedQueues queues;
+	std::vector<QueueWait> waits;
+	int texture = 0;
+
+	QueueDependencies graphics;
+	graphics.Read(&texture);
+	const uint64_t readFence = queues.Submit(scheduler, QueueType::graphics, graphics, waits);
+
+	QueueDependencies copy;
+	copy.Write(&texture);
+	queues.Submit(scheduler, QueueType::copy, copy, waits);
+	STYX_REQUIRE(waits.size() == 1);
+	STYX_CHECK(waits[0].mSignalingQueue == QueueType::graphics);
+	STYX_CHECK(waits[0].mFenceValue == readFence);
+}
+
+STYX_TEST(QueueScheduler_CompletedWorkNeedsNoWait)
+{
+	QueueScheduler scheduler;
+	SimulatedQueues queues;
+	std::vector<QueueWait> waits;
+	int heightfield = 0;
+
+	QueueDependencies compute;
+	compute.Write(&heightfield);
+	queues.Submit(scheduler, QueueType::compute, compute, waits);
+
+	scheduler.RetireCompletedFences(queues.nextFenceValues);
+
+	QueueDependencies graphics;
+	graphics.Read(&heightfield);
+	queues.Submit(scheduler, QueueType::graphics, graphics, waits);
+	STYX_CHECK(waits.empty());
+}
+
+STYX_TEST(QueueScheduler_RandomDAGsAreOrderedWithMinimalWaits)
+{
+	std::mt19937 random(27);
+	constexpr uint32_t NUM_RESOURCES = 12;
+
+	struct Access
+	{
+		QueueFence submission;
+		uint32_t resource;
+		bool isWrite;
+	};
+
+	for (uint32_t graph = 0; graph < 50; graph++)
+	{
+		QueueScheduler scheduler;
+		SimulatedQueues queues;
+		std::vector<QueueWait> waits;
+		std::vector<Access> accesses;
+		int resources[NUM_RESOURCES] = {};
+
+		for (uint32_t submission = 0; submission < 300; submission++)
+		{
+			const QueueType queue = static_cast<QueueType>(random() % NUM_QUEUE_TYPES);
+			const uint32_t queueIndex = static_cast<uint32_t>(queue);
+
+			QueueDependencies dependencies;
+			const uint32_t numAccesses = 1 + random() % 3;
+			std::vector<std::pair<uint32_t, bool>> submissionAccesses;
+			for (uint32_t accessIndex = 0; accessIndex < numAccesses; accessIndex++)
+			{
+				const uint32_t resource = random() % NUM_RESOURCES;
+				const bool isWrite = random() % 3 == 0;
+				isWrite ? dependencies.Write(&resources[resource]) : dependencies.Read(&resources[resource]);
+				submissionAccesses.push_back({ resource, isWrite });
+			}
+
+			const QueueFenceClock clockBefore = queues.lastClocks[queueIndex];
+			const uint64_t fenceValue = queues.Submit(scheduler, queue, dependencies, waits);
+			const QueueFence self{ queue, fenceValue };
+
+			// No wait on something the queue already knows is done, and no two waits on the same queue
+			QueueFenceClock waitedFences{};
+			for (const QueueWait& wait : waits)
+			{
+				const uint32_t signalingQueueIndex = static_cast<uint32_t>(wait.mSignalingQueue);
+				STYX_CHECK(wait.mSignalingQueue != queue);
+				STYX_CHECK(wait.mFenceValue > clockBefore[signalingQueueIndex]);
+				STYX_CHECK(waitedFences[signalingQueueIndex] == 0);
+				waitedFences[signalingQueueIndex] = wait.mFenceValue;
+			}
+
+			// Every earlier conflicting access on another queue has to be done first
+			for (const Access& earlier : accesses)
+			{
+				for (const auto& [resource, isWrite] : submissionAccesses)
+				{
+					if (earlier.resource == resource && (earlier.isWrite || isWrite))
+					{
+						STYX_CHECK(queues.HappensBefore(earlier.submission, self));
+					}
+				}
+			}
+
+			for (const auto& [resource, isWrite] : submissionAccesses)
+			{
+				accesses.push_back({ self, resource, isWrite });
+			}
+		}
+	}
+}
+
+STYX_BENCHMARK(QueueScheduler_ScheduleSubmissions)
+{
+	constexpr uint32_t NUM_SUBMISSIONS = 200000;
+	constexpr uint32_t NUM_RESOURCES = 256;
+
+	std::mt19937 random(27);
+	std::vector<QueueDependencies> dependencies(1024);
+	int resources[NUM_RESOURCES] = {};
+
+	for (QueueDependencies& submission : dependencies)
+	{
+		for (uint32_t accessIndex = 0; accessIndex < 4; accessIndex++)
+		{
+			const uint32_t resource = random() % NUM_RESOURCES;
+			random() % 4 == 0 ? submission.Write(&resources[resource]) : submission.Read(&resources[resource]);
+		}
+	}
+
+	QueueScheduler scheduler;
+	QueueFenceClock fenceValues{};
+	std::vector<QueueWait> waits;
+
+	const double timeInMilliseconds = MeasureMilliseconds([&]()
+	{
+		for (uint32_t submission = 0; submission < NUM_SUBMISSIONS; submission++)
+		{
+			const uint32_t queueIndex = submission % NUM_QUEUE_TYPES;
+			waits.clear();
+			scheduler.ScheduleSubmission(static_cast<QueueType>(queueIndex), ++fenceValues[queueIndex], dependencies[submission % dependencies.size()], waits);
+
+			// The GPU keeps up a few submissions behind
+			if (submission % 16 == 15)
+			{
+				QueueFenceClock completedFences = fenceValues;
+				for (uint64_t& fenceValue : completedFences)
+				{
+					fenceValue = fenceValue > 4 ? fenceValue - 4 : 0;
+				}
+
+				scheduler.RetireCompletedFences(completedFences);
+			}
+		}
+	});
+
+	const QueueSchedulerStats& stats = scheduler.GetStats();
+	printf("    %u submissions in %.2f ms, %.0f ns each, %u waits emitted, %u elided\n", NUM_SUBMISSIONS, timeInMilliseconds,
+		timeInMilliseconds * 1e6 / NUM_SUBMISSIONS, stats.mNumEmittedWaits, stats.mNumElidedWaits);
+}
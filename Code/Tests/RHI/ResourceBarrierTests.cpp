@@ -0,0 +1,283 @@
+#include "TestFramework.h"
+
+#include <RHI/D3D12Lite.h>
+
+#include <array>
+#include <random>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	// Barriers only carry the resource pointer, they are never submitted here
+	ID3D12Resource* MakeFakeResource(uintptr_t id)
+	{
+		return reinterpret_cast<ID3D12Resource*>(id * 0x1000);
+	}
+
+	TextureResource MakeTexture(uintptr_t id, uint16_t numMips, uint16_t arraySize)
+	{
+		TextureResource texture;
+		texture.mResource = MakeFakeResource(id);
+		texture.mDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+		texture.mDesc.MipLevels = numMips;
+		texture.mDesc.DepthOrArraySize = arraySize;
+		return texture;
+	}
+
+	BufferResource MakeBuffer(uintptr_t id)
+	{
+		BufferResource buffer;
+		buffer.mResource = MakeFakeResource(id);
+		buffer.mDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		return buffer;
+	}
+
+	D3D12_RESOURCE_STATES GetSubresourceState(const Resource& resource, uint32_t subresource)
+	{
+		return resource.mSubresourceStates.empty() ? resource.mState : resource.mSubresourceStates[subresource];
+	}
+
+	// The tracking rules spelled out on a plain per-subresource array, to replay sequences against
+	struct ReferenceTracker
+	{
+		static bool IsReadOnly(D3D12_RESOURCE_STATES state)
+		{
+			constexpr D3D12_RESOURCE_STATES READ_ONLY_STATES = D3D12_RESOURCE_STATE_GENERIC_READ | D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
+			return state != D3D12_RESOURCE_STATE_COMMON && (state & READ_ONLY_STATES) == state;
+		}
+
+		static bool IsCovered(D3D12_RESOURCE_STATES currentState, D3D12_RESOURCE_STATES newState)
+		{
+			return currentState == newState || (IsReadOnly(currentState) && IsReadOnly(newState) && (currentState & newState) == newState);
+		}
+
+		// Barriers a transition emits: transitions, plus UAV barriers between two unordered access uses
+		uint32_t Transition(D3D12_RESOURCE_STATES newState, uint32_t subresource, uint32_t& outNumUAVBarriers)
+		{
+			outNumUAVBarriers = 0;
+
+			if (subresource != D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES && states.size() > 1)
+			{
+				if (IsCovered(states[subresource], newState))
+				{
+					outNumUAVBarriers = newState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS ? 1 : 0;
+					return 0;
+				}
+
+				states[subresource] = newState;
+				return 1;
+			}
+
+			const bool isUniform = std::all_of(states.begin(), states.end(), [this](D3D12_RESOURCE_STATES state) { return state == states[0]; });
+			if (isUniform)
+			{
+				if (IsCovered(states[0], newState))
+				{
+					outNumUAVBarriers = newState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS ? 1 : 0;
+					return 0;
+				}
+
+				std::fill(states.begin(), states.end(), newState);
+				return 1;
+			}
+
+			uint32_t numBarriers = 0;
+			for (D3D12_RESOURCE_STATES& state : states)
+			{
+				numBarriers += state != newState ? 1 : 0;
+				state = newState;
+			}
+
+			return numBarriers;
+		}
+
+		std::vector<D3D12_RESOURCE_STATES> states;
+	};
+
+	constexpr std::array<D3D12_RESOURCE_STATES, 8> REPLAY_STATES =
+	{
+		D3D12_RESOURCE_STATE_COMMON,
+		D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE,
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		D3D12_RESOURCE_STATE_COPY_SOURCE,
+	};
+}
+
+STYX_TEST(ResourceBarrierBatch_DropsRedundantTransitions)
+{
+	BufferResource buffer = MakeBuffer(1);
+	ResourceBarrierBatch batch;
+
+	batch.Transition(buffer, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	batch.Transition(buffer, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	// Already readable from pixel shaders
+	batch.Transition(buffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	STYX_REQUIRE(batch.GetNumBarriers() == 1);
+	STYX_CHECK(batch.GetBarriers()[0].Transition.StateBefore == D3D12_RESOURCE_STATE_COMMON);
+	STYX_CHECK(batch.GetBarriers()[0].Transition.StateAfter == D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+	STYX_CHECK(batch.GetStats().mNumTransitionBarriers == 1);
+	STYX_CHECK(batch.GetStats().mNumSkippedBarriers == 2);
+	STYX_CHECK(buffer.mState == D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+
+	// A write state is never covered by a read state
+	batch.Transition(buffer, D3D12_RESOURCE_STATE_COPY_DEST);
+	STYX_CHECK(batch.GetNumBarriers() == 2);
+}
+
+STYX_TEST(ResourceBarrierBatch_UnorderedAccessTwiceIsAUAVBarrier)
+{
+	BufferResource buffer = MakeBuffer(1);
+	ResourceBarrierBatch batch;
+
+	batch.Transition(buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	batch.Transition(buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+
+	STYX_REQUIRE(batch.GetNumBarriers() == 2);
+	STYX_CHECK(batch.GetBarriers()[0].Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION);
+	STYX_CHECK(batch.GetBarriers()[1].Type == D3D12_RESOURCE_BARRIER_TYPE_UAV);
+	STYX_CHECK(batch.GetBarriers()[1].UAV.pResource == buffer.mResource);
+	STYX_CHECK(batch.GetStats().mNumUAVBarriers == 1);
+}
+
+STYX_TEST(ResourceBarrierBatch_TracksSubresourcesAndCollapses)
+{
+	TextureResource texture = MakeTexture(1, 4, 2);
+	STYX_REQUIRE(texture.GetSubresourceCount() == 8);
+
+	ResourceBarrierBatch batch;
+
+	batch.Transition(texture, D3D12_RESOURCE_STATE_RENDER_TARGET, 1);
+	STYX_REQUIRE(batch.GetNumBarriers() == 1);
+	STYX_CHECK(batch.GetBarriers()[0].Transition.Subresource == 1);
+	STYX_CHECK(texture.mSubresourceStates.size() == 8);
+	STYX_CHECK(GetSubresourceState(texture, 0) == D3D12_RESOURCE_STATE_COMMON);
+	STYX_CHECK(GetSubresourceState(texture, 1) == D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	// Every subresource but the one already there gets its own barrier, then tracking collapses
+	batch.Clear();
+	batch.Transition(texture, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	STYX_CHECK(batch.GetNumBarriers() == 7);
+	STYX_CHECK(texture.mSubresourceStates.empty());
+	STYX_CHECK(texture.mState == D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	// Moving the subresources one at a time collapses as soon as the last one arrives
+	batch.Clear();
+	for (uint32_t subresource = 0; subresource < 8; subresource++)
+	{
+		batch.Transition(texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, subresource);
+		STYX_CHECK(texture.mSubresourceStates.empty() == (subresource == 7));
+	}
+
+	STYX_CHECK(batch.GetNumBarriers() == 8);
+	STYX_CHECK(texture.mState == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+}
+
+STYX_TEST(ResourceBarrierBatch_SplitsTransitions)
+{
+	TextureResource texture = MakeTexture(1, 1, 1);
+	ResourceBarrierBatch batch;
+
+	batch.BeginSplitTransition(texture, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	STYX_REQUIRE(batch.GetNumBarriers() == 1);
+	STYX_CHECK(batch.GetBarriers()[0].Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+	// The resource can't be used in its new state before the end half
+	STYX_CHECK(texture.mState == D3D12_RESOURCE_STATE_COMMON);
+	STYX_CHECK(texture.mHasPendingSplitBarrier);
+
+	batch.EndSplitTransition(texture);
+	STYX_REQUIRE(batch.GetNumBarriers() == 2);
+	STYX_CHECK(batch.GetBarriers()[1].Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+	STYX_CHECK(batch.GetBarriers()[1].Transition.StateBefore == D3D12_RESOURCE_STATE_COMMON);
+	STYX_CHECK(batch.GetBarriers()[1].Transition.StateAfter == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	STYX_CHECK(texture.mState == D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	STYX_CHECK(!texture.mHasPendingSplitBarrier);
+	STYX_CHECK(batch.GetStats().mNumSplitBarriers == 2);
+}
+
+STYX_TEST(ResourceBarrierBatch_GrowsPastTheOldQueueLimit)
+{
+	std::vector<BufferResource> buffers;
+	for (uintptr_t bufferIndex = 0; bufferIndex < 100; bufferIndex++)
+	{
+		buffers.push_back(MakeBuffer(bufferIndex + 1));
+	}
+
+	ResourceBarrierBatch batch;
+	for (BufferResource& buffer : buffers)
+	{
+		batch.Transition(buffer, D3D12_RESOURCE_STATE_COPY_DEST);
+	}
+
+	// One flush for the whole pass
+	STYX_CHECK(batch.GetNumBarriers() == 100);
+	batch.Clear();
+	STYX_CHECK(batch.GetStats().mNumFlushes == 1);
+	batch.Clear();
+	STYX_CHECK(batch.GetStats().mNumFlushes == 1);
+}
+
+STYX_TEST(ResourceBarrierBatch_ReplaysRandomSequences)
+{
+	std::mt19937 random(26);
+
+	for (uint32_t sequence = 0; sequence < 200; sequence++)
+	{
+		const uint16_t numMips = static_cast<uint16_t>(1 + random() % 4);
+		const uint16_t arraySize = static_cast<uint16_t>(1 + random() % 3);
+		TextureResource texture = MakeTexture(1, numMips, arraySize);
+		const uint32_t numSubresources = texture.GetSubresourceCount();
+
+		ReferenceTracker reference;
+		reference.states.resize(numSubresources, D3D12_RESOURCE_STATE_COMMON);
+
+		ResourceBarrierBatch batch;
+		uint32_t expectedTransitions = 0;
+		uint32_t expectedUAVBarriers = 0;
+
+		for (uint32_t step = 0; step < 64; step++)
+		{
+			const D3D12_RESOURCE_STATES newState = REPLAY_STATES[random() % REPLAY_STATES.size()];
+			const uint32_t subresource = random() % 3 == 0 ? D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES : static_cast<uint32_t>(random() % numSubresources);
+
+			const uint32_t numBarriersBefore = batch.GetNumBarriers();
+			uint32_t numUAVBarriers = 0;
+			const uint32_t numTransitions = reference.Transition(newState, subresource, numUAVBarriers);
+			batch.Transition(texture, newState, subresource);
+
+			STYX_CHECK(batch.GetNumBarriers() - numBarriersBefore == numTransitions + numUAVBarriers);
+			expectedTransitions += numTransitions;
+			expectedUAVBarriers += numUAVBarriers;
+
+			for (uint32_t subresourceIndex = 0; subresourceIndex < numSubresources; subresourceIndex++)
+			{
+				STYX_CHECK(GetSubresourceState(texture, subresourceIndex) == reference.states[subresourceIndex]);
+			}
+
+			// Every barrier starts from the state the previous one left its subresource in
+			for (uint32_t barrierIndex = numBarriersBefore; barrierIndex < batch.GetNumBarriers(); barrierIndex++)
+			{
+				const D3D12_RESOURCE_BARRIER& barrier = batch.GetBarriers()[barrierIndex];
+				if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)
+				{
+					STYX_CHECK(barrier.Transition.StateAfter == newState);
+					STYX_CHECK(barrier.Transition.StateBefore != newState);
+				}
+			}
+
+			if (random() % 8 == 0)
+			{
+				batch.Clear();
+			}
+		}
+
+		STYX_CHECK(batch.GetStats().mNumTransitionBarriers == expectedTransitions);
+		STYX_CHECK(batch.GetStats().mNumUAVBarriers == expectedUAVBarriers);
+	}
+}
@@ -0,0 +1,195 @@
+#include "TestFramework.h"
+
+#include <RHI/ResourcePool.h>
+
+#include <atomic>
+#include <random>
+#include <unordered_map>
+
+using namespace Styx::Tests;
+using namespace D3D12Lite;
+
+namespace
+{
+	struct TestResource
+	{
+		uint32_t value = 0;
+		std::atomic<uint32_t> counter = 0;
+	};
+
+	struct TestHotData
+	{
+		uint32_t descriptorIndex = 0;
+	};
+
+	using TestPool = ResourcePool<TestResource, TestHotData>;
+	using TestHandle = TestPool::Handle;
+}
+
+STYX_TEST(ResourcePool_StaleHandlesAreRejected)
+{
+	TestPool pool;
+
+	const TestHandle first = pool.Allocate();
+	STYX_CHECK(first.IsValid() && pool.IsValid(first));
+	pool.Get(first).value = 42;
+
+	pool.Free(first);
+	STYX_CHECK(!pool.IsValid(first));
+	STYX_CHECK(pool.TryGet(first) == nullptr);
+
+	// Same slot, new generation: the old handle must not alias the new resource
+	const TestHandle second = pool.Allocate();
+	STYX_CHECK(second.GetIndex() == first.GetIndex());
+	STYX_CHECK(second.GetGeneration() != first.GetGeneration());
+	STYX_CHECK(pool.IsValid(second) && !pool.IsValid(first));
+	STYX_CHECK(pool.Get(second).value == 0);
+
+	STYX_CHECK(!pool.IsValid(TestHandle()));
+	STYX_CHECK(!pool.IsValid(TestHandle(100, 1)));
+}
+
+STYX_TEST(ResourcePool_GenerationWrapSkipsZero)
+{
+	TestPool pool;
+
+	TestHandle handle = pool.Allocate();
+	const uint32_t index = handle.GetIndex();
+
+	for (uint32_t cycle = 0; cycle < TestHandle::MAX_GENERATION + 2; cycle++)
+	{
+		pool.Free(handle);
+		handle = pool.Allocate();
+		STYX_CHECK(handle.GetIndex() == index);
+		STYX_CHECK(handle.GetGeneration() != 0 && handle.IsValid());
+	}
+
+	STYX_CHECK(pool.GetNumSlots() == 1);
+}
+
+STYX_TEST(ResourcePool_ReferencesSurviveGrowth)
+{
+	TestPool pool;
+
+	const TestHandle first = pool.Allocate();
+	TestResource* firstResource = &pool.Get(first);
+	firstResource->value = 7;
+
+	// Enough allocations to add many chunks and reallocate the flat arrays several times
+	for (uint32_t allocation = 0; allocation < TestPool::CHUNK_SIZE * 16; allocation++)
+	{
+		pool.Allocate();
+	}
+
+	STYX_CHECK(&pool.Get(first) == firstResource);
+	STYX_CHECK(firstResource->value == 7);
+}
+
+STYX_TEST(ResourcePool_RandomChurnMatchesReference)
+{
+	std::mt19937 random(30);
+	TestPool pool;
+
+	std::vector<TestHandle> alive;
+	std::vector<TestHandle> freed;
+	std::unordered_map<uint32_t, uint32_t> values;
+	uint32_t nextValue = 1;
+
+	for (uint32_t operation = 0; operation < 100000; operation++)
+	{
+		if (alive.empty() || random() % 5 < 3)
+		{
+			const TestHandle handle = pool.Allocate();
+			STYX_CHECK(pool.Get(handle).value == 0 && pool.GetHotData(handle).descriptorIndex == 0);
+
+			pool.Get(handle).value = nextValue;
+			pool.GetHotData(handle).descriptorIndex = nextValue;
+			values[handle.GetValue()] = nextValue++;
+			alive.push_back(handle);
+		}
+		else
+		{
+			const size_t position = random() % alive.size();
+			const TestHandle handle = alive[position];
+			alive[position] = alive.back();
+			alive.pop_back();
+
+			STYX_CHECK(pool.Get(handle).value == values[handle.GetValue()]);
+			STYX_CHECK(pool.GetHotData(handle).descriptorIndex == values[handle.GetValue()]);
+			values.erase(handle.GetValue());
+			pool.Free(handle);
+			freed.push_back(handle);
+		}
+	}
+
+	STYX_CHECK(pool.GetNumAlive() == alive.size());
+
+	// Freed slots are recycled instead of growing the pool past the high-water mark
+	STYX_CHECK(pool.GetNumSlots() < 100000 / 2);
+
+	for (const TestHandle& handle : freed)
+	{
+		STYX_CHECK(!pool.IsValid(handle) || values.count(handle.GetValue()) == 1);
+	}
+
+	uint32_t numVisited = 0;
+	pool.ForEach([&](TestHandle handle, TestResource& resource, TestHotData& hotData)
+	{
+		STYX_CHECK(values.count(handle.GetValue()) == 1);
+		STYX_CHECK(resource.value == values[handle.GetValue()] && hotData.descriptorIndex == resource.value);
+		numVisited++;
+	});
+
+	STYX_CHECK(numVisited == alive.size());
+}
+
+STYX_BENCHMARK(ResourcePool_HandleOperations)
+{
+	constexpr uint32_t NUM_RESOURCES = 16384;
+	constexpr uint32_t NUM_LOOKUPS = 10000000;
+
+	TestPool pool;
+	std::vector<TestHandle> handles;
+
+	const double allocateTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t resource = 0; resource < NUM_RESOURCES; resource++)
+		{
+			handles.push_back(pool.Allocate());
+		}
+	});
+
+	// Steady state churn, every slot comes from the free list
+	const double churnTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t resource = 0; resource < NUM_RESOURCES; resource++)
+		{
+			pool.Free(handles[resource]);
+			handles[resource] = pool.Allocate();
+		}
+	});
+
+	// What a draw does: validate the handle and read the hot data
+	std::mt19937 random(30);
+	std::vector<uint32_t> order(NUM_RESOURCES * 4);
+	for (uint32_t& position : order)
+	{
+		position = random() % NUM_RESOURCES;
+	}
+
+	uint64_t checksum = 0;
+	const double lookupTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t lookup = 0; lookup < NUM_LOOKUPS; lookup++)
+		{
+			const TestHandle handle = handles[order[lookup % order.size()]];
+			if (pool.IsValid(handle))
+			{
+				checksum += pool.GetHotData(handle).descriptorIndex + handle.GetIndex();
+			}
+		}
+	});
+
+	printf("    allocate %.1f ns, free+allocate %.1f ns, validated hot lookup %.2f ns (checksum %llu)\n",
+		allocateTime * 1e6 / NUM_RESOURCES, churnTime * 1e6 / NUM_RESOURCES, lookupTime * 1e6 / NUM_LOOKUPS, static_cast<unsigned long long>(checksum));
+}
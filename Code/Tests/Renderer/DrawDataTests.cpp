@@ -0,0 +1,154 @@
+#include "TestFramework.h"
+
+#include <Renderer/DrawData.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <thread>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	// Fills the per-field streams directly, PackDrawData never looks at anything else
+	void FillDrawList(DrawList& drawList, uint32_t numDraws, uint32_t seed)
+	{
+		std::mt19937 random(seed);
+
+		for (uint32_t draw = 0; draw < numDraws; draw++)
+		{
+			drawList.transformIndices.push_back(random());
+			drawList.vertexOffsets.push_back(random());
+			drawList.positionBufferIndices.push_back(random());
+			drawList.normalBufferIndices.push_back(random());
+			drawList.tangentBufferIndices.push_back(random());
+			drawList.uvBufferIndices.push_back(random());
+			drawList.materialIndices.push_back(random());
+		}
+	}
+
+	PerDrawData PackReference(const DrawList& drawList, uint32_t drawIndex)
+	{
+		PerDrawData drawData;
+		drawData.transformIndex = drawList.transformIndices[drawIndex];
+		drawData.vertexOffset = drawList.vertexOffsets[drawIndex];
+		drawData.positionBufferIndex = drawList.positionBufferIndices[drawIndex];
+		drawData.normalBufferIndex = drawList.normalBufferIndices[drawIndex];
+		drawData.tangentBufferIndex = drawList.tangentBufferIndices[drawIndex];
+		drawData.uvBufferIndex = drawList.uvBufferIndices[drawIndex];
+		drawData.materialIndex = drawList.materialIndices[drawIndex];
+		drawData.padding = 0;
+		return drawData;
+	}
+
+	void PackOnThreads(const DrawList& drawList, uint32_t numThreads, PerDrawData* outDrawData)
+	{
+		const uint32_t numDraws = drawList.GetNumDraws();
+		std::vector<std::thread> threads;
+
+		for (uint32_t threadIndex = 0; threadIndex < numThreads; threadIndex++)
+		{
+			const uint32_t firstDraw = static_cast<uint32_t>(static_cast<uint64_t>(numDraws) * threadIndex / numThreads);
+			const uint32_t endDraw = static_cast<uint32_t>(static_cast<uint64_t>(numDraws) * (threadIndex + 1) / numThreads);
+			threads.emplace_back([&drawList, firstDraw, endDraw, outDrawData]() { PackDrawData(drawList, firstDraw, endDraw - firstDraw, outDrawData); });
+		}
+
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+}
+
+STYX_TEST(DrawData_PackingMatchesTheScalarReference)
+{
+	DrawList drawList;
+	FillDrawList(drawList, 1031, 33);
+
+	std::vector<PerDrawData> drawData(drawList.GetNumDraws());
+
+	// Every head and tail length around the four-wide loop
+	for (uint32_t firstDraw = 0; firstDraw < 9; firstDraw++)
+	{
+		for (uint32_t numDraws : { 0u, 1u, 3u, 4u, 5u, 8u, 13u, 1000u })
+		{
+			memset(drawData.data(), 0xcd, drawData.size() * sizeof(PerDrawData));
+			PackDrawData(drawList, firstDraw, numDraws, drawData.data());
+
+			for (uint32_t drawIndex = 0; drawIndex < drawList.GetNumDraws(); drawIndex++)
+			{
+				const bool isPacked = drawIndex >= firstDraw && drawIndex < firstDraw + numDraws;
+				if (isPacked)
+				{
+					const PerDrawData expected = PackReference(drawList, drawIndex);
+					STYX_CHECK(memcmp(&drawData[drawIndex], &expected, sizeof(PerDrawData)) == 0);
+				}
+				else
+				{
+					// Draws outside the range are left alone, so ranges can be packed from different threads
+					STYX_CHECK(drawData[drawIndex].transformIndex == 0xcdcdcdcd);
+				}
+			}
+		}
+	}
+}
+
+STYX_TEST(DrawData_ThreadedPackingMatchesSinglePass)
+{
+	DrawList drawList;
+	FillDrawList(drawList, 10007, 33);
+
+	std::vector<PerDrawData> expected(drawList.GetNumDraws());
+	PackDrawData(drawList, 0, drawList.GetNumDraws(), expected.data());
+
+	for (uint32_t numThreads : { 2u, 3u, 8u })
+	{
+		std::vector<PerDrawData> drawData(drawList.GetNumDraws());
+		PackOnThreads(drawList, numThreads, drawData.data());
+		STYX_CHECK(memcmp(drawData.data(), expected.data(), expected.size() * sizeof(PerDrawData)) == 0);
+	}
+}
+
+STYX_BENCHMARK(DrawData_DrawsPackedPerMillisecond)
+{
+	constexpr uint32_t NUM_DRAWS = 100000;
+	constexpr uint32_t NUM_REPEATS = 200;
+
+	DrawList drawList;
+	FillDrawList(drawList, NUM_DRAWS, 33);
+	std::vector<PerDrawData> drawData(NUM_DRAWS);
+
+	const double scalarTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t repeat = 0; repeat < NUM_REPEATS; repeat++)
+		{
+			for (uint32_t drawIndex = 0; drawIndex < NUM_DRAWS; drawIndex++)
+			{
+				drawData[drawIndex] = PackReference(drawList, drawIndex);
+			}
+		}
+	});
+
+	const double simdTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t repeat = 0; repeat < NUM_REPEATS; repeat++)
+		{
+			PackDrawData(drawList, 0, NUM_DRAWS, drawData.data());
+		}
+	});
+
+	const uint32_t numThreads = (std::max)(1u, std::thread::hardware_concurrency());
+	const double threadedTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t repeat = 0; repeat < NUM_REPEATS; repeat++)
+		{
+			PackOnThreads(drawList, numThreads, drawData.data());
+		}
+	});
+
+	const double numPacked = static_cast<double>(NUM_DRAWS) * NUM_REPEATS;
+	printf("    scalar %.0f draws/ms, SSE2 %.0f draws/ms, SSE2 on %u threads %.0f draws/ms\n",
+		numPacked / scalarTime, numPacked / simdTime, numThreads, numPacked / threadedTime);
+}
@@ -0,0 +1,468 @@
+#include "TestFramework.h"
+
+#include <Core/JobSystem.h>
+#include <Renderer/HeightfieldImporter.h>
+#include <Renderer/HeightmapReader.h>
+#include <Renderer/TerrainTileFile.h>
+#include <Renderer/TerrainTileStreamer.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	std::string GetTempPath(const char* name)
+	{
+		return (std::filesystem::temp_directory_path() / name).string();
+	}
+
+	// Slopes and ridges over most of the 16 bit range, nothing a tile could get right by accident
+	std::vector<uint16_t> MakeHeights(uint32_t width, uint32_t height)
+	{
+		std::vector<uint16_t> heights(static_cast<size_t>(width) * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				heights[static_cast<size_t>(y) * width + x] = static_cast<uint16_t>(x * 97 + y * 131 + ((x * y) % 251) * 40);
+			}
+		}
+
+		return heights;
+	}
+
+	bool WriteRaw(const std::string& path, const std::vector<uint16_t>& heights)
+	{
+		FILE* file = nullptr;
+		fopen_s(&file, path.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+
+		// Little endian
+		std::vector<uint8_t> bytes(heights.size() * 2);
+		for (size_t index = 0; index < heights.size(); index++)
+		{
+			bytes[2 * index] = static_cast<uint8_t>(heights[index]);
+			bytes[2 * index + 1] = static_cast<uint8_t>(heights[index] >> 8);
+		}
+
+		const bool isWritten = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+		return fclose(file) == 0 && isWritten;
+	}
+
+	uint32_t ComputeCrc(const uint8_t* data, size_t size, uint32_t crc = 0xFFFFFFFFu)
+	{
+		for (size_t index = 0; index < size; index++)
+		{
+			crc ^= data[index];
+			for (uint32_t bit = 0; bit < 8; bit++)
+			{
+				crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+			}
+		}
+
+		return crc;
+	}
+
+	void AppendBigEndian32(std::vector<uint8_t>& bytes, uint32_t value)
+	{
+		bytes.push_back(static_cast<uint8_t>(value >> 24));
+		bytes.push_back(static_cast<uint8_t>(value >> 16));
+		bytes.push_back(static_cast<uint8_t>(value >> 8));
+		bytes.push_back(static_cast<uint8_t>(value));
+	}
+
+	void AppendChunk(std::vector<uint8_t>& bytes, const char* type, const std::vector<uint8_t>& data)
+	{
+		AppendBigEndian32(bytes, static_cast<uint32_t>(data.size()));
+		const size_t typeOffset = bytes.size();
+		bytes.insert(bytes.end(), type, type + 4);
+		bytes.insert(bytes.end(), data.begin(), data.end());
+		AppendBigEndian32(bytes, ComputeCrc(bytes.data() + typeOffset, bytes.size() - typeOffset) ^ 0xFFFFFFFFu);
+	}
+
+	// A 16 bit grayscale PNG of stored deflate blocks, odd rows Sub filtered so the reader unfilters too
+	bool WritePng(const std::string& path, const std::vector<uint16_t>& heights, uint32_t width, uint32_t height)
+	{
+		std::vector<uint8_t> scanlines;
+		for (uint32_t y = 0; y < height; y++)
+		{
+			const uint8_t filter = y & 1;
+			scanlines.push_back(filter);
+			for (uint32_t x = 0; x < width; x++)
+			{
+				const uint16_t sample = heights[static_cast<size_t>(y) * width + x];
+				const uint16_t left = filter != 0 && x > 0 ? heights[static_cast<size_t>(y) * width + x - 1] : 0;
+				scanlines.push_back(static_cast<uint8_t>((sample >> 8) - (left >> 8)));
+				scanlines.push_back(static_cast<uint8_t>((sample & 0xFF) - (left & 0xFF)));
+			}
+		}
+
+		std::vector<uint8_t> zlib = { 0x78, 0x01 };
+		for (size_t offset = 0; offset < scanlines.size(); offset += 65535)
+		{
+			const uint16_t blockSize = static_cast<uint16_t>((std::min)(scanlines.size() - offset, static_cast<size_t>(65535)));
+			zlib.push_back(offset + blockSize == scanlines.size() ? 1 : 0);
+			zlib.push_back(static_cast<uint8_t>(blockSize));
+			zlib.push_back(static_cast<uint8_t>(blockSize >> 8));
+			zlib.push_back(static_cast<uint8_t>(~blockSize));
+			zlib.push_back(static_cast<uint8_t>(~blockSize >> 8));
+			zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+		}
+
+		uint32_t a = 1;
+		uint32_t b = 0;
+		for (uint8_t byte : scanlines)
+		{
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		AppendBigEndian32(zlib, (b << 16) | a);
+
+		std::vector<uint8_t> ihdr;
+		AppendBigEndian32(ihdr, width);
+		AppendBigEndian32(ihdr, height);
+		ihdr.insert(ihdr.end(), { 16, 0, 0, 0, 0 });
+
+		std::vector<uint8_t> bytes = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		AppendChunk(bytes, "IHDR", ihdr);
+		// Split in two IDAT chunks
+		const size_t half = zlib.size() / 2;
+		AppendChunk(bytes, "IDAT", std::vector<uint8_t>(zlib.begin(), zlib.begin() + half));
+		AppendChunk(bytes, "IDAT", std::vector<uint8_t>(zlib.begin() + half, zlib.end()));
+		AppendChunk(bytes, "IEND", {});
+
+		FILE* file = nullptr;
+		fopen_s(&file, path.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+
+		const bool isWritten = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+		return fclose(file) == 0 && isWritten;
+	}
+
+	bool ImportRaw(const std::string& rawPath, uint32_t width, uint32_t height, const HeightfieldImportDesc& desc, const std::string& outputPath, HeightfieldImportStats* outStats = nullptr)
+	{
+		HeightmapReader reader;
+		return reader.OpenRaw(rawPath.c_str(), width, height) && ImportHeightfield(reader, desc, outputPath.c_str(), outStats);
+	}
+
+	std::vector<uint8_t> ReadFile(const std::string& path)
+	{
+		std::error_code error;
+		std::vector<uint8_t> bytes(static_cast<size_t>(std::filesystem::file_size(path, error)));
+
+		FILE* file = nullptr;
+		fopen_s(&file, path.c_str(), "rb");
+		if (!file || error)
+		{
+			return {};
+		}
+
+		const size_t numRead = fread(bytes.data(), 1, bytes.size(), file);
+		fclose(file);
+		return numRead == bytes.size() ? bytes : std::vector<uint8_t>{};
+	}
+
+	// Heights outside the heightmap repeat its edges
+	uint16_t GetClampedHeight(const std::vector<uint16_t>& heights, uint32_t width, uint32_t height, uint32_t x, uint32_t y)
+	{
+		return heights[static_cast<size_t>((std::min)(y, height - 1)) * width + (std::min)(x, width - 1)];
+	}
+}
+
+STYX_TEST(HeightfieldImporter_RawRoundTripsThroughTheTileFile)
+{
+	// Neither side a multiple of the tile size
+	constexpr uint32_t WIDTH = 300;
+	constexpr uint32_t HEIGHT = 200;
+	constexpr uint32_t TILE_SIZE = 64;
+	constexpr uint32_t NUM_SAMPLES = TILE_SIZE + 1;
+
+	const std::vector<uint16_t> heights = MakeHeights(WIDTH, HEIGHT);
+	const std::string rawPath = GetTempPath("StyxImporterRoundTrip.raw");
+	const std::string tilePath = GetTempPath("StyxImporterRoundTrip.sttf");
+	STYX_REQUIRE(WriteRaw(rawPath, heights));
+
+	HeightfieldImportDesc desc;
+	desc.tileSize = TILE_SIZE;
+	desc.sampleSpacing = 2.0f;
+	desc.heightScale = 300.0f;
+
+	HeightfieldImportStats stats;
+	STYX_REQUIRE(ImportRaw(rawPath, WIDTH, HEIGHT, desc, tilePath, &stats));
+
+	TerrainTileFile tileFile;
+	STYX_REQUIRE(tileFile.Open(tilePath.c_str()));
+
+	const TerrainTileFileHeader& header = tileFile.GetHeader();
+	STYX_CHECK(header.width == WIDTH && header.height == HEIGHT && header.tileSize == TILE_SIZE);
+	STYX_CHECK(header.numTilesX == 5 && header.numTilesY == 4);
+	STYX_CHECK(header.numMips == TerrainTileFile::GetMaxNumMips(TILE_SIZE));
+	STYX_CHECK(header.sampleSpacing == desc.sampleSpacing && header.heightScale == desc.heightScale);
+	STYX_CHECK(stats.numBytesWritten == header.dataOffset + static_cast<uint64_t>(header.numTilesX) * header.numTilesY * header.tileStride);
+
+	// What the streamer gets for every tile, and flat ground around the heightfield
+	uint32_t numDifferences = 0;
+	std::vector<uint16_t> tileHeights(NUM_SAMPLES * NUM_SAMPLES);
+	for (int32_t tileY = -1; tileY <= static_cast<int32_t>(header.numTilesY); tileY++)
+	{
+		for (int32_t tileX = -1; tileX <= static_cast<int32_t>(header.numTilesX); tileX++)
+		{
+			const bool isInside = tileX >= 0 && tileY >= 0 && tileX < static_cast<int32_t>(header.numTilesX) && tileY < static_cast<int32_t>(header.numTilesY);
+			tileFile.CopyTileHeights(TerrainTileCoord{ tileX, tileY }, tileHeights.data());
+
+			for (uint32_t sampleY = 0; sampleY < NUM_SAMPLES; sampleY++)
+			{
+				for (uint32_t sampleX = 0; sampleX < NUM_SAMPLES; sampleX++)
+				{
+					const uint16_t expected = isInside ? GetClampedHeight(heights, WIDTH, HEIGHT, tileX * TILE_SIZE + sampleX, tileY * TILE_SIZE + sampleY) : 0;
+					numDifferences += tileHeights[sampleY * NUM_SAMPLES + sampleX] == expected ? 0 : 1;
+				}
+			}
+		}
+	}
+	STYX_CHECK(numDifferences == 0);
+
+	// Neighbours agree on the edges they share at every mip
+	uint32_t numEdgeDifferences = 0;
+	for (uint32_t mip = 0; mip < header.numMips; mip++)
+	{
+		const uint32_t size = TerrainTileFile::GetMipSize(TILE_SIZE, mip);
+		for (uint32_t tileY = 0; tileY < header.numTilesY; tileY++)
+		{
+			for (uint32_t tileX = 0; tileX < header.numTilesX; tileX++)
+			{
+				const uint16_t* tile = tileFile.GetHeights(tileX, tileY, mip);
+				const uint16_t* right = tileX + 1 < header.numTilesX ? tileFile.GetHeights(tileX + 1, tileY, mip) : nullptr;
+				const uint16_t* below = tileY + 1 < header.numTilesY ? tileFile.GetHeights(tileX, tileY + 1, mip) : nullptr;
+				for (uint32_t i = 0; i < size; i++)
+				{
+					numEdgeDifferences += right && tile[i * size + size - 1] != right[i * size] ? 1 : 0;
+					numEdgeDifferences += below && tile[(size - 1) * size + i] != below[i] ? 1 : 0;
+				}
+			}
+		}
+	}
+	STYX_CHECK(numEdgeDifferences == 0);
+	tileFile.Close();
+
+	// The tiles built on the job system are the same bytes
+	const std::string jobTilePath = GetTempPath("StyxImporterRoundTripJobs.sttf");
+	JobSystemDesc jobSystemDesc;
+	jobSystemDesc.numWorkers = 3;
+	JobSystem::Initialize(jobSystemDesc);
+
+	bool isJobImported = false;
+	JobCounter counter;
+	JobSystem::Run(counter, [&]() { isJobImported = ImportRaw(rawPath, WIDTH, HEIGHT, desc, jobTilePath); });
+	JobSystem::Wait(counter);
+	JobSystem::Shutdown();
+
+	STYX_CHECK(isJobImported);
+	const std::vector<uint8_t> bytes = ReadFile(tilePath);
+	STYX_CHECK(!bytes.empty() && bytes == ReadFile(jobTilePath));
+
+	std::filesystem::remove(rawPath);
+	std::filesystem::remove(tilePath);
+	std::filesystem::remove(jobTilePath);
+}
+
+STYX_TEST(HeightfieldImporter_PngImportsLikeTheSameRaw)
+{
+	constexpr uint32_t WIDTH = 150;
+	constexpr uint32_t HEIGHT = 230;
+
+	const std::vector<uint16_t> heights = MakeHeights(WIDTH, HEIGHT);
+	const std::string rawPath = GetTempPath("StyxImporterPng.raw");
+	const std::string pngPath = GetTempPath("StyxImporterPng.png");
+	const std::string rawTilePath = GetTempPath("StyxImporterPngRaw.sttf");
+	const std::string pngTilePath = GetTempPath("StyxImporterPngPng.sttf");
+	STYX_REQUIRE(WriteRaw(rawPath, heights));
+	STYX_REQUIRE(WritePng(pngPath, heights, WIDTH, HEIGHT));
+
+	HeightfieldImportDesc desc;
+	desc.tileSize = 32;
+	STYX_REQUIRE(ImportRaw(rawPath, WIDTH, HEIGHT, desc, rawTilePath));
+
+	HeightmapReader reader;
+	STYX_REQUIRE(reader.OpenPng(pngPath.c_str()));
+	STYX_CHECK(reader.GetWidth() == WIDTH && reader.GetHeight() == HEIGHT);
+	STYX_REQUIRE(ImportHeightfield(reader, desc, pngTilePath.c_str()));
+	reader.Close();
+
+	const std::vector<uint8_t> bytes = ReadFile(rawTilePath);
+	STYX_CHECK(!bytes.empty() && bytes == ReadFile(pngTilePath));
+
+	std::filesystem::remove(rawPath);
+	std::filesystem::remove(pngPath);
+	std::filesystem::remove(rawTilePath);
+	std::filesystem::remove(pngTilePath);
+}
+
+STYX_TEST(HeightfieldImporter_PeakMemoryDoesntGrowWithTheHeight)
+{
+	constexpr uint32_t WIDTH = 256;
+
+	HeightfieldImportDesc desc;
+	size_t peakMemory[2] = {};
+	uint32_t index = 0;
+	for (uint32_t height : { 1024u, 4096u })
+	{
+		const std::string rawPath = GetTempPath("StyxImporterMemory.raw");
+		const std::string tilePath = GetTempPath("StyxImporterMemory.sttf");
+		STYX_REQUIRE(WriteRaw(rawPath, MakeHeights(WIDTH, height)));
+
+		HeightfieldImportStats stats;
+		STYX_REQUIRE(ImportRaw(rawPath, WIDTH, height, desc, tilePath, &stats));
+		peakMemory[index++] = stats.peakMemoryInBytes;
+
+		std::filesystem::remove(rawPath);
+		std::filesystem::remove(tilePath);
+	}
+
+	STYX_CHECK(peakMemory[0] == peakMemory[1]);
+	// A fraction of what the taller heightmap's heights alone take
+	STYX_CHECK(peakMemory[1] < static_cast<size_t>(WIDTH) * 4096 * sizeof(uint16_t) / 4);
+}
+
+STYX_TEST(HeightfieldImporter_StreamerStreamsTheFilesTiles)
+{
+	constexpr uint32_t WIDTH = 200;
+	constexpr uint32_t HEIGHT = 170;
+
+	const std::vector<uint16_t> heights = MakeHeights(WIDTH, HEIGHT);
+	const std::string rawPath = GetTempPath("StyxImporterStreamer.raw");
+	const std::string tilePath = GetTempPath("StyxImporterStreamer.sttf");
+	STYX_REQUIRE(WriteRaw(rawPath, heights));
+
+	HeightfieldImportDesc importDesc;
+	importDesc.tileSize = 32;
+	STYX_REQUIRE(ImportRaw(rawPath, WIDTH, HEIGHT, importDesc, tilePath));
+
+	TerrainTileFile tileFile;
+	STYX_REQUIRE(tileFile.Open(tilePath.c_str()));
+	const TerrainTileFileHeader& header = tileFile.GetHeader();
+
+	// Set up like TerrainRenderer does for an imported heightfield
+	TerrainTileStreamerDesc desc;
+	desc.tileSize = header.tileSize;
+	desc.tileWorldSize = header.sampleSpacing * static_cast<float>(header.tileSize);
+	desc.viewRadius = 3;
+
+	uint32_t numUploads = 0;
+	uint32_t numInsideUploads = 0;
+	uint32_t numDifferences = 0;
+	{
+		TerrainTileStreamer streamer(desc, [&tileFile](const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants&, uint32_t, uint16_t* tileHeights)
+		{
+			tileFile.CopyTileHeights(coord, tileHeights);
+		});
+
+		TerrainTileView view;
+		view.positionX = 2.5f * desc.tileWorldSize;
+		view.positionZ = 2.5f * desc.tileWorldSize;
+
+		const uint32_t numSamples = desc.tileSize + 1;
+		for (uint64_t frame = 0; frame < 200; frame++)
+		{
+			streamer.Update(view, frame);
+			streamer.WaitForIdle();
+
+			for (const TerrainTileUpload& upload : streamer.GetUploads())
+			{
+				numUploads++;
+				const bool isInside = upload.coord.x >= 0 && upload.coord.y >= 0 && upload.coord.x < static_cast<int32_t>(header.numTilesX) && upload.coord.y < static_cast<int32_t>(header.numTilesY);
+				numInsideUploads += isInside ? 1 : 0;
+
+				for (uint32_t sampleY = 0; sampleY < numSamples; sampleY++)
+				{
+					for (uint32_t sampleX = 0; sampleX < numSamples; sampleX++)
+					{
+						const uint16_t expected = isInside ? GetClampedHeight(heights, WIDTH, HEIGHT, upload.coord.x * desc.tileSize + sampleX, upload.coord.y * desc.tileSize + sampleY) : 0;
+						numDifferences += upload.heights[sampleY * numSamples + sampleX] == expected ? 0 : 1;
+					}
+				}
+			}
+		}
+	}
+
+	// The whole 7x7 view from tile (-1, -1) to (5, 5), 6x6 of the file's 7x6 tiles within it
+	STYX_CHECK(header.numTilesX == 7 && header.numTilesY == 6);
+	STYX_CHECK(numUploads == 49);
+	STYX_CHECK(numInsideUploads == 36);
+	STYX_CHECK(numDifferences == 0);
+
+	tileFile.Close();
+	std::filesystem::remove(rawPath);
+	std::filesystem::remove(tilePath);
+}
+
+STYX_BENCHMARK(HeightfieldImporter_MegasamplesPerSecond)
+{
+	constexpr uint32_t SIZE = 2048;
+	constexpr uint32_t TILE_SIZE = 64;
+
+	const std::string rawPath = GetTempPath("StyxImporterBenchmark.raw");
+	const std::string tilePath = GetTempPath("StyxImporterBenchmark.sttf");
+	if (!WriteRaw(rawPath, MakeHeights(SIZE, SIZE)))
+	{
+		printf("    Failed to write '%s'\n", rawPath.c_str());
+		return;
+	}
+
+	HeightfieldImportDesc desc;
+	desc.tileSize = TILE_SIZE;
+
+	HeightfieldImportStats stats;
+	ImportRaw(rawPath, SIZE, SIZE, desc, tilePath, &stats);
+	printf("    %ux%u, one thread: %.1f MP/s (read %.1f ms, build %.1f ms, write %.1f ms), %.2f MB peak\n", SIZE, SIZE, stats.GetMegasamplesPerSecond(), stats.readTimeInMilliseconds, stats.buildTimeInMilliseconds, stats.writeTimeInMilliseconds, stats.peakMemoryInBytes / (1024.0 * 1024.0));
+
+	JobSystem::Initialize();
+	JobCounter counter;
+	JobSystem::Run(counter, [&]() { ImportRaw(rawPath, SIZE, SIZE, desc, tilePath, &stats); });
+	JobSystem::Wait(counter);
+	printf("    %ux%u, %u threads: %.1f MP/s (read %.1f ms, build %.1f ms, write %.1f ms), %.2f MB peak\n", SIZE, SIZE, JobSystem::GetNumThreads(), stats.GetMegasamplesPerSecond(), stats.readTimeInMilliseconds, stats.buildTimeInMilliseconds, stats.writeTimeInMilliseconds, stats.peakMemoryInBytes / (1024.0 * 1024.0));
+	JobSystem::Shutdown();
+
+	// What a streamer generator thread pays per tile, read from the file against generated from noise
+	TerrainTileFile tileFile;
+	if (tileFile.Open(tilePath.c_str()))
+	{
+		const TerrainTileFileHeader& header = tileFile.GetHeader();
+		const uint32_t numTiles = header.numTilesX * header.numTilesY;
+		std::vector<uint16_t> tileHeights((TILE_SIZE + 1) * (TILE_SIZE + 1));
+
+		const double fileTime = MeasureMilliseconds([&]()
+		{
+			for (uint32_t tileIndex = 0; tileIndex < numTiles; tileIndex++)
+			{
+				tileFile.CopyTileHeights(TerrainTileCoord{ static_cast<int32_t>(tileIndex % header.numTilesX), static_cast<int32_t>(tileIndex / header.numTilesX) }, tileHeights.data());
+			}
+		});
+
+		HeightfieldNoiseMaterialConstants constants;
+		const double noiseTime = MeasureMilliseconds([&]()
+		{
+			for (uint32_t tileIndex = 0; tileIndex < numTiles; tileIndex++)
+			{
+				GenerateTerrainTileHeights(TerrainTileCoord{ static_cast<int32_t>(tileIndex % header.numTilesX), static_cast<int32_t>(tileIndex / header.numTilesX) }, constants, TILE_SIZE, tileHeights.data());
+			}
+		});
+
+		printf("    %u tile from the file: %.4f ms per tile, from noise: %.4f ms per tile\n", TILE_SIZE, fileTime / numTiles, noiseTime / numTiles);
+		tileFile.Close();
+	}
+
+	std::filesystem::remove(rawPath);
+	std::filesystem::remove(tilePath);
+}
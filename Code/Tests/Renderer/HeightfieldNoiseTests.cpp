@@ -0,0 +1,169 @@
+#include "TestFramework.h"
+
+#include <Core/JobSystem.h>
+#include <Renderer/HeightfieldNoise.h>
+
+#include <cstring>
+#include <random>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	constexpr NoiseInstructionSet INSTRUCTION_SETS[] = { NoiseInstructionSet::scalar, NoiseInstructionSet::sse2, NoiseInstructionSet::avx2 };
+
+	bool IsBitIdentical(float a, float b)
+	{
+		uint32_t aBits;
+		uint32_t bBits;
+		memcpy(&aBits, &a, sizeof(a));
+		memcpy(&bBits, &b, sizeof(b));
+		return aBits == bBits;
+	}
+
+	HeightfieldNoiseMaterialConstants GetRandomConstants(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> frequency(0.0005f, 0.2f);
+		std::uniform_real_distribution<float> lacunarity(1.5f, 3.0f);
+		std::uniform_real_distribution<float> gain(0.2f, 0.8f);
+
+		HeightfieldNoiseMaterialConstants constants;
+		constants.seed = static_cast<int32_t>(random());
+		constants.frequency = frequency(random);
+		constants.octaves = static_cast<int32_t>(random() % 9);
+		constants.lacunarity = lacunarity(random);
+		constants.gain = gain(random);
+		return constants;
+	}
+}
+
+STYX_TEST(HeightfieldNoise_InstructionSetsAreBitIdentical)
+{
+	printf("    %s detected\n", GetNoiseInstructionSetName(GetNoiseInstructionSet()));
+
+	std::mt19937 random(42);
+	std::vector<float> output;
+	uint32_t numMismatches = 0;
+
+	for (uint32_t round = 0; round < 40; round++)
+	{
+		const HeightfieldNoiseMaterialConstants constants = GetRandomConstants(random);
+
+		// Widths around the vector widths exercise the vectorised body and the scalar remainder of a row
+		const uint32_t width = 1 + random() % 67;
+		const uint32_t height = 1 + random() % 5;
+		const uint32_t rowPitch = width + random() % 3;
+		const int32_t originX = static_cast<int32_t>(random() % 20000) - 10000;
+		const int32_t originY = static_cast<int32_t>(random() % 20000) - 10000;
+
+		for (NoiseInstructionSet instructionSet : INSTRUCTION_SETS)
+		{
+			output.assign(static_cast<size_t>(rowPitch) * height, -1.0f);
+			GenerateHeightfieldNoise(constants, originX, originY, width, height, output.data(), rowPitch, instructionSet);
+
+			for (uint32_t y = 0; y < height; y++)
+			{
+				for (uint32_t x = 0; x < rowPitch; x++)
+				{
+					const float value = output[static_cast<size_t>(y) * rowPitch + x];
+
+					// The padding past the end of a row is left alone
+					const float expected = x < width ? SampleHeightfieldNoise(constants, static_cast<float>(originX + static_cast<int32_t>(x)), static_cast<float>(originY + static_cast<int32_t>(y))) : -1.0f;
+					numMismatches += IsBitIdentical(value, expected) ? 0 : 1;
+				}
+			}
+		}
+	}
+
+	STYX_CHECK(numMismatches == 0);
+}
+
+STYX_TEST(HeightfieldNoise_HeightsStayInRange)
+{
+	HeightfieldNoiseMaterialConstants constants;
+	constants.octaves = 6;
+	constants.gain = 0.7f;
+
+	std::vector<float> output(256 * 256);
+	GenerateHeightfieldNoise(constants, -128, -128, 256, 256, output.data(), 256);
+
+	float minHeight = 1.0f;
+	float maxHeight = 0.0f;
+	for (float value : output)
+	{
+		minHeight = (std::min)(minHeight, value);
+		maxHeight = (std::max)(maxHeight, value);
+	}
+
+	STYX_CHECK(minHeight >= 0.0f && maxHeight <= 1.0f);
+
+	// Not flat either
+	STYX_CHECK(maxHeight - minHeight > 0.1f);
+
+	// No octaves: the sum is zero, remapped to the middle of the range
+	constants.octaves = 0;
+	GenerateHeightfieldNoise(constants, 0, 0, 16, 1, output.data(), 16);
+	STYX_CHECK(output[0] == 0.5f && output[15] == 0.5f);
+}
+
+// Rows spread over the job system land exactly where the serial loop puts them
+STYX_TEST(HeightfieldNoise_JobsMatchTheSerialResult)
+{
+	HeightfieldNoiseMaterialConstants constants;
+	constants.seed = 1234;
+	constants.octaves = 5;
+
+	constexpr uint32_t SIZE = 300;
+	std::vector<float> serial(SIZE * SIZE);
+	GenerateHeightfieldNoise(constants, 77, -301, SIZE, SIZE, serial.data(), SIZE);
+
+	JobSystemDesc desc;
+	desc.numWorkers = 3;
+	JobSystem::Initialize(desc);
+
+	std::vector<float> parallel(SIZE * SIZE);
+	GenerateHeightfieldNoise(constants, 77, -301, SIZE, SIZE, parallel.data(), SIZE);
+
+	JobSystem::Shutdown();
+
+	STYX_CHECK(memcmp(serial.data(), parallel.data(), serial.size() * sizeof(float)) == 0);
+}
+
+STYX_BENCHMARK(HeightfieldNoise_TexelsPerSecond)
+{
+	constexpr uint32_t SIZE = 1024;
+
+	HeightfieldNoiseMaterialConstants constants;
+	constants.octaves = 6;
+
+	std::vector<float> output(SIZE * SIZE);
+
+	const auto measure = [&](NoiseInstructionSet instructionSet)
+	{
+		double bestTime = 1e9;
+		for (uint32_t iteration = 0; iteration < 3; iteration++)
+		{
+			bestTime = (std::min)(bestTime, MeasureMilliseconds([&]() { GenerateHeightfieldNoise(constants, 0, 0, SIZE, SIZE, output.data(), SIZE, instructionSet); }));
+		}
+
+		return bestTime;
+	};
+
+	// The wider paths fall back to the widest the CPU has
+	for (NoiseInstructionSet instructionSet : INSTRUCTION_SETS)
+	{
+		if (static_cast<uint32_t>(instructionSet) > static_cast<uint32_t>(GetNoiseInstructionSet()))
+		{
+			continue;
+		}
+
+		const double time = measure(instructionSet);
+		printf("    %-6s %u octaves, one thread: %.1f M texels/s\n", GetNoiseInstructionSetName(instructionSet), constants.octaves, SIZE * SIZE / time / 1000.0);
+	}
+
+	JobSystem::Initialize();
+	const double jobTime = measure(GetNoiseInstructionSet());
+	printf("    %-6s %u octaves, %u threads: %.1f M texels/s\n", GetNoiseInstructionSetName(GetNoiseInstructionSet()), constants.octaves, JobSystem::GetNumThreads(), SIZE * SIZE / jobTime / 1000.0);
+	JobSystem::Shutdown();
+}
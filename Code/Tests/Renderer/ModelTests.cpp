@@ -0,0 +1,253 @@
+#include "TestFramework.h"
+
+#include <RHI/D3D12Lite.h>
+#include <Renderer/Model.h>
+
+#include <filesystem>
+#include <string>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	struct PassConstants
+	{
+		DirectX::XMFLOAT4X4 viewMatrix;
+		DirectX::XMFLOAT4X4 projectionMatrix;
+	};
+
+	// A grid of separate cube objects, one model and one draw each once Assimp has loaded it
+	std::string WriteCubeGrid(uint32_t gridSize)
+	{
+		const std::filesystem::path path = std::filesystem::temp_directory_path() / ("StyxCubeGrid" + std::to_string(gridSize) + ".obj");
+
+		FILE* file = nullptr;
+		fopen_s(&file, path.string().c_str(), "w");
+		if (!file)
+		{
+			return {};
+		}
+
+		uint32_t firstVertex = 1;
+		for (uint32_t z = 0; z < gridSize; z++)
+		{
+			for (uint32_t x = 0; x < gridSize; x++)
+			{
+				fprintf(file, "o Cube_%u_%u\n", x, z);
+				for (uint32_t corner = 0; corner < 8; corner++)
+				{
+					fprintf(file, "v %f %f %f\n", x * 3.0f + (corner & 1), static_cast<float>((corner >> 1) & 1), z * 3.0f + ((corner >> 2) & 1));
+				}
+
+				const uint32_t faces[6][4] = { { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 } };
+				for (const uint32_t* face : faces)
+				{
+					fprintf(file, "f %u %u %u %u\n", firstVertex + face[0], firstVertex + face[1], firstVertex + face[2], firstVertex + face[3]);
+				}
+
+				firstVertex += 8;
+			}
+		}
+
+		fclose(file);
+		return path.string();
+	}
+
+	Model* FindModelWithMeshes(Model* model)
+	{
+		if (!model->meshes.empty())
+		{
+			return model;
+		}
+
+		for (Model* child : model->m_Children)
+		{
+			if (Model* found = FindModelWithMeshes(child))
+			{
+				return found;
+			}
+		}
+
+		return nullptr;
+	}
+
+	// Headless device on the null backend: the scene does all of its CPU work, nothing reaches a GPU
+	class SceneHarness
+	{
+	public:
+		SceneHarness(uint32_t gridSize)
+		{
+			m_Device = std::make_unique<D3D12Lite::Device>(nullptr, D3D12Lite::Uint2{ 1280, 720 }, D3D12Lite::CommandBackend::null);
+			m_Context = m_Device->CreateGraphicsContext();
+
+			D3D12Lite::ShaderCreationDesc vsDesc{};
+			vsDesc.mShaderName = L"MeshPreview.hlsl";
+			vsDesc.mEntryPoint = L"VertexShader";
+			vsDesc.mType = D3D12Lite::ShaderType::vertex;
+
+			D3D12Lite::ShaderCreationDesc psDesc{};
+			psDesc.mShaderName = L"MeshPreview.hlsl";
+			psDesc.mEntryPoint = L"PixelShader";
+			psDesc.mType = D3D12Lite::ShaderType::pixel;
+
+			m_VertexShader = m_Device->CreateShader(vsDesc);
+			m_PixelShader = m_Device->CreateShader(psDesc);
+
+			D3D12Lite::GraphicsPipelineDesc psoDesc = D3D12Lite::GetDefaultGraphicsPipelineDesc();
+			psoDesc.mVertexShader = m_VertexShader.get();
+			psoDesc.mPixelShader = m_PixelShader.get();
+			psoDesc.mRenderTargetDesc.mNumRenderTargets = 1;
+			psoDesc.mRenderTargetDesc.mRenderTargetFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+
+			m_PerPassResourceSpace.SetDynamicCBV();
+			m_PerPassResourceSpace.Lock();
+
+			// Draw ID, draw data buffer index and transform buffer index
+			D3D12Lite::PipelineResourceLayout resourceLayout;
+			resourceLayout.mSpaces[D3D12Lite::PER_PASS_SPACE] = &m_PerPassResourceSpace;
+			resourceLayout.mNum32BitConstants = 3;
+
+			m_Pipeline = m_Device->CreateGraphicsPipeline(psoDesc, resourceLayout);
+
+			m_Scene = std::make_unique<Scene>(m_Device.get());
+			m_Scene->Initialize(WriteCubeGrid(gridSize).c_str());
+
+			m_Projection = DirectX::XMMatrixPerspectiveFovLH(DirectX::XMConvertToRadians(45.0f), 1280.0f / 720.0f, 0.01f, 1000.0f);
+		}
+
+		~SceneHarness()
+		{
+			m_Device->WaitForIdle();
+			m_Scene->Shutdown();
+			m_Device->DestroyPipelineStateObject(std::move(m_Pipeline));
+			m_Device->DestroyShader(std::move(m_VertexShader));
+			m_Device->DestroyShader(std::move(m_PixelShader));
+			m_Device->DestroyContext(std::move(m_Context));
+		}
+
+		void RenderFrame(const DirectX::XMVECTOR& cameraPosition)
+		{
+			const DirectX::XMMATRIX view = DirectX::XMMatrixLookAtLH(cameraPosition, DirectX::XMVectorAdd(cameraPosition, DirectX::XMVectorSet(0.0f, -1.0f, 0.6f, 0.0f)), DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+			m_Device->BeginFrame();
+			D3D12Lite::TextureResource& backBuffer = m_Device->GetCurrentBackBuffer();
+
+			PassConstants passConstants;
+			DirectX::XMStoreFloat4x4(&passConstants.viewMatrix, view);
+			DirectX::XMStoreFloat4x4(&passConstants.projectionMatrix, m_Projection);
+
+			D3D12Lite::PipelineInfo pipeline;
+			pipeline.mPipeline = m_Pipeline.get();
+			pipeline.mRenderTargets.push_back(&backBuffer);
+
+			m_Context->Reset();
+			m_Context->AddBarrier(backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+			m_Context->FlushBarriers();
+			m_Context->SetPipeline(pipeline);
+			m_Context->SetPipelineConstants(D3D12Lite::PER_PASS_SPACE, m_Device->AllocateConstants(passConstants));
+			m_Context->SetDefaultViewPortAndScissor(m_Device->GetScreenSize());
+
+			m_Scene->SetViewProjection(DirectX::XMMatrixMultiply(view, m_Projection));
+			m_Scene->Render(m_Context.get(), m_Pipeline.get());
+
+			m_Context->AddBarrier(backBuffer, D3D12_RESOURCE_STATE_PRESENT);
+			m_Context->FlushBarriers();
+
+			m_Device->SubmitContextWork(*m_Context);
+			m_Device->EndFrame();
+			m_Device->Present();
+		}
+
+		Scene& GetScene() { return *m_Scene; }
+
+	private:
+		std::unique_ptr<D3D12Lite::Device> m_Device;
+		std::unique_ptr<D3D12Lite::GraphicsContext> m_Context;
+		std::unique_ptr<D3D12Lite::Shader> m_VertexShader;
+		std::unique_ptr<D3D12Lite::Shader> m_PixelShader;
+		std::unique_ptr<D3D12Lite::PipelineStateObject> m_Pipeline;
+		D3D12Lite::PipelineResourceSpace m_PerPassResourceSpace;
+		std::unique_ptr<Scene> m_Scene;
+		DirectX::XMMATRIX m_Projection;
+	};
+}
+
+STYX_TEST(Scene_StaticFramesReuseTheirCommands)
+{
+	SceneHarness harness(8);
+	STYX_REQUIRE(harness.GetScene().m_Root != nullptr);
+
+	// Looks down on the whole grid
+	const DirectX::XMVECTOR cameraPosition = DirectX::XMVectorSet(12.0f, 60.0f, -20.0f, 0.0f);
+
+	// Every frame in flight records its commands once
+	for (uint32_t frame = 0; frame < D3D12Lite::NUM_FRAMES_IN_FLIGHT; frame++)
+	{
+		harness.RenderFrame(cameraPosition);
+		STYX_CHECK(!harness.GetScene().GetDrawDataStats().reusedCommands);
+	}
+
+	for (uint32_t frame = 0; frame < 2 * D3D12Lite::NUM_FRAMES_IN_FLIGHT; frame++)
+	{
+		harness.RenderFrame(cameraPosition);
+		STYX_CHECK(harness.GetScene().GetDrawDataStats().reusedCommands);
+		STYX_CHECK(harness.GetScene().GetDrawDataStats().numVisibleDraws > 0);
+	}
+
+	// A view that keeps the same draws in sight keeps the recorded commands
+	const DirectX::XMVECTOR nudgedPosition = DirectX::XMVectorAdd(cameraPosition, DirectX::XMVectorSet(0.01f, 0.0f, 0.0f, 0.0f));
+	harness.RenderFrame(nudgedPosition);
+	STYX_CHECK(harness.GetScene().GetDrawDataStats().reusedCommands);
+
+	// One that sees fewer of them records again
+	const uint32_t numVisibleDraws = harness.GetScene().GetDrawDataStats().numVisibleDraws;
+	harness.RenderFrame(DirectX::XMVectorAdd(cameraPosition, DirectX::XMVectorSet(-80.0f, 0.0f, 0.0f, 0.0f)));
+	STYX_CHECK(!harness.GetScene().GetDrawDataStats().reusedCommands);
+	STYX_CHECK(harness.GetScene().GetDrawDataStats().numVisibleDraws < numVisibleDraws);
+
+	// So can a transform: move a cube out of view
+	Model* model = FindModelWithMeshes(harness.GetScene().m_Root);
+	STYX_REQUIRE(model != nullptr);
+
+	for (uint32_t frame = 0; frame < D3D12Lite::NUM_FRAMES_IN_FLIGHT; frame++)
+	{
+		harness.RenderFrame(cameraPosition);
+	}
+
+	Transform transform = model->transforms[0];
+	transform.worldMatrix._42 -= 10000.0f;
+	model->SetTransform(0, transform);
+
+	harness.RenderFrame(cameraPosition);
+	STYX_CHECK(!harness.GetScene().GetDrawDataStats().reusedCommands);
+	STYX_CHECK(harness.GetScene().GetDrawDataStats().numVisibleDraws == numVisibleDraws - 1);
+}
+
+STYX_BENCHMARK(Scene_CachedFrameTime)
+{
+	constexpr uint32_t NUM_FRAMES = 300;
+
+	SceneHarness harness(64);
+	const DirectX::XMVECTOR cameraPosition = DirectX::XMVectorSet(96.0f, 40.0f, -40.0f, 0.0f);
+
+	auto measure = [&](const char* label, auto&& updateFrame)
+	{
+		double prepareTime = 0.0;
+		const double frameTime = MeasureMilliseconds([&]()
+		{
+			for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+			{
+				harness.RenderFrame(updateFrame(frame));
+				prepareTime += harness.GetScene().GetDrawDataStats().prepareTimeInMilliseconds;
+			}
+		});
+
+		const DrawDataStats& stats = harness.GetScene().GetDrawDataStats();
+		printf("    %-16s %.3f ms per frame, %.3f ms in Scene::PrepareDraws (%u of %u draws visible)\n", label, frameTime / NUM_FRAMES,
+			prepareTime / NUM_FRAMES, stats.numVisibleDraws, stats.numDraws);
+	};
+
+	measure("static camera", [&](uint32_t) { return cameraPosition; });
+	measure("moving camera", [&](uint32_t frame) { return DirectX::XMVectorAdd(cameraPosition, DirectX::XMVectorSet(0.05f * frame, 0.0f, 0.0f, 0.0f)); });
+}
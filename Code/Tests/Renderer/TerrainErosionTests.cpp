@@ -0,0 +1,264 @@
+#include "TestFramework.h"
+
+#include <Core/JobSystem.h>
+#include <Renderer/TerrainErosion.h>
+#include <Renderer/TerrainTileStreamer.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	constexpr float HEIGHT_SCALE = 40.0f;
+
+	std::vector<float> GenerateHeights(int32_t originX, int32_t originY, uint32_t width, uint32_t height)
+	{
+		HeightfieldNoiseMaterialConstants constants;
+		constants.frequency = 0.03f;
+
+		std::vector<float> heights(static_cast<size_t>(width) * height);
+		GenerateHeightfieldNoise(constants, originX, originY, width, height, heights.data(), width);
+
+		for (float& sample : heights)
+		{
+			sample *= HEIGHT_SCALE;
+		}
+
+		return heights;
+	}
+
+	std::vector<float> Erode(const TerrainErosionDesc& desc, const std::vector<float>& heights, uint32_t width, uint32_t height, uint32_t numIterations)
+	{
+		TerrainErosion erosion(desc);
+		erosion.Reset(heights.data(), width, height, width);
+		while (erosion.GetNumIterations() < numIterations)
+		{
+			erosion.Run(numIterations - erosion.GetNumIterations(), 0.0);
+		}
+
+		std::vector<float> eroded(heights.size());
+		erosion.ReadHeights(eroded.data(), width);
+		return eroded;
+	}
+
+	uint32_t CountDifferences(const std::vector<float>& a, const std::vector<float>& b)
+	{
+		uint32_t numDifferences = 0;
+		for (size_t index = 0; index < a.size(); index++)
+		{
+			numDifferences += a[index] == b[index] ? 0 : 1;
+		}
+
+		return numDifferences;
+	}
+}
+
+STYX_TEST(TerrainErosion_SameResultWhateverTheBlocksThreadsAndRuns)
+{
+	constexpr uint32_t WIDTH = 150;
+	constexpr uint32_t HEIGHT = 90;
+	constexpr uint32_t NUM_ITERATIONS = 20;
+
+	const std::vector<float> heights = GenerateHeights(0, 0, WIDTH, HEIGHT);
+
+	// One iteration per Run, the budget is spent as soon as one ran
+	TerrainErosionDesc desc;
+	const std::vector<float> reference = Erode(desc, heights, WIDTH, HEIGHT, NUM_ITERATIONS);
+	STYX_CHECK(CountDifferences(reference, heights) > WIDTH * HEIGHT / 2);
+
+	for (uint32_t blockSize : { 7u, 32u, 256u })
+	{
+		desc.blockSize = blockSize;
+
+		TerrainErosion erosion(desc);
+		erosion.Reset(heights.data(), WIDTH, HEIGHT, WIDTH);
+		STYX_CHECK(erosion.Run(NUM_ITERATIONS) == NUM_ITERATIONS);
+
+		std::vector<float> eroded(heights.size());
+		erosion.ReadHeights(eroded.data(), WIDTH);
+		STYX_CHECK(CountDifferences(eroded, reference) == 0);
+	}
+
+	// Blocks spread over the job system when run from a job
+	JobSystemDesc jobSystemDesc;
+	jobSystemDesc.numWorkers = 3;
+	JobSystem::Initialize(jobSystemDesc);
+
+	desc.blockSize = 16;
+	std::vector<float> jobEroded;
+	JobCounter counter;
+	JobSystem::Run(counter, [&]() { jobEroded = Erode(desc, heights, WIDTH, HEIGHT, NUM_ITERATIONS); });
+	JobSystem::Wait(counter);
+	JobSystem::Shutdown();
+
+	STYX_CHECK(CountDifferences(jobEroded, reference) == 0);
+}
+
+STYX_TEST(TerrainErosion_ThermalErosionConservesMaterial)
+{
+	constexpr uint32_t SIZE = 64;
+
+	// A single spike, far steeper than the talus slope
+	std::vector<float> heights(SIZE * SIZE, 1.0f);
+	heights[(SIZE / 2) * SIZE + SIZE / 2] = 30.0f;
+	// Against the wall, nothing may slide off the heightfield
+	heights[SIZE / 2] = 30.0f;
+
+	TerrainErosionDesc desc;
+	desc.hasHydraulicErosion = false;
+	desc.blockSize = 16;
+	const std::vector<float> eroded = Erode(desc, heights, SIZE, SIZE, 200);
+
+	double total = 0.0;
+	double erodedTotal = 0.0;
+	float maxSlope = 0.0f;
+	for (uint32_t y = 0; y < SIZE; y++)
+	{
+		for (uint32_t x = 0; x < SIZE; x++)
+		{
+			total += heights[y * SIZE + x];
+			erodedTotal += eroded[y * SIZE + x];
+			if (x + 1 < SIZE)
+			{
+				maxSlope = fmaxf(maxSlope, fabsf(eroded[y * SIZE + x + 1] - eroded[y * SIZE + x]));
+			}
+		}
+	}
+
+	STYX_CHECK(fabs(erodedTotal - total) <= 1e-5 * total);
+	// The spikes slumped to little more than the talus slope
+	STYX_CHECK(eroded[(SIZE / 2) * SIZE + SIZE / 2] < 10.0f);
+	STYX_CHECK(maxSlope < 2.0f * desc.talusSlope);
+}
+
+STYX_TEST(TerrainErosion_ErodedTilesMatchTheTerrainErodedInOnePiece)
+{
+	constexpr uint32_t TILE_SIZE = 32;
+	constexpr uint32_t NUM_TILES = 3;
+	constexpr uint32_t NUM_SAMPLES = TILE_SIZE + 1;
+
+	HeightfieldNoiseMaterialConstants constants;
+	constants.frequency = 0.03f;
+
+	for (bool hasHydraulicErosion : { true, false })
+	{
+		TerrainTileErosionDesc desc;
+		desc.erosion.hasHydraulicErosion = hasHydraulicErosion;
+		desc.erosion.blockSize = 24;
+		desc.numIterations = 12;
+		desc.heightScale = HEIGHT_SCALE;
+
+		// Tiles (-1, -1) to (1, 1), with as much terrain around them as any tile gets, all eroded at once
+		const uint32_t halo = TerrainErosion::GetReach(desc.erosion, desc.numIterations);
+		const uint32_t size = NUM_TILES * TILE_SIZE + 1 + 2 * halo;
+		const int32_t origin = -static_cast<int32_t>(TILE_SIZE + halo);
+
+		std::vector<float> terrain(static_cast<size_t>(size) * size);
+		GenerateHeightfieldNoise(constants, origin, origin, size, size, terrain.data(), size);
+		for (float& sample : terrain)
+		{
+			sample *= HEIGHT_SCALE;
+		}
+
+		TerrainErosion erosion(desc.erosion);
+		erosion.Reset(terrain.data(), size, size, size, origin, origin);
+		erosion.Run(desc.numIterations);
+		erosion.ReadHeights(terrain.data(), size);
+
+		// Tiles share their edges, so this also checks neighbours agree on them. Heights are quantized like the generator does.
+		const float inverseHeightScale = 1.0f / HEIGHT_SCALE;
+		uint32_t numDifferences = 0;
+		uint32_t numChanged = 0;
+		std::vector<uint16_t> tileHeights(NUM_SAMPLES * NUM_SAMPLES);
+		std::vector<uint16_t> noiseHeights(NUM_SAMPLES * NUM_SAMPLES);
+
+		for (int32_t tileY = -1; tileY <= 1; tileY++)
+		{
+			for (int32_t tileX = -1; tileX <= 1; tileX++)
+			{
+				const TerrainTileCoord coord{ tileX, tileY };
+				GenerateErodedTerrainTileHeights(desc, coord, constants, TILE_SIZE, tileHeights.data());
+				GenerateTerrainTileHeights(coord, constants, TILE_SIZE, noiseHeights.data());
+
+				for (uint32_t sampleY = 0; sampleY < NUM_SAMPLES; sampleY++)
+				{
+					for (uint32_t sampleX = 0; sampleX < NUM_SAMPLES; sampleX++)
+					{
+						const uint32_t terrainX = (tileX + 1) * TILE_SIZE + sampleX + halo;
+						const uint32_t terrainY = (tileY + 1) * TILE_SIZE + sampleY + halo;
+						const float height = fminf(fmaxf(terrain[terrainY * size + terrainX] * inverseHeightScale, 0.0f), 1.0f);
+						const uint16_t expected = static_cast<uint16_t>(height * 65535.0f + 0.5f);
+
+						numDifferences += tileHeights[sampleY * NUM_SAMPLES + sampleX] == expected ? 0 : 1;
+						numChanged += tileHeights[sampleY * NUM_SAMPLES + sampleX] == noiseHeights[sampleY * NUM_SAMPLES + sampleX] ? 0 : 1;
+					}
+				}
+			}
+		}
+
+		STYX_CHECK(numDifferences == 0);
+		STYX_CHECK(numChanged > NUM_TILES * NUM_TILES * NUM_SAMPLES * NUM_SAMPLES / 4);
+	}
+}
+
+STYX_BENCHMARK(TerrainErosion_CellsPerSecond)
+{
+	constexpr uint32_t SIZE = 512;
+	constexpr uint32_t NUM_ITERATIONS = 20;
+
+	const std::vector<float> heights = GenerateHeights(0, 0, SIZE, SIZE);
+
+	for (bool hasHydraulicErosion : { true, false })
+	{
+		TerrainErosionDesc desc;
+		desc.hasHydraulicErosion = hasHydraulicErosion;
+
+		TerrainErosion erosion(desc);
+		erosion.Reset(heights.data(), SIZE, SIZE, SIZE);
+		erosion.Run(NUM_ITERATIONS);
+		printf("    %s, %ux%u, one thread: %.1f M cells/s\n", hasHydraulicErosion ? "hydraulic and thermal" : "thermal only", SIZE, SIZE, erosion.GetStats().GetCellsPerSecond() / 1e6);
+
+		JobSystem::Initialize();
+		erosion.Reset(heights.data(), SIZE, SIZE, SIZE);
+		erosion.ResetStats();
+		JobCounter counter;
+		JobSystem::Run(counter, [&erosion]() { erosion.Run(NUM_ITERATIONS); });
+		JobSystem::Wait(counter);
+		printf("    %s, %ux%u, %u threads: %.1f M cells/s\n", hasHydraulicErosion ? "hydraulic and thermal" : "thermal only", SIZE, SIZE, JobSystem::GetNumThreads(), erosion.GetStats().GetCellsPerSecond() / 1e6);
+		JobSystem::Shutdown();
+	}
+
+	// What a streamer generator thread pays per tile, the halo grows with the iterations
+	constexpr uint32_t TILE_SIZE = 64;
+	constexpr uint32_t NUM_TILES = 8;
+	HeightfieldNoiseMaterialConstants constants;
+	std::vector<uint16_t> tileHeights((TILE_SIZE + 1) * (TILE_SIZE + 1));
+
+	const double noiseTime = MeasureMilliseconds([&]()
+	{
+		for (int32_t tileIndex = 0; tileIndex < static_cast<int32_t>(NUM_TILES); tileIndex++)
+		{
+			GenerateTerrainTileHeights(TerrainTileCoord{ tileIndex, 0 }, constants, TILE_SIZE, tileHeights.data());
+		}
+	});
+	printf("    %u tile, noise only: %.2f ms per tile\n", TILE_SIZE, noiseTime / NUM_TILES);
+
+	for (uint32_t numIterations : { 4u, 16u, 32u })
+	{
+		TerrainTileErosionDesc desc;
+		desc.numIterations = numIterations;
+		desc.heightScale = 5.0f;
+
+		const double erosionTime = MeasureMilliseconds([&]()
+		{
+			for (int32_t tileIndex = 0; tileIndex < static_cast<int32_t>(NUM_TILES); tileIndex++)
+			{
+				GenerateErodedTerrainTileHeights(desc, TerrainTileCoord{ tileIndex, 0 }, constants, TILE_SIZE, tileHeights.data());
+			}
+		});
+		printf("    %u tile, %2u iterations, %3u cells of halo: %.2f ms per tile\n", TILE_SIZE, numIterations, TerrainErosion::GetReach(desc.erosion, numIterations), erosionTime / NUM_TILES);
+	}
+}
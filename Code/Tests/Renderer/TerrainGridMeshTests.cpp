@@ -0,0 +1,300 @@
+#include "TestFramework.h"
+
+#include <Renderer/TerrainGridMesh.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <filesystem>
+#include <map>
+#include <string>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	struct Vector3
+	{
+		float x;
+		float y;
+		float z;
+	};
+
+	Vector3 GetPosition(const TerrainGridMeshData& data, uint32_t vertex)
+	{
+		return { data.positions[3 * vertex + 0], data.positions[3 * vertex + 1], data.positions[3 * vertex + 2] };
+	}
+
+	Vector3 GetFaceNormal(const TerrainGridMeshData& data, uint32_t firstIndex)
+	{
+		const Vector3 a = GetPosition(data, data.indices[firstIndex + 0]);
+		const Vector3 b = GetPosition(data, data.indices[firstIndex + 1]);
+		const Vector3 c = GetPosition(data, data.indices[firstIndex + 2]);
+		const Vector3 ab = { b.x - a.x, b.y - a.y, b.z - a.z };
+		const Vector3 ac = { c.x - a.x, c.y - a.y, c.z - a.z };
+		return { ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x };
+	}
+
+	// Two triangles per quad, row after row, the way a plane exported from a DCC tool usually comes
+	std::vector<uint16_t> GenerateRowMajorIndices(uint32_t resolution)
+	{
+		std::vector<uint16_t> indices;
+		for (uint32_t z = 0; z < resolution; z++)
+		{
+			for (uint32_t x = 0; x < resolution; x++)
+			{
+				const uint16_t v00 = static_cast<uint16_t>(z * (resolution + 1) + x);
+				const uint16_t v01 = static_cast<uint16_t>(v00 + resolution + 1);
+				indices.insert(indices.end(), { v00, v01, static_cast<uint16_t>(v00 + 1), static_cast<uint16_t>(v00 + 1), v01, static_cast<uint16_t>(v01 + 1) });
+			}
+		}
+
+		return indices;
+	}
+
+	// The same grid as an OBJ file, for what loading it through Assimp used to cost
+	std::string WriteGridObj(uint32_t resolution)
+	{
+		const std::filesystem::path path = std::filesystem::temp_directory_path() / ("StyxTerrainGrid" + std::to_string(resolution) + ".obj");
+
+		FILE* file = nullptr;
+		fopen_s(&file, path.string().c_str(), "w");
+		if (!file)
+		{
+			return {};
+		}
+
+		for (uint32_t z = 0; z <= resolution; z++)
+		{
+			for (uint32_t x = 0; x <= resolution; x++)
+			{
+				fprintf(file, "v %f 0 %f\nvt %f %f\n", x / static_cast<float>(resolution), z / static_cast<float>(resolution), x / static_cast<float>(resolution), z / static_cast<float>(resolution));
+			}
+		}
+
+		for (uint32_t z = 0; z < resolution; z++)
+		{
+			for (uint32_t x = 0; x < resolution; x++)
+			{
+				const uint32_t v00 = z * (resolution + 1) + x + 1;
+				const uint32_t v01 = v00 + resolution + 1;
+				fprintf(file, "f %u/%u %u/%u %u/%u %u/%u\n", v00, v00, v01, v01, v01 + 1, v01 + 1, v00 + 1, v00 + 1);
+			}
+		}
+
+		fclose(file);
+		return path.string();
+	}
+}
+
+STYX_TEST(TerrainGridMesh_TopologyIsWatertight)
+{
+	for (uint32_t resolution : { 1u, 2u, 3u, 7u, 16u, 31u, 64u, 200u })
+	{
+		for (bool hasSkirts : { false, true })
+		{
+			TerrainGridMeshDesc desc;
+			desc.resolution = resolution;
+			desc.hasSkirts = hasSkirts;
+
+			TerrainGridMeshData data;
+			GenerateTerrainGridMesh(desc, data);
+
+			const uint32_t numGridVertices = (resolution + 1) * (resolution + 1);
+			STYX_REQUIRE(data.GetNumVertices() == numGridVertices + (hasSkirts ? 4 * resolution : 0));
+			STYX_REQUIRE(data.GetNumIndices() == 6 * resolution * resolution + (hasSkirts ? 24 * resolution : 0));
+			STYX_CHECK(data.numGridIndices == 6 * resolution * resolution);
+			STYX_CHECK(data.uvs.size() == 2 * data.GetNumVertices());
+
+			// Numbered in order of first use, so every vertex is used
+			uint32_t nextNewVertex = 0;
+			for (uint16_t index : data.indices)
+			{
+				STYX_CHECK(index <= nextNewVertex);
+				nextNewVertex = index == nextNewVertex ? nextNewVertex + 1 : nextNewVertex;
+			}
+
+			STYX_CHECK(nextNewVertex == data.GetNumVertices());
+
+			uint32_t numWrongVertices = 0;
+			for (uint32_t vertex = 0; vertex < data.GetNumVertices(); vertex++)
+			{
+				const Vector3 position = GetPosition(data, vertex);
+				numWrongVertices += data.uvs[2 * vertex] != position.x || data.uvs[2 * vertex + 1] != position.z ? 1 : 0;
+				numWrongVertices += position.x < 0.0f || position.x > 1.0f || position.z < 0.0f || position.z > 1.0f ? 1 : 0;
+			}
+
+			STYX_CHECK(numWrongVertices == 0);
+
+			// Clockwise seen from +Y on the grid, facing away from the centre on the skirts
+			uint32_t numWrongTriangles = 0;
+			for (uint32_t firstIndex = 0; firstIndex < data.GetNumIndices(); firstIndex += 3)
+			{
+				const Vector3 normal = GetFaceNormal(data, firstIndex);
+				if (firstIndex < data.numGridIndices)
+				{
+					numWrongTriangles += normal.y > 0.0f && normal.x == 0.0f && normal.z == 0.0f ? 0 : 1;
+				}
+				else
+				{
+					const Vector3 position = GetPosition(data, data.indices[firstIndex]);
+					const float outwards = normal.x * (position.x - 0.5f) + normal.z * (position.z - 0.5f);
+					numWrongTriangles += outwards > 0.0f && normal.y == 0.0f ? 0 : 1;
+				}
+			}
+
+			STYX_CHECK(numWrongTriangles == 0);
+
+			// Every directed edge is used once. The edges left open are the border of the grid, or with skirts the
+			// bottom loop of the skirts.
+			std::map<std::pair<uint16_t, uint16_t>, uint32_t> edges;
+			for (uint32_t firstIndex = 0; firstIndex < data.GetNumIndices(); firstIndex += 3)
+			{
+				for (uint32_t corner = 0; corner < 3; corner++)
+				{
+					edges[{ data.indices[firstIndex + corner], data.indices[firstIndex + (corner + 1) % 3] }]++;
+				}
+			}
+
+			uint32_t numSharedEdges = 0;
+			uint32_t numOpenEdges = 0;
+			uint32_t numWrongOpenEdges = 0;
+			for (const auto& [edge, numUses] : edges)
+			{
+				STYX_CHECK(numUses == 1);
+
+				if (edges.count({ edge.second, edge.first }) > 0)
+				{
+					numSharedEdges++;
+					continue;
+				}
+
+				numOpenEdges++;
+
+				const Vector3 a = GetPosition(data, edge.first);
+				const Vector3 b = GetPosition(data, edge.second);
+				const float expectedY = hasSkirts ? -1.0f : 0.0f;
+				const bool isOnBorder = (a.x == b.x && (a.x == 0.0f || a.x == 1.0f)) || (a.z == b.z && (a.z == 0.0f || a.z == 1.0f));
+				numWrongOpenEdges += a.y == expectedY && b.y == expectedY && isOnBorder ? 0 : 1;
+			}
+
+			STYX_CHECK(numOpenEdges == 4 * resolution);
+			STYX_CHECK(numWrongOpenEdges == 0);
+			STYX_CHECK(numSharedEdges + numOpenEdges == data.GetNumIndices());
+		}
+	}
+}
+
+STYX_TEST(TerrainGridMesh_TriangleOrderSuitsTheVertexCache)
+{
+	for (uint32_t resolution : { 16u, 64u, 128u })
+	{
+		TerrainGridMeshDesc desc;
+		desc.resolution = resolution;
+		desc.hasSkirts = false;
+
+		TerrainGridMeshData data;
+		GenerateTerrainGridMesh(desc, data);
+
+		const std::vector<uint16_t> rowMajorIndices = GenerateRowMajorIndices(resolution);
+		const float acmr = ComputeAverageCacheMissRatio(data.indices.data(), data.GetNumIndices(), desc.vertexCacheSize);
+		const float rowMajorAcmr = ComputeAverageCacheMissRatio(rowMajorIndices.data(), static_cast<uint32_t>(rowMajorIndices.size()), desc.vertexCacheSize);
+
+		// 0.5 is the best a grid can do, every vertex transformed once
+		STYX_CHECK(acmr >= 0.5f && acmr <= 0.61f);
+		STYX_CHECK(resolution < 32 || acmr < 0.6f * rowMajorAcmr);
+	}
+
+	// Smaller caches get narrower bands
+	TerrainGridMeshDesc desc;
+	desc.resolution = 64;
+	desc.hasSkirts = false;
+	desc.vertexCacheSize = 16;
+
+	TerrainGridMeshData data;
+	GenerateTerrainGridMesh(desc, data);
+	STYX_CHECK(ComputeAverageCacheMissRatio(data.indices.data(), data.GetNumIndices(), 16) < 0.65f);
+
+	const uint16_t triangle[] = { 0, 1, 2 };
+	STYX_CHECK(ComputeAverageCacheMissRatio(triangle, 3, 32) == 3.0f);
+	STYX_CHECK(ComputeAverageCacheMissRatio(triangle, 0, 32) == 0.0f);
+}
+
+// Generating the patch grid against loading the same grid through Assimp, as TerrainRenderer used to
+STYX_BENCHMARK(TerrainGridMesh_GenerateVsAssimp)
+{
+	constexpr uint32_t NUM_ITERATIONS = 20;
+	constexpr uint32_t CACHE_SIZE = 32;
+
+	for (uint32_t resolution : { 16u, 64u })
+	{
+		TerrainGridMeshDesc desc;
+		desc.resolution = resolution;
+		desc.hasSkirts = false;
+		desc.vertexCacheSize = CACHE_SIZE;
+
+		TerrainGridMeshData data;
+		const double generateTime = MeasureMilliseconds([&]()
+		{
+			for (uint32_t iteration = 0; iteration < NUM_ITERATIONS; iteration++)
+			{
+				GenerateTerrainGridMesh(desc, data);
+			}
+		});
+
+		printf("    %3ux%-3u generated:                %8.3f ms, %5u vertices, ACMR %.2f\n", resolution, resolution, generateTime / NUM_ITERATIONS,
+			data.GetNumVertices(), ComputeAverageCacheMissRatio(data.indices.data(), data.GetNumIndices(), CACHE_SIZE));
+
+		const std::string path = WriteGridObj(resolution);
+		if (path.empty())
+		{
+			continue;
+		}
+
+		const std::pair<const char*, unsigned int> importModes[] =
+		{
+			{ "Assimp:", aiProcess_Triangulate | aiProcess_CalcTangentSpace },
+			{ "Assimp, cache optimised:", aiProcess_Triangulate | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices | aiProcess_ImproveCacheLocality },
+		};
+
+		for (const auto& [label, flags] : importModes)
+		{
+			std::vector<uint16_t> indices;
+			uint32_t numVertices = 0;
+
+			const double importTime = MeasureMilliseconds([&]()
+			{
+				for (uint32_t iteration = 0; iteration < NUM_ITERATIONS; iteration++)
+				{
+					Assimp::Importer importer;
+					const aiScene* scene = importer.ReadFile(path, flags);
+					if (!scene || scene->mNumMeshes == 0)
+					{
+						return;
+					}
+
+					const aiMesh* mesh = scene->mMeshes[0];
+					numVertices = mesh->mNumVertices;
+					indices.clear();
+					for (uint32_t faceIndex = 0; faceIndex < mesh->mNumFaces; faceIndex++)
+					{
+						for (uint32_t corner = 0; corner < mesh->mFaces[faceIndex].mNumIndices; corner++)
+						{
+							indices.push_back(static_cast<uint16_t>(mesh->mFaces[faceIndex].mIndices[corner]));
+						}
+					}
+				}
+			});
+
+			if (numVertices == 0)
+			{
+				printf("    %3ux%-3u %-25s failed to load '%s'\n", resolution, resolution, label, path.c_str());
+				continue;
+			}
+
+			printf("    %3ux%-3u %-25s %8.3f ms, %5u vertices, ACMR %.2f\n", resolution, resolution, label, importTime / NUM_ITERATIONS, numVertices,
+				ComputeAverageCacheMissRatio(indices.data(), static_cast<uint32_t>(indices.size()), CACHE_SIZE));
+		}
+	}
+}
@@ -0,0 +1,383 @@
+#include "TestFramework.h"
+
+#include <Core/JobSystem.h>
+#include <Renderer/HeightfieldNoise.h>
+#include <Renderer/TerrainHeightPyramid.h>
+
+#include <cmath>
+#include <random>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	constexpr float ORIGIN_X = -10.0f;
+	constexpr float ORIGIN_Z = 5.0f;
+	constexpr float SAMPLE_SPACING = 0.75f;
+	constexpr float HEIGHT_SCALE = 40.0f;
+
+	struct Heightfield
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<float> heights;
+	};
+
+	Heightfield GenerateHeightfield(uint32_t width, uint32_t height)
+	{
+		HeightfieldNoiseMaterialConstants constants;
+		constants.octaves = 6;
+		constants.frequency = 0.02f;
+
+		Heightfield heightfield;
+		heightfield.width = width;
+		heightfield.height = height;
+		heightfield.heights.resize(width * height);
+		GenerateHeightfieldNoise(constants, 0, 0, width, height, heightfield.heights.data(), width);
+
+		for (float& sample : heightfield.heights)
+		{
+			sample *= HEIGHT_SCALE;
+		}
+
+		return heightfield;
+	}
+
+	// The closest root of the ray against the bilinear patch of every cell, in double precision and without any
+	// acceleration structure. Returns a negative distance when the ray misses.
+	double BruteForceRayCast(const Heightfield& heightfield, const TerrainRay& ray)
+	{
+		double closest = -1.0;
+
+		for (uint32_t cellZ = 0; cellZ + 1 < heightfield.height; cellZ++)
+		{
+			for (uint32_t cellX = 0; cellX + 1 < heightfield.width; cellX++)
+			{
+				const double minX = ORIGIN_X + cellX * static_cast<double>(SAMPLE_SPACING);
+				const double minZ = ORIGIN_Z + cellZ * static_cast<double>(SAMPLE_SPACING);
+
+				// The part of the ray above the cell
+				double tEnter = 0.0;
+				double tExit = ray.maxDistance;
+				const double origins[2] = { ray.originX, ray.originZ };
+				const double directions[2] = { ray.directionX, ray.directionZ };
+				const double mins[2] = { minX, minZ };
+
+				for (uint32_t axis = 0; axis < 2; axis++)
+				{
+					if (directions[axis] == 0.0)
+					{
+						if (origins[axis] < mins[axis] || origins[axis] > mins[axis] + SAMPLE_SPACING)
+						{
+							tExit = -1.0;
+						}
+
+						continue;
+					}
+
+					const double t0 = (mins[axis] - origins[axis]) / directions[axis];
+					const double t1 = (mins[axis] + SAMPLE_SPACING - origins[axis]) / directions[axis];
+					tEnter = fmax(tEnter, fmin(t0, t1));
+					tExit = fmin(tExit, fmax(t0, t1));
+				}
+
+				if (tEnter > tExit)
+				{
+					continue;
+				}
+
+				const float* row0 = heightfield.heights.data() + cellZ * heightfield.width + cellX;
+				const float* row1 = row0 + heightfield.width;
+				const double a = row0[0];
+				const double b = static_cast<double>(row0[1]) - row0[0];
+				const double c = static_cast<double>(row1[0]) - row0[0];
+				const double d = static_cast<double>(row0[0]) - row0[1] - row1[0] + row1[1];
+
+				const double u0 = (ray.originX - minX) / SAMPLE_SPACING;
+				const double v0 = (ray.originZ - minZ) / SAMPLE_SPACING;
+				const double du = ray.directionX / static_cast<double>(SAMPLE_SPACING);
+				const double dv = ray.directionZ / static_cast<double>(SAMPLE_SPACING);
+
+				// Height of the ray above the patch as a quadratic in t
+				const double quadratic = -d * du * dv;
+				const double linear = ray.directionY - (b * du + c * dv + d * (u0 * dv + v0 * du));
+				const double constant = ray.originY - (a + b * u0 + c * v0 + d * u0 * v0);
+
+				double roots[2] = { -1.0, -1.0 };
+				if (fabs(quadratic) < 1e-14)
+				{
+					roots[0] = linear != 0.0 ? -constant / linear : -1.0;
+				}
+				else
+				{
+					const double discriminant = linear * linear - 4.0 * quadratic * constant;
+					if (discriminant < 0.0)
+					{
+						continue;
+					}
+
+					roots[0] = (-linear - sqrt(discriminant)) / (2.0 * quadratic);
+					roots[1] = (-linear + sqrt(discriminant)) / (2.0 * quadratic);
+				}
+
+				for (double root : roots)
+				{
+					if (root >= tEnter && root <= tExit && (closest < 0.0 || root < closest))
+					{
+						closest = root;
+					}
+				}
+			}
+		}
+
+		return closest;
+	}
+
+	TerrainRay GenerateRandomRay(std::mt19937& random, const TerrainHeightPyramid& pyramid, uint32_t rayIndex)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		TerrainRay ray;
+		ray.originX = ORIGIN_X + unit(random) * pyramid.GetWidth() * SAMPLE_SPACING * 0.75f;
+		ray.originZ = ORIGIN_Z + unit(random) * pyramid.GetHeight() * SAMPLE_SPACING * 0.75f;
+		ray.originY = pyramid.GetMaxHeight() + 0.01f + unit(random) * 30.0f;
+
+		switch (rayIndex % 5)
+		{
+		case 0:
+			// Straight down
+			ray.directionX = 0.0f;
+			ray.directionY = -1.0f;
+			ray.directionZ = 0.0f;
+			break;
+		case 1:
+			// From below the surface, hitting it on the way out
+			ray.originY = pyramid.SampleHeight(ray.originX, ray.originZ) - 1.0f - unit(random) * 5.0f;
+			ray.directionX = unit(random) * 2.0f - 1.0f;
+			ray.directionY = unit(random) * 0.5f + 0.05f;
+			ray.directionZ = unit(random) * 2.0f - 1.0f;
+			break;
+		default:
+			// Oblique to grazing, not normalized, some cut short
+			ray.directionX = (unit(random) * 2.0f - 1.0f) * 3.0f;
+			ray.directionY = -unit(random) * 0.8f + 0.05f;
+			ray.directionZ = (unit(random) * 2.0f - 1.0f) * 3.0f;
+			ray.maxDistance = rayIndex % 3 == 0 ? 20.0f : FLT_MAX;
+			break;
+		}
+
+		return ray;
+	}
+
+	bool IsSameHit(const TerrainRayHit& hit, double expectedDistance)
+	{
+		if (expectedDistance < 0.0)
+		{
+			return !hit.hasHit;
+		}
+
+		return hit.hasHit && fabs(hit.distance - expectedDistance) <= 1e-3 * (1.0 + expectedDistance);
+	}
+}
+
+STYX_TEST(TerrainHeightPyramid_RayCastMatchesBruteForce)
+{
+	const Heightfield heightfield = GenerateHeightfield(97, 70);
+
+	TerrainHeightPyramid pyramid;
+	pyramid.Build(heightfield.heights.data(), heightfield.width, heightfield.height, heightfield.width, ORIGIN_X, ORIGIN_Z, SAMPLE_SPACING);
+	STYX_REQUIRE(pyramid.GetNumLevels() == 8);
+
+	constexpr uint32_t NUM_RAYS = 1500;
+	std::mt19937 random(46);
+	std::vector<TerrainRay> rays(NUM_RAYS);
+	for (uint32_t rayIndex = 0; rayIndex < NUM_RAYS; rayIndex++)
+	{
+		rays[rayIndex] = GenerateRandomRay(random, pyramid, rayIndex);
+	}
+
+	std::vector<TerrainRayHit> hits(NUM_RAYS);
+	pyramid.RayCast(rays.data(), NUM_RAYS, hits.data());
+
+	uint32_t numHits = 0;
+	uint32_t numWrongHits = 0;
+	uint32_t numWrongPackets = 0;
+	uint32_t numWrongPositions = 0;
+
+	for (uint32_t rayIndex = 0; rayIndex < NUM_RAYS; rayIndex++)
+	{
+		const double expectedDistance = BruteForceRayCast(heightfield, rays[rayIndex]);
+
+		TerrainRayHit hit;
+		const bool hasHit = pyramid.RayCast(rays[rayIndex], hit);
+		numHits += hasHit ? 1 : 0;
+		numWrongHits += hasHit == hit.hasHit && IsSameHit(hit, expectedDistance) ? 0 : 1;
+		numWrongPackets += IsSameHit(hits[rayIndex], expectedDistance) ? 0 : 1;
+
+		// Rays hit what the height queries return
+		if (hit.hasHit)
+		{
+			numWrongPositions += fabsf(hit.positionY - pyramid.SampleHeight(hit.positionX, hit.positionZ)) <= 1e-2f ? 0 : 1;
+		}
+	}
+
+	// Plenty of both, many oblique rays leave the heightfield before reaching the ground
+	STYX_CHECK(numHits > NUM_RAYS / 4 && numHits < 3 * NUM_RAYS / 4);
+	STYX_CHECK(numWrongHits == 0);
+	STYX_CHECK(numWrongPackets == 0);
+	STYX_CHECK(numWrongPositions == 0);
+
+	// Spread over the job system when cast from a job, with the same results
+	JobSystemDesc jobSystemDesc;
+	jobSystemDesc.numWorkers = 3;
+	JobSystem::Initialize(jobSystemDesc);
+
+	std::vector<TerrainRayHit> jobHits(NUM_RAYS);
+	JobCounter counter;
+	JobSystem::Run(counter, [&]() { pyramid.RayCast(rays.data(), NUM_RAYS, jobHits.data()); });
+	JobSystem::Wait(counter);
+	JobSystem::Shutdown();
+
+	uint32_t numDifferentJobHits = 0;
+	for (uint32_t rayIndex = 0; rayIndex < NUM_RAYS; rayIndex++)
+	{
+		numDifferentJobHits += jobHits[rayIndex].hasHit == hits[rayIndex].hasHit && jobHits[rayIndex].distance == hits[rayIndex].distance ? 0 : 1;
+	}
+
+	STYX_CHECK(numDifferentJobHits == 0);
+}
+
+STYX_TEST(TerrainHeightPyramid_SamplesAreBilinear)
+{
+	// A tilted plane, h = 0.5 * x - 0.25 * z + 3 in world units, which bilinear interpolation reproduces exactly
+	constexpr uint32_t WIDTH = 33;
+	constexpr uint32_t HEIGHT = 17;
+	auto planeHeight = [](float x, float z) { return 0.5f * x - 0.25f * z + 3.0f; };
+
+	std::vector<float> heights(WIDTH * HEIGHT);
+	std::vector<uint16_t> unormHeights(WIDTH * HEIGHT);
+	for (uint32_t z = 0; z < HEIGHT; z++)
+	{
+		for (uint32_t x = 0; x < WIDTH; x++)
+		{
+			heights[z * WIDTH + x] = planeHeight(ORIGIN_X + x * SAMPLE_SPACING, ORIGIN_Z + z * SAMPLE_SPACING);
+			unormHeights[z * WIDTH + x] = static_cast<uint16_t>(x * 1000 + z);
+		}
+	}
+
+	TerrainHeightPyramid pyramid;
+	pyramid.Build(heights.data(), WIDTH, HEIGHT, WIDTH, ORIGIN_X, ORIGIN_Z, SAMPLE_SPACING);
+
+	std::mt19937 random(46);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (uint32_t query = 0; query < 200; query++)
+	{
+		const float x = ORIGIN_X + unit(random) * (WIDTH - 1) * SAMPLE_SPACING;
+		const float z = ORIGIN_Z + unit(random) * (HEIGHT - 1) * SAMPLE_SPACING;
+		const TerrainHeightSample sample = pyramid.Sample(x, z);
+
+		STYX_CHECK(fabsf(sample.height - planeHeight(x, z)) < 1e-4f);
+		STYX_CHECK(sample.height == pyramid.SampleHeight(x, z));
+
+		const float inverseLength = 1.0f / sqrtf(0.25f + 1.0f + 0.0625f);
+		STYX_CHECK(fabsf(sample.normalX + 0.5f * inverseLength) < 1e-5f && fabsf(sample.normalY - inverseLength) < 1e-5f && fabsf(sample.normalZ - 0.25f * inverseLength) < 1e-5f);
+
+		// Straight down onto the plane
+		TerrainRay ray;
+		ray.originX = x;
+		ray.originY = 100.0f;
+		ray.originZ = z;
+		TerrainRayHit hit;
+		STYX_CHECK(pyramid.RayCast(ray, hit) && fabsf(hit.distance - (100.0f - planeHeight(x, z))) < 1e-3f);
+
+		// Too short to get there
+		ray.maxDistance = 50.0f;
+		STYX_CHECK(!pyramid.RayCast(ray, hit) && !hit.hasHit);
+	}
+
+	// Queries past the edges are clamped
+	STYX_CHECK(pyramid.SampleHeight(ORIGIN_X - 100.0f, ORIGIN_Z) == heights[0]);
+	STYX_CHECK(pyramid.SampleHeight(ORIGIN_X + 1000.0f, ORIGIN_Z + 1000.0f) == heights.back());
+	STYX_CHECK(pyramid.GetMinHeight() == planeHeight(ORIGIN_X, ORIGIN_Z + (HEIGHT - 1) * SAMPLE_SPACING));
+	STYX_CHECK(pyramid.GetMaxHeight() == planeHeight(ORIGIN_X + (WIDTH - 1) * SAMPLE_SPACING, ORIGIN_Z));
+
+	// R16_UNORM heights, e.g. a streamed tile, are scaled to world heights
+	TerrainHeightPyramid unormPyramid;
+	unormPyramid.Build(unormHeights.data(), WIDTH, HEIGHT, WIDTH, 0.0f, 0.0f, 1.0f, 65535.0f);
+	STYX_CHECK(fabsf(unormPyramid.SampleHeight(3.0f, 2.0f) - 3002.0f) < 0.01f);
+	STYX_CHECK(fabsf(unormPyramid.SampleHeight(3.5f, 2.5f) - 3502.5f) < 0.01f);
+}
+
+// Camera rays sweep a view like picking or collision queries from one place would, random rays go anywhere
+STYX_BENCHMARK(TerrainHeightPyramid_RayCastThroughput)
+{
+	constexpr uint32_t SIZE = 1025;
+	constexpr uint32_t NUM_RAYS = 1 << 16;
+
+	const Heightfield heightfield = GenerateHeightfield(SIZE, SIZE);
+
+	TerrainHeightPyramid pyramid;
+	const double buildTime = MeasureMilliseconds([&]()
+	{
+		pyramid.Build(heightfield.heights.data(), SIZE, SIZE, SIZE, ORIGIN_X, ORIGIN_Z, SAMPLE_SPACING);
+	});
+
+	std::vector<TerrainRay> cameraRays(NUM_RAYS);
+	for (uint32_t rayIndex = 0; rayIndex < NUM_RAYS; rayIndex++)
+	{
+		const float u = static_cast<float>(rayIndex % 256) / 255.0f - 0.5f;
+		const float v = static_cast<float>(rayIndex / 256) / 255.0f;
+
+		TerrainRay& ray = cameraRays[rayIndex];
+		ray.originX = ORIGIN_X + SIZE * SAMPLE_SPACING * 0.5f;
+		ray.originY = pyramid.GetMaxHeight() + 20.0f;
+		ray.originZ = ORIGIN_Z + 10.0f;
+		ray.directionX = u;
+		ray.directionY = -0.1f - 0.5f * v;
+		ray.directionZ = 1.0f;
+	}
+
+	std::mt19937 random(46);
+	std::vector<TerrainRay> randomRays(NUM_RAYS);
+	for (uint32_t rayIndex = 0; rayIndex < NUM_RAYS; rayIndex++)
+	{
+		randomRays[rayIndex] = GenerateRandomRay(random, pyramid, rayIndex);
+	}
+
+	std::vector<TerrainRayHit> hits(NUM_RAYS);
+	auto measure = [&](const char* label, const std::vector<TerrainRay>& rays, bool isBatched)
+	{
+		double bestTime = 1e9;
+		for (uint32_t iteration = 0; iteration < 3; iteration++)
+		{
+			bestTime = (std::min)(bestTime, MeasureMilliseconds([&]()
+			{
+				if (isBatched)
+				{
+					pyramid.RayCast(rays.data(), NUM_RAYS, hits.data());
+					return;
+				}
+
+				for (uint32_t rayIndex = 0; rayIndex < NUM_RAYS; rayIndex++)
+				{
+					pyramid.RayCast(rays[rayIndex], hits[rayIndex]);
+				}
+			}));
+		}
+
+		uint32_t numHits = 0;
+		for (const TerrainRayHit& hit : hits)
+		{
+			numHits += hit.hasHit ? 1 : 0;
+		}
+
+		printf("    %-20s %.2f M rays/s (%u of %u hit)\n", label, NUM_RAYS / bestTime / 1000.0, numHits, NUM_RAYS);
+	};
+
+	printf("    %ux%u heightfield, pyramid of %u levels built in %.1f ms\n", SIZE, SIZE, pyramid.GetNumLevels(), buildTime);
+	measure("camera, one by one", cameraRays, false);
+	measure("camera, packets", cameraRays, true);
+	measure("random, one by one", randomRays, false);
+	measure("random, packets", randomRays, true);
+}
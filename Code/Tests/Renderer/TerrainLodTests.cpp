@@ -0,0 +1,228 @@
+#include "TestFramework.h"
+
+#include <Renderer/TerrainLod.h>
+
+#include <cmath>
+#include <random>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	constexpr float MIN_HEIGHT = 0.0f;
+	constexpr float MAX_HEIGHT = 5.0f;
+
+	float GetDistance(const TerrainLodView& view, float x, float y, float z)
+	{
+		return sqrtf((x - view.positionX) * (x - view.positionX) + (y - view.positionY) * (y - view.positionY) + (z - view.positionZ) * (z - view.positionZ));
+	}
+
+	bool GetOverlap(float a0, float a1, float b0, float b1, float& outBegin, float& outEnd)
+	{
+		outBegin = fmaxf(a0, b0);
+		outEnd = fminf(a1, b1);
+		return outEnd > outBegin;
+	}
+
+	// Counts the pairs of patches sharing part of an edge and the ones that would crack: more than one level apart, or
+	// somewhere along the edge the finer one isn't fully morphed into the coarser one's grid or the coarser one morphs
+	void CheckNeighbours(const TerrainLodSelector& selector, const TerrainLodView& view, const std::vector<TerrainPatch>& patches, uint32_t& numPairs, uint32_t& numCracks)
+	{
+		for (const TerrainPatch& fine : patches)
+		{
+			for (const TerrainPatch& coarse : patches)
+			{
+				if (fine.level >= coarse.level)
+				{
+					continue;
+				}
+
+				float begin = 0.0f;
+				float end = 0.0f;
+				float edge = 0.0f;
+				bool isAlongZ = false;
+
+				if ((fine.x == coarse.x + coarse.size || fine.x + fine.size == coarse.x) && GetOverlap(fine.z, fine.z + fine.size, coarse.z, coarse.z + coarse.size, begin, end))
+				{
+					isAlongZ = true;
+					edge = fine.x == coarse.x + coarse.size ? fine.x : fine.x + fine.size;
+				}
+				else if ((fine.z == coarse.z + coarse.size || fine.z + fine.size == coarse.z) && GetOverlap(fine.x, fine.x + fine.size, coarse.x, coarse.x + coarse.size, begin, end))
+				{
+					edge = fine.z == coarse.z + coarse.size ? fine.z : fine.z + fine.size;
+				}
+				else
+				{
+					continue;
+				}
+
+				numPairs++;
+
+				if (coarse.level - fine.level > 1)
+				{
+					numCracks++;
+					continue;
+				}
+
+				for (uint32_t step = 0; step <= 16; step++)
+				{
+					const float t = begin + (end - begin) * static_cast<float>(step) / 16.0f;
+					for (float height : { MIN_HEIGHT, MAX_HEIGHT })
+					{
+						const float distance = isAlongZ ? GetDistance(view, edge, height, t) : GetDistance(view, t, height, edge);
+						const float fineMorph = TerrainLodSelector::ComputeMorphFactor(distance, selector.GetMorphStart(fine.level), selector.GetMorphEnd(fine.level));
+						const float coarseMorph = TerrainLodSelector::ComputeMorphFactor(distance, selector.GetMorphStart(coarse.level), selector.GetMorphEnd(coarse.level));
+						numCracks += fineMorph != 1.0f || coarseMorph != 0.0f ? 1 : 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+STYX_TEST(TerrainLod_NeighbouringPatchesNeverCrack)
+{
+	std::mt19937 random(44);
+	uint32_t numPairs = 0;
+
+	for (uint32_t numLevels : { 3u, 4u, 6u })
+	{
+		TerrainLodDesc desc;
+		desc.numLevels = numLevels;
+		TerrainLodSelector selector(desc);
+		STYX_REQUIRE(selector.IsCrackFree(MAX_HEIGHT - MIN_HEIGHT));
+
+		const float rootSize = selector.GetRootNodeSize();
+		std::uniform_real_distribution<float> horizontal(-rootSize, 4.0f * rootSize);
+		std::uniform_real_distribution<float> vertical(-2.0f, 40.0f);
+
+		std::vector<TerrainPatch> patches;
+		for (uint32_t trial = 0; trial < 100; trial++)
+		{
+			TerrainLodView view;
+			view.positionX = horizontal(random);
+			view.positionY = vertical(random);
+			view.positionZ = horizontal(random);
+
+			// 3x3 roots, patches of neighbouring roots have to line up as well
+			patches.clear();
+			for (uint32_t rootZ = 0; rootZ < 3; rootZ++)
+			{
+				for (uint32_t rootX = 0; rootX < 3; rootX++)
+				{
+					selector.Select(view, rootX * rootSize, rootZ * rootSize, MIN_HEIGHT, MAX_HEIGHT, patches);
+				}
+			}
+
+			// Without a frustum the patches cover the roots exactly
+			double area = 0.0;
+			for (const TerrainPatch& patch : patches)
+			{
+				area += static_cast<double>(patch.size) * patch.size;
+				STYX_CHECK(patch.size == selector.GetNodeSize(patch.level));
+			}
+
+			STYX_CHECK(fabs(area - 9.0 * rootSize * rootSize) <= 1e-3 * rootSize * rootSize);
+
+			uint32_t numCracks = 0;
+			CheckNeighbours(selector, view, patches, numPairs, numCracks);
+			STYX_CHECK(numCracks == 0);
+		}
+	}
+
+	// Views spread enough to see plenty of level transitions
+	STYX_CHECK(numPairs > 1000);
+}
+
+STYX_TEST(TerrainLod_IsCrackFreeRejectsRangesTooClose)
+{
+	TerrainLodDesc desc;
+	STYX_CHECK(TerrainLodSelector(desc).IsCrackFree(MAX_HEIGHT - MIN_HEIGHT));
+
+	desc.leafRangeInNodes = 2.0f;
+	STYX_CHECK(!TerrainLodSelector(desc).IsCrackFree(MAX_HEIGHT - MIN_HEIGHT));
+
+	// Tall terrain pushes the patches of a level further from the camera
+	desc.leafRangeInNodes = 5.0f;
+	STYX_CHECK(!TerrainLodSelector(desc).IsCrackFree(200.0f));
+
+	// Morphing starts at the given fraction of the way through a level's range, and ends with it
+	TerrainLodSelector selector(TerrainLodDesc{});
+	STYX_CHECK(TerrainLodSelector::ComputeMorphFactor(selector.GetMorphStart(1) - 0.01f, selector.GetMorphStart(1), selector.GetMorphEnd(1)) == 0.0f);
+	STYX_CHECK(TerrainLodSelector::ComputeMorphFactor(selector.GetMorphEnd(1), selector.GetMorphStart(1), selector.GetMorphEnd(1)) == 1.0f);
+	STYX_CHECK(selector.GetMorphEnd(0) < selector.GetMorphStart(1) && selector.GetMorphEnd(1) == 2.0f * selector.GetMorphEnd(0));
+}
+
+STYX_TEST(TerrainLod_NodesBehindTheCameraAreCulled)
+{
+	TerrainLodSelector selector(TerrainLodDesc{});
+
+	// Looking down +z from above the origin with a 90 degree field of view, depth in [0, 1] over [0.1, 1000]
+	constexpr float NEAR_PLANE = 0.1f;
+	constexpr float FAR_PLANE = 1000.0f;
+	DirectX::XMFLOAT4X4 viewProjection = {};
+	viewProjection.m[0][0] = 1.0f;
+	viewProjection.m[1][1] = 1.0f;
+	viewProjection.m[2][2] = FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+	viewProjection.m[2][3] = 1.0f;
+	viewProjection.m[3][2] = -NEAR_PLANE * FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+
+	TerrainLodView view;
+	view.positionY = 2.0f;
+	view.viewProjection = &viewProjection;
+
+	std::vector<TerrainPatch> patches;
+	const float rootSize = selector.GetRootNodeSize();
+	for (int32_t rootZ = -3; rootZ <= 3; rootZ++)
+	{
+		for (int32_t rootX = -3; rootX <= 3; rootX++)
+		{
+			selector.Select(view, rootX * rootSize, rootZ * rootSize, MIN_HEIGHT, MAX_HEIGHT, patches);
+		}
+	}
+
+	uint32_t numPatchesBehind = 0;
+	bool hasPatchAhead = false;
+	for (const TerrainPatch& patch : patches)
+	{
+		numPatchesBehind += patch.z + patch.size < 0.0f ? 1 : 0;
+		hasPatchAhead = hasPatchAhead || patch.z > rootSize;
+	}
+
+	STYX_CHECK(numPatchesBehind == 0);
+	STYX_CHECK(hasPatchAhead);
+	STYX_CHECK(selector.GetStats().numCulledNodes > 0);
+	STYX_CHECK(selector.GetStats().numPatches == patches.size());
+}
+
+// A single root deepening the quadtree, with the camera sliding over it
+STYX_BENCHMARK(TerrainLod_SelectionTime)
+{
+	constexpr uint32_t NUM_FRAMES = 200;
+
+	for (uint32_t numLevels : { 6u, 8u, 10u, 12u, 14u })
+	{
+		TerrainLodDesc desc;
+		desc.numLevels = numLevels;
+		TerrainLodSelector selector(desc);
+
+		const float rootSize = selector.GetRootNodeSize();
+		TerrainLodView view;
+		view.positionX = rootSize * 0.5f;
+		view.positionY = 10.0f;
+		view.positionZ = rootSize * 0.5f;
+
+		std::vector<TerrainPatch> patches;
+		for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+		{
+			patches.clear();
+			view.positionX += 1.0f;
+			selector.Select(view, 0.0f, 0.0f, 0.0f, 50.0f, patches);
+		}
+
+		const TerrainLodStats& stats = selector.GetStats();
+		printf("    %2u levels, %7.1f km: %5zu patches, %5u nodes visited, %.1f us per selection\n", numLevels, rootSize / 1000.0f, patches.size(),
+			stats.numVisitedNodes / NUM_FRAMES, 1000.0 * stats.selectionTimeInMilliseconds / NUM_FRAMES);
+	}
+}
@@ -0,0 +1,536 @@
+#include "TestFramework.h"
+
+#include <Core/JobSystem.h>
+#include <Renderer/TerrainScatter.h>
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	constexpr uint32_t TILE_SIZE = 64;
+	constexpr float TILE_WORLD_SIZE = 100.0f;
+	constexpr float HEIGHT_SCALE = 50.0f;
+
+	// Heights of a plane through height at the tile origin, rising by slopeX and slopeZ per world unit
+	std::vector<uint16_t> GeneratePlaneHeights(float height, float slopeX, float slopeZ, float heightScale = HEIGHT_SCALE)
+	{
+		const uint32_t numSamples = TILE_SIZE + 1;
+		const float sampleSpacing = TILE_WORLD_SIZE / static_cast<float>(TILE_SIZE);
+
+		std::vector<uint16_t> heights(numSamples * numSamples);
+		for (uint32_t z = 0; z < numSamples; z++)
+		{
+			for (uint32_t x = 0; x < numSamples; x++)
+			{
+				const float sample = height + (slopeX * x + slopeZ * z) * sampleSpacing;
+				heights[z * numSamples + x] = static_cast<uint16_t>(fminf(fmaxf(sample / heightScale, 0.0f), 1.0f) * 65535.0f + 0.5f);
+			}
+		}
+
+		return heights;
+	}
+
+	// Rolling ground, different on every tile
+	std::vector<uint16_t> GenerateRollingHeights(const TerrainTileCoord& coord)
+	{
+		const uint32_t numSamples = TILE_SIZE + 1;
+		std::vector<uint16_t> heights(numSamples * numSamples);
+
+		for (uint32_t z = 0; z < numSamples; z++)
+		{
+			for (uint32_t x = 0; x < numSamples; x++)
+			{
+				const float worldX = static_cast<float>(coord.x * static_cast<int32_t>(TILE_SIZE) + static_cast<int32_t>(x));
+				const float worldZ = static_cast<float>(coord.y * static_cast<int32_t>(TILE_SIZE) + static_cast<int32_t>(z));
+				const float sample = 0.5f + 0.25f * sinf(worldX * 0.07f) * cosf(worldZ * 0.05f);
+				heights[z * numSamples + x] = static_cast<uint16_t>(sample * 65535.0f + 0.5f);
+			}
+		}
+
+		return heights;
+	}
+
+	TerrainScatterDesc GetScatterDesc()
+	{
+		// Like the renderer's: trees on the lower, gentler ground and rocks anywhere
+		TerrainScatterLayerDesc treeLayer;
+		treeLayer.minSpacing = 6.0f;
+		treeLayer.seed = 1;
+		treeLayer.maxHeight = 0.6f * HEIGHT_SCALE;
+		treeLayer.heightFade = 0.1f * HEIGHT_SCALE;
+		treeLayer.maxSlope = 0.6f;
+		treeLayer.slopeFade = 0.1f;
+		treeLayer.boundsRadius = 4.0f;
+		treeLayer.drawDistance = 400.0f;
+
+		TerrainScatterLayerDesc rockLayer;
+		rockLayer.minSpacing = 3.0f;
+		rockLayer.seed = 2;
+		rockLayer.density = 0.3f;
+		rockLayer.minScale = 0.5f;
+		rockLayer.maxScale = 1.5f;
+		rockLayer.boundsRadius = 0.5f;
+		rockLayer.drawDistance = 150.0f;
+
+		TerrainScatterDesc desc;
+		desc.tileSize = TILE_SIZE;
+		desc.tileWorldSize = TILE_WORLD_SIZE;
+		desc.heightScale = HEIGHT_SCALE;
+		desc.layers = { treeLayer, rockLayer };
+		return desc;
+	}
+
+	DirectX::XMFLOAT4X4 Multiply(const DirectX::XMFLOAT4X4& a, const DirectX::XMFLOAT4X4& b)
+	{
+		DirectX::XMFLOAT4X4 result = {};
+		for (uint32_t row = 0; row < 4; row++)
+		{
+			for (uint32_t column = 0; column < 4; column++)
+			{
+				for (uint32_t k = 0; k < 4; k++)
+				{
+					result.m[row][column] += a.m[row][k] * b.m[k][column];
+				}
+			}
+		}
+
+		return result;
+	}
+
+	// Row vector convention with a [0, 1] depth range, a 90 degree field of view turned by yaw around +Y
+	DirectX::XMFLOAT4X4 GetViewProjection(float x, float y, float z, float yaw)
+	{
+		DirectX::XMFLOAT4X4 translation = {};
+		translation.m[0][0] = translation.m[1][1] = translation.m[2][2] = translation.m[3][3] = 1.0f;
+		translation.m[3][0] = -x;
+		translation.m[3][1] = -y;
+		translation.m[3][2] = -z;
+
+		// Inverse of the camera's rotation
+		DirectX::XMFLOAT4X4 rotation = {};
+		rotation.m[0][0] = cosf(yaw);
+		rotation.m[0][2] = sinf(yaw);
+		rotation.m[1][1] = 1.0f;
+		rotation.m[2][0] = -sinf(yaw);
+		rotation.m[2][2] = cosf(yaw);
+		rotation.m[3][3] = 1.0f;
+
+		constexpr float NEAR_PLANE = 0.1f;
+		constexpr float FAR_PLANE = 1000.0f;
+		DirectX::XMFLOAT4X4 projection = {};
+		projection.m[0][0] = 1.0f;
+		projection.m[1][1] = 1.0f;
+		projection.m[2][2] = FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+		projection.m[2][3] = 1.0f;
+		projection.m[3][2] = -NEAR_PLANE * FAR_PLANE / (FAR_PLANE - NEAR_PLANE);
+
+		return Multiply(Multiply(translation, rotation), projection);
+	}
+
+	// Signed distance from the sphere to the frustum plane it's furthest outside of, in double precision: visible at 0
+	// or more. The planes are clip space x >= -w, x <= w, y >= -w, y <= w, z >= 0 and z <= w.
+	double GetVisibilityMargin(const DirectX::XMFLOAT4X4& m, const TerrainScatterInstance& instance, double radius)
+	{
+		struct ClipPlane
+		{
+			double w;
+			uint32_t axis;
+			double sign;
+		};
+
+		const ClipPlane clipPlanes[6] = { { 1.0, 0, 1.0 }, { 1.0, 0, -1.0 }, { 1.0, 1, 1.0 }, { 1.0, 1, -1.0 }, { 0.0, 2, 1.0 }, { 1.0, 2, -1.0 } };
+		const double position[4] = { instance.positionX, instance.positionY, instance.positionZ, 1.0 };
+		double margin = DBL_MAX;
+
+		for (const ClipPlane& clipPlane : clipPlanes)
+		{
+			double plane[4];
+			for (uint32_t row = 0; row < 4; row++)
+			{
+				plane[row] = clipPlane.w * m.m[row][3] + clipPlane.sign * m.m[row][clipPlane.axis];
+			}
+
+			const double length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			const double distance = plane[0] * position[0] + plane[1] * position[1] + plane[2] * position[2] + plane[3] * position[3];
+			margin = fmin(margin, distance / length + radius);
+		}
+
+		return margin;
+	}
+}
+
+STYX_TEST(TerrainScatter_PoissonDiskPatternKeepsItsSpacingAcrossTheEdges)
+{
+	for (float minDistance : { 0.03f, 0.06f, 0.2f })
+	{
+		std::vector<float> points;
+		TerrainScatter::GeneratePoissonDiskPattern(minDistance, 7, points);
+		const uint32_t numPoints = static_cast<uint32_t>(points.size() / 2);
+
+		uint32_t numTooClose = 0;
+		for (uint32_t a = 0; a < numPoints; a++)
+		{
+			STYX_CHECK(points[2 * a] >= 0.0f && points[2 * a] < 1.0f && points[2 * a + 1] >= 0.0f && points[2 * a + 1] < 1.0f);
+
+			for (uint32_t b = a + 1; b < numPoints; b++)
+			{
+				double dx = fabs(points[2 * a] - points[2 * b]);
+				double dy = fabs(points[2 * a + 1] - points[2 * b + 1]);
+				dx = fmin(dx, 1.0 - dx);
+				dy = fmin(dy, 1.0 - dy);
+				numTooClose += sqrt(dx * dx + dy * dy) < minDistance * (1.0 - 1e-5) ? 1 : 0;
+			}
+		}
+
+		STYX_CHECK(numTooClose == 0);
+
+		// Maximal: nowhere on the torus is further than twice minDistance from a point
+		std::mt19937 random(48);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		uint32_t numGaps = 0;
+		for (uint32_t probe = 0; probe < 500; probe++)
+		{
+			const float x = unit(random);
+			const float y = unit(random);
+			double closest = DBL_MAX;
+			for (uint32_t point = 0; point < numPoints; point++)
+			{
+				double dx = fabs(x - points[2 * point]);
+				double dy = fabs(y - points[2 * point + 1]);
+				dx = fmin(dx, 1.0 - dx);
+				dy = fmin(dy, 1.0 - dy);
+				closest = fmin(closest, sqrt(dx * dx + dy * dy));
+			}
+
+			numGaps += closest > 2.0 * minDistance ? 1 : 0;
+		}
+
+		STYX_CHECK(numGaps == 0);
+
+		// Same seed, same pattern
+		std::vector<float> samePoints;
+		TerrainScatter::GeneratePoissonDiskPattern(minDistance, 7, samePoints);
+		STYX_CHECK(samePoints == points);
+	}
+}
+
+STYX_TEST(TerrainScatter_NeighbouringTilesKeepTheSpacing)
+{
+	TerrainScatterDesc desc = GetScatterDesc();
+	desc.layers[0].maxHeight = FLT_MAX;
+	desc.layers[0].maxSlope = FLT_MAX;
+	desc.layers[1].density = 1.0f;
+	TerrainScatter scatter(desc);
+
+	const std::vector<uint16_t> heights = GeneratePlaneHeights(10.0f, 0.0f, 0.0f);
+
+	// 3x3 tiles around the origin, every point of the patterns is kept on flat ground at full density
+	std::vector<TerrainScatterTile> tiles;
+	for (int32_t tileY = -1; tileY <= 1; tileY++)
+	{
+		for (int32_t tileX = -1; tileX <= 1; tileX++)
+		{
+			tiles.emplace_back();
+			scatter.GenerateTile(TerrainTileCoord{ tileX, tileY }, heights.data(), tiles.back());
+		}
+	}
+
+	for (uint32_t layer = 0; layer < scatter.GetNumLayers(); layer++)
+	{
+		STYX_CHECK(tiles[0].GetNumInstances(layer) == scatter.GetPattern(layer).size() / 2);
+
+		std::vector<const TerrainScatterInstance*> instances;
+		for (const TerrainScatterTile& tile : tiles)
+		{
+			for (uint32_t instanceIndex = 0; instanceIndex < tile.GetNumInstances(layer); instanceIndex++)
+			{
+				instances.push_back(tile.GetInstances(layer) + instanceIndex);
+			}
+		}
+
+		// Positions are floats a few hundred units from the origin
+		const double minSpacing = desc.layers[layer].minSpacing - 1e-3;
+		uint32_t numTooClose = 0;
+		for (size_t a = 0; a < instances.size(); a++)
+		{
+			for (size_t b = a + 1; b < instances.size(); b++)
+			{
+				const double dx = instances[a]->positionX - instances[b]->positionX;
+				const double dz = instances[a]->positionZ - instances[b]->positionZ;
+				numTooClose += dx * dx + dz * dz < minSpacing * minSpacing ? 1 : 0;
+			}
+		}
+
+		STYX_CHECK(numTooClose == 0);
+	}
+}
+
+STYX_TEST(TerrainScatter_HeightAndSlopeMasks)
+{
+	TerrainScatterDesc desc = GetScatterDesc();
+	desc.layers.resize(1);
+	desc.layers[0].density = 1.0f;
+	TerrainScatter scatter(desc);
+	const uint32_t numPoints = static_cast<uint32_t>(scatter.GetPattern(0).size() / 2);
+	const TerrainScatterLayerDesc layer = desc.layers[0];
+
+	TerrainScatterTile tile;
+
+	// Flat, well below the height limit
+	std::vector<uint16_t> heights = GeneratePlaneHeights(0.2f * HEIGHT_SCALE, 0.0f, 0.0f);
+	scatter.GenerateTile(TerrainTileCoord{ 3, -2 }, heights.data(), tile);
+	STYX_CHECK(tile.GetNumInstances(0) == numPoints);
+	for (const TerrainScatterInstance& instance : tile.instances)
+	{
+		STYX_CHECK(fabsf(instance.positionY - 0.2f * HEIGHT_SCALE) < 1e-3f);
+		STYX_CHECK(instance.scale >= layer.minScale && instance.scale <= layer.maxScale);
+		STYX_CHECK(instance.positionX >= 3.0f * TILE_WORLD_SIZE && instance.positionX < 4.0f * TILE_WORLD_SIZE);
+		STYX_CHECK(instance.positionZ >= -2.0f * TILE_WORLD_SIZE && instance.positionZ < -1.0f * TILE_WORLD_SIZE);
+	}
+
+	STYX_CHECK(tile.boundsMin[1] == tile.boundsMax[1]);
+
+	// Above the height limit
+	heights = GeneratePlaneHeights(layer.maxHeight + 0.01f, 0.0f, 0.0f);
+	scatter.GenerateTile(TerrainTileCoord{ 3, -2 }, heights.data(), tile);
+	STYX_CHECK(tile.GetNumInstances(0) == 0);
+
+	// Halfway through the height fade, about half of them
+	heights = GeneratePlaneHeights(layer.maxHeight - 0.5f * layer.heightFade, 0.0f, 0.0f);
+	scatter.GenerateTile(TerrainTileCoord{ 3, -2 }, heights.data(), tile);
+	STYX_CHECK(tile.GetNumInstances(0) > numPoints / 3 && tile.GetNumInstances(0) < 2 * numPoints / 3);
+
+	// A slope gentle enough, then one too steep, diagonal so both axes count. Tall enough for the slopes to fit on a
+	// tile, without a height limit.
+	desc.heightScale = 1000.0f;
+	desc.layers[0].maxHeight = FLT_MAX;
+	TerrainScatter slopeScatter(desc);
+
+	const float gentle = (layer.maxSlope - layer.slopeFade - 0.05f) / sqrtf(2.0f);
+	heights = GeneratePlaneHeights(0.0f, gentle, gentle, desc.heightScale);
+	slopeScatter.GenerateTile(TerrainTileCoord{ 0, 0 }, heights.data(), tile);
+	STYX_CHECK(tile.GetNumInstances(0) == numPoints);
+
+	const float steep = (layer.maxSlope + 0.05f) / sqrtf(2.0f);
+	heights = GeneratePlaneHeights(0.0f, steep, steep, desc.heightScale);
+	slopeScatter.GenerateTile(TerrainTileCoord{ 0, 0 }, heights.data(), tile);
+	STYX_CHECK(tile.GetNumInstances(0) == 0);
+}
+
+STYX_TEST(TerrainScatter_TilesAreTheSameWhereverTheyAreGenerated)
+{
+	const TerrainScatter scatter(GetScatterDesc());
+
+	std::vector<TerrainTileCoord> coords;
+	std::vector<std::vector<uint16_t>> heights;
+	std::vector<const uint16_t*> heightPointers;
+	for (int32_t tileY = -3; tileY <= 3; tileY++)
+	{
+		for (int32_t tileX = -3; tileX <= 3; tileX++)
+		{
+			coords.push_back(TerrainTileCoord{ tileX, tileY });
+			heights.push_back(GenerateRollingHeights(coords.back()));
+		}
+	}
+
+	for (const std::vector<uint16_t>& tileHeights : heights)
+	{
+		heightPointers.push_back(tileHeights.data());
+	}
+
+	const uint32_t numTiles = static_cast<uint32_t>(coords.size());
+	std::vector<TerrainScatterTile> tiles(numTiles);
+	scatter.GenerateTiles(coords.data(), heightPointers.data(), numTiles, tiles.data());
+
+	JobSystemDesc jobSystemDesc;
+	jobSystemDesc.numWorkers = 3;
+	JobSystem::Initialize(jobSystemDesc);
+
+	std::vector<TerrainScatterTile> jobTiles(numTiles);
+	JobCounter counter;
+	JobSystem::Run(counter, [&]() { scatter.GenerateTiles(coords.data(), heightPointers.data(), numTiles, jobTiles.data()); });
+	JobSystem::Wait(counter);
+	JobSystem::Shutdown();
+
+	uint32_t numDifferentTiles = 0;
+	uint32_t numInstances = 0;
+	for (uint32_t tileIndex = 0; tileIndex < numTiles; tileIndex++)
+	{
+		// Once more, in reverse, as a streamer thread would long after
+		TerrainScatterTile tile;
+		scatter.GenerateTile(coords[numTiles - 1 - tileIndex], heightPointers[numTiles - 1 - tileIndex], tile);
+
+		const TerrainScatterTile& reference = tiles[numTiles - 1 - tileIndex];
+		const TerrainScatterTile& jobTile = jobTiles[numTiles - 1 - tileIndex];
+		const size_t numBytes = reference.instances.size() * sizeof(TerrainScatterInstance);
+		const bool isSame = tile.instances.size() == reference.instances.size() && jobTile.instances.size() == reference.instances.size() &&
+			memcmp(tile.instances.data(), reference.instances.data(), numBytes) == 0 && memcmp(jobTile.instances.data(), reference.instances.data(), numBytes) == 0 &&
+			tile.layerOffsets == reference.layerOffsets && jobTile.layerOffsets == reference.layerOffsets;
+
+		numDifferentTiles += isSame ? 0 : 1;
+		numInstances += static_cast<uint32_t>(reference.instances.size());
+	}
+
+	STYX_CHECK(numDifferentTiles == 0);
+
+	// Neither empty nor every point, the masks vary over the rolling ground
+	size_t numPoints = 0;
+	for (uint32_t layer = 0; layer < scatter.GetNumLayers(); layer++)
+	{
+		numPoints += scatter.GetPattern(layer).size() / 2;
+	}
+
+	STYX_CHECK(numInstances > 0 && numInstances < numTiles * numPoints / 2);
+}
+
+STYX_TEST(TerrainScatter_CullingMatchesBruteForce)
+{
+	const TerrainScatter scatter(GetScatterDesc());
+
+	std::vector<TerrainScatterTile> tiles;
+	for (int32_t tileY = -2; tileY <= 2; tileY++)
+	{
+		for (int32_t tileX = -2; tileX <= 2; tileX++)
+		{
+			const std::vector<uint16_t> heights = GenerateRollingHeights(TerrainTileCoord{ tileX, tileY });
+			tiles.emplace_back();
+			scatter.GenerateTile(TerrainTileCoord{ tileX, tileY }, heights.data(), tiles.back());
+		}
+	}
+
+	std::mt19937 random(48);
+	std::uniform_real_distribution<float> horizontal(-2.5f * TILE_WORLD_SIZE, 2.5f * TILE_WORLD_SIZE);
+	std::uniform_real_distribution<float> vertical(0.0f, 60.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+
+	std::vector<TerrainScatterInstance> visible;
+	uint32_t numWrong = 0;
+	uint32_t numVisible = 0;
+	uint32_t numTotal = 0;
+
+	for (uint32_t trial = 0; trial < 40; trial++)
+	{
+		TerrainScatterView view;
+		view.positionX = horizontal(random);
+		view.positionY = vertical(random);
+		view.positionZ = horizontal(random);
+
+		// Every other view without a frustum, only the draw distances then
+		const DirectX::XMFLOAT4X4 viewProjection = GetViewProjection(view.positionX, view.positionY, view.positionZ, angle(random));
+		view.viewProjection = trial % 2 == 0 ? &viewProjection : nullptr;
+
+		for (const TerrainScatterTile& tile : tiles)
+		{
+			for (uint32_t layer = 0; layer < scatter.GetNumLayers(); layer++)
+			{
+				const TerrainScatterLayerDesc& layerDesc = scatter.GetDesc().layers[layer];
+				visible.resize(tile.GetNumInstances(layer));
+				const uint32_t numLayerVisible = scatter.CullInstances(view, tile, layer, visible.data());
+
+				// The visible instances come out in order, so walk both lists together
+				uint32_t visibleIndex = 0;
+				for (uint32_t instanceIndex = 0; instanceIndex < tile.GetNumInstances(layer); instanceIndex++)
+				{
+					const TerrainScatterInstance& instance = tile.GetInstances(layer)[instanceIndex];
+					const bool isCulled = visibleIndex >= numLayerVisible || memcmp(&visible[visibleIndex], &instance, sizeof(instance)) != 0;
+					visibleIndex += isCulled ? 0 : 1;
+
+					const double dx = instance.positionX - view.positionX;
+					const double dy = instance.positionY - view.positionY;
+					const double dz = instance.positionZ - view.positionZ;
+					double margin = layerDesc.drawDistance - sqrt(dx * dx + dy * dy + dz * dz);
+					if (view.viewProjection)
+					{
+						margin = fmin(margin, GetVisibilityMargin(viewProjection, instance, layerDesc.boundsRadius * instance.scale));
+					}
+
+					// Within float precision of a plane either way is right
+					numWrong += (margin > 1e-3 && isCulled) || (margin < -1e-3 && !isCulled) ? 1 : 0;
+					numVisible += isCulled ? 0 : 1;
+					numTotal++;
+				}
+
+				numWrong += visibleIndex == numLayerVisible ? 0 : 1;
+			}
+		}
+	}
+
+	STYX_CHECK(numWrong == 0);
+	// Views see some of the instances, not all of them
+	STYX_CHECK(numVisible > numTotal / 50 && numVisible < numTotal / 2);
+}
+
+STYX_BENCHMARK(TerrainScatter_GenerationAndCulling)
+{
+	const TerrainScatter scatter(GetScatterDesc());
+
+	constexpr int32_t RADIUS = 5;
+	std::vector<std::vector<uint16_t>> heights;
+	for (int32_t tileY = -RADIUS; tileY <= RADIUS; tileY++)
+	{
+		for (int32_t tileX = -RADIUS; tileX <= RADIUS; tileX++)
+		{
+			heights.push_back(GenerateRollingHeights(TerrainTileCoord{ tileX, tileY }));
+		}
+	}
+
+	std::vector<TerrainScatterTile> tiles(heights.size());
+	const double generationTime = MeasureMilliseconds([&]()
+	{
+		size_t tileIndex = 0;
+		for (int32_t tileY = -RADIUS; tileY <= RADIUS; tileY++)
+		{
+			for (int32_t tileX = -RADIUS; tileX <= RADIUS; tileX++, tileIndex++)
+			{
+				scatter.GenerateTile(TerrainTileCoord{ tileX, tileY }, heights[tileIndex].data(), tiles[tileIndex]);
+			}
+		}
+	});
+
+	size_t numInstances = 0;
+	for (const TerrainScatterTile& tile : tiles)
+	{
+		numInstances += tile.instances.size();
+	}
+
+	printf("    %zu tiles, %zu instances: %.3f ms per tile\n", tiles.size(), numInstances, generationTime / tiles.size());
+
+	// A camera sliding over the middle tile, looking around: most tiles are out of view or beyond the draw distance,
+	// the ones on the frustum's edges test every instance
+	constexpr uint32_t NUM_FRAMES = 200;
+	std::vector<TerrainScatterInstance> visible(numInstances);
+	size_t numVisible = 0;
+
+	const double cullTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+		{
+			TerrainScatterView view;
+			view.positionX = static_cast<float>(frame) * 0.5f;
+			view.positionY = 20.0f;
+			view.positionZ = 10.0f;
+			const DirectX::XMFLOAT4X4 viewProjection = GetViewProjection(view.positionX, view.positionY, view.positionZ, static_cast<float>(frame) * 0.03f);
+			view.viewProjection = &viewProjection;
+
+			uint32_t numFrameVisible = 0;
+			for (uint32_t layer = 0; layer < scatter.GetNumLayers(); layer++)
+			{
+				for (const TerrainScatterTile& tile : tiles)
+				{
+					numFrameVisible += scatter.CullInstances(view, tile, layer, visible.data() + numFrameVisible);
+				}
+			}
+
+			numVisible += numFrameVisible;
+		}
+	});
+
+	printf("    culling: %.3f ms per frame, %zu visible on average, %.1f M instances/s considered\n", cullTime / NUM_FRAMES, numVisible / NUM_FRAMES,
+		static_cast<double>(numInstances) * NUM_FRAMES / (cullTime * 1000.0));
+}
@@ -0,0 +1,370 @@
+#include "TestFramework.h"
+
+#include <Core/JobSystem.h>
+#include <Renderer/TerrainSurfaceMaps.h>
+#include <Renderer/TerrainTileStreamer.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	constexpr uint32_t TILE_SIZE = 32;
+	constexpr uint32_t NUM_SAMPLES = TILE_SIZE + 1;
+
+	// Like TerrainRenderer: grass on the gentler ground, rock on the steep slopes, snow on the peaks and sand along the
+	// lowest ground
+	TerrainSurfaceMapsDesc GetTestDesc()
+	{
+		TerrainSurfaceMapsDesc desc;
+		desc.tileSize = TILE_SIZE;
+		desc.tileWorldSize = 50.0f;
+		desc.heightScale = 40.0f;
+		desc.materials[0].maxSlope = 0.6f;
+		desc.materials[1].minSlope = 0.5f;
+		desc.materials[2].minHeight = 0.75f * desc.heightScale;
+		desc.materials[2].heightFade = 0.05f * desc.heightScale;
+		desc.materials[2].maxSlope = 0.8f;
+		desc.materials[3].maxHeight = 0.1f * desc.heightScale;
+		desc.materials[3].heightFade = 0.05f * desc.heightScale;
+		desc.materials[3].maxSlope = 0.3f;
+		return desc;
+	}
+
+	// The numTiles x numTiles tiles from (origin, origin) on, as generated by the streamer, and the whole region they cover
+	struct TestTerrain
+	{
+		TestTerrain(int32_t origin, uint32_t numTiles)
+			: origin(origin)
+			, numTiles(numTiles)
+			, size(numTiles * TILE_SIZE + 1)
+			, heights(static_cast<size_t>(size) * size)
+			, tiles(static_cast<size_t>(numTiles) * numTiles, std::vector<uint16_t>(NUM_SAMPLES * NUM_SAMPLES))
+		{
+			HeightfieldNoiseMaterialConstants constants;
+			constants.frequency = 0.05f;
+
+			for (uint32_t tileIndex = 0; tileIndex < tiles.size(); tileIndex++)
+			{
+				const uint32_t tileX = tileIndex % numTiles;
+				const uint32_t tileY = tileIndex / numTiles;
+				GenerateTerrainTileHeights(GetCoord(tileIndex), constants, TILE_SIZE, tiles[tileIndex].data());
+
+				for (uint32_t sampleY = 0; sampleY < NUM_SAMPLES; sampleY++)
+				{
+					std::copy_n(tiles[tileIndex].data() + sampleY * NUM_SAMPLES, NUM_SAMPLES, heights.data() + static_cast<size_t>(tileY * TILE_SIZE + sampleY) * size + tileX * TILE_SIZE);
+				}
+			}
+		}
+
+		TerrainTileCoord GetCoord(uint32_t tileIndex) const
+		{
+			return TerrainTileCoord{ origin + static_cast<int32_t>(tileIndex % numTiles), origin + static_cast<int32_t>(tileIndex / numTiles) };
+		}
+
+		int32_t origin;
+		uint32_t numTiles;
+		uint32_t size;
+		std::vector<uint16_t> heights;
+		std::vector<std::vector<uint16_t>> tiles;
+	};
+
+	// The unit normal an octahedral RG8_SNORM texel decodes to, like Terrain.hlsl does
+	void DecodeNormal(const int8_t* texel, float* outNormal)
+	{
+		const float x = texel[0] / 127.0f;
+		const float z = texel[1] / 127.0f;
+		const float y = 1.0f - fabsf(x) - fabsf(z);
+		const float length = sqrtf(x * x + y * y + z * z);
+		outNormal[0] = x / length;
+		outNormal[1] = y / length;
+		outNormal[2] = z / length;
+	}
+
+	uint32_t CountDifferences(const TerrainSurfaceMaps& a, const TerrainSurfaceMaps& b, uint32_t numSlots)
+	{
+		uint32_t numDifferences = 0;
+		for (uint32_t slot = 0; slot < numSlots; slot++)
+		{
+			numDifferences += std::equal(a.GetNormals(slot), a.GetNormals(slot) + NUM_SAMPLES * NUM_SAMPLES * 2, b.GetNormals(slot)) ? 0 : 1;
+			numDifferences += std::equal(a.GetMaterialWeights(slot), a.GetMaterialWeights(slot) + NUM_SAMPLES * NUM_SAMPLES * 4, b.GetMaterialWeights(slot)) ? 0 : 1;
+		}
+
+		return numDifferences;
+	}
+}
+
+STYX_TEST(TerrainSurfaceMaps_PlanesGetTheirNormalsAndMaterials)
+{
+	// One height step per texel is a slope of 1 / 1000
+	TerrainSurfaceMapsDesc desc = GetTestDesc();
+	desc.tileWorldSize = static_cast<float>(TILE_SIZE);
+	desc.heightScale = 65535.0f / 1000.0f;
+	desc.materials[2].minHeight = FLT_MAX;
+	desc.materials[3].maxHeight = -FLT_MAX;
+
+	TerrainSurfaceMaps surfaceMaps(desc, 1);
+	std::vector<uint16_t> heights(NUM_SAMPLES * NUM_SAMPLES);
+
+	// Gentle grass along +z, then steep rock down towards +x
+	for (float slope : { 0.1f, -1.0f })
+	{
+		const bool isAlongX = slope < 0.0f;
+		for (uint32_t y = 0; y < NUM_SAMPLES; y++)
+		{
+			for (uint32_t x = 0; x < NUM_SAMPLES; x++)
+			{
+				const float steps = static_cast<float>(isAlongX ? TILE_SIZE - x : y) * fabsf(slope) * 1000.0f;
+				heights[y * NUM_SAMPLES + x] = static_cast<uint16_t>(steps);
+			}
+		}
+
+		surfaceMaps.SetTile(0, TerrainTileCoord{ 0, 0 }, heights.data());
+		STYX_CHECK(surfaceMaps.Update().size() == 1);
+
+		// The normal of the plane, (-dh/dx, 1, -dh/dz) normalized
+		const float length = sqrtf(1.0f + slope * slope);
+		const float expected[3] = { isAlongX ? -slope / length : 0.0f, 1.0f / length, isAlongX ? 0.0f : -slope / length };
+
+		float maxError = 0.0f;
+		uint32_t numWrongWeights = 0;
+		for (uint32_t y = 1; y < TILE_SIZE; y++)
+		{
+			for (uint32_t x = 1; x < TILE_SIZE; x++)
+			{
+				float normal[3];
+				DecodeNormal(surfaceMaps.GetNormals(0) + (y * NUM_SAMPLES + x) * 2, normal);
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					maxError = fmaxf(maxError, fabsf(normal[axis] - expected[axis]));
+				}
+
+				const uint8_t* weights = surfaceMaps.GetMaterialWeights(0) + (y * NUM_SAMPLES + x) * 4;
+				numWrongWeights += weights[isAlongX ? 1 : 0] == 255 && weights[isAlongX ? 0 : 1] == 0 && weights[2] == 0 && weights[3] == 0 ? 0 : 1;
+			}
+		}
+
+		// Within the 8 bit quantization of the encoding
+		STYX_CHECK(maxError < 0.02f);
+		STYX_CHECK(numWrongWeights == 0);
+	}
+}
+
+STYX_TEST(TerrainSurfaceMaps_WeightsSumTo255)
+{
+	const TestTerrain terrain(0, 2);
+	TerrainSurfaceMaps surfaceMaps(GetTestDesc(), 4);
+	for (uint32_t slot = 0; slot < 4; slot++)
+	{
+		surfaceMaps.SetTile(slot, terrain.GetCoord(slot), terrain.tiles[slot].data());
+	}
+	surfaceMaps.Update();
+
+	uint32_t numWrongSums = 0;
+	uint32_t numCovered[4] = {};
+	for (uint32_t slot = 0; slot < 4; slot++)
+	{
+		const uint8_t* weights = surfaceMaps.GetMaterialWeights(slot);
+		for (uint32_t texel = 0; texel < NUM_SAMPLES * NUM_SAMPLES; texel++)
+		{
+			const int32_t sum = weights[4 * texel] + weights[4 * texel + 1] + weights[4 * texel + 2] + weights[4 * texel + 3];
+			numWrongSums += sum >= 253 && sum <= 257 ? 0 : 1;
+			for (uint32_t material = 0; material < 4; material++)
+			{
+				numCovered[material] += weights[4 * texel + material] > 128 ? 1 : 0;
+			}
+		}
+	}
+
+	STYX_CHECK(numWrongSums == 0);
+	// The noise is varied enough for grass and rock to both show up
+	STYX_CHECK(numCovered[0] > 0 && numCovered[1] > 0);
+}
+
+STYX_TEST(TerrainSurfaceMaps_SeamsCloseAsNeighboursStreamIn)
+{
+	const TestTerrain terrain(-1, 3);
+	const TerrainSurfaceMapsDesc desc = GetTestDesc();
+	TerrainSurfaceMaps surfaceMaps(desc, 9);
+
+	// The centre first, then its neighbours one at a time. Each new tile updates itself and the tiles around it.
+	constexpr uint32_t CENTRE = 4;
+	constexpr uint32_t ORDER[9] = { CENTRE, 1, 5, 0, 8, 3, 2, 7, 6 };
+	std::vector<bool> isResident(9, false);
+	uint32_t numWrongUpdates = 0;
+	for (uint32_t slot : ORDER)
+	{
+		surfaceMaps.SetTile(slot, terrain.GetCoord(slot), terrain.tiles[slot].data());
+		isResident[slot] = true;
+
+		std::vector<uint32_t> expected;
+		for (uint32_t other = 0; other < 9; other++)
+		{
+			const int32_t distanceX = abs(static_cast<int32_t>(other % 3) - static_cast<int32_t>(slot % 3));
+			const int32_t distanceY = abs(static_cast<int32_t>(other / 3) - static_cast<int32_t>(slot / 3));
+			if (isResident[other] && distanceX <= 1 && distanceY <= 1)
+			{
+				expected.push_back(other);
+			}
+		}
+
+		std::vector<uint32_t> updated = surfaceMaps.Update();
+		std::sort(updated.begin(), updated.end());
+		numWrongUpdates += updated == expected ? 0 : 1;
+	}
+	STYX_CHECK(numWrongUpdates == 0);
+
+	// With all its neighbours in, the centre matches the maps of the whole region
+	std::vector<float> region(static_cast<size_t>(NUM_SAMPLES + 2) * (NUM_SAMPLES + 2));
+	for (uint32_t y = 0; y < NUM_SAMPLES + 2; y++)
+	{
+		for (uint32_t x = 0; x < NUM_SAMPLES + 2; x++)
+		{
+			region[y * (NUM_SAMPLES + 2) + x] = terrain.heights[static_cast<size_t>(TILE_SIZE - 1 + y) * terrain.size + TILE_SIZE - 1 + x];
+		}
+	}
+
+	std::vector<int8_t> normals(NUM_SAMPLES * NUM_SAMPLES * 2);
+	std::vector<uint8_t> weights(NUM_SAMPLES * NUM_SAMPLES * 4);
+	const float normalScale = desc.heightScale / (65535.0f * 2.0f * (desc.tileWorldSize / TILE_SIZE));
+	TerrainSurfaceMaps::ComputeNormals(region.data(), NUM_SAMPLES + 2, NUM_SAMPLES, NUM_SAMPLES, normalScale, normals.data(), NUM_SAMPLES);
+	surfaceMaps.ComputeMaterialWeights(region.data(), NUM_SAMPLES + 2, NUM_SAMPLES, NUM_SAMPLES, weights.data(), NUM_SAMPLES);
+
+	STYX_CHECK(std::equal(normals.begin(), normals.end(), surfaceMaps.GetNormals(CENTRE)));
+	STYX_CHECK(std::equal(weights.begin(), weights.end(), surfaceMaps.GetMaterialWeights(CENTRE)));
+
+	// And neighbours agree on every texel of the edges they share
+	uint32_t numEdgeDifferences = 0;
+	for (uint32_t slot = 0; slot < 9; slot++)
+	{
+		const int8_t* tileNormals = surfaceMaps.GetNormals(slot);
+		const uint8_t* tileWeights = surfaceMaps.GetMaterialWeights(slot);
+		for (uint32_t i = 0; i < NUM_SAMPLES; i++)
+		{
+			const uint32_t neighbours[2] = { slot % 3 < 2 ? slot + 1 : ~0u, slot / 3 < 2 ? slot + 3 : ~0u };
+			for (uint32_t side = 0; side < 2; side++)
+			{
+				if (neighbours[side] == ~0u)
+				{
+					continue;
+				}
+
+				// The right column against the neighbour's left one, or the bottom row against the neighbour's top one
+				const uint32_t texel = side == 0 ? i * NUM_SAMPLES + TILE_SIZE : TILE_SIZE * NUM_SAMPLES + i;
+				const uint32_t neighbourTexel = side == 0 ? i * NUM_SAMPLES : i;
+				numEdgeDifferences += std::equal(tileNormals + 2 * texel, tileNormals + 2 * texel + 2, surfaceMaps.GetNormals(neighbours[side]) + 2 * neighbourTexel) ? 0 : 1;
+				numEdgeDifferences += std::equal(tileWeights + 4 * texel, tileWeights + 4 * texel + 4, surfaceMaps.GetMaterialWeights(neighbours[side]) + 4 * neighbourTexel) ? 0 : 1;
+			}
+		}
+	}
+	STYX_CHECK(numEdgeDifferences == 0);
+}
+
+STYX_TEST(TerrainSurfaceMaps_SameMapsOnTheJobSystem)
+{
+	const TestTerrain terrain(-2, 4);
+	const uint32_t numSlots = static_cast<uint32_t>(terrain.tiles.size());
+
+	TerrainSurfaceMaps serialMaps(GetTestDesc(), numSlots);
+	TerrainSurfaceMaps jobMaps(GetTestDesc(), numSlots);
+	for (uint32_t slot = 0; slot < numSlots; slot++)
+	{
+		serialMaps.SetTile(slot, terrain.GetCoord(slot), terrain.tiles[slot].data());
+		jobMaps.SetTile(slot, terrain.GetCoord(slot), terrain.tiles[slot].data());
+	}
+	serialMaps.Update();
+
+	JobSystemDesc jobSystemDesc;
+	jobSystemDesc.numWorkers = 3;
+	JobSystem::Initialize(jobSystemDesc);
+
+	JobCounter counter;
+	JobSystem::Run(counter, [&jobMaps]() { jobMaps.Update(); });
+	JobSystem::Wait(counter);
+	JobSystem::Shutdown();
+
+	STYX_CHECK(jobMaps.GetStats().numTilesUpdated == numSlots);
+	STYX_CHECK(CountDifferences(serialMaps, jobMaps, numSlots) == 0);
+}
+
+// The renderer updates the maps on the render thread, which registers with the job system
+STYX_TEST(TerrainSurfaceMaps_SameMapsFromARegisteredThread)
+{
+	const TestTerrain terrain(-2, 4);
+	const uint32_t numSlots = static_cast<uint32_t>(terrain.tiles.size());
+
+	TerrainSurfaceMaps serialMaps(GetTestDesc(), numSlots);
+	TerrainSurfaceMaps renderThreadMaps(GetTestDesc(), numSlots);
+	for (uint32_t slot = 0; slot < numSlots; slot++)
+	{
+		serialMaps.SetTile(slot, terrain.GetCoord(slot), terrain.tiles[slot].data());
+		renderThreadMaps.SetTile(slot, terrain.GetCoord(slot), terrain.tiles[slot].data());
+	}
+	serialMaps.Update();
+
+	JobSystemDesc jobSystemDesc;
+	jobSystemDesc.numWorkers = 3;
+	jobSystemDesc.numExternalThreads = 1;
+	JobSystem::Initialize(jobSystemDesc);
+
+	bool isRegistered = false;
+	std::thread renderThread([&]()
+	{
+		isRegistered = JobSystem::RegisterThread();
+		renderThreadMaps.Update();
+
+		if (isRegistered)
+		{
+			JobSystem::UnregisterThread();
+		}
+	});
+
+	renderThread.join();
+	JobSystem::Shutdown();
+
+	STYX_CHECK(isRegistered);
+	STYX_CHECK(renderThreadMaps.GetStats().numTilesUpdated == numSlots);
+	STYX_CHECK(CountDifferences(serialMaps, renderThreadMaps, numSlots) == 0);
+}
+
+STYX_BENCHMARK(TerrainSurfaceMaps_MegapixelsPerSecond)
+{
+	// The view of the renderer's streamer: 7x7 tiles
+	const TestTerrain terrain(-3, 7);
+	const uint32_t numSlots = static_cast<uint32_t>(terrain.tiles.size());
+
+	TerrainSurfaceMaps surfaceMaps(GetTestDesc(), numSlots);
+	const auto setAllTiles = [&]()
+	{
+		for (uint32_t slot = 0; slot < numSlots; slot++)
+		{
+			surfaceMaps.SetTile(slot, terrain.GetCoord(slot), terrain.tiles[slot].data());
+		}
+	};
+
+	setAllTiles();
+	surfaceMaps.Update();
+	printf("    %u tiles of %u, one thread: %.1f MP/s\n", numSlots, TILE_SIZE, surfaceMaps.GetStats().GetMegapixelsPerSecond());
+
+	JobSystem::Initialize();
+	setAllTiles();
+	JobCounter counter;
+	JobSystem::Run(counter, [&surfaceMaps]() { surfaceMaps.Update(); });
+	JobSystem::Wait(counter);
+	printf("    %u tiles of %u, %u threads: %.1f MP/s\n", numSlots, TILE_SIZE, JobSystem::GetNumThreads(), surfaceMaps.GetStats().GetMegapixelsPerSecond());
+	JobSystem::Shutdown();
+
+	// What a frame pays when one tile streams in among resident neighbours: the tile and eight edges
+	const uint32_t centre = numSlots / 2;
+	surfaceMaps.SetTile(centre, terrain.GetCoord(centre), terrain.tiles[centre].data());
+	surfaceMaps.Update();
+	const TerrainSurfaceMapsStats& stats = surfaceMaps.GetStats();
+	printf("    One new tile: %u tiles, %u texels updated in %.3f ms\n", stats.numTilesUpdated, stats.numTexelsUpdated, stats.updateTimeInMilliseconds);
+}
@@ -0,0 +1,400 @@
+#include "TestFramework.h"
+
+#include <Core/JobSystem.h>
+#include <Renderer/TerrainTileStreamer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	// Writes which tile and which seed the heights were generated for, and counts the generations of every tile
+	struct CountingGenerator
+	{
+		void Generate(const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights)
+		{
+			const uint32_t numHeights = (tileSize + 1) * (tileSize + 1);
+			for (uint32_t heightIndex = 0; heightIndex < numHeights; heightIndex++)
+			{
+				heights[heightIndex] = static_cast<uint16_t>(constants.seed);
+			}
+
+			heights[0] = static_cast<uint16_t>(coord.x);
+			heights[1] = static_cast<uint16_t>(coord.y);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			numGenerations[coord]++;
+		}
+
+		uint32_t GetNumGenerations(const TerrainTileCoord& coord)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = numGenerations.find(coord);
+			return it != numGenerations.end() ? it->second : 0;
+		}
+
+		void Reset()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			numGenerations.clear();
+		}
+
+		std::mutex mutex;
+		std::unordered_map<TerrainTileCoord, uint32_t, TerrainTileCoordHash> numGenerations;
+	};
+
+	// What the texture of each slot holds, uploads land right away
+	struct SlotContents
+	{
+		uint16_t x = 0;
+		uint16_t y = 0;
+		uint16_t seed = 0;
+	};
+
+	class StreamerHarness
+	{
+	public:
+		StreamerHarness(const TerrainTileStreamerDesc& desc)
+			: m_Streamer(desc, [this](const TerrainTileCoord& coord, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights)
+			{
+				m_Generator.Generate(coord, constants, tileSize, heights);
+			})
+			, m_Slots(desc.cacheCapacity)
+		{
+		}
+
+		// Returns the number of visible tiles drawn from a slot that doesn't hold them
+		uint32_t Update(const TerrainTileView& view)
+		{
+			m_Streamer.Update(view, m_FrameIndex++);
+
+			for (const TerrainTileUpload& upload : m_Streamer.GetUploads())
+			{
+				m_Slots[upload.slot] = SlotContents{ upload.heights[0], upload.heights[1], upload.heights[2] };
+			}
+
+			uint32_t numWrongTiles = 0;
+			for (const TerrainTileDraw& draw : m_Streamer.GetVisibleTiles())
+			{
+				const SlotContents& contents = m_Slots[draw.slot];
+				numWrongTiles += contents.x != static_cast<uint16_t>(draw.coord.x) || contents.y != static_cast<uint16_t>(draw.coord.y) ? 1 : 0;
+			}
+
+			return numWrongTiles;
+		}
+
+		// Runs frames until every tile in view is uploaded and nothing is left to generate. Returns the number of frames
+		// where a tile in view wasn't drawn although it had been before, or was drawn from the wrong slot.
+		uint32_t Settle(const TerrainTileView& view, uint32_t* numFrames = nullptr)
+		{
+			uint32_t numBadFrames = 0;
+			uint32_t numVisibleTiles = 0;
+			uint32_t numQuietFrames = 0;
+			uint32_t frame = 0;
+
+			for (; frame < 1000; frame++)
+			{
+				const uint32_t numWrongTiles = Update(view);
+				m_Streamer.WaitForIdle();
+
+				const TerrainTileStreamerStats& stats = m_Streamer.GetStats();
+				numBadFrames += numWrongTiles > 0 || stats.numVisibleTiles < numVisibleTiles ? 1 : 0;
+				numVisibleTiles = stats.numVisibleTiles;
+
+				// The last uploads are drawn once they had time to land
+				const bool isQuiet = stats.numUploads == 0 && stats.numPendingTiles == 0 && stats.numReadyTiles == 0 && stats.numTilesRequested == 0;
+				numQuietFrames = isQuiet ? numQuietFrames + 1 : 0;
+				if (numQuietFrames > m_Streamer.GetDesc().minFramesBeforeReuse)
+				{
+					break;
+				}
+			}
+
+			if (numFrames)
+			{
+				*numFrames = frame;
+			}
+
+			return numBadFrames;
+		}
+
+		TerrainTileStreamer& GetStreamer() { return m_Streamer; }
+		CountingGenerator& GetGenerator() { return m_Generator; }
+		const SlotContents& GetSlot(uint32_t slot) const { return m_Slots[slot]; }
+
+	private:
+		CountingGenerator m_Generator;
+		TerrainTileStreamer m_Streamer;
+		std::vector<SlotContents> m_Slots;
+		uint64_t m_FrameIndex = 0;
+	};
+
+	TerrainTileStreamerDesc GetTestDesc()
+	{
+		TerrainTileStreamerDesc desc;
+		desc.tileSize = 8;
+		desc.tileWorldSize = 10.0f;
+		desc.viewRadius = 3;
+		return desc;
+	}
+
+	// Centre of tile (0, 0), so the view covers tiles -3 to 3 on both axes
+	constexpr TerrainTileView CENTRE_VIEW{ 5.0f, 5.0f, 0.0f, 1.0f };
+	constexpr uint32_t NUM_TILES_IN_VIEW = 49;
+}
+
+STYX_TEST(TerrainTileStreamer_FillsTheViewOnce)
+{
+	StreamerHarness harness(GetTestDesc());
+
+	STYX_CHECK(harness.Settle(CENTRE_VIEW) == 0);
+	STYX_CHECK(harness.GetStreamer().GetStats().numVisibleTiles == NUM_TILES_IN_VIEW);
+	STYX_CHECK(harness.GetStreamer().GetStats().numTilesGenerated == NUM_TILES_IN_VIEW);
+
+	for (int32_t tileY = -3; tileY <= 3; tileY++)
+	{
+		for (int32_t tileX = -3; tileX <= 3; tileX++)
+		{
+			STYX_CHECK(harness.GetGenerator().GetNumGenerations(TerrainTileCoord{ tileX, tileY }) == 1);
+		}
+	}
+
+	// A still camera costs no generation at all
+	for (uint32_t frame = 0; frame < 10; frame++)
+	{
+		harness.Update(CENTRE_VIEW);
+		STYX_CHECK(harness.GetStreamer().GetStats().numTilesRequested == 0 && harness.GetStreamer().GetStats().numUploads == 0);
+	}
+
+	STYX_CHECK(harness.GetStreamer().GetStats().numTilesGenerated == NUM_TILES_IN_VIEW);
+}
+
+// The dirty region regeneration DirtyRegionTracker used to do, at tile granularity
+STYX_TEST(TerrainTileStreamer_MarkDirtyRegeneratesOnlyTheOverlappingTiles)
+{
+	StreamerHarness harness(GetTestDesc());
+	STYX_REQUIRE(harness.Settle(CENTRE_VIEW) == 0);
+
+	struct DirtyCase
+	{
+		int32_t x;
+		int32_t y;
+		uint32_t width;
+		uint32_t height;
+		std::vector<TerrainTileCoord> expectedTiles;
+	};
+
+	// Tiles are 8 quads wide, texel 8 is the edge between tiles 0 and 1 and belongs to both
+	const DirtyCase dirtyCases[] =
+	{
+		{ 2, 3, 4, 4, { { 0, 0 } } },
+		{ 8, 3, 1, 1, { { 0, 0 }, { 1, 0 } } },
+		{ 8, 8, 1, 1, { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } } },
+		{ -7, -7, 6, 6, { { -1, -1 } } },
+		{ 9, 1, 15, 6, { { 1, 0 }, { 2, 0 } } },
+		{ 3, 3, 0, 5, {} },
+	};
+
+	for (const DirtyCase& dirtyCase : dirtyCases)
+	{
+		harness.GetGenerator().Reset();
+		harness.GetStreamer().MarkDirty(dirtyCase.x, dirtyCase.y, dirtyCase.width, dirtyCase.height);
+
+		// The previous version of a dirty tile is drawn until the new one landed, so nothing ever goes missing
+		STYX_CHECK(harness.Settle(CENTRE_VIEW) == 0);
+		STYX_CHECK(harness.GetStreamer().GetStats().numVisibleTiles == NUM_TILES_IN_VIEW);
+
+		uint32_t numGenerations = 0;
+		for (const auto& [coord, tileGenerations] : harness.GetGenerator().numGenerations)
+		{
+			numGenerations += tileGenerations;
+		}
+
+		STYX_CHECK(numGenerations == dirtyCase.expectedTiles.size());
+		for (const TerrainTileCoord& coord : dirtyCase.expectedTiles)
+		{
+			STYX_CHECK(harness.GetGenerator().GetNumGenerations(coord) == 1);
+		}
+	}
+}
+
+STYX_TEST(TerrainTileStreamer_NewConstantsRegenerateEveryTile)
+{
+	StreamerHarness harness(GetTestDesc());
+
+	HeightfieldNoiseMaterialConstants constants;
+	harness.GetStreamer().SetNoiseConstants(constants);
+	STYX_REQUIRE(harness.Settle(CENTRE_VIEW) == 0);
+
+	// The same constants again don't outdate anything
+	harness.GetGenerator().Reset();
+	harness.GetStreamer().SetNoiseConstants(constants);
+	STYX_CHECK(harness.Settle(CENTRE_VIEW) == 0);
+	STYX_CHECK(harness.GetGenerator().numGenerations.empty());
+
+	// Different ones outdate every tile, dirty or not, and every tile keeps being drawn while it's regenerated
+	harness.GetStreamer().MarkDirty(0, 0, 4, 4);
+	constants.seed = 7;
+	harness.GetStreamer().SetNoiseConstants(constants);
+	STYX_CHECK(harness.Settle(CENTRE_VIEW) == 0);
+	STYX_CHECK(harness.GetStreamer().GetStats().numVisibleTiles == NUM_TILES_IN_VIEW);
+
+	for (const TerrainTileDraw& draw : harness.GetStreamer().GetVisibleTiles())
+	{
+		STYX_CHECK(harness.GetGenerator().GetNumGenerations(draw.coord) == 1);
+		STYX_CHECK(harness.GetSlot(draw.slot).seed == 7);
+	}
+}
+
+// The generators run on registered threads, so the loops in them, e.g. the noise rows, are stolen by the workers
+STYX_TEST(TerrainTileStreamer_GeneratorThreadsTakePartInTheJobSystem)
+{
+	TerrainTileStreamerDesc desc = GetTestDesc();
+	desc.viewRadius = 1;
+
+	JobSystemDesc jobSystemDesc;
+	jobSystemDesc.numWorkers = 2;
+	jobSystemDesc.numExternalThreads = desc.numGeneratorThreads;
+	JobSystem::Initialize(jobSystemDesc);
+
+	std::atomic<uint32_t> numGenerations = 0;
+	std::atomic<uint32_t> numGenerationsOffJobThreads = 0;
+	std::atomic<uint32_t> numRangesElsewhere = 0;
+
+	{
+		TerrainTileStreamer streamer(desc, [&](const TerrainTileCoord&, const HeightfieldNoiseMaterialConstants& constants, uint32_t tileSize, uint16_t* heights)
+		{
+			numGenerations.fetch_add(1, std::memory_order_relaxed);
+			numGenerationsOffJobThreads.fetch_add(JobSystem::GetThreadIndex() == JobSystem::INVALID_THREAD_INDEX ? 1 : 0, std::memory_order_relaxed);
+
+			const std::thread::id generatorThreadId = std::this_thread::get_id();
+			const uint32_t numSamples = tileSize + 1;
+			JobSystem::ParallelFor(numSamples, 1, [&](uint32_t beginRow, uint32_t endRow)
+			{
+				if (std::this_thread::get_id() != generatorThreadId)
+				{
+					numRangesElsewhere.fetch_add(1, std::memory_order_relaxed);
+				}
+
+				// Gives the workers time to steal the ranges pushed meanwhile
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+				std::fill(heights + beginRow * numSamples, heights + endRow * numSamples, static_cast<uint16_t>(constants.seed));
+			});
+		});
+
+		for (uint64_t frameIndex = 0; frameIndex < 4; frameIndex++)
+		{
+			streamer.Update(CENTRE_VIEW, frameIndex);
+			streamer.WaitForIdle();
+		}
+	}
+
+	JobSystem::Shutdown();
+
+	STYX_CHECK(numGenerations.load() == 9);
+	STYX_CHECK(numGenerationsOffJobThreads.load() == 0);
+	STYX_CHECK(numRangesElsewhere.load() > 0);
+}
+
+STYX_TEST(TerrainTileCache_EvictsTheLeastRecentlyUsedTileOnceTheGpuIsDone)
+{
+	TerrainTileCache cache(2, 2);
+
+	const uint32_t slotA = cache.Insert(TerrainTileCoord{ 0, 0 }, 0);
+	const uint32_t slotB = cache.Insert(TerrainTileCoord{ 1, 0 }, 0);
+	STYX_REQUIRE(slotA != TerrainTileCache::INVALID_SLOT && slotB != TerrainTileCache::INVALID_SLOT && slotA != slotB);
+
+	// Both slots may still be read by the frames in flight
+	STYX_CHECK(cache.Lookup(TerrainTileCoord{ 1, 0 }, 1) == slotB);
+	STYX_CHECK(cache.Insert(TerrainTileCoord{ 2, 0 }, 1) == TerrainTileCache::INVALID_SLOT);
+	STYX_CHECK(cache.GetStats().numRejectedInserts == 1);
+
+	// Two frames later tile (0, 0) is the least recently used one and its slot is free to go
+	STYX_CHECK(cache.Insert(TerrainTileCoord{ 2, 0 }, 2) == slotA);
+	STYX_CHECK(cache.Find(TerrainTileCoord{ 0, 0 }) == TerrainTileCache::INVALID_SLOT);
+	STYX_CHECK(cache.Find(TerrainTileCoord{ 1, 0 }) == slotB);
+	STYX_CHECK(cache.GetStats().numEvictions == 1);
+
+	// A new version of a tile drawn this frame moves to another slot once one is old enough
+	STYX_CHECK(cache.Lookup(TerrainTileCoord{ 1, 0 }, 3) == slotB);
+	STYX_CHECK(cache.Insert(TerrainTileCoord{ 1, 0 }, 3) == TerrainTileCache::INVALID_SLOT);
+	STYX_CHECK(cache.Insert(TerrainTileCoord{ 1, 0 }, 4) == slotA);
+	STYX_CHECK(cache.Find(TerrainTileCoord{ 1, 0 }) == slotA);
+	STYX_CHECK(cache.Find(TerrainTileCoord{ 2, 0 }) == TerrainTileCache::INVALID_SLOT);
+	STYX_CHECK(cache.GetNumTiles() == 1);
+
+	STYX_CHECK(cache.Lookup(TerrainTileCoord{ 5, 5 }, 4) == TerrainTileCache::INVALID_SLOT);
+	STYX_CHECK(cache.GetStats().numMisses == 1 && cache.GetStats().numHits == 2);
+}
+
+// Real noise tiles along a camera path, then a brush stroke and a constants edit on a still camera
+STYX_BENCHMARK(TerrainTileStreamer_FlyThroughAndEdits)
+{
+	constexpr uint32_t NUM_FRAMES = 2000;
+
+	TerrainTileStreamerDesc desc;
+	TerrainTileStreamer streamer(desc);
+
+	TerrainTileView view;
+	view.forwardX = 0.6f;
+	view.forwardZ = 0.8f;
+
+	double updateTime = 0.0;
+	uint64_t frameIndex = 0;
+	const double flyTime = MeasureMilliseconds([&]()
+	{
+		for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+		{
+			view.positionX += 6.0f * view.forwardX;
+			view.positionZ += 6.0f * view.forwardZ;
+			updateTime += MeasureMilliseconds([&]() { streamer.Update(view, frameIndex++); });
+		}
+	});
+
+	const TerrainTileStreamerStats stats = streamer.GetStats();
+	printf("    fly-through: %.3f ms per Update, %.1f%% hit rate, %.2f ms latency (max %.2f), %.3f ms per tile, %llu tiles in %.0f ms\n",
+		updateTime / NUM_FRAMES, 100.0 * stats.cacheStats.GetHitRate(), stats.averageGenerationLatencyInMilliseconds, stats.maxGenerationLatencyInMilliseconds,
+		stats.averageGenerationTimeInMilliseconds, static_cast<unsigned long long>(stats.numTilesGenerated), flyTime);
+
+	auto measureEdit = [&](const char* label, auto&& edit)
+	{
+		for (uint32_t frame = 0; frame < 200 && (frame < 2 || streamer.GetStats().numPendingTiles + streamer.GetStats().numReadyTiles > 0); frame++)
+		{
+			streamer.Update(view, frameIndex++);
+			streamer.WaitForIdle();
+		}
+
+		const uint64_t numTilesBefore = streamer.GetStats().numTilesGenerated;
+		uint32_t numFrames = 0;
+		const double editTime = MeasureMilliseconds([&]()
+		{
+			edit();
+			do
+			{
+				streamer.Update(view, frameIndex++);
+				streamer.WaitForIdle();
+				numFrames++;
+			}
+			while (numFrames < 500 && (numFrames < 2 || streamer.GetStats().numPendingTiles + streamer.GetStats().numReadyTiles + streamer.GetStats().numUploads > 0));
+		});
+
+		printf("    %-16s %llu tiles regenerated in %u frames, %.2f ms\n", label, static_cast<unsigned long long>(streamer.GetStats().numTilesGenerated - numTilesBefore),
+			numFrames, editTime);
+	};
+
+	const int32_t texelX = static_cast<int32_t>(view.positionX / desc.tileWorldSize * desc.tileSize);
+	const int32_t texelY = static_cast<int32_t>(view.positionZ / desc.tileWorldSize * desc.tileSize);
+
+	measureEdit("32x32 brush", [&]() { streamer.MarkDirty(texelX, texelY, 32, 32); });
+
+	HeightfieldNoiseMaterialConstants constants;
+	constants.seed = 1234;
+	measureEdit("new constants", [&]() { streamer.SetNoiseConstants(constants); });
+}
@@ -0,0 +1,213 @@
+#include "TestFramework.h"
+
+#include <Renderer/TerrainTileStreamer.h>
+#include <Renderer/TerrainTileVersions.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace Styx::Tests;
+using namespace Styx;
+
+namespace
+{
+	constexpr uint32_t TILE_SIZE = 8;
+
+	// Tiles of the [-4, 4)^2 area the tests work in
+	std::vector<TerrainTileCoord> GetTestTiles()
+	{
+		std::vector<TerrainTileCoord> tiles;
+		for (int32_t tileY = -4; tileY < 4; tileY++)
+		{
+			for (int32_t tileX = -4; tileX < 4; tileX++)
+			{
+				tiles.push_back(TerrainTileCoord{ tileX, tileY });
+			}
+		}
+
+		return tiles;
+	}
+
+	// Whether [x, x + width) overlaps the texels [tile * TILE_SIZE, (tile + 1) * TILE_SIZE] of a tile
+	bool Overlaps(int32_t tile, int32_t x, uint32_t width)
+	{
+		const int32_t tileStart = tile * static_cast<int32_t>(TILE_SIZE);
+		return width > 0 && x <= tileStart + static_cast<int32_t>(TILE_SIZE) && x + static_cast<int32_t>(width) - 1 >= tileStart;
+	}
+}
+
+STYX_TEST(TerrainTileVersions_DirtyRegionsOutdateOnlyTheOverlappingTiles)
+{
+	struct DirtyCase
+	{
+		int32_t x;
+		int32_t y;
+		uint32_t width;
+		uint32_t height;
+		std::vector<TerrainTileCoord> expectedTiles;
+	};
+
+	// Texel 8 is the edge between tiles 0 and 1 and belongs to both
+	const DirtyCase dirtyCases[] =
+	{
+		{ 2, 3, 4, 4, { { 0, 0 } } },
+		{ 8, 3, 1, 1, { { 0, 0 }, { 1, 0 } } },
+		{ 8, 8, 1, 1, { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } } },
+		{ -7, -7, 6, 6, { { -1, -1 } } },
+		{ 9, 1, 15, 6, { { 1, 0 }, { 2, 0 } } },
+		{ 3, 3, 0, 5, {} },
+	};
+
+	for (const DirtyCase& dirtyCase : dirtyCases)
+	{
+		TerrainTileVersions versions(TILE_SIZE);
+		const uint32_t generatedVersion = versions.GetVersion();
+
+		STYX_CHECK(versions.MarkDirty(dirtyCase.x, dirtyCase.y, dirtyCase.width, dirtyCase.height) == dirtyCase.expectedTiles.size());
+		STYX_CHECK(versions.GetNumDirtyTiles() == dirtyCase.expectedTiles.size());
+
+		for (const TerrainTileCoord& coord : GetTestTiles())
+		{
+			const bool isExpected = std::find(dirtyCase.expectedTiles.begin(), dirtyCase.expectedTiles.end(), coord) != dirtyCase.expectedTiles.end();
+			STYX_CHECK(versions.IsOutdated(coord, generatedVersion) == isExpected);
+
+			// A tile generated after the change is up to date again
+			STYX_CHECK(!versions.IsOutdated(coord, versions.GetVersion()));
+		}
+	}
+}
+
+STYX_TEST(TerrainTileVersions_NothingIsOutdatedWithoutChanges)
+{
+	TerrainTileVersions versions(TILE_SIZE);
+	const uint32_t generatedVersion = versions.GetVersion();
+
+	for (const TerrainTileCoord& coord : GetTestTiles())
+	{
+		STYX_CHECK(!versions.IsOutdated(coord, generatedVersion));
+	}
+
+	STYX_CHECK(versions.GetVersion() == generatedVersion);
+	STYX_CHECK(versions.GetNumDirtyTiles() == 0);
+}
+
+STYX_TEST(TerrainTileVersions_MarkAllDirtyOutdatesEveryTile)
+{
+	TerrainTileVersions versions(TILE_SIZE);
+	const uint32_t firstVersion = versions.GetVersion();
+
+	versions.MarkDirty(2, 2, 4, 4);
+	const uint32_t dirtyVersion = versions.GetVersion();
+
+	versions.MarkAllDirty();
+	STYX_CHECK(versions.GetNumDirtyTiles() == 0);
+
+	for (const TerrainTileCoord& coord : GetTestTiles())
+	{
+		STYX_CHECK(versions.IsOutdated(coord, firstVersion));
+		STYX_CHECK(versions.IsOutdated(coord, dirtyVersion));
+		STYX_CHECK(!versions.IsOutdated(coord, versions.GetVersion()));
+	}
+
+	// Dirty regions after it only outdate their tiles again
+	const uint32_t allDirtyVersion = versions.GetVersion();
+	versions.MarkDirty(2, 2, 4, 4);
+	STYX_CHECK(versions.IsOutdated(TerrainTileCoord{ 0, 0 }, allDirtyVersion));
+	STYX_CHECK(!versions.IsOutdated(TerrainTileCoord{ 1, 1 }, allDirtyVersion));
+}
+
+// Random edits and tiles generated at random versions, against the latest change overlapping each tile
+STYX_TEST(TerrainTileVersions_MatchesTheLatestOverlappingChange)
+{
+	std::mt19937 random(41);
+	TerrainTileVersions versions(TILE_SIZE);
+
+	const std::vector<TerrainTileCoord> tiles = GetTestTiles();
+	std::vector<uint32_t> latestChanges(tiles.size(), 1);
+	uint32_t numMismatches = 0;
+
+	for (uint32_t step = 0; step < 5000; step++)
+	{
+		if (random() % 50 == 0)
+		{
+			versions.MarkAllDirty();
+			std::fill(latestChanges.begin(), latestChanges.end(), versions.GetVersion());
+		}
+		else
+		{
+			const int32_t x = static_cast<int32_t>(random() % 80) - 40;
+			const int32_t y = static_cast<int32_t>(random() % 80) - 40;
+			const uint32_t width = random() % 20;
+			const uint32_t height = random() % 20;
+			versions.MarkDirty(x, y, width, height);
+
+			for (uint32_t tileIndex = 0; tileIndex < tiles.size(); tileIndex++)
+			{
+				if (Overlaps(tiles[tileIndex].x, x, width) && Overlaps(tiles[tileIndex].y, y, height))
+				{
+					latestChanges[tileIndex] = versions.GetVersion();
+				}
+			}
+		}
+
+		for (uint32_t tileIndex = 0; tileIndex < tiles.size(); tileIndex++)
+		{
+			const uint32_t generatedVersion = 1 + random() % versions.GetVersion();
+			numMismatches += versions.IsOutdated(tiles[tileIndex], generatedVersion) != (generatedVersion < latestChanges[tileIndex]) ? 1 : 0;
+		}
+	}
+
+	STYX_CHECK(numMismatches == 0);
+}
+
+// Per-frame streaming work on a still camera: idle frames, a brush dragged over the terrain and new noise constants
+STYX_BENCHMARK(TerrainTileVersions_IdleAndEditingFrames)
+{
+	constexpr uint32_t NUM_FRAMES = 300;
+
+	TerrainTileStreamerDesc desc;
+	TerrainTileStreamer streamer(desc);
+
+	TerrainTileView view;
+	uint64_t frameIndex = 0;
+	for (uint32_t frame = 0; frame < 200 && (frame < 2 || streamer.GetStats().numPendingTiles + streamer.GetStats().numReadyTiles > 0); frame++)
+	{
+		streamer.Update(view, frameIndex++);
+		streamer.WaitForIdle();
+	}
+
+	auto measureFrames = [&](const char* label, auto&& edit)
+	{
+		const uint64_t numTilesBefore = streamer.GetStats().numTilesGenerated;
+		uint64_t numTilesRequested = 0;
+		double updateTime = 0.0;
+
+		const double frameTime = MeasureMilliseconds([&]()
+		{
+			for (uint32_t frame = 0; frame < NUM_FRAMES; frame++)
+			{
+				edit(frame);
+				updateTime += MeasureMilliseconds([&]() { streamer.Update(view, frameIndex++); });
+				streamer.WaitForIdle();
+				numTilesRequested += streamer.GetStats().numTilesRequested;
+			}
+		});
+
+		const uint64_t numTilesGenerated = streamer.GetStats().numTilesGenerated - numTilesBefore;
+		printf("    %-14s %.3f ms per Update, %.3f ms per frame with generation, %.2f tiles requested and %.2f generated per frame\n", label,
+			updateTime / NUM_FRAMES, frameTime / NUM_FRAMES, static_cast<double>(numTilesRequested) / NUM_FRAMES, static_cast<double>(numTilesGenerated) / NUM_FRAMES);
+	};
+
+	measureFrames("idle", [](uint32_t) {});
+
+	// A 16x16 brush moving a texel per frame, across a few tile edges
+	measureFrames("brush stroke", [&](uint32_t frame) { streamer.MarkDirty(static_cast<int32_t>(frame % 128) - 64, 10, 16, 16); });
+
+	HeightfieldNoiseMaterialConstants constants;
+	measureFrames("new constants", [&](uint32_t frame)
+	{
+		constants.seed = frame + 1;
+		streamer.SetNoiseConstants(constants);
+	});
+}
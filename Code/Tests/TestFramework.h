@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <stdio.h>
+#include <vector>
+
+// NOTE: Just enough of a test framework for the CPU side of the runtime. Tests and benchmarks register themselves
+// from the files that define them, the runner in main.cpp picks them by name. A failed check reports itself and lets
+// the test carry on, STYX_REQUIRE returns from the test instead. Benchmarks print their own figures.
+namespace Styx
+{
+	namespace Tests
+	{
+		enum class TestKind : uint8_t
+		{
+			test,
+			benchmark,
+		};
+
+		using TestFunction = void (*)();
+
+		struct TestCase
+		{
+			const char* name;
+			TestFunction function;
+			TestKind kind;
+		};
+
+		std::vector<TestCase>& GetTestCases();
+		void ReportFailure(const char* file, int line, const char* expression);
+
+		struct TestRegistrar
+		{
+			TestRegistrar(const char* name, TestFunction function, TestKind kind)
+			{
+				GetTestCases().push_back({ name, function, kind });
+			}
+		};
+
+		template<typename F>
+		double MeasureMilliseconds(F&& function)
+		{
+			const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			function();
+			const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+			return std::chrono::duration<double, std::milli>(end - start).count();
+		}
+	}
+}
+
+#define STYX_TEST(name) \
+	static void name(); \
+	static const Styx::Tests::TestRegistrar name##Registrar(#name, &name, Styx::Tests::TestKind::test); \
+	static void name()
+
+#define STYX_BENCHMARK(name) \
+	static void name(); \
+	static const Styx::Tests::TestRegistrar name##Registrar(#name, &name, Styx::Tests::TestKind::benchmark); \
+	static void name()
+
+#define STYX_CHECK(expression) \
+	do \
+	{ \
+		if (!(expression)) \
+		{ \
+			Styx::Tests::ReportFailure(__FILE__, __LINE__, #expression); \
+		} \
+	} while (false)
+
+#define STYX_REQUIRE(expression) \
+	do \
+	{ \
+		if (!(expression)) \
+		{ \
+			Styx::Tests::ReportFailure(__FILE__, __LINE__, #expression); \
+			return; \
+		} \
+	} while (false)
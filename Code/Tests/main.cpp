@@ -0,0 +1,111 @@
+/*
+Copyright(c) 2023 Giuseppe Modarelli
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is furnished
+to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TestFramework.h"
+
+#include <cstring>
+#include <string_view>
+
+namespace
+{
+	uint32_t g_NumFailures = 0;
+
+	bool IsSelected(const Styx::Tests::TestCase& testCase, Styx::Tests::TestKind kind, const std::vector<std::string_view>& filters)
+	{
+		if (testCase.kind != kind)
+		{
+			return false;
+		}
+
+		if (filters.empty())
+		{
+			return true;
+		}
+
+		for (std::string_view filter : filters)
+		{
+			if (std::string_view(testCase.name).find(filter) != std::string_view::npos)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+std::vector<Styx::Tests::TestCase>& Styx::Tests::GetTestCases()
+{
+	static std::vector<TestCase> testCases;
+	return testCases;
+}
+
+void Styx::Tests::ReportFailure(const char* file, int line, const char* expression)
+{
+	printf("    %s(%d): check failed: %s\n", file, line, expression);
+	g_NumFailures++;
+}
+
+// Runs the tests, or the benchmarks with --bench, whose name contains any of the other arguments
+int main(int argc, char** argv)
+{
+	using namespace Styx::Tests;
+
+	TestKind kind = TestKind::test;
+	std::vector<std::string_view> filters;
+
+	for (int argIndex = 1; argIndex < argc; argIndex++)
+	{
+		if (strcmp(argv[argIndex], "--bench") == 0)
+		{
+			kind = TestKind::benchmark;
+		}
+		else
+		{
+			filters.push_back(argv[argIndex]);
+		}
+	}
+
+	uint32_t numRun = 0;
+	uint32_t numFailed = 0;
+
+	for (const TestCase& testCase : GetTestCases())
+	{
+		if (!IsSelected(testCase, kind, filters))
+		{
+			continue;
+		}
+
+		printf("[Tests] %s\n", testCase.name);
+
+		const uint32_t numFailuresBefore = g_NumFailures;
+		const double timeInMilliseconds = MeasureMilliseconds(testCase.function);
+		const bool hasFailed = g_NumFailures != numFailuresBefore;
+
+		printf("[Tests] %s %s (%.1f ms)\n", testCase.name, hasFailed ? "FAILED" : "passed", timeInMilliseconds);
+
+		numRun++;
+		numFailed += hasFailed ? 1 : 0;
+	}
+
+	printf("[Tests] %u run, %u failed\n", numRun, numFailed);
+	return numFailed > 0 ? 1 : 0;
+}